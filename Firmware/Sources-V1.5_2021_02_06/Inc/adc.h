@@ -12,15 +12,30 @@
 #ifndef ADC_H_
 #define ADC_H_
 
+#include "system_conf.h"
+
+typedef struct
+{
+	uint16_t average[MAX_ANALOG_CHANNELS];
+	int16_t currentSense;
+} ADC_Snapshot_t;
+
 void ADC_Init(const uint32_t sysTime);
+void ADC_Restart(const uint32_t sysTime);
 void ADC_Service(const uint32_t sysTime);
 void ADC_Shutdown(void);
 
 uint16_t ADC_GetInstantValue(const uint8_t channel);
 uint16_t ADC_GetAverageValue(const uint8_t channel);
+uint16_t ADC_GetCalibratedAverage(const uint8_t channel);
+void ADC_GetSnapshot(ADC_Snapshot_t * const p_snapshot);
 uint16_t ADC_CalibrateValue(const uint16_t value);
 bool ADC_GetFilterReady(void);
 int16_t ADC_GetCurrentSenseAverage(void);
 void ADC_SetIFilterPeriod(const uint32_t newFilterPeriodMs);
+uint32_t ADC_GetSettleTimeMs(const uint8_t channel);
+uint32_t ADC_GetIFilterSettleTimeMs(void);
+void ADC_StartWindow(const uint8_t channel);
+uint16_t ADC_GetWindowAverage(void);
 
 #endif /* ADC_H_ */
@@ -18,15 +18,39 @@
 #error average filter elements exceed indexer capacity
 #endif
 
+#if ( (AVE_FILTER_MEDIAN_COUNT & 1u) == 0u ) || (AVE_FILTER_MEDIAN_COUNT > 7u)
+#error median filter length must be odd and no more than 7
+#endif
+
+#define AVE_FILTER_TYPE_BOXCAR			0u	/* Moving average, needs element storage */
+#define AVE_FILTER_TYPE_IIR				1u	/* First order, y += (x - y) >> shift */
+#define AVE_FILTER_TYPE_MEDIAN_IIR		2u	/* Median of AVE_FILTER_MEDIAN_COUNT into the IIR */
+
+#define AVE_FILTER_IIR_SHIFT_MAX		8u
+#define AVE_FILTER_U16_IIR_FRAC_BITS	12u
+#define AVE_FILTER_S32_IIR_FRAC_BITS	16u
+
+typedef struct
+{
+	uint16_t filterPeriodMs;
+	uint8_t type;
+	uint8_t iirShift;
+} AVE_FILTER_Config_t;
+
 struct AVE_FILTER_U16_s
 {
 	uint16_t lastVal;
 	uint16_t average;
-	uint16_t elements[AVE_FILTER_ELEMENT_COUNT];
-	uint32_t total;
+	uint16_t * p_elements;
+	uint16_t median[AVE_FILTER_MEDIAN_COUNT];
+	uint32_t total;		/* Boxcar sum of elements, IIR state with AVE_FILTER_U16_IIR_FRAC_BITS */
 	uint16_t filterPeriodMs;
 	uint32_t lastFilterUpdateTime;
 	uint8_t nextValueIdx;
+	uint8_t medianIdx;
+	uint8_t type;
+	uint8_t iirShift;
+	bool seeded;
 };
 
 typedef struct AVE_FILTER_U16_s AVE_FILTER_U16_t;
@@ -35,11 +59,16 @@ struct AVE_FILTER_S32_s
 {
 	int32_t lastVal;
 	int32_t average;
-	int32_t elements[AVE_FILTER_ELEMENT_COUNT];
-	int64_t total;
+	int32_t * p_elements;
+	int32_t median[AVE_FILTER_MEDIAN_COUNT];
+	int64_t total;		/* Boxcar sum of elements, IIR state with AVE_FILTER_S32_IIR_FRAC_BITS */
 	uint16_t filterPeriodMs;
 	uint32_t lastFilterUpdateTime;
 	uint8_t nextValueIdx;
+	uint8_t medianIdx;
+	uint8_t type;
+	uint8_t iirShift;
+	bool seeded;
 };
 
 
@@ -49,11 +78,18 @@ typedef struct AVE_FILTER_S32_s AVE_FILTER_S32_t;
 void AVE_FILTER_U16_Update(AVE_FILTER_U16_t * const p_filter, const uint16_t newValue);
 void AVE_FILTER_U16_UpdatePeriodic(AVE_FILTER_U16_t * const p_filter, const uint16_t newValue, const uint32_t sysTime);
 void AVE_FILTER_U16_Reset(AVE_FILTER_U16_t * const aveFilter);
-void AVE_FILTER_U16_InitPeriodic(AVE_FILTER_U16_t * const aveFilter, const uint32_t sysTime, const uint16_t filterPeriodMs);
+void AVE_FILTER_U16_InitPeriodic(AVE_FILTER_U16_t * const aveFilter, const uint32_t sysTime,
+									const AVE_FILTER_Config_t * const p_config, uint16_t * const p_elements);
+void AVE_FILTER_U16_Seed(AVE_FILTER_U16_t * const p_filter, const uint16_t value, const uint32_t sysTime);
+uint32_t AVE_FILTER_U16_GetScaledTotal(const AVE_FILTER_U16_t * const p_filter);
+uint16_t AVE_FILTER_U16_GetSettleCount(const AVE_FILTER_U16_t * const p_filter);
 
 void AVE_FILTER_S32_Update(AVE_FILTER_S32_t * const p_filter, const int32_t newValue);
 void AVE_FILTER_S32_UpdatePeriodic(AVE_FILTER_S32_t * const p_filter, const int32_t newValue, const uint32_t sysTime);
 void AVE_FILTER_S32_Reset(AVE_FILTER_S32_t * const aveFilter);
-void AVE_FILTER_S32_InitPeriodic(AVE_FILTER_S32_t * const aveFilter, const uint32_t sysTime, const uint16_t filterPeriodMs);
+void AVE_FILTER_S32_InitPeriodic(AVE_FILTER_S32_t * const aveFilter, const uint32_t sysTime,
+									const AVE_FILTER_Config_t * const p_config, int32_t * const p_elements);
+void AVE_FILTER_S32_Seed(AVE_FILTER_S32_t * const p_filter, const int32_t value, const uint32_t sysTime);
+uint16_t AVE_FILTER_S32_GetSettleCount(const AVE_FILTER_S32_t * const p_filter);
 
 #endif /* AVE_FILTER_H_ */
@@ -0,0 +1,32 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file		battery_char.h
+ * @date       	18 October 2026
+ * @brief       Header file for battery_char.c
+ * @note        Please refer to the .c file for a detailed description.
+ *
+ */
+// ----------------------------------------------------------------------------
+
+#ifndef BATTERY_CHAR_H_
+#define BATTERY_CHAR_H_
+
+typedef enum
+{
+	BATCHAR_STATUS_IDLE = 0u,
+	BATCHAR_STATUS_RUNNING,
+	BATCHAR_STATUS_DONE,
+	BATCHAR_STATUS_STOPPED,
+	BATCHAR_STATUS_VSYS_FAULT,
+	BATCHAR_STATUS_BAD_CONFIG
+} BATCHAR_Status_t;
+
+void BATCHAR_Init(void);
+void BATCHAR_Service(const uint32_t sysTime);
+void BATCHAR_Task(void);
+bool BATCHAR_IsRunning(void);
+
+void BATCHAR_SetCommandData(const uint8_t * const p_data, const uint16_t len);
+void BATCHAR_GetRecordData(uint8_t * const p_data, uint16_t * const p_len);
+
+#endif /* BATTERY_CHAR_H_ */
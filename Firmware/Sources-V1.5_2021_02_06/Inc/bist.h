@@ -0,0 +1,41 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file		bist.h
+ * @date       	18 October 2026
+ * @brief       Header file for bist.c
+ * @note        Please refer to the .c file for a detailed description.
+ *
+ */
+// ----------------------------------------------------------------------------
+
+#ifndef BIST_H_
+#define BIST_H_
+
+typedef enum
+{
+	BIST_STEP_FAULTS = 0u,
+	BIST_STEP_BOOST_OFF,
+	BIST_STEP_BOOST_ON,
+	BIST_STEP_CHARGER,
+	BIST_STEP_ISENSE,
+	BIST_STEP_COUNT
+} BIST_Step_t;
+
+typedef enum
+{
+	BIST_STATUS_IDLE = 0u,
+	BIST_STATUS_RUNNING,
+	BIST_STATUS_PASS,
+	BIST_STATUS_FAIL
+} BIST_Status_t;
+
+void BIST_Init(void);
+void BIST_Task(void);
+bool BIST_IsRunning(void);
+
+uint8_t BIST_GetBoardFaults(void);
+
+void BIST_SetCommandData(const uint8_t * const p_data, const uint16_t len);
+void BIST_GetResultData(uint8_t * const p_data, uint16_t * const p_len);
+
+#endif /* BIST_H_ */
@@ -14,38 +14,45 @@
 #define ID_T_POLY_COEFF_VDG_INC 	10u
 #define ID_T_POLY_COEFF_LEN 		(((ID_T_POLY_COEFF_VDG_END - ID_T_POLY_COEFF_VDG_START) / ID_T_POLY_COEFF_VDG_INC) + 1u)
 #define ID_T_POLY_LAST_COEFF_IDX	(ID_T_POLY_COEFF_LEN - 1u)
+#define ID_T_POLY_COEFF_Q			16u		/* Coefficients are the fitted values * 2^16 */
 
 
-const float a[ID_T_POLY_COEFF_LEN] =
+const int32_t a[ID_T_POLY_COEFF_LEN] =
 {
-		0.00672f, 0.0065f, 0.00628f, 0.00606f, 0.00584f, 0.00562f, 0.0054f, 0.00518f,
-		0.00496f, 0.00474f, 0.00452f, 0.0043f, 0.00408f, 0.00386f, 0.00364f, 0.00342f,
-		0.0032f, 0.00298f, 0.00276f, 0.00254f, 0.00232f, 0.0021f, 0.00188f, 0.00166f,
-		0.00144f, 0.00122f, 0.001f, 0.00065f, 0.0003f, 0.0f,-0.0051f,-0.0092f,-0.0139f,
-		-0.0193f,-0.0254f,-0.0323f,-0.0399f,-0.0483f,-0.0576f,-0.0677f,-0.0788f,-0.0909f,-0.104f,
-		-0.1181f,-0.1311f,-0.1458f,-0.1612f,-0.1774f,-0.1945f,-0.2123f,-0.231f,-0.2506f,-0.271f,
-		-0.2922f,-0.3144f,-0.3374f,-0.3614f
+		440, 426, 412, 397, 383, 368, 354, 339,
+		325, 311, 296, 282, 267, 253, 239, 224,
+		210, 195, 181, 166, 152, 138, 123, 109,
+		94, 80, 66, 43, 20, 0, -334, -603,
+		-911, -1265, -1665, -2117, -2615, -3165, -3775, -4437,
+		-5164, -5957, -6816, -7740, -8592, -9555, -10564, -11626,
+		-12747, -13913, -15139, -16423, -17760, -19150, -20605, -22112,
+		-23685
 };
 
 
-const float b[ID_T_POLY_COEFF_LEN] =
+const int32_t b[ID_T_POLY_COEFF_LEN] =
 {
-		0.2169f,0.1571f,0.1201f,0.1042f,0.1078f,0.1295f,0.1676f,0.2207f,0.2872f,0.3655f,0.4541f,
-		0.5514f,0.3989f,0.4694f,0.5615f,0.6495f,0.7352f,0.8204f,0.9068f,0.9962f,1.0904f,1.1911f,
-		1.3001f,1.4193f,1.5503f,1.695f,1.8551f,2.0323f,2.2286f,2.4456f,3.0549f,3.5263f,4.0515f,
-		4.6335f,5.2757f,5.981f,6.7528f,7.5942f,8.5084f,9.4986f,10.568f,11.719f,12.957f,14.282f,
-		15.501f,16.858f,18.278f,19.763f,21.312f,22.926f,24.607f,26.354f,28.169f,30.052f,32.004f,
-		34.025f,36.117f
+		14215, 10296, 7871, 6829, 7065, 8487, 10984, 14464,
+		18822, 23953, 29760, 36137, 26142, 30763, 36798, 42566,
+		48182, 53766, 59428, 65287, 71460, 78060, 85203, 93015,
+		101600, 111084, 121576, 133189, 146054, 160275, 200206, 231100,
+		265519, 303661, 345748, 391971, 442552, 497693, 557607, 622500,
+		692584, 768016, 849150, 935985, 1015874, 1104806, 1197867, 1295188,
+		1396703, 1502478, 1612644, 1727136, 1846084, 1969488, 2097414, 2229862,
+		2366964
 };
 
 
-const float c[ID_T_POLY_COEFF_LEN] =
+const int32_t c[ID_T_POLY_COEFF_LEN] =
 {
-		-8.2299f,-4.4796f,-1.6241f,0.4295f,1.774f,2.5026f,2.708f,2.4833f,1.9213f,1.115f,0.1574f,
-		-0.8587f,3.632f,3.669f,4.126f,5.003f,6.3f,8.017f,10.154f,12.711f,15.688f,19.085f,22.902f,
-		27.139f,31.796f,36.873f,42.37f,48.287f,54.624f,61.381f,68.558f,76.155f,84.172f,92.609f,
-		101.47f,110.74f,120.44f,130.56f,141.09f,152.05f,163.43f,175.23f,187.44f,200.08f,217.37f,
-		234.16f,252.12f,271.29f,291.73f,313.5f,336.64f,361.2f,387.24f,414.82f,443.99f,474.79f,507.28f
+		-539355, -293575, -106437, 28148, 116261, 164010, 177471, 162746,
+		125914, 73073, 10315, -56276, 238027, 240452, 270402, 327877,
+		412877, 525402, 665453, 833028, 1028129, 1250755, 1500905, 1778582,
+		2083783, 2416509, 2776760, 3164537, 3579838, 4022665, 4493017, 4990894,
+		5516296, 6069223, 6649938, 7257457, 7893156, 8556380, 9246474, 9964749,
+		10710548, 11483873, 12284068, 13112443, 14245560, 15345910, 16522936, 17779261,
+		19118817, 20545536, 22062039, 23671603, 25378161, 27185644, 29097329, 31115837,
+		33245102
 };
 
 
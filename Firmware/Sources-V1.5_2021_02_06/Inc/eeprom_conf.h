@@ -99,11 +99,11 @@
  NV_LED_PARAM_R_2, \
  NV_LED_PARAM_G_2, \
  NV_LED_PARAM_B_2, \
- NV_ADDR_RESERVED9, \
- NV_ADDR_RESERVED10, \
+ OSLOOP_CONFIG_NV_ADDR, /* NV_ADDR_RESERVED9 */ \
+ TASKMAN_PERIOD_NV_ADDR, /* NV_ADDR_RESERVED10 */ \
  POWER_REGULATOR_CONFIG_NV_ADDR, \
  NV_RUN_PIN_CONFIG, \
- NV_ADDR_RESERVED11, \
+ TASKMAN_SLEEP_NV_ADDR, /* NV_ADDR_RESERVED11 */ \
  OWN_ADDRESS1_NV_ADDR, \
  OWN_ADDRESS2_NV_ADDR, \
  ID_EEPROM_ADR_NV_ADDR, \
@@ -52,5 +52,6 @@ int8_t FUELGAUGE_GetBatteryTemperature(void);
 uint16_t FUELGAUGE_GetIcId(void);
 bool FUELGAUGE_IsNtcOK(void);
 bool FUELGAUGE_IsOnline(void);
+bool FUELGAUGE_IsBusy(void);
 
 #endif /* FUEL_GAUGE_LC709203F_H_ */
@@ -17,12 +17,19 @@
 #define HOSTCOMMS_SECONDARY_ADDR	1u
 #define HOSTCOMMS_ADDR_TYPES		2u
 
+// Host idle time when it is not expected back
+#define HOSTCOMMS_IDLE_FOREVER		0xFFFFFFFFu
+
 void HOSTCOMMS_Init(const uint32_t sysTime);
 void HOSTCOMMS_Service(const uint32_t sysTime);
 void HOSTCOMMS_Task(void);
 
 bool HOSTCOMMS_IsCommandActive(void);
 uint32_t HOSTCOMMS_GetLastCommandAgeMs(const uint32_t sysTime);
+uint32_t HOSTCOMMS_GetHostIdleMs(const uint32_t sysTime);
+void HOSTCOMMS_SetQuiesceData(const uint8_t * const p_data, const uint16_t len);
+void HOSTCOMMS_GetActivityData(uint8_t * const p_data, uint16_t * const p_len);
+bool HOSTCOMMS_IsHostQuiesced(void);
 void HOSTCOMMS_SetInterrupt(void);
 void HOSTCOMMS_PiJuiceAddressSetEnable(const bool enabled);
 void HOSTCOMMS_ChangeAddress(const uint8_t addrType, const uint8_t addr);
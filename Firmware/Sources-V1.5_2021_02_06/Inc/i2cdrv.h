@@ -47,6 +47,8 @@ typedef struct
 	I2CDRV_Device_Event_t event;
 	uint8_t data[I2CDRV_MAX_BUFFER_SIZE];
 	uint8_t datalen;
+	uint8_t txLen;
+	uint8_t txIdx;
 	I2CDRV_Device_Status status;
 	uint32_t transactTime;
 	uint16_t timeout;
@@ -65,5 +67,8 @@ bool I2CDRV_Transact(const uint8_t deviceIdx, const uint8_t addr,
 					const uint8_t * const data,	const uint8_t len,
 					I2CDRV_TransactionType_t transactType, const I2CDRV_EventCb_t callback,
 					const uint16_t timeout, const uint32_t sysTime);
+bool I2CDRV_TransactWriteRead(const uint8_t deviceIdx, const uint8_t addr,
+					const uint8_t * const writeData, const uint8_t writeLen, const uint8_t readLen,
+					const I2CDRV_EventCb_t callback, const uint16_t timeout, const uint32_t sysTime);
 
 #endif
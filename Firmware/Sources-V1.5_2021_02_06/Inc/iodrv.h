@@ -34,6 +34,8 @@ typedef struct
 	uint32_t			lastDigitalChangeTime;
 	uint32_t			lastPosPulseWidthTimeMs;
 	uint32_t			lastNegPulseWidthTimeMs;
+	uint32_t			lastPosPulseWidthTimeUs;
+	uint32_t			lastNegPulseWidthTimeUs;
 	uint8_t				adcChannel;
 	uint32_t			analogConversionFactor;
 	IODRV_PinType_t		pinType;
@@ -42,6 +44,7 @@ typedef struct
 	GPIO_TypeDef*		gpioPort;
 	uint16_t			invert_bm;
 	bool				canConfigure;
+	bool				edgeCapture;
 	uint8_t				index;
 } IODRV_Pin_t;
 
@@ -54,6 +57,7 @@ uint16_t IODRV_ReadPinValue(const uint8_t pin);
 bool IODRV_ReadPinOutputState(const uint8_t pin);
 const IODRV_Pin_t * IODRV_GetPinInfo(const uint8_t pin);
 void IORDV_ClearPinEdges(const uint8_t pinIdx);
+void IODRV_CaptureEdge(const uint16_t gpioPin_bm);
 bool IODRV_SetPinType(const uint8_t pin, const IODRV_PinType_t newType);
 bool IODRV_WritePin(const uint8_t pin, bool newValue);
 bool IODRV_SetPin(const uint8_t pin, const bool newValue);
@@ -8,14 +8,31 @@
 #ifndef LOAD_CURRENT_SENSE_H_
 #define LOAD_CURRENT_SENSE_H_
 
+typedef enum
+{
+	ISENSE_CAL_MODE_LOAD = 0u,
+	ISENSE_CAL_MODE_ZERO,
+	ISENSE_CAL_MODE_51MA,
+	ISENSE_CAL_MODE_510MA
+} ISENSE_CalMode_t;
+
+typedef enum
+{
+	ISENSE_CAL_STATUS_IDLE = 0u,
+	ISENSE_CAL_STATUS_BUSY,
+	ISENSE_CAL_STATUS_PASS,
+	ISENSE_CAL_STATUS_FAIL
+} ISENSE_CalStatus_t;
+
 void ISENSE_Init(void);
 void ISENSE_Task(void);
 
 int16_t ISENSE_GetLoadCurrentMa(void);
-void ISENSE_CalibrateLoadCurrent(void);
-void ISENSE_CalibrateZeroCurrent(void);
-void ISENSE_Calibrate51mACurrent(void);
-void ISENSE_Calibrate510mACurrent(void);
+bool ISENSE_StartCalibration(const ISENSE_CalMode_t mode);
+void ISENSE_AbortCalibration(void);
+ISENSE_CalStatus_t ISENSE_GetCalibrationStatus(void);
+bool ISENSE_IsCalibrating(void);
+void ISENSE_GetCalibrationData(uint8_t * const p_data, uint16_t * const p_len);
 bool ISENSE_WriteNVCalibration(void);
 
 #endif /* LOAD_CURRENT_SENSE_H_ */
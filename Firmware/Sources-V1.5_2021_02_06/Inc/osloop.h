@@ -19,5 +19,8 @@ void OSLOOP_Restart(void);
 
 void OSLOOP_AtomicAccess(const bool access);
 
+void OSLOOP_SetPeriod(const uint8_t periodMs);
+uint8_t OSLOOP_GetPeriod(void);
+
 
 #endif	/* OSLOOP_H_ */
@@ -0,0 +1,121 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file		seqlock.h
+ * @date       	18 October 2026
+ * @brief       Sequence counter for taking consistent snapshots of multi word
+ * 				values shared with an interrupt without holding the interrupt off.
+ * 				The writer makes the counter odd while it updates and even again
+ * 				when done, a reader copies the values and retries if the counter
+ * 				was odd or changed while it copied.
+ * @note        A reader must not have a higher priority than the writer, it would
+ * 				spin forever if it interrupted an update, those readers should take
+ * 				one attempt and keep their last good copy instead. Include after
+ * 				main.h for the CMSIS intrinsics.
+ *
+ */
+// ----------------------------------------------------------------------------
+
+#ifndef SEQLOCK_H_
+#define SEQLOCK_H_
+
+typedef volatile uint32_t SEQLOCK_t;
+
+
+// ****************************************************************************
+/*!
+ * SEQLOCK_WriteBegin marks the start of an update. Only for values that are
+ * written from a single interrupt priority, the increment is not atomic.
+ *
+ * @param	p_seq		pointer to the sequence counter
+ * @retval	none
+ */
+// ****************************************************************************
+__STATIC_INLINE void SEQLOCK_WriteBegin(SEQLOCK_t * const p_seq)
+{
+	(*p_seq)++;
+	__DMB();
+}
+
+
+// ****************************************************************************
+/*!
+ * SEQLOCK_TryWriteBegin marks the start of an update for values that are written
+ * from more than one priority. The M0 has no exclusive access instructions so the
+ * test and increment is done with interrupts masked for a few cycles. Returns
+ * false if a lower priority writer is part way through, the caller should drop
+ * its update rather than wait.
+ *
+ * @param	p_seq		pointer to the sequence counter
+ * @retval	bool		true = update may go ahead, end it with SEQLOCK_WriteEnd
+ */
+// ****************************************************************************
+__STATIC_INLINE bool SEQLOCK_TryWriteBegin(SEQLOCK_t * const p_seq)
+{
+	const uint32_t primask = __get_PRIMASK();
+	bool result = false;
+
+	__disable_irq();
+
+	if (0u == (*p_seq & 1u))
+	{
+		(*p_seq)++;
+		result = true;
+	}
+
+	__set_PRIMASK(primask);
+	__DMB();
+
+	return result;
+}
+
+
+// ****************************************************************************
+/*!
+ * SEQLOCK_WriteEnd marks the end of an update.
+ *
+ * @param	p_seq		pointer to the sequence counter
+ * @retval	none
+ */
+// ****************************************************************************
+__STATIC_INLINE void SEQLOCK_WriteEnd(SEQLOCK_t * const p_seq)
+{
+	__DMB();
+	(*p_seq)++;
+}
+
+
+// ****************************************************************************
+/*!
+ * SEQLOCK_ReadBegin gets the counter value before the values are copied.
+ *
+ * @param	p_seq		pointer to the sequence counter
+ * @retval	uint32_t	counter value to pass to SEQLOCK_ReadRetry
+ */
+// ****************************************************************************
+__STATIC_INLINE uint32_t SEQLOCK_ReadBegin(const SEQLOCK_t * const p_seq)
+{
+	const uint32_t seq = *p_seq;
+
+	__DMB();
+
+	return seq;
+}
+
+
+// ****************************************************************************
+/*!
+ * SEQLOCK_ReadRetry checks the copy taken since SEQLOCK_ReadBegin is whole.
+ *
+ * @param	p_seq		pointer to the sequence counter
+ * @param	seq			value returned by SEQLOCK_ReadBegin
+ * @retval	bool		true = copy may be torn, read again or discard it
+ */
+// ****************************************************************************
+__STATIC_INLINE bool SEQLOCK_ReadRetry(const SEQLOCK_t * const p_seq, const uint32_t seq)
+{
+	__DMB();
+
+	return ( (0u != (seq & 1u)) || (seq != *p_seq) );
+}
+
+#endif /* SEQLOCK_H_ */
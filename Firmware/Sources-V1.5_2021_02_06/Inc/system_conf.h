@@ -171,6 +171,8 @@
 
 /* Must not be more than 255, 16 is a good number */
 #define AVE_FILTER_ELEMENT_COUNT			16u
+/* Odd and no more than 7, spike rejection in front of the IIR */
+#define AVE_FILTER_MEDIAN_COUNT				3u
 
 #define ANALOG_CHANNEL_CS1					0u
 #define ANALOG_CHANNEL_CS2					1u
@@ -182,18 +184,44 @@
 #define ANALOG_CHANNEL_MPUTEMP				7u
 #define ANALOG_CHANNEL_INTREF				8u
 
-#define FILTER_PERIOD_MS_CS1				10u
-#define FILTER_PERIOD_MS_CS2				10u
-#define FILTER_PERIOD_MS_VBAT				10u
-#define FILTER_PERIOD_MS_NTC				10u
-#define FILTER_PERIOD_MS_POW_DET			10u
-#define FILTER_PERIOD_MS_BATTYPE			10u
-#define FILTER_PERIOD_MS_IO1				10u
-#define FILTER_PERIOD_MS_MPUTEMP			10u
-#define FILTER_PERIOD_MS_INTREF				10u
+#define FILTER_PERIOD_MS_CS1				8u
+#define FILTER_PERIOD_MS_CS2				8u
+#define FILTER_PERIOD_MS_VBAT				8u
+#define FILTER_PERIOD_MS_NTC				8u
+#define FILTER_PERIOD_MS_POW_DET			8u
+#define FILTER_PERIOD_MS_BATTYPE			8u
+#define FILTER_PERIOD_MS_IO1				8u
+#define FILTER_PERIOD_MS_MPUTEMP			8u
+#define FILTER_PERIOD_MS_INTREF				8u
+
+/* AVE_FILTER_TYPE_BOXCAR, _IIR or _MEDIAN_IIR. IIR time constant is 2^shift
+ * updates, shift 3 has about the noise of the 16 element boxcar with a quicker
+ * step response. Only boxcar filters take element ram.
+ */
+#define FILTER_TYPE_CS1						AVE_FILTER_TYPE_IIR
+#define FILTER_TYPE_CS2						AVE_FILTER_TYPE_IIR
+#define FILTER_TYPE_VBAT					AVE_FILTER_TYPE_MEDIAN_IIR
+#define FILTER_TYPE_NTC						AVE_FILTER_TYPE_IIR
+#define FILTER_TYPE_POW_DET					AVE_FILTER_TYPE_IIR
+#define FILTER_TYPE_BATTYPE					AVE_FILTER_TYPE_IIR
+#define FILTER_TYPE_IO1						AVE_FILTER_TYPE_IIR
+#define FILTER_TYPE_MPUTEMP					AVE_FILTER_TYPE_IIR
+#define FILTER_TYPE_INTREF					AVE_FILTER_TYPE_BOXCAR
+
+#define FILTER_IIR_SHIFT_CS1				3u
+#define FILTER_IIR_SHIFT_CS2				3u
+#define FILTER_IIR_SHIFT_VBAT				4u
+#define FILTER_IIR_SHIFT_NTC				4u
+#define FILTER_IIR_SHIFT_POW_DET			3u
+#define FILTER_IIR_SHIFT_BATTYPE			4u
+#define FILTER_IIR_SHIFT_IO1				3u
+#define FILTER_IIR_SHIFT_MPUTEMP			4u
+#define FILTER_IIR_SHIFT_INTREF				0u
 
 // Average current reading over 1 second
 #define FILTER_PERIOD_MS_ISENSE				(1000u / AVE_FILTER_ELEMENT_COUNT)
+#define FILTER_TYPE_ISENSE					AVE_FILTER_TYPE_BOXCAR
+#define FILTER_IIR_SHIFT_ISENSE				0u
 
 #define MAX_ANALOG_CHANNELS					9u
 
@@ -207,8 +235,13 @@
 
 #define ISENSE_POWDET_K						105600ul
 #define ISENSE_UPDATE_PERIOD				125u
+#define ISENSE_CAL_FILTER_PERIOD_MS			1000u
+#define ISENSE_CAL_CHECK_MIN_MA				42
+#define ISENSE_CAL_CHECK_MAX_MA				59
 
 #define IODRV_PIN_DEBOUNCE_COUNT			5u
+#define IODRV_PIN_SETTLE_US					20000u	/* Captured input must be quiet this long after its last edge */
+#define IODRV_EDGE_CAPTURE_COUNT			3u		/* Buttons, both edges on EXTI */
 
 #define BUTTON_EVENT_EXPIRE_PERIOD_MS		30000u
 #define BUTTON_MAX_BUTTONS					3u
@@ -223,10 +256,22 @@
 #define BUTTON_EVENT_FUNC_SYS_EVENT			0x10u
 
 #define IODRV_PIN_UPDATE_PERIOD_MS			10u
-#define ADC_SAMPLE_PERIOD_MS				0u
+/* No adc trigger timer of the F030 is free, TIM1 runs the io pwm, TIM3 and TIM15
+ * the leds. The led code keeps the TIM15 counter running and its rate as set here,
+ * the filter periods above are matched to it.
+ */
+#define ADC_TRIGGER_TIMER					TIM15	/* Update event (TRGO) starts each conversion sequence, 8.2mS */
+#define ADC_TRIGGER_PRESCALER				0u		/* 8MHz timer clock */
+#define ADC_TRIGGER_RELOAD					65535u	/* Also the led pwm full scale */
+#define ADC_TRIGGER_SOURCE					ADC_EXTERNALTRIGCONV_T15_TRGO
+#define ADC_DMA_SEQUENCES					2u		/* Circular buffer, one sequence per half */
+#define ADC_DMA_IRQ_PRIORITY				2u		/* Matches osloop timer */
+#define ADC_RESTART_SETTLE_SEQUENCES		2u		/* Conversions discarded after wake from stop */
 
 #define I2CDRV_MAX_DEVICES					2u
-#define I2CDRV_MAX_BUFFER_SIZE				12u		/* Big enough to read all registers from charger */
+#define I2CDRV_MAX_BUFFER_SIZE				32u		/* Write bytes + address + read bytes of one transaction */
+#define I2CDRV_QUEUE_LENGTH					4u		/* Queue slots per device, one always left free */
+#define I2CDRV_DMA_IRQ_PRIORITY				0u		/* Matches I2C2 interrupt, define I2CDRV_POLLED_COMPLETION for the old polled path */
 
 #define FUELGAUGE_I2C_ADDR					0x16u
 #define FUELGAUGE_I2C_PORTNO				1u
@@ -257,9 +302,31 @@
 #define POWERSOURCE_RPI_LOW_MV				4800u
 #define POWERSOURCE_RPI_UNDER_MV			4500u
 
-#define TASKMAN_TASK_PERIOD_MS				20u
-#define TASKMAN_SLEEP_TIME_MS				4000u
-#define TASKMAN_SLEEP_SETTING				((TASKMAN_SLEEP_TIME_MS * 2048ul) / 1000u)
+#define TASKMAN_TASK_PERIOD_MS				20u		/* Default, NV configurable */
+#define TASKMAN_SLEEP_TIME_MS				4000u	/* Default, NV configurable in 100mS steps */
+#define TASKMAN_SLEEP_SETTING_K				2048u	/* RTC wakeup counts per second, RTCCLK / 16 */
+#define TASKMAN_ADAPT_HOST_IDLE_MS			30000u	/* Host quiet time before stretching the periods */
+#define TASKMAN_ADAPT_HOLD_MS				10000u	/* Normal periods kept after a charger event */
+#define TASKMAN_ADAPT_TASK_FACTOR			4u
+#define TASKMAN_ADAPT_SLEEP_FACTOR			2u
+#define TASKMAN_STOP_MIN_MS					100u	/* Shortest stop worth restarting the background services for */
+#define TASKMAN_WAKE_SETTLE_MS				22u		/* Awake after a wake before stop, covers the IODRV pin settle */
+
+#define HOSTCOMMS_BURST_GAP_MS				50u		/* Host commands closer than this are one poll burst */
+#define HOSTCOMMS_HOST_GONE_MS				5000u	/* No commands for this long and the host is not polling */
+#define HOSTCOMMS_PREDICT_CONFIDENCE		4u		/* Bursts on time in a row before stopping between them */
+#define HOSTCOMMS_PREDICT_SLACK_MS			20u		/* Burst lateness allowed on top of the measured jitter */
+#define HOSTCOMMS_PREDICT_WAKE_MS			30u		/* Awake this long ahead of a predicted burst */
+#define HOSTCOMMS_PREDICT_MAX_PERIOD_MS		60000u	/* Longest burst period learnt */
+#define HOSTCOMMS_RX_RING_SLOTS				4u		/* Host writes queued before stretching, power of 2 */
+
+#define OSLOOP_PERIOD_MS					1u		/* Default, NV configurable */
+#define OSLOOP_PERIOD_MAX_MS				8u		/* Must still catch every ADC sequence */
+#define OSLOOP_ADAPT_FACTOR					4u
+
+#define BATCHAR_WINDOW_MS					50u		/* VBAT averaged over about 6 ADC sequences */
+#define BATCHAR_SWITCH_MOHM					60u		/* VSys switch resistance in series with the load */
+#define BATCHAR_RECORD_COUNT				32u
 
 #define LED_COUNT							2u
 #define LED_LAST_LED_IDX					(LED_COUNT - 1u)
@@ -26,4 +26,7 @@ TASKMAN_RunState_t TASKMAN_GetRunState(void);
 bool TASKMAN_GetIOWakeEvent(void);
 void TASKMAN_ClearIOWakeEvent(void);
 
+void TASKMAN_SetLoopConfigData(const uint8_t * const p_data, const uint16_t len);
+void TASKMAN_GetLoopConfigData(uint8_t * const p_data, uint16_t * const p_len);
+
 #endif /* TASKLOOP_H_ */
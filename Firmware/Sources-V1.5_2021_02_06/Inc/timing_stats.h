@@ -0,0 +1,66 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file		timing_stats.h
+ * @date       	18 October 2026
+ * @brief       Header file for timing_stats.c
+ * @note        Please refer to the .c file for a detailed description.
+ *
+ */
+// ----------------------------------------------------------------------------
+
+#ifndef TIMING_STATS_H_
+#define TIMING_STATS_H_
+
+typedef enum
+{
+	TIMING_STATS_OSLOOP = 0u,
+	TIMING_STATS_TASKMAN,
+
+	/* Osloop service routines, osloop timer ticks */
+	TIMING_STATS_ADC_SERVICE,
+	TIMING_STATS_IODRV_SERVICE,
+	TIMING_STATS_ANALOG_SERVICE,
+	TIMING_STATS_I2CDRV_SERVICE,
+	TIMING_STATS_HOSTCOMMS_SERVICE,
+	TIMING_STATS_LED_SERVICE,
+
+	/* Taskman tasks, uS */
+	TIMING_STATS_CHARGER_TASK,
+	TIMING_STATS_FUELGAUGE_TASK,
+	TIMING_STATS_BATTERY_TASK,
+	TIMING_STATS_POWERSOURCE_TASK,
+	TIMING_STATS_ISENSE_TASK,
+	TIMING_STATS_RTC_TASK,
+	TIMING_STATS_BUTTON_TASK,
+	TIMING_STATS_POWERMAN_TASK,
+	TIMING_STATS_HOSTCOMMS_TASK,
+	TIMING_STATS_RTC_MIRROR,
+
+	/* I2CDRV transaction start to callback, uS */
+	TIMING_STATS_I2CDRV_TRANSACT,
+
+	TIMING_STATS_MAX_ENTRIES
+} TIMING_STATS_Id_t;
+
+typedef struct
+{
+	uint16_t min;
+	uint16_t max;
+	uint16_t mean;
+	uint16_t p99;
+	uint32_t count;
+} TIMING_STATS_Summary_t;
+
+void TIMING_STATS_Init(void);
+void TIMING_STATS_Reset(void);
+
+uint32_t TIMING_STATS_RecordService(const TIMING_STATS_Id_t id, const uint32_t startTime, const uint32_t endTime);
+uint32_t TIMING_STATS_RecordTask(const TIMING_STATS_Id_t id, const uint32_t startTime, const uint32_t endTime);
+uint32_t TIMING_STATS_GetTimeUs(void);
+
+void TIMING_STATS_GetSummary(const TIMING_STATS_Id_t id, TIMING_STATS_Summary_t * const p_summary);
+
+void TIMING_STATS_ReadCmd(uint8_t * const p_data, uint16_t * const p_len);
+void TIMING_STATS_WriteCmd(const uint8_t * const p_data, const uint16_t len);
+
+#endif /* TIMING_STATS_H_ */
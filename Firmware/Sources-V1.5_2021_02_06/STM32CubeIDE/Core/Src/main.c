@@ -728,6 +728,8 @@ static void MX_TIM15_Init(void)
     Error_Handler();
   }
   /* USER CODE BEGIN TIM15_Init 2 */
+	// TIM15 update is also the adc trigger, see ADC_TRIGGER_TIMER in system_conf.h,
+	// LED_Init puts the prescaler and period back to the ones set there
 
   /* USER CODE END TIM15_Init 2 */
   HAL_TIM_MspPostInit(&htim15);
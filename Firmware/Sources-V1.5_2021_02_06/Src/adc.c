@@ -3,16 +3,28 @@
  * @file		adc.c
  * @author    	John Steggall
  * @date       	19 March 2021
- * @brief       Lowish level driver for the ADC peripheral. Starts the ADC and using
- * 				DMA transfer in a periodic fashion and updates an averaging filter
- * 				dependant on its update period. On startup and wakeup from stop the
- * 				module is reset and the filter buffers are cleared. Once they've
+ * @brief       Lowish level driver for the ADC peripheral. The ADC conversion
+ * 				sequence is triggered by a timer update event and transferred by DMA
+ * 				into a circular buffer, the half and complete callbacks each receive
+ * 				one sequence and update the averaging filters dependant on their
+ * 				update period. The service routine only does the derived arithmetic
+ * 				on the latest sequence. On startup the module is reset and the
+ * 				filter buffers are cleared. Once they've
  * 				completed one non periodic cycle the average filter ready flag is set
  * 				and the averaging is performed periodically as set by the defines.
+ * 				On wakeup from stop the filters are kept (ram is retained) and
+ * 				seeded with their last average so they stay ready, the first few
+ * 				conversion sequences are discarded while the adc settles.
+ * 				The filter type of each channel is set in system_conf.h, element
+ * 				storage is only reserved for the channels that are boxcar.
  * 				There is a special current sense filter also that operates on the
  * 				difference between the CS1 and CS2 channels. The filter totals of
  * 				these channels are used to try and get some more resolution but it
  * 				does mean the reading is quite unstable. The filter operates in mA.
+ * 				The DMA callbacks and the service routine share a priority and
+ * 				bump a sequence counter around their updates, the getters copy
+ * 				the values and retry if an update got in the way so the taskman
+ * 				never sees a half updated set and never holds off the interrupts.
  *
  */
 // ----------------------------------------------------------------------------
@@ -23,6 +35,7 @@
 #include "ave_filter.h"
 #include "time_count.h"
 #include "util.h"
+#include "seqlock.h"
 
 #include "adc.h"
 
@@ -31,28 +44,119 @@
 // ----------------------------------------------------------------------------
 // Defines section - add all #defines here:
 
+#define ADC_IS_BOXCAR(t)		(((t) == AVE_FILTER_TYPE_BOXCAR) ? 1u : 0u)
+#define ADC_BOXCAR_FILTERS		( ADC_IS_BOXCAR(FILTER_TYPE_CS1) + ADC_IS_BOXCAR(FILTER_TYPE_CS2) + \
+									ADC_IS_BOXCAR(FILTER_TYPE_VBAT) + ADC_IS_BOXCAR(FILTER_TYPE_NTC) + \
+									ADC_IS_BOXCAR(FILTER_TYPE_POW_DET) + ADC_IS_BOXCAR(FILTER_TYPE_BATTYPE) + \
+									ADC_IS_BOXCAR(FILTER_TYPE_IO1) + ADC_IS_BOXCAR(FILTER_TYPE_MPUTEMP) + \
+									ADC_IS_BOXCAR(FILTER_TYPE_INTREF) )
 
 // ----------------------------------------------------------------------------
 // Function prototypes for functions that only have scope in this module:
 
+static void ADC_ProcessSequence(const uint16_t * const p_adcVals);
+static uint16_t ADC_ApplyRefScale(const uint16_t value, const uint32_t refScale);
+
 
 // ----------------------------------------------------------------------------
 // Variables that only have scope in this module:
 
-static uint16_t m_adcVals[MAX_ANALOG_CHANNELS];
+static uint16_t m_adcVals[ADC_DMA_SEQUENCES * MAX_ANALOG_CHANNELS];
 static AVE_FILTER_U16_t	m_aveFilters[MAX_ANALOG_CHANNELS];
 static AVE_FILTER_S32_t m_currentSenseFilter;
-static uint32_t m_lastAdcStartTime;
+
+#if ADC_BOXCAR_FILTERS > 0u
+static uint16_t m_boxcarElements[ADC_BOXCAR_FILTERS][AVE_FILTER_ELEMENT_COUNT];
+#endif
+
+#if FILTER_TYPE_ISENSE == AVE_FILTER_TYPE_BOXCAR
+static int32_t m_currentSenseElements[AVE_FILTER_ELEMENT_COUNT];
+#else
+#define m_currentSenseElements	NULL
+#endif
+
+static const AVE_FILTER_Config_t m_filterConfig[MAX_ANALOG_CHANNELS] =
+{
+	[ANALOG_CHANNEL_CS1] = { FILTER_PERIOD_MS_CS1, FILTER_TYPE_CS1, FILTER_IIR_SHIFT_CS1 },
+	[ANALOG_CHANNEL_CS2] = { FILTER_PERIOD_MS_CS2, FILTER_TYPE_CS2, FILTER_IIR_SHIFT_CS2 },
+	[ANALOG_CHANNEL_VBAT] = { FILTER_PERIOD_MS_VBAT, FILTER_TYPE_VBAT, FILTER_IIR_SHIFT_VBAT },
+	[ANALOG_CHANNEL_NTC] = { FILTER_PERIOD_MS_NTC, FILTER_TYPE_NTC, FILTER_IIR_SHIFT_NTC },
+	[ANALOG_CHANNEL_POW_DET] = { FILTER_PERIOD_MS_POW_DET, FILTER_TYPE_POW_DET, FILTER_IIR_SHIFT_POW_DET },
+	[ANALOG_CHANNEL_BATTYPE] = { FILTER_PERIOD_MS_BATTYPE, FILTER_TYPE_BATTYPE, FILTER_IIR_SHIFT_BATTYPE },
+	[ANALOG_CHANNEL_IO1] = { FILTER_PERIOD_MS_IO1, FILTER_TYPE_IO1, FILTER_IIR_SHIFT_IO1 },
+	[ANALOG_CHANNEL_MPUTEMP] = { FILTER_PERIOD_MS_MPUTEMP, FILTER_TYPE_MPUTEMP, FILTER_IIR_SHIFT_MPUTEMP },
+	[ANALOG_CHANNEL_INTREF] = { FILTER_PERIOD_MS_INTREF, FILTER_TYPE_INTREF, FILTER_IIR_SHIFT_INTREF }
+};
+
+static const AVE_FILTER_Config_t m_currentSenseConfig =
+{
+	FILTER_PERIOD_MS_ISENSE, FILTER_TYPE_ISENSE, FILTER_IIR_SHIFT_ISENSE
+};
+static volatile int32_t m_csTotalDiff;
+static volatile bool m_newSequence;
+static SEQLOCK_t m_adcSeq;
 
 static uint16_t m_adcIntRefCal;
 static uint32_t m_adcRefScale = 0x00010000u;
 
 static bool m_aveFilterReady;
+static uint8_t m_adcSettleCount;
+
+static uint8_t m_windowChannel = MAX_ANALOG_CHANNELS;
+static uint32_t m_windowTotal;
+static uint16_t m_windowCount;
 
 // ----------------------------------------------------------------------------
 // Variables that have scope from outside this module:
 
 extern ADC_HandleTypeDef hadc;
+extern DMA_HandleTypeDef hdma_adc;
+
+
+// ----------------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+// INTERRUPT HANDLERS
+// ----------------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+// ****************************************************************************
+/*!
+ * DMA1_Channel1_IRQHandler handles the adc dma half and full transfer interrupts.
+ */
+// ****************************************************************************
+void DMA1_Channel1_IRQHandler(void)
+{
+	HAL_DMA_IRQHandler(&hdma_adc);
+}
+
+
+// ****************************************************************************
+/*!
+ * HAL_ADC_ConvHalfCpltCallback is called from the DMA interrupt when the first
+ * sequence in the circular buffer has been transferred.
+ *
+ * @param	p_hadc		handle of the adc that completed
+ * @retval	none
+ */
+// ****************************************************************************
+void HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef * p_hadc)
+{
+	ADC_ProcessSequence(&m_adcVals[0u]);
+}
+
+
+// ****************************************************************************
+/*!
+ * HAL_ADC_ConvCpltCallback is called from the DMA interrupt when the last
+ * sequence in the circular buffer has been transferred.
+ *
+ * @param	p_hadc		handle of the adc that completed
+ * @retval	none
+ */
+// ****************************************************************************
+void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef * p_hadc)
+{
+	ADC_ProcessSequence(&m_adcVals[MAX_ANALOG_CHANNELS]);
+}
 
 
 // ----------------------------------------------------------------------------
@@ -69,27 +173,82 @@ extern ADC_HandleTypeDef hadc;
 // ****************************************************************************
 void ADC_Init(const uint32_t sysTime)
 {
-	AVE_FILTER_U16_InitPeriodic(&m_aveFilters[ANALOG_CHANNEL_CS1], sysTime, FILTER_PERIOD_MS_CS1);
-	AVE_FILTER_U16_InitPeriodic(&m_aveFilters[ANALOG_CHANNEL_CS2], sysTime, FILTER_PERIOD_MS_CS2);
-	AVE_FILTER_U16_InitPeriodic(&m_aveFilters[ANALOG_CHANNEL_VBAT], sysTime, FILTER_PERIOD_MS_VBAT);
-	AVE_FILTER_U16_InitPeriodic(&m_aveFilters[ANALOG_CHANNEL_NTC], sysTime, FILTER_PERIOD_MS_NTC);
-	AVE_FILTER_U16_InitPeriodic(&m_aveFilters[ANALOG_CHANNEL_POW_DET], sysTime, FILTER_PERIOD_MS_POW_DET);
-	AVE_FILTER_U16_InitPeriodic(&m_aveFilters[ANALOG_CHANNEL_BATTYPE], sysTime, FILTER_PERIOD_MS_BATTYPE);
-	AVE_FILTER_U16_InitPeriodic(&m_aveFilters[ANALOG_CHANNEL_IO1], sysTime, FILTER_PERIOD_MS_IO1);
-	AVE_FILTER_U16_InitPeriodic(&m_aveFilters[ANALOG_CHANNEL_MPUTEMP], sysTime, FILTER_PERIOD_MS_MPUTEMP);
-	AVE_FILTER_U16_InitPeriodic(&m_aveFilters[ANALOG_CHANNEL_INTREF], sysTime, FILTER_PERIOD_MS_INTREF);
-
-	AVE_FILTER_S32_InitPeriodic(&m_currentSenseFilter, sysTime, FILTER_PERIOD_MS_ISENSE);
+	uint16_t * p_elements;
+	uint8_t boxcarIdx = 0u;
+	uint8_t i;
+
+	for (i = 0u; i < MAX_ANALOG_CHANNELS; i++)
+	{
+		p_elements = NULL;
+
+#if ADC_BOXCAR_FILTERS > 0u
+		if ( (AVE_FILTER_TYPE_BOXCAR == m_filterConfig[i].type) && (boxcarIdx < ADC_BOXCAR_FILTERS) )
+		{
+			p_elements = m_boxcarElements[boxcarIdx];
+			boxcarIdx++;
+		}
+#endif
+
+		AVE_FILTER_U16_InitPeriodic(&m_aveFilters[i], sysTime, &m_filterConfig[i], p_elements);
+	}
+
+	AVE_FILTER_S32_InitPeriodic(&m_currentSenseFilter, sysTime, &m_currentSenseConfig, m_currentSenseElements);
 
 	m_aveFilterReady = false;
+	m_adcSettleCount = 0u;
+	m_newSequence = false;
+	m_windowChannel = MAX_ANALOG_CHANNELS;
 
 	m_adcIntRefCal = *(VREFINT_CAL_ADDR);
 
+	// One sequence per trigger timer update, DMA keeps running in circular mode
+	hadc.Init.ContinuousConvMode = DISABLE;
+	hadc.Init.ExternalTrigConv = ADC_TRIGGER_SOURCE;
+	hadc.Init.ExternalTrigConvEdge = ADC_EXTERNALTRIGCONVEDGE_RISING;
+	hadc.Init.DMAContinuousRequests = ENABLE;
+	HAL_ADC_Init(&hadc);
+
+	// Timer runs for the led pwm, use its update event as trigger output. Led code
+	// keeps it counting at ADC_TRIGGER_PRESCALER and ADC_TRIGGER_RELOAD.
+	ADC_TRIGGER_TIMER->CR2 = (ADC_TRIGGER_TIMER->CR2 & ~(TIM_CR2_MMS)) | TIM_TRGO_UPDATE;
+
+	// Same priority as the osloop so the callbacks and service never interrupt each other
+	HAL_NVIC_SetPriority(DMA1_Channel1_IRQn, ADC_DMA_IRQ_PRIORITY, 0u);
+	HAL_NVIC_EnableIRQ(DMA1_Channel1_IRQn);
+
 	HAL_ADCEx_Calibration_Start(&hadc);
 
-	HAL_ADC_Start_DMA(&hadc, (uint32_t*)&m_adcVals[0u], MAX_ANALOG_CHANNELS);
+	HAL_ADC_Start_DMA(&hadc, (uint32_t*)&m_adcVals[0u], ADC_DMA_SEQUENCES * MAX_ANALOG_CHANNELS);
+}
+
 
-	MS_TIMEREF_INIT(m_lastAdcStartTime, sysTime);
+// ****************************************************************************
+/*!
+ * ADC_Restart restarts the module after a wake from low power stop mode without
+ * losing the filter state. Each filter is seeded with the average it had before
+ * stop and the ready flag is left as it was, so the averages can be read straight
+ * away. The first conversion sequences are discarded while the adc settles.
+ * Calibration factor is retained through stop so calibration is not repeated.
+ *
+ * @param	sysTime		current value of the ms tick timer
+ * @retval	none
+ */
+// ****************************************************************************
+void ADC_Restart(const uint32_t sysTime)
+{
+	uint8_t i;
+
+	for (i = 0u; i < MAX_ANALOG_CHANNELS; i++)
+	{
+		AVE_FILTER_U16_Seed(&m_aveFilters[i], m_aveFilters[i].average, sysTime);
+	}
+
+	AVE_FILTER_S32_Seed(&m_currentSenseFilter, m_currentSenseFilter.average, sysTime);
+
+	m_adcSettleCount = ADC_RESTART_SETTLE_SEQUENCES;
+	m_newSequence = false;
+
+	HAL_ADC_Start_DMA(&hadc, (uint32_t*)&m_adcVals[0u], ADC_DMA_SEQUENCES * MAX_ANALOG_CHANNELS);
 }
 
 
@@ -108,7 +267,8 @@ void ADC_Shutdown(void)
 
 // ****************************************************************************
 /*!
- * ADC_Service performs periodic updates for this module
+ * ADC_Service performs periodic updates for this module, the filters are updated
+ * from the DMA interrupt so this only works out the values derived from them.
  *
  * @param	sysTime		current value of the ms tick timer
  * @retval	none
@@ -116,48 +276,26 @@ void ADC_Shutdown(void)
 // ****************************************************************************
 void ADC_Service(const uint32_t sysTime)
 {
-	uint8_t i;
 	int16_t iVal;
 
-	if (MS_TIMEREF_TIMEOUT(m_lastAdcStartTime, sysTime, ADC_SAMPLE_PERIOD_MS))
+	if (true == m_newSequence)
 	{
-		MS_TIMEREF_INIT(m_lastAdcStartTime, sysTime);
+		m_newSequence = false;
+
+		SEQLOCK_WriteBegin(&m_adcSeq);
 
-		if ((hadc.Instance->ISR & ADC_ISR_EOS) != 0u)
+		if ( (true == m_aveFilterReady) && (m_aveFilters[ANALOG_CHANNEL_INTREF].average > 0u) )
 		{
-			HAL_ADC_Stop_DMA(&hadc);
-
-			for (i = 0u; i < MAX_ANALOG_CHANNELS; i++)
-			{
-				if (false == m_aveFilterReady)
-				{
-					// Spam in values to fill the buffer
-					AVE_FILTER_U16_Update(&m_aveFilters[i], m_adcVals[i]);
-				}
-				else
-				{
-					AVE_FILTER_U16_UpdatePeriodic(&m_aveFilters[i], m_adcVals[i], sysTime);
-				}
-			}
-
-			if ( (true == m_aveFilterReady) && (m_aveFilters[ANALOG_CHANNEL_INTREF].average > 0u) )
-			{
-				m_adcRefScale = (0x00010000u * ((uint32_t)m_adcIntRefCal)) / (uint32_t)m_aveFilters[ANALOG_CHANNEL_INTREF].average;
-			}
-
-			// Convert sense resistor value to mA (not calibrated!)
-			iVal = UTIL_FixMul_U32_S16(ADC_RES_TO_MA_K,(int32_t)(m_aveFilters[ANALOG_CHANNEL_CS1].total - m_aveFilters[ANALOG_CHANNEL_CS2].total));
-
-			// update filter
-			AVE_FILTER_S32_UpdatePeriodic(&m_currentSenseFilter, iVal, sysTime);
-
-			if (0u == m_aveFilters[0].nextValueIdx)
-			{
-				m_aveFilterReady = true;
-			}
-
-			HAL_ADC_Start_DMA(&hadc, (uint32_t*)&m_adcVals[0u], MAX_ANALOG_CHANNELS);
+			m_adcRefScale = (0x00010000u * ((uint32_t)m_adcIntRefCal)) / (uint32_t)m_aveFilters[ANALOG_CHANNEL_INTREF].average;
 		}
+
+		// Convert sense resistor value to mA (not calibrated!)
+		iVal = UTIL_FixMul_U32_S16(ADC_RES_TO_MA_K, m_csTotalDiff);
+
+		// update filter
+		AVE_FILTER_S32_UpdatePeriodic(&m_currentSenseFilter, iVal, sysTime);
+
+		SEQLOCK_WriteEnd(&m_adcSeq);
 	}
 }
 
@@ -196,16 +334,95 @@ uint16_t ADC_GetInstantValue(const uint8_t channel)
 uint16_t ADC_GetAverageValue(const uint8_t channel)
 {
 	uint16_t result = 0u;
+	uint32_t seq;
 
 	if (channel < MAX_ANALOG_CHANNELS)
 	{
-		result = m_aveFilters[channel].average;
+		do
+		{
+			seq = SEQLOCK_ReadBegin(&m_adcSeq);
+			result = m_aveFilters[channel].average;
+		} while (true == SEQLOCK_ReadRetry(&m_adcSeq, seq));
 	}
 
 	return result;
 }
 
 
+// ****************************************************************************
+/*!
+ * ADC_GetCalibratedAverage returns the average value of the analog channel
+ * corrected using the internal reference, the average and the reference scale
+ * are taken from the same conversion sequence. Out of bounds channel access
+ * returns 0.
+ *
+ * @param	channel		channel to be accessed
+ * @retval	uint16_t	corrected average value of the analog channel
+ */
+// ****************************************************************************
+uint16_t ADC_GetCalibratedAverage(const uint8_t channel)
+{
+	uint16_t average = 0u;
+	uint32_t refScale;
+	uint32_t seq;
+
+	if (channel >= MAX_ANALOG_CHANNELS)
+	{
+		return 0u;
+	}
+
+	do
+	{
+		seq = SEQLOCK_ReadBegin(&m_adcSeq);
+		average = m_aveFilters[channel].average;
+		refScale = m_adcRefScale;
+	} while (true == SEQLOCK_ReadRetry(&m_adcSeq, seq));
+
+	return ADC_ApplyRefScale(average, refScale);
+}
+
+
+// ****************************************************************************
+/*!
+ * ADC_GetSnapshot copies the averages of all the channels and the current sense
+ * filter, all from the same conversion sequence.
+ *
+ * @param	p_snapshot	pointer to the snapshot to fill
+ * @retval	none
+ */
+// ****************************************************************************
+void ADC_GetSnapshot(ADC_Snapshot_t * const p_snapshot)
+{
+	int32_t currentSense;
+	uint32_t seq;
+	uint8_t i;
+
+	do
+	{
+		seq = SEQLOCK_ReadBegin(&m_adcSeq);
+
+		for (i = 0u; i < MAX_ANALOG_CHANNELS; i++)
+		{
+			p_snapshot->average[i] = m_aveFilters[i].average;
+		}
+
+		currentSense = m_currentSenseFilter.average;
+	} while (true == SEQLOCK_ReadRetry(&m_adcSeq, seq));
+
+	if (currentSense < INT16_MIN)
+	{
+		currentSense = INT16_MIN;
+	}
+
+	if (currentSense > INT16_MAX)
+	{
+		currentSense = INT16_MAX;
+	}
+
+	p_snapshot->currentSense = (int16_t)currentSense;
+}
+
+
 // ****************************************************************************
 /*!
  * ADC_CalibrateValue adjusts a value read by the adc using the internal reference
@@ -217,16 +434,7 @@ uint16_t ADC_GetAverageValue(const uint8_t channel)
 // ****************************************************************************
 uint16_t ADC_CalibrateValue(const uint16_t value)
 {
-	/* Apply fixed point multipler */
-	uint32_t result = value * m_adcRefScale;
-
-	// Round up if halfway there
-	if (0u != (result & 0x8000u))
-	{
-		result += 0x10000u;
-	}
-
-	return (uint16_t)(result >> 16u);
+	return ADC_ApplyRefScale(value, m_adcRefScale);
 }
 
 
@@ -242,7 +450,14 @@ uint16_t ADC_CalibrateValue(const uint16_t value)
 // ****************************************************************************
 int16_t ADC_GetCurrentSenseAverage(void)
 {
-	int32_t result = m_currentSenseFilter.average;
+	int32_t result;
+	uint32_t seq;
+
+	do
+	{
+		seq = SEQLOCK_ReadBegin(&m_adcSeq);
+		result = m_currentSenseFilter.average;
+	} while (true == SEQLOCK_ReadRetry(&m_adcSeq, seq));
 
 	if (result < INT16_MIN)
 	{
@@ -312,8 +527,167 @@ void ADC_SetIFilterPeriod(const uint32_t newFilterPeriodMs)
 	m_currentSenseFilter.filterPeriodMs = newFilterPeriodMs;
 }
 
+
+// ****************************************************************************
+/*!
+ * ADC_GetSettleTimeMs returns how long the average of a channel takes to follow
+ * a step in its input, out of bounds channel access returns 0.
+ *
+ * @param	channel		channel to be accessed
+ * @retval	uint32_t	settling time in mS
+ */
+// ****************************************************************************
+uint32_t ADC_GetSettleTimeMs(const uint8_t channel)
+{
+	if (channel >= MAX_ANALOG_CHANNELS)
+	{
+		return 0u;
+	}
+
+	return (uint32_t)m_aveFilters[channel].filterPeriodMs * AVE_FILTER_U16_GetSettleCount(&m_aveFilters[channel]);
+}
+
+
+// ****************************************************************************
+/*!
+ * ADC_GetIFilterSettleTimeMs returns how long the current sense filter takes to
+ * follow a step at its present update period.
+ *
+ * @param	none
+ * @retval	uint32_t	settling time in mS
+ */
+// ****************************************************************************
+uint32_t ADC_GetIFilterSettleTimeMs(void)
+{
+	return (uint32_t)m_currentSenseFilter.filterPeriodMs * AVE_FILTER_S32_GetSettleCount(&m_currentSenseFilter);
+}
+
+
+// ****************************************************************************
+/*!
+ * ADC_StartWindow starts averaging every raw conversion of a channel, bypassing
+ * the filters so a measurement can be lined up with an event to the conversion.
+ * There is one window, starting again throws away what was collected. Must only
+ * be called from the osloop, it has the same priority as the dma interrupt that
+ * adds the conversions.
+ *
+ * @param	channel		channel to average
+ * @retval	none
+ */
+// ****************************************************************************
+void ADC_StartWindow(const uint8_t channel)
+{
+	m_windowTotal = 0u;
+	m_windowCount = 0u;
+	m_windowChannel = channel;
+}
+
+
+// ****************************************************************************
+/*!
+ * ADC_GetWindowAverage closes the window and returns the average of the conversions
+ * collected since ADC_StartWindow, corrected for AVDD variance. Must only be called
+ * from the osloop.
+ *
+ * @param	none
+ * @retval	uint16_t	average, 0 if no conversions were collected
+ */
+// ****************************************************************************
+uint16_t ADC_GetWindowAverage(void)
+{
+	m_windowChannel = MAX_ANALOG_CHANNELS;
+
+	if (0u == m_windowCount)
+	{
+		return 0u;
+	}
+
+	return ADC_ApplyRefScale((uint16_t)((m_windowTotal + (m_windowCount / 2u)) / m_windowCount), m_adcRefScale);
+}
+
 // ----------------------------------------------------------------------------
 // ----------------------------------------------------------------------------
 // FUNCTIONS WITH LOCAL SCOPE
 // ----------------------------------------------------------------------------
 // ----------------------------------------------------------------------------
+// ****************************************************************************
+/*!
+ * ADC_ProcessSequence updates the average filters with a completed conversion
+ * sequence, runs in the DMA interrupt. The current sense difference is taken
+ * here so the service routine does not see the totals half way through an
+ * update.
+ *
+ * @param	p_adcVals	pointer to the sequence in the dma buffer
+ * @retval	none
+ */
+// ****************************************************************************
+static void ADC_ProcessSequence(const uint16_t * const p_adcVals)
+{
+	const uint32_t sysTime = HAL_GetTick();
+	uint8_t i;
+
+	if (m_adcSettleCount > 0u)
+	{
+		// Discard conversions after wake from stop, filters hold seeded values
+		m_adcSettleCount--;
+
+		return;
+	}
+
+	SEQLOCK_WriteBegin(&m_adcSeq);
+
+	for (i = 0u; i < MAX_ANALOG_CHANNELS; i++)
+	{
+		if (false == m_aveFilterReady)
+		{
+			// Spam in values to fill the buffer
+			AVE_FILTER_U16_Update(&m_aveFilters[i], p_adcVals[i]);
+		}
+		else
+		{
+			AVE_FILTER_U16_UpdatePeriodic(&m_aveFilters[i], p_adcVals[i], sysTime);
+		}
+	}
+
+	m_csTotalDiff = (int32_t)(AVE_FILTER_U16_GetScaledTotal(&m_aveFilters[ANALOG_CHANNEL_CS1])
+								- AVE_FILTER_U16_GetScaledTotal(&m_aveFilters[ANALOG_CHANNEL_CS2]));
+
+	SEQLOCK_WriteEnd(&m_adcSeq);
+
+	if ( (m_windowChannel < MAX_ANALOG_CHANNELS) && (m_windowCount < UINT16_MAX) )
+	{
+		m_windowTotal += p_adcVals[m_windowChannel];
+		m_windowCount++;
+	}
+
+	m_newSequence = true;
+
+	if (0u == m_aveFilters[0].nextValueIdx)
+	{
+		m_aveFilterReady = true;
+	}
+}
+
+
+// ****************************************************************************
+/*!
+ * ADC_ApplyRefScale applies the internal reference correction to an ADC value.
+ *
+ * @param	value		ADC value
+ * @param	refScale	16/16 fixed point reference correction
+ * @retval	uint16_t	corrected value
+ */
+// ****************************************************************************
+static uint16_t ADC_ApplyRefScale(const uint16_t value, const uint32_t refScale)
+{
+	/* Apply fixed point multipler */
+	uint32_t result = value * refScale;
+
+	// Round up if halfway there
+	if (0u != (result & 0x8000u))
+	{
+		result += 0x10000u;
+	}
+
+	return (uint16_t)(result >> 16u);
+}
@@ -120,7 +120,7 @@ uint16_t ANALOG_GetAVDDMv(void)
 // ****************************************************************************
 uint16_t ANALOG_GetMv(const uint8_t channelIdx)
 {
-	const uint16_t adcVal = ADC_CalibrateValue(ADC_GetAverageValue(channelIdx));
+	const uint16_t adcVal = ADC_GetCalibratedAverage(channelIdx);
 
 	return UTIL_FixMul_U32_U16(ADC_TO_MV_K, adcVal);
 }
@@ -137,7 +137,7 @@ uint16_t ANALOG_GetMv(const uint8_t channelIdx)
 // ****************************************************************************
 uint16_t ANALOG_GetBatteryMv(void)
 {
-	const uint16_t adcVal = ADC_CalibrateValue(ADC_GetAverageValue(ANALOG_CHANNEL_VBAT));
+	const uint16_t adcVal = ADC_GetCalibratedAverage(ANALOG_CHANNEL_VBAT);
 
 	return UTIL_FixMul_U32_U16(ADC_TO_BATTMV_K, adcVal);
 }
@@ -154,7 +154,7 @@ uint16_t ANALOG_GetBatteryMv(void)
 // ****************************************************************************
 uint16_t ANALOG_Get5VRailMv(void)
 {
-	const uint16_t adcVal = ADC_CalibrateValue(ADC_GetAverageValue(ANALOG_CHANNEL_CS1));
+	const uint16_t adcVal = ADC_GetCalibratedAverage(ANALOG_CHANNEL_CS1);
 
 	return UTIL_FixMul_U32_U16(ADC_TO_5VRAIL_MV_K, adcVal);
 }
@@ -172,9 +172,17 @@ uint16_t ANALOG_Get5VRailMv(void)
 // ****************************************************************************
 int16_t ANALOG_Get5VRailMa(void)
 {
-	const int16_t diff = ADC_GetAverageValue(ANALOG_CHANNEL_CS1) - ADC_GetAverageValue(ANALOG_CHANNEL_CS2);
-	const bool neg = (diff < 0u) ? true : false;
-	const uint16_t convVal = UTIL_FixMul_U32_U16(ADC_TO_5VRAIL_ISEN_K, ADC_CalibrateValue(abs(diff)));
+	ADC_Snapshot_t adcSnapshot;
+	int16_t diff;
+	bool neg;
+	uint16_t convVal;
+
+	// Both channels from the same sequence or the difference is meaningless
+	ADC_GetSnapshot(&adcSnapshot);
+
+	diff = adcSnapshot.average[ANALOG_CHANNEL_CS1] - adcSnapshot.average[ANALOG_CHANNEL_CS2];
+	neg = (diff < 0u) ? true : false;
+	convVal = UTIL_FixMul_U32_U16(ADC_TO_5VRAIL_ISEN_K, ADC_CalibrateValue(abs(diff)));
 
 	return (neg == true) ? -convVal : convVal;
 }
@@ -7,6 +7,15 @@
  * 				by calling the periodic functions or manage time by calling the
  * 				update functions directly. To use the periodic update, the init
  * 				function must be called for the filter.
+ * 				Each filter is either a boxcar moving average, which needs the
+ * 				caller to give it AVE_FILTER_ELEMENT_COUNT elements of storage,
+ * 				or a fixed point first order IIR which needs no storage and has a
+ * 				quicker step response for the same noise (shift 3 is about the
+ * 				same noise as a 16 element boxcar). The IIR can have a short
+ * 				median in front of it to throw away single sample spikes. The IIR
+ * 				is seeded with the first value after a reset rather than rising
+ * 				from zero. The element index still counts round for all types so
+ * 				the caller can tell when the filter has seen a full boxcar worth.
  *
  */
 // ----------------------------------------------------------------------------
@@ -22,6 +31,12 @@
 // ----------------------------------------------------------------------------
 // Function prototypes for functions that only have scope in this module:
 
+static void AVE_FILTER_U16_Fill(AVE_FILTER_U16_t * const p_filter, const uint16_t value);
+static uint16_t AVE_FILTER_U16_Median(const uint16_t * const p_window);
+static void AVE_FILTER_S32_Fill(AVE_FILTER_S32_t * const p_filter, const int32_t value);
+static int32_t AVE_FILTER_S32_Median(const int32_t * const p_window);
+static uint16_t AVE_FILTER_GetSettleCount(const uint8_t type, const uint8_t iirShift);
+
 // ----------------------------------------------------------------------------
 // Variables that have scope from outside this module:
 
@@ -70,15 +85,48 @@ void AVE_FILTER_U16_UpdatePeriodic(AVE_FILTER_U16_t * const p_filter,
 // ****************************************************************************
 void AVE_FILTER_U16_Update(AVE_FILTER_U16_t * const p_filter, const uint16_t newValue)
 {
+	uint16_t value = newValue;
+	int32_t state;
+
 	if (NULL != p_filter)
 	{
-		/* Add in new value */
-		p_filter->total -= p_filter->elements[p_filter->nextValueIdx];
-		p_filter->total += newValue;
-		p_filter->elements[p_filter->nextValueIdx] = newValue;
+		if (AVE_FILTER_TYPE_BOXCAR == p_filter->type)
+		{
+			/* Add in new value */
+			p_filter->total -= p_filter->p_elements[p_filter->nextValueIdx];
+			p_filter->total += newValue;
+			p_filter->p_elements[p_filter->nextValueIdx] = newValue;
 
-		/* Calculate filter average */
-		p_filter->average = p_filter->total / AVE_FILTER_ELEMENT_COUNT;
+			/* Calculate filter average */
+			p_filter->average = p_filter->total / AVE_FILTER_ELEMENT_COUNT;
+		}
+		else if (false == p_filter->seeded)
+		{
+			AVE_FILTER_U16_Fill(p_filter, newValue);
+			p_filter->seeded = true;
+		}
+		else
+		{
+			if (AVE_FILTER_TYPE_MEDIAN_IIR == p_filter->type)
+			{
+				p_filter->median[p_filter->medianIdx] = newValue;
+
+				if (AVE_FILTER_MEDIAN_COUNT == ++p_filter->medianIdx)
+				{
+					p_filter->medianIdx = 0u;
+				}
+
+				value = AVE_FILTER_U16_Median(p_filter->median);
+			}
+
+			/* Move the state towards the new value */
+			state = (int32_t)p_filter->total;
+			state += (((int32_t)value << AVE_FILTER_U16_IIR_FRAC_BITS) - state) >> p_filter->iirShift;
+			p_filter->total = (uint32_t)state;
+
+			p_filter->average = (uint16_t)((p_filter->total + (1ul << (AVE_FILTER_U16_IIR_FRAC_BITS - 1u)))
+									>> AVE_FILTER_U16_IIR_FRAC_BITS);
+		}
 
 		/* Update pointer to next value index */
 		if (AVE_FILTER_ELEMENT_COUNT ==  ++ p_filter->nextValueIdx)
@@ -94,18 +142,30 @@ void AVE_FILTER_U16_Update(AVE_FILTER_U16_t * const p_filter, const uint16_t new
 // ****************************************************************************
 /*!
  * AVE_FILTER_U16_InitPeriodic resets all the internal filter values and initialises
- * the values for performing periodic updates
+ * the values for performing periodic updates. A boxcar filter without element
+ * storage is run as an IIR.
  *
  * @param	p_filter		filter to reset
  * @param	sysTime			current value of the system tick timer
- * @param	filterPeriodMs	filter update period in milliseconds
+ * @param	p_config		filter update period in milliseconds, type and IIR shift
+ * @param	p_elements		AVE_FILTER_ELEMENT_COUNT elements for a boxcar, else NULL
  * @retval	none
  */
 // ****************************************************************************
-void AVE_FILTER_U16_InitPeriodic(AVE_FILTER_U16_t * const p_filter, const uint32_t sysTime, const uint16_t filterPeriodMs)
+void AVE_FILTER_U16_InitPeriodic(AVE_FILTER_U16_t * const p_filter, const uint32_t sysTime,
+									const AVE_FILTER_Config_t * const p_config, uint16_t * const p_elements)
 {
 	MS_TIMEREF_INIT(p_filter->lastFilterUpdateTime, sysTime);
-	p_filter->filterPeriodMs = filterPeriodMs;
+	p_filter->filterPeriodMs = p_config->filterPeriodMs;
+	p_filter->type = p_config->type;
+	p_filter->iirShift = (p_config->iirShift > AVE_FILTER_IIR_SHIFT_MAX) ? AVE_FILTER_IIR_SHIFT_MAX : p_config->iirShift;
+	p_filter->p_elements = p_elements;
+
+	if ( (AVE_FILTER_TYPE_BOXCAR == p_filter->type) && (NULL == p_elements) )
+	{
+		p_filter->type = AVE_FILTER_TYPE_IIR;
+	}
+
 	AVE_FILTER_U16_Reset(p_filter);
 }
 
@@ -120,22 +180,95 @@ void AVE_FILTER_U16_InitPeriodic(AVE_FILTER_U16_t * const p_filter, const uint32
 // ****************************************************************************
 void AVE_FILTER_U16_Reset(AVE_FILTER_U16_t * const p_filter)
 {
+	uint8_t i;
+
 	if (NULL != p_filter)
 	{
 		p_filter->total = 0u;
 		p_filter->average = 0u;
-		p_filter->nextValueIdx = AVE_FILTER_ELEMENT_COUNT;
+		p_filter->nextValueIdx = 0u;
+		p_filter->medianIdx = 0u;
 		p_filter->lastVal = 0u;
+		p_filter->seeded = false;
+
+		for (i = 0u; i < AVE_FILTER_MEDIAN_COUNT; i++)
+		{
+			p_filter->median[i] = 0u;
+		}
 
-		while (p_filter->nextValueIdx > 0u)
+		if (AVE_FILTER_TYPE_BOXCAR == p_filter->type)
 		{
-			p_filter->nextValueIdx--;
-			p_filter->elements[p_filter->nextValueIdx] = 0u;
+			for (i = 0u; i < AVE_FILTER_ELEMENT_COUNT; i++)
+			{
+				p_filter->p_elements[i] = 0u;
+			}
 		}
 	}
 }
 
 
+// ****************************************************************************
+/*!
+ * AVE_FILTER_U16_Seed fills the filter with a value so the average is immediately
+ * valid, the update period is kept and restarted from sysTime.
+ *
+ * @param	p_filter	filter to seed
+ * @param	value		value to fill the filter with
+ * @param	sysTime		current value of the system tick timer
+ * @retval	none
+ */
+// ****************************************************************************
+void AVE_FILTER_U16_Seed(AVE_FILTER_U16_t * const p_filter, const uint16_t value, const uint32_t sysTime)
+{
+	if (NULL != p_filter)
+	{
+		MS_TIMEREF_INIT(p_filter->lastFilterUpdateTime, sysTime);
+
+		AVE_FILTER_U16_Fill(p_filter, value);
+
+		p_filter->nextValueIdx = 0u;
+		p_filter->lastVal = value;
+		p_filter->seeded = true;
+	}
+}
+
+
+// ****************************************************************************
+/*!
+ * AVE_FILTER_U16_GetScaledTotal returns the filter state scaled the same as the
+ * sum of a full boxcar, AVE_FILTER_ELEMENT_COUNT times the average but with the
+ * extra resolution the filter has.
+ *
+ * @param	p_filter	filter to read
+ * @retval	uint32_t	average * AVE_FILTER_ELEMENT_COUNT
+ */
+// ****************************************************************************
+uint32_t AVE_FILTER_U16_GetScaledTotal(const AVE_FILTER_U16_t * const p_filter)
+{
+	if (AVE_FILTER_TYPE_BOXCAR == p_filter->type)
+	{
+		return p_filter->total;
+	}
+
+	return (uint32_t)(((uint64_t)p_filter->total * AVE_FILTER_ELEMENT_COUNT) >> AVE_FILTER_U16_IIR_FRAC_BITS);
+}
+
+
+// ****************************************************************************
+/*!
+ * AVE_FILTER_U16_GetSettleCount returns the number of updates the filter takes
+ * to follow a step to within 0.1%.
+ *
+ * @param	p_filter	filter to read
+ * @retval	uint16_t	number of updates
+ */
+// ****************************************************************************
+uint16_t AVE_FILTER_U16_GetSettleCount(const AVE_FILTER_U16_t * const p_filter)
+{
+	return AVE_FILTER_GetSettleCount(p_filter->type, p_filter->iirShift);
+}
+
+
 // ****************************************************************************
 /*!
  * AVE_FILTER_S32_UpdatePeriodic updates the filter with a new value and calculates
@@ -163,7 +296,7 @@ void AVE_FILTER_S32_UpdatePeriodic(AVE_FILTER_S32_t * const p_filter,
 
 // ****************************************************************************
 /*!
- * AVE_FILTER_U16_Update updates the filter with a new value and calculates the
+ * AVE_FILTER_S32_Update updates the filter with a new value and calculates the
  * average
  *
  * @param	p_filter	filter to update
@@ -173,15 +306,46 @@ void AVE_FILTER_S32_UpdatePeriodic(AVE_FILTER_S32_t * const p_filter,
 // ****************************************************************************
 void AVE_FILTER_S32_Update(AVE_FILTER_S32_t * const p_filter, const int32_t newValue)
 {
+	int32_t value = newValue;
+
 	if (NULL != p_filter)
 	{
-		/* Add in new value */
-		p_filter->total -= p_filter->elements[p_filter->nextValueIdx];
-		p_filter->total += newValue;
-		p_filter->elements[p_filter->nextValueIdx] = newValue;
+		if (AVE_FILTER_TYPE_BOXCAR == p_filter->type)
+		{
+			/* Add in new value */
+			p_filter->total -= p_filter->p_elements[p_filter->nextValueIdx];
+			p_filter->total += newValue;
+			p_filter->p_elements[p_filter->nextValueIdx] = newValue;
 
-		/* Calculate filter average */
-		p_filter->average = p_filter->total / AVE_FILTER_ELEMENT_COUNT;
+			/* Calculate filter average */
+			p_filter->average = p_filter->total / AVE_FILTER_ELEMENT_COUNT;
+		}
+		else if (false == p_filter->seeded)
+		{
+			AVE_FILTER_S32_Fill(p_filter, newValue);
+			p_filter->seeded = true;
+		}
+		else
+		{
+			if (AVE_FILTER_TYPE_MEDIAN_IIR == p_filter->type)
+			{
+				p_filter->median[p_filter->medianIdx] = newValue;
+
+				if (AVE_FILTER_MEDIAN_COUNT == ++p_filter->medianIdx)
+				{
+					p_filter->medianIdx = 0u;
+				}
+
+				value = AVE_FILTER_S32_Median(p_filter->median);
+			}
+
+			/* Move the state towards the new value */
+			p_filter->total += (((int64_t)value * ((int64_t)1 << AVE_FILTER_S32_IIR_FRAC_BITS)) - p_filter->total)
+									>> p_filter->iirShift;
+
+			p_filter->average = (int32_t)((p_filter->total + ((int64_t)1 << (AVE_FILTER_S32_IIR_FRAC_BITS - 1u)))
+									>> AVE_FILTER_S32_IIR_FRAC_BITS);
+		}
 
 		/* Update pointer to next value index */
 		if (AVE_FILTER_ELEMENT_COUNT ==  ++p_filter->nextValueIdx)
@@ -204,17 +368,28 @@ void AVE_FILTER_S32_Update(AVE_FILTER_S32_t * const p_filter, const int32_t newV
 // ****************************************************************************
 void AVE_FILTER_S32_Reset(AVE_FILTER_S32_t * const p_filter)
 {
+	uint8_t i;
+
 	if (NULL != p_filter)
 	{
-		p_filter->total = 0u;
-		p_filter->average = 0u;
-		p_filter->nextValueIdx = AVE_FILTER_ELEMENT_COUNT;
-		p_filter->lastVal = 0u;
+		p_filter->total = 0;
+		p_filter->average = 0;
+		p_filter->nextValueIdx = 0u;
+		p_filter->medianIdx = 0u;
+		p_filter->lastVal = 0;
+		p_filter->seeded = false;
+
+		for (i = 0u; i < AVE_FILTER_MEDIAN_COUNT; i++)
+		{
+			p_filter->median[i] = 0;
+		}
 
-		while (p_filter->nextValueIdx > 0u)
+		if (AVE_FILTER_TYPE_BOXCAR == p_filter->type)
 		{
-			p_filter->nextValueIdx--;
-			p_filter->elements[p_filter->nextValueIdx] = 0u;
+			for (i = 0u; i < AVE_FILTER_ELEMENT_COUNT; i++)
+			{
+				p_filter->p_elements[i] = 0;
+			}
 		}
 	}
 }
@@ -223,24 +398,240 @@ void AVE_FILTER_S32_Reset(AVE_FILTER_S32_t * const p_filter)
 // ****************************************************************************
 /*!
  * AVE_FILTER_S32_InitPeriodic resets all the internal filter values and initialises
- * the values for performing periodic updates
+ * the values for performing periodic updates. A boxcar filter without element
+ * storage is run as an IIR.
  *
  * @param	p_filter		filter to reset
  * @param	sysTime			current value of the system tick timer
- * @param	filterPeriodMs	filter update period in milliseconds
+ * @param	p_config		filter update period in milliseconds, type and IIR shift
+ * @param	p_elements		AVE_FILTER_ELEMENT_COUNT elements for a boxcar, else NULL
  * @retval	none
  */
 // ****************************************************************************
-void AVE_FILTER_S32_InitPeriodic(AVE_FILTER_S32_t * const p_filter, const uint32_t sysTime, const uint16_t filterPeriodMs)
+void AVE_FILTER_S32_InitPeriodic(AVE_FILTER_S32_t * const p_filter, const uint32_t sysTime,
+									const AVE_FILTER_Config_t * const p_config, int32_t * const p_elements)
 {
 	MS_TIMEREF_INIT(p_filter->lastFilterUpdateTime, sysTime);
-	p_filter->filterPeriodMs = filterPeriodMs;
+	p_filter->filterPeriodMs = p_config->filterPeriodMs;
+	p_filter->type = p_config->type;
+	p_filter->iirShift = (p_config->iirShift > AVE_FILTER_IIR_SHIFT_MAX) ? AVE_FILTER_IIR_SHIFT_MAX : p_config->iirShift;
+	p_filter->p_elements = p_elements;
+
+	if ( (AVE_FILTER_TYPE_BOXCAR == p_filter->type) && (NULL == p_elements) )
+	{
+		p_filter->type = AVE_FILTER_TYPE_IIR;
+	}
+
 	AVE_FILTER_S32_Reset(p_filter);
 }
 
 
+// ****************************************************************************
+/*!
+ * AVE_FILTER_S32_Seed fills the filter with a value so the average is immediately
+ * valid, the update period is kept and restarted from sysTime.
+ *
+ * @param	p_filter	filter to seed
+ * @param	value		value to fill the filter with
+ * @param	sysTime		current value of the system tick timer
+ * @retval	none
+ */
+// ****************************************************************************
+void AVE_FILTER_S32_Seed(AVE_FILTER_S32_t * const p_filter, const int32_t value, const uint32_t sysTime)
+{
+	if (NULL != p_filter)
+	{
+		MS_TIMEREF_INIT(p_filter->lastFilterUpdateTime, sysTime);
+
+		AVE_FILTER_S32_Fill(p_filter, value);
+
+		p_filter->nextValueIdx = 0u;
+		p_filter->lastVal = value;
+		p_filter->seeded = true;
+	}
+}
+
+
+// ****************************************************************************
+/*!
+ * AVE_FILTER_S32_GetSettleCount returns the number of updates the filter takes
+ * to follow a step to within 0.1%.
+ *
+ * @param	p_filter	filter to read
+ * @retval	uint16_t	number of updates
+ */
+// ****************************************************************************
+uint16_t AVE_FILTER_S32_GetSettleCount(const AVE_FILTER_S32_t * const p_filter)
+{
+	return AVE_FILTER_GetSettleCount(p_filter->type, p_filter->iirShift);
+}
+
+
 // ----------------------------------------------------------------------------
 // ----------------------------------------------------------------------------
 // FUNCTIONS WITH LOCAL SCOPE
 // ----------------------------------------------------------------------------
 // ----------------------------------------------------------------------------
+// ****************************************************************************
+/*!
+ * AVE_FILTER_U16_Fill sets the whole filter state to a value.
+ *
+ * @param	p_filter	filter to fill
+ * @param	value		value to fill the filter with
+ * @retval	none
+ */
+// ****************************************************************************
+static void AVE_FILTER_U16_Fill(AVE_FILTER_U16_t * const p_filter, const uint16_t value)
+{
+	uint8_t i;
+
+	for (i = 0u; i < AVE_FILTER_MEDIAN_COUNT; i++)
+	{
+		p_filter->median[i] = value;
+	}
+
+	if (AVE_FILTER_TYPE_BOXCAR == p_filter->type)
+	{
+		for (i = 0u; i < AVE_FILTER_ELEMENT_COUNT; i++)
+		{
+			p_filter->p_elements[i] = value;
+		}
+
+		p_filter->total = (uint32_t)value * AVE_FILTER_ELEMENT_COUNT;
+	}
+	else
+	{
+		p_filter->total = (uint32_t)value << AVE_FILTER_U16_IIR_FRAC_BITS;
+	}
+
+	p_filter->average = value;
+}
+
+
+// ****************************************************************************
+/*!
+ * AVE_FILTER_U16_Median works out the median of the median window, insertion
+ * sort of a copy is quickest for so few values.
+ *
+ * @param	p_window	AVE_FILTER_MEDIAN_COUNT values
+ * @retval	uint16_t	median value
+ */
+// ****************************************************************************
+static uint16_t AVE_FILTER_U16_Median(const uint16_t * const p_window)
+{
+	uint16_t sorted[AVE_FILTER_MEDIAN_COUNT];
+	uint16_t value;
+	uint8_t i;
+	uint8_t j;
+
+	for (i = 0u; i < AVE_FILTER_MEDIAN_COUNT; i++)
+	{
+		value = p_window[i];
+
+		for (j = i; (j > 0u) && (sorted[j - 1u] > value); j--)
+		{
+			sorted[j] = sorted[j - 1u];
+		}
+
+		sorted[j] = value;
+	}
+
+	return sorted[AVE_FILTER_MEDIAN_COUNT / 2u];
+}
+
+
+// ****************************************************************************
+/*!
+ * AVE_FILTER_S32_Fill sets the whole filter state to a value.
+ *
+ * @param	p_filter	filter to fill
+ * @param	value		value to fill the filter with
+ * @retval	none
+ */
+// ****************************************************************************
+static void AVE_FILTER_S32_Fill(AVE_FILTER_S32_t * const p_filter, const int32_t value)
+{
+	uint8_t i;
+
+	for (i = 0u; i < AVE_FILTER_MEDIAN_COUNT; i++)
+	{
+		p_filter->median[i] = value;
+	}
+
+	if (AVE_FILTER_TYPE_BOXCAR == p_filter->type)
+	{
+		for (i = 0u; i < AVE_FILTER_ELEMENT_COUNT; i++)
+		{
+			p_filter->p_elements[i] = value;
+		}
+
+		p_filter->total = (int64_t)value * AVE_FILTER_ELEMENT_COUNT;
+	}
+	else
+	{
+		p_filter->total = (int64_t)value * ((int64_t)1 << AVE_FILTER_S32_IIR_FRAC_BITS);
+	}
+
+	p_filter->average = value;
+}
+
+
+// ****************************************************************************
+/*!
+ * AVE_FILTER_S32_Median works out the median of the median window, insertion
+ * sort of a copy is quickest for so few values.
+ *
+ * @param	p_window	AVE_FILTER_MEDIAN_COUNT values
+ * @retval	int32_t		median value
+ */
+// ****************************************************************************
+static int32_t AVE_FILTER_S32_Median(const int32_t * const p_window)
+{
+	int32_t sorted[AVE_FILTER_MEDIAN_COUNT];
+	int32_t value;
+	uint8_t i;
+	uint8_t j;
+
+	for (i = 0u; i < AVE_FILTER_MEDIAN_COUNT; i++)
+	{
+		value = p_window[i];
+
+		for (j = i; (j > 0u) && (sorted[j - 1u] > value); j--)
+		{
+			sorted[j] = sorted[j - 1u];
+		}
+
+		sorted[j] = value;
+	}
+
+	return sorted[AVE_FILTER_MEDIAN_COUNT / 2u];
+}
+
+
+// ****************************************************************************
+/*!
+ * AVE_FILTER_GetSettleCount works out how many updates a filter type takes to
+ * settle. A boxcar is there after one full buffer, the IIR is within 0.1% after
+ * 7 time constants of 2^shift updates, the median delays it by half its length.
+ *
+ * @param	type		filter type
+ * @param	iirShift	IIR shift
+ * @retval	uint16_t	number of updates
+ */
+// ****************************************************************************
+static uint16_t AVE_FILTER_GetSettleCount(const uint8_t type, const uint8_t iirShift)
+{
+	uint16_t result = AVE_FILTER_ELEMENT_COUNT;
+
+	if (AVE_FILTER_TYPE_BOXCAR != type)
+	{
+		result = 7u << iirShift;
+
+		if (AVE_FILTER_TYPE_MEDIAN_IIR == type)
+		{
+			result += AVE_FILTER_MEDIAN_COUNT / 2u;
+		}
+	}
+
+	return result;
+}
@@ -0,0 +1,598 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file		battery_char.c
+ * @date       	18 October 2026
+ * @brief       Battery characterisation by pulsing a resistor load on the VSys
+ * 				output. The load is switched from the osloop so the edges are on
+ * 				the ms tick, VBAT is averaged straight from the adc conversions
+ * 				for a short window before and after each edge. A cycle is the load
+ * 				off then on, at the end of each cycle a record is made of the open
+ * 				circuit voltage before the load goes on, the loaded voltage, the load
+ * 				current, the internal resistance from the rising and falling edges
+ * 				and the charge taken out since the start. The host harvests the
+ * 				records to find the ocv and resistance at 10, 50 and 90% charge
+ * 				for the battery profile. The test ends when the open circuit voltage
+ * 				drops below the end voltage or the host stops it, VSys is then
+ * 				turned off.
+ *
+ * 				The load current is worked out from the loaded voltage and the
+ * 				load resistance given by the host, VSys must have nothing else on it.
+ * 				The host should turn off charging from the GPIO 5V input before
+ * 				starting.
+ *
+ * 				Command write:	[0] BATCHAR_CMD_START, [1..2] load on time mS,
+ * 								[3..4] load off time mS, [5..6] delay after edge mS,
+ * 								[7..8] end voltage mV, [9..10] load resistance mOhm
+ * 								[0] BATCHAR_CMD_STOP
+ * 								[0] BATCHAR_CMD_RELEASE, [1] number of records read
+ * 				Record read:	[0] status, [1] records waiting, [2..3] records dropped,
+ * 								then the oldest BATCHAR_READ_RECORDS records:
+ * 								[0..1] sequence, [2..3] time S, [4..5] ocv mV,
+ * 								[6..7] loaded mV, [8..9] load mA, [10..11] resistance mOhm,
+ * 								[12..13] discharged 0.1mAh, [14..15] fuel gauge soc 0.1%.
+ * 								All values little endian, records stay until released.
+ *
+ */
+// ----------------------------------------------------------------------------
+// Include section - add all #includes here:
+
+#include "main.h"
+#include "system_conf.h"
+#include "time_count.h"
+#include "util.h"
+
+#include "adc.h"
+#include "iodrv.h"
+#include "analog.h"
+#include "fuel_gauge_lc709203f.h"
+#include "power_source.h"
+
+#include "battery_char.h"
+
+
+// ----------------------------------------------------------------------------
+// Defines section - add all #defines here:
+
+#define BATCHAR_CMD_STOP			0x00u
+#define BATCHAR_CMD_RELEASE			0x0Au
+#define BATCHAR_CMD_START			0xC5u
+
+#define BATCHAR_START_LEN			11u
+#define BATCHAR_RECORD_LEN			16u
+#define BATCHAR_READ_RECORDS		3u
+#define BATCHAR_READ_LEN			(4u + (BATCHAR_READ_RECORDS * BATCHAR_RECORD_LEN))
+
+#define BATCHAR_VSYS_ON_SETTING		21u		/* 2.1A limit */
+#define BATCHAR_VSYS_OFF_SETTING	0u
+
+/* Steps within a load on or off phase */
+#define BATCHAR_STEP_AFTER_EDGE		0u
+#define BATCHAR_STEP_AFTER_WINDOW	1u
+#define BATCHAR_STEP_BEFORE_EDGE	2u
+#define BATCHAR_STEP_EDGE			3u
+
+typedef struct
+{
+	uint16_t seq;
+	uint16_t timeS;
+	uint16_t ocvMv;
+	uint16_t loadMv;
+	uint16_t loadMa;
+	uint16_t rMohm;
+	uint16_t dischargedPt1MaHr;
+	uint16_t socPt1;
+} BATCHAR_Record_t;
+
+
+// ----------------------------------------------------------------------------
+// Function prototypes for functions that only have scope in this module:
+
+static void BATCHAR_SampleAfterEdge(const uint32_t sysTime);
+static bool BATCHAR_SampleBeforeEdge(const uint32_t sysTime);
+static void BATCHAR_AddRecord(const uint32_t sysTime);
+static uint16_t BATCHAR_GetLoadMa(const uint16_t loadMv);
+static uint16_t BATCHAR_GetResistanceMohm(const uint16_t highMv, const uint16_t lowMv, const uint16_t loadMa);
+static void BATCHAR_Stop(const BATCHAR_Status_t status);
+
+
+// ----------------------------------------------------------------------------
+// Variables that only have scope in this module:
+
+static volatile BATCHAR_Status_t m_status;
+static volatile bool m_stopRequest;
+static volatile bool m_vsysRelease;
+
+static uint16_t m_onTimeMs;
+static uint16_t m_offTimeMs;
+static uint16_t m_edgeDelayMs;
+static uint16_t m_endMv;
+static uint16_t m_loadMohm;
+
+static bool m_loadOn;
+static bool m_cycleValid;
+static uint8_t m_phaseStep;
+static uint32_t m_phaseStartTime;
+static uint32_t m_loadOnTime;
+static uint32_t m_startTime;
+
+static uint16_t m_ocvMv;
+static uint16_t m_loadOnMv;
+static uint16_t m_loadEndMv;
+
+static uint32_t m_chargeMaMs;
+static uint32_t m_chargeMaS;
+
+static BATCHAR_Record_t m_records[BATCHAR_RECORD_COUNT];
+static volatile uint8_t m_recordHead;
+static volatile uint8_t m_recordTail;
+static uint16_t m_recordSeq;
+static uint16_t m_droppedCount;
+
+
+// ----------------------------------------------------------------------------
+// Variables that have scope from outside this module:
+
+
+// ----------------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+// FUNCTIONS WITH GLOBAL SCOPE
+// ----------------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+// ****************************************************************************
+/*!
+ * BATCHAR_Init configures the module to a known initial state
+ * @param	none
+ * @retval	none
+ */
+// ****************************************************************************
+void BATCHAR_Init(void)
+{
+	m_status = BATCHAR_STATUS_IDLE;
+	m_stopRequest = false;
+	m_vsysRelease = false;
+	m_recordHead = 0u;
+	m_recordTail = 0u;
+	m_recordSeq = 0u;
+	m_droppedCount = 0u;
+}
+
+
+// ****************************************************************************
+/*!
+ * BATCHAR_Service runs the load timing from the osloop. Each phase takes a window
+ * of VBAT after the delay following its edge and another window just before the
+ * edge that ends it. The phase start is moved on by the phase length rather
+ * than the time the edge happened so the cycle period does not drift with the
+ * osloop period.
+ *
+ * @param	sysTime		current value of the ms tick timer
+ * @retval	none
+ */
+// ****************************************************************************
+void BATCHAR_Service(const uint32_t sysTime)
+{
+	const uint32_t phaseTime = MS_TIMEREF_DIFF(m_phaseStartTime, sysTime);
+	const uint32_t phaseLength = (true == m_loadOn) ? m_onTimeMs : m_offTimeMs;
+
+	if (BATCHAR_STATUS_RUNNING != m_status)
+	{
+		return;
+	}
+
+	if (true == m_stopRequest)
+	{
+		BATCHAR_Stop(BATCHAR_STATUS_STOPPED);
+
+		return;
+	}
+
+	// Power source turned VSys off, battery too low
+	if (false == POWERSOURCE_IsVsysEnabled())
+	{
+		BATCHAR_Stop(BATCHAR_STATUS_VSYS_FAULT);
+
+		return;
+	}
+
+	switch (m_phaseStep)
+	{
+	case BATCHAR_STEP_AFTER_EDGE:
+		if (phaseTime >= m_edgeDelayMs)
+		{
+			ADC_StartWindow(ANALOG_CHANNEL_VBAT);
+			m_phaseStep = BATCHAR_STEP_AFTER_WINDOW;
+		}
+		break;
+
+	case BATCHAR_STEP_AFTER_WINDOW:
+		if (phaseTime >= (m_edgeDelayMs + BATCHAR_WINDOW_MS))
+		{
+			BATCHAR_SampleAfterEdge(sysTime);
+			m_phaseStep = BATCHAR_STEP_BEFORE_EDGE;
+		}
+		break;
+
+	case BATCHAR_STEP_BEFORE_EDGE:
+		if (phaseTime >= (phaseLength - BATCHAR_WINDOW_MS))
+		{
+			ADC_StartWindow(ANALOG_CHANNEL_VBAT);
+			m_phaseStep = BATCHAR_STEP_EDGE;
+		}
+		break;
+
+	default:
+		if (phaseTime >= phaseLength)
+		{
+			if (true == BATCHAR_SampleBeforeEdge(sysTime))
+			{
+				m_phaseStartTime += phaseLength;
+				m_phaseStep = BATCHAR_STEP_AFTER_EDGE;
+			}
+		}
+		break;
+	}
+}
+
+
+// ****************************************************************************
+/*!
+ * BATCHAR_Task hands VSys back to the power source module once the service has
+ * stopped the test.
+ *
+ * @param	none
+ * @retval	none
+ */
+// ****************************************************************************
+void BATCHAR_Task(void)
+{
+	if (true == m_vsysRelease)
+	{
+		m_vsysRelease = false;
+
+		POWERSOURCE_SetVSysSwitchState(BATCHAR_VSYS_OFF_SETTING);
+	}
+}
+
+
+// ****************************************************************************
+/*!
+ * BATCHAR_IsRunning lets the task manager know the test is running, it must not
+ * sleep or stretch the loop periods.
+ *
+ * @param	none
+ * @retval	bool		true = test running
+ */
+// ****************************************************************************
+bool BATCHAR_IsRunning(void)
+{
+	return (BATCHAR_STATUS_RUNNING == m_status);
+}
+
+
+// ****************************************************************************
+/*!
+ * BATCHAR_SetCommandData handles the command writes, start, stop and release
+ * records. The on and off times must leave room for the delay and two windows.
+ *
+ * @param	p_data		pointer to the command data
+ * @param	len			length of the command data
+ * @retval	none
+ */
+// ****************************************************************************
+void BATCHAR_SetCommandData(const uint8_t * const p_data, const uint16_t len)
+{
+	const uint32_t minPhaseMs = (2u * BATCHAR_WINDOW_MS);
+	uint8_t count;
+
+	if (len < 1u)
+	{
+		return;
+	}
+
+	if (BATCHAR_CMD_STOP == p_data[0u])
+	{
+		m_stopRequest = true;
+	}
+	else if ( (BATCHAR_CMD_RELEASE == p_data[0u]) && (len >= 2u) )
+	{
+		count = (m_recordHead + BATCHAR_RECORD_COUNT - m_recordTail) % BATCHAR_RECORD_COUNT;
+
+		if (p_data[1u] < count)
+		{
+			count = p_data[1u];
+		}
+
+		m_recordTail = (m_recordTail + count) % BATCHAR_RECORD_COUNT;
+	}
+	else if ( (BATCHAR_CMD_START == p_data[0u]) && (len >= BATCHAR_START_LEN)
+				&& (BATCHAR_STATUS_RUNNING != m_status) )
+	{
+		m_onTimeMs = UTIL_FromBytes_U16(&p_data[1u]);
+		m_offTimeMs = UTIL_FromBytes_U16(&p_data[3u]);
+		m_edgeDelayMs = UTIL_FromBytes_U16(&p_data[5u]);
+		m_endMv = UTIL_FromBytes_U16(&p_data[7u]);
+		m_loadMohm = UTIL_FromBytes_U16(&p_data[9u]);
+
+		if ( (m_onTimeMs < (m_edgeDelayMs + minPhaseMs)) || (m_offTimeMs < (m_edgeDelayMs + minPhaseMs))
+				|| (0u == m_loadMohm) )
+		{
+			m_status = BATCHAR_STATUS_BAD_CONFIG;
+
+			return;
+		}
+
+		m_recordHead = 0u;
+		m_recordTail = 0u;
+		m_recordSeq = 0u;
+		m_droppedCount = 0u;
+		m_chargeMaMs = 0u;
+		m_chargeMaS = 0u;
+		m_loadOn = false;
+		m_cycleValid = false;
+		m_phaseStep = BATCHAR_STEP_AFTER_EDGE;
+		m_stopRequest = false;
+
+		// Power source checks the battery can take it, the service holds the load off until the first edge
+		POWERSOURCE_SetVSysSwitchState(BATCHAR_VSYS_ON_SETTING);
+		IODRV_SetPin(IODRV_PIN_EXTVS_EN, false);
+
+		if (false == POWERSOURCE_IsVsysEnabled())
+		{
+			m_status = BATCHAR_STATUS_VSYS_FAULT;
+
+			return;
+		}
+
+		MS_TIME_COUNTER_INIT(m_startTime);
+		m_phaseStartTime = m_startTime;
+
+		m_status = BATCHAR_STATUS_RUNNING;
+	}
+}
+
+
+// ****************************************************************************
+/*!
+ * BATCHAR_GetRecordData fills the buffer with the status and the oldest records,
+ * the records are left in place until the host releases them so a corrupted read
+ * can be repeated. Called from the osloop by the host comms read service.
+ *
+ * @param	p_data		pointer to buffer to place the data, must hold BATCHAR_READ_LEN
+ * @param	p_len		pointer to length of data placed in the buffer
+ * @retval	none
+ */
+// ****************************************************************************
+void BATCHAR_GetRecordData(uint8_t * const p_data, uint16_t * const p_len)
+{
+	const uint8_t count = (m_recordHead + BATCHAR_RECORD_COUNT - m_recordTail) % BATCHAR_RECORD_COUNT;
+	uint8_t idx = m_recordTail;
+	uint8_t i;
+	uint8_t * p_record;
+
+	p_data[0u] = (uint8_t)m_status;
+	p_data[1u] = count;
+	UTIL_ToBytes_U16(m_droppedCount, &p_data[2u]);
+
+	for (i = 0u; i < BATCHAR_READ_RECORDS; i++)
+	{
+		p_record = &p_data[4u + (i * BATCHAR_RECORD_LEN)];
+
+		if (i < count)
+		{
+			UTIL_ToBytes_U16(m_records[idx].seq, &p_record[0u]);
+			UTIL_ToBytes_U16(m_records[idx].timeS, &p_record[2u]);
+			UTIL_ToBytes_U16(m_records[idx].ocvMv, &p_record[4u]);
+			UTIL_ToBytes_U16(m_records[idx].loadMv, &p_record[6u]);
+			UTIL_ToBytes_U16(m_records[idx].loadMa, &p_record[8u]);
+			UTIL_ToBytes_U16(m_records[idx].rMohm, &p_record[10u]);
+			UTIL_ToBytes_U16(m_records[idx].dischargedPt1MaHr, &p_record[12u]);
+			UTIL_ToBytes_U16(m_records[idx].socPt1, &p_record[14u]);
+
+			idx = (idx + 1u) % BATCHAR_RECORD_COUNT;
+		}
+		else
+		{
+			UTIL_ToBytes_U16(0u, &p_record[0u]);
+			UTIL_ToBytes_U16(0u, &p_record[2u]);
+			UTIL_ToBytes_U16(0u, &p_record[4u]);
+			UTIL_ToBytes_U16(0u, &p_record[6u]);
+			UTIL_ToBytes_U16(0u, &p_record[8u]);
+			UTIL_ToBytes_U16(0u, &p_record[10u]);
+			UTIL_ToBytes_U16(0u, &p_record[12u]);
+			UTIL_ToBytes_U16(0u, &p_record[14u]);
+		}
+	}
+
+	*p_len = BATCHAR_READ_LEN;
+}
+
+
+// ----------------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+// FUNCTIONS WITH LOCAL SCOPE
+// ----------------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+// ****************************************************************************
+/*!
+ * BATCHAR_SampleAfterEdge takes the VBAT window after an edge, with the load on
+ * it is the loaded voltage, with the load off it is the recovery that completes
+ * the cycle and makes the record. The first off phase has no cycle before it.
+ *
+ * @param	sysTime		current value of the ms tick timer
+ * @retval	none
+ */
+// ****************************************************************************
+static void BATCHAR_SampleAfterEdge(const uint32_t sysTime)
+{
+	if (true == m_loadOn)
+	{
+		m_loadOnMv = UTIL_FixMul_U32_U16(ADC_TO_BATTMV_K, ADC_GetWindowAverage());
+	}
+	else if (true == m_cycleValid)
+	{
+		BATCHAR_AddRecord(sysTime);
+	}
+	else
+	{
+		ADC_GetWindowAverage();
+	}
+}
+
+
+// ****************************************************************************
+/*!
+ * BATCHAR_SampleBeforeEdge takes the VBAT window before an edge and switches the
+ * load. Before the load goes on it is the open circuit voltage which is checked
+ * against the end voltage. When the load goes off the charge taken during the on
+ * time is added to the total.
+ *
+ * @param	sysTime		current value of the ms tick timer
+ * @retval	bool		true = load switched, false = test ended
+ */
+// ****************************************************************************
+static bool BATCHAR_SampleBeforeEdge(const uint32_t sysTime)
+{
+	const uint16_t vBatMv = UTIL_FixMul_U32_U16(ADC_TO_BATTMV_K, ADC_GetWindowAverage());
+	uint32_t loadMa;
+
+	if (true == m_loadOn)
+	{
+		IODRV_SetPin(IODRV_PIN_EXTVS_EN, false);
+		m_loadOn = false;
+
+		m_loadEndMv = vBatMv;
+
+		// Average of the current at the start and end of the on time
+		loadMa = ((uint32_t)BATCHAR_GetLoadMa(m_loadOnMv) + BATCHAR_GetLoadMa(m_loadEndMv)) / 2u;
+
+		m_chargeMaMs += loadMa * MS_TIMEREF_DIFF(m_loadOnTime, sysTime);
+		m_chargeMaS += m_chargeMaMs / 1000u;
+		m_chargeMaMs %= 1000u;
+
+		m_cycleValid = true;
+	}
+	else
+	{
+		m_ocvMv = vBatMv;
+
+		if ( (vBatMv > 0u) && (vBatMv < m_endMv) )
+		{
+			BATCHAR_Stop(BATCHAR_STATUS_DONE);
+
+			return false;
+		}
+
+		IODRV_SetPin(IODRV_PIN_EXTVS_EN, true);
+		m_loadOn = true;
+
+		MS_TIMEREF_INIT(m_loadOnTime, sysTime);
+	}
+
+	return true;
+}
+
+
+// ****************************************************************************
+/*!
+ * BATCHAR_AddRecord makes the record for the cycle just finished. The resistance
+ * is the average of the one from the voltage drop when the load went on and the
+ * one from the recovery when it went off. Dropped if the host has not kept up.
+ *
+ * @param	sysTime		current value of the ms tick timer
+ * @retval	none
+ */
+// ****************************************************************************
+static void BATCHAR_AddRecord(const uint32_t sysTime)
+{
+	const uint16_t recoverMv = UTIL_FixMul_U32_U16(ADC_TO_BATTMV_K, ADC_GetWindowAverage());
+	const uint16_t onMa = BATCHAR_GetLoadMa(m_loadOnMv);
+	const uint16_t endMa = BATCHAR_GetLoadMa(m_loadEndMv);
+	const uint8_t nextHead = (m_recordHead + 1u) % BATCHAR_RECORD_COUNT;
+	const uint32_t timeS = MS_TIMEREF_DIFF(m_startTime, sysTime) / 1000u;
+	const uint32_t dischargedPt1MaHr = m_chargeMaS / 360u;
+	BATCHAR_Record_t * const p_record = &m_records[m_recordHead];
+
+	m_recordSeq++;
+
+	if (nextHead == m_recordTail)
+	{
+		m_droppedCount++;
+
+		return;
+	}
+
+	p_record->seq = m_recordSeq;
+	p_record->timeS = (timeS > UINT16_MAX) ? UINT16_MAX : (uint16_t)timeS;
+	p_record->ocvMv = m_ocvMv;
+	p_record->loadMv = m_loadOnMv;
+	p_record->loadMa = (uint16_t)(((uint32_t)onMa + endMa) / 2u);
+	p_record->rMohm = (uint16_t)(((uint32_t)BATCHAR_GetResistanceMohm(m_ocvMv, m_loadOnMv, onMa)
+							+ BATCHAR_GetResistanceMohm(recoverMv, m_loadEndMv, endMa)) / 2u);
+	p_record->dischargedPt1MaHr = (dischargedPt1MaHr > UINT16_MAX) ? UINT16_MAX : (uint16_t)dischargedPt1MaHr;
+	p_record->socPt1 = FUELGAUGE_GetSocPt1();
+
+	m_recordHead = nextHead;
+}
+
+
+// ****************************************************************************
+/*!
+ * BATCHAR_GetLoadMa works out the load current from the battery voltage, the
+ * load resistance and the VSys switch resistance.
+ *
+ * @param	loadMv		battery voltage with the load on
+ * @retval	uint16_t	load current in mA
+ */
+// ****************************************************************************
+static uint16_t BATCHAR_GetLoadMa(const uint16_t loadMv)
+{
+	return (uint16_t)(((uint32_t)loadMv * 1000u) / ((uint32_t)m_loadMohm + BATCHAR_SWITCH_MOHM));
+}
+
+
+// ****************************************************************************
+/*!
+ * BATCHAR_GetResistanceMohm works out the internal resistance from the voltage
+ * step across an edge.
+ *
+ * @param	highMv		unloaded battery voltage
+ * @param	lowMv		loaded battery voltage
+ * @param	loadMa		load current
+ * @retval	uint16_t	resistance in mOhm, 0 if the step is the wrong way
+ */
+// ****************************************************************************
+static uint16_t BATCHAR_GetResistanceMohm(const uint16_t highMv, const uint16_t lowMv, const uint16_t loadMa)
+{
+	uint32_t result;
+
+	if ( (highMv <= lowMv) || (0u == loadMa) )
+	{
+		return 0u;
+	}
+
+	result = ((uint32_t)(highMv - lowMv) * 1000u) / loadMa;
+
+	return (result > UINT16_MAX) ? UINT16_MAX : (uint16_t)result;
+}
+
+
+// ****************************************************************************
+/*!
+ * BATCHAR_Stop turns the load off and ends the test, the task turns VSys off
+ * through the power source module.
+ *
+ * @param	status		reason for stopping
+ * @retval	none
+ */
+// ****************************************************************************
+static void BATCHAR_Stop(const BATCHAR_Status_t status)
+{
+	IODRV_SetPin(IODRV_PIN_EXTVS_EN, false);
+	ADC_GetWindowAverage();
+
+	m_loadOn = false;
+	m_stopRequest = false;
+	m_vsysRelease = true;
+
+	m_status = status;
+}
@@ -0,0 +1,578 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file		bist.c
+ * @date       	18 October 2026
+ * @brief       Built in self test for production. Runs the checks that do not
+ * 				need an operator from the taskman so the test jig only has to
+ * 				start it and poll the result rather than make each check over i2c
+ * 				with fixed delays in between. The steps to run are selected by a
+ * 				bit mask, each step polls for its condition with a timeout so it
+ * 				finishes as soon as the board is ready. The test stops at the first
+ * 				failing step, the result holds the step, a failure code, the values
+ * 				measured and the time each step took.
+ * 				The boost converter is returned to the state it was in before the
+ * 				test when the test ends.
+ *
+ * 				Command write:	[0] BIST_CMD_START, [1] step mask (bit = BIST_Step_t)
+ * 								[0] BIST_CMD_ABORT
+ * 				Result read:	[0] status, [1] step, [2] fail code, [3] step mask,
+ * 								[4] board faults, [5] charge level %, [6] charger status,
+ * 								[7..8] 5V rail mV boost off, [9..10] 5V rail mV boost on,
+ * 								[11..12] load current mA, [13..22] step times mS,
+ * 								[23..24] total time mS. All values little endian.
+ *
+ */
+// ----------------------------------------------------------------------------
+// Include section - add all #includes here:
+
+#include "main.h"
+#include "system_conf.h"
+#include "time_count.h"
+#include "util.h"
+
+#include "analog.h"
+#include "charger_bq2416x.h"
+#include "fuel_gauge_lc709203f.h"
+#include "power_source.h"
+#include "load_current_sense.h"
+
+#include "bist.h"
+
+
+// ----------------------------------------------------------------------------
+// Defines section - add all #defines here:
+
+#define BIST_CMD_ABORT				0x00u
+#define BIST_CMD_START				0xB1u
+
+#define BIST_READ_LEN				25u
+#define BIST_STEP_BUSY				0xFFu
+#define BIST_STEP_PASS				0x00u
+
+#define BIST_RAIL_OFF_MAX_MV		500u
+#define BIST_RAIL_ON_MIN_MV			4900u
+#define BIST_RAIL_ON_MAX_MV			5250u
+#define BIST_BOOST_TIMEOUT_MS		1500u
+
+#define BIST_CHARGE_LEVEL_MIN		1u
+#define BIST_CHARGE_LEVEL_MAX		99u
+
+#define BIST_ISENSE_ATTEMPTS		2u
+
+/* Failure codes, per step */
+#define BIST_FAIL_BOARD_FAULT		0x01u
+#define BIST_FAIL_CHARGE_LEVEL		0x02u
+#define BIST_FAIL_RAIL_TIMEOUT		0x01u
+#define BIST_FAIL_BOOST_REFUSED		0x02u
+#define BIST_FAIL_CHARGER_FAULT		0x01u
+#define BIST_FAIL_CHARGER_STATUS	0x02u
+#define BIST_FAIL_NO_BATTERY		0x03u
+#define BIST_FAIL_LOAD_CURRENT		0x01u
+
+typedef struct
+{
+	uint8_t boardFaults;
+	uint8_t chargeLevel;
+	uint8_t chargerStatus;
+	uint16_t railOffMv;
+	uint16_t railOnMv;
+	int16_t loadCurrentMa;
+	uint16_t stepTimeMs[BIST_STEP_COUNT];
+	uint16_t totalTimeMs;
+} BIST_Result_t;
+
+
+// ----------------------------------------------------------------------------
+// Function prototypes for functions that only have scope in this module:
+
+static uint8_t BIST_RunFaults(void);
+static uint8_t BIST_RunBoostOff(const uint32_t stepTime);
+static uint8_t BIST_RunBoostOn(const uint32_t stepTime);
+static uint8_t BIST_RunCharger(void);
+static uint8_t BIST_RunIsense(void);
+static void BIST_EndStep(const uint32_t sysTime, const uint8_t stepResult);
+static void BIST_Finish(const BIST_Status_t status);
+
+
+// ----------------------------------------------------------------------------
+// Variables that only have scope in this module:
+
+static volatile BIST_Status_t m_status;
+static volatile uint8_t m_step;
+static uint8_t m_stepMask;
+static uint8_t m_failCode;
+static bool m_stepEntry;
+static uint32_t m_stepStartTime;
+static uint32_t m_testStartTime;
+static bool m_boostWasEnabled;
+
+static uint8_t m_isenseAttempts;
+static bool m_isenseStarted;
+
+static BIST_Result_t m_result;
+
+
+// ----------------------------------------------------------------------------
+// Variables that have scope from outside this module:
+
+
+// ----------------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+// FUNCTIONS WITH GLOBAL SCOPE
+// ----------------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+// ****************************************************************************
+/*!
+ * BIST_Init configures the module to a known initial state
+ * @param	none
+ * @retval	none
+ */
+// ****************************************************************************
+void BIST_Init(void)
+{
+	m_status = BIST_STATUS_IDLE;
+	m_step = 0u;
+	m_stepMask = 0u;
+	m_failCode = 0u;
+}
+
+
+// ****************************************************************************
+/*!
+ * BIST_Task runs the current step of the self test, steps not in the mask are
+ * skipped. Each step is called until it passes, fails or times out.
+ *
+ * @param	none
+ * @retval	none
+ */
+// ****************************************************************************
+void BIST_Task(void)
+{
+	const uint32_t sysTime = HAL_GetTick();
+	const uint32_t stepTime = MS_TIMEREF_DIFF(m_stepStartTime, sysTime);
+	uint8_t stepResult = BIST_STEP_PASS;
+
+	if (BIST_STATUS_RUNNING != m_status)
+	{
+		return;
+	}
+
+	if (0u != (m_stepMask & (1u << m_step)))
+	{
+		switch (m_step)
+		{
+		case BIST_STEP_FAULTS:
+			stepResult = BIST_RunFaults();
+			break;
+
+		case BIST_STEP_BOOST_OFF:
+			stepResult = BIST_RunBoostOff(stepTime);
+			break;
+
+		case BIST_STEP_BOOST_ON:
+			stepResult = BIST_RunBoostOn(stepTime);
+			break;
+
+		case BIST_STEP_CHARGER:
+			stepResult = BIST_RunCharger();
+			break;
+
+		case BIST_STEP_ISENSE:
+			stepResult = BIST_RunIsense();
+			break;
+
+		default:
+			break;
+		}
+
+		m_stepEntry = false;
+	}
+
+	if (BIST_STEP_BUSY != stepResult)
+	{
+		// Steps may block (calibration) so take the time again
+		BIST_EndStep(HAL_GetTick(), stepResult);
+	}
+}
+
+
+// ****************************************************************************
+/*!
+ * BIST_IsRunning lets the taskman know not to go to low power while the test
+ * is running.
+ *
+ * @param	none
+ * @retval	bool		true = test in progress
+ */
+// ****************************************************************************
+bool BIST_IsRunning(void)
+{
+	return (BIST_STATUS_RUNNING == m_status);
+}
+
+
+// ****************************************************************************
+/*!
+ * BIST_GetBoardFaults puts together the board fault bits in the same layout as
+ * command 250, bit 0 charger i2c fault (not tracked, always 0), bits 1-3 charger
+ * fault status, bit 4 fuel gauge not communicating. Bit 5 (thermistor) is left
+ * clear as the fuel gauge driver does not evaluate the thermistor.
+ *
+ * @param	none
+ * @retval	uint8_t		board fault bits, 0 = no faults
+ */
+// ****************************************************************************
+uint8_t BIST_GetBoardFaults(void)
+{
+	uint8_t result = (CHARGER_GetFaultStatus() & 0x07u) << 1u;
+
+	if (false == FUELGAUGE_IsOnline())
+	{
+		result |= 0x10u;
+	}
+
+	return result;
+}
+
+
+// ****************************************************************************
+/*!
+ * BIST_SetCommandData starts or aborts the self test from a command server write.
+ * Starting while a test is running restarts it.
+ *
+ * @param	p_data		pointer to data written by the host
+ * @param	len			length of the data
+ * @retval	none
+ */
+// ****************************************************************************
+void BIST_SetCommandData(const uint8_t * const p_data, const uint16_t len)
+{
+	const uint32_t sysTime = HAL_GetTick();
+	uint8_t i;
+
+	if (len < 1u)
+	{
+		return;
+	}
+
+	if (BIST_CMD_ABORT == p_data[0u])
+	{
+		if (BIST_STATUS_RUNNING == m_status)
+		{
+			m_failCode = 0u;
+			BIST_Finish(BIST_STATUS_IDLE);
+		}
+	}
+	else if ( (BIST_CMD_START == p_data[0u]) && (len >= 2u) )
+	{
+		if (BIST_STATUS_RUNNING != m_status)
+		{
+			m_boostWasEnabled = POWERSOURCE_IsBoostConverterEnabled();
+		}
+		else if ( (BIST_STEP_ISENSE == m_step) && (true == m_isenseStarted) )
+		{
+			ISENSE_AbortCalibration();
+		}
+
+		m_result.boardFaults = 0u;
+		m_result.chargeLevel = 0u;
+		m_result.chargerStatus = 0u;
+		m_result.railOffMv = 0u;
+		m_result.railOnMv = 0u;
+		m_result.loadCurrentMa = 0;
+		m_result.totalTimeMs = 0u;
+
+		for (i = 0u; i < BIST_STEP_COUNT; i++)
+		{
+			m_result.stepTimeMs[i] = 0u;
+		}
+
+		m_stepMask = p_data[1u] & ((1u << BIST_STEP_COUNT) - 1u);
+		m_failCode = 0u;
+		m_step = 0u;
+		m_stepEntry = true;
+		m_isenseAttempts = 0u;
+		m_isenseStarted = false;
+
+		MS_TIMEREF_INIT(m_stepStartTime, sysTime);
+		MS_TIMEREF_INIT(m_testStartTime, sysTime);
+
+		m_status = BIST_STATUS_RUNNING;
+	}
+}
+
+
+// ****************************************************************************
+/*!
+ * BIST_GetResultData fills a command server read with the test result, layout
+ * is in the file description.
+ *
+ * @param	p_data		pointer to command server buffer
+ * @param	p_len		pointer to length of the response
+ * @retval	none
+ */
+// ****************************************************************************
+void BIST_GetResultData(uint8_t * const p_data, uint16_t * const p_len)
+{
+	uint8_t i;
+
+	p_data[0u] = m_status;
+	p_data[1u] = m_step;
+	p_data[2u] = m_failCode;
+	p_data[3u] = m_stepMask;
+	p_data[4u] = m_result.boardFaults;
+	p_data[5u] = m_result.chargeLevel;
+	p_data[6u] = m_result.chargerStatus;
+	UTIL_ToBytes_U16(m_result.railOffMv, &p_data[7u]);
+	UTIL_ToBytes_U16(m_result.railOnMv, &p_data[9u]);
+	UTIL_ToBytes_U16((uint16_t)m_result.loadCurrentMa, &p_data[11u]);
+
+	for (i = 0u; i < BIST_STEP_COUNT; i++)
+	{
+		UTIL_ToBytes_U16(m_result.stepTimeMs[i], &p_data[13u + (i * 2u)]);
+	}
+
+	UTIL_ToBytes_U16(m_result.totalTimeMs, &p_data[23u]);
+
+	*p_len = BIST_READ_LEN;
+}
+
+
+// ----------------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+// FUNCTIONS WITH LOCAL SCOPE
+// ----------------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+// ****************************************************************************
+/*!
+ * BIST_RunFaults checks the board fault bits and that the fuel gauge is giving a
+ * sensible charge level.
+ *
+ * @param	none
+ * @retval	uint8_t		BIST_STEP_PASS or failure code
+ */
+// ****************************************************************************
+static uint8_t BIST_RunFaults(void)
+{
+	m_result.boardFaults = BIST_GetBoardFaults();
+	m_result.chargeLevel = (uint8_t)((FUELGAUGE_GetSocPt1() + 5u) / 10u);
+
+	if (0u != m_result.boardFaults)
+	{
+		return BIST_FAIL_BOARD_FAULT;
+	}
+
+	if ( (m_result.chargeLevel < BIST_CHARGE_LEVEL_MIN) || (m_result.chargeLevel > BIST_CHARGE_LEVEL_MAX) )
+	{
+		return BIST_FAIL_CHARGE_LEVEL;
+	}
+
+	return BIST_STEP_PASS;
+}
+
+
+// ****************************************************************************
+/*!
+ * BIST_RunBoostOff turns the boost converter off and waits for the 5V rail to
+ * drop. There must be nothing else powering the 5V rail.
+ *
+ * @param	stepTime	time since the step started in mS
+ * @retval	uint8_t		BIST_STEP_BUSY, BIST_STEP_PASS or failure code
+ */
+// ****************************************************************************
+static uint8_t BIST_RunBoostOff(const uint32_t stepTime)
+{
+	if (true == m_stepEntry)
+	{
+		POWERSOURCE_Set5vBoostEnable(false);
+	}
+
+	m_result.railOffMv = ANALOG_Get5VRailMv();
+
+	if (m_result.railOffMv < BIST_RAIL_OFF_MAX_MV)
+	{
+		return BIST_STEP_PASS;
+	}
+
+	return (stepTime > BIST_BOOST_TIMEOUT_MS) ? BIST_FAIL_RAIL_TIMEOUT : BIST_STEP_BUSY;
+}
+
+
+// ****************************************************************************
+/*!
+ * BIST_RunBoostOn turns the boost converter on and waits for the 5V rail to come
+ * into regulation.
+ *
+ * @param	stepTime	time since the step started in mS
+ * @retval	uint8_t		BIST_STEP_BUSY, BIST_STEP_PASS or failure code
+ */
+// ****************************************************************************
+static uint8_t BIST_RunBoostOn(const uint32_t stepTime)
+{
+	if (true == m_stepEntry)
+	{
+		POWERSOURCE_Set5vBoostEnable(true);
+
+		if (false == POWERSOURCE_IsBoostConverterEnabled())
+		{
+			// Battery too low or high impedance
+			return BIST_FAIL_BOOST_REFUSED;
+		}
+	}
+
+	m_result.railOnMv = ANALOG_Get5VRailMv();
+
+	if ( (m_result.railOnMv >= BIST_RAIL_ON_MIN_MV) && (m_result.railOnMv <= BIST_RAIL_ON_MAX_MV) )
+	{
+		return BIST_STEP_PASS;
+	}
+
+	return (stepTime > BIST_BOOST_TIMEOUT_MS) ? BIST_FAIL_RAIL_TIMEOUT : BIST_STEP_BUSY;
+}
+
+
+// ****************************************************************************
+/*!
+ * BIST_RunCharger checks the charger reports no fault and sees the battery.
+ *
+ * @param	none
+ * @retval	uint8_t		BIST_STEP_PASS or failure code
+ */
+// ****************************************************************************
+static uint8_t BIST_RunCharger(void)
+{
+	m_result.chargerStatus = CHARGER_GetStatus();
+
+	if (CHG_FAULT_NORMAL != CHARGER_GetFaultStatus())
+	{
+		return BIST_FAIL_CHARGER_FAULT;
+	}
+
+	if ( (CHG_FAULT == m_result.chargerStatus) || (CHG_NA == m_result.chargerStatus) )
+	{
+		return BIST_FAIL_CHARGER_STATUS;
+	}
+
+	if (false == CHARGER_IsBatteryPresent())
+	{
+		return BIST_FAIL_NO_BATTERY;
+	}
+
+	return BIST_STEP_PASS;
+}
+
+
+// ****************************************************************************
+/*!
+ * BIST_RunIsense runs the load current calibration with the calibration load
+ * fitted, the isense module checks the load current reads correctly with the new
+ * values. The calibration is tried again once if it fails, the same as the test
+ * jig used to.
+ *
+ * @param	none
+ * @retval	uint8_t		BIST_STEP_BUSY, BIST_STEP_PASS or failure code
+ */
+// ****************************************************************************
+static uint8_t BIST_RunIsense(void)
+{
+	ISENSE_CalStatus_t calStatus;
+
+	if (false == m_isenseStarted)
+	{
+		ISENSE_StartCalibration(ISENSE_CAL_MODE_LOAD);
+
+		m_isenseAttempts++;
+		m_isenseStarted = true;
+
+		return BIST_STEP_BUSY;
+	}
+
+	calStatus = ISENSE_GetCalibrationStatus();
+
+	if (ISENSE_CAL_STATUS_BUSY == calStatus)
+	{
+		return BIST_STEP_BUSY;
+	}
+
+	m_result.loadCurrentMa = ISENSE_GetLoadCurrentMa();
+
+	if (ISENSE_CAL_STATUS_PASS == calStatus)
+	{
+		return BIST_STEP_PASS;
+	}
+
+	if (m_isenseAttempts < BIST_ISENSE_ATTEMPTS)
+	{
+		m_isenseStarted = false;
+
+		return BIST_STEP_BUSY;
+	}
+
+	return BIST_FAIL_LOAD_CURRENT;
+}
+
+
+// ****************************************************************************
+/*!
+ * BIST_EndStep records the step time and moves to the next step, or finishes the
+ * test if the step failed or it was the last one.
+ *
+ * @param	sysTime		current value of the ms tick timer
+ * @param	stepResult	BIST_STEP_PASS or failure code
+ * @retval	none
+ */
+// ****************************************************************************
+static void BIST_EndStep(const uint32_t sysTime, const uint8_t stepResult)
+{
+	const uint32_t stepTime = MS_TIMEREF_DIFF(m_stepStartTime, sysTime);
+
+	m_result.stepTimeMs[m_step] = (stepTime > UINT16_MAX) ? UINT16_MAX : (uint16_t)stepTime;
+
+	if (BIST_STEP_PASS != stepResult)
+	{
+		m_failCode = stepResult;
+		BIST_Finish(BIST_STATUS_FAIL);
+
+		return;
+	}
+
+	if ((m_step + 1u) >= BIST_STEP_COUNT)
+	{
+		BIST_Finish(BIST_STATUS_PASS);
+
+		return;
+	}
+
+	m_step++;
+	m_stepEntry = true;
+	MS_TIMEREF_INIT(m_stepStartTime, sysTime);
+}
+
+
+// ****************************************************************************
+/*!
+ * BIST_Finish ends the test and puts the boost converter back how it was found.
+ *
+ * @param	status		final status of the test
+ * @retval	none
+ */
+// ****************************************************************************
+static void BIST_Finish(const BIST_Status_t status)
+{
+	const uint32_t totalTime = MS_TIME_COUNT(m_testStartTime);
+
+	m_result.totalTimeMs = (totalTime > UINT16_MAX) ? UINT16_MAX : (uint16_t)totalTime;
+
+	// Aborted part way through the calibration
+	if ( (BIST_STEP_ISENSE == m_step) && (true == m_isenseStarted) )
+	{
+		ISENSE_AbortCalibration();
+	}
+
+	if (m_boostWasEnabled != POWERSOURCE_IsBoostConverterEnabled())
+	{
+		POWERSOURCE_Set5vBoostEnable(m_boostWasEnabled);
+	}
+
+	m_status = status;
+}
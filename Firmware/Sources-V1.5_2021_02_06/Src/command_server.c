@@ -28,6 +28,10 @@
 #include "execution.h"
 #include "hostcomms.h"
 #include "i2cdrv.h"
+#include "timing_stats.h"
+#include "taskman.h"
+#include "bist.h"
+#include "battery_char.h"
 
 #include "command_server.h"
 
@@ -144,6 +148,16 @@ void CmdServerReadWriteIoConfig1(uint8_t dir, uint8_t *pData, uint16_t *dataLen)
 void CmdServerReadWriteIoConfig2(uint8_t dir, uint8_t *pData, uint16_t *dataLen);
 void CmdServerReadWriteIoValue1(uint8_t dir, uint8_t *pData, uint16_t *dataLen);
 void CmdServerReadWriteIoValue2(uint8_t dir, uint8_t *pData, uint16_t *dataLen);
+void CmdServerReadWriteTimingStats(uint8_t dir, uint8_t *pData,
+		uint16_t *dataLen);
+void CmdServerReadWriteLoopConfig(uint8_t dir, uint8_t *pData,
+		uint16_t *dataLen);
+void CmdServerReadWriteSelfTest(uint8_t dir, uint8_t *pData,
+		uint16_t *dataLen);
+void CmdServerReadWriteBatteryChar(uint8_t dir, uint8_t *pData,
+		uint16_t *dataLen);
+void CmdServerReadWriteHostActivity(uint8_t dir, uint8_t *pData,
+		uint16_t *dataLen);
 
 MasterCommand_T masterCommands[REGISTERS_NUM] =
 {
@@ -426,12 +440,12 @@ MasterCommand_T masterCommands[REGISTERS_NUM] =
 		/*241*/NULL,
 		/*242*/NULL,
 		/*243*/NULL,
-		/*244*/NULL,
-		/*245*/NULL,
-		/*246*/NULL,
-		/*247*/NULL,
+		/*244*/CmdServerReadWriteHostActivity,
+		/*245*/CmdServerReadWriteBatteryChar,
+		/*246*/CmdServerReadWriteTimingStats,
+		/*247*/CmdServerReadWriteLoopConfig,
 		/*248*/CmdServerReadWriteTestAndCalibration,
-		/*249*/NULL,
+		/*249*/CmdServerReadWriteSelfTest,
 		/*250*/CmdServerReadBoardFaultStatus,
 		/*251*/NULL,
 		/*252*/NULL,
@@ -1288,33 +1302,38 @@ void CmdServerReadWriteTestAndCalibration(uint8_t dir, uint8_t *pData,
 {
 	if (dir == MASTER_CMD_DIR_WRITE)
 	{
+		// Calibrations run in the isense task, poll the read for the result
 		if ((pData[1] == 0x55) && (pData[2] == 0x26) && (pData[3] == 0xa0))
 		{
 			if (pData[4] == 0x2b)
 			{
-				ISENSE_CalibrateLoadCurrent();
+				ISENSE_StartCalibration(ISENSE_CAL_MODE_LOAD);
 			}
 			else if (pData[4u] == 0x3Au)
 			{
-				ISENSE_CalibrateZeroCurrent();
+				ISENSE_StartCalibration(ISENSE_CAL_MODE_ZERO);
 			}
 			else if (pData[4u] == 0x4Fu)
 			{
-				ISENSE_Calibrate51mACurrent();
+				ISENSE_StartCalibration(ISENSE_CAL_MODE_51MA);
 			}
 			else if (pData[4u] == 0x52u)
 			{
-				ISENSE_Calibrate510mACurrent();
+				ISENSE_StartCalibration(ISENSE_CAL_MODE_510MA);
 			}
 			else if (pData[4u] == 0x69u)
 			{
 				ISENSE_WriteNVCalibration();
 			}
 		}
+		else if (pData[1] == 0x00)
+		{
+			ISENSE_AbortCalibration();
+		}
 	}
 	else
 	{
-		*dataLen = 0;
+		ISENSE_GetCalibrationData(pData, dataLen);
 	}
 }
 
@@ -1457,3 +1476,67 @@ void CmdServerReadWriteIoValue2(uint8_t dir, uint8_t *pData, uint16_t *dataLen)
 	}
 }
 
+void CmdServerReadWriteTimingStats(uint8_t dir, uint8_t *pData,
+		uint16_t *dataLen)
+{
+	if (dir == MASTER_CMD_DIR_WRITE)
+	{
+		TIMING_STATS_WriteCmd(pData + 1, *dataLen - 1);
+	}
+	else
+	{
+		TIMING_STATS_ReadCmd(pData, dataLen);
+	}
+}
+
+void CmdServerReadWriteLoopConfig(uint8_t dir, uint8_t *pData,
+		uint16_t *dataLen)
+{
+	if (dir == MASTER_CMD_DIR_WRITE)
+	{
+		TASKMAN_SetLoopConfigData(pData + 1, *dataLen - 1);
+	}
+	else
+	{
+		TASKMAN_GetLoopConfigData(pData, dataLen);
+	}
+}
+
+void CmdServerReadWriteSelfTest(uint8_t dir, uint8_t *pData,
+		uint16_t *dataLen)
+{
+	if (dir == MASTER_CMD_DIR_WRITE)
+	{
+		BIST_SetCommandData(pData + 1, *dataLen - 1);
+	}
+	else
+	{
+		BIST_GetResultData(pData, dataLen);
+	}
+}
+
+void CmdServerReadWriteBatteryChar(uint8_t dir, uint8_t *pData,
+		uint16_t *dataLen)
+{
+	if (dir == MASTER_CMD_DIR_WRITE)
+	{
+		BATCHAR_SetCommandData(pData + 1, *dataLen - 1);
+	}
+	else
+	{
+		BATCHAR_GetRecordData(pData, dataLen);
+	}
+}
+
+void CmdServerReadWriteHostActivity(uint8_t dir, uint8_t *pData,
+		uint16_t *dataLen)
+{
+	if (dir == MASTER_CMD_DIR_WRITE)
+	{
+		HOSTCOMMS_SetQuiesceData(pData + 1, *dataLen - 1);
+	}
+	else
+	{
+		HOSTCOMMS_GetActivityData(pData, dataLen);
+	}
+}
@@ -32,13 +32,43 @@
 #define RSOC_TEMP_MAX_COMPENSATE	21
 #define RSOC_TEMP_STEP_COUNT		(RSOC_TEMP_MAX_COMPENSATE - RSOC_TEMP_TABLE_MIN)
 
+#define FUELGAUGE_TRANSFER_MAX		3u
+#define FUELGAUGE_I2C_TIMEOUT_MS	1000u
+
+typedef enum
+{
+	FUELGAUGE_TASK_STATE_IDLE = 0u,
+	FUELGAUGE_TASK_STATE_IC_INIT = 1u,
+	FUELGAUGE_TASK_STATE_READ = 2u
+} FUELGAUGE_TaskState_t;
+
+typedef enum
+{
+	FUELGAUGE_PROGRESS_BUSY = 0u,
+	FUELGAUGE_PROGRESS_DONE = 1u,
+	FUELGAUGE_PROGRESS_FAILED = 2u
+} FUELGAUGE_Progress_t;
+
+typedef struct
+{
+	uint8_t cmd;
+	I2CDRV_TransactionType_t transactType;
+	uint16_t word;
+	bool success;
+} FUELGAUGE_Transfer_t;
+
 // ----------------------------------------------------------------------------
 // Function prototypes for functions that only have scope in this module:
 
 static void FUELGAUGE_I2C_Callback(const I2CDRV_Device_t * const p_i2cdrvDevice);
-static bool FUELGAUGE_WriteWord(const uint8_t cmd, const uint16_t word);
-static bool FUELGAUGE_ReadWord(const uint8_t cmd, uint16_t *const word);
-static bool FUELGAUGE_IcInit(void);
+static void FUELGAUGE_ClearTransfers(void);
+static void FUELGAUGE_AddRead(const uint8_t cmd);
+static void FUELGAUGE_AddWrite(const uint8_t memAddress, const uint16_t value);
+static void FUELGAUGE_StartTransfers(const uint32_t sysTime);
+static bool FUELGAUGE_TransfersDone(void);
+static FUELGAUGE_Progress_t FUELGAUGE_IcInit(const uint32_t sysTime);
+static void FUELGAUGE_StartUpdate(const uint32_t sysTime);
+static void FUELGAUGE_FinishUpdate(const uint32_t sysTime);
 static bool FUELGAUGE_CalculateDischargeRate(const uint16_t previousRSoc,
 												const uint16_t newRsoc,
 												const uint32_t timeDeltaMs);
@@ -52,8 +82,6 @@ static void FUELGAUGE_UpdateCalculateSOC(const uint16_t batteryMv,
 // ----------------------------------------------------------------------------
 // Variables that only have scope in this module:
 
-static uint16_t m_fuelgaugeI2CReadResult;
-static bool m_fuelgaugeI2CSuccess;
 static FUELGAUGE_Status_t m_fuelgaugeIcStatus;
 static uint16_t m_batteryMv;
 static uint8_t m_icInitState;
@@ -69,6 +97,10 @@ static bool m_thermistorGood;
 static uint32_t m_lastFuelGaugeTaskTimeMs;
 static bool m_updateBatteryProfile;
 static bool m_initBatterySOC;
+static FUELGAUGE_TaskState_t m_taskState;
+static FUELGAUGE_Transfer_t m_transfers[FUELGAUGE_TRANSFER_MAX];
+static uint8_t m_transferCount;
+static volatile uint8_t m_transferDoneCount;
 
 
 // ----------------------------------------------------------------------------
@@ -91,38 +123,44 @@ static int32_t m_soc __attribute__((section("no_init")));
  * FUELGAUGE_I2C_Callback interfaces with the i2cdrv module, lets this module
  * 			know when the transaction is complete and provides a pointer to the
  * 			i2cdriver internal data which will contain information regarding the
- * 			transaction.
+ * 			transaction. The transfers are queued together and completed by the
+ * 			driver in order, so each callback belongs to the next outstanding
+ * 			transfer. Anything other than a good completion leaves the transfer
+ * 			marked as failed.
  * @param	p_i2cdrvDevice		pointer to the i2cdrv internals
  * @retval	none
  */
 // ****************************************************************************
 static void FUELGAUGE_I2C_Callback(const I2CDRV_Device_t * const p_i2cdrvDevice)
 {
+	FUELGAUGE_Transfer_t * p_transfer;
+	crc_t crc;
+
+	if (m_transferDoneCount >= m_transferCount)
+	{
+		return;
+	}
+
+	p_transfer = &m_transfers[m_transferDoneCount];
+
 	if (p_i2cdrvDevice->event == I2CDRV_EVENT_RX_COMPLETE)
 	{
-		crc_t crc = crc_8_init(FUELGAUGE_I2C_ADDR);
+		crc = crc_8_init(FUELGAUGE_I2C_ADDR);
 		// crc includes address, mem address, address | 0x01, data
 		crc = crc_8_update(crc, p_i2cdrvDevice->data, 4u);
 
 		if (crc == p_i2cdrvDevice->data[4u])
 		{
-			m_fuelgaugeI2CReadResult = (uint16_t)p_i2cdrvDevice->data[2u] | (p_i2cdrvDevice->data[3u] << 8u);
-
-			m_fuelgaugeI2CSuccess = true;
-		}
-		else
-		{
-			m_fuelgaugeI2CSuccess = false;
+			p_transfer->word = (uint16_t)p_i2cdrvDevice->data[2u] | (p_i2cdrvDevice->data[3u] << 8u);
+			p_transfer->success = true;
 		}
 	}
 	else if (p_i2cdrvDevice->event == I2CDRV_EVENT_TX_COMPLETE)
 	{
-		m_fuelgaugeI2CSuccess = true;
-	}
-	else
-	{
-		m_fuelgaugeI2CSuccess = false;
+		p_transfer->success = true;
 	}
+
+	m_transferDoneCount++;
 }
 
 
@@ -133,7 +171,9 @@ static void FUELGAUGE_I2C_Callback(const I2CDRV_Device_t * const p_i2cdrvDevice)
 // ----------------------------------------------------------------------------
 // ****************************************************************************
 /*!
- * FUELGAUGE_Init configures the module to a known initial state
+ * FUELGAUGE_Init configures the module to a known initial state. The task loop
+ * is not yet running so the ic init and first reads are run through to the end
+ * here, the osloop completes the transfers.
  * @param	none
  * @retval	none
  */
@@ -142,7 +182,7 @@ void FUELGAUGE_Init(void)
 {
 	const uint32_t sysTime = HAL_GetTick();
 
-	uint16_t tempU16;
+	FUELGAUGE_Progress_t initProgress;
 	uint8_t config;
 
 	if (NV_READ_VARIABLE_SUCCESS == NvReadVariableU8(FUEL_GAUGE_CONFIG_NV_ADDR, &config))
@@ -156,22 +196,40 @@ void FUELGAUGE_Init(void)
 		// FuelGaugeDvInit();
 	}
 
+	m_taskState = FUELGAUGE_TASK_STATE_IDLE;
+	m_icInitState = 0u;
+
 	// Try and talk to the fuel gauge ic
 	// Note: SOC might not be correctly evaluated if the battery is being charged or discharged
-	if (true == FUELGAUGE_IcInit())
+	do
+	{
+		initProgress = FUELGAUGE_IcInit(HAL_GetTick());
+	} while (FUELGAUGE_PROGRESS_BUSY == initProgress);
+
+	if (FUELGAUGE_PROGRESS_DONE == initProgress)
 	{
 		m_fuelgaugeIcStatus = FUELGAUGE_STATUS_ONLINE;
 
-		if (true == FUELGAUGE_ReadWord(FG_MEM_ADDR_ITE, &tempU16))
+		FUELGAUGE_ClearTransfers();
+		FUELGAUGE_AddRead(FG_MEM_ADDR_ITE);
+		FUELGAUGE_AddRead(FG_MEM_ADDR_CELL_MV);
+		FUELGAUGE_StartTransfers(HAL_GetTick());
+
+		while (false == FUELGAUGE_TransfersDone())
 		{
-			m_lastSocPt1 = tempU16;
+			// Wait for transfers
+		}
+
+		if (true == m_transfers[0u].success)
+		{
+			m_lastSocPt1 = m_transfers[0u].word;
 
 			MS_TIMEREF_INIT(m_lastSocTimeMs, sysTime);
 		}
 
-		if (true == FUELGAUGE_ReadWord(FG_MEM_ADDR_CELL_MV, &tempU16))
+		if (true == m_transfers[1u].success)
 		{
-			m_batteryMv = tempU16;
+			m_batteryMv = m_transfers[1u].word;
 		}
 	}
 	else
@@ -194,7 +252,9 @@ void FUELGAUGE_Init(void)
 
 // ****************************************************************************
 /*!
- * FUELGAUGE_Task performs periodic updates for this module
+ * FUELGAUGE_Task performs periodic updates for this module. The ic init and the
+ * register reads are queued with the i2c driver and picked up on a later pass
+ * once the callback has completed them, the task never waits on the bus.
  *
  * @param	none
  * @retval	none
@@ -203,14 +263,32 @@ void FUELGAUGE_Init(void)
 void FUELGAUGE_Task(void)
 {
 	const uint32_t sysTime = HAL_GetTick();
-	const int16_t mcuTemperature = ANALOG_GetMCUTemp();
 	const uint16_t battMv = ANALOG_GetBatteryMv();
 
-	uint16_t tempU16;
-	int16_t tempS16;
-	uint32_t socTimeDiff;
+	FUELGAUGE_Progress_t initProgress;
+
+	if (FUELGAUGE_TASK_STATE_IC_INIT == m_taskState)
+	{
+		initProgress = FUELGAUGE_IcInit(sysTime);
+
+		if (FUELGAUGE_PROGRESS_BUSY != initProgress)
+		{
+			if (FUELGAUGE_PROGRESS_DONE == initProgress)
+			{
+				m_fuelgaugeIcStatus = FUELGAUGE_STATUS_ONLINE;
+			}
 
-	if (MS_TIMEREF_TIMEOUT(m_lastFuelGaugeTaskTimeMs, sysTime, FUELGAUGE_TASK_PERIOD_MS))
+			FUELGAUGE_StartUpdate(sysTime);
+		}
+	}
+	else if (FUELGAUGE_TASK_STATE_READ == m_taskState)
+	{
+		if (true == FUELGAUGE_TransfersDone())
+		{
+			FUELGAUGE_FinishUpdate(sysTime);
+		}
+	}
+	else if (MS_TIMEREF_TIMEOUT(m_lastFuelGaugeTaskTimeMs, sysTime, FUELGAUGE_TASK_PERIOD_MS))
 	{
 		MS_TIMEREF_INIT(m_lastFuelGaugeTaskTimeMs, sysTime);
 
@@ -234,89 +312,15 @@ void FUELGAUGE_Task(void)
 		{
 			m_updateBatteryProfile = false;
 
-			if (true == FUELGAUGE_IcInit())
-			{
-				m_fuelgaugeIcStatus = FUELGAUGE_STATUS_ONLINE;
-			}
-		}
-
-		// If battery just inserted or there has been a profile change, work out the SOC
-		// Should not run if soc is used from fuel gauge ic.
-		if (m_initBatterySOC)
-		{
-			m_initBatterySOC = false;
-
-			//m_currentSocTableIdx = FUELGAUGE_GetSocTableIdxFromOCV(battMv);
-			m_soc = FUELGAUGE_GetSOCFromOCV(battMv);
-			MS_TIMEREF_INIT(m_lastSocTimeMs, sysTime);
-
-		}
-
-
-		if (FUELGAUGE_STATUS_ONLINE == m_fuelgaugeIcStatus)
-		{
-			if (true == FUELGAUGE_ReadWord(FG_MEM_ADDR_CELL_MV, &tempU16))
-			{
-				m_batteryMv = tempU16;
-			}
-
-			if (m_temperatureMode == FUEL_GAUGE_TEMP_MODE_THERMISTOR)
-			{
-				if (true == FUELGAUGE_ReadWord(FG_MEM_ADDR_CELL_TEMP, &tempU16))
-				{
-					tempS16 = ((int16_t)tempU16 - CELL_TEMP_OFS);
-
-					// Check for a sane number
-					if (tempS16 < (int16_t)(mcuTemperature - 10))
-					{
-						m_batteryTemperaturePt1 = mcuTemperature * 10;
-					}
-					else
-					{
-						m_batteryTemperaturePt1 = tempS16;
-					}
-				}
-			}
-			else
-			{
-				m_batteryTemperaturePt1 = mcuTemperature * 10;
-				FUELGAUGE_WriteWord(0x08, m_batteryTemperaturePt1 + CELL_TEMP_OFS);
-			}
-
-			socTimeDiff = MS_TIMEREF_DIFF(m_lastSocTimeMs, HAL_GetTick());
+			// Kick off the first step, the rest follow on later passes
+			m_icInitState = 0u;
+			m_taskState = FUELGAUGE_TASK_STATE_IC_INIT;
 
-			if (RSOC_MEASUREMENT_DIRECT_DV == m_rsocMeasurementConfig)
-			{
-				FUELGAUGE_UpdateCalculateSOC(battMv, m_batteryTemperaturePt1 / 10, socTimeDiff);
-
-				MS_TIMEREF_INIT(m_lastSocTimeMs, sysTime);
-			}
-			else
-			{
-				if (true == FUELGAUGE_ReadWord(FG_MEM_ADDR_ITE, &tempU16))
-				{
-					if (FUELGAUGE_CalculateDischargeRate(m_lastSocPt1, tempU16,	socTimeDiff))
-					{
-						// Log soc and time for next update
-						m_lastSocPt1 = tempU16;
-
-						MS_TIMEREF_INIT(m_lastSocTimeMs, sysTime);
-					}
-				}
-			}
+			FUELGAUGE_IcInit(sysTime);
 		}
 		else
 		{
-			m_batteryMv = battMv;
-
-			socTimeDiff = MS_TIMEREF_DIFF(m_lastSocTimeMs, HAL_GetTick());
-
-			if (RSOC_MEASUREMENT_DIRECT_DV == m_rsocMeasurementConfig)
-			{
-				FUELGAUGE_UpdateCalculateSOC(battMv, m_batteryTemperaturePt1 / 10, socTimeDiff);
-
-				MS_TIMEREF_INIT(m_lastSocTimeMs, sysTime);
-			}
+			FUELGAUGE_StartUpdate(sysTime);
 		}
 	}
 }
@@ -535,6 +539,23 @@ BatteryTempSenseConfig_T FUELGAUGE_GetBatteryTempSensorCfg(void)
 }
 
 
+// ****************************************************************************
+/*!
+ * FUELGAUGE_IsBusy returns true while the module has transfers with the fuel
+ * gauge IC outstanding. The task loop needs to keep running until they are done
+ * and the i2c should not be shut down in the middle of them.
+ *
+ * @param	none
+ * @retval	bool		false = no transfers in progress
+ * 						true = ic init or register reads in progress
+ */
+// ****************************************************************************
+bool FUELGAUGE_IsBusy(void)
+{
+	return FUELGAUGE_TASK_STATE_IDLE != m_taskState;
+}
+
+
 // ----------------------------------------------------------------------------
 // ----------------------------------------------------------------------------
 // FUNCTIONS WITH LOCAL SCOPE
@@ -543,78 +564,95 @@ BatteryTempSenseConfig_T FUELGAUGE_GetBatteryTempSensorCfg(void)
 // ****************************************************************************
 /*!
  * FUELGAUGE_IcInit initialises the fuel gauge IC with the battery information.
+ * One register is written per call, the next is only sent once the previous
+ * transfer has completed successfully so the routine is called until it stops
+ * returning busy. Set m_icInitState to 0 to start from the beginning.
  *
- * @param	none
- * @retval	bool
+ * @param	sysTime					current value of the ms tick timer
+ * @retval	FUELGAUGE_Progress_t	busy = waiting on a transfer
+ * 									done = ic initialised
+ * 									failed = ic did not respond or took a write
  */
 // ****************************************************************************
-static bool FUELGAUGE_IcInit(void)
+static FUELGAUGE_Progress_t FUELGAUGE_IcInit(const uint32_t sysTime)
 {
 	const BatteryProfile_T * currentBatProfile = BATTERY_GetActiveProfileHandle();
-	uint16_t tempU16;
 
-	m_icInitState = 0u;
+	if (false == FUELGAUGE_TransfersDone())
+	{
+		return FUELGAUGE_PROGRESS_BUSY;
+	}
 
-	// Check to see if the device is online
-	if (FUELGAUGE_ReadWord(0x11, &tempU16))
+	if (m_icInitState > 0u)
 	{
-		m_fuelgaugeIcId = tempU16;
+		if (false == m_transfers[0u].success)
+		{
+			if (1u == m_icInitState)
+			{
+				m_fuelgaugeIcId = 0u;
+			}
 
-		m_icInitState++;
+			return FUELGAUGE_PROGRESS_FAILED;
+		}
 
-		// Set operational mode
-		if (false == FUELGAUGE_WriteWord(FG_MEM_ADDR_POWER_MODE, POWER_MODE_OPERATIONAL))
+		if (1u == m_icInitState)
 		{
-			return false;
+			m_fuelgaugeIcId = m_transfers[0u].word;
 		}
+	}
 
-		m_icInitState++;
+	FUELGAUGE_ClearTransfers();
 
-		// set APA
-		if (false == FUELGAUGE_WriteWord(FG_MEM_ADDR_APA, 0x36u))
-		{
-			return false;
-		}
+	switch (m_icInitState)
+	{
+	case 0u:
+		// Check to see if the device is online
+		FUELGAUGE_AddRead(FG_MEM_ADDR_IC_VERSION);
+		break;
+
+	case 1u:
+		// Set operational mode
+		FUELGAUGE_AddWrite(FG_MEM_ADDR_POWER_MODE, POWER_MODE_OPERATIONAL);
+		break;
 
-		m_icInitState++;
+	case 2u:
+		// set APA
+		FUELGAUGE_AddWrite(FG_MEM_ADDR_APA, 0x36u);
+		break;
 
+	case 3u:
 		// set change of the parameter
-		if (false == FUELGAUGE_WriteWord(FG_MEM_ADDR_PARAM_NO_SET,
+		FUELGAUGE_AddWrite(FG_MEM_ADDR_PARAM_NO_SET,
 				(currentBatProfile->chemistry == BAT_CHEMISTRY_LIPO_GRAPHENE) ?
 						BATT_PROFILE_0 :
-						BATT_PROFILE_1)
-				)
-		{
-			return false;
-		}
-
-		m_icInitState++;
+						BATT_PROFILE_1);
+		break;
 
+	case 4u:
 		// set APT
-		if (false == FUELGAUGE_WriteWord(FG_MEM_ADDR_APT, 0x3000u))
-		{
-			return false;
-		}
-
-		m_icInitState++;
+		FUELGAUGE_AddWrite(FG_MEM_ADDR_APT, 0x3000u);
+		break;
 
+	case 5u:
 		if ( (NULL != currentBatProfile) && (0xFFFFu != currentBatProfile->ntcB) )
 		{
 			// Set NTC B constant
-			if (false == FUELGAUGE_WriteWord(FG_MEM_ADDR_THERMB, currentBatProfile->ntcB))
-			{
-				return false;
-			}
+			FUELGAUGE_AddWrite(FG_MEM_ADDR_THERMB, currentBatProfile->ntcB);
 		}
-
-		m_icInitState++;
-
-		// Set NTC mode
-		if (false == FUELGAUGE_WriteWord(FG_MEM_ADDR_THERM_TYPE, THERM_TYPE_NTC))
+		else
 		{
-			return false;
+			// Nothing to set, skip straight on to the NTC mode
+			FUELGAUGE_AddWrite(FG_MEM_ADDR_THERM_TYPE, THERM_TYPE_NTC);
+			m_icInitState++;
 		}
+		break;
+
+	case 6u:
+		// Set NTC mode
+		FUELGAUGE_AddWrite(FG_MEM_ADDR_THERM_TYPE, THERM_TYPE_NTC);
+		break;
 
+	default:
 		m_temperatureMode = FUEL_GAUGE_TEMP_MODE_THERMISTOR;
 
 		// IC only calculates for LIPO chemistry, override the setting
@@ -623,100 +661,307 @@ static bool FUELGAUGE_IcInit(void)
 			m_rsocMeasurementConfig = RSOC_MEASUREMENT_DIRECT_DV;
 		}
 
-		m_icInitState++;
+		return FUELGAUGE_PROGRESS_DONE;
+	}
+
+	FUELGAUGE_StartTransfers(sysTime);
+
+	m_icInitState++;
+
+	return FUELGAUGE_PROGRESS_BUSY;
+}
+
+
+// ****************************************************************************
+/*!
+ * FUELGAUGE_StartUpdate runs the first half of the periodic update. If the ic
+ * is online the register transfers are queued in one go, the i2c driver runs
+ * them back to back, and the task waits for them in the read state. Otherwise
+ * the update is completed from the adc straight away.
+ *
+ * @param	sysTime		current value of the ms tick timer
+ * @retval	none
+ */
+// ****************************************************************************
+static void FUELGAUGE_StartUpdate(const uint32_t sysTime)
+{
+	const int16_t mcuTemperature = ANALOG_GetMCUTemp();
+	const uint16_t battMv = ANALOG_GetBatteryMv();
+
+	uint32_t socTimeDiff;
+
+	// If battery just inserted or there has been a profile change, work out the SOC
+	// Should not run if soc is used from fuel gauge ic.
+	if (m_initBatterySOC)
+	{
+		m_initBatterySOC = false;
+
+		//m_currentSocTableIdx = FUELGAUGE_GetSocTableIdxFromOCV(battMv);
+		m_soc = FUELGAUGE_GetSOCFromOCV(battMv);
+		MS_TIMEREF_INIT(m_lastSocTimeMs, sysTime);
 
-		return true;
 	}
 
-	m_fuelgaugeIcId = 0u;
+	if (FUELGAUGE_STATUS_ONLINE == m_fuelgaugeIcStatus)
+	{
+		// Transfer 0 is the cell voltage, 1 the temperature and 2 the ITE if used
+		FUELGAUGE_ClearTransfers();
+		FUELGAUGE_AddRead(FG_MEM_ADDR_CELL_MV);
 
-	return false;
+		if (m_temperatureMode == FUEL_GAUGE_TEMP_MODE_THERMISTOR)
+		{
+			FUELGAUGE_AddRead(FG_MEM_ADDR_CELL_TEMP);
+		}
+		else
+		{
+			m_batteryTemperaturePt1 = mcuTemperature * 10;
+			FUELGAUGE_AddWrite(FG_MEM_ADDR_CELL_TEMP, m_batteryTemperaturePt1 + CELL_TEMP_OFS);
+		}
+
+		if (RSOC_MEASUREMENT_DIRECT_DV != m_rsocMeasurementConfig)
+		{
+			FUELGAUGE_AddRead(FG_MEM_ADDR_ITE);
+		}
+
+		FUELGAUGE_StartTransfers(sysTime);
+
+		m_taskState = FUELGAUGE_TASK_STATE_READ;
+	}
+	else
+	{
+		m_batteryMv = battMv;
+
+		socTimeDiff = MS_TIMEREF_DIFF(m_lastSocTimeMs, sysTime);
 
+		if (RSOC_MEASUREMENT_DIRECT_DV == m_rsocMeasurementConfig)
+		{
+			FUELGAUGE_UpdateCalculateSOC(battMv, m_batteryTemperaturePt1 / 10, socTimeDiff);
+
+			MS_TIMEREF_INIT(m_lastSocTimeMs, sysTime);
+		}
+
+		m_taskState = FUELGAUGE_TASK_STATE_IDLE;
+	}
 }
 
 
 // ****************************************************************************
 /*!
- * FUELGAUGE_ReadWord reads a single register word from the fuel gauge IC, the
- * routine returns true if the read was successful and the value is valid. The
- * crc of the returned value is checked in the callback to ensure correctness.
+ * FUELGAUGE_FinishUpdate takes the results of the transfers queued by
+ * FUELGAUGE_StartUpdate once they have all completed. Any that failed leave the
+ * previous value in place.
  *
- * @param	cmd			address of device register to read
- * @param	p_word		pointer to value destination
- * @retval	bool		false = read unsuccessful
- * 						true = read successful
+ * @param	sysTime		current value of the ms tick timer
+ * @retval	none
  */
 // ****************************************************************************
-static bool FUELGAUGE_ReadWord(const uint8_t cmd, uint16_t * const p_word)
+static void FUELGAUGE_FinishUpdate(const uint32_t sysTime)
 {
-	const uint32_t sysTime = HAL_GetTick();
-	bool transactGood;
+	const int16_t mcuTemperature = ANALOG_GetMCUTemp();
+	const uint16_t battMv = ANALOG_GetBatteryMv();
 
-	m_fuelgaugeI2CSuccess = false;
+	uint16_t tempU16;
+	int16_t tempS16;
+	uint32_t socTimeDiff;
 
-	transactGood = I2CDRV_Transact(FUELGAUGE_I2C_PORTNO, FUELGAUGE_I2C_ADDR, &cmd, 3u,
-						I2CDRV_TRANSACTION_RX, FUELGAUGE_I2C_Callback,
-						1000u, sysTime
-						);
+	if (true == m_transfers[0u].success)
+	{
+		m_batteryMv = m_transfers[0u].word;
+	}
 
-	if (false == transactGood)
+	if ( (m_temperatureMode == FUEL_GAUGE_TEMP_MODE_THERMISTOR) && (true == m_transfers[1u].success) )
 	{
-		return false;
+		tempS16 = ((int16_t)m_transfers[1u].word - CELL_TEMP_OFS);
+
+		// Check for a sane number
+		if (tempS16 < (int16_t)(mcuTemperature - 10))
+		{
+			m_batteryTemperaturePt1 = mcuTemperature * 10;
+		}
+		else
+		{
+			m_batteryTemperaturePt1 = tempS16;
+		}
 	}
 
-	while(false == I2CDRV_IsReady(FUELGAUGE_I2C_PORTNO))
+	socTimeDiff = MS_TIMEREF_DIFF(m_lastSocTimeMs, sysTime);
+
+	if (RSOC_MEASUREMENT_DIRECT_DV == m_rsocMeasurementConfig)
 	{
-		// Wait for transfer
+		FUELGAUGE_UpdateCalculateSOC(battMv, m_batteryTemperaturePt1 / 10, socTimeDiff);
+
+		MS_TIMEREF_INIT(m_lastSocTimeMs, sysTime);
 	}
+	else if (true == m_transfers[2u].success)
+	{
+		tempU16 = m_transfers[2u].word;
+
+		if (FUELGAUGE_CalculateDischargeRate(m_lastSocPt1, tempU16,	socTimeDiff))
+		{
+			// Log soc and time for next update
+			m_lastSocPt1 = tempU16;
 
-	*p_word = m_fuelgaugeI2CReadResult;
+			MS_TIMEREF_INIT(m_lastSocTimeMs, sysTime);
+		}
+	}
 
-	return m_fuelgaugeI2CSuccess;
+	m_taskState = FUELGAUGE_TASK_STATE_IDLE;
 }
 
 
 // ****************************************************************************
 /*!
- * FUELGAUGE_WriteWord writes to a word register within the fuel gauge device.
- * A transfer buffer is created and the crc is calculated and appended to the
- * end of the buffer. The routine will wait until the transfer is complete and
- * upon a successful write will return true.
+ * FUELGAUGE_ClearTransfers empties the transfer list ready for a new set. Must
+ * only be called once the previous set has completed.
+ *
+ * @param	none
+ * @retval	none
+ */
+// ****************************************************************************
+static void FUELGAUGE_ClearTransfers(void)
+{
+	m_transferCount = 0u;
+	m_transferDoneCount = 0u;
+}
+
+
+// ****************************************************************************
+/*!
+ * FUELGAUGE_AddRead adds a register word read to the transfer list, the crc of
+ * the returned value is checked in the callback to ensure correctness.
+ *
+ * @param	cmd			address of device register to read
+ * @retval	none
+ */
+// ****************************************************************************
+static void FUELGAUGE_AddRead(const uint8_t cmd)
+{
+	if (m_transferCount < FUELGAUGE_TRANSFER_MAX)
+	{
+		m_transfers[m_transferCount].cmd = cmd;
+		m_transfers[m_transferCount].transactType = I2CDRV_TRANSACTION_RX;
+		m_transfers[m_transferCount].word = 0u;
+		m_transfers[m_transferCount].success = false;
+
+		m_transferCount++;
+	}
+}
+
+
+// ****************************************************************************
+/*!
+ * FUELGAUGE_AddWrite adds a register word write to the transfer list.
  *
  * @param	memAddress		device memory address to write to
  * @param	value			uint16 value to write to the memory address
- * @retval	bool			false = write unsuccessful
- * 							true = write successful
+ * @retval	none
  */
 // ****************************************************************************
-static bool FUELGAUGE_WriteWord(const uint8_t memAddress, const uint16_t value)
+static void FUELGAUGE_AddWrite(const uint8_t memAddress, const uint16_t value)
 {
-	const uint32_t sysTime = HAL_GetTick();
+	if (m_transferCount < FUELGAUGE_TRANSFER_MAX)
+	{
+		m_transfers[m_transferCount].cmd = memAddress;
+		m_transfers[m_transferCount].transactType = I2CDRV_TRANSACTION_TX;
+		m_transfers[m_transferCount].word = value;
+		m_transfers[m_transferCount].success = false;
+
+		m_transferCount++;
+	}
+}
+
+
+// ****************************************************************************
+/*!
+ * FUELGAUGE_StartTransfers loads the transfer list in to the i2c driver queue.
+ * A write has its crc calculated and appended to the end of the buffer. If the
+ * driver won't take a transfer the list is cut short there and the remainder
+ * are left marked as failed.
+ *
+ * @param	sysTime		current value of the ms tick timer
+ * @retval	none
+ */
+// ****************************************************************************
+static void FUELGAUGE_StartTransfers(const uint32_t sysTime)
+{
+	const uint8_t count = m_transferCount;
+
+	FUELGAUGE_Transfer_t * p_transfer;
+	uint8_t writeData[4u];
 	bool transactGood;
-	uint8_t writeData[4u] = { memAddress, (uint8_t)(value & 0xFFu), (uint8_t)(value >> 8u), 0u};
+	crc_t crc;
+	uint8_t i;
+
+	for (i = 0u; i < count; i++)
+	{
+		p_transfer = &m_transfers[i];
 
-	crc_t crc = crc_8_init(FUELGAUGE_I2C_ADDR);
-	crc = crc_8_update(crc, writeData, 3u);
+		if (I2CDRV_TRANSACTION_TX == p_transfer->transactType)
+		{
+			writeData[0u] = p_transfer->cmd;
+			writeData[1u] = (uint8_t)(p_transfer->word & 0xFFu);
+			writeData[2u] = (uint8_t)(p_transfer->word >> 8u);
+
+			crc = crc_8_init(FUELGAUGE_I2C_ADDR);
+			crc = crc_8_update(crc, writeData, 3u);
 
-	writeData[3u] = (uint8_t)crc;
+			writeData[3u] = (uint8_t)crc;
+
+			transactGood = I2CDRV_Transact(FUELGAUGE_I2C_PORTNO, FUELGAUGE_I2C_ADDR, writeData, 4u,
+								I2CDRV_TRANSACTION_TX, FUELGAUGE_I2C_Callback,
+								FUELGAUGE_I2C_TIMEOUT_MS, sysTime
+								);
+		}
+		else
+		{
+			transactGood = I2CDRV_Transact(FUELGAUGE_I2C_PORTNO, FUELGAUGE_I2C_ADDR, &p_transfer->cmd, 3u,
+								I2CDRV_TRANSACTION_RX, FUELGAUGE_I2C_Callback,
+								FUELGAUGE_I2C_TIMEOUT_MS, sysTime
+								);
+		}
 
-	m_fuelgaugeI2CSuccess = false;
+		if (false == transactGood)
+		{
+			m_transferCount = i;
+			break;
+		}
+	}
+}
 
-	transactGood = I2CDRV_Transact(FUELGAUGE_I2C_PORTNO, FUELGAUGE_I2C_ADDR, writeData, 4u,
-						I2CDRV_TRANSACTION_TX, FUELGAUGE_I2C_Callback,
-						1000u, sysTime
-						);
 
-	if (false == transactGood)
+// ****************************************************************************
+/*!
+ * FUELGAUGE_TransfersDone checks if all the queued transfers have had their
+ * callback. A nack or bus fault is reported through the callback and the driver
+ * times out a transfer that never finishes, so the wait is always bounded. If
+ * the driver goes idle with transfers still outstanding they have been lost,
+ * the queue is emptied when it is restarted after a stop, and they count as
+ * failed.
+ *
+ * @param	none
+ * @retval	bool		false = transfers still in progress
+ * 						true = all transfers completed or failed
+ */
+// ****************************************************************************
+static bool FUELGAUGE_TransfersDone(void)
+{
+	if (m_transferDoneCount >= m_transferCount)
 	{
-		return false;
+		return true;
 	}
 
-	while(false == I2CDRV_IsReady(FUELGAUGE_I2C_PORTNO))
+	// Also runs any pending callback rather than waiting for the osloop
+	if (true == I2CDRV_IsReady(FUELGAUGE_I2C_PORTNO))
 	{
-		// Wait for transfer
+		if (m_transferDoneCount < m_transferCount)
+		{
+			m_transferCount = m_transferDoneCount;
+		}
+
+		return true;
 	}
 
-	return m_fuelgaugeI2CSuccess;
+	return false;
 }
 
 
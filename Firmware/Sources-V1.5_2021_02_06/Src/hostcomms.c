@@ -8,7 +8,19 @@
  * 				commands from the pijuice interface and the emulated RTC.
  * 				The RTC has a dedicated buffer here to give a fast response to
  * 				the kernel driver which seems to be a bit sensitive to clock
- * 				stretching.
+ * 				stretching. The buffer is doubled up, the task refreshes the
+ * 				hidden copy once a second (or after a host write) and flips it
+ * 				in so the i2c port is never held off while the rtc is read.
+ * 				The host poll bursts are timed to predict how long the host
+ * 				will be quiet so the taskman can stop between regular polls,
+ * 				the host can also tell it is going quiet with the quiesce
+ * 				command.
+ * 				Writes to the pijuice address are received in to a ring of
+ * 				slots and acked straight away, the task drains them in order.
+ * 				The host is only stretched when the ring is full, a read waits
+ * 				for the ring to drain so it always sees the writes before it.
+ * 				A write that still gets in with the ring full is NACKed so the
+ * 				host can retry it, the overflow flag records that it happened.
  *
  * @note		time references are linked to the last time the service routine
  * 				was run due to the concurrency of the interrupt routine, the
@@ -19,6 +31,8 @@
 // ----------------------------------------------------------------------------
 // Include section - add all #includes here:
 
+#include <string.h>
+
 #include "main.h"
 #include "eeprom.h"
 #include "nv.h"
@@ -46,6 +60,8 @@
 #include "adc.h"
 #include "i2cdrv.h"
 #include "util.h"
+#include "timing_stats.h"
+#include "seqlock.h"
 
 #include "hostcomms.h"
 
@@ -65,18 +81,43 @@
 // 255 is max transaction length, byte 0 will have address, byte 1 will have command code
 #define HOSTCOMMS_I2C_BUFFER_LEN		256u
 
+// Time, alarm 1, alarm 2, control and status registers of the ds1339
+#define HOSTCOMMS_RTC_BUFFER_LEN		17u
+
+// RTC time register never reads this, forces a mirror refresh
+#define HOSTCOMMS_RTC_MIRROR_STALE		0xFFFFFFFFu
+
+#define HOSTCOMMS_QUIESCE_RESUME		0u
+#define HOSTCOMMS_QUIESCE_ENTER			1u
+
+#define HOSTCOMMS_ACTIVITY_QUIESCED		0x01u
+#define HOSTCOMMS_ACTIVITY_PREDICTING	0x02u
+#define HOSTCOMMS_ACTIVITY_RX_OVERFLOW	0x04u
+
+
+// Receive ring slots in use, the counters are free running
+#define HOSTCOMMS_RX_RING_COUNT()		((uint8_t)(m_rxHead - m_rxTail))
+#define HOSTCOMMS_RX_RING_FULL()		(HOSTCOMMS_RX_RING_COUNT() >= HOSTCOMMS_RX_RING_SLOTS)
+#define HOSTCOMMS_RX_RING_SLOT(idx)		(&m_rxRing[(idx) & (HOSTCOMMS_RX_RING_SLOTS - 1u)])
+
 
 typedef enum
 {
 	HOSTCOMMS_MODE_WAIT = 0u,
 	HOSTCOMMS_MODE_RX = 1u,
-	HOSTCOMMS_MODE_RXC = 2u,
 	HOSTCOMMS_MODE_TX = 3u,
 	HOSTCOMMS_MODE_TX_CLOCK = 4u,
 	HOSTCOMMS_MODE_FAULT = 5u
 } HOSTCOMMS_Mode_t;
 
 
+typedef struct
+{
+	uint8_t data[HOSTCOMMS_I2C_BUFFER_LEN];		// byte 0 address, byte 1 command code
+	uint16_t len;								// command code and data
+} HOSTCOMMS_RxSlot_t;
+
+
 typedef struct
 {
 	uint8_t addr;
@@ -85,15 +126,34 @@ typedef struct
 } HOSTCOMMS_Msg_t;
 
 
+typedef struct
+{
+	SEQLOCK_t seq;
+	uint32_t lastCommandTimeMs;		// Host command stamp last seen
+	uint32_t lastActivityMs;		// Service time the stamp last changed
+	uint32_t burstStartMs;			// Service time the current burst started
+	uint32_t periodMs;				// Averaged time between burst starts, 0 = not learnt
+	uint32_t jitterMs;				// Averaged difference of the bursts from the period
+	uint8_t confidence;				// Bursts in a row that came when expected
+} HOSTCOMMS_IdlePredictor_t;
+
+
 // ----------------------------------------------------------------------------
 // Function prototypes for functions that only have scope in this module:
 
+static void HOSTCOMMS_UpdateIdlePredictor(const uint32_t sysTime);
 
 // ----------------------------------------------------------------------------
 // Variables that only have scope in this module:
 
 static uint8_t m_hostcommsBuffer[HOSTCOMMS_I2C_BUFFER_LEN];
-static uint16_t m_rxLen;
+static HOSTCOMMS_RxSlot_t m_rxRing[HOSTCOMMS_RX_RING_SLOTS];
+static volatile uint8_t m_rxHead;		// Slot being received, moved on by the interrupt
+static volatile uint8_t m_rxTail;		// Oldest queued write, moved on by the task
+static uint8_t * m_rxData;				// Where the current transfer is received, the head slot or the tx buffer
+static volatile bool m_rxOverflow;		// A write was NACKed with the ring full, cleared when read
+static uint32_t m_rxRingFullCount;
+static uint32_t m_rxDrainTime;
 static uint32_t m_txCount;
 static uint32_t m_rxCount;
 static uint32_t m_addrCount;
@@ -103,10 +163,17 @@ static uint32_t m_i2cResetCount;
 static HOSTCOMMS_Mode_t m_hostcommsMode;
 static uint32_t m_lastServiceTime;
 
-static uint32_t m_lastHostCommandTimeMs __attribute__((section("no_init")));
+static volatile uint32_t m_lastHostCommandTimeMs __attribute__((section("no_init")));
+
+static uint8_t m_rtcBuffer[2u][HOSTCOMMS_RTC_BUFFER_LEN];
+static volatile uint8_t m_rtcBufferIdx;
+static volatile uint32_t m_rtcRegUpdate_bm;
+static uint32_t m_rtcMirrorTime = HOSTCOMMS_RTC_MIRROR_STALE;
 
-static uint8_t m_rtcBuffer[17u];
-static uint32_t m_rtcRegUpdate_bm;
+static HOSTCOMMS_IdlePredictor_t m_idlePredict;
+static volatile bool m_hostQuiesced;
+static uint32_t m_quiesceTimeMs;
+static uint32_t m_quiesceLengthMs;
 
 // ----------------------------------------------------------------------------
 // Variables that have scope from outside this module:
@@ -144,12 +211,25 @@ void HOSTCOMMS_Init(const uint32_t sysTime)
 
 	m_i2cResetCount = 0u;
 
+	m_rxHead = 0u;
+	m_rxTail = 0u;
+	m_rxData = m_rxRing[0u].data;
+	m_rxOverflow = false;
+	m_rxRingFullCount = 0u;
+
 
 	if (executionState != EXECUTION_STATE_NORMAL)
 	{
 		MS_TIME_COUNTER_INIT(m_lastHostCommandTimeMs);
 	}
 
+	m_idlePredict.lastCommandTimeMs = m_lastHostCommandTimeMs;
+	m_idlePredict.lastActivityMs = sysTime;
+	m_idlePredict.burstStartMs = sysTime;
+	m_idlePredict.periodMs = 0u;
+	m_idlePredict.jitterMs = 0u;
+	m_idlePredict.confidence = 0u;
+
 
 	if (NV_ReadVariable_U8(OWN_ADDRESS1_NV_ADDR, &tempU8))
 	{
@@ -177,7 +257,7 @@ void HOSTCOMMS_Init(const uint32_t sysTime)
 	// Assign the peripheral address
 	hi2c1.hdmarx->Instance->CPAR = (uint32_t)&I2C1->RXDR;
 	// Point to the second byte, the first will contain the device address.
-	hi2c1.hdmarx->Instance->CMAR = (uint32_t)&m_hostcommsBuffer[1u];
+	hi2c1.hdmarx->Instance->CMAR = (uint32_t)&m_rxRing[0u].data[1u];
 
 	// Disable the dma channel for now
 	hi2c1.hdmarx->Instance->CCR &= ~(DMA_CCR_EN);
@@ -242,10 +322,16 @@ void HOSTCOMMS_Service(const uint32_t sysTime)
 		MS_TIMEREF_INIT(m_i2cBusyTime, m_lastServiceTime);
 	}
 
+	// A read held for the ring to drain is not stuck, time from when it drained
+	if (0u != HOSTCOMMS_RX_RING_COUNT())
+	{
+		MS_TIMEREF_INIT(m_rxDrainTime, m_lastServiceTime);
+	}
+
 	// Timeout after a second, will catch fault mode
 	if ( ( MS_TIMEREF_TIMEOUT(m_lastHostCommandTimeMs, m_lastServiceTime, 100u) &&
-			(HOSTCOMMS_MODE_WAIT != m_hostcommsMode) &&
-			(HOSTCOMMS_MODE_RXC != m_hostcommsMode) ) ||
+			MS_TIMEREF_TIMEOUT(m_rxDrainTime, m_lastServiceTime, 100u) &&
+			(HOSTCOMMS_MODE_WAIT != m_hostcommsMode) ) ||
 			MS_TIMEREF_TIMEOUT(m_i2cBusyTime, m_lastServiceTime, 500u)
 			)
 	{
@@ -256,16 +342,21 @@ void HOSTCOMMS_Service(const uint32_t sysTime)
 		hi2c1.hdmatx->Instance->CCR &= ~(DMA_CCR_EN);
 		hi2c1.hdmarx->Instance->CCR &= ~(DMA_CCR_EN);
 
-		// Re-enable the peripheral and addr interrupt
+		// Re-enable the peripheral and addr interrupt, unless the ring is full and stretching the host
 		I2C1->CR1 |= I2C_CR1_PE;
-		I2C1->CR1 |= I2C_CR1_ADDRIE;
+
+		if (false == HOSTCOMMS_RX_RING_FULL())
+		{
+			I2C1->CR1 |= I2C_CR1_ADDRIE;
+		}
 
 		m_i2cResetCount++;
 		m_hostcommsMode = HOSTCOMMS_MODE_WAIT;
 	}
 
 
-	if (HOSTCOMMS_MODE_TX == m_hostcommsMode)
+	// Reads are held until the writes before them have been dealt with
+	if ( (HOSTCOMMS_MODE_TX == m_hostcommsMode) && (0u == HOSTCOMMS_RX_RING_COUNT()) )
 	{
 		readCmdCode = m_hostcommsBuffer[1u];
 
@@ -290,6 +381,8 @@ void HOSTCOMMS_Service(const uint32_t sysTime)
 		}
 	}
 
+	HOSTCOMMS_UpdateIdlePredictor(sysTime);
+
 	m_lastServiceTime = sysTime;
 }
 
@@ -298,9 +391,11 @@ void HOSTCOMMS_Service(const uint32_t sysTime)
 /*!
  * HOSTCOMMS_Task performs the command server write tasks with a lowish priority
  * to make sure any write commands that contain delays that would cause issue to
- * the osloop system. The RTC buffer is updated here too, calling the rtc module
- * where needed after a host write and reading the rtc value ready for the host
- * to fetch.
+ * the osloop system. The queued writes are all drained in order, a full ring
+ * lets the host back in as soon as a slot is free. The RTC buffer is updated here too, calling the rtc module
+ * where needed after a host write. The rtc value is read in to the hidden copy
+ * of the buffer when the seconds tick over and then swapped in for the host to
+ * fetch, the address interrupt is left alone so the host is never stretched.
  *
  * @param	sysTime		current value of the ms tick timer
  * @retval	none
@@ -310,71 +405,119 @@ void HOSTCOMMS_Task(void)
 {
 	uint16_t dataLen;
 	uint8_t readCmdCode;
-
-	if (HOSTCOMMS_MODE_RXC == m_hostcommsMode)
+	HOSTCOMMS_RxSlot_t * p_slot;
+	uint8_t * p_rtcBuffer = m_rtcBuffer[m_rtcBufferIdx];
+	uint32_t rtcRegUpdate_bm;
+	uint32_t rtcTime;
+	uint32_t refreshStartUs;
+	uint8_t ctrlStatus[2u];
+
+	while (0u != HOSTCOMMS_RX_RING_COUNT())
 	{
-		dataLen = m_rxLen;
-		readCmdCode = m_hostcommsBuffer[1u];
+		p_slot = HOSTCOMMS_RX_RING_SLOT(m_rxTail);
+		dataLen = p_slot->len;
+		readCmdCode = p_slot->data[1u];
 
 		// Something sent from the host
-		if (m_hostcommsBuffer[0u] == (I2C1->OAR1 & 0xFEu))
+		if (p_slot->data[0u] == (I2C1->OAR1 & 0xFEu))
 		{
 			// Is a pijuice command
 			if ( (readCmdCode >= 0x80u) && (readCmdCode <= 0x8Fu) )
 			{
 				dataLen -= 1u; // first is command
-				RtcDs1339ProcessRequest(I2C_DIRECTION_TRANSMIT, readCmdCode - 0x80u, &m_hostcommsBuffer[2u], &dataLen);
+				RtcDs1339ProcessRequest(I2C_DIRECTION_TRANSMIT, readCmdCode - 0x80u, &p_slot->data[2u], &dataLen);
 			}
 			else
 			{
-				CmdServerProcessRequest(MASTER_CMD_DIR_WRITE, &m_hostcommsBuffer[1u], &dataLen);
+				CmdServerProcessRequest(MASTER_CMD_DIR_WRITE, &p_slot->data[1u], &dataLen);
 			}
 		}
 
-		m_hostcommsMode = HOSTCOMMS_MODE_WAIT;
-	}
+		// Slot free, let the host back in if the ring was full. The interrupt can
+		// fill the ring again in between so the check is done with it held off.
+		__disable_irq();
 
-	// Stop the interrupt so the clock will stretch briefly if an attempt to access device
-	I2C1->CR1 &= ~(I2C_CR1_ADDRIE);
+		m_rxTail++;
 
-	// If the host isn't transferring RTC data, update the buffer here
-	// Burns clock cycles and briefly blocks i2c port, maybe some optimisation could be had.
-	if (HOSTCOMMS_MODE_TX_CLOCK != m_hostcommsMode)
-	{
+		if (false == HOSTCOMMS_RX_RING_FULL())
+		{
+			I2C1->CR1 |= I2C_CR1_ADDRIE;
+		}
 
+		__enable_irq();
+	}
 
-		if (0u != (m_rtcRegUpdate_bm & RTC_REG_TIME_Msk))
-		{
-			m_rtcRegUpdate_bm &= ~(RTC_REG_TIME_Msk);
+	// Grab the registers the host has written, the interrupt writes them in to
+	// the buffer that is visible to the host.
+	__disable_irq();
+	rtcRegUpdate_bm = m_rtcRegUpdate_bm;
+	m_rtcRegUpdate_bm = 0u;
+	__enable_irq();
 
-			RtcWriteTime(&m_rtcBuffer[0u], false);
+	if (0u != rtcRegUpdate_bm)
+	{
+		if (0u != (rtcRegUpdate_bm & RTC_REG_TIME_Msk))
+		{
+			RtcWriteTime(&p_rtcBuffer[0u], false);
 		}
 
-		if (0u != (m_rtcRegUpdate_bm & RTC_REG_ALARM1_Msk))
+		if (0u != (rtcRegUpdate_bm & RTC_REG_ALARM1_Msk))
 		{
-			m_rtcRegUpdate_bm &= ~(RTC_REG_ALARM1_Msk);
-
-			RtcWriteAlarm1(&m_rtcBuffer[7u], false);
+			RtcWriteAlarm1(&p_rtcBuffer[7u], false);
 		}
 
-		if (0u != (m_rtcRegUpdate_bm & (RTC_REG_CTRL_Msk | RTC_REG_STATUS_Msk)))
+		if (0u != (rtcRegUpdate_bm & (RTC_REG_CTRL_Msk | RTC_REG_STATUS_Msk)))
 		{
-			dataLen = (0u == (m_rtcRegUpdate_bm & RTC_REG_STATUS_Msk)) ? 1u : 2u;
-			m_rtcRegUpdate_bm &= ~(RTC_REG_CTRL_Msk | RTC_REG_STATUS_Msk);
+			dataLen = (0u == (rtcRegUpdate_bm & RTC_REG_STATUS_Msk)) ? 1u : 2u;
 
-			RtcWriteControlStatus(&m_rtcBuffer[0xEu], dataLen);
+			RtcWriteControlStatus(&p_rtcBuffer[0xEu], dataLen);
 		}
 
-		m_rtcRegUpdate_bm &= ~(RTC_REG_ALARM2_Msk);
+		m_rtcMirrorTime = HOSTCOMMS_RTC_MIRROR_STALE;
+	}
+
+	// Alarm flags can change at any time, only costs a couple of bytes to check
+	RtcReadControlStatus(ctrlStatus, &dataLen);
 
-		RtcReadTime(m_rtcBuffer, false);
-		RtcReadAlarm1(&m_rtcBuffer[7u], false);
-		RtcReadControlStatus(&m_rtcBuffer[0xEu], &dataLen);
+	if ( (ctrlStatus[0u] != p_rtcBuffer[0xEu]) || (ctrlStatus[1u] != p_rtcBuffer[0xFu]) )
+	{
+		m_rtcMirrorTime = HOSTCOMMS_RTC_MIRROR_STALE;
 	}
 
-	// Restore the ADDRIE state depending on the mode, addrie will get restored on the next spin
-	// if rxc has just occurred.
-	I2C1->CR1 |= (HOSTCOMMS_MODE_RXC == m_hostcommsMode) ? 0u : I2C_CR1_ADDRIE;
+	// Reading the time register locks the date shadow until it is read too
+	rtcTime = RTC->TR;
+	(void)RTC->DR;
+
+	// If the host is transferring RTC data the buffer not visible could still be
+	// in use by the dma if swapped since the transfer started, try again next time.
+	if ( (rtcTime != m_rtcMirrorTime) && (HOSTCOMMS_MODE_TX_CLOCK != m_hostcommsMode) )
+	{
+		refreshStartUs = TIMING_STATS_GetTimeUs();
+
+		p_rtcBuffer = m_rtcBuffer[m_rtcBufferIdx ^ 1u];
+
+		RtcReadTime(p_rtcBuffer, false);
+		RtcReadAlarm1(&p_rtcBuffer[7u], false);
+		RtcReadControlStatus(&p_rtcBuffer[0xEu], &dataLen);
+
+		// Alarm 2 and trickle charger are not emulated, registers read back as written
+		memcpy(&p_rtcBuffer[11u], &m_rtcBuffer[m_rtcBufferIdx][11u], 3u);
+		p_rtcBuffer[16u] = m_rtcBuffer[m_rtcBufferIdx][16u];
+
+		// Only swap if the host hasn't written to the visible buffer in the mean time,
+		// the write needs applying to the rtc first.
+		__disable_irq();
+
+		if (0u == m_rtcRegUpdate_bm)
+		{
+			m_rtcBufferIdx ^= 1u;
+			m_rtcMirrorTime = rtcTime;
+		}
+
+		__enable_irq();
+
+		TIMING_STATS_RecordTask(TIMING_STATS_RTC_MIRROR, refreshStartUs, TIMING_STATS_GetTimeUs());
+	}
 }
 
 
@@ -382,7 +525,9 @@ void HOSTCOMMS_Task(void)
 // ****************************************************************************
 /*!
  * HOSTCOMMS_GetLastCommandAgeMs returns the time elapsed in milliseconds since the last
- * host access.
+ * host access. The i2c interrupt stamps the command with the osloop time which can be
+ * ahead of a sysTime the taskman took earlier, that reads as no time rather than the
+ * difference wrapping round to a host that looks to have been gone for weeks.
  *
  * @param	sysTime		current value of the system tick timer
  * @retval	uint32_t	time elapsed in mS since the last host access
@@ -390,7 +535,173 @@ void HOSTCOMMS_Task(void)
 // ****************************************************************************
 uint32_t HOSTCOMMS_GetLastCommandAgeMs(const uint32_t sysTime)
 {
-	return MS_TIMEREF_DIFF(m_lastHostCommandTimeMs, sysTime);
+	const uint32_t lastHostCommandTimeMs = m_lastHostCommandTimeMs;
+	const uint32_t age = MS_TIMEREF_DIFF(lastHostCommandTimeMs, sysTime);
+
+	return (age > INT32_MAX) ? 0u : age;
+}
+
+
+// ****************************************************************************
+/*!
+ * HOSTCOMMS_GetHostIdleMs returns how long the host is expected to leave the i2c
+ * port alone. Nothing is promised while a transfer or poll burst is going on. If
+ * the host has quiesced it is not expected back. Once the bursts have come
+ * regularly for a while the time to the next one is predicted, cut short by
+ * twice the jitter and the wake time so the device is up before it comes. If
+ * that is wrong the address match still wakes the device. With no prediction, or
+ * an overdue burst, the host is not expected back once it has sent nothing for
+ * HOSTCOMMS_HOST_GONE_MS.
+ *
+ * @param	sysTime		current value of the system tick timer
+ * @retval	uint32_t	expected quiet time in ms, HOSTCOMMS_IDLE_FOREVER if the
+ * 						host is not expected back
+ */
+// ****************************************************************************
+uint32_t HOSTCOMMS_GetHostIdleMs(const uint32_t sysTime)
+{
+	const uint32_t lastCommandAge = HOSTCOMMS_GetLastCommandAgeMs(sysTime);
+	uint32_t seq;
+	uint32_t burstStartMs;
+	uint32_t periodMs;
+	uint32_t jitterMs;
+	uint8_t confidence;
+	uint32_t burstAgeMs;
+	uint32_t guardMs;
+
+	if ( (HOSTCOMMS_MODE_WAIT != m_hostcommsMode) || (0u != HOSTCOMMS_RX_RING_COUNT()) ||
+			(lastCommandAge < HOSTCOMMS_BURST_GAP_MS) )
+	{
+		return 0u;
+	}
+
+	if (true == m_hostQuiesced)
+	{
+		if ( (0u == m_quiesceLengthMs) || (false == MS_TIMEREF_TIMEOUT(m_quiesceTimeMs, sysTime, m_quiesceLengthMs)) )
+		{
+			return HOSTCOMMS_IDLE_FOREVER;
+		}
+
+		m_hostQuiesced = false;
+	}
+
+	do
+	{
+		seq = SEQLOCK_ReadBegin(&m_idlePredict.seq);
+		burstStartMs = m_idlePredict.burstStartMs;
+		periodMs = m_idlePredict.periodMs;
+		jitterMs = m_idlePredict.jitterMs;
+		confidence = m_idlePredict.confidence;
+	} while (true == SEQLOCK_ReadRetry(&m_idlePredict.seq, seq));
+
+	if (confidence >= HOSTCOMMS_PREDICT_CONFIDENCE)
+	{
+		// The service can have stamped the burst with a later tick than sysTime
+		burstAgeMs = MS_TIMEREF_DIFF(burstStartMs, sysTime);
+		burstAgeMs = (burstAgeMs > INT32_MAX) ? 0u : burstAgeMs;
+
+		guardMs = (jitterMs * 2u) + HOSTCOMMS_PREDICT_WAKE_MS;
+
+		if ((burstAgeMs + guardMs) < periodMs)
+		{
+			return periodMs - guardMs - burstAgeMs;
+		}
+
+		// Burst due, stay awake for it unless it is overdue
+		if (burstAgeMs <= (periodMs + (jitterMs * 2u) + HOSTCOMMS_PREDICT_SLACK_MS))
+		{
+			return 0u;
+		}
+	}
+
+	return (lastCommandAge >= HOSTCOMMS_HOST_GONE_MS) ? HOSTCOMMS_IDLE_FOREVER : 0u;
+}
+
+
+// ****************************************************************************
+/*!
+ * HOSTCOMMS_SetQuiesceData lets the host say it is going quiet, the device can
+ * then stop as soon as everything else allows without waiting for the host poll
+ * window to time out. The host is still served, each transfer wakes the device.
+ *
+ * p_data[0] = HOSTCOMMS_QUIESCE_ENTER or HOSTCOMMS_QUIESCE_RESUME
+ * p_data[1..2] = quiesce time in seconds, 0 = until resumed
+ *
+ * @param	p_data		pointer to command data
+ * @param	len			length of command data
+ * @retval	none
+ */
+// ****************************************************************************
+void HOSTCOMMS_SetQuiesceData(const uint8_t * const p_data, const uint16_t len)
+{
+	if (len < 1u)
+	{
+		return;
+	}
+
+	if (HOSTCOMMS_QUIESCE_ENTER == p_data[0u])
+	{
+		m_quiesceLengthMs = (len >= 3u) ? (UTIL_FromBytes_U16(&p_data[1u]) * 1000ul) : 0u;
+		MS_TIME_COUNTER_INIT(m_quiesceTimeMs);
+		m_hostQuiesced = true;
+	}
+	else if (HOSTCOMMS_QUIESCE_RESUME == p_data[0u])
+	{
+		m_hostQuiesced = false;
+	}
+}
+
+
+// ****************************************************************************
+/*!
+ * HOSTCOMMS_GetActivityData reads the quiesce state and what the idle predictor
+ * has learnt of the host poll bursts.
+ *
+ * p_data[0] = bit 0 quiesced, bit 1 predicting, bit 2 a host write was dropped
+ * 				with the receive ring full since the last read
+ * p_data[1] = bursts in a row that came when expected
+ * p_data[2..3] = burst period in ms
+ * p_data[4..5] = burst jitter in ms
+ *
+ * @param	p_data		pointer to destination of data
+ * @param	p_len		length of data
+ * @retval	none
+ */
+// ****************************************************************************
+void HOSTCOMMS_GetActivityData(uint8_t * const p_data, uint16_t * const p_len)
+{
+	bool rxOverflow;
+
+	// The interrupt can set the flag again between the read and the clear
+	__disable_irq();
+	rxOverflow = m_rxOverflow;
+	m_rxOverflow = false;
+	__enable_irq();
+
+	// Same priority as the predictor update, can't be torn
+	p_data[0u] = ((true == m_hostQuiesced) ? HOSTCOMMS_ACTIVITY_QUIESCED : 0u) |
+					((m_idlePredict.confidence >= HOSTCOMMS_PREDICT_CONFIDENCE) ? HOSTCOMMS_ACTIVITY_PREDICTING : 0u) |
+					((true == rxOverflow) ? HOSTCOMMS_ACTIVITY_RX_OVERFLOW : 0u);
+	p_data[1u] = m_idlePredict.confidence;
+	UTIL_ToBytes_U16((m_idlePredict.periodMs > UINT16_MAX) ? UINT16_MAX : m_idlePredict.periodMs, &p_data[2u]);
+	UTIL_ToBytes_U16((m_idlePredict.jitterMs > UINT16_MAX) ? UINT16_MAX : m_idlePredict.jitterMs, &p_data[4u]);
+
+	*p_len = 6u;
+}
+
+
+// ****************************************************************************
+/*!
+ * HOSTCOMMS_IsHostQuiesced returns true if the host has said it is going quiet,
+ * the quiesce time is only checked by HOSTCOMMS_GetHostIdleMs.
+ *
+ * @param	none
+ * @retval	bool		true = host has quiesced
+ */
+// ****************************************************************************
+bool HOSTCOMMS_IsHostQuiesced(void)
+{
+	return m_hostQuiesced;
 }
 
 
@@ -415,7 +726,7 @@ void HOSTCOMMS_SetInterrupt(void)
  * HOSTCOMMS_ChangeAddress handles the immediate update of an address change for
  * either of the slave addresses. It will be called from the command server so the
  * assumption is that there will not be an ongoing transaction as the hardware will
- * be tied with the RXC event. The address is 7 bits for i2c and it should be
+ * be tied with the write being drained from the ring. The address is 7 bits for i2c and it should be
  * pre-shifted before calling. Sett addr type to select the primary or secondary
  * slave address
  *
@@ -457,6 +768,73 @@ void HOSTCOMMS_ChangeAddress(const uint8_t addrType, const uint8_t addr)
 // FUNCTIONS WITH LOCAL SCOPE
 // ----------------------------------------------------------------------------
 // ----------------------------------------------------------------------------
+// ****************************************************************************
+/*!
+ * HOSTCOMMS_UpdateIdlePredictor times the host poll bursts, a command after a
+ * gap of HOSTCOMMS_BURST_GAP_MS starts a new burst. A burst that starts when
+ * expected is averaged in to the period and jitter, an early one is taken as a
+ * stray command if the period is established, anything else means the host has
+ * changed what it is doing and the period is learnt again. The service time
+ * is used rather than the command stamp, the interrupt stamps commands with the
+ * time of the last service which is stale after a wake from stop.
+ *
+ * @param	sysTime		current value of the ms tick timer
+ * @retval	none
+ */
+// ****************************************************************************
+static void HOSTCOMMS_UpdateIdlePredictor(const uint32_t sysTime)
+{
+	const uint32_t lastHostCommandTimeMs = m_lastHostCommandTimeMs;
+	uint32_t intervalMs;
+	uint32_t errorMs;
+
+	if (lastHostCommandTimeMs == m_idlePredict.lastCommandTimeMs)
+	{
+		return;
+	}
+
+	SEQLOCK_WriteBegin(&m_idlePredict.seq);
+
+	if (MS_TIMEREF_TIMEOUT(m_idlePredict.lastActivityMs, sysTime, HOSTCOMMS_BURST_GAP_MS))
+	{
+		intervalMs = MS_TIMEREF_DIFF(m_idlePredict.burstStartMs, sysTime);
+		errorMs = (intervalMs > m_idlePredict.periodMs) ?
+					(intervalMs - m_idlePredict.periodMs) :
+					(m_idlePredict.periodMs - intervalMs);
+
+		if ( (0u != m_idlePredict.periodMs) &&
+				(errorMs <= ((m_idlePredict.jitterMs * 2u) + HOSTCOMMS_PREDICT_SLACK_MS)) )
+		{
+			m_idlePredict.periodMs = ((m_idlePredict.periodMs * 3u) + intervalMs + 2u) / 4u;
+			m_idlePredict.jitterMs = ((m_idlePredict.jitterMs * 3u) + errorMs + 2u) / 4u;
+
+			if (m_idlePredict.confidence < (HOSTCOMMS_PREDICT_CONFIDENCE * 2u))
+			{
+				m_idlePredict.confidence++;
+			}
+
+			m_idlePredict.burstStartMs = sysTime;
+		}
+		else if ( (m_idlePredict.confidence >= HOSTCOMMS_PREDICT_CONFIDENCE) && (intervalMs < m_idlePredict.periodMs) )
+		{
+			// A stray command between regular bursts, a few of these and the period is learnt again
+			m_idlePredict.confidence /= 2u;
+		}
+		else
+		{
+			m_idlePredict.periodMs = (intervalMs < HOSTCOMMS_PREDICT_MAX_PERIOD_MS) ? intervalMs : 0u;
+			m_idlePredict.jitterMs = 0u;
+			m_idlePredict.confidence = 0u;
+			m_idlePredict.burstStartMs = sysTime;
+		}
+	}
+
+	m_idlePredict.lastActivityMs = sysTime;
+	m_idlePredict.lastCommandTimeMs = lastHostCommandTimeMs;
+
+	SEQLOCK_WriteEnd(&m_idlePredict.seq);
+}
+
 
 
 // ----------------------------------------------------------------------------
@@ -468,8 +846,10 @@ void HOSTCOMMS_ChangeAddress(const uint8_t addrType, const uint8_t addr)
 void I2C1_IRQHandler(void)
 {
 	const uint8_t addrMatch = (uint8_t)((I2C1->ISR >> 16u) & 0xFEu);
+	HOSTCOMMS_RxSlot_t * const p_slot = HOSTCOMMS_RX_RING_SLOT(m_rxHead);
 	uint32_t addrClear = I2C_ICR_ADDRCF;
 	uint32_t rtcReg_bm;
+	uint16_t rxLen;
 
 	MS_TIMEREF_INIT(m_i2cBusyTime, m_lastServiceTime);
 
@@ -482,7 +862,7 @@ void I2C1_IRQHandler(void)
 
 			// Check to make sure the host has given a command
 			if ( (HOSTCOMMS_MODE_RX == m_hostcommsMode) &&
-					(1u == (m_rxLen = (HOSTCOMMS_I2C_BUFFER_LEN - hi2c1.hdmarx->Instance->CNDTR)))
+					(1u == (HOSTCOMMS_I2C_BUFFER_LEN - hi2c1.hdmarx->Instance->CNDTR))
 					)
 			{
 				// Disable rx dma
@@ -490,16 +870,17 @@ void I2C1_IRQHandler(void)
 
 				if (addrMatch == (I2C1->OAR1 & 0xFEu))
 				{
-					// Is from pijuice, let the service routine handle it
+					// Is from pijuice, let the service routine handle it once the ring is drained
 					m_hostcommsMode = HOSTCOMMS_MODE_TX;
 					m_hostcommsBuffer[0u] = addrMatch;
+					m_hostcommsBuffer[1u] = m_rxData[1u];
 				}
-				else if (m_hostcommsBuffer[1u] < sizeof(m_rtcBuffer))
+				else if (m_rxData[1u] < HOSTCOMMS_RTC_BUFFER_LEN)
 				{
 					// Is the RTC, can deal with this right now
-					hi2c1.hdmatx->Instance->CMAR = (uint32_t)&m_rtcBuffer[m_hostcommsBuffer[1u]];
+					hi2c1.hdmatx->Instance->CMAR = (uint32_t)&m_rtcBuffer[m_rtcBufferIdx][m_rxData[1u]];
 					hi2c1.hdmatx->DmaBaseAddress->IFCR |= (DMA_FLAG_GL1 << hi2c1.hdmatx->ChannelIndex);
-					hi2c1.hdmatx->Instance->CNDTR = sizeof(m_rtcBuffer) - m_hostcommsBuffer[1u];
+					hi2c1.hdmatx->Instance->CNDTR = HOSTCOMMS_RTC_BUFFER_LEN - m_rxData[1u];
 					hi2c1.hdmatx->Instance->CCR |= DMA_CCR_EN;
 
 					m_hostcommsMode = HOSTCOMMS_MODE_TX_CLOCK;
@@ -521,8 +902,6 @@ void I2C1_IRQHandler(void)
 
 			if (HOSTCOMMS_MODE_WAIT == m_hostcommsMode)
 			{
-				m_rxLen = 0u;
-
 				// Data is for master to slave
 				m_hostcommsMode = HOSTCOMMS_MODE_RX;
 
@@ -532,11 +911,30 @@ void I2C1_IRQHandler(void)
 				// Clear dma flags
 				hi2c1.hdmarx->DmaBaseAddress->IFCR |= (DMA_FLAG_GL1 << hi2c1.hdmarx->ChannelIndex);
 
+				// Receive in to the free slot at the head of the ring. With the ring full the
+				// address is only seen if another interrupt came in while the host was
+				// stretched, the head slot is the oldest queued write so the tx buffer, which
+				// is idle in WAIT, takes an rtc write instead.
+				m_rxData = (true == HOSTCOMMS_RX_RING_FULL()) ? m_hostcommsBuffer : p_slot->data;
+
+				hi2c1.hdmarx->Instance->CMAR = (uint32_t)&m_rxData[1u];
+
 				// Load in max data size
 				hi2c1.hdmarx->Instance->CNDTR = HOSTCOMMS_I2C_BUFFER_LEN;
 
-				// Enable dma device
-				hi2c1.hdmarx->Instance->CCR |= DMA_CCR_EN;
+				if ( (addrMatch == (I2C1->OAR1 & 0xFEu)) && (true == HOSTCOMMS_RX_RING_FULL()) )
+				{
+					// No slot for a pijuice command, NACK the command byte so the host sees
+					// the transfer fail and can retry it. Nothing is received, the stop finds
+					// no data and goes back to WAIT.
+					I2C1->CR2 |= I2C_CR2_NACK;
+					m_rxOverflow = true;
+				}
+				else
+				{
+					// Enable dma device
+					hi2c1.hdmarx->Instance->CCR |= DMA_CCR_EN;
+				}
 			}
 			else
 			{
@@ -554,7 +952,7 @@ void I2C1_IRQHandler(void)
 	{
 		if (HOSTCOMMS_MODE_RX == m_hostcommsMode)
 		{
-			m_rxLen = (HOSTCOMMS_I2C_BUFFER_LEN - hi2c1.hdmarx->Instance->CNDTR);
+			rxLen = (HOSTCOMMS_I2C_BUFFER_LEN - hi2c1.hdmarx->Instance->CNDTR);
 			// Check amount of data received
 			// 1 byte == command code, wait for repeated start
 			// More == rx complete, do something with it
@@ -562,33 +960,38 @@ void I2C1_IRQHandler(void)
 			// Disable rx dma
 			hi2c1.hdmarx->Instance->CCR &= ~(DMA_CCR_EN);
 
-			if (m_rxLen > 1u)
+			if (rxLen > 1u)
 			{
 				if (addrMatch == (I2C1->OAR1 & 0xFEu))
 				{
-					m_hostcommsMode = HOSTCOMMS_MODE_RXC;
+					// Queue it for the task, the host can carry on with the next one
+					p_slot->data[0u] = addrMatch;
+					p_slot->len = rxLen;
+					m_rxHead++;
 
-					// Let the service routine know the message is to be dealt with, probably not needed
-					// as the RTC address is dealt with here.
-					m_hostcommsBuffer[0u] = addrMatch;
+					m_hostcommsMode = HOSTCOMMS_MODE_WAIT;
 
-					// Stretch the next address clock until the command has been dealt with so the
-					// host knows the device is busy.
-					I2C1->CR1 &= ~(I2C_CR1_ADDRIE);
+					if (true == HOSTCOMMS_RX_RING_FULL())
+					{
+						// Nowhere to put another, stretch the next address clock until the task
+						// frees a slot so the host knows the device is busy.
+						I2C1->CR1 &= ~(I2C_CR1_ADDRIE);
+						m_rxRingFullCount++;
+					}
 				}
-				else if ( (m_hostcommsBuffer[1u] + m_rxLen) <= sizeof(m_rtcBuffer) )
+				else if ( (m_rxData[1u] + rxLen) <= HOSTCOMMS_RTC_BUFFER_LEN )
 				{
 					// Is for RTC, deal with this now.
-					m_rxLen--;
+					rxLen--;
 
-					rtcReg_bm = (1u << (m_hostcommsBuffer[1u] + m_rxLen));
+					rtcReg_bm = (1u << (m_rxData[1u] + rxLen));
 
-					while (m_rxLen > 0u)
+					while (rxLen > 0u)
 					{
-						m_rxLen--;
+						rxLen--;
 						rtcReg_bm >>= 1u;
 
-						m_rtcBuffer[m_hostcommsBuffer[1u] + m_rxLen] = m_hostcommsBuffer[2u + m_rxLen];
+						m_rtcBuffer[m_rtcBufferIdx][m_rxData[1u] + rxLen] = m_rxData[2u + rxLen];
 						m_rtcRegUpdate_bm |= rtcReg_bm;
 					}
 
@@ -604,7 +1007,13 @@ void I2C1_IRQHandler(void)
 			}
 			else
 			{
-				// This happens when i2cdetect sends an addr followed by a stop condition
+				// This happens when i2cdetect sends an addr followed by a stop condition,
+				// or after a NACKed command byte which may be left in the receive register.
+				if (I2C_ISR_RXNE == (I2C1->ISR & I2C_ISR_RXNE))
+				{
+					(void)I2C1->RXDR;
+				}
+
 				m_hostcommsMode = HOSTCOMMS_MODE_WAIT;
 			}
 		}
@@ -6,7 +6,19 @@
  * @brief       Lowish level driver for the i2c master port that talks to the
  * 				charger and fuel gauge. Kick off a transfer with I2CDRV_Transact
  * 				and the callback function (if set) is called once complete.
- * 				The IsReady function can be called to get the driver state.
+ * 				Each device has a small queue so several transactions can be
+ * 				loaded at once, the next one is started as soon as the previous
+ * 				completes so a register set can be refreshed in one burst.
+ * 				The IsReady function can be called to get the driver state, it
+ * 				is only ready once the queue has emptied.
+ *
+ * 				Completion and errors are picked up by the i2c and dma interrupts
+ * 				which flag the event as pending, the callback and the start of the
+ * 				next queued transaction are run from the service routine or from
+ * 				IsReady so a task waiting on the device doesn't wait for the next
+ * 				osloop tick. Build with I2CDRV_POLLED_COMPLETION defined to go back
+ * 				to checking the hardware flags from the osloop, the transaction
+ * 				times are recorded in the timing stats for comparing the two.
  *
  */
 // ----------------------------------------------------------------------------
@@ -18,16 +30,44 @@
 #include "system_conf.h"
 
 #include "time_count.h"
+#include "osloop.h"
+#include "timing_stats.h"
 #include "i2cdrv.h"
 
 // ----------------------------------------------------------------------------
 // Defines section - add all #defines here:
 
+#define I2CDRV_CR1_IRQ_ENABLES		(I2C_CR1_TXIE | I2C_CR1_TCIE | I2C_CR1_STOPIE | I2C_CR1_NACKIE | I2C_CR1_ERRIE)
+
+typedef struct
+{
+	uint8_t addr;
+	I2CDRV_TransactionType_t transactType;
+	uint8_t data[I2CDRV_MAX_BUFFER_SIZE];
+	uint8_t txLen;
+	uint8_t rxLen;
+	I2CDRV_EventCb_t callback;
+	uint16_t timeout;
+} I2CDRV_Transaction_t;
+
+typedef struct
+{
+	I2CDRV_Transaction_t transactions[I2CDRV_QUEUE_LENGTH];
+	volatile uint8_t head;
+	volatile uint8_t tail;
+} I2CDRV_Queue_t;
 
 // ----------------------------------------------------------------------------
 // Function prototypes for functions that only have scope in this module:
 
 static void I2CDRV_ProcessDevice(I2CDRV_Device_t * const p_device, const uint32_t sysTime);
+static bool I2CDRV_Enqueue(const uint8_t deviceIdx, const uint8_t addr,
+					const uint8_t * const data, const uint8_t txLen, const uint8_t rxLen,
+					I2CDRV_TransactionType_t transactType, const I2CDRV_EventCb_t callback,
+					const uint16_t timeout, const uint32_t sysTime);
+static void I2CDRV_StartNext(I2CDRV_Device_t * const p_device, const uint32_t sysTime);
+static void I2CDRV_RaiseEvent(I2CDRV_Device_t * const p_device, const I2CDRV_Device_Event_t event);
+static void I2CDRV_DispatchEvent(I2CDRV_Device_t * const p_device, const uint32_t sysTime);
 
 
 // ----------------------------------------------------------------------------
@@ -55,6 +95,9 @@ static I2CDRV_Device_t m_devices[I2CDRV_MAX_DEVICES] =
 };
 
 static I2CDRV_EventCb_t m_deviceCallbacks[I2CDRV_MAX_DEVICES] = {NULL, NULL};
+static I2CDRV_Queue_t m_queues[I2CDRV_MAX_DEVICES];
+static volatile uint8_t m_eventPending;
+static uint32_t m_transactStartUs[I2CDRV_MAX_DEVICES];
 
 
 // ----------------------------------------------------------------------------
@@ -66,6 +109,41 @@ void I2C2_IRQHandler(void)
 {
 	I2CDRV_Device_t * p_device = &m_devices[1u];
 
+#ifndef I2CDRV_POLLED_COMPLETION
+	const uint32_t isr = I2C2->ISR;
+
+	if (0u != (isr & (I2C_ISR_NACKF | I2C_ISR_BERR | I2C_ISR_ARLO)))
+	{
+		// Device didn't respond or the bus went wrong, bin the transaction
+		I2C2->ICR = I2C_ICR_NACKCF | I2C_ICR_BERRCF | I2C_ICR_ARLOCF | I2C_ICR_STOPCF;
+
+		I2CDRV_RaiseEvent(p_device, (I2CDRV_STATUS_BUSY_TX == p_device->status) ?
+												I2CDRV_EVENT_TX_FAILED :
+												I2CDRV_EVENT_RX_FAILED);
+		return;
+	}
+	else if (0u != (isr & I2C_ISR_STOPF))
+	{
+		// Auto end has put the stop on the bus so the transfer is all done, the
+		// dma complete flag is no good for transmit as it is set as the last byte
+		// goes in to the data register.
+		I2C2->ICR = I2C_ICR_STOPCF;
+
+		if (I2CDRV_STATUS_BUSY_TX == p_device->status)
+		{
+			I2CDRV_RaiseEvent(p_device, I2CDRV_EVENT_TX_COMPLETE);
+		}
+		else
+		{
+			I2CDRV_RaiseEvent(p_device, (0u == p_device->p_dmaRXChannelInstance->CNDTR) ?
+												I2CDRV_EVENT_RX_COMPLETE :
+												I2CDRV_EVENT_RX_FAILED);
+		}
+
+		return;
+	}
+#endif
+
 	if (0u != (I2C2->ISR & I2C_ISR_TXIS))
 	{
 		// Transmit complete of address
@@ -79,9 +157,18 @@ void I2C2_IRQHandler(void)
 		}
 		else if(p_device->status == I2CDRV_STATUS_BUSY_RX)
 		{
-			I2C2->CR1 |= I2C_CR1_TCIE;
+			I2C2->TXDR = p_device->data[p_device->txIdx];
+			p_device->txIdx++;
 
-			I2C2->TXDR = p_device->data[0u];
+			if (p_device->txIdx < p_device->txLen)
+			{
+				// More memory address bytes to go
+				I2C2->CR1 |= I2C_CR1_TXIE;
+			}
+			else
+			{
+				I2C2->CR1 |= I2C_CR1_TCIE;
+			}
 		}
 	}
 	else if (0u != (I2C2->ISR & I2C_ISR_TC))
@@ -104,6 +191,35 @@ void I2C2_IRQHandler(void)
 }
 
 
+#ifndef I2CDRV_POLLED_COMPLETION
+// ****************************************************************************
+/*!
+ * DMA1_Channel4_5_IRQHandler catches transfer errors on the i2c2 dma channels,
+ * completion is taken from the i2c stop flag.
+ */
+// ****************************************************************************
+void DMA1_Channel4_5_IRQHandler(void)
+{
+	I2CDRV_Device_t * p_device = &m_devices[1u];
+	const uint32_t isr = DMA1->ISR;
+
+	if (0u != (isr & (DMA_FLAG_TE1 << p_device->txDmaChannelIndex)))
+	{
+		p_device->p_dmaTXInstance->IFCR = (DMA_FLAG_GL1 << p_device->txDmaChannelIndex);
+
+		I2CDRV_RaiseEvent(p_device, I2CDRV_EVENT_TX_FAILED);
+	}
+
+	if (0u != (isr & (DMA_FLAG_TE1 << p_device->rxDmaChannelIndex)))
+	{
+		p_device->p_dmaRXInstance->IFCR = (DMA_FLAG_GL1 << p_device->rxDmaChannelIndex);
+
+		I2CDRV_RaiseEvent(p_device, I2CDRV_EVENT_RX_FAILED);
+	}
+}
+#endif
+
+
 // ----------------------------------------------------------------------------
 // ----------------------------------------------------------------------------
 // FUNCTIONS WITH GLOBAL SCOPE
@@ -137,10 +253,8 @@ void I2CDRV_Init(const uint32_t sysTime)
 	m_devices[1u].p_dmaTXChannelInstance->CPAR = (uint32_t)&I2C2->TXDR;
 	m_devices[1u].p_dmaTXChannelInstance->CMAR = (uint32_t)m_devices[1u].data;
 
+	// Memory address of the receive channel is set per transaction, after the written bytes
 	m_devices[1u].p_dmaRXChannelInstance->CPAR = (uint32_t)&I2C2->RXDR;
-	// Point to the 3rd byte as the first will contain the address to read
-	// The second will contain the device address with the read flag set (bit 0)
-	m_devices[1u].p_dmaRXChannelInstance->CMAR = (uint32_t)&m_devices[1u].data[2u];
 
 	// Enable the DMA transfer mode
 	I2C2->CR1 |= I2C_CR1_TXDMAEN | I2C_CR1_RXDMAEN;
@@ -151,6 +265,19 @@ void I2CDRV_Init(const uint32_t sysTime)
 	// Disable own address
 	I2C2->OAR1 = 0u;
 
+#ifndef I2CDRV_POLLED_COMPLETION
+	m_devices[1u].p_dmaTXChannelInstance->CCR |= DMA_CCR_TEIE;
+	m_devices[1u].p_dmaRXChannelInstance->CCR |= DMA_CCR_TEIE;
+
+	HAL_NVIC_SetPriority(DMA1_Channel4_5_IRQn, I2CDRV_DMA_IRQ_PRIORITY, 0u);
+	HAL_NVIC_EnableIRQ(DMA1_Channel4_5_IRQn);
+#endif
+
+	m_eventPending &= ~(1u << 1u);
+
+	// Anything queued before stop is lost
+	m_queues[1u].head = 0u;
+	m_queues[1u].tail = 0u;
 
 	m_devices[1u].status = I2CDRV_STATUS_READY;
 }
@@ -165,7 +292,7 @@ void I2CDRV_Init(const uint32_t sysTime)
 // ****************************************************************************
 void I2CDRV_Shutdown(void)
 {
-	I2C2->CR1 &= ~I2C_CR1_PE;
+	I2C2->CR1 &= ~(I2C_CR1_PE | I2CDRV_CR1_IRQ_ENABLES);
 }
 
 
@@ -196,7 +323,18 @@ bool I2CDRV_IsReady(const uint8_t devIdx)
 {
 	if (devIdx < I2CDRV_MAX_DEVICES)
 	{
-		return m_devices[devIdx].status == I2CDRV_STATUS_READY;
+		if (0u != (m_eventPending & (1u << devIdx)))
+		{
+			// Run the callback now rather than waiting for the osloop to get round to it
+			OSLOOP_AtomicAccess(true);
+
+			I2CDRV_DispatchEvent(&m_devices[devIdx], HAL_GetTick());
+
+			OSLOOP_AtomicAccess(false);
+		}
+
+		return (m_devices[devIdx].status == I2CDRV_STATUS_READY) &&
+				(m_queues[devIdx].head == m_queues[devIdx].tail);
 	}
 
 	return false;
@@ -205,13 +343,15 @@ bool I2CDRV_IsReady(const uint8_t devIdx)
 
 // ****************************************************************************
 /*!
- * I2CDRV_Transact starts a transaction with an i2c device hooked on the bus.
+ * I2CDRV_Transact loads a transaction with an i2c device hooked on the bus.
  * The transaction can be transmit or receive but for a receive transaction the
- * module is limited to only one memory address byte. In both cases the device
- * address is limited to the standard 7bit also. The caller is expected to either
- * provide a call back or poll the is isready to see if the transaction is complete,
- * the latter being slightly dangerous if not careful as the device could be used
- * and the data becoming inconsistent.
+ * module is limited to only one memory address byte, use I2CDRV_TransactWriteRead
+ * for more. In both cases the device address is limited to the standard 7bit also.
+ * The transaction is queued behind any others for the device and started as soon
+ * as the device is free. The caller is expected to either provide a call back
+ * or poll the is isready to see if the transaction is complete, the latter being
+ * slightly dangerous if not careful as the device could be used and the data
+ * becoming inconsistent.
  *
  * @param	devIdx			index of the device that is required
  * @param	addr			address of the i2c device, pre bit shifted..
@@ -237,7 +377,8 @@ bool I2CDRV_IsReady(const uint8_t devIdx)
  * @param	sysTime			current value of the ms tick timer
  *
  * @retval	bool			true if the transaction can be loaded
- * 							false if the transaction can't be performed
+ * 							false if the transaction can't be performed or the
+ * 							queue is full
  *
  */
 // ****************************************************************************
@@ -246,102 +387,45 @@ bool I2CDRV_Transact(const uint8_t deviceIdx, const uint8_t addr,
 					I2CDRV_TransactionType_t transactType, const I2CDRV_EventCb_t callback,
 					const uint16_t timeout, const uint32_t sysTime)
 {
-
-	if (deviceIdx >= I2CDRV_MAX_DEVICES)
-	{
-		return false;
-	}
-
-	I2CDRV_Device_t * const p_device = &m_devices[deviceIdx];
-
-	if (p_device->status != I2CDRV_STATUS_READY)
-	{
-		return false;
-	}
-
-	if ( (len > sizeof(p_device->data)) || (len == 0u) )
-	{
-		return false;
-	}
-
-
-	p_device->datalen = len;
-	p_device->event = I2CDRV_EVENT_NONE;
-
-
-	m_deviceCallbacks[deviceIdx] = callback;
-
 	if (transactType == I2CDRV_TRANSACTION_TX)
 	{
-		// Copy data to transmit
-		memcpy(p_device->data, data, len);
-
-		// Transmit action is pretty straightforward.... Just spam out the data.
-		p_device->p_i2cInstance->CR2 = I2C_AUTOEND_MODE | (len << I2C_CR2_NBYTES_Pos);
-
-		// Disable DMA channel for transmitter
-		p_device->p_dmaTXChannelInstance->CCR &= ~DMA_CCR_EN;
-
-		// Clear all flags
-		p_device->p_dmaTXInstance->IFCR = (DMA_FLAG_GL1 << p_device->txDmaChannelIndex);
-
-		// Bung in the amount of data to send
-		p_device->p_dmaTXChannelInstance->CNDTR = len;
-
-		p_device->status = I2CDRV_STATUS_BUSY_TX;
-
+		return I2CDRV_Enqueue(deviceIdx, addr, data, len, 0u, transactType, callback, timeout, sysTime);
 	}
 	else if (transactType == I2CDRV_TRANSACTION_RX)
 	{
-		// Receive is more complex, the address needs to be sent in the 1st and maybe 2nd byte
-		// the hardware then needs to switch to receive mode and grab the incomming data.
-
-		// This implementation luckily only requires one byte so it'll just send out the address
-		// in the first iteration of the interrupt routine.
-
-		// Only need the first byte to read
-		p_device->data[0u] = data[0u];
-
-		// Populate the address to send and the read flag
-		p_device->data[1u] = (addr | 0x01u);
-
-		// Clear rest of the buffer
-		memset(&p_device->data[2u], 0u, len);
-
-		// Make sure the stop bit doesn't get set, load in 1 byte for address
-		p_device->p_i2cInstance->CR2 = (1u << I2C_CR2_NBYTES_Pos);
-
-		// Disable DMA channel for transmitter
-		p_device->p_dmaRXChannelInstance->CCR &= ~DMA_CCR_EN;
-
-		// Clear all flags
-		p_device->p_dmaRXInstance->IFCR = (DMA_FLAG_GL1 << p_device->rxDmaChannelIndex);
-
-		// Bung in the amount of data to expect
-		p_device->p_dmaRXChannelInstance->CNDTR = len;
-
-		// Notify what the device is busy doing
-		p_device->status = I2CDRV_STATUS_BUSY_RX;
-
+		return I2CDRV_Enqueue(deviceIdx, addr, data, 1u, len, transactType, callback, timeout, sysTime);
 	}
-	else
-	{
-		return false;
-	}
-
-	// Note transaction start time
-	MS_TIMEREF_INIT(p_device->transactTime, sysTime);
 
-	// Load in the max time for the transaction
-	p_device->timeout = timeout;
-
-	// Enable the transmit interrupt and turn on the peripheral
-	p_device->p_i2cInstance->CR1 |= I2C_CR1_PE | I2C_CR1_TXIE;
+	return false;
+}
 
-	// Initiate the transaction
-	p_device->p_i2cInstance->CR2 |= (addr | I2C_GENERATE_START_WRITE);
 
-	return true;
+// ****************************************************************************
+/*!
+ * I2CDRV_TransactWriteRead loads a write then repeated start read transaction,
+ * for devices with more than one memory address byte or that need a command
+ * sent before the read. On completion the data buffer holds the written bytes,
+ * then the device address or'd with 0x01, then the bytes read.
+ *
+ * @param	devIdx			index of the device that is required
+ * @param	addr			address of the i2c device, pre bit shifted
+ * @param	writeData		bytes to write before the read
+ * @param	writeLen		number of bytes to write
+ * @param	readLen			number of bytes to read
+ * @param	callback		pointer to a callback function, NULL is ignored
+ * @param	timeout			max time for the transaction in ms
+ * @param	sysTime			current value of the ms tick timer
+ * @retval	bool			true if the transaction can be loaded
+ * 							false if the transaction can't be performed or the
+ * 							queue is full
+ */
+// ****************************************************************************
+bool I2CDRV_TransactWriteRead(const uint8_t deviceIdx, const uint8_t addr,
+					const uint8_t * const writeData, const uint8_t writeLen, const uint8_t readLen,
+					const I2CDRV_EventCb_t callback, const uint16_t timeout, const uint32_t sysTime)
+{
+	return I2CDRV_Enqueue(deviceIdx, addr, writeData, writeLen, readLen,
+							I2CDRV_TRANSACTION_RX, callback, timeout, sysTime);
 }
 
 
@@ -352,9 +436,10 @@ bool I2CDRV_Transact(const uint8_t deviceIdx, const uint8_t addr,
 // ----------------------------------------------------------------------------
 // ****************************************************************************
 /*!
- * I2CDRV_ProcessDevice checks the i2c hardware and the dma hardware to see if
- * the transaction is complete or has any errors. Registered callbacks are
- * processed here, errors are not at all analysed but will be cleared either after
+ * I2CDRV_ProcessDevice checks the transaction for a timeout and runs the callback
+ * of any completed transaction. Unless built for polled completion the i2c and
+ * dma interrupts flag completion and errors, otherwise the hardware flags are
+ * checked here. Errors are not at all analysed but will be cleared either after
  * the callback has been performed (i2c device is disabled) or on next transaction
  * call (dma controller).
  *
@@ -365,18 +450,15 @@ bool I2CDRV_Transact(const uint8_t deviceIdx, const uint8_t addr,
 // ****************************************************************************
 static void I2CDRV_ProcessDevice(I2CDRV_Device_t * const p_device, const uint32_t sysTime)
 {
-	DMA_Channel_TypeDef * p_dmaChannel;
+#ifdef I2CDRV_POLLED_COMPLETION
 	DMA_TypeDef * p_dma;
 	uint8_t dmaChannelPos;
-
+#endif
 
 	// If blocked or ready then alles gut
 	if ( (I2CDRV_STATUS_BUSY_TX == p_device->status) || (I2CDRV_STATUS_BUSY_RX == p_device->status) )
 	{
-		p_dmaChannel = (I2CDRV_STATUS_BUSY_TX == p_device->status) ?
-												p_device->p_dmaTXChannelInstance :
-												p_device->p_dmaRXChannelInstance;
-
+#ifdef I2CDRV_POLLED_COMPLETION
 		p_dma = (I2CDRV_STATUS_BUSY_TX == p_device->status) ?
 												p_device->p_dmaTXInstance :
 												p_device->p_dmaRXInstance;
@@ -388,32 +470,103 @@ static void I2CDRV_ProcessDevice(I2CDRV_Device_t * const p_device, const uint32_
 		// Check for complete flag
 		if ( 0u != (p_dma->ISR & (DMA_FLAG_TC1 << dmaChannelPos)) )
 		{
-			p_device->event = (I2CDRV_STATUS_BUSY_TX == p_device->status) ?
+			I2CDRV_RaiseEvent(p_device, (I2CDRV_STATUS_BUSY_TX == p_device->status) ?
 												I2CDRV_EVENT_TX_COMPLETE :
-												I2CDRV_EVENT_RX_COMPLETE;
+												I2CDRV_EVENT_RX_COMPLETE);
+		}
+		else if (0u != (p_device->p_i2cInstance->ISR & (I2C_ISR_NACKF | I2C_ISR_BERR | I2C_ISR_ARLO)))
+		{
+			I2CDRV_RaiseEvent(p_device, (I2CDRV_STATUS_BUSY_TX == p_device->status) ?
+												I2CDRV_EVENT_TX_FAILED :
+												I2CDRV_EVENT_RX_FAILED);
 		}
 		else
+#endif
+		if ( (0u == (m_eventPending & (1u << p_device->index)))
+				&& MS_TIMEREF_TIMEOUT(p_device->transactTime, sysTime, p_device->timeout) )
 		{
-			// Check for errors in data transfer or just a timeout because something else went wrong?
-			if (MS_TIMEREF_TIMEOUT(p_device->transactTime, sysTime, p_device->timeout)
-					|| (0u != (I2C2->ISR & (I2C_ISR_NACKF | I2C_ISR_BERR | I2C_ISR_ARLO)))
-					/*|| (0u != (p_dma->ISR & (DMA_FLAG_TE1 << dmaChannelPos)))*/
-			)
-			{
-				// Disable DMA channel for transmitter
-				p_dmaChannel->CCR &= ~DMA_CCR_EN;
+			// Something else went wrong, stop the interrupts first so they can't
+			// race the timeout then check nothing finished in the mean time.
+			p_device->p_i2cInstance->CR1 &= ~I2CDRV_CR1_IRQ_ENABLES;
 
-				// Notify event
-				p_device->event = (I2CDRV_STATUS_BUSY_TX == p_device->status) ?
+			if (0u == (m_eventPending & (1u << p_device->index)))
+			{
+				I2CDRV_RaiseEvent(p_device, (I2CDRV_STATUS_BUSY_TX == p_device->status) ?
 												I2CDRV_EVENT_TX_FAILED :
-												I2CDRV_EVENT_RX_FAILED;
+												I2CDRV_EVENT_RX_FAILED);
 			}
 		}
 	}
 
+	I2CDRV_DispatchEvent(p_device, sysTime);
+
+	return;
+}
+
+
+// ****************************************************************************
+/*!
+ * I2CDRV_RaiseEvent ends the transaction on the hardware and flags the event as
+ * pending so the callback gets run outside of the interrupt. The i2c and dma
+ * interrupts and the osloop timeout can all get here for the same transaction
+ * and the osloop can be interrupted part way through, so the check and claim of
+ * the event is done with interrupts off.
+ *
+ * @param	p_device	pointer to the i2cdrv struct
+ * @param	event		completion or failure event
+ * @retval	none
+ */
+// ****************************************************************************
+static void I2CDRV_RaiseEvent(I2CDRV_Device_t * const p_device, const I2CDRV_Device_Event_t event)
+{
+	const uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+
+	// Only the first event of a transaction counts
+	if (0u != (m_eventPending & (1u << p_device->index)))
+	{
+		__set_PRIMASK(primask);
+
+		return;
+	}
+
+	p_device->p_i2cInstance->CR1 &= ~I2CDRV_CR1_IRQ_ENABLES;
+
+	// Disable DMA channels
+	p_device->p_dmaTXChannelInstance->CCR &= ~DMA_CCR_EN;
+	p_device->p_dmaRXChannelInstance->CCR &= ~DMA_CCR_EN;
+
+	p_device->event = event;
+
+	m_eventPending |= (1u << p_device->index);
+
+	__set_PRIMASK(primask);
+}
+
+
+// ****************************************************************************
+/*!
+ * I2CDRV_DispatchEvent runs the callback for a pending event, releases the device
+ * and starts the next queued transaction. Must be called either from the osloop
+ * or with the osloop held off.
+ *
+ * @param	p_device	pointer to the i2cdrv struct
+ * @param	sysTime		current value of the ms tick timer
+ * @retval	none
+ */
+// ****************************************************************************
+static void I2CDRV_DispatchEvent(I2CDRV_Device_t * const p_device, const uint32_t sysTime)
+{
+	uint32_t primask;
+
 	// Raise on event
-	if (p_device->event != I2CDRV_EVENT_NONE)
+	if (0u != (m_eventPending & (1u << p_device->index)))
 	{
+		TIMING_STATS_RecordService(TIMING_STATS_I2CDRV_TRANSACT,
+									m_transactStartUs[p_device->index],
+									TIMING_STATS_GetTimeUs());
+
 		if (m_deviceCallbacks[p_device->index] != NULL)
 		{
 			m_deviceCallbacks[p_device->index](p_device);
@@ -424,8 +577,218 @@ static void I2CDRV_ProcessDevice(I2CDRV_Device_t * const p_device, const uint32_
 
 		// Turn off the device, clears all isr flags but keeps the existing configuration
 		p_device->p_i2cInstance->CR1 &= ~I2C_CR1_PE;
+
+		// Other devices can raise events in the middle of the read modify write
+		primask = __get_PRIMASK();
+		__disable_irq();
+
+		m_eventPending &= ~(1u << p_device->index);
+
+		__set_PRIMASK(primask);
 	}
 
-	return;
+	// Chain straight on to the next queued transaction
+	if (I2CDRV_STATUS_READY == p_device->status)
+	{
+		I2CDRV_StartNext(p_device, sysTime);
+	}
+}
+
+
+// ****************************************************************************
+/*!
+ * I2CDRV_Enqueue copies a transaction in to the device queue and starts it
+ * if the device is idle. The queue is only emptied from the osloop so the
+ * osloop is held off while checking if the device is idle.
+ *
+ * @param	devIdx			index of the device that is required
+ * @param	addr			address of the i2c device, pre bit shifted
+ * @param	data			bytes to write
+ * @param	txLen			number of bytes to write
+ * @param	rxLen			number of bytes to read, 0 for a transmit transaction
+ * @param	transactType	I2CDRV_TRANSACTION_TX or I2CDRV_TRANSACTION_RX
+ * @param	callback		pointer to a callback function, NULL is ignored
+ * @param	timeout			max time for the transaction in ms
+ * @param	sysTime			current value of the ms tick timer
+ * @retval	bool			true if the transaction has been queued
+ * 							false if it is invalid or the queue is full
+ */
+// ****************************************************************************
+static bool I2CDRV_Enqueue(const uint8_t deviceIdx, const uint8_t addr,
+					const uint8_t * const data, const uint8_t txLen, const uint8_t rxLen,
+					I2CDRV_TransactionType_t transactType, const I2CDRV_EventCb_t callback,
+					const uint16_t timeout, const uint32_t sysTime)
+{
+	I2CDRV_Queue_t * p_queue;
+	I2CDRV_Transaction_t * p_transact;
+	uint8_t nextHead;
+
+	if (deviceIdx >= I2CDRV_MAX_DEVICES)
+	{
+		return false;
+	}
+
+	if (I2CDRV_STATUS_BLOCKED == m_devices[deviceIdx].status)
+	{
+		return false;
+	}
+
+	// Receive needs room for the written bytes, the read address and the read bytes
+	if ( (txLen == 0u) || (((uint16_t)txLen + ((rxLen > 0u) ? (1u + rxLen) : 0u)) > I2CDRV_MAX_BUFFER_SIZE) )
+	{
+		return false;
+	}
+
+	if ( (I2CDRV_TRANSACTION_RX == transactType) && (rxLen == 0u) )
+	{
+		return false;
+	}
+
+	p_queue = &m_queues[deviceIdx];
+	nextHead = (p_queue->head + 1u) % I2CDRV_QUEUE_LENGTH;
+
+	if (nextHead == p_queue->tail)
+	{
+		return false;
+	}
+
+	p_transact = &p_queue->transactions[p_queue->head];
+
+	p_transact->addr = addr;
+	p_transact->transactType = transactType;
+	p_transact->txLen = txLen;
+	p_transact->rxLen = rxLen;
+	p_transact->callback = callback;
+	p_transact->timeout = timeout;
+
+	memcpy(p_transact->data, data, txLen);
+
+	p_queue->head = nextHead;
+
+	OSLOOP_AtomicAccess(true);
+
+	if (I2CDRV_STATUS_READY == m_devices[deviceIdx].status)
+	{
+		I2CDRV_StartNext(&m_devices[deviceIdx], sysTime);
+	}
+
+	OSLOOP_AtomicAccess(false);
+
+	return true;
+}
+
+
+// ****************************************************************************
+/*!
+ * I2CDRV_StartNext takes the oldest transaction from the device queue and starts
+ * it on the hardware. Must only be called when the device is ready.
+ *
+ * @param	p_device	pointer to the i2cdrv struct
+ * @param	sysTime		current value of the ms tick timer
+ * @retval	none
+ */
+// ****************************************************************************
+static void I2CDRV_StartNext(I2CDRV_Device_t * const p_device, const uint32_t sysTime)
+{
+	I2CDRV_Queue_t * const p_queue = &m_queues[p_device->index];
+	const I2CDRV_Transaction_t * p_transact;
+
+	if (p_queue->head == p_queue->tail)
+	{
+		return;
+	}
+
+	p_transact = &p_queue->transactions[p_queue->tail];
+
+	// Peripheral needs PE low for 3 APB cycles after the last transaction to reset
+	while (0u != (p_device->p_i2cInstance->CR1 & I2C_CR1_PE))
+	{
+		p_device->p_i2cInstance->CR1 &= ~I2C_CR1_PE;
+	}
+
+	(void)p_device->p_i2cInstance->CR1;
+	(void)p_device->p_i2cInstance->CR1;
+	(void)p_device->p_i2cInstance->CR1;
+
+	p_device->event = I2CDRV_EVENT_NONE;
+
+	m_deviceCallbacks[p_device->index] = p_transact->callback;
+
+	if (p_transact->transactType == I2CDRV_TRANSACTION_TX)
+	{
+		p_device->datalen = p_transact->txLen;
+
+		// Copy data to transmit
+		memcpy(p_device->data, p_transact->data, p_transact->txLen);
+
+		// Transmit action is pretty straightforward.... Just spam out the data.
+		p_device->p_i2cInstance->CR2 = I2C_AUTOEND_MODE | (p_transact->txLen << I2C_CR2_NBYTES_Pos);
+
+		// Disable DMA channel for transmitter
+		p_device->p_dmaTXChannelInstance->CCR &= ~DMA_CCR_EN;
+
+		// Clear all flags
+		p_device->p_dmaTXInstance->IFCR = (DMA_FLAG_GL1 << p_device->txDmaChannelIndex);
+
+		// Bung in the amount of data to send
+		p_device->p_dmaTXChannelInstance->CNDTR = p_transact->txLen;
+
+		p_device->status = I2CDRV_STATUS_BUSY_TX;
+	}
+	else
+	{
+		// Receive is more complex, the memory address is sent byte by byte from the
+		// interrupt routine then the hardware switches to receive mode with a repeated
+		// start and the dma grabs the incomming data.
+		p_device->datalen = p_transact->rxLen;
+		p_device->txLen = p_transact->txLen;
+		p_device->txIdx = 0u;
+
+		memcpy(p_device->data, p_transact->data, p_transact->txLen);
+
+		// Populate the address to send and the read flag
+		p_device->data[p_transact->txLen] = (p_transact->addr | 0x01u);
+
+		// Clear rest of the buffer
+		memset(&p_device->data[p_transact->txLen + 1u], 0u, p_transact->rxLen);
+
+		// Make sure the stop bit doesn't get set, load in the memory address bytes
+		p_device->p_i2cInstance->CR2 = (p_transact->txLen << I2C_CR2_NBYTES_Pos);
+
+		// Disable DMA channel for receiver
+		p_device->p_dmaRXChannelInstance->CCR &= ~DMA_CCR_EN;
+
+		// Clear all flags
+		p_device->p_dmaRXInstance->IFCR = (DMA_FLAG_GL1 << p_device->rxDmaChannelIndex);
+
+		// Read data goes after the device address
+		p_device->p_dmaRXChannelInstance->CMAR = (uint32_t)&p_device->data[p_transact->txLen + 1u];
+
+		// Bung in the amount of data to expect
+		p_device->p_dmaRXChannelInstance->CNDTR = p_transact->rxLen;
+
+		// Notify what the device is busy doing
+		p_device->status = I2CDRV_STATUS_BUSY_RX;
+	}
+
+	// Note transaction start time
+	MS_TIMEREF_INIT(p_device->transactTime, sysTime);
+
+	// Load in the max time for the transaction
+	p_device->timeout = p_transact->timeout;
+
+	m_transactStartUs[p_device->index] = TIMING_STATS_GetTimeUs();
+
+	// Enable the transmit interrupt and turn on the peripheral
+#ifdef I2CDRV_POLLED_COMPLETION
+	p_device->p_i2cInstance->CR1 |= I2C_CR1_PE | I2C_CR1_TXIE;
+#else
+	p_device->p_i2cInstance->CR1 |= I2C_CR1_PE | I2C_CR1_TXIE | I2C_CR1_STOPIE | I2C_CR1_NACKIE | I2C_CR1_ERRIE;
+#endif
+
+	// Initiate the transaction
+	p_device->p_i2cInstance->CR2 |= (p_transact->addr | I2C_GENERATE_START_WRITE);
+
+	p_queue->tail = (p_queue->tail + 1u) % I2CDRV_QUEUE_LENGTH;
 }
 
@@ -9,6 +9,11 @@
  * 				by cubemx or using the hal drivers. As long as there is an entry
  * 				in the array the module will monitor it. Configuration options
  * 				allow for inverted operation and digital inputs are debounced.
+ * 				The button inputs are not polled, both edges interrupt and get a
+ * 				uS time stamp from the EXTI callback. The service only looks at
+ * 				a captured pin once it has seen an edge, when the pin has been
+ * 				quiet for the settle time it is read and a change is logged with
+ * 				the time of the first edge in the burst.
  *
  */
 // ----------------------------------------------------------------------------
@@ -21,6 +26,8 @@
 #include "time_count.h"
 #include "adc.h"
 #include "util.h"
+#include "seqlock.h"
+#include "timing_stats.h"
 
 #include "iodrv.h"
 
@@ -32,11 +39,26 @@
 #define PINMODE_ALTERNATE			2u
 #define PINMODE_ANALOG				3u
 
+#define IODRV_PULSE_US_MAX_MS		4294000u	/* uS time stamps wrap after a little longer */
+
+typedef struct
+{
+	SEQLOCK_t	seq;
+	uint32_t	firstEdgeUs;
+	uint32_t	lastEdgeUs;
+	bool		pending;
+	uint32_t	lastChangeUs;
+	uint8_t		pin;
+} IODRV_EdgeCapture_t;
 
 // ----------------------------------------------------------------------------
 // Function prototypes for functions that only have scope in this module:
 
 static void IODRV_UpdatePins(const uint32_t sysTime);
+static void IODRV_ServiceEdgeCaptures(const uint32_t sysTime);
+static void IODRV_LogPinChange(IODRV_EdgeCapture_t * const p_capture, const uint32_t edgeUs,
+								const uint32_t nowUs, const uint32_t sysTime);
+static void IODRV_ExpirePulseWidths(IODRV_Pin_t * const p_pin, const uint32_t sysTime);
 
 
 // ----------------------------------------------------------------------------
@@ -74,6 +96,7 @@ static IODRV_Pin_t m_pins[IODRV_MAX_IO_PINS] =
 				.gpioPort = IODRV_PIN_SW1_GPIO,
 				.invert_bm = IODRV_PIN_SW1_INVERT_bm,
 				.canConfigure = false,
+				.edgeCapture = true,
 				.index = IODRV_PIN_SW1
 		},
 		{
@@ -83,6 +106,7 @@ static IODRV_Pin_t m_pins[IODRV_MAX_IO_PINS] =
 				.gpioPort = IODRV_PIN_SW2_GPIO,
 				.invert_bm = IODRV_PIN_SW2_INVERT_bm,
 				.canConfigure = false,
+				.edgeCapture = true,
 				.index = IODRV_PIN_SW2
 		},
 		{
@@ -92,6 +116,7 @@ static IODRV_Pin_t m_pins[IODRV_MAX_IO_PINS] =
 				.gpioPort = IODRV_PIN_SW3_GPIO,
 				.invert_bm = IODRV_PIN_SW3_INVERT_bm,
 				.canConfigure = false,
+				.edgeCapture = true,
 				.index = IODRV_PIN_SW3
 		},
 		{
@@ -260,6 +285,13 @@ static IODRV_Pin_t m_pins[IODRV_MAX_IO_PINS] =
 
 static uint32_t m_lastPinUpdateTime;
 
+static IODRV_EdgeCapture_t m_edgeCaptures[IODRV_EDGE_CAPTURE_COUNT] =
+{
+		{ .pin = IODRV_PIN_SW1 },
+		{ .pin = IODRV_PIN_SW2 },
+		{ .pin = IODRV_PIN_SW3 }
+};
+
 
 // ----------------------------------------------------------------------------
 // ----------------------------------------------------------------------------
@@ -276,12 +308,32 @@ static uint32_t m_lastPinUpdateTime;
 void IODRV_Init(const uint32_t sysTime)
 {
 	uint8_t i;
+	IODRV_EdgeCapture_t * p_capture;
 
 	for (i = 0u; i < IODRV_MAX_IO_PINS; i++)
 	{
 		m_pins[i].value = 0u;
 	}
 
+	for (i = 0u; i < IODRV_EDGE_CAPTURE_COUNT; i++)
+	{
+		p_capture = &m_edgeCaptures[i];
+
+		// Cube sets the buttons up for the rising edge only
+		EXTI->FTSR |= m_pins[p_capture->pin].gpioPin_bm;
+
+		// Value has been cleared, make the service read the pin once it settles.
+		// Also covers the edge that woke from stop, it got stamped before the
+		// tick caught up.
+		if (true == SEQLOCK_TryWriteBegin(&p_capture->seq))
+		{
+			p_capture->firstEdgeUs = sysTime * 1000u;
+			p_capture->lastEdgeUs = p_capture->firstEdgeUs;
+			p_capture->pending = true;
+			SEQLOCK_WriteEnd(&p_capture->seq);
+		}
+	}
+
 	MS_TIMEREF_INIT(m_lastPinUpdateTime, sysTime);
 }
 
@@ -302,6 +354,8 @@ void IODRV_Shutdown(void)
 // ****************************************************************************
 void IODRV_Service(const uint32_t sysTime)
 {
+	IODRV_ServiceEdgeCaptures(sysTime);
+
 	if (MS_TIMEREF_TIMEOUT(m_lastPinUpdateTime, sysTime, IODRV_PIN_UPDATE_PERIOD_MS))
 	{
 		IODRV_UpdatePins(sysTime);
@@ -504,6 +558,54 @@ void IORDV_ClearPinEdges(const uint8_t pinIdx)
 {
 	m_pins[pinIdx].lastNegPulseWidthTimeMs = 0u;
 	m_pins[pinIdx].lastPosPulseWidthTimeMs = 0u;
+	m_pins[pinIdx].lastNegPulseWidthTimeUs = 0u;
+	m_pins[pinIdx].lastPosPulseWidthTimeUs = 0u;
+}
+
+
+// ****************************************************************************
+/*!
+ * IODRV_CaptureEdge time stamps an edge on a captured pin, called from the EXTI
+ * callback which is below the systick priority so the uS time is good. Only the
+ * time is taken here, the pin is read by the service once it has settled. An
+ * edge that lands while IODRV_Init is re-arming the pin is dropped, the init
+ * time stamps it anyway.
+ *
+ * @param	gpioPin_bm	pin bitmask passed to the EXTI callback
+ * @retval	none
+ */
+// ****************************************************************************
+void IODRV_CaptureEdge(const uint16_t gpioPin_bm)
+{
+	const uint32_t timeUs = TIMING_STATS_GetTimeUs();
+	IODRV_EdgeCapture_t * p_capture;
+	uint8_t i;
+
+	for (i = 0u; i < IODRV_EDGE_CAPTURE_COUNT; i++)
+	{
+		p_capture = &m_edgeCaptures[i];
+
+		if (m_pins[p_capture->pin].gpioPin_bm != gpioPin_bm)
+		{
+			continue;
+		}
+
+		if (true == SEQLOCK_TryWriteBegin(&p_capture->seq))
+		{
+			// Keep the start of a bounce burst, that is when the pin changed
+			if (false == p_capture->pending)
+			{
+				p_capture->firstEdgeUs = timeUs;
+			}
+
+			p_capture->lastEdgeUs = timeUs;
+			p_capture->pending = true;
+
+			SEQLOCK_WriteEnd(&p_capture->seq);
+		}
+
+		return;
+	}
 }
 
 // ----------------------------------------------------------------------------
@@ -543,6 +645,12 @@ static void IODRV_UpdatePins(const uint32_t sysTime)
 		{
 			value = 0u;
 		}
+		else if (true == m_pins[pin].edgeCapture)
+		{
+			// Changes come from IODRV_ServiceEdgeCaptures, value stays as it is
+			IODRV_ExpirePulseWidths(&m_pins[pin], sysTime);
+			continue;
+		}
 		else // Must be digital then
 		{
 			value = m_pins[pin].value;
@@ -590,15 +698,148 @@ static void IODRV_UpdatePins(const uint32_t sysTime)
 				}
 			}
 
-			// Clear pulse widths after one day, button routine might catch uint32_t timeref roll over and cause havok!
-			if (MS_TIMEREF_TIMEOUT(m_pins[pin].lastDigitalChangeTime, sysTime, MS_ONE_DAY))
-			{
-				m_pins[pin].lastNegPulseWidthTimeMs = 0u;
-				m_pins[pin].lastPosPulseWidthTimeMs = 0u;
-			}
+			IODRV_ExpirePulseWidths(&m_pins[pin], sysTime);
 		}
 
 		m_pins[pin].value = (value ^ m_pins[pin].invert_bm);
 	}
 }
 
+
+// ****************************************************************************
+/*!
+ * IODRV_ServiceEdgeCaptures checks the captured pins that have seen an edge,
+ * nothing is read from a pin that has been quiet. Once the last edge is older
+ * than the settle time the pin is read, if it is different to the stable value
+ * the change is logged from the first edge of the burst. A burst that ends at
+ * the level it started from was bounce or a glitch and is dropped. A pin the
+ * EXTI callback is part way through is picked up on the next pass, the callback
+ * can't run while this does.
+ *
+ * @param	sysTime		current value of the ms tick timer
+ * @retval	none
+ */
+// ****************************************************************************
+static void IODRV_ServiceEdgeCaptures(const uint32_t sysTime)
+{
+	IODRV_EdgeCapture_t * p_capture;
+	uint32_t nowUs = 0u;
+	uint32_t seq;
+	uint32_t firstEdgeUs;
+	uint32_t lastEdgeUs;
+	bool pending;
+	uint8_t i;
+
+	for (i = 0u; i < IODRV_EDGE_CAPTURE_COUNT; i++)
+	{
+		p_capture = &m_edgeCaptures[i];
+
+		if (false == p_capture->pending)
+		{
+			continue;
+		}
+
+		seq = SEQLOCK_ReadBegin(&p_capture->seq);
+		firstEdgeUs = p_capture->firstEdgeUs;
+		lastEdgeUs = p_capture->lastEdgeUs;
+		pending = p_capture->pending;
+
+		if ( (true == SEQLOCK_ReadRetry(&p_capture->seq, seq)) || (false == pending) )
+		{
+			continue;
+		}
+
+		if (0u == nowUs)
+		{
+			nowUs = TIMING_STATS_GetTimeUs();
+		}
+
+		if ( (nowUs - lastEdgeUs) < IODRV_PIN_SETTLE_US )
+		{
+			continue;
+		}
+
+		SEQLOCK_WriteBegin(&p_capture->seq);
+		p_capture->pending = false;
+		SEQLOCK_WriteEnd(&p_capture->seq);
+
+		IODRV_LogPinChange(p_capture, firstEdgeUs, nowUs, sysTime);
+	}
+}
+
+
+// ****************************************************************************
+/*!
+ * IODRV_LogPinChange reads a captured pin after it has settled and logs the
+ * change if there is one. The pulse width comes from the uS stamps unless it is
+ * long enough for them to have wrapped, then it is the ms difference.
+ *
+ * @param	p_capture	pointer to the capture data for the pin
+ * @param	edgeUs		time of the first edge in the burst
+ * @param	nowUs		current uS time
+ * @param	sysTime		current value of the ms tick timer
+ * @retval	none
+ */
+// ****************************************************************************
+static void IODRV_LogPinChange(IODRV_EdgeCapture_t * const p_capture, const uint32_t edgeUs,
+								const uint32_t nowUs, const uint32_t sysTime)
+{
+	IODRV_Pin_t * const p_pin = &m_pins[p_capture->pin];
+	const uint16_t value = (GPIO_PIN_SET == HAL_GPIO_ReadPin(p_pin->gpioPort, p_pin->gpioPin_bm)) ? 1u : 0u;
+	const uint32_t edgeTimeMs = sysTime - ((nowUs - edgeUs) / 1000u);
+	uint32_t widthMs = MS_TIMEREF_DIFF(p_pin->lastDigitalChangeTime, edgeTimeMs);
+	uint32_t widthUs;
+
+	if ( (value ^ p_pin->invert_bm) == p_pin->value )
+	{
+		return;
+	}
+
+	if (widthMs < IODRV_PULSE_US_MAX_MS)
+	{
+		widthUs = edgeUs - p_capture->lastChangeUs;
+		widthMs = (widthUs + 500u) / 1000u;
+	}
+	else
+	{
+		widthUs = UINT32_MAX;
+	}
+
+	if (0u != value)
+	{
+		p_pin->lastNegPulseWidthTimeMs = widthMs;
+		p_pin->lastNegPulseWidthTimeUs = widthUs;
+	}
+	else
+	{
+		p_pin->lastPosPulseWidthTimeMs = widthMs;
+		p_pin->lastPosPulseWidthTimeUs = widthUs;
+	}
+
+	p_capture->lastChangeUs = edgeUs;
+	p_pin->lastDigitalChangeTime = edgeTimeMs;
+	p_pin->value = (value ^ p_pin->invert_bm);
+}
+
+
+// ****************************************************************************
+/*!
+ * IODRV_ExpirePulseWidths clears the pulse widths after one day without a
+ * change, button routine might catch uint32_t timeref roll over and cause havok!
+ *
+ * @param	p_pin		pointer to the pin
+ * @param	sysTime		current value of the ms tick timer
+ * @retval	none
+ */
+// ****************************************************************************
+static void IODRV_ExpirePulseWidths(IODRV_Pin_t * const p_pin, const uint32_t sysTime)
+{
+	if (MS_TIMEREF_TIMEOUT(p_pin->lastDigitalChangeTime, sysTime, MS_ONE_DAY))
+	{
+		p_pin->lastNegPulseWidthTimeMs = 0u;
+		p_pin->lastPosPulseWidthTimeMs = 0u;
+		p_pin->lastNegPulseWidthTimeUs = 0u;
+		p_pin->lastPosPulseWidthTimeUs = 0u;
+	}
+}
+
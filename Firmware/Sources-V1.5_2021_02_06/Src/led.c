@@ -37,6 +37,7 @@ static void LED_InitFunction(const uint8_t ledIdx);
 // ----------------------------------------------------------------------------
 // Variables that only have scope in this module:
 
+// TIM15 is also the adc trigger timer, the leds only change its compare values
 static Led_T m_leds[LED_COUNT] =
 {
 	{ LED_CHARGE_STATUS, .paramR = 60u, .paramG = 60u, .paramB = 100u, .pwmDrv_r = &TIM3->CCR1, .pwmDrv_g = &TIM3->CCR2, .pwmDrv_b = &TIM3->CCR3},
@@ -72,6 +73,10 @@ extern TIM_HandleTypeDef htim17;
 // ****************************************************************************
 void LED_Init(const uint32_t sysTime)
 {
+	// Adc sequence rate comes from the TIM15 update, keep it where the filters expect
+	ADC_TRIGGER_TIMER->PSC = ADC_TRIGGER_PRESCALER;
+	ADC_TRIGGER_TIMER->ARR = ADC_TRIGGER_RELOAD;
+
 	// Start pwm timer channels, also starts the timers
 	HAL_TIM_PWM_Start(&htim3, TIM_CHANNEL_1);
 	HAL_TIM_PWM_Start(&htim3, TIM_CHANNEL_2);
@@ -118,6 +123,10 @@ void LED_Shutdown(void)
 	HAL_TIM_PWM_Stop(&htim15, TIM_CHANNEL_2);
 	HAL_TIM_PWM_Stop(&htim17, TIM_CHANNEL_1);
 
+	// Stopping the last TIM15 channel stops its counter, it keeps counting as the
+	// adc trigger. Stop mode halts it anyway.
+	__HAL_TIM_ENABLE(&htim15);
+
 	// Make all pins pull down
 	IODRV_SetPinType(IODRV_PIN_LED1_R, IOTYPE_DIGIN);
 	IODRV_SetPinType(IODRV_PIN_LED1_G, IOTYPE_DIGIN);
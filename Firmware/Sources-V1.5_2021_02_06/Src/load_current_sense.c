@@ -33,6 +33,19 @@
 #define ISENSE_CAL_POINT_MID		1u
 #define ISENSE_CAL_POINT_HIGH		2u
 
+#define ISENSE_CAL_PHASE_FILTER_READY	0u
+#define ISENSE_CAL_PHASE_RAIL			1u
+#define ISENSE_CAL_PHASE_ISENSE			2u
+#define ISENSE_CAL_PHASE_CHECK			3u
+
+#define ISENSE_CAL_FAIL_NONE			0u
+#define ISENSE_CAL_FAIL_POWER_CHANGED	1u	/* Boost converter switched by something else */
+#define ISENSE_CAL_FAIL_FET_DRIVE		2u	/* Fet drive gives no current, nothing to scale */
+#define ISENSE_CAL_FAIL_RANGE			3u	/* Coefficients do not fit NV */
+#define ISENSE_CAL_FAIL_CHECK			4u	/* Load current out of window after calibration */
+
+#define ISENSE_CAL_READ_LEN				18u
+
 typedef struct
 {
 	uint16_t iActual;
@@ -49,8 +62,14 @@ typedef struct
 static bool ISENSE_ReadNVCalibration(void);
 static uint16_t ISENSE_CalculatePMOSLoadCurrentMa(void);
 static int16_t ISENSE_CalculateResSenseCurrentMa(void);
-static void ISENSE_CalibrateCurrent(const uint8_t pointIdx, const uint16_t currentMa);
-static float ISENSE_ConvertFETDrvToX(const uint16_t fetDrvAdc, const int8_t temperature);
+static void ISENSE_RunCalibration(const uint32_t sysTime);
+static uint8_t ISENSE_CalibrateLoadPoint(void);
+static uint32_t ISENSE_GetCalPhaseTimeMs(void);
+static void ISENSE_RestoreCalPower(void);
+static void ISENSE_FinishCalibration(const ISENSE_CalStatus_t status, const uint8_t failCode);
+static uint32_t ISENSE_ConvertFETDrvToX(const uint16_t fetDrvAdc, const int8_t temperature);
+static bool ISENSE_CalculateFETDriveCoeffs(const ISENSE_CalPoint_t * const p_point, const uint16_t iLoadMa,
+											uint8_t * const p_kta, uint8_t * const p_ktb);
 static void ISENSE_CalculateLoadCurrentMa(void);
 
 
@@ -67,6 +86,20 @@ static int16_t m_loadCurrentMa;
 static int16_t m_loadResMa;
 static int16_t m_loadFetMa;
 
+static const uint8_t m_calModePoint[] = {ISENSE_CAL_POINT_MID, ISENSE_CAL_POINT_LOW, ISENSE_CAL_POINT_MID, ISENSE_CAL_POINT_HIGH};
+static const uint16_t m_calModeCurrentMa[] = {50u, 0u, 51u, 510u};
+
+static volatile ISENSE_CalStatus_t m_calStatus;
+static ISENSE_CalMode_t m_calMode;
+static uint8_t m_calPhase;
+static uint8_t m_calFailCode;
+static uint32_t m_calStartTime;
+static uint32_t m_calPhaseStartTime;
+static uint32_t m_calEndTime;
+static bool m_calBoostEnabled;
+static bool m_calLdoEnabled;
+static int16_t m_calCheckMa;
+
 
 // ----------------------------------------------------------------------------
 // Variables that have scope from outside this module:
@@ -100,6 +133,12 @@ void ISENSE_Init(void)
 
 	m_loadCurrentMa = 0;
 
+	m_calStatus = ISENSE_CAL_STATUS_IDLE;
+	m_calMode = ISENSE_CAL_MODE_LOAD;
+	m_calPhase = ISENSE_CAL_PHASE_FILTER_READY;
+	m_calFailCode = ISENSE_CAL_FAIL_NONE;
+	m_calCheckMa = 0;
+
 	// Load calibration values from NV
 	ISENSE_ReadNVCalibration();
 
@@ -109,7 +148,8 @@ void ISENSE_Init(void)
 
 // ****************************************************************************
 /*!
- * ISENSE_Task performs periodic updates for this module, calculates the load current.
+ * ISENSE_Task performs periodic updates for this module, calculates the load current
+ * and steps the calibration if one is running.
  *
  * @param	none
  * @retval	none
@@ -125,6 +165,11 @@ void ISENSE_Task(void)
 
 		ISENSE_CalculateLoadCurrentMa();
 	}
+
+	if (ISENSE_CAL_STATUS_BUSY == m_calStatus)
+	{
+		ISENSE_RunCalibration(sysTime);
+	}
 }
 
 
@@ -184,88 +229,137 @@ uint16_t ISENSE_GetFetMa(void)
 
 // ****************************************************************************
 /*!
- * ISENSE_CalibrateLoadCurrent performs a single point calibration at 50mA, being
- * a single point the resistor will not be as accurate but the fet drive is unaffected.
- * Will take a while as the current sense filter is slowed down to try and get
- * a fairly stable figure.
+ * ISENSE_StartCalibration starts a calibration, it is run by the task so the
+ * caller polls ISENSE_GetCalibrationStatus for the result. ISENSE_CAL_MODE_LOAD
+ * performs a single point calibration at 50mA and writes it to NV, being a single
+ * point the resistor will not be as accurate but the fet drive is unaffected. The
+ * other modes record the 0mA, 51mA or 510mA points for ISENSE_WriteNVCalibration:
+ * 	0mA:	Fit 1M to RPi 5V (ca. 0mA @ 4.8v)
+ * 	51mA:	Fit 94R to RPi 5V (ca. 51mA @ 4.8v)
+ * 	510mA:	Fit 9.4R to RPi 5V (ca. 510mA @ 4.8v)
+ * Will take a while as the current sense filter is slowed down to try and get a
+ * fairly stable figure. Starting again while busy restarts the calibration.
  *
- * @param	none
- * @retval	none
+ * @param	mode		calibration to perform
+ * @retval	bool		false = invalid mode, true = calibration started
  */
 // ****************************************************************************
-void ISENSE_CalibrateLoadCurrent(void)
+bool ISENSE_StartCalibration(const ISENSE_CalMode_t mode)
 {
-	ISENSE_CalibrateCurrent(ISENSE_CAL_POINT_MID, 50u);
+	if (mode > ISENSE_CAL_MODE_510MA)
+	{
+		return false;
+	}
 
-	float k12;
-	float ktNorm;
+	ISENSE_AbortCalibration();
 
-	m_resLoadCurrCalibOffset = m_calPoints[ISENSE_CAL_POINT_MID].iRes - 51u;
-	m_resLoadCurrCalibScale_K = 0x10000u;
+	m_calMode = mode;
+	m_calPhase = ISENSE_CAL_PHASE_FILTER_READY;
+	m_calFailCode = ISENSE_CAL_FAIL_NONE;
+	m_calCheckMa = 0;
+	m_calBoostEnabled = POWERSOURCE_IsBoostConverterEnabled();
+	m_calLdoEnabled = POWERSOURCE_IsLDOEnabled();
 
-	NV_WriteVariable_S8(RES_ILOAD_CALIB_ZERO_NV_ADDR, m_resLoadCurrCalibOffset / 10u);
+	MS_TIME_COUNTER_INIT(m_calStartTime);
+	MS_TIME_COUNTER_INIT(m_calPhaseStartTime);
 
-	NV_WipeVariable(ISENSE_RES_SPAN_L);
-	NV_WipeVariable(ISENSE_RES_SPAN_H);
+	m_calStatus = ISENSE_CAL_STATUS_BUSY;
 
-	ktNorm = 0.0052f * m_calPoints[ISENSE_CAL_POINT_MID].temperature + 0.9376f;
+	return true;
+}
 
-	k12 = 52.0f / (ISENSE_ConvertFETDrvToX(m_calPoints[ISENSE_CAL_POINT_MID].iFet, m_calPoints[ISENSE_CAL_POINT_MID].temperature) * ktNorm);
 
-	m_kta = 0.0052f * k12 * 1024u * 8u;
-	m_ktb = 0.9376f * k12 * 32u;
+// ****************************************************************************
+/*!
+ * ISENSE_AbortCalibration stops a running calibration, the power regulation and
+ * current sense filter are put back and the calibration values are left alone.
+ *
+ * @param	none
+ * @retval	none
+ */
+// ****************************************************************************
+void ISENSE_AbortCalibration(void)
+{
+	if (ISENSE_CAL_STATUS_BUSY != m_calStatus)
+	{
+		return;
+	}
 
-	NV_WriteVariable_U8(VDG_ILOAD_CALIB_KTA_NV_ADDR, m_kta);
-	NV_WriteVariable_U8(VDG_ILOAD_CALIB_KTB_NV_ADDR, m_ktb);
+	if ( (ISENSE_CAL_PHASE_RAIL == m_calPhase) || (ISENSE_CAL_PHASE_ISENSE == m_calPhase) )
+	{
+		ISENSE_RestoreCalPower();
+	}
+
+	ISENSE_FinishCalibration(ISENSE_CAL_STATUS_IDLE, ISENSE_CAL_FAIL_NONE);
 }
 
 
 // ****************************************************************************
 /*!
- * ISENSE_CalibrateZeroCurrent records the adc values for a load current of 0mA.
- *
- * Fit 1M to RPi 5V (ca. 0mA @ 4.8v) before calling this routine.
+ * ISENSE_GetCalibrationStatus returns the state of the last calibration started.
  *
  * @param	none
- * @retval	none
+ * @retval	ISENSE_CalStatus_t
  */
 // ****************************************************************************
-void ISENSE_CalibrateZeroCurrent(void)
+ISENSE_CalStatus_t ISENSE_GetCalibrationStatus(void)
 {
-	ISENSE_CalibrateCurrent(ISENSE_CAL_POINT_LOW, 0u);
+	return m_calStatus;
 }
 
 
 // ****************************************************************************
 /*!
- * ISENSE_Calibrate51mACurrent records the adc values for a load current of 51mA.
- *
- * Fit 94R to RPi 5V (ca. 51mA @ 4.8v) before calling this routine.
+ * ISENSE_IsCalibrating lets the task manager know it should not go to sleep, the
+ * adc has to keep running while the calibration waits for the filters.
  *
  * @param	none
- * @retval	none
+ * @retval	bool		true = calibration running
  */
 // ****************************************************************************
-void ISENSE_Calibrate51mACurrent(void)
+bool ISENSE_IsCalibrating(void)
 {
-	ISENSE_CalibrateCurrent(ISENSE_CAL_POINT_MID, 51u);
+	return (ISENSE_CAL_STATUS_BUSY == m_calStatus);
 }
 
 
-
 // ****************************************************************************
 /*!
- * ISENSE_Calibrate510mACurrent records the adc values for a load current of 510mA.
- *
- * Fit 9.4R to RPi 5V (ca. 510mA @ 4.8v) before calling this routine.
+ * ISENSE_GetCalibrationData fills the calibration status register:
+ * 	[0] status, [1] mode, [2] phase, [3] fail code, [4] kta, [5] ktb,
+ * 	[6..7] resistor offset mA, [8..11] resistor scale K, [12..13] load current mA
+ * 	measured by the check, [14..15] mS since start, [16..17] mS left in the phase
+ * 	(0 when not known). All values little endian.
  *
- * @param	none
+ * @param	p_data		pointer to buffer to place the data, must hold ISENSE_CAL_READ_LEN
+ * @param	p_len		pointer to length of data placed in the buffer
  * @retval	none
  */
 // ****************************************************************************
-void ISENSE_Calibrate510mACurrent(void)
+void ISENSE_GetCalibrationData(uint8_t * const p_data, uint16_t * const p_len)
 {
-	ISENSE_CalibrateCurrent(ISENSE_CAL_POINT_HIGH, 510u);
+	const uint32_t sysTime = HAL_GetTick();
+	const bool busy = (ISENSE_CAL_STATUS_BUSY == m_calStatus);
+	const uint32_t elapsed = MS_TIMEREF_DIFF(m_calStartTime, busy ? sysTime : m_calEndTime);
+	const uint32_t phaseTime = MS_TIMEREF_DIFF(m_calPhaseStartTime, sysTime);
+	uint32_t remaining = busy ? ISENSE_GetCalPhaseTimeMs() : 0u;
+
+	remaining = (remaining > phaseTime) ? (remaining - phaseTime) : 0u;
+
+	p_data[0u] = (uint8_t)m_calStatus;
+	p_data[1u] = (uint8_t)m_calMode;
+	p_data[2u] = m_calPhase;
+	p_data[3u] = m_calFailCode;
+	p_data[4u] = m_kta;
+	p_data[5u] = m_ktb;
+	UTIL_ToBytes_U16((uint16_t)m_resLoadCurrCalibOffset, &p_data[6u]);
+	UTIL_ToBytes_U16((uint16_t)(m_resLoadCurrCalibScale_K & 0xFFFFu), &p_data[8u]);
+	UTIL_ToBytes_U16((uint16_t)(m_resLoadCurrCalibScale_K >> 16u), &p_data[10u]);
+	UTIL_ToBytes_U16((uint16_t)m_calCheckMa, &p_data[12u]);
+	UTIL_ToBytes_U16((elapsed > UINT16_MAX) ? UINT16_MAX : (uint16_t)elapsed, &p_data[14u]);
+	UTIL_ToBytes_U16((remaining > UINT16_MAX) ? UINT16_MAX : (uint16_t)remaining, &p_data[16u]);
+
+	*p_len = ISENSE_CAL_READ_LEN;
 }
 
 
@@ -291,8 +385,8 @@ bool ISENSE_WriteNVCalibration(void)
 	uint32_t spanK = 0u;
 	int16_t spanIAct = m_calPoints[ISENSE_CAL_POINT_HIGH].iActual - m_calPoints[ISENSE_CAL_POINT_MID].iActual;
 	int16_t spanIMeas = m_calPoints[ISENSE_CAL_POINT_HIGH].iRes - m_calPoints[ISENSE_CAL_POINT_MID].iRes;
-	float k12;
-	float ktNorm;
+	uint8_t kta;
+	uint8_t ktb;
 
 	// Spans must be positive and not 0.
 	if ( (spanIAct <= 0) || (spanIMeas <= 0) )
@@ -323,14 +417,11 @@ bool ISENSE_WriteNVCalibration(void)
 
 	NV_WriteVariable_S8(RES_ILOAD_CALIB_ZERO_NV_ADDR, (m_calPoints[ISENSE_CAL_POINT_MID].iRes - m_calPoints[ISENSE_CAL_POINT_MID].iActual) / 10u);
 
-	if (0u != m_calPoints[ISENSE_CAL_POINT_MID].iActual)
+	if ( (0u != m_calPoints[ISENSE_CAL_POINT_MID].iActual) &&
+			(true == ISENSE_CalculateFETDriveCoeffs(&m_calPoints[ISENSE_CAL_POINT_MID], m_calPoints[ISENSE_CAL_POINT_MID].iActual, &kta, &ktb)) )
 	{
-		ktNorm = 0.0052f * m_calPoints[ISENSE_CAL_POINT_MID].temperature + 0.9376f;
-
-		k12 = (float)m_calPoints[ISENSE_CAL_POINT_MID].iActual / (ISENSE_ConvertFETDrvToX(m_calPoints[ISENSE_CAL_POINT_MID].iFet, m_calPoints[ISENSE_CAL_POINT_MID].temperature) * ktNorm);
-
-		m_kta = 0.0052f * k12 * 1024u * 8u;
-		m_ktb = 0.9376f * k12 * 32u;
+		m_kta = kta;
+		m_ktb = ktb;
 
 		NV_WriteVariable_U8(VDG_ILOAD_CALIB_KTA_NV_ADDR, m_kta);
 		NV_WriteVariable_U8(VDG_ILOAD_CALIB_KTB_NV_ADDR, m_ktb);
@@ -433,8 +524,10 @@ static bool ISENSE_ReadNVCalibration(void)
 
 	NV_ReadVariable_U8(VDG_ILOAD_CALIB_KTA_NV_ADDR, &m_kta);
 	NV_ReadVariable_U8(VDG_ILOAD_CALIB_KTB_NV_ADDR, &m_ktb);
-	NV_ReadVariable_U8(RES_ILOAD_CALIB_ZERO_NV_ADDR, &tempU8);
-	m_resLoadCurrCalibOffset = ((int8_t)tempU8 * 10u);
+	if (true == NV_ReadVariable_U8(RES_ILOAD_CALIB_ZERO_NV_ADDR, &tempU8))
+	{
+		m_resLoadCurrCalibOffset = (int8_t)tempU8 * 10;
+	}
 
 	if (false == NV_ReadVariable_U8(ISENSE_RES_SPAN_L, &tempU8))
 	{
@@ -476,9 +569,9 @@ static uint16_t ISENSE_CalculatePMOSLoadCurrentMa(void)
 {
 	const int16_t mcuTemperature = ANALOG_GetMCUTemp();
 	const uint16_t powDet = ADC_CalibrateValue(ADC_GetAverageValue(ANALOG_CHANNEL_POW_DET));
-	const float iNorm = ISENSE_ConvertFETDrvToX(powDet, mcuTemperature);
+	const int32_t iNorm = (int32_t)((ISENSE_ConvertFETDrvToX(powDet, mcuTemperature) + (1ul << (ID_T_POLY_COEFF_Q - 1u))) >> ID_T_POLY_COEFF_Q);
 
-	int32_t result = ((m_kta * mcuTemperature + (((uint16_t)m_ktb) << 8) ) * ((int32_t)(iNorm + 0.5))) >> 13;
+	int32_t result = ((m_kta * mcuTemperature + (((uint16_t)m_ktb) << 8) ) * iNorm) >> 13;
 
 	// Current can't go backwards here!
 	return (result > 0) ? result : 0u;
@@ -489,20 +582,23 @@ static uint16_t ISENSE_CalculatePMOSLoadCurrentMa(void)
 /*!
  * ISENSE_ConvertFETDrvToX returns a value that has a relationship to the amount
  * of current being drawn across the FET. This can be used as a factor for converting
- * the current using the reference tables.
+ * the current using the reference tables. The coefficients are fixed point so the
+ * quadratic is done in integers, the terms stay inside int32 for any int8
+ * temperature.
  *
  * @param	fetDrv				fet drive value from ADC
  * @param	temperature			temperature in degrees
- * @retval	float				converted value
+ * @retval	uint32_t			converted value, ID_T_POLY_COEFF_Q fractional bits
  */
 // ****************************************************************************
-static float ISENSE_ConvertFETDrvToX(const uint16_t fetDrvAdc, const int8_t temperature)
+static uint32_t ISENSE_ConvertFETDrvToX(const uint16_t fetDrvAdc, const int8_t temperature)
 {
 	const uint16_t fetDrvConv = UTIL_FixMul_U32_U16(ISENSE_POWDET_K, fetDrvAdc);
 	const uint16_t vdg = (fetDrvConv > 4790u) ? 0u : 4790u - fetDrvConv;
+	const int32_t t = temperature;
 
 	uint16_t coeffIdx;
-	float result;
+	int32_t result;
 
 	// Check index isn't minimum
 	coeffIdx = (vdg >= ID_T_POLY_COEFF_VDG_START) ?
@@ -515,11 +611,10 @@ static float ISENSE_ConvertFETDrvToX(const uint16_t fetDrvAdc, const int8_t temp
 		coeffIdx = ID_T_POLY_LAST_COEFF_IDX;
 	}
 
-	// Should be some brackets here somewhere!
-	result = a[coeffIdx] * temperature * temperature + b[coeffIdx] * temperature + c[coeffIdx];
+	result = (a[coeffIdx] * t * t) + (b[coeffIdx] * t) + c[coeffIdx];
 
 	// Make sure its positive
-	return (result > 0.0f) ? result : 0.0f;
+	return (result > 0) ? (uint32_t)result : 0u;
 }
 
 
@@ -544,72 +639,296 @@ static int16_t ISENSE_CalculateResSenseCurrentMa(void)
 
 // ****************************************************************************
 /*!
- * ISENSE_CalibrateCurrent records the values for the current sense resistor, power
- * detect fet drive and the actual current and bundles them into an array so that
- * calibration can be performed on all values. There are 3 points possible to store,
- * should be 0mA, 51mA and 510mA. The mid point 51mA is required to calibrate the
- * FET drive. The boost converter and LDO enables are overridden and returned back
- * to their original state. The routine will block for the amount of time it takes
- * to fill the current sense filter. Could be a while.
+ * ISENSE_RunCalibration steps the calibration, records the values for the current
+ * sense resistor, power detect fet drive and the actual current into the calibration
+ * point for the mode. Waits for the adc filters to fill, then with the boost converter
+ * forced on and the LDO off for the 5V rail to settle, then with the LDO on for
+ * the slowed down current sense filter to settle. The boost converter and LDO
+ * enables are then returned to their original state. The load calibration goes
+ * on to work out the coefficients and checks the load current reads back in the
+ * expected window.
  *
- * @param	pointIdx		calibration point index
- * @param	currentMa		actual current applied to the 5v rail
+ * @param	sysTime		current value of the ms tick timer
  * @retval	none
  */
 // ****************************************************************************
-static void ISENSE_CalibrateCurrent(const uint8_t pointIdx, const uint16_t currentMa)
+static void ISENSE_RunCalibration(const uint32_t sysTime)
 {
-	const bool boostEnabled = POWERSOURCE_IsBoostConverterEnabled();
-	const bool ldoEnabled = POWERSOURCE_IsLDOEnabled();
-	const uint32_t watchdogTime = hiwdg.Init.Reload;
+	const uint8_t pointIdx = m_calModePoint[m_calMode];
+	ADC_Snapshot_t adcSnapshot;
+	uint8_t failCode;
+
+	if ( ((ISENSE_CAL_PHASE_RAIL == m_calPhase) || (ISENSE_CAL_PHASE_ISENSE == m_calPhase))
+			&& (m_calBoostEnabled != POWERSOURCE_IsBoostConverterEnabled()) )
+	{
+		ISENSE_RestoreCalPower();
+		ISENSE_FinishCalibration(ISENSE_CAL_STATUS_FAIL, ISENSE_CAL_FAIL_POWER_CHANGED);
+
+		return;
+	}
+
+	if ( (ISENSE_CAL_PHASE_FILTER_READY != m_calPhase)
+			&& (false == MS_TIMEREF_TIMEOUT(m_calPhaseStartTime, sysTime, ISENSE_GetCalPhaseTimeMs())) )
+	{
+		return;
+	}
 
-	if (pointIdx >= 3u)
+	switch (m_calPhase)
 	{
+	case ISENSE_CAL_PHASE_FILTER_READY:
+		if (false == ADC_GetFilterReady())
+		{
+			return;
+		}
+
+		// Adjust filter period to try and stabilise the sense resistor.
+		ADC_SetIFilterPeriod(ISENSE_CAL_FILTER_PERIOD_MS);
+
+		// Override any config settings
+		IODRV_SetPin(IODRV_PIN_POWDET_EN, false);
+		IODRV_SetPin(IODRV_PIN_POW_EN, true);
+
+		m_calPhase = ISENSE_CAL_PHASE_RAIL;
+
+		break;
+
+	case ISENSE_CAL_PHASE_RAIL:
+		// Get boost converter voltage
+		m_calPoints[pointIdx].vBoost = ANALOG_Get5VRailMv();
+
+		// Enable LDO
+		IODRV_SetPin(IODRV_PIN_POWDET_EN, true);
+
+		m_calPhase = ISENSE_CAL_PHASE_ISENSE;
+
+		break;
+
+	case ISENSE_CAL_PHASE_ISENSE:
+		// Log current sense value and LDO drive value from the same sequence
+		ADC_GetSnapshot(&adcSnapshot);
+
+		m_calPoints[pointIdx].iActual = m_calModeCurrentMa[m_calMode];
+		m_calPoints[pointIdx].iRes = adcSnapshot.currentSense;
+		m_calPoints[pointIdx].iFet = ADC_CalibrateValue(adcSnapshot.average[ANALOG_CHANNEL_POW_DET]);
+
+		// Log temperature
+		m_calPoints[pointIdx].temperature = ANALOG_GetMCUTemp();
+
+		ISENSE_RestoreCalPower();
+
+		if (ISENSE_CAL_MODE_LOAD != m_calMode)
+		{
+			ISENSE_FinishCalibration(ISENSE_CAL_STATUS_PASS, ISENSE_CAL_FAIL_NONE);
+
+			return;
+		}
+
+		failCode = ISENSE_CalibrateLoadPoint();
+
+		if (ISENSE_CAL_FAIL_NONE != failCode)
+		{
+			ISENSE_FinishCalibration(ISENSE_CAL_STATUS_FAIL, failCode);
+
+			return;
+		}
+
+		m_calPhase = ISENSE_CAL_PHASE_CHECK;
+
+		break;
+
+	case ISENSE_CAL_PHASE_CHECK:
+	default:
+		// The task's last reading can be from before the wait, take a fresh one
+		ISENSE_CalculateLoadCurrentMa();
+		m_calCheckMa = m_loadCurrentMa;
+
+		if ( (m_calCheckMa >= ISENSE_CAL_CHECK_MIN_MA) && (m_calCheckMa <= ISENSE_CAL_CHECK_MAX_MA) )
+		{
+			ISENSE_FinishCalibration(ISENSE_CAL_STATUS_PASS, ISENSE_CAL_FAIL_NONE);
+		}
+		else
+		{
+			ISENSE_FinishCalibration(ISENSE_CAL_STATUS_FAIL, ISENSE_CAL_FAIL_CHECK);
+		}
+
 		return;
 	}
 
-	// Make sure the watchdog doesn't time out whilst waiting for the filter, set to max.
-	hiwdg.Init.Reload = 4095u;
-	HAL_IWDG_Refresh(&hiwdg);
+	MS_TIMEREF_INIT(m_calPhaseStartTime, sysTime);
+}
+
+
+// ****************************************************************************
+/*!
+ * ISENSE_CalibrateLoadPoint works out the resistor offset and fet drive coefficients
+ * from the mid point taken at 50mA and writes them to NV.
+ *
+ * @param	none
+ * @retval	uint8_t		ISENSE_CAL_FAIL_NONE or failure code
+ */
+// ****************************************************************************
+static uint8_t ISENSE_CalibrateLoadPoint(void)
+{
+	const ISENSE_CalPoint_t * const p_point = &m_calPoints[ISENSE_CAL_POINT_MID];
+	uint8_t kta;
+	uint8_t ktb;
+
+	if (0u == ISENSE_ConvertFETDrvToX(p_point->iFet, p_point->temperature))
+	{
+		return ISENSE_CAL_FAIL_FET_DRIVE;
+	}
+
+	if (false == ISENSE_CalculateFETDriveCoeffs(p_point, 52u, &kta, &ktb))
+	{
+		return ISENSE_CAL_FAIL_RANGE;
+	}
+
+	m_resLoadCurrCalibOffset = p_point->iRes - 51u;
+	m_resLoadCurrCalibScale_K = 0x10000u;
+
+	NV_WriteVariable_S8(RES_ILOAD_CALIB_ZERO_NV_ADDR, m_resLoadCurrCalibOffset / 10u);
+
+	NV_WipeVariable(ISENSE_RES_SPAN_L);
+	NV_WipeVariable(ISENSE_RES_SPAN_H);
+
+	m_kta = kta;
+	m_ktb = ktb;
+
+	NV_WriteVariable_U8(VDG_ILOAD_CALIB_KTA_NV_ADDR, m_kta);
+	NV_WriteVariable_U8(VDG_ILOAD_CALIB_KTB_NV_ADDR, m_ktb);
+
+	return ISENSE_CAL_FAIL_NONE;
+}
+
+
+// ****************************************************************************
+/*!
+ * ISENSE_CalculateFETDriveCoeffs works out the temperature coefficients for the
+ * fet drive current from a known load point. The fitted temperature correction is
+ * 0.0052 * T + 0.9376, the coefficients are scaled by 8192 and 32 so that when
+ * scaled by 10000 it all comes out as integers:
+ * kta = 52 * 8192 * iLoadMa / (fetX * (52 * T + 9376))
+ * ktb = 9376 * 32 * iLoadMa / (fetX * (52 * T + 9376))
+ * Only runs when calibrating so the 64 bit divide does not matter.
+ *
+ * @param	p_point		pointer to the calibration point
+ * @param	iLoadMa		load current at the point
+ * @param	p_kta		pointer to the temperature slope coefficient result
+ * @param	p_ktb		pointer to the temperature offset coefficient result
+ * @retval	bool		false = no fet drive or coefficients will not fit 8 bits
+ */
+// ****************************************************************************
+static bool ISENSE_CalculateFETDriveCoeffs(const ISENSE_CalPoint_t * const p_point, const uint16_t iLoadMa,
+											uint8_t * const p_kta, uint8_t * const p_ktb)
+{
+	const uint32_t fetX = ISENSE_ConvertFETDrvToX(p_point->iFet, p_point->temperature);
+	const int32_t ktNormE4 = (52 * (int8_t)p_point->temperature) + 9376;
+	uint64_t den;
+	uint64_t kta;
+	uint64_t ktb;
+
+	if ( (0u == fetX) || (ktNormE4 <= 0) || (0u == iLoadMa) )
+	{
+		return false;
+	}
+
+	// fetX carries the fractional bits, put them on the top too
+	den = (uint64_t)fetX * (uint32_t)ktNormE4;
+	kta = (((uint64_t)(52u * 8192u) * iLoadMa) << ID_T_POLY_COEFF_Q) / den;
+	ktb = (((uint64_t)(9376u * 32u) * iLoadMa) << ID_T_POLY_COEFF_Q) / den;
 
-	// Adjust filter period to try and stabilise the sense resistor.
-	ADC_SetIFilterPeriod(1000u);
+	if ( (kta > UINT8_MAX) || (ktb > UINT8_MAX) )
+	{
+		return false;
+	}
+
+	*p_kta = (uint8_t)kta;
+	*p_ktb = (uint8_t)ktb;
 
-	m_calPoints[pointIdx].iActual = currentMa;
+	return true;
+}
 
-	// Override any config settings
-	IODRV_SetPin(IODRV_PIN_POWDET_EN, false);
-	IODRV_SetPin(IODRV_PIN_POW_EN, true);
 
-	HAL_Delay(FILTER_PERIOD_MS_CS1 * AVE_FILTER_ELEMENT_COUNT);
+// ****************************************************************************
+/*!
+ * ISENSE_GetCalPhaseTimeMs returns how long the present calibration phase waits.
+ * The check only has to wait for the next load current update if the LDO and
+ * boost converter were already on, otherwise the filters have to follow the change
+ * when they were put back.
+ *
+ * @param	none
+ * @retval	uint32_t	phase time in mS, 0 if the phase waits on a condition
+ */
+// ****************************************************************************
+static uint32_t ISENSE_GetCalPhaseTimeMs(void)
+{
+	uint32_t result;
+	uint32_t iFilterSettle;
+
+	switch (m_calPhase)
+	{
+	case ISENSE_CAL_PHASE_RAIL:
+		return ADC_GetSettleTimeMs(ANALOG_CHANNEL_CS1);
 
-	// Get boost converter voltage
-	m_calPoints[pointIdx].vBoost = ANALOG_Get5VRailMv();
+	case ISENSE_CAL_PHASE_ISENSE:
+		return ADC_GetIFilterSettleTimeMs();
 
-	// Enable LDO
-	IODRV_SetPin(IODRV_PIN_POWDET_EN, true);
+	case ISENSE_CAL_PHASE_CHECK:
+		if ( (true == m_calBoostEnabled) && (true == m_calLdoEnabled) )
+		{
+			return ISENSE_UPDATE_PERIOD;
+		}
 
-	// Wait for the filter to work.
-	HAL_Delay(1000u * AVE_FILTER_ELEMENT_COUNT);
+		result = ADC_GetSettleTimeMs(ANALOG_CHANNEL_POW_DET);
+		iFilterSettle = ADC_GetIFilterSettleTimeMs();
 
-	// Log current sense value
-	m_calPoints[pointIdx].iRes = ADC_GetCurrentSenseAverage();
+		return ((iFilterSettle > result) ? iFilterSettle : result) + ISENSE_UPDATE_PERIOD;
 
-	// Log LDO drive value
-	m_calPoints[pointIdx].iFet = ADC_CalibrateValue(
-									ADC_GetAverageValue(ANALOG_CHANNEL_POW_DET)
-									);
+	default:
+		return 0u;
+	}
+}
 
-	// Log temperature
-	m_calPoints[pointIdx].temperature = ANALOG_GetMCUTemp();
 
+// ****************************************************************************
+/*!
+ * ISENSE_RestoreCalPower puts the normal current sense filter period and the
+ * power regulation back after the calibration overrode them.
+ *
+ * @param	none
+ * @retval	none
+ */
+// ****************************************************************************
+static void ISENSE_RestoreCalPower(void)
+{
 	// Restore normal I sense filter period
 	ADC_SetIFilterPeriod(FILTER_PERIOD_MS_ISENSE);
 
 	// Restore power regulation
-	POWERSOURCE_SetLDOEnable(ldoEnabled);
-	POWERSOURCE_Set5vBoostEnable(boostEnabled);
+	POWERSOURCE_SetLDOEnable(m_calLdoEnabled);
+	POWERSOURCE_Set5vBoostEnable(m_calBoostEnabled);
+
+	// The override did not go through the power source module, it won't switch off what it thinks is off
+	if (false == m_calBoostEnabled)
+	{
+		IODRV_SetPin(IODRV_PIN_POW_EN, false);
+	}
+}
+
+
+// ****************************************************************************
+/*!
+ * ISENSE_FinishCalibration ends the calibration with a result.
+ *
+ * @param	status		result status
+ * @param	failCode	ISENSE_CAL_FAIL_NONE or failure code
+ * @retval	none
+ */
+// ****************************************************************************
+static void ISENSE_FinishCalibration(const ISENSE_CalStatus_t status, const uint8_t failCode)
+{
+	m_calFailCode = failCode;
+	MS_TIME_COUNTER_INIT(m_calEndTime);
 
-	// Restore the watchdog value
-	hiwdg.Init.Reload = watchdogTime;
+	m_calStatus = status;
 }
@@ -25,6 +25,8 @@
 #include "i2cdrv.h"
 #include "led.h"
 #include "hostcomms.h"
+#include "timing_stats.h"
+#include "battery_char.h"
 
 
 // ----------------------------------------------------------------------------
@@ -44,6 +46,7 @@ void OSLOOP_Service(void);
 
 static volatile uint32_t m_osloopTimeTrack[OSLOOP_LOOP_TRACKER_COUNT];
 static uint32_t m_osloopTimeTrackIdx = 0u;
+static uint8_t m_osloopPeriodMs = OSLOOP_PERIOD_MS;
 
 
 // ----------------------------------------------------------------------------
@@ -113,17 +116,30 @@ void OSLOOP_Service(void)
 {
 	const uint32_t sysTime = HAL_GetTick();
 	const uint32_t timeIn = TIMER_OSLOOP->CNT;
+	uint32_t timeMark = timeIn;
 
 	ADC_Service(sysTime);
+	timeMark = TIMING_STATS_RecordService(TIMING_STATS_ADC_SERVICE, timeMark, TIMER_OSLOOP->CNT);
 	IODRV_Service(sysTime);
+	timeMark = TIMING_STATS_RecordService(TIMING_STATS_IODRV_SERVICE, timeMark, TIMER_OSLOOP->CNT);
 	ANALOG_Service(sysTime);
+	timeMark = TIMING_STATS_RecordService(TIMING_STATS_ANALOG_SERVICE, timeMark, TIMER_OSLOOP->CNT);
 
 	I2CDRV_Service(sysTime);
+	timeMark = TIMING_STATS_RecordService(TIMING_STATS_I2CDRV_SERVICE, timeMark, TIMER_OSLOOP->CNT);
 	HOSTCOMMS_Service(sysTime);
+	timeMark = TIMING_STATS_RecordService(TIMING_STATS_HOSTCOMMS_SERVICE, timeMark, TIMER_OSLOOP->CNT);
 
 	LED_Service(sysTime);
+	timeMark = TIMING_STATS_RecordService(TIMING_STATS_LED_SERVICE, timeMark, TIMER_OSLOOP->CNT);
 
-	m_osloopTimeTrack[m_osloopTimeTrackIdx] = (TIMER_OSLOOP->CNT - timeIn);
+	// Not one of the timed services, only runs for battery characterisation
+	BATCHAR_Service(sysTime);
+	timeMark = TIMER_OSLOOP->CNT;
+
+	TIMING_STATS_RecordService(TIMING_STATS_OSLOOP, timeIn, timeMark);
+
+	m_osloopTimeTrack[m_osloopTimeTrackIdx] = (timeMark - timeIn);
 	m_osloopTimeTrackIdx++;
 
 	if (OSLOOP_LOOP_TRACKER_COUNT == m_osloopTimeTrackIdx)
@@ -159,7 +175,8 @@ void OSLOOP_Shutdown(void)
 
 // ****************************************************************************
 /*!
- * OSLOOP_Restart reinitilises the modules after a wake from low power stop
+ * OSLOOP_Restart reinitilises the modules after a wake from low power stop, the
+ * adc keeps its filter state so the system does not wait for the filters to refill.
  *
  * @param	none
  * @retval	none
@@ -169,7 +186,7 @@ void OSLOOP_Restart(void)
 {
 	const uint32_t sysTime = HAL_GetTick();
 
-	ADC_Init(sysTime);
+	ADC_Restart(sysTime);
 	IODRV_Init(sysTime);
 	ANALOG_Init(sysTime);
 	I2CDRV_Init(sysTime);
@@ -205,3 +222,44 @@ void OSLOOP_AtomicAccess(const bool access)
 	}
 }
 
+
+// ****************************************************************************
+/*!
+ * OSLOOP_SetPeriod changes the time between osloop service calls, the service
+ * routines all work off the system tick so only the latency changes. The auto
+ * reload is buffered so the change takes effect at the end of the current
+ * period.
+ *
+ * @param	periodMs	time between service calls in ms, 1 - OSLOOP_PERIOD_MAX_MS
+ * @retval	none
+ */
+// ****************************************************************************
+void OSLOOP_SetPeriod(const uint8_t periodMs)
+{
+	const uint32_t tickKHz = HAL_RCC_GetPCLK1Freq() / ((TIMER_OSLOOP->PSC + 1u) * 1000u);
+
+	if ( (periodMs == 0u) || (periodMs > OSLOOP_PERIOD_MAX_MS) || (periodMs == m_osloopPeriodMs) )
+	{
+		return;
+	}
+
+	TIMER_OSLOOP->CR1 |= TIM_CR1_ARPE;
+	TIMER_OSLOOP->ARR = (periodMs * tickKHz) - 1u;
+
+	m_osloopPeriodMs = periodMs;
+}
+
+
+// ****************************************************************************
+/*!
+ * OSLOOP_GetPeriod returns the time between osloop service calls.
+ *
+ * @param	none
+ * @retval	uint8_t		time between service calls in ms
+ */
+// ****************************************************************************
+uint8_t OSLOOP_GetPeriod(void)
+{
+	return m_osloopPeriodMs;
+}
+
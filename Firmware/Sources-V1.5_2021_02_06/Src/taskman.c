@@ -6,8 +6,12 @@
  * @details     Handles the application side of the system that isn't too dependent
  * 				on close synchronous actions. The power mode is switched here
  * 				where possible stopping the main process waiting for an external
- * 				event or RTC alarm. The stop mode is woken up after 4 seconds regardless
- * 				of no event occurring.
+ * 				event or RTC alarm. The stop mode is woken up after the sleep time
+ * 				(4 seconds by default) regardless of no event occurring. The loop
+ * 				periods and sleep time are NV configurable and can be stretched
+ * 				automatically while on battery with the host quiet. The host
+ * 				idle time comes from hostcomms, the device stops between
+ * 				regular host polls and wakes ahead of the next one.
  *
  */
 // ----------------------------------------------------------------------------
@@ -47,6 +51,9 @@
 #include "e2.h"
 
 #include "util.h"
+#include "timing_stats.h"
+#include "bist.h"
+#include "battery_char.h"
 
 
 #include "taskman.h"
@@ -57,6 +64,12 @@
 
 #define TASKMAN_LOOP_TRACKER_COUNT		16u
 
+// Longest sleep that will be accounted for, stops nonsense if the rtc jumps
+#define TASKMAN_SLEEP_MAX_SECONDS		86400u
+
+#define TASKMAN_LOOP_CONFIG_ADAPTIVE	0x80u
+#define TASKMAN_LOOP_CONFIG_OSLOOP_Msk	0x0Fu
+
 
 typedef enum
 {
@@ -72,6 +85,12 @@ typedef enum
 // Function prototypes for functions that only have scope in this module:
 
 void TASKMAN_WaitInterrupt(void);
+static uint32_t TASKMAN_GetRtcDay(const RTC_DateTypeDef * const p_date);
+static uint32_t TASKMAN_GetRtcSecondOfDay(const RTC_TimeTypeDef * const p_time);
+static uint32_t TASKMAN_GetSleepTimeMs(const RTC_TimeTypeDef * const p_sleepTime, const RTC_DateTypeDef * const p_sleepDate,
+										const RTC_TimeTypeDef * const p_wakeTime, const RTC_DateTypeDef * const p_wakeDate);
+static void TASKMAN_LoadLoopConfig(void);
+static void TASKMAN_UpdateLoopPeriods(const uint32_t sysTime, const uint32_t lastHostCommandAge);
 
 
 // ----------------------------------------------------------------------------
@@ -81,6 +100,7 @@ static volatile uint32_t m_taskmanLoopTimeTrack[TASKMAN_LOOP_TRACKER_COUNT];
 static uint32_t m_taskloopTrackIdx = 0u;
 
 static uint32_t m_lastSleepTimeMs = 0u;
+static uint32_t m_sleepRemainder = 0u;
 static uint32_t m_lastTaskRunTimeMs;
 static uint32_t m_lowPowerDelayTimer;
 
@@ -89,6 +109,16 @@ static TASKMAN_RunState_t m_runState;
 static EXTI_EventStatus_t m_extiEvent = 0;
 static bool m_ioWakeupEvent = false;
 
+static uint8_t m_osloopPeriodMs;
+static uint8_t m_taskPeriodMs;
+static uint8_t m_sleepTime100Ms;
+static bool m_adaptiveEnabled;
+static bool m_adaptStretched;
+static uint32_t m_activeTaskPeriodMs;
+static uint32_t m_activeSleepSetting;
+static uint32_t m_stopSleepSetting;
+static uint32_t m_adaptHoldTimer;
+
 
 // ----------------------------------------------------------------------------
 // Variables that have scope from outside this module:
@@ -130,8 +160,15 @@ void TASKMAN_Init(void)
 	RtcInit();
 	IoControlInit();
 
+	TIMING_STATS_Init();
+	BIST_Init();
+	BATCHAR_Init();
+
+	TASKMAN_LoadLoopConfig();
+
 	MS_TIME_COUNTER_INIT(m_lastTaskRunTimeMs);
 	MS_TIME_COUNTER_INIT(m_lowPowerDelayTimer);
+	MS_TIME_COUNTER_INIT(m_adaptHoldTimer);
 
 	HOSTCOMMS_PiJuiceAddressSetEnable(true);
 
@@ -155,8 +192,11 @@ void TASKMAN_Run(void)
 	bool powerManagerCanShutdown;
 	bool rtcWakeEvent;
 	uint32_t lastHostCommandAge;
+	uint32_t hostIdleMs;
 	bool needEventPoll;
 	uint32_t sysTime;
+	uint32_t loopStartUs;
+	uint32_t timeMarkUs;
 
 	while(true)
 	{
@@ -164,6 +204,7 @@ void TASKMAN_Run(void)
 
 		powerManagerCanShutdown = POWERMAN_CanShutDown();
 		lastHostCommandAge = HOSTCOMMS_GetLastCommandAgeMs(sysTime);
+		hostIdleMs = HOSTCOMMS_GetHostIdleMs(sysTime);
 		rtcWakeEvent = RTC_GetWakeEvent();
 
 		needEventPoll = CHARGER_RequirePoll()
@@ -171,20 +212,35 @@ void TASKMAN_Run(void)
 							|| lastHostCommandAge < 10u
 							|| rtcWakeEvent
 							|| POWERSOURCE_NeedPoll()
-							|| RTC_GetAlarmState();
+							|| RTC_GetAlarmState()
+							|| BIST_IsRunning()
+							|| BATCHAR_IsRunning()
+							|| ISENSE_IsCalibrating()
+							|| FUELGAUGE_IsBusy();
+
+		// A quiesced host counts as quiet for the adaptive periods too
+		TASKMAN_UpdateLoopPeriods(sysTime, (true == HOSTCOMMS_IsHostQuiesced()) ? UINT32_MAX : lastHostCommandAge);
 
 		if (false == needEventPoll)
 		{
 			if ( /*(
 					(ANALOG_Get5VRailMa() <= 50) ||
 					( (ANALOG_Get5VRailMv() < 4600u) && IODRV_ReadPinValue(IODRV_PIN_EXTVS_EN)) ) &&*/
-					(lastHostCommandAge > 5000u) &&
-					MS_TIMEREF_TIMEOUT(m_lowPowerDelayTimer, sysTime, 22u) &&
+					(hostIdleMs >= TASKMAN_STOP_MIN_MS) &&
+					MS_TIMEREF_TIMEOUT(m_lowPowerDelayTimer, sysTime, TASKMAN_WAKE_SETTLE_MS) &&
 					(true == powerManagerCanShutdown) &&
 					(CHG_NO_VALID_SOURCE == CHARGER_GetStatus()) &&
 					(false == BUTTON_IsButtonActive())
 					)
 			{
+				// Wake up ahead of a predicted host poll
+				m_stopSleepSetting = m_activeSleepSetting;
+
+				if ( (HOSTCOMMS_IDLE_FOREVER != hostIdleMs) &&
+						(((hostIdleMs * TASKMAN_SLEEP_SETTING_K) / 1000u) < m_stopSleepSetting) )
+				{
+					m_stopSleepSetting = (hostIdleMs * TASKMAN_SLEEP_SETTING_K) / 1000u;
+				}
 
 				m_runState = TASKMAN_RUNSTATE_LOW_POWER;
 			}
@@ -208,27 +264,47 @@ void TASKMAN_Run(void)
 
 
 		// Do not disturb i2c transfer if this is i2c interrupt wakeup
-		if ( (MS_TIME_COUNT(m_lastTaskRunTimeMs) >= TASKMAN_TASK_PERIOD_MS) || needEventPoll )
+		if ( (MS_TIME_COUNT(m_lastTaskRunTimeMs) >= m_activeTaskPeriodMs) || needEventPoll )
 		{
 			MS_TIME_COUNTER_INIT(m_lastTaskRunTimeMs);
 
 			// Reset the watchdog down timer
 			HAL_IWDG_Refresh(&hiwdg);
 
+			loopStartUs = TIMING_STATS_GetTimeUs();
+			timeMarkUs = loopStartUs;
+
 			CHARGER_Task();
+			timeMarkUs = TIMING_STATS_RecordTask(TIMING_STATS_CHARGER_TASK, timeMarkUs, TIMING_STATS_GetTimeUs());
 			FUELGAUGE_Task();
+			timeMarkUs = TIMING_STATS_RecordTask(TIMING_STATS_FUELGAUGE_TASK, timeMarkUs, TIMING_STATS_GetTimeUs());
 			BATTERY_Task();
+			timeMarkUs = TIMING_STATS_RecordTask(TIMING_STATS_BATTERY_TASK, timeMarkUs, TIMING_STATS_GetTimeUs());
 			POWERSOURCE_Task();
+			timeMarkUs = TIMING_STATS_RecordTask(TIMING_STATS_POWERSOURCE_TASK, timeMarkUs, TIMING_STATS_GetTimeUs());
 			ISENSE_Task();
+			timeMarkUs = TIMING_STATS_RecordTask(TIMING_STATS_ISENSE_TASK, timeMarkUs, TIMING_STATS_GetTimeUs());
 
 			RTC_EvaluateAlarm();
+			timeMarkUs = TIMING_STATS_RecordTask(TIMING_STATS_RTC_TASK, timeMarkUs, TIMING_STATS_GetTimeUs());
 
 			BUTTON_Task();
+			timeMarkUs = TIMING_STATS_RecordTask(TIMING_STATS_BUTTON_TASK, timeMarkUs, TIMING_STATS_GetTimeUs());
 			POWERMAN_Task();
+			timeMarkUs = TIMING_STATS_RecordTask(TIMING_STATS_POWERMAN_TASK, timeMarkUs, TIMING_STATS_GetTimeUs());
 
 			HOSTCOMMS_Task();
+			timeMarkUs = TIMING_STATS_RecordTask(TIMING_STATS_HOSTCOMMS_TASK, timeMarkUs, TIMING_STATS_GetTimeUs());
+
+			// Not timed tasks, only run for production test and battery characterisation
+			BIST_Task();
+			BATCHAR_Task();
+			timeMarkUs = TIMING_STATS_GetTimeUs();
 
 			CHARGER_Task();
+			timeMarkUs = TIMING_STATS_RecordTask(TIMING_STATS_CHARGER_TASK, timeMarkUs, TIMING_STATS_GetTimeUs());
+
+			TIMING_STATS_RecordTask(TIMING_STATS_TASKMAN, loopStartUs, timeMarkUs);
 
 			m_taskmanLoopTimeTrack[m_taskloopTrackIdx] = MS_TIMEREF_DIFF(m_lastTaskRunTimeMs, HAL_GetTick());
 			m_taskloopTrackIdx++;
@@ -283,6 +359,62 @@ void TASKMAN_ClearIOWakeEvent(void)
 	m_ioWakeupEvent = false;
 }
 
+
+// ****************************************************************************
+/*!
+ * TASKMAN_SetLoopConfigData writes the osloop period, taskman period and sleep
+ * time to NV memory and applies them. A zero leaves the setting at default.
+ *
+ * p_data[0] = bits 0-3 osloop period in ms, bit 7 adaptive mode enable
+ * p_data[1] = taskman period in ms
+ * p_data[2] = low power sleep time in 100ms steps
+ *
+ * @param	p_data		pointer to config data
+ * @param	len			length of config data
+ * @retval	none
+ */
+// ****************************************************************************
+void TASKMAN_SetLoopConfigData(const uint8_t * const p_data, const uint16_t len)
+{
+	if (len < 3u)
+	{
+		return;
+	}
+
+	if ( ((p_data[0u] & TASKMAN_LOOP_CONFIG_OSLOOP_Msk) > OSLOOP_PERIOD_MAX_MS) ||
+			(0u != (p_data[0u] & ~(TASKMAN_LOOP_CONFIG_ADAPTIVE | TASKMAN_LOOP_CONFIG_OSLOOP_Msk))) )
+	{
+		return;
+	}
+
+	NV_WriteVariable_U8(OSLOOP_CONFIG_NV_ADDR, p_data[0u]);
+	NV_WriteVariable_U8(TASKMAN_PERIOD_NV_ADDR, p_data[1u]);
+	NV_WriteVariable_U8(TASKMAN_SLEEP_NV_ADDR, p_data[2u]);
+
+	TASKMAN_LoadLoopConfig();
+}
+
+
+// ****************************************************************************
+/*!
+ * TASKMAN_GetLoopConfigData reads the loop config as written, plus the state of
+ * the adaptive mode in the last byte (1 = periods stretched).
+ *
+ * @param	p_data		pointer to destination of config data
+ * @param	p_len		length of config data
+ * @retval	none
+ */
+// ****************************************************************************
+void TASKMAN_GetLoopConfigData(uint8_t * const p_data, uint16_t * const p_len)
+{
+	p_data[0u] = m_osloopPeriodMs | ((true == m_adaptiveEnabled) ? TASKMAN_LOOP_CONFIG_ADAPTIVE : 0u);
+	p_data[1u] = m_taskPeriodMs;
+	p_data[2u] = m_sleepTime100Ms;
+	p_data[3u] = (true == m_adaptStretched) ? 1u : 0u;
+
+	*p_len = 4u;
+}
+
 // ----------------------------------------------------------------------------
 // ----------------------------------------------------------------------------
 // FUNCTIONS WITH LOCAL SCOPE
@@ -306,10 +438,12 @@ void HAL_RTCEx_WakeUpTimerEventCallback(RTC_HandleTypeDef *hrtc)
  * and then waits for a configured interrupt event. If in low power mode the
  * processor will enter STOP mode for it's lowest power consumption. Configured
  * peripherals can wake up the device at any point or the RTC peripheral will
- * set a timer to wake up the device every 4 seconds by default, the osloop
- * and taskman will run their routines for a period defined or until any task
- * has been satisfied. On wake from STOP the system tick timer is adjusted for
- * the amount of time it has been suspended.
+ * set a timer to wake up the device every 4 seconds by default, or ahead of an
+ * expected host poll, the osloop and taskman will run their routines for a
+ * period defined or until any task has been satisfied. On wake from STOP the system tick timer is adjusted for
+ * the amount of time it has been suspended, worked out from the full rtc date,
+ * time and sub seconds so it is good whatever woke the device and across day
+ * and month boundaries.
  *
  * @param	none
  * @retval	none
@@ -321,8 +455,7 @@ void TASKMAN_WaitInterrupt(void)
 	extern __IO uint32_t uwTick;
 
 	RTC_TimeTypeDef sleepTime_rtc, wakeTime_rtc;
-	uint32_t sleepTime, wakeTime;
-	uint8_t tempU8;
+	RTC_DateTypeDef sleepDate_rtc, wakeDate_rtc;
 
 	if (TASKMAN_RUNSTATE_LOW_POWER == m_runState)
 	{
@@ -332,9 +465,9 @@ void TASKMAN_WaitInterrupt(void)
 		OSLOOP_Shutdown();
 
 	    HAL_RTC_GetTime(&hrtc, &sleepTime_rtc, RTC_FORMAT_BIN);
-	    (void)RTC->DR;
+	    HAL_RTC_GetDate(&hrtc, &sleepDate_rtc, RTC_FORMAT_BIN);
 
-	    HAL_RTCEx_SetWakeUpTimer_IT(&hrtc, TASKMAN_SLEEP_SETTING, RTC_WAKEUPCLOCK_RTCCLK_DIV16);
+	    HAL_RTCEx_SetWakeUpTimer_IT(&hrtc, m_stopSleepSetting, RTC_WAKEUPCLOCK_RTCCLK_DIV16);
 
 #ifdef LOWPOWER_NO_STOP
 
@@ -353,30 +486,18 @@ void TASKMAN_WaitInterrupt(void)
 		HAL_RTCEx_DeactivateWakeUpTimer(&hrtc);
 
 	    HAL_RTC_GetTime(&hrtc, &wakeTime_rtc, RTC_FORMAT_BIN);
-	    (void)RTC->DR;
+	    HAL_RTC_GetDate(&hrtc, &wakeDate_rtc, RTC_FORMAT_BIN);
 
-	    sleepTime = (sleepTime_rtc.Hours * 3600) + (sleepTime_rtc.Minutes * 60) + (sleepTime_rtc.Seconds);
-	    wakeTime = (wakeTime_rtc.Hours * 3600) + (wakeTime_rtc.Minutes * 60) + (wakeTime_rtc.Seconds);
-	    m_lastSleepTimeMs = (wakeTime - sleepTime) * 1000u;
-
-	    tempU8 = (uint8_t)(wakeTime_rtc.SubSeconds & 0xFFu);
-	    tempU8 -= (uint8_t)(sleepTime_rtc.SubSeconds & 0xFFu);
-
-	    // Add on the ms from the subseconds timer
-	    m_lastSleepTimeMs += UTIL_FixMul_U32_U16(257003ul, tempU8);
+	    m_lastSleepTimeMs = TASKMAN_GetSleepTimeMs(&sleepTime_rtc, &sleepDate_rtc, &wakeTime_rtc, &wakeDate_rtc);
 
 	    uwTick += m_lastSleepTimeMs;
 
 	    HAL_ResumeTick();
 
 		// Restart background tasks
+	    // Adc filters keep their values from before stop, no need to wait for them
 	    OSLOOP_Restart();
 
-		while(false == ADC_GetFilterReady())
-		{
-			// Wait for ADC to become ready
-		}
-
 		MS_TIME_COUNTER_INIT(m_lowPowerDelayTimer);
 
 	}
@@ -387,6 +508,232 @@ void TASKMAN_WaitInterrupt(void)
 }
 
 
+// ****************************************************************************
+/*!
+ * TASKMAN_LoadLoopConfig reads the loop periods from NV memory, anything missing
+ * or out of range gets the default. The periods are then applied straight away.
+ *
+ * @param	none
+ * @retval	none
+ */
+// ****************************************************************************
+static void TASKMAN_LoadLoopConfig(void)
+{
+	uint8_t tempU8;
+
+	m_osloopPeriodMs = OSLOOP_PERIOD_MS;
+	m_adaptiveEnabled = false;
+	m_taskPeriodMs = TASKMAN_TASK_PERIOD_MS;
+	m_sleepTime100Ms = TASKMAN_SLEEP_TIME_MS / 100u;
+
+	if (NV_ReadVariable_U8(OSLOOP_CONFIG_NV_ADDR, &tempU8))
+	{
+		if ( ((tempU8 & TASKMAN_LOOP_CONFIG_OSLOOP_Msk) > 0u) &&
+				((tempU8 & TASKMAN_LOOP_CONFIG_OSLOOP_Msk) <= OSLOOP_PERIOD_MAX_MS) )
+		{
+			m_osloopPeriodMs = tempU8 & TASKMAN_LOOP_CONFIG_OSLOOP_Msk;
+		}
+
+		m_adaptiveEnabled = (0u != (tempU8 & TASKMAN_LOOP_CONFIG_ADAPTIVE));
+	}
+
+	if ( NV_ReadVariable_U8(TASKMAN_PERIOD_NV_ADDR, &tempU8) && (tempU8 > 0u) )
+	{
+		m_taskPeriodMs = tempU8;
+	}
+
+	if ( NV_ReadVariable_U8(TASKMAN_SLEEP_NV_ADDR, &tempU8) && (tempU8 > 0u) )
+	{
+		m_sleepTime100Ms = tempU8;
+	}
+
+	// Force the periods to be applied
+	m_adaptStretched = true;
+
+	TASKMAN_UpdateLoopPeriods(HAL_GetTick(), 0u);
+}
+
+
+// ****************************************************************************
+/*!
+ * TASKMAN_UpdateLoopPeriods picks the osloop and taskman periods and the low
+ * power sleep time. With the adaptive mode enabled the periods are stretched if
+ * running from the battery and the host has been quiet for a while, a charger
+ * event or host command brings them straight back. Charger events hold the
+ * normal periods for a while as the charger tends to chatter.
+ *
+ * @param	sysTime				current value of the ms tick timer
+ * @param	lastHostCommandAge	time since the host last sent a command in ms
+ * @retval	none
+ */
+// ****************************************************************************
+static void TASKMAN_UpdateLoopPeriods(const uint32_t sysTime, const uint32_t lastHostCommandAge)
+{
+	bool stretch = false;
+	uint32_t sleepSetting;
+
+	// Keep the normal periods for a charger event and while the battery characterisation times the load
+	if ( (EXTI_EVENT_CHARGER == m_extiEvent) || (true == CHARGER_RequirePoll()) || (true == BATCHAR_IsRunning()) )
+	{
+		MS_TIMEREF_INIT(m_adaptHoldTimer, sysTime);
+	}
+
+	if (true == m_adaptiveEnabled)
+	{
+		stretch = (lastHostCommandAge > TASKMAN_ADAPT_HOST_IDLE_MS) &&
+					(CHG_NO_VALID_SOURCE == CHARGER_GetStatus()) &&
+					MS_TIMEREF_TIMEOUT(m_adaptHoldTimer, sysTime, TASKMAN_ADAPT_HOLD_MS);
+	}
+
+	if (stretch == m_adaptStretched)
+	{
+		return;
+	}
+
+	m_adaptStretched = stretch;
+
+	if (true == stretch)
+	{
+		m_activeTaskPeriodMs = m_taskPeriodMs * TASKMAN_ADAPT_TASK_FACTOR;
+		sleepSetting = ((m_sleepTime100Ms * 100ul * TASKMAN_ADAPT_SLEEP_FACTOR) * TASKMAN_SLEEP_SETTING_K) / 1000u;
+
+		OSLOOP_SetPeriod( ((m_osloopPeriodMs * OSLOOP_ADAPT_FACTOR) < OSLOOP_PERIOD_MAX_MS) ?
+							(m_osloopPeriodMs * OSLOOP_ADAPT_FACTOR) :
+							OSLOOP_PERIOD_MAX_MS);
+	}
+	else
+	{
+		m_activeTaskPeriodMs = m_taskPeriodMs;
+		sleepSetting = ((m_sleepTime100Ms * 100ul) * TASKMAN_SLEEP_SETTING_K) / 1000u;
+
+		OSLOOP_SetPeriod(m_osloopPeriodMs);
+	}
+
+	// Wakeup timer counter is only 16 bits
+	m_activeSleepSetting = (sleepSetting > 0xFFFFu) ? 0xFFFFu : sleepSetting;
+}
+
+
+// ****************************************************************************
+/*!
+ * TASKMAN_GetRtcDay returns the number of days since 1st January 2000 for an
+ * rtc date, the rtc only holds a two digit year so every fourth year is a leap.
+ *
+ * @param	p_date		pointer to the rtc date in binary format
+ * @retval	uint32_t	day number
+ */
+// ****************************************************************************
+static uint32_t TASKMAN_GetRtcDay(const RTC_DateTypeDef * const p_date)
+{
+	static const uint16_t daysBeforeMonth[12u] = {0u, 31u, 59u, 90u, 120u, 151u, 181u, 212u, 243u, 273u, 304u, 334u};
+	const uint8_t monthIdx = ((p_date->Month >= 1u) && (p_date->Month <= 12u)) ? (p_date->Month - 1u) : 0u;
+
+	uint32_t days = (p_date->Year * 365u) + ((p_date->Year + 3u) / 4u);
+
+	days += daysBeforeMonth[monthIdx];
+
+	if ( (0u == (p_date->Year & 0x03u)) && (monthIdx > 1u) )
+	{
+		days++;
+	}
+
+	days += p_date->Date;
+
+	return days;
+}
+
+
+// ****************************************************************************
+/*!
+ * TASKMAN_GetRtcSecondOfDay returns the number of seconds since midnight for an
+ * rtc time, takes care of the rtc being set to 12 hour mode by the host.
+ *
+ * @param	p_time		pointer to the rtc time in binary format
+ * @retval	uint32_t	seconds since midnight
+ */
+// ****************************************************************************
+static uint32_t TASKMAN_GetRtcSecondOfDay(const RTC_TimeTypeDef * const p_time)
+{
+	uint32_t hours = p_time->Hours;
+
+	if (RTC_HOURFORMAT_12 == hrtc.Init.HourFormat)
+	{
+		hours %= 12u;
+
+		if (RTC_HOURFORMAT12_PM == p_time->TimeFormat)
+		{
+			hours += 12u;
+		}
+	}
+
+	return (hours * 3600u) + (p_time->Minutes * 60u) + p_time->Seconds;
+}
+
+
+// ****************************************************************************
+/*!
+ * TASKMAN_GetSleepTimeMs works out the time spent asleep from the rtc readings
+ * taken before and after. The sub second counter counts down from the synchronous
+ * prescaler value, the fraction of a ms left over is carried to the next sleep
+ * so the system tick doesn't drift from the rtc over a long time asleep. If the
+ * rtc went backwards (or jumped forward a silly amount) no time is added, the
+ * system tick must never go backwards.
+ *
+ * @param	p_sleepTime		pointer to the rtc time when going to sleep
+ * @param	p_sleepDate		pointer to the rtc date when going to sleep
+ * @param	p_wakeTime		pointer to the rtc time on wake
+ * @param	p_wakeDate		pointer to the rtc date on wake
+ * @retval	uint32_t		time asleep in ms
+ */
+// ****************************************************************************
+static uint32_t TASKMAN_GetSleepTimeMs(const RTC_TimeTypeDef * const p_sleepTime, const RTC_DateTypeDef * const p_sleepDate,
+										const RTC_TimeTypeDef * const p_wakeTime, const RTC_DateTypeDef * const p_wakeDate)
+{
+	const uint32_t subSecondCount = hrtc.Init.SynchPrediv + 1u;
+	const uint32_t sleepDay = TASKMAN_GetRtcDay(p_sleepDate);
+	const uint32_t wakeDay = TASKMAN_GetRtcDay(p_wakeDate);
+	const uint32_t sleepSecond = TASKMAN_GetRtcSecondOfDay(p_sleepTime);
+	const uint32_t wakeSecond = TASKMAN_GetRtcSecondOfDay(p_wakeTime);
+	uint32_t sleepSeconds;
+	uint32_t sleepTicks;
+	uint32_t sleepMs;
+
+	if ( (wakeDay < sleepDay) || ((wakeDay == sleepDay) && (wakeSecond < sleepSecond)) )
+	{
+		return 0u;
+	}
+
+	if ((wakeDay - sleepDay) > (TASKMAN_SLEEP_MAX_SECONDS / 86400u))
+	{
+		return 0u;
+	}
+
+	sleepSeconds = ((wakeDay - sleepDay) * 86400u) + wakeSecond - sleepSecond;
+
+	if (sleepSeconds > TASKMAN_SLEEP_MAX_SECONDS)
+	{
+		return 0u;
+	}
+
+	// Sub seconds count down, so the elapsed part of the second is prediv - ssr
+	sleepTicks = (sleepSeconds * subSecondCount)
+				+ (hrtc.Init.SynchPrediv - p_wakeTime->SubSeconds)
+				- (hrtc.Init.SynchPrediv - p_sleepTime->SubSeconds);
+
+	// Wake can't be before sleep within the same second
+	if ((int32_t)sleepTicks < 0)
+	{
+		return 0u;
+	}
+
+	sleepMs = ((sleepTicks % subSecondCount) * 1000u) + m_sleepRemainder;
+
+	m_sleepRemainder = sleepMs % subSecondCount;
+
+	return ((sleepTicks / subSecondCount) * 1000u) + (sleepMs / subSecondCount);
+}
+
+
 // ****************************************************************************
 /*!
  * HAL_GPIO_EXTI_Callback deals with the EXTI events, the HAL driver is fairly
@@ -404,6 +751,9 @@ void TASKMAN_WaitInterrupt(void)
 // ****************************************************************************
 void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
 {
+	// Time stamp button edges, ignores anything that is not captured
+	IODRV_CaptureEdge(GPIO_Pin);
+
 	if (GPIO_Pin == GPIO_PIN_0)
 	{
 		// CH_INT
@@ -422,7 +772,7 @@ void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
 	}
 	else
 	{
-		// SW1, SW2, SW3
+		// SW1, SW2, SW3, press and release
 		m_extiEvent = EXTI_EVENT_USER;
 	}
 }
@@ -0,0 +1,532 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file		timing_stats.c
+ * @date       	18 October 2026
+ * @brief       Collects execution time statistics for the osloop service routines
+ * 				and the taskman tasks so they can be read out over the command
+ * 				server. Each entry keeps min, max and a mean that decays when the
+ * 				sample count gets large so it follows the recent behaviour. The
+ * 				two loop totals also keep a log scale histogram, 4 buckets per
+ * 				octave, that the 99th percentile is estimated from.
+ * 				Osloop entries are in osloop timer ticks and are recorded from the
+ * 				osloop interrupt, taskman entries are in uS. Each entry has its own
+ * 				sequence counter, the readout (which happens inside the osloop) can
+ * 				interrupt a taskman update so it keeps the last good summary of an
+ * 				entry that is part way through rather than waiting for it. A
+ * 				sample that lands on an entry being updated at a lower priority is
+ * 				dropped, nothing holds off the osloop interrupt.
+ *
+ */
+// ----------------------------------------------------------------------------
+// Include section - add all #includes here:
+
+#include "main.h"
+#include "system_conf.h"
+#include "util.h"
+#include "seqlock.h"
+
+#include "timing_stats.h"
+
+
+// ----------------------------------------------------------------------------
+// Defines section - add all #defines here:
+
+#define TIMING_STATS_LOOP_COUNT			2u
+#define TIMING_STATS_HIST_BUCKETS		60u		/* log2 with 2 bits of mantissa covers 16 bits */
+#define TIMING_STATS_DECAY_COUNT		0x8000u	/* Halve the totals when count reaches this */
+
+#define TIMING_STATS_READ_LEN			31u
+#define TIMING_STATS_PAGE_ENTRIES		7u
+#define TIMING_STATS_MODULE_COUNT		(TIMING_STATS_MAX_ENTRIES - TIMING_STATS_LOOP_COUNT)
+#define TIMING_STATS_PAGES				(1u + ((TIMING_STATS_MODULE_COUNT + TIMING_STATS_PAGE_ENTRIES - 1u) / TIMING_STATS_PAGE_ENTRIES))
+
+#define TIMING_STATS_CMD_RESET			0x00u
+#define TIMING_STATS_CMD_SELECT_PAGE	0x01u
+
+typedef struct
+{
+	uint16_t min;
+	uint16_t max;
+	uint32_t total;
+	uint32_t count;
+	SEQLOCK_t seq;
+} TIMING_STATS_Entry_t;
+
+
+// ----------------------------------------------------------------------------
+// Function prototypes for functions that only have scope in this module:
+
+static void TIMING_STATS_Update(const TIMING_STATS_Id_t id, const uint32_t duration);
+static uint8_t TIMING_STATS_GetBucket(const uint16_t value);
+static uint16_t TIMING_STATS_GetBucketUpper(const uint8_t bucket);
+
+
+// ----------------------------------------------------------------------------
+// Variables that only have scope in this module:
+
+static TIMING_STATS_Entry_t m_entries[TIMING_STATS_MAX_ENTRIES];
+static uint16_t m_loopHistogram[TIMING_STATS_LOOP_COUNT][TIMING_STATS_HIST_BUCKETS];
+
+static TIMING_STATS_Summary_t m_snapshot[TIMING_STATS_MAX_ENTRIES];
+static uint8_t m_readPage;
+
+static uint32_t m_sysTickUsScale;
+
+
+// ----------------------------------------------------------------------------
+// Variables that have scope from outside this module:
+
+
+// ----------------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+// FUNCTIONS WITH GLOBAL SCOPE
+// ----------------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+// ****************************************************************************
+/*!
+ * TIMING_STATS_Init configures the module to a known initial state
+ * @param	none
+ * @retval	none
+ */
+// ****************************************************************************
+void TIMING_STATS_Init(void)
+{
+	// 16/16 fixed point multiplier to turn systick counts into uS
+	m_sysTickUsScale = (1000ul << 16u) / (SysTick->LOAD + 1u);
+
+	TIMING_STATS_Reset();
+}
+
+
+// ****************************************************************************
+/*!
+ * TIMING_STATS_Reset clears all the collected statistics, each entry is cleared
+ * as an update of its own so the osloop keeps running.
+ * @param	none
+ * @retval	none
+ */
+// ****************************************************************************
+void TIMING_STATS_Reset(void)
+{
+	uint8_t i;
+	uint8_t j;
+
+	for (i = 0u; i < TIMING_STATS_MAX_ENTRIES; i++)
+	{
+		if (false == SEQLOCK_TryWriteBegin(&m_entries[i].seq))
+		{
+			continue;
+		}
+
+		m_entries[i].min = UINT16_MAX;
+		m_entries[i].max = 0u;
+		m_entries[i].total = 0u;
+		m_entries[i].count = 0u;
+
+		if (i < TIMING_STATS_LOOP_COUNT)
+		{
+			for (j = 0u; j < TIMING_STATS_HIST_BUCKETS; j++)
+			{
+				m_loopHistogram[i][j] = 0u;
+			}
+		}
+
+		SEQLOCK_WriteEnd(&m_entries[i].seq);
+	}
+
+	m_readPage = 0u;
+}
+
+
+// ****************************************************************************
+/*!
+ * TIMING_STATS_RecordService adds a duration to a statistics entry, to be called
+ * from the osloop interrupt. The end time is returned so the calls can be
+ * chained to time consecutive routines.
+ *
+ * @param	id			statistics entry
+ * @param	startTime	time the routine started
+ * @param	endTime		time the routine ended
+ * @retval	uint32_t	endTime
+ */
+// ****************************************************************************
+uint32_t TIMING_STATS_RecordService(const TIMING_STATS_Id_t id, const uint32_t startTime, const uint32_t endTime)
+{
+	TIMING_STATS_Update(id, endTime - startTime);
+
+	return endTime;
+}
+
+
+// ****************************************************************************
+/*!
+ * TIMING_STATS_RecordTask adds a duration to a statistics entry from outside of
+ * the osloop interrupt, the same as TIMING_STATS_RecordService now the entries
+ * look after themselves. The end time is returned so the calls can be chained
+ * to time consecutive routines.
+ *
+ * @param	id			statistics entry
+ * @param	startTime	time the routine started
+ * @param	endTime		time the routine ended
+ * @retval	uint32_t	endTime
+ */
+// ****************************************************************************
+uint32_t TIMING_STATS_RecordTask(const TIMING_STATS_Id_t id, const uint32_t startTime, const uint32_t endTime)
+{
+	TIMING_STATS_Update(id, endTime - startTime);
+
+	return endTime;
+}
+
+
+// ****************************************************************************
+/*!
+ * TIMING_STATS_GetTimeUs gets a uS resolution time from the ms tick and the
+ * systick down counter. Not to be used from interrupts with a higher priority
+ * than systick as the ms tick may not have caught up with the counter.
+ *
+ * @param	none
+ * @retval	uint32_t	time in uS, wraps
+ */
+// ****************************************************************************
+uint32_t TIMING_STATS_GetTimeUs(void)
+{
+	uint32_t tick;
+	uint32_t count;
+
+	do
+	{
+		tick = HAL_GetTick();
+		count = SysTick->VAL;
+	} while (tick != HAL_GetTick());
+
+	return (tick * 1000u) + (((SysTick->LOAD - count) * m_sysTickUsScale) >> 16u);
+}
+
+
+// ****************************************************************************
+/*!
+ * TIMING_STATS_GetSummary works out the min, max, mean and 99th percentile of a
+ * statistics entry. The percentile comes from the histogram for the loop
+ * entries, it is the upper edge of the bucket so will read a bit high. Module
+ * entries have no histogram so the max is used. If the entry is part way
+ * through an update at a lower priority the summary is left as it was.
+ *
+ * @param	id			statistics entry
+ * @param	p_summary	pointer to summary to fill
+ * @retval	none
+ */
+// ****************************************************************************
+void TIMING_STATS_GetSummary(const TIMING_STATS_Id_t id, TIMING_STATS_Summary_t * const p_summary)
+{
+	const TIMING_STATS_Entry_t * p_entry;
+	TIMING_STATS_Summary_t summary;
+	uint32_t histCount = 0u;
+	uint32_t target;
+	uint32_t seq;
+	uint8_t i;
+
+	if ( (NULL == p_summary) || (id >= TIMING_STATS_MAX_ENTRIES) )
+	{
+		return;
+	}
+
+	p_entry = &m_entries[id];
+	seq = SEQLOCK_ReadBegin(&p_entry->seq);
+
+	if (0u != (seq & 1u))
+	{
+		return;
+	}
+
+	summary.count = p_entry->count;
+	summary.min = 0u;
+	summary.max = 0u;
+	summary.mean = 0u;
+	summary.p99 = 0u;
+
+	if (0u == summary.count)
+	{
+		if (false == SEQLOCK_ReadRetry(&p_entry->seq, seq))
+		{
+			*p_summary = summary;
+		}
+
+		return;
+	}
+
+	summary.min = p_entry->min;
+	summary.max = p_entry->max;
+	summary.mean = (uint16_t)((p_entry->total + (summary.count / 2u)) / summary.count);
+	summary.p99 = summary.max;
+
+	if (id < TIMING_STATS_LOOP_COUNT)
+	{
+		for (i = 0u; i < TIMING_STATS_HIST_BUCKETS; i++)
+		{
+			histCount += m_loopHistogram[id][i];
+		}
+
+		// Smallest bucket with at least 99% of the samples at or below it
+		target = histCount - (histCount / 100u);
+		histCount = 0u;
+
+		for (i = 0u; i < TIMING_STATS_HIST_BUCKETS; i++)
+		{
+			histCount += m_loopHistogram[id][i];
+
+			if (histCount >= target)
+			{
+				break;
+			}
+		}
+
+		if ( (i < TIMING_STATS_HIST_BUCKETS) && (TIMING_STATS_GetBucketUpper(i) < summary.max) )
+		{
+			summary.p99 = TIMING_STATS_GetBucketUpper(i);
+		}
+	}
+
+	if (false == SEQLOCK_ReadRetry(&p_entry->seq, seq))
+	{
+		*p_summary = summary;
+	}
+}
+
+
+// ****************************************************************************
+/*!
+ * TIMING_STATS_ReadCmd fills a command server read with one page of the stats.
+ * Reading page 0 takes a snapshot of all entries so the following pages are
+ * consistent with it, the page advances on each read and returns to 0 after
+ * the last one.
+ *
+ * Page 0:	[0] page, [1] page count, [2..9] osloop min, max, mean, p99,
+ * 			[10..17] taskman min, max, mean, p99, [18..19] osloop timer kHz,
+ * 			[20..23] osloop count, [24..27] taskman count
+ * Page n:	[0] page, [1] page count, [2..29] 7 module entries, mean then max
+ *
+ * All values little endian.
+ *
+ * @param	p_data		pointer to command server buffer
+ * @param	p_len		pointer to length of the response
+ * @retval	none
+ */
+// ****************************************************************************
+void TIMING_STATS_ReadCmd(uint8_t * const p_data, uint16_t * const p_len)
+{
+	const uint32_t osloopKHz = HAL_RCC_GetPCLK1Freq() / ((TIMER_OSLOOP->PSC + 1u) * 1000u);
+	uint8_t i;
+	uint8_t idx;
+	uint8_t entry;
+
+	for (i = 0u; i < TIMING_STATS_READ_LEN; i++)
+	{
+		p_data[i] = 0u;
+	}
+
+	*p_len = TIMING_STATS_READ_LEN;
+
+	p_data[0u] = m_readPage;
+	p_data[1u] = TIMING_STATS_PAGES;
+
+	if (0u == m_readPage)
+	{
+		// Entries part way through a taskman update keep their last summary
+		for (i = 0u; i < TIMING_STATS_MAX_ENTRIES; i++)
+		{
+			TIMING_STATS_GetSummary(i, &m_snapshot[i]);
+		}
+
+		idx = 2u;
+
+		for (i = 0u; i < TIMING_STATS_LOOP_COUNT; i++)
+		{
+			UTIL_ToBytes_U16(m_snapshot[i].min, &p_data[idx]);
+			UTIL_ToBytes_U16(m_snapshot[i].max, &p_data[idx + 2u]);
+			UTIL_ToBytes_U16(m_snapshot[i].mean, &p_data[idx + 4u]);
+			UTIL_ToBytes_U16(m_snapshot[i].p99, &p_data[idx + 6u]);
+			idx += 8u;
+		}
+
+		UTIL_ToBytes_U16((uint16_t)osloopKHz, &p_data[18u]);
+
+		for (i = 0u; i < TIMING_STATS_LOOP_COUNT; i++)
+		{
+			UTIL_ToBytes_U16((uint16_t)m_snapshot[i].count, &p_data[20u + (i * 4u)]);
+			UTIL_ToBytes_U16((uint16_t)(m_snapshot[i].count >> 16u), &p_data[22u + (i * 4u)]);
+		}
+	}
+	else
+	{
+		entry = TIMING_STATS_LOOP_COUNT + ((m_readPage - 1u) * TIMING_STATS_PAGE_ENTRIES);
+		idx = 2u;
+
+		for (i = 0u; (i < TIMING_STATS_PAGE_ENTRIES) && (entry < TIMING_STATS_MAX_ENTRIES); i++)
+		{
+			UTIL_ToBytes_U16(m_snapshot[entry].mean, &p_data[idx]);
+			UTIL_ToBytes_U16(m_snapshot[entry].max, &p_data[idx + 2u]);
+			idx += 4u;
+			entry++;
+		}
+	}
+
+	m_readPage++;
+
+	if (m_readPage >= TIMING_STATS_PAGES)
+	{
+		m_readPage = 0u;
+	}
+}
+
+
+// ****************************************************************************
+/*!
+ * TIMING_STATS_WriteCmd handles a command server write,
+ * [0] = 0x00 clears the statistics, [0] = 0x01, [1] = page selects the next page
+ * to be read.
+ *
+ * @param	p_data		pointer to data written by the host
+ * @param	len			length of the data
+ * @retval	none
+ */
+// ****************************************************************************
+void TIMING_STATS_WriteCmd(const uint8_t * const p_data, const uint16_t len)
+{
+	if (len < 1u)
+	{
+		return;
+	}
+
+	if (TIMING_STATS_CMD_RESET == p_data[0u])
+	{
+		TIMING_STATS_Reset();
+	}
+	else if ( (TIMING_STATS_CMD_SELECT_PAGE == p_data[0u]) && (len >= 2u) )
+	{
+		m_readPage = (p_data[1u] < TIMING_STATS_PAGES) ? p_data[1u] : 0u;
+	}
+}
+
+
+// ----------------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+// FUNCTIONS WITH LOCAL SCOPE
+// ----------------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+// ****************************************************************************
+/*!
+ * TIMING_STATS_Update adds a duration to an entry, durations saturate at 16 bits.
+ * When the count gets large the count, total and histogram are halved so the
+ * mean and percentile follow the recent behaviour and nothing overflows. The
+ * sample is dropped if it interrupted an update of the same entry.
+ *
+ * @param	id			statistics entry
+ * @param	duration	time taken
+ * @retval	none
+ */
+// ****************************************************************************
+static void TIMING_STATS_Update(const TIMING_STATS_Id_t id, const uint32_t duration)
+{
+	const uint16_t value = (duration > UINT16_MAX) ? UINT16_MAX : (uint16_t)duration;
+	TIMING_STATS_Entry_t * p_entry;
+	uint8_t i;
+
+	if (id >= TIMING_STATS_MAX_ENTRIES)
+	{
+		return;
+	}
+
+	p_entry = &m_entries[id];
+
+	if (false == SEQLOCK_TryWriteBegin(&p_entry->seq))
+	{
+		return;
+	}
+
+	if (value < p_entry->min)
+	{
+		p_entry->min = value;
+	}
+
+	if (value > p_entry->max)
+	{
+		p_entry->max = value;
+	}
+
+	if (p_entry->count >= TIMING_STATS_DECAY_COUNT)
+	{
+		p_entry->count >>= 1u;
+		p_entry->total >>= 1u;
+
+		if (id < TIMING_STATS_LOOP_COUNT)
+		{
+			for (i = 0u; i < TIMING_STATS_HIST_BUCKETS; i++)
+			{
+				m_loopHistogram[id][i] >>= 1u;
+			}
+		}
+	}
+
+	p_entry->count++;
+	p_entry->total += value;
+
+	if (id < TIMING_STATS_LOOP_COUNT)
+	{
+		m_loopHistogram[id][TIMING_STATS_GetBucket(value)]++;
+	}
+
+	SEQLOCK_WriteEnd(&p_entry->seq);
+}
+
+
+// ****************************************************************************
+/*!
+ * TIMING_STATS_GetBucket works out the histogram bucket for a value, values
+ * below 8 get their own bucket, above that each octave is split in to 4.
+ *
+ * @param	value		value to place
+ * @retval	uint8_t		histogram bucket
+ */
+// ****************************************************************************
+static uint8_t TIMING_STATS_GetBucket(const uint16_t value)
+{
+	uint8_t msb = 2u;
+
+	if (value < 4u)
+	{
+		return (uint8_t)value;
+	}
+
+	while ( (msb < 15u) && ((value >> (msb + 1u)) != 0u) )
+	{
+		msb++;
+	}
+
+	return (uint8_t)(((msb - 1u) * 4u) + ((value >> (msb - 2u)) & 0x03u));
+}
+
+
+// ****************************************************************************
+/*!
+ * TIMING_STATS_GetBucketUpper gets the largest value that falls in a bucket.
+ *
+ * @param	bucket		histogram bucket
+ * @retval	uint16_t	upper value of the bucket
+ */
+// ****************************************************************************
+static uint16_t TIMING_STATS_GetBucketUpper(const uint8_t bucket)
+{
+	uint8_t msb;
+	uint32_t lower;
+
+	if (bucket < 4u)
+	{
+		return bucket;
+	}
+
+	msb = (bucket / 4u) + 1u;
+	lower = (uint32_t)(4u + (bucket & 0x03u)) << (msb - 2u);
+
+	return (uint16_t)(lower + (1ul << (msb - 2u)) - 1u);
+}
@@ -0,0 +1,188 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file		bench_adc_osloop.c
+ * @date       	18 October 2026
+ * @brief       Instruction counts of the adc work done in the osloop, the share
+ * 				of m_osloopTimeTrack that changed when the adc moved to timer
+ * 				triggered dma. Built by make measure_adc_osloop against the adc
+ * 				sources from before the change and against the working tree, the
+ * 				sources are found through the include path.
+ *
+ * 				Before, ADC_Service ran the filters and restarted the dma on
+ * 				every osloop pass that found a finished sequence. After, the dma
+ * 				interrupt runs the filters once per trigger and ADC_Service only
+ * 				does the arithmetic. The osloop runs every ms for two simulated
+ * 				seconds and the trigger comes every 8.192 ms. The HAL dma stop and
+ * 				start are stubs here, so the before figures are a lower bound.
+ *
+ */
+// ----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "system_conf.h"
+
+// The factory calibration lives in system memory on the part
+static const uint16_t m_simVrefIntCal = 1526u;
+#undef VREFINT_CAL_ADDR
+#define VREFINT_CAL_ADDR				(&m_simVrefIntCal)
+
+#include "util.c"
+#include "ave_filter.c"
+#include "adc.c"
+
+#ifdef ADC_DMA_SEQUENCES
+#define BENCH_TRIGGER_US				8192u		/* TIM15 update, 8MHz / 65536 */
+#else
+#define BENCH_TRIGGER_US				1000u		/* Started again by every osloop pass */
+#endif
+
+#define BENCH_RUN_MS					2000u
+#define BENCH_SETTLE_MS					1000u		/* Filters filled before counting */
+
+typedef struct
+{
+	uint32_t count;
+	uint32_t max;
+	uint64_t total;
+} BENCH_Stat_t;
+
+
+// ----------------------------------------------------------------------------
+// Stubs
+
+ADC_HandleTypeDef hadc;
+DMA_HandleTypeDef hdma_adc;
+
+uint32_t HAL_GetTick(void) { return g_hostTick; }
+HAL_StatusTypeDef HAL_ADC_Init(ADC_HandleTypeDef *hadc) { return HAL_OK; }
+HAL_StatusTypeDef HAL_ADCEx_Calibration_Start(ADC_HandleTypeDef *hadc) { return HAL_OK; }
+HAL_StatusTypeDef HAL_ADC_Start_DMA(ADC_HandleTypeDef *hadc, uint32_t *pData, uint32_t Length) { return HAL_OK; }
+HAL_StatusTypeDef HAL_ADC_Stop_DMA(ADC_HandleTypeDef *hadc) { return HAL_OK; }
+void HAL_DMA_IRQHandler(DMA_HandleTypeDef *hdma) { }
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority) { }
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn) { }
+
+
+// ----------------------------------------------------------------------------
+// Bench
+
+static uint32_t m_sequences;
+
+static void BenchFill(uint16_t * const p_vals)
+{
+	uint8_t i;
+
+	for (i = 0u; i < MAX_ANALOG_CHANNELS; i++)
+	{
+		p_vals[i] = (uint16_t)(2000u + ((uint32_t)rand() & 0x1Fu));
+	}
+}
+
+static void BenchService(void)
+{
+	ADC_Service(g_hostTick);
+}
+
+#ifdef ADC_DMA_SEQUENCES
+
+static void BenchSequence(void)
+{
+	if (0u == (m_sequences % ADC_DMA_SEQUENCES))
+	{
+		HAL_ADC_ConvHalfCpltCallback(&hadc);
+	}
+	else
+	{
+		HAL_ADC_ConvCpltCallback(&hadc);
+	}
+}
+
+// A trigger converts a sequence into the next half of the circular buffer and
+// the dma interrupt takes it
+static uint32_t BenchTrigger(void)
+{
+	BenchFill(&m_adcVals[(m_sequences % ADC_DMA_SEQUENCES) * MAX_ANALOG_CHANNELS]);
+
+	return HOST_CountInstructions(BenchSequence);
+}
+
+#else
+
+// Software started sequence, done well within a ms, the osloop finds it finished
+static uint32_t BenchTrigger(void)
+{
+	BenchFill(&m_adcVals[0u]);
+	hadc.Instance->ISR |= ADC_ISR_EOS;
+
+	return 0u;
+}
+
+#endif
+
+static void BenchAdd(BENCH_Stat_t * const p_stat, const uint32_t value)
+{
+	p_stat->count++;
+	p_stat->total += value;
+
+	if (value > p_stat->max)
+	{
+		p_stat->max = value;
+	}
+}
+
+
+int main(int argc, char ** argv)
+{
+	const char * const p_name = (argc > 1) ? argv[1] : "adc";
+	BENCH_Stat_t service = { 0u };
+	BENCH_Stat_t irq = { 0u };
+	uint32_t triggerUs = 0u;
+	uint32_t instructions;
+	uint32_t ms;
+
+	hadc.Instance = ADC1;
+	srand(1u);
+
+	g_hostTick = 1000u;
+	ADC_Init(g_hostTick);
+
+	if (0u == HOST_CountInstructions(BenchService))
+	{
+		printf("bench_adc_osloop: SKIP, host can't single step\n");
+		return 0;
+	}
+
+	for (ms = 0u; ms < (BENCH_SETTLE_MS + BENCH_RUN_MS); ms++)
+	{
+		g_hostTick++;
+		triggerUs += 1000u;
+
+		instructions = 0u;
+
+		if (triggerUs >= BENCH_TRIGGER_US)
+		{
+			triggerUs -= BENCH_TRIGGER_US;
+			instructions = BenchTrigger();
+			m_sequences++;
+		}
+
+		if (ms >= BENCH_SETTLE_MS)
+		{
+			if (0u != instructions)
+			{
+				BenchAdd(&irq, instructions);
+			}
+
+			BenchAdd(&service, HOST_CountInstructions(BenchService));
+		}
+	}
+
+	printf("bench_adc_osloop: %-7s ADC_Service per osloop pass mean %6.1f max %5u, dma interrupt per sequence mean %6.1f max %5u, %7llu a second in all\n",
+			p_name, (double)service.total / service.count, (unsigned)service.max,
+			(0u != irq.count) ? ((double)irq.total / irq.count) : 0.0, (unsigned)irq.max,
+			(unsigned long long)(((service.total + irq.total) * 1000u) / BENCH_RUN_MS));
+
+	return 0;
+}
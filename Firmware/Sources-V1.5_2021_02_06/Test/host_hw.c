@@ -0,0 +1,465 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file		host_hw.c
+ * @date       	18 October 2026
+ * @brief       Fake peripherals, interrupt lines, write trap and test reporting
+ * 				for the host build of the firmware module tests. See host_hw.h.
+ *
+ */
+// ----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+
+#define HOST_TRAP_FLAG					0x100u	/* x86 eflags single step */
+
+// ----------------------------------------------------------------------------
+// Peripherals
+
+HOST_I2C_t g_hostI2C1;
+HOST_I2C_t g_hostI2C2;
+HOST_DMA_t g_hostDMA1;
+HOST_DMAChannels_t g_hostDMA1Channel;
+HOST_TIM_t g_hostTIM3;
+HOST_TIM_t g_hostTIM6;
+HOST_TIM_t g_hostTIM14;
+HOST_TIM_t g_hostTIM15;
+HOST_TIM_t g_hostTIM16;
+HOST_TIM_t g_hostTIM17;
+HOST_RTC_t g_hostRTC;
+HOST_EXTI_t g_hostEXTI;
+HOST_GPIOs_t g_hostGPIO;
+HOST_ADC_t g_hostADC1;
+HOST_PWR_t g_hostPWR;
+HOST_RCC_t g_hostRCC;
+HOST_SysTick_t g_hostSysTick;
+HOST_NVIC_t g_hostNVIC;
+HOST_SCB_t g_hostSCB;
+
+// ----------------------------------------------------------------------------
+// Simulated time and interrupts
+
+volatile uint32_t g_hostTick;
+volatile uint32_t g_hostPrimask;
+
+static void (*m_p_irqHandler[HOST_IRQ_COUNT])(void);
+static volatile bool m_irqPending[HOST_IRQ_COUNT];
+static volatile bool m_inIrq[HOST_IRQ_COUNT];
+static volatile bool m_osloopHeld;
+static void (*m_p_wfiHook)(void);
+
+static uint8_t * m_p_trapPage;
+static uint32_t m_trapSkip;
+static uint32_t m_trapCount;
+static void (*m_p_trapHook)(void);
+
+static volatile uint32_t m_stepCount;
+static void (*volatile m_p_stepHook)(void);
+static volatile bool m_stepCounting;
+static volatile uint32_t m_stepTotal;
+
+uint32_t g_hostChecks;
+uint32_t g_hostFailures;
+
+
+// ****************************************************************************
+/*!
+ * HOST_SetIrqHandler sets the routine run when the test raises a simulated
+ * interrupt line.
+ *
+ * @param	irq			interrupt line
+ * @param	p_handler	interrupt routine, NULL for none
+ * @retval	none
+ */
+// ****************************************************************************
+void HOST_SetIrqHandler(const HOST_Irq_t irq, void (*p_handler)(void))
+{
+	m_p_irqHandler[irq] = p_handler;
+	m_irqPending[irq] = false;
+}
+
+
+// ****************************************************************************
+/*!
+ * HOST_RaiseIrq runs the simulated interrupt now if nothing holds it off,
+ * otherwise it is left pending and runs when released. The device line
+ * pre-empts the osloop line but not the other way round.
+ *
+ * @param	irq			interrupt line
+ * @retval	none
+ */
+// ****************************************************************************
+void HOST_RaiseIrq(const HOST_Irq_t irq)
+{
+	bool held = (0u != g_hostPrimask) || (true == m_inIrq[HOST_IRQ_DEVICE]);
+
+	if (HOST_IRQ_OSLOOP == irq)
+	{
+		held = held || (true == m_osloopHeld) || (true == m_inIrq[HOST_IRQ_OSLOOP]);
+	}
+
+	if (true == held)
+	{
+		m_irqPending[irq] = true;
+		return;
+	}
+
+	m_irqPending[irq] = false;
+
+	if (NULL != m_p_irqHandler[irq])
+	{
+		m_inIrq[irq] = true;
+		m_p_irqHandler[irq]();
+		m_inIrq[irq] = false;
+	}
+
+	HOST_Unmasked();
+}
+
+
+// ****************************************************************************
+/*!
+ * HOST_IrqPending returns true if a raised interrupt is waiting to be released.
+ *
+ * @param	irq			interrupt line
+ * @retval	bool
+ */
+// ****************************************************************************
+bool HOST_IrqPending(const HOST_Irq_t irq)
+{
+	return m_irqPending[irq];
+}
+
+
+// ****************************************************************************
+/*!
+ * HOST_OsloopHold holds off or releases the osloop line, for the test's
+ * OSLOOP_AtomicAccess stub.
+ *
+ * @param	hold		true = hold off the osloop
+ * @retval	none
+ */
+// ****************************************************************************
+void HOST_OsloopHold(const bool hold)
+{
+	m_osloopHeld = hold;
+
+	if (false == hold)
+	{
+		HOST_Unmasked();
+	}
+}
+
+
+// ****************************************************************************
+/*!
+ * HOST_Unmasked runs any interrupt that has been released, device line first.
+ *
+ * @param	none
+ * @retval	none
+ */
+// ****************************************************************************
+void HOST_Unmasked(void)
+{
+	if ( (true == m_irqPending[HOST_IRQ_DEVICE]) && (0u == g_hostPrimask) && (false == m_inIrq[HOST_IRQ_DEVICE]) )
+	{
+		HOST_RaiseIrq(HOST_IRQ_DEVICE);
+	}
+
+	if ( (true == m_irqPending[HOST_IRQ_OSLOOP]) && (0u == g_hostPrimask) && (false == m_osloopHeld)
+			&& (false == m_inIrq[HOST_IRQ_DEVICE]) && (false == m_inIrq[HOST_IRQ_OSLOOP]) )
+	{
+		HOST_RaiseIrq(HOST_IRQ_OSLOOP);
+	}
+}
+
+
+// ****************************************************************************
+/*!
+ * HOST_SetWfiHook sets a routine to stand in for the wait for interrupt.
+ *
+ * @param	p_hook		routine run by __WFI, NULL for none
+ * @retval	none
+ */
+// ****************************************************************************
+void HOST_SetWfiHook(void (*p_hook)(void))
+{
+	m_p_wfiHook = p_hook;
+}
+
+
+void HOST_Wfi(void)
+{
+	if (NULL != m_p_wfiHook)
+	{
+		m_p_wfiHook();
+	}
+}
+
+
+// ----------------------------------------------------------------------------
+// Write trap. The peripheral page is made read only, a write faults, the page
+// is opened and the write single stepped, then the page is closed again and
+// the write counted. The hook runs after the chosen write as an interrupt would.
+// Both signals are SA_NODEFER so writes from within the hook nest.
+
+#if defined(__x86_64__) && defined(__linux__)
+
+static void HOST_TrapFault(int sig, siginfo_t * p_info, void * p_context)
+{
+	ucontext_t * const p_uc = (ucontext_t *)p_context;
+	uint8_t * const p_addr = (uint8_t *)p_info->si_addr;
+
+	(void)sig;
+
+	if ( (NULL == m_p_trapPage) || (p_addr < m_p_trapPage) || (p_addr >= (m_p_trapPage + HOST_PAGE_SIZE)) )
+	{
+		signal(SIGSEGV, SIG_DFL);
+		return;
+	}
+
+	mprotect(m_p_trapPage, HOST_PAGE_SIZE, PROT_READ | PROT_WRITE);
+	p_uc->uc_mcontext.gregs[REG_EFL] |= HOST_TRAP_FLAG;
+}
+
+
+static void HOST_TrapStep(int sig, siginfo_t * p_info, void * p_context)
+{
+	ucontext_t * const p_uc = (ucontext_t *)p_context;
+	void (*p_hook)(void) = m_p_stepHook;
+
+	(void)sig;
+	(void)p_info;
+
+	// Counting instructions for HOST_CountInstructions, the flag stays set
+	if (true == m_stepCounting)
+	{
+		m_stepTotal++;
+		return;
+	}
+
+	// Stepping instructions for HOST_InterruptAfter, the flag stays set until the
+	// hook is due
+	if (NULL != p_hook)
+	{
+		if (0u != m_stepCount)
+		{
+			m_stepCount--;
+			return;
+		}
+
+		// Held off like a real interrupt while masked
+		if (0u != g_hostPrimask)
+		{
+			return;
+		}
+
+		p_uc->uc_mcontext.gregs[REG_EFL] &= ~HOST_TRAP_FLAG;
+		m_p_stepHook = NULL;
+		p_hook();
+		return;
+	}
+
+	p_uc->uc_mcontext.gregs[REG_EFL] &= ~HOST_TRAP_FLAG;
+
+	if (NULL == m_p_trapPage)
+	{
+		return;
+	}
+
+	mprotect(m_p_trapPage, HOST_PAGE_SIZE, PROT_READ);
+
+	m_trapCount++;
+
+	// Writes made by the hook are trapped and counted too
+	if ( (m_trapCount == (m_trapSkip + 1u)) && (NULL != m_p_trapHook) )
+	{
+		m_p_trapHook();
+	}
+}
+
+
+// ****************************************************************************
+/*!
+ * HOST_TrapWrites counts writes to a peripheral and runs the hook straight
+ * after the write that follows the first skip writes. Counting carries on
+ * until disarmed by passing NULL.
+ *
+ * @param	p_periph	any register of the peripheral, NULL to disarm
+ * @param	skip		number of writes to let through first
+ * @param	p_hook		routine to run after the write
+ * @retval	bool		false if the host can't trap writes
+ */
+// ****************************************************************************
+bool HOST_TrapWrites(void * const p_periph, const uint32_t skip, void (*p_hook)(void))
+{
+	struct sigaction action;
+
+	if (NULL != m_p_trapPage)
+	{
+		mprotect(m_p_trapPage, HOST_PAGE_SIZE, PROT_READ | PROT_WRITE);
+		m_p_trapPage = NULL;
+	}
+
+	m_trapCount = 0u;
+
+	if (NULL == p_periph)
+	{
+		return true;
+	}
+
+	memset(&action, 0, sizeof(action));
+	action.sa_flags = SA_SIGINFO | SA_NODEFER;
+
+	action.sa_sigaction = HOST_TrapFault;
+	sigaction(SIGSEGV, &action, NULL);
+
+	action.sa_sigaction = HOST_TrapStep;
+	sigaction(SIGTRAP, &action, NULL);
+
+	m_trapSkip = skip;
+	m_p_trapHook = p_hook;
+	m_p_trapPage = (uint8_t *)((uintptr_t)p_periph & ~((uintptr_t)HOST_PAGE_SIZE - 1u));
+
+	return (0 == mprotect(m_p_trapPage, HOST_PAGE_SIZE, PROT_READ));
+}
+
+
+
+// ****************************************************************************
+/*!
+ * HOST_InterruptAfter single steps the caller and runs the hook once the given
+ * number of instructions have gone, as an interrupt arriving at that point would.
+ * The hook waits while interrupts are masked. Stepping starts on the return from
+ * this function. Passing NULL stops stepping,
+ * the hook is then never run.
+ *
+ * @param	instructions	number of instructions to let through first
+ * @param	p_hook			routine to run, NULL to cancel
+ * @retval	bool			false if the host can't step
+ */
+// ****************************************************************************
+bool HOST_InterruptAfter(const uint32_t instructions, void (*p_hook)(void))
+{
+	struct sigaction action;
+
+	if (NULL == p_hook)
+	{
+		m_p_stepHook = NULL;
+		__asm volatile("pushfq\n\tandq %0, (%%rsp)\n\tpopfq" :: "i"(~(int32_t)HOST_TRAP_FLAG) : "memory", "cc");
+
+		return true;
+	}
+
+	memset(&action, 0, sizeof(action));
+	action.sa_flags = SA_SIGINFO | SA_NODEFER;
+	action.sa_sigaction = HOST_TrapStep;
+	sigaction(SIGTRAP, &action, NULL);
+
+	m_stepCount = instructions;
+	m_p_stepHook = p_hook;
+
+	__asm volatile("pushfq\n\torq %0, (%%rsp)\n\tpopfq" :: "i"(HOST_TRAP_FLAG) : "memory", "cc");
+
+	return true;
+}
+
+
+// ****************************************************************************
+/*!
+ * HOST_CountInstructions single steps a routine and returns the number of
+ * instructions it took, the call and return included.
+ *
+ * @param	p_fn		routine to run
+ * @retval	uint32_t	instructions, 0 if the host can't step
+ */
+// ****************************************************************************
+uint32_t HOST_CountInstructions(void (*p_fn)(void))
+{
+	struct sigaction action;
+
+	memset(&action, 0, sizeof(action));
+	action.sa_flags = SA_SIGINFO | SA_NODEFER;
+	action.sa_sigaction = HOST_TrapStep;
+	sigaction(SIGTRAP, &action, NULL);
+
+	m_stepTotal = 0u;
+	m_stepCounting = true;
+
+	__asm volatile("pushfq\n\torq %0, (%%rsp)\n\tpopfq" :: "i"(HOST_TRAP_FLAG) : "memory", "cc");
+	p_fn();
+	__asm volatile("pushfq\n\tandq %0, (%%rsp)\n\tpopfq" :: "i"(~(int32_t)HOST_TRAP_FLAG) : "memory", "cc");
+
+	m_stepCounting = false;
+
+	return m_stepTotal;
+}
+
+#else
+
+bool HOST_TrapWrites(void * const p_periph, const uint32_t skip, void (*p_hook)(void))
+{
+	(void)skip;
+	(void)p_hook;
+
+	return (NULL == p_periph);
+}
+
+
+bool HOST_InterruptAfter(const uint32_t instructions, void (*p_hook)(void))
+{
+	(void)instructions;
+
+	return (NULL == p_hook);
+}
+
+
+uint32_t HOST_CountInstructions(void (*p_fn)(void))
+{
+	p_fn();
+
+	return 0u;
+}
+
+#endif
+
+
+// ****************************************************************************
+/*!
+ * HOST_TrapCount returns the number of trapped writes since HOST_TrapWrites.
+ *
+ * @param	none
+ * @retval	uint32_t
+ */
+// ****************************************************************************
+uint32_t HOST_TrapCount(void)
+{
+	return m_trapCount;
+}
+
+
+// ----------------------------------------------------------------------------
+// Test reporting
+
+void HOST_Check(const bool pass, const char * const p_text, const char * const p_file, const int line)
+{
+	g_hostChecks++;
+
+	if (false == pass)
+	{
+		g_hostFailures++;
+		printf("%s:%d: check failed: %s\n", p_file, line, p_text);
+	}
+}
+
+
+int HOST_Report(const char * const p_name)
+{
+	printf("%s: %s, %u checks, %u failed\n", p_name, (0u == g_hostFailures) ? "PASS" : "FAIL",
+			(unsigned)g_hostChecks, (unsigned)g_hostFailures);
+
+	return (0u == g_hostFailures) ? 0 : 1;
+}
@@ -0,0 +1,243 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file		host_hw.h
+ * @date       	18 October 2026
+ * @brief       Host build shim for the firmware module tests, force included
+ * 				ahead of every source by the Makefile.
+ * @details     The arm intrinsics of cmsis_gcc.h are replaced with host versions,
+ * 				the interrupt mask is a variable and unmasking runs any simulated
+ * 				interrupt that was raised while masked. The peripherals the
+ * 				modules touch are pointed at plain structs so a test can poke the
+ * 				status registers and look at what the module wrote.
+ *
+ * 				A test has two simulated interrupt lines, set with
+ * 				HOST_SetIrqHandler and raised with HOST_RaiseIrq. The device line
+ * 				stands for the peripheral interrupts and pre-empts the osloop line,
+ * 				both are held off by __disable_irq and the osloop line is also held
+ * 				off by HOST_OsloopHold, which the test's OSLOOP_AtomicAccess stub
+ * 				calls. A held interrupt runs when it is released.
+ *
+ * 				HOST_TrapWrites catches writes to one of the peripherals and runs a
+ * 				hook straight after a chosen one, so an interrupt can be raised at
+ * 				an exact point in a module function. HOST_InterruptAfter single
+ * 				steps the caller and runs a hook after a chosen number of
+ * 				instructions, so a test can sweep an interrupt across every point
+ * 				of a routine. HOST_CountInstructions single steps a routine to
+ * 				count the instructions it takes (all three x86-64 Linux only).
+ *
+ */
+// ----------------------------------------------------------------------------
+
+#ifndef HOST_HW_H_
+#define HOST_HW_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// ----------------------------------------------------------------------------
+// Replacement for cmsis_gcc.h
+
+#define __CMSIS_GCC_H
+
+#define __ASM							__asm
+#define __INLINE						inline
+#define __STATIC_INLINE					static inline
+#define __STATIC_FORCEINLINE			static inline
+#define __NO_RETURN						__attribute__((__noreturn__))
+#define __USED							__attribute__((used))
+#define __WEAK							__attribute__((weak))
+#define __PACKED						__attribute__((packed, aligned(1)))
+#define __PACKED_STRUCT					struct __attribute__((packed, aligned(1)))
+#define __PACKED_UNION					union __attribute__((packed, aligned(1)))
+#define __ALIGNED(x)					__attribute__((aligned(x)))
+#define __RESTRICT						__restrict
+#define __COMPILER_BARRIER()			__asm volatile("" ::: "memory")
+
+extern volatile uint32_t g_hostPrimask;
+
+void HOST_Unmasked(void);
+void HOST_Wfi(void);
+
+__STATIC_INLINE void __disable_irq(void)
+{
+	g_hostPrimask = 1u;
+	__COMPILER_BARRIER();
+}
+
+__STATIC_INLINE void __enable_irq(void)
+{
+	__COMPILER_BARRIER();
+	g_hostPrimask = 0u;
+	HOST_Unmasked();
+}
+
+__STATIC_INLINE uint32_t __get_PRIMASK(void)
+{
+	return g_hostPrimask;
+}
+
+__STATIC_INLINE void __set_PRIMASK(uint32_t priMask)
+{
+	__COMPILER_BARRIER();
+	g_hostPrimask = priMask;
+
+	if (0u == priMask)
+	{
+		HOST_Unmasked();
+	}
+}
+
+__STATIC_INLINE void __set_MSP(uint32_t topOfMainStack)
+{
+	(void)topOfMainStack;
+}
+
+#define __NOP()							__COMPILER_BARRIER()
+#define __DMB()							__COMPILER_BARRIER()
+#define __DSB()							__COMPILER_BARRIER()
+#define __ISB()							__COMPILER_BARRIER()
+#define __WFI()							HOST_Wfi()
+#define __WFE()							HOST_Wfi()
+#define __SEV()							__COMPILER_BARRIER()
+#define __REV(x)						__builtin_bswap32(x)
+#define __REV16(x)						((uint32_t)(((x) & 0xFF00FF00u) >> 8u) | (((x) & 0x00FF00FFu) << 8u))
+
+#include "main.h"
+
+// ----------------------------------------------------------------------------
+// Peripherals, each on a page of its own so HOST_TrapWrites can catch writes
+
+#define HOST_PAGE_SIZE					4096u
+#define HOST_PERIPH(name, type, count)	typedef union { type regs[count]; uint8_t page[HOST_PAGE_SIZE]; } __attribute__((aligned(HOST_PAGE_SIZE))) name
+
+HOST_PERIPH(HOST_I2C_t, I2C_TypeDef, 1u);
+HOST_PERIPH(HOST_DMA_t, DMA_TypeDef, 1u);
+HOST_PERIPH(HOST_DMAChannels_t, DMA_Channel_TypeDef, 7u);
+HOST_PERIPH(HOST_TIM_t, TIM_TypeDef, 1u);
+HOST_PERIPH(HOST_RTC_t, RTC_TypeDef, 1u);
+HOST_PERIPH(HOST_EXTI_t, EXTI_TypeDef, 1u);
+HOST_PERIPH(HOST_GPIOs_t, GPIO_TypeDef, 6u);
+HOST_PERIPH(HOST_ADC_t, ADC_TypeDef, 1u);
+HOST_PERIPH(HOST_PWR_t, PWR_TypeDef, 1u);
+HOST_PERIPH(HOST_RCC_t, RCC_TypeDef, 1u);
+HOST_PERIPH(HOST_SysTick_t, SysTick_Type, 1u);
+HOST_PERIPH(HOST_NVIC_t, NVIC_Type, 1u);
+HOST_PERIPH(HOST_SCB_t, SCB_Type, 1u);
+
+extern HOST_I2C_t g_hostI2C1;
+extern HOST_I2C_t g_hostI2C2;
+extern HOST_DMA_t g_hostDMA1;
+extern HOST_DMAChannels_t g_hostDMA1Channel;
+extern HOST_TIM_t g_hostTIM3;
+extern HOST_TIM_t g_hostTIM6;
+extern HOST_TIM_t g_hostTIM14;
+extern HOST_TIM_t g_hostTIM15;
+extern HOST_TIM_t g_hostTIM16;
+extern HOST_TIM_t g_hostTIM17;
+extern HOST_RTC_t g_hostRTC;
+extern HOST_EXTI_t g_hostEXTI;
+extern HOST_GPIOs_t g_hostGPIO;
+extern HOST_ADC_t g_hostADC1;
+extern HOST_PWR_t g_hostPWR;
+extern HOST_RCC_t g_hostRCC;
+extern HOST_SysTick_t g_hostSysTick;
+extern HOST_NVIC_t g_hostNVIC;
+extern HOST_SCB_t g_hostSCB;
+
+#undef I2C1
+#undef I2C2
+#undef DMA1
+#undef DMA1_Channel1
+#undef DMA1_Channel2
+#undef DMA1_Channel3
+#undef DMA1_Channel4
+#undef DMA1_Channel5
+#undef DMA1_Channel6
+#undef DMA1_Channel7
+#undef TIM3
+#undef TIM6
+#undef TIM14
+#undef TIM15
+#undef TIM16
+#undef TIM17
+#undef RTC
+#undef EXTI
+#undef GPIOA
+#undef GPIOB
+#undef GPIOC
+#undef GPIOD
+#undef GPIOF
+#undef ADC1
+#undef PWR
+#undef RCC
+#undef SysTick
+#undef NVIC
+#undef SCB
+
+#define I2C1							(&g_hostI2C1.regs[0u])
+#define I2C2							(&g_hostI2C2.regs[0u])
+#define DMA1							(&g_hostDMA1.regs[0u])
+#define DMA1_Channel1					(&g_hostDMA1Channel.regs[0u])
+#define DMA1_Channel2					(&g_hostDMA1Channel.regs[1u])
+#define DMA1_Channel3					(&g_hostDMA1Channel.regs[2u])
+#define DMA1_Channel4					(&g_hostDMA1Channel.regs[3u])
+#define DMA1_Channel5					(&g_hostDMA1Channel.regs[4u])
+#define DMA1_Channel6					(&g_hostDMA1Channel.regs[5u])
+#define DMA1_Channel7					(&g_hostDMA1Channel.regs[6u])
+#define TIM3							(&g_hostTIM3.regs[0u])
+#define TIM6							(&g_hostTIM6.regs[0u])
+#define TIM14							(&g_hostTIM14.regs[0u])
+#define TIM15							(&g_hostTIM15.regs[0u])
+#define TIM16							(&g_hostTIM16.regs[0u])
+#define TIM17							(&g_hostTIM17.regs[0u])
+#define RTC								(&g_hostRTC.regs[0u])
+#define EXTI							(&g_hostEXTI.regs[0u])
+#define GPIOA							(&g_hostGPIO.regs[0u])
+#define GPIOB							(&g_hostGPIO.regs[1u])
+#define GPIOC							(&g_hostGPIO.regs[2u])
+#define GPIOD							(&g_hostGPIO.regs[3u])
+#define GPIOF							(&g_hostGPIO.regs[5u])
+#define ADC1							(&g_hostADC1.regs[0u])
+#define PWR								(&g_hostPWR.regs[0u])
+#define RCC								(&g_hostRCC.regs[0u])
+#define SysTick							(&g_hostSysTick.regs[0u])
+#define NVIC							(&g_hostNVIC.regs[0u])
+#define SCB								(&g_hostSCB.regs[0u])
+
+// ----------------------------------------------------------------------------
+// Simulated time and interrupts
+
+typedef enum
+{
+	HOST_IRQ_DEVICE = 0u,		/* Peripheral interrupt, pre-empts the osloop */
+	HOST_IRQ_OSLOOP,			/* Osloop timer, held off by OSLOOP_AtomicAccess */
+	HOST_IRQ_COUNT
+} HOST_Irq_t;
+
+extern volatile uint32_t g_hostTick;
+
+void HOST_SetIrqHandler(const HOST_Irq_t irq, void (*p_handler)(void));
+void HOST_RaiseIrq(const HOST_Irq_t irq);
+bool HOST_IrqPending(const HOST_Irq_t irq);
+void HOST_OsloopHold(const bool hold);
+
+void HOST_SetWfiHook(void (*p_hook)(void));
+
+bool HOST_TrapWrites(void * const p_periph, const uint32_t skip, void (*p_hook)(void));
+uint32_t HOST_TrapCount(void);
+bool HOST_InterruptAfter(const uint32_t instructions, void (*p_hook)(void));
+uint32_t HOST_CountInstructions(void (*p_fn)(void));
+
+// ----------------------------------------------------------------------------
+// Test reporting
+
+extern uint32_t g_hostChecks;
+extern uint32_t g_hostFailures;
+
+#define HOST_CHECK(cond)				HOST_Check((cond), #cond, __FILE__, __LINE__)
+
+void HOST_Check(const bool pass, const char * const p_text, const char * const p_file, const int line);
+int HOST_Report(const char * const p_name);
+
+#endif /* HOST_HW_H_ */
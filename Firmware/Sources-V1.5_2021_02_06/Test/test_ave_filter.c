@@ -0,0 +1,439 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file		test_ave_filter.c
+ * @date       	18 October 2026
+ * @brief       Step and impulse response of the boxcar, IIR and median+IIR
+ * 				average filters, U16 and S32. Checks the settle counts the adc
+ * 				uses for its calibration waits, the seeding after a reset, the
+ * 				element index the ready flag is taken from, the scaled total and
+ * 				the periodic update across a tick rollover, then prints the host
+ * 				time per update of each type.
+ *
+ */
+// ----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../Src/ave_filter.c"
+
+#define SIM_LOW							1000
+#define SIM_HIGH						2000
+#define SIM_SPIKE						4000
+#define SIM_BENCH_UPDATES				4000000u
+
+static const uint8_t m_types[] = { AVE_FILTER_TYPE_BOXCAR, AVE_FILTER_TYPE_IIR, AVE_FILTER_TYPE_MEDIAN_IIR };
+static const char * const m_typeNames[] = { "boxcar", "iir", "median+iir" };
+
+static uint16_t m_u16Elements[AVE_FILTER_ELEMENT_COUNT];
+static int32_t m_s32Elements[AVE_FILTER_ELEMENT_COUNT];
+
+
+// ----------------------------------------------------------------------------
+// Helpers
+
+static void U16Init(AVE_FILTER_U16_t * const p_filter, const uint8_t type, const uint8_t shift,
+						const uint16_t periodMs, const uint32_t sysTime)
+{
+	const AVE_FILTER_Config_t config = { periodMs, type, shift };
+
+	AVE_FILTER_U16_InitPeriodic(p_filter, sysTime, &config,
+			(AVE_FILTER_TYPE_BOXCAR == type) ? m_u16Elements : NULL);
+}
+
+static void S32Init(AVE_FILTER_S32_t * const p_filter, const uint8_t type, const uint8_t shift)
+{
+	const AVE_FILTER_Config_t config = { 1u, type, shift };
+
+	AVE_FILTER_S32_InitPeriodic(p_filter, 0u, &config,
+			(AVE_FILTER_TYPE_BOXCAR == type) ? m_s32Elements : NULL);
+}
+
+static void U16Run(AVE_FILTER_U16_t * const p_filter, const uint16_t value, const uint32_t count)
+{
+	uint32_t i;
+
+	for (i = 0u; i < count; i++)
+	{
+		AVE_FILTER_U16_Update(p_filter, value);
+	}
+}
+
+static void S32Run(AVE_FILTER_S32_t * const p_filter, const int32_t value, const uint32_t count)
+{
+	uint32_t i;
+
+	for (i = 0u; i < count; i++)
+	{
+		AVE_FILTER_S32_Update(p_filter, value);
+	}
+}
+
+static uint32_t Distance(const int32_t a, const int32_t b)
+{
+	return (uint32_t)abs(a - b);
+}
+
+
+// ----------------------------------------------------------------------------
+// Tests
+
+// A step from low to high has to rise without overshoot and be within 0.1% by
+// the settle count, and for the IIR types not long before it
+static void TestU16Step(const uint8_t type, const uint8_t shift)
+{
+	AVE_FILTER_U16_t filter;
+	const uint32_t tolerance = SIM_HIGH / 1000;
+	uint16_t settle;
+	uint16_t last;
+	uint32_t settledAt = 0u;
+	uint32_t i;
+
+	U16Init(&filter, type, shift, 1u, 0u);
+	AVE_FILTER_U16_Seed(&filter, SIM_LOW, 0u);
+
+	settle = AVE_FILTER_U16_GetSettleCount(&filter);
+	last = filter.average;
+
+	for (i = 1u; i <= (2u * settle); i++)
+	{
+		AVE_FILTER_U16_Update(&filter, SIM_HIGH);
+
+		HOST_CHECK(filter.average >= last);
+		HOST_CHECK(filter.average <= SIM_HIGH);
+		last = filter.average;
+
+		if ( (0u == settledAt) && (Distance(filter.average, SIM_HIGH) <= tolerance) )
+		{
+			settledAt = i;
+		}
+	}
+
+	HOST_CHECK(0u != settledAt);
+	HOST_CHECK(settledAt <= settle);
+
+	if (AVE_FILTER_TYPE_BOXCAR == type)
+	{
+		HOST_CHECK(AVE_FILTER_ELEMENT_COUNT == settledAt);
+	}
+	else if (shift >= 2u)
+	{
+		HOST_CHECK(settledAt > (settle / 2u));
+	}
+
+	HOST_CHECK(SIM_HIGH == filter.average);
+}
+
+// A single sample spike: the boxcar carries it for one buffer, the IIR decays
+// from a peak of the spike over 2^shift and the median drops it altogether.
+// Two in a row get through the median.
+static void TestU16Impulse(const uint8_t type, const uint8_t shift)
+{
+	AVE_FILTER_U16_t filter;
+	uint16_t settle;
+	uint16_t peak = 0u;
+	uint32_t i;
+
+	U16Init(&filter, type, shift, 1u, 0u);
+	AVE_FILTER_U16_Seed(&filter, SIM_HIGH, 0u);
+	settle = AVE_FILTER_U16_GetSettleCount(&filter);
+
+	AVE_FILTER_U16_Update(&filter, SIM_SPIKE);
+
+	for (i = 0u; i < settle; i++)
+	{
+		if (filter.average > peak)
+		{
+			peak = filter.average;
+		}
+
+		if (AVE_FILTER_TYPE_BOXCAR == type)
+		{
+			HOST_CHECK(filter.average == ((i < AVE_FILTER_ELEMENT_COUNT) ?
+					(SIM_HIGH + ((SIM_SPIKE - SIM_HIGH) / AVE_FILTER_ELEMENT_COUNT)) : SIM_HIGH));
+		}
+
+		AVE_FILTER_U16_Update(&filter, SIM_HIGH);
+	}
+
+	HOST_CHECK(Distance(filter.average, SIM_HIGH) <= 1u);
+
+	switch (type)
+	{
+	case AVE_FILTER_TYPE_IIR:
+		HOST_CHECK(Distance(peak, SIM_HIGH + ((SIM_SPIKE - SIM_HIGH) >> shift)) <= 1u);
+		break;
+
+	case AVE_FILTER_TYPE_MEDIAN_IIR:
+		HOST_CHECK(SIM_HIGH == peak);
+
+		U16Run(&filter, SIM_SPIKE, 2u);
+		HOST_CHECK(filter.average > SIM_HIGH);
+		break;
+
+	default:
+		break;
+	}
+}
+
+// The IIR types take the first sample after a reset as their state, the boxcar
+// fills from zero. Seed makes any type valid at once.
+static void TestU16Seeding(const uint8_t type)
+{
+	AVE_FILTER_U16_t filter;
+
+	U16Init(&filter, type, 4u, 1u, 0u);
+	HOST_CHECK(0u == filter.average);
+	HOST_CHECK(false == filter.seeded);
+
+	AVE_FILTER_U16_Update(&filter, SIM_HIGH);
+
+	HOST_CHECK(filter.average == ((AVE_FILTER_TYPE_BOXCAR == type) ? (SIM_HIGH / AVE_FILTER_ELEMENT_COUNT) : SIM_HIGH));
+	HOST_CHECK(SIM_HIGH == filter.lastVal);
+
+	AVE_FILTER_U16_Reset(&filter);
+	HOST_CHECK(0u == filter.average);
+	HOST_CHECK(0u == AVE_FILTER_U16_GetScaledTotal(&filter));
+
+	AVE_FILTER_U16_Seed(&filter, SIM_LOW, 0u);
+	HOST_CHECK(SIM_LOW == filter.average);
+	HOST_CHECK(0u == filter.nextValueIdx);
+	HOST_CHECK((SIM_LOW * AVE_FILTER_ELEMENT_COUNT) == AVE_FILTER_U16_GetScaledTotal(&filter));
+
+	AVE_FILTER_U16_Update(&filter, SIM_LOW);
+	HOST_CHECK(SIM_LOW == filter.average);
+}
+
+// The adc takes ready from the element index coming back round to zero, for
+// every type. The scaled total has the boxcar sum scale for every type, so the
+// oversampled difference keeps its extra bit whatever the type.
+static void TestU16Index(const uint8_t type)
+{
+	AVE_FILTER_U16_t filter;
+	uint32_t i;
+	uint32_t total;
+
+	U16Init(&filter, type, 3u, 1u, 0u);
+
+	for (i = 1u; i <= (3u * AVE_FILTER_ELEMENT_COUNT); i++)
+	{
+		AVE_FILTER_U16_Update(&filter, SIM_HIGH);
+		HOST_CHECK(filter.nextValueIdx == (i % AVE_FILTER_ELEMENT_COUNT));
+	}
+
+	U16Run(&filter, SIM_HIGH, AVE_FILTER_U16_GetSettleCount(&filter));
+	HOST_CHECK((SIM_HIGH * AVE_FILTER_ELEMENT_COUNT) == AVE_FILTER_U16_GetScaledTotal(&filter));
+
+	// Half way between two counts
+	AVE_FILTER_U16_Seed(&filter, SIM_HIGH, 0u);
+
+	for (i = 0u; i < (8u * AVE_FILTER_ELEMENT_COUNT); i++)
+	{
+		AVE_FILTER_U16_Update(&filter, SIM_HIGH + (i & 1u));
+	}
+
+	total = AVE_FILTER_U16_GetScaledTotal(&filter);
+	HOST_CHECK(Distance(total, (SIM_HIGH * AVE_FILTER_ELEMENT_COUNT) + (AVE_FILTER_ELEMENT_COUNT / 2u)) <= 1u);
+}
+
+// The period is measured with the wrapping tick difference
+static void TestU16Periodic(void)
+{
+	AVE_FILTER_U16_t filter;
+	uint32_t sysTime = 0xFFFFFFF0u;
+	uint32_t taken = 0u;
+	uint32_t i;
+
+	U16Init(&filter, AVE_FILTER_TYPE_BOXCAR, 0u, 10u, sysTime);
+
+	for (i = 0u; i < 100u; i++)
+	{
+		const uint8_t before = filter.nextValueIdx;
+
+		sysTime++;
+		AVE_FILTER_U16_UpdatePeriodic(&filter, SIM_HIGH, sysTime);
+
+		if (before != filter.nextValueIdx)
+		{
+			taken++;
+		}
+	}
+
+	HOST_CHECK(10u == taken);
+	HOST_CHECK(filter.lastFilterUpdateTime == (0xFFFFFFF0u + 100u));
+}
+
+// Boxcar without storage runs as IIR and the shift is limited
+static void TestConfig(void)
+{
+	AVE_FILTER_U16_t u16;
+	AVE_FILTER_S32_t s32;
+	const AVE_FILTER_Config_t config = { 1u, AVE_FILTER_TYPE_BOXCAR, 12u };
+
+	AVE_FILTER_U16_InitPeriodic(&u16, 0u, &config, NULL);
+	HOST_CHECK(AVE_FILTER_TYPE_IIR == u16.type);
+	HOST_CHECK(AVE_FILTER_IIR_SHIFT_MAX == u16.iirShift);
+	HOST_CHECK((7u << AVE_FILTER_IIR_SHIFT_MAX) == AVE_FILTER_U16_GetSettleCount(&u16));
+
+	AVE_FILTER_U16_Update(&u16, SIM_HIGH);
+	HOST_CHECK(SIM_HIGH == u16.average);
+
+	AVE_FILTER_S32_InitPeriodic(&s32, 0u, &config, NULL);
+	HOST_CHECK(AVE_FILTER_TYPE_IIR == s32.type);
+	HOST_CHECK(AVE_FILTER_IIR_SHIFT_MAX == s32.iirShift);
+
+	U16Init(&u16, AVE_FILTER_TYPE_MEDIAN_IIR, 2u, 1u, 0u);
+	HOST_CHECK(((7u << 2u) + (AVE_FILTER_MEDIAN_COUNT / 2u)) == AVE_FILTER_U16_GetSettleCount(&u16));
+
+	// Full scale doesn't overflow the U16 state
+	U16Init(&u16, AVE_FILTER_TYPE_IIR, 0u, 1u, 0u);
+	U16Run(&u16, 0xFFFFu, 4u);
+	HOST_CHECK(0xFFFFu == u16.average);
+	U16Run(&u16, 0u, 1u);
+	HOST_CHECK(0u == u16.average);
+}
+
+// Current sense is signed, a step through zero and a negative spike
+static void TestS32(const uint8_t type, const uint8_t shift)
+{
+	AVE_FILTER_S32_t filter;
+	uint16_t settle;
+	int32_t last;
+	int32_t low = 0;
+	uint32_t i;
+
+	S32Init(&filter, type, shift);
+	AVE_FILTER_S32_Seed(&filter, -SIM_HIGH, 0u);
+	HOST_CHECK(-SIM_HIGH == filter.average);
+
+	settle = AVE_FILTER_S32_GetSettleCount(&filter);
+	last = filter.average;
+
+	for (i = 0u; i < settle; i++)
+	{
+		AVE_FILTER_S32_Update(&filter, SIM_HIGH);
+		HOST_CHECK(filter.average >= last);
+		HOST_CHECK(filter.average <= SIM_HIGH);
+		last = filter.average;
+	}
+
+	HOST_CHECK(Distance(filter.average, SIM_HIGH) <= ((2 * SIM_HIGH) / 1000));
+
+	S32Run(&filter, SIM_HIGH, settle);
+	HOST_CHECK(SIM_HIGH == filter.average);
+
+	AVE_FILTER_S32_Update(&filter, -SIM_SPIKE);
+
+	for (i = 0u; i < settle; i++)
+	{
+		if (filter.average < low)
+		{
+			low = filter.average;
+		}
+
+		AVE_FILTER_S32_Update(&filter, SIM_HIGH);
+	}
+
+	if (AVE_FILTER_TYPE_MEDIAN_IIR == type)
+	{
+		HOST_CHECK(0 == low);
+	}
+
+	HOST_CHECK(Distance(filter.average, SIM_HIGH) <= 1u);
+
+	// IIR takes the first sample after a reset, also when negative
+	AVE_FILTER_S32_Reset(&filter);
+	AVE_FILTER_S32_Update(&filter, -SIM_LOW);
+	HOST_CHECK(filter.average == ((AVE_FILTER_TYPE_BOXCAR == type) ? (-SIM_LOW / (int32_t)AVE_FILTER_ELEMENT_COUNT) : -SIM_LOW));
+	HOST_CHECK(1u == filter.nextValueIdx);
+}
+
+
+// ----------------------------------------------------------------------------
+// Benchmark, host time per update. Only the ratios between types mean anything
+// for the M0.
+
+static double BenchNs(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return ((double)now.tv_sec * 1e9) + (double)now.tv_nsec;
+}
+
+static void Bench(void)
+{
+	AVE_FILTER_U16_t u16;
+	AVE_FILTER_S32_t s32;
+	volatile uint32_t sink = 0u;
+	double u16Ns[3u];
+	double s32Ns[3u];
+	double start;
+	uint32_t t;
+	uint32_t i;
+
+	for (t = 0u; t < 3u; t++)
+	{
+		U16Init(&u16, m_types[t], 3u, 1u, 0u);
+		start = BenchNs();
+
+		for (i = 0u; i < SIM_BENCH_UPDATES; i++)
+		{
+			AVE_FILTER_U16_Update(&u16, (uint16_t)(i & 0xFFFu));
+			sink += u16.average;
+		}
+
+		u16Ns[t] = (BenchNs() - start) / SIM_BENCH_UPDATES;
+
+		S32Init(&s32, m_types[t], 3u);
+		start = BenchNs();
+
+		for (i = 0u; i < SIM_BENCH_UPDATES; i++)
+		{
+			AVE_FILTER_S32_Update(&s32, (int32_t)(i & 0xFFFu) - 2048);
+			sink += (uint32_t)s32.average;
+		}
+
+		s32Ns[t] = (BenchNs() - start) / SIM_BENCH_UPDATES;
+	}
+
+	(void)sink;
+
+	for (t = 0u; t < 3u; t++)
+	{
+		printf("test_ave_filter: %-10s u16 %.1fns s32 %.1fns per update\n", m_typeNames[t], u16Ns[t], s32Ns[t]);
+	}
+
+	printf("test_ave_filter: filter size u16 %u s32 %u bytes, boxcar storage u16 %u s32 %u bytes\n",
+			(unsigned)sizeof(AVE_FILTER_U16_t), (unsigned)sizeof(AVE_FILTER_S32_t),
+			(unsigned)sizeof(m_u16Elements), (unsigned)sizeof(m_s32Elements));
+}
+
+
+int main(void)
+{
+	uint32_t t;
+	uint8_t shift;
+
+	for (t = 0u; t < 3u; t++)
+	{
+		for (shift = 0u; shift <= 6u; shift++)
+		{
+			TestU16Step(m_types[t], shift);
+			TestU16Impulse(m_types[t], shift);
+			TestS32(m_types[t], shift);
+		}
+
+		TestU16Seeding(m_types[t]);
+		TestU16Index(m_types[t]);
+	}
+
+	TestU16Periodic();
+	TestConfig();
+
+	Bench();
+
+	return HOST_Report("test_ave_filter");
+}
@@ -0,0 +1,615 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file		test_bist.c
+ * @date       	18 October 2026
+ * @brief       Production self test run against a simulated board. The 5V rail is
+ * 				a first order model behind the CS1 average filter as configured in
+ * 				system_conf.h, the load current calibration takes the time of its
+ * 				phases at the configured filter settings and the charger, fuel
+ * 				gauge and boost converter answer from the board state. Checks every
+ * 				pass and fail path, the result read back, abort and restart, and
+ * 				that the boost converter is put back. Then times the self test
+ * 				against the fixed waits the test jig made for the same checks.
+ *
+ */
+// ----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../Src/util.c"
+#include "../Src/ave_filter.c"
+#include "../Src/bist.c"
+
+#define SIM_RAIL_ON_MV					5100u
+#define SIM_RAIL_ON_TAU_MS				2u		/* Boost soft start */
+#define SIM_RAIL_OFF_TAU_MS				10u		/* Rail caps into the jig load */
+#define SIM_RUN_LIMIT_MS				120000u
+
+#define SIM_ALL_STEPS					((1u << BIST_STEP_COUNT) - 1u)
+#define SIM_JIG_STEPS					((1u << BIST_STEP_FAULTS) | (1u << BIST_STEP_BOOST_OFF) \
+											| (1u << BIST_STEP_BOOST_ON) | (1u << BIST_STEP_CHARGER))
+
+/* Test jig, pijuice_test_gui.py */
+#define SIM_JIG_POLL_MS					50u
+#define SIM_JIG_I2C_MS					2u		/* One command from python smbus */
+#define SIM_JIG_OLD_SETTLE_MS			1000u
+#define SIM_JIG_OLD_BOOST_MS			200u
+#define SIM_JIG_OLD_ISENSE_MS			400u
+
+typedef struct
+{
+	bool boostEnabled;
+	bool boostRefused;			/* Battery can't run the boost converter */
+	bool railHeld;				/* Something else powering the 5V rail */
+	bool fuelGaugeOnline;
+	uint8_t chargerFault;
+	ChargerStatus_T chargerStatus;
+	bool batteryPresent;
+	uint16_t socPt1;
+	uint32_t railUv;
+	uint32_t boostSets;
+} SIM_Board_t;
+
+typedef struct
+{
+	ISENSE_CalStatus_t status;
+	uint32_t startTime;
+	uint8_t attempts;
+	uint8_t aborts;
+	bool passOnAttempt[2u];
+	int16_t currentMa[2u];
+	int16_t loadCurrentMa;
+} SIM_Isense_t;
+
+static SIM_Board_t m_board;
+static SIM_Isense_t m_isense;
+static AVE_FILTER_U16_t m_railFilter;
+static uint32_t m_calMs;
+
+
+// ----------------------------------------------------------------------------
+// Stubs, answered from the board model
+
+uint32_t HAL_GetTick(void) { return g_hostTick; }
+
+uint8_t CHARGER_GetFaultStatus(void) { return m_board.chargerFault; }
+ChargerStatus_T CHARGER_GetStatus(void) { return m_board.chargerStatus; }
+bool CHARGER_IsBatteryPresent(void) { return m_board.batteryPresent; }
+bool FUELGAUGE_IsOnline(void) { return m_board.fuelGaugeOnline; }
+uint16_t FUELGAUGE_GetSocPt1(void) { return m_board.socPt1; }
+bool POWERSOURCE_IsBoostConverterEnabled(void) { return m_board.boostEnabled; }
+
+void POWERSOURCE_Set5vBoostEnable(const bool enabled)
+{
+	m_board.boostSets++;
+	m_board.boostEnabled = (true == enabled) && (false == m_board.boostRefused);
+}
+
+uint16_t ANALOG_Get5VRailMv(void)
+{
+	return m_railFilter.average;
+}
+
+bool ISENSE_StartCalibration(const ISENSE_CalMode_t mode)
+{
+	m_isense.status = ISENSE_CAL_STATUS_BUSY;
+	m_isense.startTime = g_hostTick;
+
+	return (ISENSE_CAL_MODE_LOAD == mode);
+}
+
+void ISENSE_AbortCalibration(void)
+{
+	if (ISENSE_CAL_STATUS_BUSY == m_isense.status)
+	{
+		m_isense.aborts++;
+		m_isense.status = ISENSE_CAL_STATUS_IDLE;
+	}
+}
+
+ISENSE_CalStatus_t ISENSE_GetCalibrationStatus(void) { return m_isense.status; }
+int16_t ISENSE_GetLoadCurrentMa(void) { return m_isense.loadCurrentMa; }
+
+
+// ----------------------------------------------------------------------------
+// Board model
+
+// Load calibration time at the configured filters, the same phases as
+// ISENSE_GetCalPhaseTimeMs with the boost converter and LDO already on
+static uint32_t SimCalibrationMs(void)
+{
+	AVE_FILTER_U16_t cs1;
+	AVE_FILTER_S32_t isense;
+	const AVE_FILTER_Config_t cs1Config = { FILTER_PERIOD_MS_CS1, FILTER_TYPE_CS1, FILTER_IIR_SHIFT_CS1 };
+	const AVE_FILTER_Config_t isenseConfig = { ISENSE_CAL_FILTER_PERIOD_MS, FILTER_TYPE_ISENSE, FILTER_IIR_SHIFT_ISENSE };
+	static int32_t isenseElements[AVE_FILTER_ELEMENT_COUNT];
+	static uint16_t cs1Elements[AVE_FILTER_ELEMENT_COUNT];
+
+	AVE_FILTER_U16_InitPeriodic(&cs1, 0u, &cs1Config, cs1Elements);
+	AVE_FILTER_S32_InitPeriodic(&isense, 0u, &isenseConfig, isenseElements);
+
+	return ((uint32_t)FILTER_PERIOD_MS_CS1 * AVE_FILTER_U16_GetSettleCount(&cs1))
+			+ ((uint32_t)ISENSE_CAL_FILTER_PERIOD_MS * AVE_FILTER_S32_GetSettleCount(&isense))
+			+ ISENSE_UPDATE_PERIOD;
+}
+
+static void SimReset(void)
+{
+	const AVE_FILTER_Config_t railConfig = { FILTER_PERIOD_MS_CS1, FILTER_TYPE_CS1, FILTER_IIR_SHIFT_CS1 };
+	static uint16_t railElements[AVE_FILTER_ELEMENT_COUNT];
+
+	memset(&m_board, 0, sizeof(m_board));
+	memset(&m_isense, 0, sizeof(m_isense));
+
+	m_board.boostEnabled = true;
+	m_board.fuelGaugeOnline = true;
+	m_board.chargerFault = CHG_FAULT_NORMAL;
+	m_board.chargerStatus = CHG_NO_VALID_SOURCE;
+	m_board.batteryPresent = true;
+	m_board.socPt1 = 523u;
+	m_board.railUv = SIM_RAIL_ON_MV * 1000u;
+
+	m_isense.passOnAttempt[0u] = true;
+	m_isense.currentMa[0u] = 51;
+	m_isense.currentMa[1u] = 51;
+
+	g_hostTick = 100000u;
+	AVE_FILTER_U16_InitPeriodic(&m_railFilter, g_hostTick, &railConfig, railElements);
+	AVE_FILTER_U16_Seed(&m_railFilter, SIM_RAIL_ON_MV, g_hostTick);
+
+	BIST_Init();
+}
+
+// A millisecond of the board and the taskman, which runs the tasks every osloop
+// while the self test is running
+static void SimTick(void)
+{
+	const uint32_t targetUv = ( (true == m_board.boostEnabled) || (true == m_board.railHeld) ) ? (SIM_RAIL_ON_MV * 1000u) : 0u;
+	const uint32_t tau = (targetUv > m_board.railUv) ? SIM_RAIL_ON_TAU_MS : SIM_RAIL_OFF_TAU_MS;
+
+	g_hostTick++;
+
+	if (targetUv > m_board.railUv)
+	{
+		m_board.railUv += (targetUv - m_board.railUv + tau - 1u) / tau;
+	}
+	else
+	{
+		m_board.railUv -= (m_board.railUv - targetUv + tau - 1u) / tau;
+	}
+
+	AVE_FILTER_U16_UpdatePeriodic(&m_railFilter, (uint16_t)(m_board.railUv / 1000u), g_hostTick);
+
+	if ( (ISENSE_CAL_STATUS_BUSY == m_isense.status) && MS_TIMEREF_TIMEOUT(m_isense.startTime, g_hostTick, m_calMs) )
+	{
+		const uint8_t attempt = (m_isense.attempts < 2u) ? m_isense.attempts : 1u;
+
+		m_isense.loadCurrentMa = m_isense.currentMa[attempt];
+		m_isense.status = (true == m_isense.passOnAttempt[attempt]) ? ISENSE_CAL_STATUS_PASS : ISENSE_CAL_STATUS_FAIL;
+		m_isense.attempts++;
+	}
+
+	BIST_Task();
+}
+
+static uint32_t SimStart(const uint8_t steps)
+{
+	const uint8_t command[] = { BIST_CMD_START, steps };
+
+	BIST_SetCommandData(command, sizeof(command));
+
+	return g_hostTick;
+}
+
+static uint32_t SimRun(void)
+{
+	const uint32_t start = g_hostTick;
+
+	while ( (true == BIST_IsRunning()) && (MS_TIMEREF_DIFF(start, g_hostTick) < SIM_RUN_LIMIT_MS) )
+	{
+		SimTick();
+	}
+
+	return MS_TIMEREF_DIFF(start, g_hostTick);
+}
+
+
+// ----------------------------------------------------------------------------
+// Result read back
+
+typedef struct
+{
+	uint8_t status;
+	uint8_t step;
+	uint8_t failCode;
+	uint8_t steps;
+	uint8_t boardFaults;
+	uint8_t chargeLevel;
+	uint8_t chargerStatus;
+	uint16_t railOffMv;
+	uint16_t railOnMv;
+	int16_t loadCurrentMa;
+	uint16_t stepMs[BIST_STEP_COUNT];
+	uint16_t totalMs;
+} SIM_Result_t;
+
+static SIM_Result_t SimRead(void)
+{
+	SIM_Result_t result;
+	uint8_t data[32u];
+	uint16_t len = 0u;
+	uint8_t i;
+
+	memset(data, 0xA5u, sizeof(data));
+	BIST_GetResultData(data, &len);
+	HOST_CHECK(BIST_READ_LEN == len);
+	HOST_CHECK(0xA5u == data[BIST_READ_LEN]);
+
+	result.status = data[0u];
+	result.step = data[1u];
+	result.failCode = data[2u];
+	result.steps = data[3u];
+	result.boardFaults = data[4u];
+	result.chargeLevel = data[5u];
+	result.chargerStatus = data[6u];
+	result.railOffMv = UTIL_FromBytes_U16(&data[7u]);
+	result.railOnMv = UTIL_FromBytes_U16(&data[9u]);
+	result.loadCurrentMa = (int16_t)UTIL_FromBytes_U16(&data[11u]);
+
+	for (i = 0u; i < BIST_STEP_COUNT; i++)
+	{
+		result.stepMs[i] = UTIL_FromBytes_U16(&data[13u + (i * 2u)]);
+	}
+
+	result.totalMs = UTIL_FromBytes_U16(&data[23u]);
+
+	return result;
+}
+
+static uint32_t Distance(const uint32_t a, const uint32_t b)
+{
+	return (a > b) ? (a - b) : (b - a);
+}
+
+static uint32_t SimStepTotal(const SIM_Result_t * const p_result)
+{
+	uint32_t total = 0u;
+	uint8_t i;
+
+	for (i = 0u; i < BIST_STEP_COUNT; i++)
+	{
+		total += p_result->stepMs[i];
+	}
+
+	return total;
+}
+
+static void CheckFail(const uint8_t step, const uint8_t failCode)
+{
+	const SIM_Result_t result = SimRead();
+
+	HOST_CHECK(BIST_STATUS_FAIL == result.status);
+	HOST_CHECK(step == result.step);
+	HOST_CHECK(failCode == result.failCode);
+	HOST_CHECK(result.totalMs == SimStepTotal(&result));
+	HOST_CHECK(false == BIST_IsRunning());
+}
+
+
+// ----------------------------------------------------------------------------
+// Tests
+
+static void TestPass(const bool boostWasOn)
+{
+	SIM_Result_t result;
+	uint32_t runMs;
+
+	SimReset();
+
+	if (false == boostWasOn)
+	{
+		POWERSOURCE_Set5vBoostEnable(false);
+
+		while (m_board.railUv > 0u)
+		{
+			SimTick();
+		}
+
+		AVE_FILTER_U16_Seed(&m_railFilter, 0u, g_hostTick);
+	}
+
+	SimStart(SIM_ALL_STEPS);
+	HOST_CHECK(true == BIST_IsRunning());
+	runMs = SimRun();
+
+	result = SimRead();
+	HOST_CHECK(BIST_STATUS_PASS == result.status);
+	HOST_CHECK(0u == result.failCode);
+	HOST_CHECK(SIM_ALL_STEPS == result.steps);
+	HOST_CHECK(0u == result.boardFaults);
+	HOST_CHECK(52u == result.chargeLevel);
+	HOST_CHECK(CHG_NO_VALID_SOURCE == result.chargerStatus);
+	HOST_CHECK(result.railOffMv < BIST_RAIL_OFF_MAX_MV);
+	HOST_CHECK( (result.railOnMv >= BIST_RAIL_ON_MIN_MV) && (result.railOnMv <= BIST_RAIL_ON_MAX_MV) );
+	HOST_CHECK(51 == result.loadCurrentMa);
+
+	// Each step starts where the last one finished
+	HOST_CHECK(result.totalMs == SimStepTotal(&result));
+	HOST_CHECK(Distance(result.totalMs, runMs) <= 1u);
+
+	// Steps that don't wait finish on the next task run
+	HOST_CHECK(1u == result.stepMs[BIST_STEP_FAULTS]);
+	HOST_CHECK(1u == result.stepMs[BIST_STEP_CHARGER]);
+	HOST_CHECK( (result.stepMs[BIST_STEP_BOOST_OFF] > 0u) && (result.stepMs[BIST_STEP_BOOST_OFF] < BIST_BOOST_TIMEOUT_MS) );
+	HOST_CHECK( (result.stepMs[BIST_STEP_BOOST_ON] > 0u) && (result.stepMs[BIST_STEP_BOOST_ON] < BIST_BOOST_TIMEOUT_MS) );
+	HOST_CHECK(Distance(result.stepMs[BIST_STEP_ISENSE], m_calMs) <= 2u);
+	HOST_CHECK(1u == m_isense.attempts);
+
+	// Boost converter as it was found
+	HOST_CHECK(boostWasOn == m_board.boostEnabled);
+
+	// Reading again gives the same and nothing runs
+	SimTick();
+	HOST_CHECK(result.totalMs == SimRead().totalMs);
+}
+
+static void TestBoardFaults(void)
+{
+	SimReset();
+	m_board.chargerFault = CHG_FAULT_WATCHDOG_TIMER_EXPIRED;
+	SimStart(SIM_ALL_STEPS);
+	SimRun();
+	CheckFail(BIST_STEP_FAULTS, BIST_FAIL_BOARD_FAULT);
+	HOST_CHECK((CHG_FAULT_WATCHDOG_TIMER_EXPIRED << 1u) == SimRead().boardFaults);
+	HOST_CHECK(0u == m_board.boostSets);
+
+	SimReset();
+	m_board.fuelGaugeOnline = false;
+	SimStart(SIM_ALL_STEPS);
+	SimRun();
+	CheckFail(BIST_STEP_FAULTS, BIST_FAIL_BOARD_FAULT);
+	HOST_CHECK(0x10u == SimRead().boardFaults);
+
+	SimReset();
+	m_board.socPt1 = 4u;
+	SimStart(SIM_ALL_STEPS);
+	SimRun();
+	CheckFail(BIST_STEP_FAULTS, BIST_FAIL_CHARGE_LEVEL);
+	HOST_CHECK(0u == SimRead().chargeLevel);
+
+	SimReset();
+	m_board.socPt1 = 995u;
+	SimStart(SIM_ALL_STEPS);
+	SimRun();
+	CheckFail(BIST_STEP_FAULTS, BIST_FAIL_CHARGE_LEVEL);
+	HOST_CHECK(100u == SimRead().chargeLevel);
+}
+
+static void TestBoost(void)
+{
+	SIM_Result_t result;
+
+	// 5V rail fed from elsewhere, never drops
+	SimReset();
+	m_board.railHeld = true;
+	SimStart(SIM_ALL_STEPS);
+	SimRun();
+	CheckFail(BIST_STEP_BOOST_OFF, BIST_FAIL_RAIL_TIMEOUT);
+	result = SimRead();
+	HOST_CHECK(result.stepMs[BIST_STEP_BOOST_OFF] == (BIST_BOOST_TIMEOUT_MS + 1u));
+	HOST_CHECK(result.railOffMv >= BIST_RAIL_OFF_MAX_MV);
+	HOST_CHECK(true == m_board.boostEnabled);
+
+	// Battery won't run the boost converter, found off so left off
+	SimReset();
+	m_board.boostRefused = true;
+	SimStart(SIM_ALL_STEPS);
+	SimRun();
+	CheckFail(BIST_STEP_BOOST_ON, BIST_FAIL_BOOST_REFUSED);
+	HOST_CHECK(1u == SimRead().stepMs[BIST_STEP_BOOST_ON]);
+	HOST_CHECK(false == m_board.boostEnabled);
+}
+
+static void TestCharger(void)
+{
+	const uint8_t chargerOnly = (1u << BIST_STEP_CHARGER);
+
+	SimReset();
+	m_board.batteryPresent = false;
+	SimStart(SIM_ALL_STEPS);
+	SimRun();
+	CheckFail(BIST_STEP_CHARGER, BIST_FAIL_NO_BATTERY);
+
+	SimReset();
+	m_board.chargerStatus = CHG_FAULT;
+	SimStart(SIM_ALL_STEPS);
+	SimRun();
+	CheckFail(BIST_STEP_CHARGER, BIST_FAIL_CHARGER_STATUS);
+	HOST_CHECK(CHG_FAULT == SimRead().chargerStatus);
+
+	// Without the board fault step the charger step sees the fault
+	SimReset();
+	m_board.chargerFault = CHG_FAULT_THERMAL_SHUTDOWN;
+	SimStart(chargerOnly);
+	SimRun();
+	CheckFail(BIST_STEP_CHARGER, BIST_FAIL_CHARGER_FAULT);
+	HOST_CHECK(0u == m_board.boostSets);
+
+	// Only the selected step runs
+	SimReset();
+	m_board.chargerStatus = CHG_CHARGING_FROM_IN;
+	SimStart(chargerOnly | 0x80u);
+	HOST_CHECK(chargerOnly == SimRead().steps);
+	SimRun();
+	HOST_CHECK(BIST_STATUS_PASS == SimRead().status);
+	HOST_CHECK(0u == m_board.boostSets);
+	HOST_CHECK(0u == m_isense.attempts);
+}
+
+static void TestIsense(void)
+{
+	const uint8_t isenseOnly = (1u << BIST_STEP_ISENSE);
+	SIM_Result_t result;
+
+	// Second try passes, the same as the jig used to
+	SimReset();
+	m_isense.passOnAttempt[0u] = false;
+	m_isense.passOnAttempt[1u] = true;
+	m_isense.currentMa[0u] = 70;
+	SimStart(isenseOnly);
+	SimRun();
+	result = SimRead();
+	HOST_CHECK(BIST_STATUS_PASS == result.status);
+	HOST_CHECK(2u == m_isense.attempts);
+	HOST_CHECK(51 == result.loadCurrentMa);
+	HOST_CHECK(Distance(result.stepMs[BIST_STEP_ISENSE], 2u * m_calMs) <= 4u);
+
+	// Both fail, the last reading is reported
+	SimReset();
+	m_isense.currentMa[0u] = 70;
+	m_isense.currentMa[1u] = 38;
+	m_isense.passOnAttempt[0u] = false;
+	SimStart(isenseOnly);
+	SimRun();
+	CheckFail(BIST_STEP_ISENSE, BIST_FAIL_LOAD_CURRENT);
+	HOST_CHECK(38 == SimRead().loadCurrentMa);
+	HOST_CHECK(2u == m_isense.attempts);
+}
+
+static void TestCommands(void)
+{
+	const uint8_t abort[] = { BIST_CMD_ABORT };
+	const uint8_t shortStart[] = { BIST_CMD_START };
+	const uint8_t unknown[] = { 0x42u, SIM_ALL_STEPS };
+	uint32_t i;
+
+	// Ignored
+	SimReset();
+	BIST_SetCommandData(shortStart, 0u);
+	BIST_SetCommandData(shortStart, sizeof(shortStart));
+	BIST_SetCommandData(unknown, sizeof(unknown));
+	BIST_SetCommandData(abort, sizeof(abort));
+	HOST_CHECK(BIST_STATUS_IDLE == SimRead().status);
+	HOST_CHECK(false == BIST_IsRunning());
+
+	// Abort in the middle of the calibration, after the boost steps
+	SimReset();
+	m_board.boostEnabled = false;
+	SimStart(SIM_ALL_STEPS);
+
+	for (i = 0u; (i < SIM_RUN_LIMIT_MS) && (ISENSE_CAL_STATUS_BUSY != m_isense.status); i++)
+	{
+		SimTick();
+	}
+
+	for (i = 0u; i < 1000u; i++)
+	{
+		SimTick();
+	}
+
+	HOST_CHECK(true == m_board.boostEnabled);
+	BIST_SetCommandData(abort, sizeof(abort));
+	HOST_CHECK(BIST_STATUS_IDLE == SimRead().status);
+	HOST_CHECK(BIST_STEP_ISENSE == SimRead().step);
+	HOST_CHECK(1u == m_isense.aborts);
+	HOST_CHECK(false == m_board.boostEnabled);
+
+	// Restart in the calibration stops it and starts over, the boost converter
+	// state from the first start is kept
+	SimReset();
+	m_board.boostEnabled = false;
+	SimStart(SIM_ALL_STEPS);
+
+	while (ISENSE_CAL_STATUS_BUSY != m_isense.status)
+	{
+		SimTick();
+	}
+
+	SimStart(SIM_ALL_STEPS);
+	HOST_CHECK(1u == m_isense.aborts);
+	HOST_CHECK(BIST_STEP_FAULTS == SimRead().step);
+	HOST_CHECK(0u == SimRead().railOnMv);
+	SimRun();
+	HOST_CHECK(BIST_STATUS_PASS == SimRead().status);
+	HOST_CHECK(false == m_board.boostEnabled);
+}
+
+
+// ----------------------------------------------------------------------------
+// Time against the fixed waits of the jig. The old jig waited 1 s before reading
+// the faults and charge level, 200 mS after each boost converter change and
+// 400 mS after each calibration command, the calibration itself blocked the
+// firmware for 16 filter periods of CS1 and 16 s. The jig now starts the self
+// test and polls it every 50 mS.
+
+static uint32_t JigPolled(const uint32_t bistMs)
+{
+	const uint32_t pollMs = SIM_JIG_POLL_MS + SIM_JIG_I2C_MS;
+
+	return SIM_JIG_I2C_MS + (((bistMs + pollMs - 1u) / pollMs) * pollMs);
+}
+
+static void TestJigTime(void)
+{
+	const uint32_t oldCalMs = ((uint32_t)FILTER_PERIOD_MS_CS1 * AVE_FILTER_ELEMENT_COUNT) + (1000u * AVE_FILTER_ELEMENT_COUNT);
+	uint32_t oldChecks;
+	uint32_t oldIsense;
+	uint32_t newChecks;
+	uint32_t newIsense;
+	uint32_t checksMs;
+	uint32_t isenseMs;
+	uint8_t retry;
+
+	for (retry = 0u; retry < 2u; retry++)
+	{
+		SimReset();
+		m_isense.passOnAttempt[0u] = (0u == retry);
+		m_isense.passOnAttempt[1u] = true;
+
+		SimStart(SIM_JIG_STEPS);
+		checksMs = SimRun();
+		HOST_CHECK(BIST_STATUS_PASS == SimRead().status);
+
+		SimStart(1u << BIST_STEP_ISENSE);
+		isenseMs = SimRun();
+		HOST_CHECK(BIST_STATUS_PASS == SimRead().status);
+
+		// Faults, charge level, boost off read, boost on read
+		oldChecks = SIM_JIG_OLD_SETTLE_MS + (2u * SIM_JIG_I2C_MS)
+					+ SIM_JIG_I2C_MS + SIM_JIG_OLD_BOOST_MS + SIM_JIG_I2C_MS
+					+ SIM_JIG_OLD_BOOST_MS + SIM_JIG_I2C_MS;
+		oldIsense = (1u + retry) * (SIM_JIG_I2C_MS + oldCalMs + SIM_JIG_OLD_ISENSE_MS + SIM_JIG_I2C_MS);
+
+		newChecks = JigPolled(checksMs);
+		newIsense = JigPolled(isenseMs);
+
+		// The calibration is mostly the 16 s current sense filter either way
+		HOST_CHECK((newChecks + SIM_JIG_OLD_SETTLE_MS) < oldChecks);
+		HOST_CHECK(Distance(newIsense, oldIsense) < ((retry + 1u) * 2u * SIM_JIG_POLL_MS));
+		HOST_CHECK((newChecks + newIsense + SIM_JIG_OLD_SETTLE_MS / 2u) < (oldChecks + oldIsense));
+
+		printf("test_bist: %s, checks %ums (jig %ums, was %ums), calibration %ums (jig %ums, was %ums), saved %dms\n",
+				(0u == retry) ? "first time" : "calibration retried",
+				(unsigned)checksMs, (unsigned)newChecks, (unsigned)oldChecks,
+				(unsigned)isenseMs, (unsigned)newIsense, (unsigned)oldIsense,
+				(int)(oldChecks + oldIsense) - (int)(newChecks + newIsense));
+	}
+}
+
+
+int main(void)
+{
+	m_calMs = SimCalibrationMs();
+
+	TestPass(true);
+	TestPass(false);
+	TestBoardFaults();
+	TestBoost();
+	TestCharger();
+	TestIsense();
+	TestCommands();
+	TestJigTime();
+
+	return HOST_Report("test_bist");
+}
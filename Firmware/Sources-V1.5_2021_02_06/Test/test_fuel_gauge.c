@@ -0,0 +1,638 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file		test_fuel_gauge.c
+ * @date       	18 October 2026
+ * @brief       Fuel gauge transfers against a stand in i2c driver and LC709203F
+ * 				register file, with a nack, a timeout or a bad crc injected on
+ * 				any chosen transfer. The ic init at startup, the background init
+ * 				and the periodic reads are taken through each failure: bounded
+ * 				waits, previous readings kept, recovery on a later pass, transfers
+ * 				lost to a driver restart, and never more than one driver poll per
+ * 				task pass.
+ *
+ */
+// ----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../Src/util.c"
+#include "../Src/crc.c"
+#include "../Src/fuel_gauge_lc709203f.c"
+
+#define SIM_QUEUE_SLOTS					(I2CDRV_QUEUE_LENGTH - 1u)
+#define SIM_TRANSACT_MS					1u		/* Three word transfer at 100kHz */
+#define SIM_FATE_SLOTS					64u
+#define SIM_REG_COUNT					0x20u
+
+#define SIM_IC_ID						0x1234u
+#define SIM_CELL_MV						3850u
+#define SIM_CELL_TEMP					(CELL_TEMP_OFS + 250u)
+#define SIM_ITE							800u
+#define SIM_NTC_B						0x0D34u
+
+typedef enum
+{
+	SIM_FATE_DEFAULT = 0u,
+	SIM_FATE_ACK = 1u,
+	SIM_FATE_NACK = 2u,
+	SIM_FATE_TIMEOUT = 3u,			/* Bus held, the driver times it out */
+	SIM_FATE_BAD_CRC = 4u,
+	SIM_FATE_STUCK = 5u				/* Never finishes, only a driver restart clears it */
+} SIM_Fate_t;
+
+typedef struct
+{
+	uint8_t data[4u];
+	I2CDRV_TransactionType_t transactType;
+	I2CDRV_EventCb_t callback;
+	uint16_t timeout;
+	uint32_t startTime;
+	SIM_Fate_t fate;
+} SIM_Transact_t;
+
+typedef struct
+{
+	uint16_t regs[SIM_REG_COUNT];
+	uint32_t writes[SIM_REG_COUNT];
+	SIM_Transact_t queue[SIM_QUEUE_SLOTS];
+	uint8_t tail;
+	uint8_t count;
+	SIM_Fate_t fates[SIM_FATE_SLOTS];
+	SIM_Fate_t defaultFate;
+	uint32_t transacts;
+	uint32_t refused;
+	uint32_t badWrites;
+	uint32_t readyCalls;
+	uint32_t maxReadyCalls;			/* Most driver polls in one task pass */
+	bool clockInReady;				/* Systick running while FUELGAUGE_Init waits */
+	uint16_t batteryMv;
+} SIM_Gauge_t;
+
+static SIM_Gauge_t m_gauge;
+static BatteryProfile_T m_profile;
+static I2CDRV_Device_t m_device;
+
+
+// ----------------------------------------------------------------------------
+// Stubs
+
+EXECUTION_State_t executionState = EXECUTION_STATE_NORMAL;
+
+uint32_t HAL_GetTick(void) { return g_hostTick; }
+
+uint16_t ANALOG_GetBatteryMv(void) { return m_gauge.batteryMv; }
+int16_t ANALOG_GetMCUTemp(void) { return 25; }
+const BatteryProfile_T * BATTERY_GetActiveProfileHandle(void) { return &m_profile; }
+uint16_t NvReadVariableU8(uint16_t VirtAddress, uint8_t *pVar) { return 1u; }
+bool NV_WriteVariable_U8(const uint16_t address, const uint8_t var) { return true; }
+void OSLOOP_AtomicAccess(const bool atomic) { }
+
+
+// ----------------------------------------------------------------------------
+// I2C driver and fuel gauge model, the transfers are run in order one at a time
+// and each takes the fate set for it when it was queued
+
+static SIM_Fate_t SimTakeFate(void)
+{
+	const uint8_t slot = m_gauge.transacts % SIM_FATE_SLOTS;
+	const SIM_Fate_t fate = m_gauge.fates[slot];
+
+	m_gauge.fates[slot] = SIM_FATE_DEFAULT;
+	m_gauge.transacts++;
+
+	return (SIM_FATE_DEFAULT == fate) ? m_gauge.defaultFate : fate;
+}
+
+bool I2CDRV_Transact(const uint8_t deviceIdx, const uint8_t addr,
+					const uint8_t * const p_data, const uint8_t len,
+					I2CDRV_TransactionType_t transactType, const I2CDRV_EventCb_t callback,
+					const uint16_t timeout, const uint32_t sysTime)
+{
+	SIM_Transact_t * p_transact;
+
+	HOST_CHECK(FUELGAUGE_I2C_PORTNO == deviceIdx);
+	HOST_CHECK(FUELGAUGE_I2C_ADDR == addr);
+
+	if (m_gauge.count >= SIM_QUEUE_SLOTS)
+	{
+		m_gauge.refused++;
+
+		return false;
+	}
+
+	p_transact = &m_gauge.queue[(m_gauge.tail + m_gauge.count) % SIM_QUEUE_SLOTS];
+
+	memset(p_transact, 0, sizeof(SIM_Transact_t));
+	memcpy(p_transact->data, p_data, (I2CDRV_TRANSACTION_TX == transactType) ? len : 1u);
+	HOST_CHECK(((I2CDRV_TRANSACTION_TX == transactType) ? 4u : 3u) == len);
+
+	p_transact->transactType = transactType;
+	p_transact->callback = callback;
+	p_transact->timeout = timeout;
+	p_transact->startTime = g_hostTick;
+	p_transact->fate = SimTakeFate();
+
+	m_gauge.count++;
+
+	return true;
+}
+
+static void SimComplete(const I2CDRV_Device_Event_t event)
+{
+	const SIM_Transact_t transact = m_gauge.queue[m_gauge.tail];
+
+	m_gauge.tail = (m_gauge.tail + 1u) % SIM_QUEUE_SLOTS;
+	m_gauge.count--;
+
+	if (m_gauge.count > 0u)
+	{
+		m_gauge.queue[m_gauge.tail].startTime = g_hostTick;
+	}
+
+	m_device.event = event;
+	transact.callback(&m_device);
+}
+
+// One ms of the bus, the head transfer finishes or times out
+static void SimBus(void)
+{
+	const SIM_Transact_t * p_transact = &m_gauge.queue[m_gauge.tail];
+	const bool tx = (I2CDRV_TRANSACTION_TX == p_transact->transactType);
+	const uint8_t reg = p_transact->data[0u] % SIM_REG_COUNT;
+	crc_t crc;
+
+	if (0u == m_gauge.count)
+	{
+		return;
+	}
+
+	if (SIM_FATE_STUCK == p_transact->fate)
+	{
+		return;
+	}
+
+	if (SIM_FATE_TIMEOUT == p_transact->fate)
+	{
+		if (MS_TIMEREF_TIMEOUT(p_transact->startTime, g_hostTick, p_transact->timeout))
+		{
+			SimComplete(tx ? I2CDRV_EVENT_TX_FAILED : I2CDRV_EVENT_RX_FAILED);
+		}
+
+		return;
+	}
+
+	if (false == MS_TIMEREF_TIMEOUT(p_transact->startTime, g_hostTick, SIM_TRANSACT_MS))
+	{
+		return;
+	}
+
+	if (SIM_FATE_NACK == p_transact->fate)
+	{
+		SimComplete(tx ? I2CDRV_EVENT_TX_FAILED : I2CDRV_EVENT_RX_FAILED);
+	}
+	else if (true == tx)
+	{
+		// The ic nacks a write with a bad crc
+		crc = crc_8_update(crc_8_init(FUELGAUGE_I2C_ADDR), p_transact->data, 3u);
+
+		if (crc == p_transact->data[3u])
+		{
+			m_gauge.regs[reg] = (uint16_t)p_transact->data[1u] | ((uint16_t)p_transact->data[2u] << 8u);
+			m_gauge.writes[reg]++;
+
+			SimComplete(I2CDRV_EVENT_TX_COMPLETE);
+		}
+		else
+		{
+			m_gauge.badWrites++;
+
+			SimComplete(I2CDRV_EVENT_TX_FAILED);
+		}
+	}
+	else
+	{
+		m_device.data[0u] = p_transact->data[0u];
+		m_device.data[1u] = FUELGAUGE_I2C_ADDR | 1u;
+		m_device.data[2u] = (uint8_t)(m_gauge.regs[reg] & 0xFFu);
+		m_device.data[3u] = (uint8_t)(m_gauge.regs[reg] >> 8u);
+		m_device.data[4u] = crc_8_update(crc_8_init(FUELGAUGE_I2C_ADDR), m_device.data, 4u);
+
+		if (SIM_FATE_BAD_CRC == p_transact->fate)
+		{
+			m_device.data[4u] ^= 0x01u;
+		}
+
+		SimComplete(I2CDRV_EVENT_RX_COMPLETE);
+	}
+}
+
+bool I2CDRV_IsReady(uint8_t devIdx)
+{
+	m_gauge.readyCalls++;
+
+	if (true == m_gauge.clockInReady)
+	{
+		g_hostTick++;
+		SimBus();
+	}
+
+	return 0u == m_gauge.count;
+}
+
+// The driver restart after a stop empties the queue without any callbacks
+static void SimDriverRestart(void)
+{
+	m_gauge.count = 0u;
+}
+
+static void SimInject(const uint32_t transfer, const SIM_Fate_t fate)
+{
+	m_gauge.fates[(m_gauge.transacts + transfer) % SIM_FATE_SLOTS] = fate;
+}
+
+
+// ----------------------------------------------------------------------------
+// Board
+
+static void SimReset(void)
+{
+	memset(&m_gauge, 0, sizeof(m_gauge));
+	memset(&m_profile, 0, sizeof(m_profile));
+
+	m_gauge.defaultFate = SIM_FATE_ACK;
+	m_gauge.batteryMv = 3900u;
+	m_gauge.regs[FG_MEM_ADDR_IC_VERSION] = SIM_IC_ID;
+	m_gauge.regs[FG_MEM_ADDR_CELL_MV] = SIM_CELL_MV;
+	m_gauge.regs[FG_MEM_ADDR_CELL_TEMP] = SIM_CELL_TEMP;
+	m_gauge.regs[FG_MEM_ADDR_ITE] = SIM_ITE;
+
+	m_profile.chemistry = BAT_CHEMISTRY_LIPO;
+	m_profile.capacity = 1000u;
+	m_profile.regulationVoltage = 210u;
+	m_profile.cutoffVoltage = 150u;
+	m_profile.ocv10 = 0xFFFFu;
+	m_profile.ocv50 = 0xFFFFu;
+	m_profile.ocv90 = 0xFFFFu;
+	m_profile.r10 = 0xFFFFu;
+	m_profile.r50 = 0xFFFFu;
+	m_profile.r90 = 0xFFFFu;
+	m_profile.ntcB = SIM_NTC_B;
+
+	m_transferCount = 0u;
+	m_transferDoneCount = 0u;
+	m_updateBatteryProfile = false;
+	m_batteryTemperaturePt1 = 0;
+
+	g_hostTick = 50000u;
+}
+
+// FUELGAUGE_Init waits on the driver, the systick moves on while it does
+static uint32_t SimInit(void)
+{
+	const uint32_t start = g_hostTick;
+
+	m_gauge.clockInReady = true;
+	FUELGAUGE_Init();
+	m_gauge.clockInReady = false;
+
+	return MS_TIMEREF_DIFF(start, g_hostTick);
+}
+
+// The osloop every ms, bus first then the task
+static void SimRun(const uint32_t ms)
+{
+	uint32_t readyCalls;
+	uint32_t i;
+
+	for (i = 0u; i < ms; i++)
+	{
+		g_hostTick++;
+		SimBus();
+
+		readyCalls = m_gauge.readyCalls;
+		FUELGAUGE_Task();
+		readyCalls = m_gauge.readyCalls - readyCalls;
+
+		if (readyCalls > m_gauge.maxReadyCalls)
+		{
+			m_gauge.maxReadyCalls = readyCalls;
+		}
+	}
+}
+
+static uint32_t SimRunUntilIdle(const uint32_t limitMs)
+{
+	const uint32_t start = g_hostTick;
+
+	do
+	{
+		SimRun(1u);
+	} while ( (true == FUELGAUGE_IsBusy()) && (MS_TIMEREF_DIFF(start, g_hostTick) < limitMs) );
+
+	return MS_TIMEREF_DIFF(start, g_hostTick);
+}
+
+static void CheckIcSetUp(void)
+{
+	HOST_CHECK(SIM_IC_ID == FUELGAUGE_GetIcId());
+	HOST_CHECK(POWER_MODE_OPERATIONAL == m_gauge.regs[FG_MEM_ADDR_POWER_MODE]);
+	HOST_CHECK(0x36u == m_gauge.regs[FG_MEM_ADDR_APA]);
+	HOST_CHECK(BATT_PROFILE_1 == m_gauge.regs[FG_MEM_ADDR_PARAM_NO_SET]);
+	HOST_CHECK(0x3000u == m_gauge.regs[FG_MEM_ADDR_APT]);
+	HOST_CHECK(SIM_NTC_B == m_gauge.regs[FG_MEM_ADDR_THERMB]);
+	HOST_CHECK(THERM_TYPE_NTC == m_gauge.regs[FG_MEM_ADDR_THERM_TYPE]);
+	HOST_CHECK(0u == m_gauge.badWrites);
+}
+
+
+// ----------------------------------------------------------------------------
+// Tests
+
+static void TestInit(void)
+{
+	uint32_t initMs;
+
+	SimReset();
+	initMs = SimInit();
+
+	HOST_CHECK(true == FUELGAUGE_IsOnline());
+	HOST_CHECK(false == FUELGAUGE_IsBusy());
+	CheckIcSetUp();
+	HOST_CHECK(1u == m_gauge.writes[FG_MEM_ADDR_POWER_MODE]);
+	HOST_CHECK(SIM_ITE == FUELGAUGE_GetSocPt1());
+	HOST_CHECK(SIM_CELL_MV == FUELGAUGE_GetBatteryMv());
+
+	// Seven init steps, then the soc and cell voltage back to back
+	HOST_CHECK(9u == m_gauge.transacts);
+	HOST_CHECK(initMs <= 10u);
+
+	// First update on the next period, the three reads queued in one go
+	SimRun(FUELGAUGE_TASK_PERIOD_MS + 5u);
+	HOST_CHECK(12u == m_gauge.transacts);
+	HOST_CHECK(0u == m_gauge.refused);
+	HOST_CHECK(25 == FUELGAUGE_GetBatteryTemperature());
+	HOST_CHECK(1u == m_gauge.maxReadyCalls);
+
+	printf("Init %lu ms, %lu transfers\n", (unsigned long)initMs, 9ul);
+}
+
+// A nack at each step of the init at startup stops it there, the task brings
+// the ic up on its first period
+static void TestInitNack(void)
+{
+	uint32_t step;
+	uint32_t initMs;
+
+	for (step = 0u; step < 7u; step++)
+	{
+		SimReset();
+		SimInject(step, SIM_FATE_NACK);
+		initMs = SimInit();
+
+		HOST_CHECK(false == FUELGAUGE_IsOnline());
+		HOST_CHECK( (step + 1u) == m_gauge.transacts);
+		HOST_CHECK(initMs <= (step + 2u));
+		HOST_CHECK(0u == FUELGAUGE_GetBatteryMv());
+		HOST_CHECK(0u == FUELGAUGE_GetSocPt1());
+
+		if (0u == step)
+		{
+			HOST_CHECK(0u == FUELGAUGE_GetIcId());
+		}
+
+		SimRun(FUELGAUGE_TASK_PERIOD_MS);
+		HOST_CHECK(true == FUELGAUGE_IsBusy());
+		SimRunUntilIdle(100u);
+
+		HOST_CHECK(true == FUELGAUGE_IsOnline());
+		HOST_CHECK(SIM_CELL_MV == FUELGAUGE_GetBatteryMv());
+		HOST_CHECK(SIM_ITE == FUELGAUGE_GetSocPt1());
+		CheckIcSetUp();
+		HOST_CHECK(1u == m_gauge.writes[FG_MEM_ADDR_THERM_TYPE]);
+		HOST_CHECK(1u == m_gauge.maxReadyCalls);
+	}
+}
+
+// A held bus at startup waits out the driver timeout and no more
+static void TestInitTimeout(void)
+{
+	uint32_t initMs;
+
+	SimReset();
+	SimInject(2u, SIM_FATE_TIMEOUT);
+	initMs = SimInit();
+
+	HOST_CHECK(false == FUELGAUGE_IsOnline());
+	HOST_CHECK(3u == m_gauge.transacts);
+	HOST_CHECK( (initMs >= FUELGAUGE_I2C_TIMEOUT_MS) && (initMs <= (FUELGAUGE_I2C_TIMEOUT_MS + 5u)) );
+
+	// The first soc and voltage reads time out after a good init
+	SimReset();
+	SimInject(7u, SIM_FATE_TIMEOUT);
+	initMs = SimInit();
+
+	HOST_CHECK(true == FUELGAUGE_IsOnline());
+	HOST_CHECK(0u == FUELGAUGE_GetSocPt1());
+	HOST_CHECK(SIM_CELL_MV == FUELGAUGE_GetBatteryMv());
+	HOST_CHECK( (initMs >= FUELGAUGE_I2C_TIMEOUT_MS) && (initMs <= (FUELGAUGE_I2C_TIMEOUT_MS + 20u)) );
+
+	printf("Init with a held bus %lu ms\n", (unsigned long)initMs);
+}
+
+// The background init waits on a timeout a pass at a time
+static void TestTaskTimeout(void)
+{
+	uint32_t busyMs;
+
+	SimReset();
+	SimInject(0u, SIM_FATE_NACK);
+	SimInit();
+
+	// The APA write of the task's init
+	SimInject(2u, SIM_FATE_TIMEOUT);
+	SimRun(FUELGAUGE_TASK_PERIOD_MS);
+	HOST_CHECK(true == FUELGAUGE_IsBusy());
+	busyMs = SimRunUntilIdle(2u * FUELGAUGE_I2C_TIMEOUT_MS);
+
+	HOST_CHECK( (busyMs >= (FUELGAUGE_I2C_TIMEOUT_MS - 10u)) && (busyMs <= (FUELGAUGE_I2C_TIMEOUT_MS + 10u)) );
+	HOST_CHECK(false == FUELGAUGE_IsOnline());
+	HOST_CHECK(1u == m_gauge.maxReadyCalls);
+
+	// Tried again on the next period
+	SimRun(FUELGAUGE_TASK_PERIOD_MS);
+	SimRunUntilIdle(100u);
+	HOST_CHECK(true == FUELGAUGE_IsOnline());
+	HOST_CHECK(SIM_CELL_MV == FUELGAUGE_GetBatteryMv());
+	HOST_CHECK(25 == FUELGAUGE_GetBatteryTemperature());
+	CheckIcSetUp();
+	HOST_CHECK(1u == m_gauge.maxReadyCalls);
+
+	printf("Background init with a held bus busy %lu ms\n", (unsigned long)busyMs);
+}
+
+// Failed reads leave the last good reading, each read on its own
+static void TestReadFailures(void)
+{
+	const SIM_Fate_t fates[] = { SIM_FATE_NACK, SIM_FATE_BAD_CRC, SIM_FATE_TIMEOUT };
+	uint32_t f;
+	uint32_t transfer;
+
+	for (f = 0u; f < (sizeof(fates) / sizeof(fates[0u])); f++)
+	{
+		for (transfer = 0u; transfer < 3u; transfer++)
+		{
+			SimReset();
+			SimInit();
+
+			SimRun(FUELGAUGE_TASK_PERIOD_MS + 5u);
+			HOST_CHECK(25 == FUELGAUGE_GetBatteryTemperature());
+
+			m_gauge.regs[FG_MEM_ADDR_CELL_MV] = 3700u;
+			m_gauge.regs[FG_MEM_ADDR_CELL_TEMP] = CELL_TEMP_OFS + 310u;
+			m_gauge.regs[FG_MEM_ADDR_ITE] = 700u;
+
+			SimInject(transfer, fates[f]);
+			SimRun(FUELGAUGE_TASK_PERIOD_MS);
+			SimRunUntilIdle(2u * FUELGAUGE_I2C_TIMEOUT_MS);
+
+			HOST_CHECK(true == FUELGAUGE_IsOnline());
+			HOST_CHECK(((0u == transfer) ? SIM_CELL_MV : 3700u) == FUELGAUGE_GetBatteryMv());
+			HOST_CHECK(((1u == transfer) ? 25 : 31) == FUELGAUGE_GetBatteryTemperature());
+			HOST_CHECK(((2u == transfer) ? SIM_ITE : 700u) == FUELGAUGE_GetSocPt1());
+
+			// All picked up on the next period
+			SimRun(FUELGAUGE_TASK_PERIOD_MS);
+			SimRunUntilIdle(100u);
+			HOST_CHECK(3700u == FUELGAUGE_GetBatteryMv());
+			HOST_CHECK(31 == FUELGAUGE_GetBatteryTemperature());
+			HOST_CHECK(700u == FUELGAUGE_GetSocPt1());
+			HOST_CHECK(1u == m_gauge.maxReadyCalls);
+		}
+	}
+}
+
+// Every transfer failing for a while, no reading is lost and the loop runs on
+static void TestBusDown(void)
+{
+	SimReset();
+	SimInit();
+	SimRun(FUELGAUGE_TASK_PERIOD_MS + 5u);
+
+	m_gauge.regs[FG_MEM_ADDR_CELL_MV] = 3700u;
+	m_gauge.defaultFate = SIM_FATE_NACK;
+	SimRun(1000u);
+	HOST_CHECK(SIM_CELL_MV == FUELGAUGE_GetBatteryMv());
+
+	m_gauge.defaultFate = SIM_FATE_BAD_CRC;
+	SimRun(1000u);
+	HOST_CHECK(SIM_CELL_MV == FUELGAUGE_GetBatteryMv());
+	HOST_CHECK(SIM_ITE == FUELGAUGE_GetSocPt1());
+	HOST_CHECK(true == FUELGAUGE_IsOnline());
+
+	m_gauge.defaultFate = SIM_FATE_ACK;
+	SimRun(FUELGAUGE_TASK_PERIOD_MS);
+	SimRunUntilIdle(100u);
+	HOST_CHECK(3700u == FUELGAUGE_GetBatteryMv());
+
+	// A battery below the ic operating voltage takes it offline without a transfer
+	m_gauge.batteryMv = FUELGAUGE_MIN_BATT_MV - 1u;
+	SimRun(FUELGAUGE_TASK_PERIOD_MS);
+	HOST_CHECK(false == FUELGAUGE_IsOnline());
+	HOST_CHECK(0u == FUELGAUGE_GetBatteryMv());
+
+	m_gauge.batteryMv = 3900u;
+	SimRun(FUELGAUGE_TASK_PERIOD_MS);
+	SimRunUntilIdle(100u);
+	HOST_CHECK(true == FUELGAUGE_IsOnline());
+	HOST_CHECK(0u == m_gauge.refused);
+	HOST_CHECK(0u == m_gauge.badWrites);
+	HOST_CHECK(1u == m_gauge.maxReadyCalls);
+}
+
+// Transfers emptied out of the driver queue by a restart count as failed
+static void TestDriverRestart(void)
+{
+	SimReset();
+	SimInit();
+
+	SimRun(FUELGAUGE_TASK_PERIOD_MS + 5u);
+	m_gauge.defaultFate = SIM_FATE_STUCK;
+	SimRun(FUELGAUGE_TASK_PERIOD_MS);
+	HOST_CHECK(true == FUELGAUGE_IsBusy());
+
+	m_gauge.regs[FG_MEM_ADDR_CELL_MV] = 3700u;
+	m_gauge.defaultFate = SIM_FATE_ACK;
+	SimDriverRestart();
+	SimRun(1u);
+	HOST_CHECK(false == FUELGAUGE_IsBusy());
+	HOST_CHECK(SIM_CELL_MV == FUELGAUGE_GetBatteryMv());
+
+	SimRun(FUELGAUGE_TASK_PERIOD_MS);
+	SimRunUntilIdle(100u);
+	HOST_CHECK(3700u == FUELGAUGE_GetBatteryMv());
+
+	// The same in the background init
+	SimInject(0u, SIM_FATE_STUCK);
+	FUELGAUGE_UpdateBatteryProfile();
+	SimRun(FUELGAUGE_TASK_PERIOD_MS + 10u);
+	HOST_CHECK(true == FUELGAUGE_IsBusy());
+	SimDriverRestart();
+	SimRunUntilIdle(100u);
+	HOST_CHECK(false == FUELGAUGE_IsBusy());
+	HOST_CHECK(1u == m_gauge.maxReadyCalls);
+}
+
+// A profile change sets up the ic again behind the running reads. If that init
+// fails the ic is left as it was and the readings carry on, as before the
+// transfers were queued.
+static void TestProfileUpdate(void)
+{
+	SimReset();
+	SimInit();
+	SimRun(FUELGAUGE_TASK_PERIOD_MS + 5u);
+
+	m_profile.ntcB = 0x0E00u;
+	FUELGAUGE_UpdateBatteryProfile();
+	SimRun(FUELGAUGE_TASK_PERIOD_MS);
+	SimRunUntilIdle(100u);
+
+	HOST_CHECK(2u == m_gauge.writes[FG_MEM_ADDR_POWER_MODE]);
+	HOST_CHECK(0x0E00u == m_gauge.regs[FG_MEM_ADDR_THERMB]);
+	HOST_CHECK(true == FUELGAUGE_IsOnline());
+
+	// No B constant goes straight to the NTC mode
+	m_profile.ntcB = 0xFFFFu;
+	FUELGAUGE_UpdateBatteryProfile();
+	SimRun(FUELGAUGE_TASK_PERIOD_MS);
+	SimRunUntilIdle(100u);
+	HOST_CHECK(2u == m_gauge.writes[FG_MEM_ADDR_THERMB]);
+	HOST_CHECK(3u == m_gauge.writes[FG_MEM_ADDR_THERM_TYPE]);
+
+	m_profile.ntcB = 0x0F00u;
+	m_gauge.regs[FG_MEM_ADDR_CELL_MV] = 3700u;
+	SimInject(5u, SIM_FATE_NACK);
+	FUELGAUGE_UpdateBatteryProfile();
+	SimRun(FUELGAUGE_TASK_PERIOD_MS);
+	SimRunUntilIdle(100u);
+	HOST_CHECK(0x0E00u == m_gauge.regs[FG_MEM_ADDR_THERMB]);
+	HOST_CHECK(true == FUELGAUGE_IsOnline());
+	HOST_CHECK(3700u == FUELGAUGE_GetBatteryMv());
+	HOST_CHECK(0u == m_gauge.badWrites);
+	HOST_CHECK(1u == m_gauge.maxReadyCalls);
+}
+
+
+int main(void)
+{
+	TestInit();
+	TestInitNack();
+	TestInitTimeout();
+	TestTaskTimeout();
+	TestReadFailures();
+	TestBusDown();
+	TestDriverRestart();
+	TestProfileUpdate();
+
+	return HOST_Report("test_fuel_gauge");
+}
@@ -0,0 +1,654 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file		test_hostcomms.c
+ * @date       	18 October 2026
+ * @brief       Host test of the hostcomms idle predictor against host poll
+ * 				traces. Each poll is a status read through the real I2C1
+ * 				interrupt and service, the loop runs every ms while awake and
+ * 				stops the way the taskman does: host idle time at least
+ * 				TASKMAN_STOP_MIN_MS, TASKMAN_WAKE_SETTLE_MS since the last wake
+ * 				and the rtc wake capped to the idle time. A poll that comes
+ * 				during a stop wakes the device on the address match.
+ *
+ * 				Each trace runs for 10 simulated minutes with the predictor and
+ * 				with the old rule of stopping 5s after the last command, and
+ * 				prints the stop residency and how many stops were cut short by a
+ * 				poll. The 1s trace runs again across the ms tick wrap.
+ *
+ * 				The receive ring is filled past capacity: the host is stretched
+ * 				once it is full, a write that still gets in is NACKed and sets
+ * 				the overflow flag without touching the queued ones, the task runs
+ * 				them in order and lets the host back in to send it again. Writes interleaved with
+ * 				the task carry on across the ring counter wrap, and a read waits
+ * 				for the writes before it.
+ *
+ */
+// ----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "../Src/util.c"
+#include "../Src/hostcomms.c"
+
+#define SIM_TRACE_MS					(10u * 60u * 1000u)
+#define SIM_TRACE_MAX					8192u
+#define SIM_LEGACY_STOP_MS				5000u		/* Old taskman, stop once the host has been quiet this long */
+#define SIM_MS_WRAP_TICK				(0u - (SIM_TRACE_MS / 2u))
+#define SIM_STATUS_CMD					0x40u
+#define SIM_WRITE_CMD					0x5Bu
+#define SIM_WRITE_MAX					8u
+#define SIM_WRITE_LOG					1024u
+
+typedef struct
+{
+	uint32_t stopMs;
+	uint32_t stops;
+	uint32_t late;
+	uint32_t polls;
+	uint32_t served;
+} SIM_Result_t;
+
+typedef struct
+{
+	uint8_t data[SIM_WRITE_MAX];
+	uint16_t len;
+} SIM_Write_t;
+
+EXECUTION_State_t executionState = EXECUTION_STATE_POWER_ON;
+
+static DMA_HandleTypeDef m_hdmaTx;
+static DMA_HandleTypeDef m_hdmaRx;
+I2C_HandleTypeDef hi2c1 = { .hdmatx = &m_hdmaTx, .hdmarx = &m_hdmaRx };
+
+static uint32_t m_simMs;
+static uint64_t m_simRand;
+static uint32_t m_simNacks;
+static uint32_t m_trace[SIM_TRACE_MAX];
+static uint32_t m_traceLen;
+static SIM_Write_t m_writeLog[SIM_WRITE_LOG];
+static uint32_t m_writeCount;
+static uint32_t m_writesBeforeRead;
+
+
+// ----------------------------------------------------------------------------
+// Stubs
+
+uint32_t HAL_GetTick(void) { return m_simMs; }
+HAL_StatusTypeDef HAL_I2C_DisableListen_IT(I2C_HandleTypeDef *hi2c) { return HAL_OK; }
+bool NV_ReadVariable_U8(const uint16_t address, uint8_t * const p_var) { return false; }
+uint8_t RtcSetPointer(uint8_t val) { return val; }
+void RtcDs1339ProcessRequest(uint8_t dir, uint8_t command, uint8_t *pData, uint16_t *dataLen) { }
+void RtcReadAlarm1(uint8_t *buffer, uint8_t extended) { }
+void RtcWriteAlarm1(uint8_t *buffer, uint8_t extended) { }
+void RtcWriteTime(uint8_t *buffer, uint8_t extended) { }
+void RtcReadTime(uint8_t *buffer, uint8_t extended) { }
+void RtcWriteControlStatus(uint8_t *buffer, uint16_t dataLen) { }
+uint32_t TIMING_STATS_GetTimeUs(void) { return m_simMs * 1000u; }
+uint32_t TIMING_STATS_RecordTask(const TIMING_STATS_Id_t id, const uint32_t startTime, const uint32_t endTime) { return endTime; }
+
+void RtcReadControlStatus(uint8_t *buffer, uint16_t *dataLen)
+{
+	buffer[0u] = 0u;
+	buffer[1u] = 0u;
+	*dataLen = 2u;
+}
+
+int8_t CmdServerProcessRequest(uint8_t dir, uint8_t *pData, uint16_t *dataLen)
+{
+	if (MASTER_CMD_DIR_READ == dir)
+	{
+		pData[0u] = 0x5Au;
+		*dataLen = 2u;
+		m_writesBeforeRead = m_writeCount;
+	}
+	else if ( (m_writeCount < SIM_WRITE_LOG) && (*dataLen <= SIM_WRITE_MAX) )
+	{
+		memcpy(m_writeLog[m_writeCount].data, pData, *dataLen);
+		m_writeLog[m_writeCount].len = *dataLen;
+		m_writeCount++;
+	}
+
+	return 0;
+}
+
+
+// ----------------------------------------------------------------------------
+// Host side of the bus
+
+static void SimI2cEvent(const uint32_t isr)
+{
+	I2C1->ISR = isr;
+	I2C1_IRQHandler();
+	I2C1->ISR = 0u;
+}
+
+// Status read as the host does it, command byte written then a repeated start
+// for the read. The service answers while the host is stretched.
+static void SimHostRead(const uint8_t cmd)
+{
+	const uint32_t addrCode = (uint32_t)(OWN1_I2C_ADDRESS << 1u) << 16u;
+	uint8_t * p_rx;
+
+	SimI2cEvent(I2C_ISR_ADDR | addrCode);
+
+	p_rx = (uint8_t *)(uintptr_t)hi2c1.hdmarx->Instance->CMAR;
+	p_rx[0u] = cmd;
+	hi2c1.hdmarx->Instance->CNDTR = HOSTCOMMS_I2C_BUFFER_LEN - 1u;
+
+	SimI2cEvent(I2C_ISR_ADDR | I2C_ISR_DIR | addrCode);
+
+	HOSTCOMMS_Service(m_simMs);
+
+	SimI2cEvent(I2C_ISR_STOPF);
+}
+
+// Command write, with the ring full the address interrupt is off and the host is
+// stretched unless another interrupt comes in and the handler sees the address.
+// Returns false if the write did not go through, stretched or NACKed.
+static bool SimHostWrite(const uint8_t * const p_data, const uint16_t len, const bool forced)
+{
+	const uint32_t addrCode = (uint32_t)(OWN1_I2C_ADDRESS << 1u) << 16u;
+	uint8_t * p_rx;
+
+	if ( (false == forced) && (0u == (I2C1->CR1 & I2C_CR1_ADDRIE)) )
+	{
+		return false;
+	}
+
+	SimI2cEvent(I2C_ISR_ADDR | addrCode);
+
+	if (I2C_CR2_NACK == (I2C1->CR2 & I2C_CR2_NACK))
+	{
+		// The host stops on the NACKed command byte, it is left in the receive
+		// register and the peripheral clears the NACK bit at the stop
+		HOST_CHECK(0u == (hi2c1.hdmarx->Instance->CCR & DMA_CCR_EN));
+		SimI2cEvent(I2C_ISR_STOPF | I2C_ISR_RXNE | addrCode);
+		I2C1->CR2 &= ~(I2C_CR2_NACK);
+		m_simNacks++;
+
+		return false;
+	}
+
+	p_rx = (uint8_t *)(uintptr_t)hi2c1.hdmarx->Instance->CMAR;
+	memcpy(p_rx, p_data, len);
+	hi2c1.hdmarx->Instance->CNDTR = HOSTCOMMS_I2C_BUFFER_LEN - len;
+
+	// The address code stays in the status register until the next address
+	SimI2cEvent(I2C_ISR_STOPF | addrCode);
+
+	return true;
+}
+
+// Write n of a sequence, the length and the data bytes tell them apart
+static uint16_t SimWriteData(const uint32_t n, uint8_t * const p_data)
+{
+	const uint16_t len = 2u + (n % (SIM_WRITE_MAX - 1u));
+	uint16_t i;
+
+	p_data[0u] = SIM_WRITE_CMD;
+
+	for (i = 1u; i < len; i++)
+	{
+		p_data[i] = (uint8_t)((n * 7u) + i);
+	}
+
+	return len;
+}
+
+static bool SimCheckWriteLog(const uint32_t first, const uint32_t count)
+{
+	uint8_t data[SIM_WRITE_MAX];
+	uint16_t len;
+	uint32_t i;
+
+	for (i = 0u; i < count; i++)
+	{
+		len = SimWriteData(first + i, data);
+
+		if ( (len != m_writeLog[i].len) || (0 != memcmp(data, m_writeLog[i].data, len)) )
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+// ----------------------------------------------------------------------------
+// Poll traces, ms from the start of the run
+
+static double SimUniform(void)
+{
+	m_simRand ^= m_simRand >> 12u;
+	m_simRand ^= m_simRand << 25u;
+	m_simRand ^= m_simRand >> 27u;
+
+	return (double)((m_simRand * 2685821657736338717ull) >> 11u) / 9007199254740992.0;
+}
+
+static double SimGauss(const double sd)
+{
+	const double u = SimUniform();
+	const double v = SimUniform();
+
+	return sd * sqrt(-2.0 * log(1.0 - u)) * cos(2.0 * M_PI * v);
+}
+
+static void SimTraceAdd(const uint32_t timeMs)
+{
+	if ( (m_traceLen < SIM_TRACE_MAX) && (timeMs < SIM_TRACE_MS) )
+	{
+		m_trace[m_traceLen] = timeMs;
+		m_traceLen++;
+	}
+}
+
+static int SimTraceCompare(const void * p_a, const void * p_b)
+{
+	const uint32_t a = *(const uint32_t *)p_a;
+	const uint32_t b = *(const uint32_t *)p_b;
+
+	return (a > b) - (a < b);
+}
+
+// Poll bursts the way pijuice_sys makes them, two reads and one time in five two
+// more, every period plus the time the service loop takes, with some jitter and
+// now and then a stray command from another client in between
+static void SimTracePoll(const uint32_t seed, const uint32_t lengthMs, const uint32_t periodMs, const uint32_t overMs,
+							const double sd, const double strays)
+{
+	double t = 500.0;
+	uint32_t ms;
+
+	m_simRand = 0x9E3779B97F4A7C15ull * seed;
+	m_traceLen = 0u;
+
+	while (t < lengthMs)
+	{
+		ms = (uint32_t)t;
+
+		SimTraceAdd(ms);
+		SimTraceAdd(ms + 1u);
+
+		if (SimUniform() < 0.2)
+		{
+			SimTraceAdd(ms + 3u);
+			SimTraceAdd(ms + 4u);
+		}
+
+		if (SimUniform() < strays)
+		{
+			SimTraceAdd((uint32_t)(t + 100.0 + (SimUniform() * (periodMs - 200u))));
+		}
+
+		t += periodMs + overMs + SimGauss(sd);
+	}
+
+	qsort(m_trace, m_traceLen, sizeof(m_trace[0u]), SimTraceCompare);
+}
+
+static void SimTraceRandom(const uint32_t seed, const uint32_t count)
+{
+	uint32_t i;
+
+	m_simRand = 0x9E3779B97F4A7C15ull * seed;
+	m_traceLen = 0u;
+
+	for (i = 0u; i < count; i++)
+	{
+		SimTraceAdd((uint32_t)(SimUniform() * SIM_TRACE_MS));
+	}
+
+	qsort(m_trace, m_traceLen, sizeof(m_trace[0u]), SimTraceCompare);
+}
+
+
+// ----------------------------------------------------------------------------
+// Device side, the taskman stop decision
+
+static void SimReset(const uint32_t startMs)
+{
+	m_simMs = startMs;
+	m_hostcommsMode = HOSTCOMMS_MODE_WAIT;
+	m_hostQuiesced = false;
+	m_lastServiceTime = startMs;
+	m_rtcMirrorTime = HOSTCOMMS_RTC_MIRROR_STALE;
+	m_writeCount = 0u;
+	m_writesBeforeRead = 0u;
+	m_simNacks = 0u;
+
+	m_hdmaTx.DmaBaseAddress = DMA1;
+	m_hdmaTx.Instance = DMA1_Channel2;
+	m_hdmaTx.ChannelIndex = 4u;
+	m_hdmaRx.DmaBaseAddress = DMA1;
+	m_hdmaRx.Instance = DMA1_Channel3;
+	m_hdmaRx.ChannelIndex = 8u;
+
+	I2C1->ISR = 0u;
+	I2C1->CR2 = 0u;
+
+	HOSTCOMMS_Init(startMs);
+}
+
+static SIM_Result_t SimRun(const uint32_t startMs, const bool legacy, const bool quiesce)
+{
+	const uint8_t quiesceData[3u] = { HOSTCOMMS_QUIESCE_ENTER, 0u, 0u };
+	SIM_Result_t result = { 0u };
+	uint32_t next = 0u;
+	uint32_t wakeMs;
+	uint32_t idleMs;
+	uint32_t sleepSetting;
+	uint32_t untilMs;
+	bool hostWake;
+
+	SimReset(startMs);
+
+	if (true == quiesce)
+	{
+		HOSTCOMMS_SetQuiesceData(quiesceData, sizeof(quiesceData));
+	}
+
+	wakeMs = m_simMs;
+	result.polls = m_traceLen;
+
+	while ((m_simMs - startMs) < SIM_TRACE_MS)
+	{
+		while ( (next < m_traceLen) && ((m_simMs - startMs) >= m_trace[next]) )
+		{
+			SimHostRead(SIM_STATUS_CMD);
+			next++;
+			result.served++;
+		}
+
+		HOSTCOMMS_Service(m_simMs);
+		HOSTCOMMS_Task();
+
+		if (true == legacy)
+		{
+			idleMs = (HOSTCOMMS_GetLastCommandAgeMs(m_simMs) >= SIM_LEGACY_STOP_MS) ? HOSTCOMMS_IDLE_FOREVER : 0u;
+		}
+		else
+		{
+			idleMs = HOSTCOMMS_GetHostIdleMs(m_simMs);
+		}
+
+		if ( (idleMs >= TASKMAN_STOP_MIN_MS) && MS_TIMEREF_TIMEOUT(wakeMs, m_simMs, TASKMAN_WAKE_SETTLE_MS) )
+		{
+			// Rtc wake as TASKMAN_Run sets it, the tick is moved on by the sleep time
+			sleepSetting = (TASKMAN_SLEEP_TIME_MS * TASKMAN_SLEEP_SETTING_K) / 1000u;
+
+			if ( (HOSTCOMMS_IDLE_FOREVER != idleMs) && (((idleMs * TASKMAN_SLEEP_SETTING_K) / 1000u) < sleepSetting) )
+			{
+				sleepSetting = (idleMs * TASKMAN_SLEEP_SETTING_K) / 1000u;
+			}
+
+			untilMs = m_simMs + ((sleepSetting * 1000u) / TASKMAN_SLEEP_SETTING_K);
+			hostWake = (next < m_traceLen) && ((untilMs - startMs) > m_trace[next]);
+
+			if (true == hostWake)
+			{
+				untilMs = startMs + m_trace[next];
+				result.late++;
+			}
+
+			result.stopMs += untilMs - m_simMs;
+			result.stops++;
+			m_simMs = untilMs;
+			wakeMs = m_simMs;
+
+			// The address match wakes it, the interrupt stamps the command with the
+			// service time from before the stop and the taskman stamps it again
+			if (true == hostWake)
+			{
+				SimHostRead(SIM_STATUS_CMD);
+				HOSTCOMMS_SetInterrupt();
+				next++;
+				result.served++;
+			}
+
+			continue;
+		}
+
+		m_simMs++;
+	}
+
+	return result;
+}
+
+static double SimPercent(const SIM_Result_t * const p_result)
+{
+	return (100.0 * p_result->stopMs) / SIM_TRACE_MS;
+}
+
+// Runs the trace both ways, the residency with the predictor has to be at least
+// the given figure, and at most a little under the old rule's, and no poll may be
+// lost
+static SIM_Result_t TestTrace(const char * const p_name, const uint32_t startMs, const bool quiesce, const double minPercent)
+{
+	const SIM_Result_t legacy = SimRun(startMs, true, quiesce);
+	const SIM_Result_t predict = SimRun(startMs, false, quiesce);
+
+	printf("  %-38s %6.1f%% %6.1f%%   %4u/%-4u %5u\n", p_name, SimPercent(&legacy), SimPercent(&predict),
+			(unsigned)predict.late, (unsigned)predict.stops, (unsigned)predict.polls);
+
+	HOST_CHECK(predict.served == predict.polls);
+	HOST_CHECK(legacy.served == legacy.polls);
+	HOST_CHECK(SimPercent(&predict) >= minPercent);
+	HOST_CHECK(SimPercent(&predict) >= (SimPercent(&legacy) - 0.5));
+	HOST_CHECK(m_txCount >= predict.polls);
+
+	return predict;
+}
+
+
+// ----------------------------------------------------------------------------
+// Tests
+
+static void TestTraces(void)
+{
+	uint8_t activity[6u];
+	uint16_t len;
+	SIM_Result_t result;
+
+	printf("  %-38s %7s %7s %11s %5s\n", "trace, stop residency", "old", "predict", "late/stops", "polls");
+
+	// Steady 1s status poll, the predictor learns the period and stops between polls,
+	// hardly any stop is cut short by a poll
+	SimTracePoll(1u, SIM_TRACE_MS, 1000u, 12u, 3.0, 0.0);
+	result = TestTrace("pijuice_sys 1s poll", 1000u, false, 88.0);
+	HOST_CHECK(result.late * 100u <= result.stops);
+
+	HOSTCOMMS_GetActivityData(activity, &len);
+	HOST_CHECK(6u == len);
+	HOST_CHECK(HOSTCOMMS_ACTIVITY_PREDICTING == activity[0u]);
+	HOST_CHECK(activity[1u] >= HOSTCOMMS_PREDICT_CONFIDENCE);
+	HOST_CHECK(abs((int)UTIL_FromBytes_U16(&activity[2u]) - 1012) <= 5);
+	HOST_CHECK(UTIL_FromBytes_U16(&activity[4u]) <= 5u);
+
+	result = TestTrace("pijuice_sys 1s poll, tick wrap", SIM_MS_WRAP_TICK, false, 88.0);
+	HOST_CHECK(result.late * 100u <= result.stops);
+
+	SimTracePoll(2u, SIM_TRACE_MS, 1000u, 12u, 15.0, 0.0);
+	TestTrace("pijuice_sys, jitter sd 15ms", 1000u, false, 80.0);
+
+	SimTracePoll(3u, SIM_TRACE_MS, 1000u, 12u, 3.0, 0.05);
+	TestTrace("pijuice_sys, 5% stray commands", 1000u, false, 85.0);
+
+	SimTracePoll(4u, SIM_TRACE_MS, 5000u, 40u, 10.0, 0.0);
+	TestTrace("GUI 5s refresh", 1000u, false, 90.0);
+
+	// Host gone half way, the same as the old rule from then on
+	SimTracePoll(5u, SIM_TRACE_MS / 2u, 1000u, 12u, 3.0, 0.0);
+	TestTrace("pijuice_sys stops after 300s", 1000u, false, 90.0);
+
+	// No period to learn, no better or worse than the old rule
+	SimTraceRandom(6u, 600u);
+	TestTrace("random commands, mean 1s", 1000u, false, 0.0);
+
+	// Quiesced, the polls that carry on each wake it from a stop
+	SimTracePoll(1u, SIM_TRACE_MS, 1000u, 12u, 3.0, 0.0);
+	TestTrace("quiesced, 1s polls carry on", 1000u, true, 92.0);
+}
+
+
+// Ring filled past capacity without the task running
+static void TestRingOverfill(void)
+{
+	uint8_t data[SIM_WRITE_MAX];
+	uint8_t activity[6u];
+	uint16_t len;
+	uint32_t i;
+
+	SimReset(1000u);
+
+	HOST_CHECK(0u != (I2C1->CR1 & I2C_CR1_ADDRIE));
+
+	for (i = 0u; i < HOSTCOMMS_RX_RING_SLOTS; i++)
+	{
+		len = SimWriteData(i, data);
+		HOST_CHECK(true == SimHostWrite(data, len, false));
+	}
+
+	// Full, the next address is stretched and nothing is lost yet
+	HOST_CHECK(HOSTCOMMS_RX_RING_SLOTS == HOSTCOMMS_RX_RING_COUNT());
+	HOST_CHECK(0u == (I2C1->CR1 & I2C_CR1_ADDRIE));
+	HOST_CHECK(1u == m_rxRingFullCount);
+	HOST_CHECK(false == m_rxOverflow);
+	HOST_CHECK(0u == HOSTCOMMS_GetHostIdleMs(m_simMs + 1000u));
+
+	len = SimWriteData(HOSTCOMMS_RX_RING_SLOTS, data);
+	HOST_CHECK(false == SimHostWrite(data, len, false));
+
+	// One that gets in anyway is NACKed, the queued writes are left alone
+	len = SimWriteData(100u, data);
+	HOST_CHECK(false == SimHostWrite(data, len, true));
+	HOST_CHECK(1u == m_simNacks);
+	HOST_CHECK(true == m_rxOverflow);
+	HOST_CHECK(HOSTCOMMS_RX_RING_SLOTS == HOSTCOMMS_RX_RING_COUNT());
+	HOST_CHECK(HOSTCOMMS_MODE_WAIT == m_hostcommsMode);
+	HOST_CHECK(0u == m_writeCount);
+
+	// Run in order, the host is let back in and the stretched write goes on
+	HOSTCOMMS_Task();
+	HOST_CHECK(HOSTCOMMS_RX_RING_SLOTS == m_writeCount);
+	HOST_CHECK(true == SimCheckWriteLog(0u, HOSTCOMMS_RX_RING_SLOTS));
+	HOST_CHECK(0u == HOSTCOMMS_RX_RING_COUNT());
+	HOST_CHECK(0u != (I2C1->CR1 & I2C_CR1_ADDRIE));
+
+	len = SimWriteData(HOSTCOMMS_RX_RING_SLOTS, data);
+	HOST_CHECK(true == SimHostWrite(data, len, false));
+	HOSTCOMMS_Task();
+	HOST_CHECK(true == SimCheckWriteLog(0u, HOSTCOMMS_RX_RING_SLOTS + 1u));
+
+	// The NACKed one can be sent again now there is room
+	len = SimWriteData(100u, data);
+	HOST_CHECK(true == SimHostWrite(data, len, true));
+	HOSTCOMMS_Task();
+	HOST_CHECK((HOSTCOMMS_RX_RING_SLOTS + 2u) == m_writeCount);
+	HOST_CHECK(1u == m_simNacks);
+
+	// Flag reads once
+	HOSTCOMMS_GetActivityData(activity, &len);
+	HOST_CHECK(0u != (activity[0u] & HOSTCOMMS_ACTIVITY_RX_OVERFLOW));
+	HOSTCOMMS_GetActivityData(activity, &len);
+	HOST_CHECK(0u == (activity[0u] & HOSTCOMMS_ACTIVITY_RX_OVERFLOW));
+	HOST_CHECK(false == m_rxOverflow);
+}
+
+// Bursts of writes with the task running in between, the host waits while it is
+// stretched, across the wrap of the free running ring counters
+static void TestRingOrder(void)
+{
+	uint8_t data[SIM_WRITE_MAX];
+	uint16_t len;
+	uint32_t sent = 0u;
+	uint32_t burst;
+	uint32_t stretched = 0u;
+
+	SimReset(1000u);
+	m_simRand = 0x9E3779B97F4A7C15ull * 7u;
+
+	while (sent < 600u)
+	{
+		burst = 1u + (uint32_t)(SimUniform() * (HOSTCOMMS_RX_RING_SLOTS + 3u));
+
+		while ( (burst > 0u) && (sent < 600u) )
+		{
+			len = SimWriteData(sent, data);
+
+			if (false == SimHostWrite(data, len, false))
+			{
+				stretched++;
+				break;
+			}
+
+			sent++;
+			burst--;
+		}
+
+		HOSTCOMMS_Task();
+	}
+
+	HOST_CHECK(600u == m_writeCount);
+	HOST_CHECK(true == SimCheckWriteLog(0u, 600u));
+	HOST_CHECK(stretched > 0u);
+	HOST_CHECK(stretched <= m_rxRingFullCount);
+	HOST_CHECK(false == m_rxOverflow);
+	HOST_CHECK(600u == (uint32_t)m_rxTail + (256u * 2u));
+}
+
+// A read after writes is answered only once the task has run them
+static void TestRingReadAfterWrite(void)
+{
+	const uint32_t addrCode = (uint32_t)(OWN1_I2C_ADDRESS << 1u) << 16u;
+	uint8_t data[SIM_WRITE_MAX];
+	uint16_t len;
+	uint32_t i;
+	uint8_t * p_rx;
+
+	SimReset(1000u);
+
+	for (i = 0u; i < 3u; i++)
+	{
+		len = SimWriteData(i, data);
+		SimHostWrite(data, len, false);
+	}
+
+	SimI2cEvent(I2C_ISR_ADDR | addrCode);
+	p_rx = (uint8_t *)(uintptr_t)hi2c1.hdmarx->Instance->CMAR;
+	p_rx[0u] = SIM_STATUS_CMD;
+	hi2c1.hdmarx->Instance->CNDTR = HOSTCOMMS_I2C_BUFFER_LEN - 1u;
+	SimI2cEvent(I2C_ISR_ADDR | I2C_ISR_DIR | addrCode);
+
+	// The queued writes are not overwritten by the read's command byte
+	HOST_CHECK(HOSTCOMMS_MODE_TX == m_hostcommsMode);
+	HOST_CHECK(3u == HOSTCOMMS_RX_RING_COUNT());
+
+	hi2c1.hdmatx->Instance->CCR = 0u;
+	HOSTCOMMS_Service(m_simMs);
+	HOST_CHECK(0u == (hi2c1.hdmatx->Instance->CCR & DMA_CCR_EN));
+
+	HOSTCOMMS_Task();
+	HOSTCOMMS_Service(m_simMs);
+	HOST_CHECK(0u != (hi2c1.hdmatx->Instance->CCR & DMA_CCR_EN));
+	HOST_CHECK(3u == m_writesBeforeRead);
+	HOST_CHECK(true == SimCheckWriteLog(0u, 3u));
+
+	SimI2cEvent(I2C_ISR_STOPF);
+	HOST_CHECK(HOSTCOMMS_MODE_WAIT == m_hostcommsMode);
+}
+
+
+int main(void)
+{
+	TestRingOverfill();
+	TestRingOrder();
+	TestRingReadAfterWrite();
+	TestTraces();
+
+	return HOST_Report("test_hostcomms");
+}
@@ -0,0 +1,844 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file		test_i2cdrv.c
+ * @date       	18 October 2026
+ * @brief       Host test of i2cdrv against a model of the I2C2 peripheral, its
+ * 				dma channels and a register file device on the bus. The model
+ * 				steps the hardware one byte at a time and raises the device
+ * 				interrupt the way the peripheral would, with faults injected for
+ * 				address and data nack, dma transfer error and a stalled bus.
+ * 				Covers queue order, write then read, queue full, timeout, errors
+ * 				and an interrupt landing part way through the osloop timeout
+ * 				raising its event.
+ *
+ * 				The latency run times the bus at 100kHz against a 1ms osloop and
+ * 				prints the transaction start to callback time from the timing
+ * 				stats. test_i2cdrv_polled builds the same tests with
+ * 				I2CDRV_POLLED_COMPLETION so the two can be compared.
+ *
+ */
+// ----------------------------------------------------------------------------
+
+#include <stdio.h>
+
+#include "../Src/util.c"
+#include "../Src/timing_stats.c"
+#include "../Src/i2cdrv.c"
+
+#define BUS_DEVICE_ADDR			0x16u
+#define BUS_TXDR_EMPTY			0x100u		/* Not a byte, shows the driver didn't write TXDR */
+#define BUS_MAX_STEPS			1000u
+#define BUS_LOG_LENGTH			16u
+#define BUS_BYTE_US				90u			/* 100kHz, 9 clocks per byte */
+
+#define SIM_OSLOOP_US			1000u
+#define SIM_BURSTS				1000u
+#define SIM_BURST_READS			3u			/* Fuel gauge voltage, temperature, ITE */
+#define SIM_READ_LEN			3u			/* Word and PEC */
+
+#define TX_CHANNEL				(&g_hostDMA1Channel.regs[3u])
+#define RX_CHANNEL				(&g_hostDMA1Channel.regs[4u])
+#define TX_CHANNEL_INDEX		12u
+#define RX_CHANNEL_INDEX		16u
+
+typedef enum
+{
+	BUS_IDLE = 0u,
+	BUS_WRITE,
+	BUS_READ,
+	BUS_DONE
+} BUS_Phase_t;
+
+typedef struct
+{
+	BUS_Phase_t phase;
+	uint8_t nbytes;
+	uint8_t count;
+	bool stall;
+	bool nackAddr;
+	int16_t nackAfter;
+	uint8_t mem[256u];
+	uint8_t ptr;
+	bool ptrSet;
+	uint8_t logAddr[BUS_LOG_LENGTH];
+	uint8_t logReg[BUS_LOG_LENGTH];
+	uint8_t logCount;
+	uint32_t byteCount;
+	bool byteDue;
+	uint8_t byte;
+} BUS_Model_t;
+
+typedef struct
+{
+	I2CDRV_Device_Event_t event;
+	uint8_t data[I2CDRV_MAX_BUFFER_SIZE];
+} CALLBACK_Record_t;
+
+
+// ----------------------------------------------------------------------------
+// Stubs
+
+static DMA_HandleTypeDef m_hdmaTx;
+static DMA_HandleTypeDef m_hdmaRx;
+I2C_HandleTypeDef hi2c1;
+I2C_HandleTypeDef hi2c2 = { .hdmatx = &m_hdmaTx, .hdmarx = &m_hdmaRx };
+
+uint32_t HAL_GetTick(void)
+{
+	return g_hostTick;
+}
+
+uint32_t HAL_RCC_GetPCLK1Freq(void)
+{
+	return 48000000u;
+}
+
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority)
+{
+}
+
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn)
+{
+}
+
+void OSLOOP_AtomicAccess(const bool access)
+{
+	HOST_OsloopHold(access);
+}
+
+
+// ----------------------------------------------------------------------------
+// Bus model
+
+static BUS_Model_t m_bus;
+static CALLBACK_Record_t m_callbacks[16u];
+static uint8_t m_callbackCount;
+static bool m_simWoken;
+static uint32_t m_simUs;
+
+
+static void Callback(const I2CDRV_Device_t * const p_device)
+{
+	if (m_callbackCount < 16u)
+	{
+		m_callbacks[m_callbackCount].event = p_device->event;
+		memcpy(m_callbacks[m_callbackCount].data, p_device->data, I2CDRV_MAX_BUFFER_SIZE);
+	}
+
+	m_callbackCount++;
+}
+
+
+static void BusClearFlags(void);
+
+
+// Stands in for both the I2C2 and DMA1 channel 4/5 vectors, same priority so
+// neither pre-empts the other
+static void DeviceIrq(void)
+{
+	const uint32_t i2cEnables = I2C2->CR1;
+	uint32_t sources = 0u;
+
+	// Any interrupt wakes the task waiting on the bus
+	m_simWoken = true;
+
+#ifndef I2CDRV_POLLED_COMPLETION
+	if (0u != (DMA1->ISR & ((DMA_FLAG_TE1 << TX_CHANNEL_INDEX) | (DMA_FLAG_TE1 << RX_CHANNEL_INDEX))))
+	{
+		DMA1_Channel4_5_IRQHandler();
+	}
+#endif
+
+	sources |= ((0u != (i2cEnables & I2C_CR1_TXIE)) ? I2C_ISR_TXIS : 0u);
+	sources |= ((0u != (i2cEnables & I2C_CR1_TCIE)) ? I2C_ISR_TC : 0u);
+	sources |= ((0u != (i2cEnables & I2C_CR1_STOPIE)) ? I2C_ISR_STOPF : 0u);
+	sources |= ((0u != (i2cEnables & I2C_CR1_NACKIE)) ? I2C_ISR_NACKF : 0u);
+	sources |= ((0u != (i2cEnables & I2C_CR1_ERRIE)) ? (I2C_ISR_BERR | I2C_ISR_ARLO) : 0u);
+
+	if (0u != (I2C2->ISR & sources))
+	{
+		I2C2_IRQHandler();
+	}
+
+	BusClearFlags();
+}
+
+
+static void BusClearFlags(void)
+{
+	uint32_t ifcr = DMA1->IFCR;
+	uint32_t ch;
+
+	// Global flag clears all four of the channel
+	for (ch = 0u; ch < 28u; ch += 4u)
+	{
+		if (0u != (ifcr & (DMA_FLAG_GL1 << ch)))
+		{
+			ifcr |= (0x0Fu << ch);
+		}
+	}
+
+	DMA1->ISR &= ~ifcr;
+	DMA1->IFCR = 0u;
+
+	I2C2->ISR &= ~(I2C2->ICR & (I2C_ISR_NACKF | I2C_ISR_STOPF | I2C_ISR_BERR | I2C_ISR_ARLO | I2C_ISR_ADDR));
+	I2C2->ICR = 0u;
+}
+
+
+static void BusDeviceByte(const uint8_t byte)
+{
+	if (false == m_bus.ptrSet)
+	{
+		m_bus.ptr = byte;
+		m_bus.ptrSet = true;
+
+		if (m_bus.logCount < BUS_LOG_LENGTH)
+		{
+			m_bus.logAddr[m_bus.logCount] = (uint8_t)(I2C2->CR2 & 0xFEu);
+			m_bus.logReg[m_bus.logCount] = byte;
+			m_bus.logCount++;
+		}
+	}
+	else
+	{
+		m_bus.mem[m_bus.ptr++] = byte;
+	}
+}
+
+
+// A byte takes its bus time first and happens on the following step, so an
+// osloop that falls part way through a byte sees the bus as it was
+static bool BusByteDone(void)
+{
+	if (false == m_bus.byteDue)
+	{
+		m_bus.byteDue = true;
+		m_bus.byteCount++;
+		return false;
+	}
+
+	m_bus.byteDue = false;
+	return true;
+}
+
+
+static void BusEnd(const uint32_t flags)
+{
+	I2C2->ISR |= flags;
+	m_bus.phase = BUS_DONE;
+	m_bus.ptrSet = false;
+
+	HOST_RaiseIrq(HOST_IRQ_DEVICE);
+}
+
+
+// ****************************************************************************
+/*!
+ * BusStep moves the hardware on by one event, a start, one byte or a stop,
+ * raising the interrupt where the peripheral would.
+ *
+ * @param	none
+ * @retval	bool		true if anything happened
+ */
+// ****************************************************************************
+static bool BusStep(void)
+{
+	BusClearFlags();
+
+	if (0u == (I2C2->CR1 & I2C_CR1_PE))
+	{
+		// PE low resets the peripheral
+		I2C2->ISR = 0u;
+		m_bus.phase = BUS_IDLE;
+		m_bus.ptrSet = false;
+		m_bus.byteDue = false;
+		return false;
+	}
+
+	if (true == m_bus.stall)
+	{
+		return false;
+	}
+
+	if (0u != (I2C2->CR2 & I2C_CR2_START))
+	{
+		// Address byte
+		if (false == BusByteDone())
+		{
+			return true;
+		}
+
+		// Driver only starts a new transaction after cycling PE, a repeated start
+		// follows the transfer complete of the write
+		if (BUS_DONE == m_bus.phase)
+		{
+			I2C2->ISR = 0u;
+		}
+
+		I2C2->ISR &= ~I2C_ISR_TC;
+		I2C2->CR2 &= ~(I2C_CR2_START | 0x80000000u);
+
+		m_bus.nbytes = (uint8_t)((I2C2->CR2 & I2C_CR2_NBYTES) >> I2C_CR2_NBYTES_Pos);
+		m_bus.count = 0u;
+
+		if ( (true == m_bus.nackAddr) || (BUS_DEVICE_ADDR != (I2C2->CR2 & 0xFEu)) )
+		{
+			BusEnd(I2C_ISR_NACKF | I2C_ISR_STOPF);
+			return true;
+		}
+
+		if (0u != (I2C2->CR2 & I2C_CR2_RD_WRN))
+		{
+			m_bus.phase = BUS_READ;
+		}
+		else
+		{
+			// Interrupt for the address ack is raised on the next step so the
+			// byte the driver loads can be picked up
+			m_bus.phase = BUS_WRITE;
+			m_bus.ptrSet = false;
+			I2C2->ISR |= I2C_ISR_TXIS;
+		}
+
+		return true;
+	}
+
+	switch (m_bus.phase)
+	{
+	case BUS_WRITE:
+		if (0u != (I2C2->ISR & I2C_ISR_TXIS))
+		{
+			if (false == m_bus.byteDue)
+			{
+				// Load the data register, then the byte goes out
+				if ( (0u != (TX_CHANNEL->CCR & DMA_CCR_EN)) && (TX_CHANNEL->CNDTR > 0u) )
+				{
+					m_bus.byte = ((uint8_t *)(uintptr_t)TX_CHANNEL->CMAR)[m_bus.nbytes - TX_CHANNEL->CNDTR];
+					TX_CHANNEL->CNDTR--;
+
+					if (0u == TX_CHANNEL->CNDTR)
+					{
+						DMA1->ISR |= (DMA_FLAG_TC1 << TX_CHANNEL_INDEX);
+					}
+				}
+				else
+				{
+					I2C2->TXDR = BUS_TXDR_EMPTY;
+					HOST_RaiseIrq(HOST_IRQ_DEVICE);
+
+					if (BUS_TXDR_EMPTY == I2C2->TXDR)
+					{
+						return false;
+					}
+
+					m_bus.byte = (uint8_t)I2C2->TXDR;
+				}
+
+				(void)BusByteDone();
+				return true;
+			}
+
+			(void)BusByteDone();
+			I2C2->ISR &= ~I2C_ISR_TXIS;
+
+			if (m_bus.nackAfter == (int16_t)m_bus.count)
+			{
+				BusEnd(I2C_ISR_NACKF | I2C_ISR_STOPF);
+				return true;
+			}
+
+			BusDeviceByte(m_bus.byte);
+			m_bus.count++;
+		}
+		else if (m_bus.count < m_bus.nbytes)
+		{
+			I2C2->ISR |= I2C_ISR_TXIS;
+		}
+		else if (0u != (I2C2->CR2 & I2C_CR2_AUTOEND))
+		{
+			BusEnd(I2C_ISR_STOPF);
+		}
+		else if (0u == (I2C2->ISR & I2C_ISR_TC))
+		{
+			I2C2->ISR |= I2C_ISR_TC;
+			HOST_RaiseIrq(HOST_IRQ_DEVICE);
+		}
+		else
+		{
+			return false;
+		}
+
+		return true;
+
+	case BUS_READ:
+		if ( (0u != (RX_CHANNEL->CCR & DMA_CCR_EN)) && (RX_CHANNEL->CNDTR > 0u) )
+		{
+			if (false == BusByteDone())
+			{
+				return true;
+			}
+
+			((uint8_t *)(uintptr_t)RX_CHANNEL->CMAR)[m_bus.nbytes - RX_CHANNEL->CNDTR] = m_bus.mem[m_bus.ptr++];
+			RX_CHANNEL->CNDTR--;
+
+			if (0u == RX_CHANNEL->CNDTR)
+			{
+				DMA1->ISR |= (DMA_FLAG_TC1 << RX_CHANNEL_INDEX);
+			}
+
+			return true;
+		}
+
+		if ( (m_bus.count < m_bus.nbytes) && (0u == RX_CHANNEL->CNDTR) )
+		{
+			BusEnd(I2C_ISR_STOPF);
+			return true;
+		}
+
+		return false;
+
+	default:
+		return false;
+	}
+}
+
+
+// Runs the bus and the osloop service until nothing more happens
+static void BusRun(void)
+{
+	uint32_t steps = 0u;
+	bool busy = true;
+
+	while ( (true == busy) && (steps < BUS_MAX_STEPS) )
+	{
+		busy = BusStep();
+		steps++;
+
+		if (false == busy)
+		{
+			I2CDRV_Service(g_hostTick);
+			busy = BusStep();
+		}
+	}
+}
+
+
+static void Reset(void)
+{
+	memset(&m_bus, 0, sizeof(m_bus));
+	m_bus.nackAfter = -1;
+	m_callbackCount = 0u;
+	memset(m_callbacks, 0, sizeof(m_callbacks));
+
+	I2C2->CR1 = 0u;
+	I2C2->CR2 = 0u;
+	I2C2->ISR = 0u;
+	DMA1->ISR = 0u;
+
+	I2CDRV_Init(g_hostTick);
+}
+
+
+// ----------------------------------------------------------------------------
+// Tests
+
+static void TestWriteRead(void)
+{
+	const uint8_t write[3u] = { 0x09u, 0x34u, 0x12u };
+	const uint8_t reg = 0x09u;
+	const uint8_t cmd[2u] = { 0x20u, 0x21u };
+
+	Reset();
+
+	HOST_CHECK(true == I2CDRV_IsReady(1u));
+	HOST_CHECK(true == I2CDRV_Transact(1u, BUS_DEVICE_ADDR, write, 3u, I2CDRV_TRANSACTION_TX, Callback, 10u, g_hostTick));
+	HOST_CHECK(false == I2CDRV_IsReady(1u));
+
+	BusRun();
+
+	HOST_CHECK(1u == m_callbackCount);
+	HOST_CHECK(I2CDRV_EVENT_TX_COMPLETE == m_callbacks[0u].event);
+	HOST_CHECK( (0x34u == m_bus.mem[0x09u]) && (0x12u == m_bus.mem[0x0Au]) );
+	HOST_CHECK(true == I2CDRV_IsReady(1u));
+
+	HOST_CHECK(true == I2CDRV_Transact(1u, BUS_DEVICE_ADDR, &reg, 2u, I2CDRV_TRANSACTION_RX, Callback, 10u, g_hostTick));
+
+	BusRun();
+
+	// Register, device address with the read bit, then the bytes read
+	HOST_CHECK(2u == m_callbackCount);
+	HOST_CHECK(I2CDRV_EVENT_RX_COMPLETE == m_callbacks[1u].event);
+	HOST_CHECK(0x09u == m_callbacks[1u].data[0u]);
+	HOST_CHECK((BUS_DEVICE_ADDR | 1u) == m_callbacks[1u].data[1u]);
+	HOST_CHECK( (0x34u == m_callbacks[1u].data[2u]) && (0x12u == m_callbacks[1u].data[3u]) );
+
+	// Two written bytes then a repeated start read, the device takes the second
+	// byte as data so the read starts at the following register
+	m_bus.mem[0x21u] = 0xA5u;
+	m_bus.mem[0x22u] = 0x3Cu;
+	m_bus.mem[0x23u] = 0x77u;
+
+	HOST_CHECK(true == I2CDRV_TransactWriteRead(1u, BUS_DEVICE_ADDR, cmd, 2u, 2u, Callback, 10u, g_hostTick));
+
+	BusRun();
+
+	HOST_CHECK(3u == m_callbackCount);
+	HOST_CHECK(I2CDRV_EVENT_RX_COMPLETE == m_callbacks[2u].event);
+	HOST_CHECK( (0x20u == m_callbacks[2u].data[0u]) && (0x21u == m_callbacks[2u].data[1u]) );
+	HOST_CHECK((BUS_DEVICE_ADDR | 1u) == m_callbacks[2u].data[2u]);
+	HOST_CHECK( (0xA5u == m_callbacks[2u].data[3u]) && (0x3Cu == m_callbacks[2u].data[4u]) );
+	HOST_CHECK(0u == m_callbacks[2u].data[5u]);
+	HOST_CHECK(0x21u == m_bus.mem[0x20u]);
+}
+
+
+static void TestQueueOrder(void)
+{
+	const uint8_t w1[2u] = { 0x40u, 0x11u };
+	const uint8_t w2[2u] = { 0x41u, 0x22u };
+	const uint8_t r1 = 0x40u;
+	uint8_t big[I2CDRV_MAX_BUFFER_SIZE + 1u] = { 0u };
+
+	Reset();
+
+	// First one goes straight on to the bus, the queue holds three more
+	m_bus.stall = true;
+
+	HOST_CHECK(true == I2CDRV_Transact(1u, BUS_DEVICE_ADDR, w1, 2u, I2CDRV_TRANSACTION_TX, Callback, 10u, g_hostTick));
+	HOST_CHECK(true == I2CDRV_Transact(1u, BUS_DEVICE_ADDR, &r1, 1u, I2CDRV_TRANSACTION_RX, Callback, 10u, g_hostTick));
+	HOST_CHECK(true == I2CDRV_Transact(1u, BUS_DEVICE_ADDR, w2, 2u, I2CDRV_TRANSACTION_TX, Callback, 10u, g_hostTick));
+	HOST_CHECK(true == I2CDRV_TransactWriteRead(1u, BUS_DEVICE_ADDR, &w2[0u], 1u, 1u, Callback, 10u, g_hostTick));
+	HOST_CHECK(false == I2CDRV_Transact(1u, BUS_DEVICE_ADDR, w1, 2u, I2CDRV_TRANSACTION_TX, Callback, 10u, g_hostTick));
+
+	// Bad requests
+	HOST_CHECK(false == I2CDRV_Transact(2u, BUS_DEVICE_ADDR, w1, 2u, I2CDRV_TRANSACTION_TX, Callback, 10u, g_hostTick));
+	HOST_CHECK(false == I2CDRV_Transact(0u, BUS_DEVICE_ADDR, w1, 2u, I2CDRV_TRANSACTION_TX, Callback, 10u, g_hostTick));
+	HOST_CHECK(false == I2CDRV_TransactWriteRead(1u, BUS_DEVICE_ADDR, big, I2CDRV_MAX_BUFFER_SIZE - 1u, 1u, Callback, 10u, g_hostTick));
+	HOST_CHECK(false == I2CDRV_TransactWriteRead(1u, BUS_DEVICE_ADDR, big, 1u, 0u, Callback, 10u, g_hostTick));
+
+	m_bus.stall = false;
+
+	BusRun();
+
+	HOST_CHECK(4u == m_callbackCount);
+	HOST_CHECK(I2CDRV_EVENT_TX_COMPLETE == m_callbacks[0u].event);
+	HOST_CHECK(I2CDRV_EVENT_RX_COMPLETE == m_callbacks[1u].event);
+	HOST_CHECK(0x11u == m_callbacks[1u].data[2u]);
+	HOST_CHECK(I2CDRV_EVENT_TX_COMPLETE == m_callbacks[2u].event);
+	HOST_CHECK(I2CDRV_EVENT_RX_COMPLETE == m_callbacks[3u].event);
+	HOST_CHECK(0x22u == m_callbacks[3u].data[2u]);
+
+	// Bus saw them in the order queued
+	HOST_CHECK(4u == m_bus.logCount);
+	HOST_CHECK( (0x40u == m_bus.logReg[0u]) && (0x40u == m_bus.logReg[1u]) );
+	HOST_CHECK( (0x41u == m_bus.logReg[2u]) && (0x41u == m_bus.logReg[3u]) );
+
+	HOST_CHECK(true == I2CDRV_IsReady(1u));
+}
+
+
+static void TestErrors(void)
+{
+	const uint8_t write[3u] = { 0x50u, 0x01u, 0x02u };
+	const uint8_t reg = 0x50u;
+
+	// Nobody at the address, the next queued transaction still runs
+	Reset();
+
+	HOST_CHECK(true == I2CDRV_Transact(1u, 0x30u, write, 3u, I2CDRV_TRANSACTION_TX, Callback, 10u, g_hostTick));
+	HOST_CHECK(true == I2CDRV_Transact(1u, BUS_DEVICE_ADDR, write, 3u, I2CDRV_TRANSACTION_TX, Callback, 10u, g_hostTick));
+
+	BusRun();
+
+	HOST_CHECK(2u == m_callbackCount);
+	HOST_CHECK(I2CDRV_EVENT_TX_FAILED == m_callbacks[0u].event);
+	HOST_CHECK(I2CDRV_EVENT_TX_COMPLETE == m_callbacks[1u].event);
+
+	// Read address nack
+	Reset();
+	m_bus.nackAddr = true;
+
+	HOST_CHECK(true == I2CDRV_Transact(1u, BUS_DEVICE_ADDR, &reg, 2u, I2CDRV_TRANSACTION_RX, Callback, 10u, g_hostTick));
+
+	BusRun();
+
+	HOST_CHECK(1u == m_callbackCount);
+	HOST_CHECK(I2CDRV_EVENT_RX_FAILED == m_callbacks[0u].event);
+
+	// Data nack part way through a write
+	Reset();
+	m_bus.nackAfter = 1;
+
+	HOST_CHECK(true == I2CDRV_Transact(1u, BUS_DEVICE_ADDR, write, 3u, I2CDRV_TRANSACTION_TX, Callback, 10u, g_hostTick));
+
+	BusRun();
+
+	HOST_CHECK(1u == m_callbackCount);
+	HOST_CHECK(I2CDRV_EVENT_TX_FAILED == m_callbacks[0u].event);
+
+#ifndef I2CDRV_POLLED_COMPLETION
+	// Dma transfer error on the read
+	Reset();
+	m_bus.stall = true;
+
+	HOST_CHECK(true == I2CDRV_Transact(1u, BUS_DEVICE_ADDR, &reg, 2u, I2CDRV_TRANSACTION_RX, Callback, 10u, g_hostTick));
+
+	DMA1->ISR |= (DMA_FLAG_TE1 << RX_CHANNEL_INDEX);
+	HOST_RaiseIrq(HOST_IRQ_DEVICE);
+
+	HOST_CHECK(0u == (DMA1->ISR & (DMA_FLAG_TE1 << RX_CHANNEL_INDEX)));
+	HOST_CHECK(0u == (RX_CHANNEL->CCR & DMA_CCR_EN));
+
+	// Picked up without waiting for the osloop
+	HOST_CHECK(true == I2CDRV_IsReady(1u));
+	HOST_CHECK(1u == m_callbackCount);
+	HOST_CHECK(I2CDRV_EVENT_RX_FAILED == m_callbacks[0u].event);
+#endif
+}
+
+
+static void TestTimeout(void)
+{
+	const uint8_t write[2u] = { 0x60u, 0x01u };
+
+	Reset();
+	m_bus.stall = true;
+
+	HOST_CHECK(true == I2CDRV_Transact(1u, BUS_DEVICE_ADDR, write, 2u, I2CDRV_TRANSACTION_TX, Callback, 10u, g_hostTick));
+	HOST_CHECK(true == I2CDRV_Transact(1u, BUS_DEVICE_ADDR, write, 2u, I2CDRV_TRANSACTION_TX, Callback, 10u, g_hostTick));
+
+	g_hostTick += 9u;
+	I2CDRV_Service(g_hostTick);
+	HOST_CHECK(0u == m_callbackCount);
+
+	g_hostTick += 1u;
+	I2CDRV_Service(g_hostTick);
+	HOST_CHECK(1u == m_callbackCount);
+	HOST_CHECK(I2CDRV_EVENT_TX_FAILED == m_callbacks[0u].event);
+
+	// Interrupts of the dead transaction were turned off, the next one is running
+	HOST_CHECK(0u != (I2C2->CR1 & I2C_CR1_TXIE));
+	HOST_CHECK(false == I2CDRV_IsReady(1u));
+
+	m_bus.stall = false;
+	BusRun();
+
+	HOST_CHECK(2u == m_callbackCount);
+	HOST_CHECK(I2CDRV_EVENT_TX_COMPLETE == m_callbacks[1u].event);
+	HOST_CHECK(true == I2CDRV_IsReady(1u));
+}
+
+
+#ifndef I2CDRV_POLLED_COMPLETION
+static bool m_raceHeld;
+static I2CDRV_Device_Event_t m_raceEventAtIrq;
+
+static void RaceHook(void)
+{
+	HOST_RaiseIrq(HOST_IRQ_DEVICE);
+
+	m_raceHeld = HOST_IrqPending(HOST_IRQ_DEVICE);
+	m_raceEventAtIrq = m_devices[1u].event;
+}
+
+
+static void TestFirstEventRace(void)
+{
+	const uint8_t reg = 0x70u;
+	uint32_t writes;
+
+	Reset();
+	m_bus.stall = true;
+
+	HOST_CHECK(true == I2CDRV_Transact(1u, BUS_DEVICE_ADDR, &reg, 2u, I2CDRV_TRANSACTION_RX, Callback, 10u, g_hostTick));
+
+	// The osloop times the transaction out, the dma error interrupt arrives just
+	// after the timeout's RaiseEvent has checked for an earlier event and started
+	// on the hardware
+	DMA1->ISR |= (DMA_FLAG_TE1 << RX_CHANNEL_INDEX);
+
+	if (false == HOST_TrapWrites(TX_CHANNEL, 0u, RaceHook))
+	{
+		printf("test_i2cdrv: write trap not supported, race not checked\n");
+		return;
+	}
+
+	g_hostTick += 10u;
+	I2CDRV_Service(g_hostTick);
+
+	writes = HOST_TrapCount();
+	HOST_TrapWrites(NULL, 0u, NULL);
+
+	// The interrupt waits for the timeout to finish claiming the event, then
+	// finds it claimed and leaves the hardware alone
+	HOST_CHECK(true == m_raceHeld);
+	HOST_CHECK(I2CDRV_EVENT_NONE == m_raceEventAtIrq);
+	HOST_CHECK(2u == writes);
+	HOST_CHECK(0u == (DMA1->ISR & (DMA_FLAG_TE1 << RX_CHANNEL_INDEX)));
+
+	HOST_CHECK(1u == m_callbackCount);
+	HOST_CHECK(I2CDRV_EVENT_RX_FAILED == m_callbacks[0u].event);
+	HOST_CHECK(true == I2CDRV_IsReady(1u));
+	HOST_CHECK(1u == m_callbackCount);
+}
+#endif
+
+
+// Sets the ms tick and the systick counter to a simulated time in uS
+static void SimSetTime(const uint32_t us)
+{
+	m_simUs = us;
+	g_hostTick = us / 1000u;
+	SysTick->VAL = SysTick->LOAD - (((us % 1000u) * (SysTick->LOAD + 1u)) / 1000u);
+}
+
+
+// ****************************************************************************
+/*!
+ * SimRun runs the bus in simulated time until the expected number of callbacks
+ * have been made. Each byte on the bus takes BUS_BYTE_US, the osloop service
+ * runs every SIM_OSLOOP_US and the task waiting on the bus calls IsReady each
+ * time an interrupt wakes it.
+ *
+ * @param	callbacks	number of callbacks to wait for
+ * @retval	none
+ */
+// ****************************************************************************
+static void SimRun(const uint8_t callbacks)
+{
+	uint32_t nextOsloop = ((m_simUs / SIM_OSLOOP_US) + 1u) * SIM_OSLOOP_US;
+	uint32_t bytes;
+	uint32_t end;
+	uint32_t guard = 0u;
+	bool progress;
+
+	while ( (m_callbackCount < callbacks) && (guard < 100000u) )
+	{
+		guard++;
+		bytes = m_bus.byteCount;
+		progress = BusStep();
+		end = m_simUs + ((m_bus.byteCount - bytes) * BUS_BYTE_US);
+
+		if ( (false == progress) && (false == m_simWoken) )
+		{
+			// Nothing happens until the next osloop
+			end = nextOsloop;
+		}
+
+		while (nextOsloop <= end)
+		{
+			SimSetTime(nextOsloop);
+			I2CDRV_Service(g_hostTick);
+			nextOsloop += SIM_OSLOOP_US;
+		}
+
+		SimSetTime(end);
+
+		if (true == m_simWoken)
+		{
+			m_simWoken = false;
+			(void)I2CDRV_IsReady(1u);
+		}
+	}
+}
+
+
+static void TestLatency(void)
+{
+	TIMING_STATS_Summary_t summary;
+	uint32_t seed = 12345u;
+	uint32_t burstStart;
+	uint64_t burstTotal = 0u;
+	uint32_t burstMax = 0u;
+	uint32_t burst;
+	uint32_t i;
+	uint8_t cmd;
+	const uint32_t readUs = (3u + SIM_READ_LEN) * BUS_BYTE_US;
+
+	Reset();
+	SimSetTime(0u);
+	TIMING_STATS_Reset();
+
+	for (i = 0u; i < SIM_BURSTS; i++)
+	{
+		// Task runs at some point in the osloop period
+		seed = (seed * 1103515245u) + 12345u;
+		SimSetTime(m_simUs + 5000u + ((seed >> 8u) % SIM_OSLOOP_US));
+
+		m_callbackCount = 0u;
+		burstStart = m_simUs;
+
+		for (cmd = 0x09u; cmd < (0x09u + SIM_BURST_READS); cmd++)
+		{
+			HOST_CHECK(true == I2CDRV_Transact(1u, BUS_DEVICE_ADDR, &cmd, SIM_READ_LEN, I2CDRV_TRANSACTION_RX,
+											Callback, 10u, g_hostTick));
+		}
+
+		SimRun(SIM_BURST_READS);
+
+		burst = m_simUs - burstStart;
+		burstTotal += burst;
+		burstMax = (burst > burstMax) ? burst : burstMax;
+	}
+
+	TIMING_STATS_GetSummary(TIMING_STATS_I2CDRV_TRANSACT, &summary);
+
+	printf("test_i2cdrv%s: %u byte reads, bus %uus, start to callback min %uus mean %uus max %uus\n",
+#ifdef I2CDRV_POLLED_COMPLETION
+			"_polled",
+#else
+			"",
+#endif
+			SIM_READ_LEN, (unsigned)readUs, summary.min, summary.mean, summary.max);
+	printf("test_i2cdrv%s: burst of %u reads mean %uus max %uus\n",
+#ifdef I2CDRV_POLLED_COMPLETION
+			"_polled",
+#else
+			"",
+#endif
+			SIM_BURST_READS, (unsigned)(burstTotal / SIM_BURSTS), (unsigned)burstMax);
+
+	HOST_CHECK((SIM_BURSTS * SIM_BURST_READS) == summary.count);
+	// uS time reads up to 1uS low
+	HOST_CHECK((summary.min + 1u) >= readUs);
+
+#ifdef I2CDRV_POLLED_COMPLETION
+	// Completion waits for the osloop to see it
+	HOST_CHECK(summary.max <= (readUs + SIM_OSLOOP_US + 1u));
+#else
+	// Callback runs as the task wakes on the stop interrupt
+	HOST_CHECK(summary.max <= (readUs + 2u));
+#endif
+}
+
+
+int main(void)
+{
+	m_hdmaTx.DmaBaseAddress = DMA1;
+	m_hdmaTx.Instance = TX_CHANNEL;
+	m_hdmaTx.ChannelIndex = TX_CHANNEL_INDEX;
+	m_hdmaRx.DmaBaseAddress = DMA1;
+	m_hdmaRx.Instance = RX_CHANNEL;
+	m_hdmaRx.ChannelIndex = RX_CHANNEL_INDEX;
+
+	SysTick->LOAD = 47999u;
+	TIMING_STATS_Init();
+
+	HOST_SetIrqHandler(HOST_IRQ_DEVICE, DeviceIrq);
+
+	TestWriteRead();
+	TestQueueOrder();
+	TestErrors();
+	TestTimeout();
+
+	TestLatency();
+
+#ifndef I2CDRV_POLLED_COMPLETION
+	TestFirstEventRace();
+
+	return HOST_Report("test_i2cdrv");
+#else
+	return HOST_Report("test_i2cdrv_polled");
+#endif
+}
@@ -0,0 +1,12 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file		test_i2cdrv_polled.c
+ * @date       	18 October 2026
+ * @brief       test_i2cdrv built for the polled completion path.
+ *
+ */
+// ----------------------------------------------------------------------------
+
+#define I2CDRV_POLLED_COMPLETION
+
+#include "test_i2cdrv.c"
@@ -0,0 +1,588 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file		test_iodrv.c
+ * @date       	18 October 2026
+ * @brief       Button edge capture in iodrv against edge sequences on the pins.
+ * 				Simulated time runs in uS, the ms tick and the uS time stamp are
+ * 				made from it the way timing_stats does, and the service is called
+ * 				at a set period. Edges change the pin and call the EXTI capture.
+ * 				Checks clean presses to the uS from a normal start, across the uS
+ * 				stamp wrap and across the ms tick wrap, bounce bursts, glitches,
+ * 				a slow service, pulses either side of the uS limit, expiry, init
+ * 				with a button held, that quiet buttons aren't read, and a release
+ * 				swept across every instruction of the service that settles the
+ * 				press.
+ *
+ */
+// ----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../Src/util.c"
+#include "../Src/iodrv.c"
+
+#define SIM_US_WRAP_TICK				4294917u		/* 50mS before the uS stamp wraps */
+#define SIM_MS_WRAP_TICK				0xFFFFFFE2u		/* 30mS before the tick wraps */
+#define SIM_SETTLED_US					(IODRV_PIN_SETTLE_US + 2000u)
+
+static uint64_t m_simUs;
+static uint64_t m_nextServiceUs;
+static uint32_t m_servicePeriodUs;
+static uint32_t m_tickBase;
+static uint32_t m_buttonReads;
+static volatile bool m_fired;
+static uint8_t m_sweepPin;
+
+
+// ----------------------------------------------------------------------------
+// Stubs
+
+uint32_t HAL_GetTick(void) { return g_hostTick; }
+uint16_t ADC_GetAverageValue(const uint8_t channel) { return 0u; }
+uint16_t ADC_CalibrateValue(const uint16_t value) { return value; }
+
+uint32_t TIMING_STATS_GetTimeUs(void)
+{
+	// Tick in mS and the systick count, the same wrap as the firmware
+	return (g_hostTick * 1000u) + (uint32_t)(m_simUs % 1000u);
+}
+
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin)
+{
+	uint8_t i;
+
+	for (i = 0u; i < IODRV_EDGE_CAPTURE_COUNT; i++)
+	{
+		if ( (m_pins[m_edgeCaptures[i].pin].gpioPort == GPIOx) && (m_pins[m_edgeCaptures[i].pin].gpioPin_bm == GPIO_Pin) )
+		{
+			m_buttonReads++;
+		}
+	}
+
+	return (0u != (GPIOx->IDR & GPIO_Pin)) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+
+void HAL_GPIO_WritePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState)
+{
+	if (GPIO_PIN_RESET != PinState)
+	{
+		GPIOx->ODR |= GPIO_Pin;
+	}
+	else
+	{
+		GPIOx->ODR &= ~GPIO_Pin;
+	}
+}
+
+
+// ----------------------------------------------------------------------------
+// Simulation
+
+static void SimSetTime(const uint64_t us)
+{
+	m_simUs = us;
+	g_hostTick = m_tickBase + (uint32_t)(us / 1000u);
+}
+
+
+static void SimRunTo(const uint64_t us)
+{
+	while (m_nextServiceUs <= us)
+	{
+		SimSetTime(m_nextServiceUs);
+		IODRV_Service(g_hostTick);
+		m_nextServiceUs += m_servicePeriodUs;
+	}
+
+	SimSetTime(us);
+}
+
+
+static void SimSetPin(const uint8_t pin, const bool level)
+{
+	if (true == level)
+	{
+		m_pins[pin].gpioPort->IDR |= m_pins[pin].gpioPin_bm;
+	}
+	else
+	{
+		m_pins[pin].gpioPort->IDR &= ~m_pins[pin].gpioPin_bm;
+	}
+}
+
+
+static bool SimPinLevel(const uint8_t pin)
+{
+	return (0u != (m_pins[pin].gpioPort->IDR & m_pins[pin].gpioPin_bm));
+}
+
+
+// An edge at a time, services in between are run first
+static void SimEdge(const uint8_t pin, const uint64_t us)
+{
+	SimRunTo(us);
+	SimSetPin(pin, !SimPinLevel(pin));
+	IODRV_CaptureEdge(m_pins[pin].gpioPin_bm);
+}
+
+
+static IODRV_EdgeCapture_t * SimCapture(const uint8_t pin)
+{
+	return &m_edgeCaptures[pin - IODRV_PIN_SW1];
+}
+
+
+// Buttons at the levels in heldMask (bit per SW1..SW3), module initialised at
+// tickBase and left to settle
+static void SimReset(const uint32_t tickBase, const uint8_t heldMask, const uint32_t servicePeriodUs)
+{
+	uint8_t i;
+
+	m_tickBase = tickBase;
+	m_servicePeriodUs = servicePeriodUs;
+	m_nextServiceUs = servicePeriodUs;
+	SimSetTime(0u);
+
+	memset(&g_hostGPIO, 0, sizeof(g_hostGPIO));
+	memset(&g_hostEXTI, 0, sizeof(g_hostEXTI));
+
+	for (i = 0u; i < IODRV_MAX_IO_PINS; i++)
+	{
+		IORDV_ClearPinEdges(i);
+		m_pins[i].lastDigitalChangeTime = tickBase;
+		m_pins[i].debounceCounter = 0u;
+	}
+
+	for (i = 0u; i < IODRV_EDGE_CAPTURE_COUNT; i++)
+	{
+		m_edgeCaptures[i].seq = 0u;
+		m_edgeCaptures[i].pending = false;
+		m_edgeCaptures[i].lastChangeUs = tickBase * 1000u;
+		SimSetPin(m_edgeCaptures[i].pin, (0u != (heldMask & (1u << i))));
+	}
+
+	IODRV_Init(g_hostTick);
+	SimRunTo(SIM_SETTLED_US);
+}
+
+
+// The tick at the edge, change times are allowed the mS the stamp was in
+static bool CheckChangeTime(const uint8_t pin, const uint64_t edgeUs)
+{
+	const uint32_t edgeTick = m_tickBase + (uint32_t)(edgeUs / 1000u);
+
+	return ((m_pins[pin].lastDigitalChangeTime - edgeTick) + 1u) <= 2u;
+}
+
+
+static uint32_t WidthMs(const uint64_t us)
+{
+	return (uint32_t)((us + 500u) / 1000u);
+}
+
+
+// ----------------------------------------------------------------------------
+// Tests
+
+// Press and release, then press again, the widths to the uS
+static void TestClean(const uint32_t tickBase)
+{
+	const uint8_t pin = IODRV_PIN_SW1;
+	const uint64_t pressUs = SIM_SETTLED_US + 4321u;
+	const uint64_t releaseUs = pressUs + 187654u;
+	const uint64_t againUs = releaseUs + 412345u;
+
+	SimReset(tickBase, 0u, 1000u);
+	HOST_CHECK(0u == IODRV_ReadPinValue(pin));
+
+	SimEdge(pin, pressUs);
+	SimRunTo(pressUs + IODRV_PIN_SETTLE_US - 1000u);
+	HOST_CHECK(0u == IODRV_ReadPinValue(pin));
+	SimRunTo(pressUs + SIM_SETTLED_US);
+	HOST_CHECK(1u == IODRV_ReadPinValue(pin));
+	HOST_CHECK(true == CheckChangeTime(pin, pressUs));
+
+	SimEdge(pin, releaseUs);
+	SimRunTo(releaseUs + SIM_SETTLED_US);
+	HOST_CHECK(0u == IODRV_ReadPinValue(pin));
+	HOST_CHECK(true == CheckChangeTime(pin, releaseUs));
+	HOST_CHECK((releaseUs - pressUs) == m_pins[pin].lastPosPulseWidthTimeUs);
+	HOST_CHECK(WidthMs(releaseUs - pressUs) == m_pins[pin].lastPosPulseWidthTimeMs);
+
+	SimEdge(pin, againUs);
+	SimRunTo(againUs + SIM_SETTLED_US);
+	HOST_CHECK(1u == IODRV_ReadPinValue(pin));
+	HOST_CHECK((againUs - releaseUs) == m_pins[pin].lastNegPulseWidthTimeUs);
+	HOST_CHECK(WidthMs(againUs - releaseUs) == m_pins[pin].lastNegPulseWidthTimeMs);
+	HOST_CHECK(false == SimCapture(pin)->pending);
+}
+
+
+// Contact bounce on both edges, one change each at the first edge of the burst
+static void TestBounce(const uint32_t tickBase)
+{
+	static const uint32_t pressBounceUs[] = { 0u, 80u, 230u, 900u, 1700u, 4100u, 4150u, 6000u, 6020u };
+	static const uint32_t releaseBounceUs[] = { 0u, 40u, 55u, 600u, 2500u, 2510u, 9000u };
+	const uint8_t pin = IODRV_PIN_SW2;
+	const uint64_t pressUs = SIM_SETTLED_US + 777u;
+	const uint64_t releaseUs = pressUs + 95000u;
+	uint32_t changeTime;
+	uint8_t i;
+
+	SimReset(tickBase, 0u, 1000u);
+
+	for (i = 0u; i < (sizeof(pressBounceUs) / sizeof(pressBounceUs[0u])); i++)
+	{
+		SimEdge(pin, pressUs + pressBounceUs[i]);
+		HOST_CHECK(0u == IODRV_ReadPinValue(pin));
+	}
+
+	HOST_CHECK(true == SimPinLevel(pin));
+
+	// Not before the last bounce has settled
+	SimRunTo(pressUs + 6020u + IODRV_PIN_SETTLE_US - 1000u);
+	HOST_CHECK(0u == IODRV_ReadPinValue(pin));
+	SimRunTo(pressUs + 6020u + SIM_SETTLED_US);
+	HOST_CHECK(1u == IODRV_ReadPinValue(pin));
+	HOST_CHECK(true == CheckChangeTime(pin, pressUs));
+	changeTime = m_pins[pin].lastDigitalChangeTime;
+
+	for (i = 0u; i < (sizeof(releaseBounceUs) / sizeof(releaseBounceUs[0u])); i++)
+	{
+		SimEdge(pin, releaseUs + releaseBounceUs[i]);
+		HOST_CHECK(1u == IODRV_ReadPinValue(pin));
+		HOST_CHECK(changeTime == m_pins[pin].lastDigitalChangeTime);
+	}
+
+	SimRunTo(releaseUs + 9000u + SIM_SETTLED_US);
+	HOST_CHECK(0u == IODRV_ReadPinValue(pin));
+	HOST_CHECK(true == CheckChangeTime(pin, releaseUs));
+	HOST_CHECK((releaseUs - pressUs) == m_pins[pin].lastPosPulseWidthTimeUs);
+	HOST_CHECK(false == SimCapture(pin)->pending);
+}
+
+
+// Bursts that end where they started change nothing
+static void TestGlitch(void)
+{
+	const uint8_t pin = IODRV_PIN_SW3;
+	uint64_t us = SIM_SETTLED_US + 100u;
+	uint32_t changeTime;
+
+	SimReset(1000u, 0u, 1000u);
+	changeTime = m_pins[pin].lastDigitalChangeTime;
+
+	SimEdge(pin, us);
+	SimEdge(pin, us + 50u);
+	SimRunTo(us + SIM_SETTLED_US);
+	HOST_CHECK(0u == IODRV_ReadPinValue(pin));
+	HOST_CHECK(changeTime == m_pins[pin].lastDigitalChangeTime);
+	HOST_CHECK(0u == m_pins[pin].lastPosPulseWidthTimeUs);
+	HOST_CHECK(0u == m_pins[pin].lastNegPulseWidthTimeUs);
+	HOST_CHECK(false == SimCapture(pin)->pending);
+
+	// Same held down, a dropout while pressed
+	us += SIM_SETTLED_US + 1000u;
+	SimEdge(pin, us);
+	SimRunTo(us + SIM_SETTLED_US);
+	HOST_CHECK(1u == IODRV_ReadPinValue(pin));
+	changeTime = m_pins[pin].lastDigitalChangeTime;
+
+	us += 300000u;
+	SimEdge(pin, us);
+	SimEdge(pin, us + 3000u);
+	SimEdge(pin, us + 3010u);
+	SimEdge(pin, us + 3500u);
+	SimRunTo(us + 3500u + SIM_SETTLED_US);
+	HOST_CHECK(1u == IODRV_ReadPinValue(pin));
+	HOST_CHECK(changeTime == m_pins[pin].lastDigitalChangeTime);
+	HOST_CHECK(0u == m_pins[pin].lastPosPulseWidthTimeUs);
+}
+
+
+// A burst that keeps going is held off until it stops
+static void TestLongBurst(void)
+{
+	const uint8_t pin = IODRV_PIN_SW1;
+	const uint64_t startUs = SIM_SETTLED_US + 250u;
+	uint64_t us = startUs;
+	uint8_t i;
+
+	SimReset(1000u, 0u, 1000u);
+
+	for (i = 0u; i < 41u; i++)
+	{
+		SimEdge(pin, us);
+		HOST_CHECK(0u == IODRV_ReadPinValue(pin));
+		us += 5000u;
+	}
+
+	us -= 5000u;
+	SimRunTo(us + IODRV_PIN_SETTLE_US - 1000u);
+	HOST_CHECK(0u == IODRV_ReadPinValue(pin));
+	SimRunTo(us + SIM_SETTLED_US);
+	HOST_CHECK(1u == IODRV_ReadPinValue(pin));
+	HOST_CHECK(true == CheckChangeTime(pin, startUs));
+}
+
+
+// Service late by a lot more than the settle time, time stamps still exact
+static void TestSlowService(void)
+{
+	const uint8_t pin = IODRV_PIN_SW2;
+	const uint64_t pressUs = 300000u + 12345u;
+	const uint64_t releaseUs = pressUs + 600000u + 678u;
+
+	SimReset(1000u, 0u, 250000u);
+	SimRunTo(300000u);
+
+	SimEdge(pin, pressUs);
+	SimEdge(pin, pressUs + 900u);
+	SimEdge(pin, pressUs + 1900u);
+	SimRunTo(pressUs + 300000u);
+	HOST_CHECK(1u == IODRV_ReadPinValue(pin));
+	HOST_CHECK(true == CheckChangeTime(pin, pressUs));
+
+	SimEdge(pin, releaseUs);
+	SimRunTo(releaseUs + 300000u);
+	HOST_CHECK(0u == IODRV_ReadPinValue(pin));
+	HOST_CHECK(true == CheckChangeTime(pin, releaseUs));
+	HOST_CHECK((releaseUs - pressUs) == m_pins[pin].lastPosPulseWidthTimeUs);
+}
+
+
+// Either side of where the uS stamps wrap, the longer one falls back to mS
+static void TestLongPulse(const uint64_t holdUs)
+{
+	const uint8_t pin = IODRV_PIN_SW3;
+	const uint64_t pressUs = SIM_SETTLED_US + 5000u;
+	const uint64_t releaseUs = pressUs + holdUs;
+	const uint32_t holdMs = (uint32_t)(holdUs / 1000u);
+
+	SimReset(123456u, 0u, 10000u);
+
+	SimEdge(pin, pressUs);
+	SimRunTo(pressUs + SIM_SETTLED_US + 10000u);
+	HOST_CHECK(1u == IODRV_ReadPinValue(pin));
+
+	SimEdge(pin, releaseUs);
+	SimRunTo(releaseUs + SIM_SETTLED_US + 10000u);
+	HOST_CHECK(0u == IODRV_ReadPinValue(pin));
+	HOST_CHECK(true == CheckChangeTime(pin, releaseUs));
+
+	if (holdMs < IODRV_PULSE_US_MAX_MS)
+	{
+		HOST_CHECK(holdUs == m_pins[pin].lastPosPulseWidthTimeUs);
+		HOST_CHECK(WidthMs(holdUs) == m_pins[pin].lastPosPulseWidthTimeMs);
+	}
+	else
+	{
+		HOST_CHECK(UINT32_MAX == m_pins[pin].lastPosPulseWidthTimeUs);
+		HOST_CHECK((m_pins[pin].lastPosPulseWidthTimeMs - holdMs + 1u) <= 2u);
+	}
+}
+
+
+// Widths are cleared a day after the last change
+static void TestExpiry(void)
+{
+	const uint8_t pin = IODRV_PIN_SW1;
+	const uint64_t pressUs = SIM_SETTLED_US + 1000u;
+	const uint64_t releaseUs = pressUs + 150000u;
+
+	SimReset(0xFFFF0000u, 0u, 1000u);
+
+	SimEdge(pin, pressUs);
+	SimEdge(pin, releaseUs);
+	SimRunTo(releaseUs + SIM_SETTLED_US);
+	HOST_CHECK(150000u == m_pins[pin].lastPosPulseWidthTimeUs);
+
+	m_servicePeriodUs = 1000000u;
+	SimRunTo(releaseUs + (MS_ONE_DAY * 1000ull) - 2000000u);
+	HOST_CHECK(150000u == m_pins[pin].lastPosPulseWidthTimeUs);
+	HOST_CHECK(150u == m_pins[pin].lastPosPulseWidthTimeMs);
+
+	SimRunTo(releaseUs + (MS_ONE_DAY * 1000ull) + 2000000u);
+	HOST_CHECK(0u == m_pins[pin].lastPosPulseWidthTimeUs);
+	HOST_CHECK(0u == m_pins[pin].lastPosPulseWidthTimeMs);
+	HOST_CHECK(0u == m_pins[pin].lastNegPulseWidthTimeUs);
+	HOST_CHECK(0u == m_pins[pin].lastNegPulseWidthTimeMs);
+	HOST_CHECK(0u == IODRV_ReadPinValue(pin));
+}
+
+
+// Buttons that haven't had an edge are never read by the service
+static void TestIdle(void)
+{
+	SimReset(1000u, 0u, 1000u);
+
+	m_buttonReads = 0u;
+	SimRunTo(SIM_SETTLED_US + 5000000u);
+	HOST_CHECK(0u == m_buttonReads);
+
+	SimEdge(IODRV_PIN_SW2, SIM_SETTLED_US + 5000000u);
+	SimRunTo(SIM_SETTLED_US + 6000000u);
+	HOST_CHECK(1u == m_buttonReads);
+	HOST_CHECK(1u == IODRV_ReadPinValue(IODRV_PIN_SW2));
+	HOST_CHECK(0u == IODRV_ReadPinValue(IODRV_PIN_SW1));
+}
+
+
+// Init after a wake with a button held, falling edges enabled
+static void TestInitHeld(void)
+{
+	uint8_t i;
+
+	SimReset(5000u, 0x05u, 1000u);
+
+	HOST_CHECK(1u == IODRV_ReadPinValue(IODRV_PIN_SW1));
+	HOST_CHECK(0u == IODRV_ReadPinValue(IODRV_PIN_SW2));
+	HOST_CHECK(1u == IODRV_ReadPinValue(IODRV_PIN_SW3));
+
+	for (i = 0u; i < IODRV_EDGE_CAPTURE_COUNT; i++)
+	{
+		HOST_CHECK(0u != (EXTI->FTSR & m_pins[m_edgeCaptures[i].pin].gpioPin_bm));
+		HOST_CHECK(false == m_edgeCaptures[i].pending);
+	}
+
+	// Release of the held button
+	SimEdge(IODRV_PIN_SW1, 500000u);
+	SimRunTo(500000u + SIM_SETTLED_US);
+	HOST_CHECK(0u == IODRV_ReadPinValue(IODRV_PIN_SW1));
+	HOST_CHECK(true == CheckChangeTime(IODRV_PIN_SW1, 500000u));
+}
+
+
+// Two buttons with edges interleaved, each keeps its own burst
+static void TestTwoButtons(void)
+{
+	const uint64_t t0 = SIM_SETTLED_US + 3000u;
+
+	SimReset(1000u, 0u, 1000u);
+
+	SimEdge(IODRV_PIN_SW1, t0);
+	SimEdge(IODRV_PIN_SW2, t0 + 5000u);
+	SimEdge(IODRV_PIN_SW1, t0 + 5100u);
+	SimEdge(IODRV_PIN_SW1, t0 + 5200u);
+	SimEdge(IODRV_PIN_SW2, t0 + 17000u);
+	SimEdge(IODRV_PIN_SW2, t0 + 18000u);
+	SimRunTo(t0 + 60000u);
+	HOST_CHECK(1u == IODRV_ReadPinValue(IODRV_PIN_SW1));
+	HOST_CHECK(1u == IODRV_ReadPinValue(IODRV_PIN_SW2));
+	HOST_CHECK(true == CheckChangeTime(IODRV_PIN_SW1, t0));
+	HOST_CHECK(true == CheckChangeTime(IODRV_PIN_SW2, t0 + 5000u));
+
+	SimEdge(IODRV_PIN_SW2, t0 + 100000u);
+	SimEdge(IODRV_PIN_SW1, t0 + 130000u);
+	SimEdge(IODRV_PIN_SW1, t0 + 130400u);
+	SimEdge(IODRV_PIN_SW1, t0 + 131000u);
+	SimRunTo(t0 + 200000u);
+	HOST_CHECK(0u == IODRV_ReadPinValue(IODRV_PIN_SW1));
+	HOST_CHECK(0u == IODRV_ReadPinValue(IODRV_PIN_SW2));
+	HOST_CHECK(130000u == m_pins[IODRV_PIN_SW1].lastPosPulseWidthTimeUs);
+	HOST_CHECK(95000u == m_pins[IODRV_PIN_SW2].lastPosPulseWidthTimeUs);
+}
+
+
+static void ReleaseIrq(void)
+{
+	m_fired = true;
+	SimSetPin(m_sweepPin, false);
+	IODRV_CaptureEdge(m_pins[m_sweepPin].gpioPin_bm);
+}
+
+
+// The release lands at every point of the service pass that settles the press.
+// Whatever point, the button ends up released with nothing left pending and the
+// press is either logged with its exact width or dropped whole as a burst that
+// ended where it started, never logged with a wrong width.
+static void TestReleaseSweep(void)
+{
+	const uint64_t pressUs = SIM_SETTLED_US + 500u;
+	uint32_t n;
+	uint32_t kept = 0u;
+	uint32_t dropped = 0u;
+	uint64_t settleUs;
+	IODRV_Pin_t * p_pin;
+
+	m_sweepPin = IODRV_PIN_SW2;
+	p_pin = &m_pins[m_sweepPin];
+
+	if (false == HOST_InterruptAfter(0u, ReleaseIrq))
+	{
+		printf("test_iodrv: SKIP release sweep, host can't single step\n");
+		return;
+	}
+
+	HOST_InterruptAfter(0u, NULL);
+
+	for (n = 1u; ; n++)
+	{
+		SimReset(SIM_US_WRAP_TICK, 0u, 1000u);
+		SimEdge(m_sweepPin, pressUs);
+
+		// First service pass that sees the press settled
+		settleUs = ((pressUs + IODRV_PIN_SETTLE_US + 999u) / 1000u) * 1000u;
+		SimRunTo(settleUs - 1u);
+		SimSetTime(settleUs);
+		m_nextServiceUs = settleUs + m_servicePeriodUs;
+
+		m_fired = false;
+		HOST_InterruptAfter(n, ReleaseIrq);
+		IODRV_Service(g_hostTick);
+		HOST_InterruptAfter(0u, NULL);
+
+		if (false == m_fired)
+		{
+			// Release after the pass, the press was logged and its width is
+			// checked by the other tests
+			HOST_CHECK(1u == p_pin->value);
+			break;
+		}
+
+		SimRunTo(settleUs + 100000u);
+
+		HOST_CHECK(0u == p_pin->value);
+		HOST_CHECK(false == SimCapture(m_sweepPin)->pending);
+
+		if (0u != p_pin->lastPosPulseWidthTimeUs)
+		{
+			HOST_CHECK((settleUs - pressUs) == p_pin->lastPosPulseWidthTimeUs);
+			HOST_CHECK(true == CheckChangeTime(m_sweepPin, settleUs));
+			kept++;
+		}
+		else
+		{
+			dropped++;
+		}
+	}
+
+	printf("test_iodrv: release swept over %u instructions of the settling service, press logged at %u, dropped at %u\n",
+			n - 1u, kept, dropped);
+}
+
+
+int main(void)
+{
+	TestClean(1000u);
+	TestClean(SIM_US_WRAP_TICK);
+	TestClean(SIM_MS_WRAP_TICK);
+	TestBounce(1000u);
+	TestBounce(SIM_US_WRAP_TICK);
+	TestBounce(SIM_MS_WRAP_TICK);
+	TestGlitch();
+	TestLongBurst();
+	TestSlowService();
+	TestLongPulse(4200000000ull + 123u);
+	TestLongPulse(4800000000ull + 456u);
+	TestExpiry();
+	TestIdle();
+	TestInitHeld();
+	TestTwoButtons();
+	TestReleaseSweep();
+
+	return HOST_Report("test_iodrv");
+}
@@ -0,0 +1,948 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file		test_isense.c
+ * @date       	18 October 2026
+ * @brief       Load current calibration replayed through the real adc module.
+ * 				Conversion sequences come every 8.2mS from a seeded board trace:
+ * 				load current with steps, sense resistor offset and gain, common
+ * 				and per channel noise with spikes, and the LDO fet drive voltage
+ * 				for the load from the same table the firmware fits. The sequence
+ * 				is built from the trace and the POW_EN and POWDET_EN pins, so the
+ * 				calibration's overrides change what the adc sees. Checks the
+ * 				phase times, captured point, coefficients, fail paths and that the
+ * 				power regulation is put back, then reads other loads back through
+ * 				the new coefficients. Prints the spread of the resistor offset
+ * 				over a set of traces.
+ *
+ */
+// ----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "system_conf.h"
+
+// The factory calibration lives in system memory on the part
+static const uint16_t m_simVrefIntCal = 1526u;
+#undef VREFINT_CAL_ADDR
+#define VREFINT_CAL_ADDR				(&m_simVrefIntCal)
+
+#include "../Src/util.c"
+#include "../Src/ave_filter.c"
+#include "../Src/adc.c"
+#include "../Src/load_current_sense.c"
+
+#define SIM_SEQUENCE_US					8200u	/* TIM15 trigger */
+#define SIM_RAIL_MV						5100u
+#define SIM_JIG_LOAD_MA					52u		/* What the calibration assumes the jig draws */
+#define SIM_FET_OFF_POWDET				2950u	/* Gate pulled up, X is all but 0 */
+#define SIM_FET_VDG_AT_JIG_LOAD			380u	/* Fet gate drive at the jig load, mV */
+#define SIM_RUN_LIMIT_MS				30000u
+#define SIM_SEEDS						8u
+#define SIM_NV_SIZE						256u
+
+typedef struct
+{
+	const char * p_name;
+	uint32_t seed;
+	uint16_t loadMa;
+	uint16_t stepMa;			/* Load once the point is taken, if stepAtCheck */
+	bool stepAtCheck;
+	int16_t offsetMa;			/* Sense amplifier offset */
+	double gain;				/* Sense resistor against nominal */
+	double noise;				/* Counts rms, per channel and common */
+	uint16_t spikeEvery;		/* Sequences between spikes on CS2, 0 for none */
+	int8_t temperature;
+	bool fetDead;
+} SIM_Trace_t;
+
+typedef struct
+{
+	bool boostEnabled;			/* What the power source module thinks */
+	bool ldoEnabled;
+	bool powEnPin;
+	bool powDetEnPin;
+	bool ldoMode;				/* Regulator config allows the LDO */
+	uint32_t seed;
+	uint32_t sequenceUs;
+	uint32_t sequences;
+	bool stepped;
+	uint16_t nvWrites;
+} SIM_Board_t;
+
+static SIM_Trace_t m_trace;
+static SIM_Board_t m_board;
+static uint16_t m_nv[SIM_NV_SIZE];
+static bool m_nvValid[SIM_NV_SIZE];
+
+
+// ----------------------------------------------------------------------------
+// Stubs, answered from the board model
+
+ADC_HandleTypeDef hadc;
+DMA_HandleTypeDef hdma_adc;
+
+uint32_t HAL_GetTick(void) { return g_hostTick; }
+HAL_StatusTypeDef HAL_ADC_Init(ADC_HandleTypeDef *hadc) { return HAL_OK; }
+HAL_StatusTypeDef HAL_ADCEx_Calibration_Start(ADC_HandleTypeDef *hadc) { return HAL_OK; }
+HAL_StatusTypeDef HAL_ADC_Start_DMA(ADC_HandleTypeDef *hadc, uint32_t *pData, uint32_t Length) { return HAL_OK; }
+HAL_StatusTypeDef HAL_ADC_Stop_DMA(ADC_HandleTypeDef *hadc) { return HAL_OK; }
+void HAL_DMA_IRQHandler(DMA_HandleTypeDef *hdma) { }
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority) { }
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn) { }
+
+bool POWERSOURCE_IsBoostConverterEnabled(void) { return m_board.boostEnabled; }
+bool POWERSOURCE_IsLDOEnabled(void) { return m_board.ldoEnabled; }
+bool POWERSOURCE_IsVsysEnabled(void) { return false; }
+POWERSOURCE_RPi5VStatus_t POWERSOURCE_GetRPi5VPowerStatus(void) { return RPI5V_DETECTION_STATUS_UNPOWERED; }
+BatteryStatus_T BATTERY_GetStatus(void) { return BAT_STATUS_NORMAL; }
+bool CHARGER_GetRPi5vInputEnable(void) { return false; }
+int16_t ANALOG_GetMCUTemp(void) { return m_trace.temperature; }
+uint16_t ANALOG_Get5VRailMv(void) { return UTIL_FixMul_U32_U16(ADC_TO_5VRAIL_MV_K, ADC_GetCalibratedAverage(ANALOG_CHANNEL_CS1)); }
+
+
+bool IODRV_SetPin(const uint8_t pin, const bool newValue)
+{
+	if (IODRV_PIN_POW_EN == pin)
+	{
+		m_board.powEnPin = newValue;
+	}
+	else if (IODRV_PIN_POWDET_EN == pin)
+	{
+		m_board.powDetEnPin = newValue;
+	}
+
+	return true;
+}
+
+
+// Same rules as power_source.c, the LDO follows the boost converter and the
+// boost converter is left alone if it is already where asked
+void POWERSOURCE_SetLDOEnable(const bool enabled)
+{
+	m_board.ldoEnabled = (true == m_board.ldoMode) && (true == m_board.boostEnabled);
+	IODRV_SetPin(IODRV_PIN_POWDET_EN, m_board.ldoEnabled);
+}
+
+
+void POWERSOURCE_Set5vBoostEnable(const bool enabled)
+{
+	if (m_board.boostEnabled == enabled)
+	{
+		return;
+	}
+
+	m_board.boostEnabled = enabled;
+
+	if (true == enabled)
+	{
+		IODRV_SetPin(IODRV_PIN_POW_EN, true);
+		POWERSOURCE_SetLDOEnable(true);
+	}
+	else
+	{
+		POWERSOURCE_SetLDOEnable(false);
+		IODRV_SetPin(IODRV_PIN_POW_EN, false);
+	}
+}
+
+
+bool NV_WriteVariable_U8(const uint16_t address, const uint8_t var)
+{
+	m_nv[address] = var;
+	m_nvValid[address] = true;
+	m_board.nvWrites++;
+
+	return true;
+}
+
+
+bool NV_ReadVariable_U8(const uint16_t address, uint8_t * const p_var)
+{
+	if (false == m_nvValid[address])
+	{
+		return false;
+	}
+
+	*p_var = (uint8_t)m_nv[address];
+
+	return true;
+}
+
+
+bool NV_WriteVariable_S8(const uint16_t address, const int8_t var)
+{
+	return NV_WriteVariable_U8(address, (uint8_t)var);
+}
+
+
+void NV_WipeVariable(const uint16_t address)
+{
+	m_nvValid[address] = false;
+	m_board.nvWrites++;
+}
+
+
+// ----------------------------------------------------------------------------
+// Board model
+
+static double SimUniform(void)
+{
+	m_board.seed = (m_board.seed * 1664525u) + 1013904223u;
+
+	return (double)(m_board.seed >> 8u) / (double)(1u << 24u);
+}
+
+
+static double SimGauss(void)
+{
+	double sum = 0.0;
+	uint8_t i;
+
+	for (i = 0u; i < 12u; i++)
+	{
+		sum += SimUniform();
+	}
+
+	return sum - 6.0;
+}
+
+
+// The table fit at a table point, linear between points
+static double SimFetX(const double vdg, const int8_t temperature)
+{
+	const double t = temperature;
+	double pos = (vdg - ID_T_POLY_COEFF_VDG_START) / ID_T_POLY_COEFF_VDG_INC;
+	uint16_t idx;
+	double x0;
+	double x1;
+
+	if (pos < 0.0)
+	{
+		pos = 0.0;
+	}
+
+	if (pos >= ID_T_POLY_LAST_COEFF_IDX)
+	{
+		pos = ID_T_POLY_LAST_COEFF_IDX - 1e-9;
+	}
+
+	idx = (uint16_t)pos;
+	x0 = (a[idx] * t * t) + (b[idx] * t) + c[idx];
+	x1 = (a[idx + 1u] * t * t) + (b[idx + 1u] * t) + c[idx + 1u];
+
+	return x0 + ((x1 - x0) * (pos - idx));
+}
+
+
+// Fet drive adc counts for a load, X is taken to scale with the current
+static double SimFetPowDet(const double loadMa)
+{
+	const double target = SimFetX(SIM_FET_VDG_AT_JIG_LOAD, m_trace.temperature) * loadMa / SIM_JIG_LOAD_MA;
+	double lo = ID_T_POLY_COEFF_VDG_START;
+	double hi = ID_T_POLY_COEFF_VDG_END;
+	uint8_t i;
+
+	if (loadMa <= 0.0)
+	{
+		return SIM_FET_OFF_POWDET;
+	}
+
+	for (i = 0u; i < 40u; i++)
+	{
+		if (SimFetX((lo + hi) / 2.0, m_trace.temperature) < target)
+		{
+			lo = (lo + hi) / 2.0;
+		}
+		else
+		{
+			hi = (lo + hi) / 2.0;
+		}
+	}
+
+	return (4790.0 - lo) * 65536.0 / ISENSE_POWDET_K;
+}
+
+
+static uint16_t SimCounts(const double value)
+{
+	const double rounded = floor(value + 0.5);
+
+	return (rounded < 0.0) ? 0u : (rounded > 4095.0) ? 4095u : (uint16_t)rounded;
+}
+
+
+static double SimLoadMa(void)
+{
+	if ( (true == m_trace.stepAtCheck) && (ISENSE_CAL_PHASE_CHECK == m_calPhase) )
+	{
+		m_board.stepped = true;
+	}
+
+	return (true == m_board.stepped) ? m_trace.stepMa : m_trace.loadMa;
+}
+
+
+// One conversion sequence into the half the dma just finished
+static void SimSequence(void)
+{
+	uint16_t * const p_vals = &m_adcVals[MAX_ANALOG_CHANNELS];
+	const double railCounts = (true == m_board.powEnPin) ? (SIM_RAIL_MV * 65536.0 / ADC_TO_5VRAIL_MV_K) : 0.0;
+	const double loadMa = (true == m_board.powEnPin) ? SimLoadMa() : 0.0;
+	const double common = m_trace.noise * SimGauss();
+	const double senseCounts = (true == m_board.powEnPin) ?
+			((loadMa * m_trace.gain) + m_trace.offsetMa) / (AVE_FILTER_ELEMENT_COUNT * 20.0) : 0.0;
+	double cs2 = railCounts + common - senseCounts + (m_trace.noise * SimGauss());
+	double powDet = SIM_FET_OFF_POWDET;
+
+	if ( (0u != m_trace.spikeEvery) && (0u == (m_board.sequences % m_trace.spikeEvery)) )
+	{
+		cs2 += (0u != ((m_board.sequences / m_trace.spikeEvery) & 1u)) ? 20.0 : -20.0;
+	}
+
+	if ( (true == m_board.powDetEnPin) && (true == m_board.powEnPin) && (false == m_trace.fetDead) )
+	{
+		powDet = SimFetPowDet(loadMa) + (m_trace.noise * SimGauss());
+	}
+
+	p_vals[ANALOG_CHANNEL_CS1] = SimCounts(railCounts + common + (m_trace.noise * SimGauss()));
+	p_vals[ANALOG_CHANNEL_CS2] = SimCounts(cs2);
+	p_vals[ANALOG_CHANNEL_VBAT] = 2300u;
+	p_vals[ANALOG_CHANNEL_NTC] = 2048u;
+	p_vals[ANALOG_CHANNEL_POW_DET] = SimCounts(powDet);
+	p_vals[ANALOG_CHANNEL_BATTYPE] = 1000u;
+	p_vals[ANALOG_CHANNEL_IO1] = 0u;
+	p_vals[ANALOG_CHANNEL_MPUTEMP] = 1700u;
+	p_vals[ANALOG_CHANNEL_INTREF] = SimCounts(m_simVrefIntCal + (0.5 * m_trace.noise * SimGauss()));
+
+	m_board.sequences++;
+
+	HAL_ADC_ConvCpltCallback(&hadc);
+}
+
+
+static void SimTick(void)
+{
+	g_hostTick++;
+
+	m_board.sequenceUs += 1000u;
+
+	if (m_board.sequenceUs >= SIM_SEQUENCE_US)
+	{
+		m_board.sequenceUs -= SIM_SEQUENCE_US;
+		SimSequence();
+	}
+
+	ADC_Service(g_hostTick);
+	ISENSE_Task();
+}
+
+
+static void SimRunMs(const uint32_t ms)
+{
+	uint32_t i;
+
+	for (i = 0u; i < ms; i++)
+	{
+		SimTick();
+	}
+}
+
+
+// Board powered from the battery through the boost converter and LDO, adc running
+static void SimReset(const SIM_Trace_t * const p_trace, const bool boostOn)
+{
+	m_trace = *p_trace;
+
+	memset(&m_board, 0, sizeof(m_board));
+	memset(m_nv, 0, sizeof(m_nv));
+	memset(m_nvValid, 0, sizeof(m_nvValid));
+
+	m_board.seed = p_trace->seed;
+	m_board.ldoMode = true;
+	m_board.boostEnabled = boostOn;
+	m_board.ldoEnabled = boostOn;
+	m_board.powEnPin = boostOn;
+	m_board.powDetEnPin = boostOn;
+
+	g_hostTick = 0xFFFFF000u;
+
+	ADC_Init(g_hostTick);
+	ISENSE_Init();
+
+	SimRunMs(2000u);
+}
+
+
+static bool SimCalibrate(const ISENSE_CalMode_t mode)
+{
+	uint32_t ms = 0u;
+
+	if (false == ISENSE_StartCalibration(mode))
+	{
+		return false;
+	}
+
+	while ( (ISENSE_CAL_STATUS_BUSY == ISENSE_GetCalibrationStatus()) && (ms < SIM_RUN_LIMIT_MS) )
+	{
+		SimTick();
+		ms++;
+	}
+
+	return (ISENSE_CAL_STATUS_BUSY != ISENSE_GetCalibrationStatus());
+}
+
+
+static uint16_t SimReadU16(const uint8_t * const p_data)
+{
+	return (uint16_t)(p_data[0u] | (p_data[1u] << 8u));
+}
+
+
+// Load current from each source averaged over whole readings
+static int32_t SimAverageMa(int16_t (*p_read)(void), const uint32_t seconds)
+{
+	int32_t total = 0;
+	uint32_t i;
+
+	for (i = 0u; i < seconds; i++)
+	{
+		SimRunMs(1000u);
+		total += p_read();
+	}
+
+	return (total + ((total < 0) ? -(int32_t)(seconds / 2u) : (int32_t)(seconds / 2u))) / (int32_t)seconds;
+}
+
+
+static int16_t SimFetMa(void) { return (int16_t)ISENSE_GetFetMa(); }
+
+static bool Within(const int32_t value, const int32_t expected, const int32_t tolerance)
+{
+	return (value >= (expected - tolerance)) && (value <= (expected + tolerance));
+}
+
+
+// ----------------------------------------------------------------------------
+// Reference model, the fitted coefficients the Q16 tables were made from and
+// the formulas of the float code they replaced, in double
+
+static const double m_refA[ID_T_POLY_COEFF_LEN] =
+{
+		0.00672, 0.0065, 0.00628, 0.00606, 0.00584, 0.00562, 0.0054, 0.00518,
+		0.00496, 0.00474, 0.00452, 0.0043, 0.00408, 0.00386, 0.00364, 0.00342,
+		0.0032, 0.00298, 0.00276, 0.00254, 0.00232, 0.0021, 0.00188, 0.00166,
+		0.00144, 0.00122, 0.001, 0.00065, 0.0003, 0.0,-0.0051,-0.0092,-0.0139,
+		-0.0193,-0.0254,-0.0323,-0.0399,-0.0483,-0.0576,-0.0677,-0.0788,-0.0909,-0.104,
+		-0.1181,-0.1311,-0.1458,-0.1612,-0.1774,-0.1945,-0.2123,-0.231,-0.2506,-0.271,
+		-0.2922,-0.3144,-0.3374,-0.3614
+};
+
+static const double m_refB[ID_T_POLY_COEFF_LEN] =
+{
+		0.2169,0.1571,0.1201,0.1042,0.1078,0.1295,0.1676,0.2207,0.2872,0.3655,0.4541,
+		0.5514,0.3989,0.4694,0.5615,0.6495,0.7352,0.8204,0.9068,0.9962,1.0904,1.1911,
+		1.3001,1.4193,1.5503,1.695,1.8551,2.0323,2.2286,2.4456,3.0549,3.5263,4.0515,
+		4.6335,5.2757,5.981,6.7528,7.5942,8.5084,9.4986,10.568,11.719,12.957,14.282,
+		15.501,16.858,18.278,19.763,21.312,22.926,24.607,26.354,28.169,30.052,32.004,
+		34.025,36.117
+};
+
+static const double m_refC[ID_T_POLY_COEFF_LEN] =
+{
+		-8.2299,-4.4796,-1.6241,0.4295,1.774,2.5026,2.708,2.4833,1.9213,1.115,0.1574,
+		-0.8587,3.632,3.669,4.126,5.003,6.3,8.017,10.154,12.711,15.688,19.085,22.902,
+		27.139,31.796,36.873,42.37,48.287,54.624,61.381,68.558,76.155,84.172,92.609,
+		101.47,110.74,120.44,130.56,141.09,152.05,163.43,175.23,187.44,200.08,217.37,
+		234.16,252.12,271.29,291.73,313.5,336.64,361.2,387.24,414.82,443.99,474.79,507.28
+};
+
+
+// Row the module picks for a fet drive reading
+static uint16_t RefRow(const uint16_t fetDrvAdc)
+{
+	const uint16_t fetDrvConv = UTIL_FixMul_U32_U16(ISENSE_POWDET_K, fetDrvAdc);
+	const uint16_t vdg = (fetDrvConv > 4790u) ? 0u : 4790u - fetDrvConv;
+	uint16_t row = (vdg >= ID_T_POLY_COEFF_VDG_START) ?
+					( (vdg - ID_T_POLY_COEFF_VDG_START) + (ID_T_POLY_COEFF_VDG_INC / 2u) ) / ID_T_POLY_COEFF_VDG_INC :
+					0u;
+
+	return (row > ID_T_POLY_LAST_COEFF_IDX) ? ID_T_POLY_LAST_COEFF_IDX : row;
+}
+
+
+static double RefFetX(const uint16_t fetDrvAdc, const int8_t temperature)
+{
+	const uint16_t row = RefRow(fetDrvAdc);
+	const double result = (m_refA[row] * temperature * temperature) + (m_refB[row] * temperature) + m_refC[row];
+
+	return (result > 0.0) ? result : 0.0;
+}
+
+
+// ----------------------------------------------------------------------------
+// Tests
+
+static const SIM_Trace_t m_quiet = {"quiet", 1u, SIM_JIG_LOAD_MA, 0u, false, 30, 1.0, 0.5, 0u, 25, false};
+static const SIM_Trace_t m_noisy = {"noisy", 2u, SIM_JIG_LOAD_MA, 0u, false, 30, 1.0, 1.5, 37u, 25, false};
+
+
+static void CheckPowerPutBack(const bool boostOn)
+{
+	HOST_CHECK(boostOn == m_board.boostEnabled);
+	HOST_CHECK(boostOn == m_board.ldoEnabled);
+	HOST_CHECK(boostOn == m_board.powEnPin);
+	HOST_CHECK(boostOn == m_board.powDetEnPin);
+	HOST_CHECK(FILTER_PERIOD_MS_ISENSE == m_currentSenseFilter.filterPeriodMs);
+}
+
+
+static void TestLoadPass(const SIM_Trace_t * const p_trace)
+{
+	const uint32_t phaseMs = ADC_GetSettleTimeMs(ANALOG_CHANNEL_CS1)
+			+ (ISENSE_CAL_FILTER_PERIOD_MS * AVE_FILTER_S32_GetSettleCount(&m_currentSenseFilter)) + ISENSE_UPDATE_PERIOD;
+	static const uint16_t readBackMa[] = {20u, 100u, 200u, 400u};
+	uint8_t data[ISENSE_CAL_READ_LEN];
+	uint16_t len;
+	int32_t fetMa;
+	uint8_t i;
+
+	SimReset(p_trace, true);
+
+	HOST_CHECK(true == SimCalibrate(ISENSE_CAL_MODE_LOAD));
+
+	ISENSE_GetCalibrationData(data, &len);
+
+	HOST_CHECK(ISENSE_CAL_READ_LEN == len);
+	HOST_CHECK(ISENSE_CAL_STATUS_PASS == data[0u]);
+	HOST_CHECK(ISENSE_CAL_FAIL_NONE == data[3u]);
+	HOST_CHECK((data[4u] == m_kta) && (data[5u] == m_ktb));
+
+	// Each phase ends on the tick after its wait
+	HOST_CHECK(SimReadU16(&data[14u]) >= phaseMs);
+	HOST_CHECK(SimReadU16(&data[14u]) <= (phaseMs + 4u));
+
+	// Rail read with the LDO off, fet drive from the load
+	HOST_CHECK(Within(m_calPoints[ISENSE_CAL_POINT_MID].vBoost, SIM_RAIL_MV, 10));
+	HOST_CHECK(Within(m_calPoints[ISENSE_CAL_POINT_MID].iFet, (int32_t)(SimFetPowDet(SIM_JIG_LOAD_MA) + 0.5),
+			1 + (int32_t)(2.0 * p_trace->noise)));
+	HOST_CHECK(p_trace->temperature == m_calPoints[ISENSE_CAL_POINT_MID].temperature);
+
+	// Check reading from the new coefficients in the window
+	HOST_CHECK(Within(SimReadU16(&data[12u]), SIM_JIG_LOAD_MA, 3));
+
+	// Written and read back
+	HOST_CHECK((true == m_nvValid[VDG_ILOAD_CALIB_KTA_NV_ADDR]) && (m_kta == m_nv[VDG_ILOAD_CALIB_KTA_NV_ADDR]));
+	HOST_CHECK((true == m_nvValid[VDG_ILOAD_CALIB_KTB_NV_ADDR]) && (m_ktb == m_nv[VDG_ILOAD_CALIB_KTB_NV_ADDR]));
+	HOST_CHECK(true == m_nvValid[RES_ILOAD_CALIB_ZERO_NV_ADDR]);
+	HOST_CHECK((false == m_nvValid[ISENSE_RES_SPAN_L]) && (false == m_nvValid[ISENSE_RES_SPAN_H]));
+	HOST_CHECK(0x10000u == m_resLoadCurrCalibScale_K);
+
+	CheckPowerPutBack(true);
+
+	// Other loads read back through the fet drive
+	for (i = 0u; i < (sizeof(readBackMa) / sizeof(readBackMa[0u])); i++)
+	{
+		m_trace.loadMa = readBackMa[i];
+
+		fetMa = SimAverageMa(SimFetMa, 4u);
+
+		HOST_CHECK(Within(fetMa, readBackMa[i], 2 + (readBackMa[i] * 12) / 100));
+		HOST_CHECK(fetMa == ISENSE_GetLoadCurrentMa());
+
+		printf("%s trace, kta %u ktb %u, %umA reads %dmA on the fet drive\n", p_trace->p_name,
+				m_kta, m_ktb, readBackMa[i], (int)fetMa);
+	}
+}
+
+
+// The offset is the one thing taken from the noisy sense resistor
+static void TestOffsetSpread(const SIM_Trace_t * const p_base)
+{
+	SIM_Trace_t trace = *p_base;
+	int32_t offset[SIM_SEEDS];
+	int32_t total = 0;
+	int32_t lo = INT16_MAX;
+	int32_t hi = INT16_MIN;
+	uint8_t i;
+
+	for (i = 0u; i < SIM_SEEDS; i++)
+	{
+		trace.seed = p_base->seed + (i * 7919u);
+
+		SimReset(&trace, true);
+
+		HOST_CHECK(true == SimCalibrate(ISENSE_CAL_MODE_LOAD));
+		HOST_CHECK(ISENSE_CAL_STATUS_PASS == ISENSE_GetCalibrationStatus());
+
+		offset[i] = m_resLoadCurrCalibOffset - (SIM_JIG_LOAD_MA - 51);
+		total += offset[i];
+		lo = (offset[i] < lo) ? offset[i] : lo;
+		hi = (offset[i] > hi) ? offset[i] : hi;
+	}
+
+	printf("%s traces, resistor offset %dmA found as %dmA mean, %dmA to %dmA over %u traces\n", p_base->p_name,
+			p_base->offsetMa, (int)(total / (int32_t)SIM_SEEDS), (int)lo, (int)hi, SIM_SEEDS);
+
+	if (p_base->noise <= m_quiet.noise)
+	{
+		HOST_CHECK(Within(total / (int32_t)SIM_SEEDS, p_base->offsetMa, 12));
+		HOST_CHECK(Within(lo, p_base->offsetMa, 60) && Within(hi, p_base->offsetMa, 60));
+	}
+}
+
+
+static void TestFailCheck(void)
+{
+	SIM_Trace_t trace = m_quiet;
+	uint8_t data[ISENSE_CAL_READ_LEN];
+	uint16_t len;
+	uint32_t offsetMs;
+
+	// Jig load steps up while the check waits, started at every point of the
+	// load current update period
+	trace.stepMa = 80u;
+	trace.stepAtCheck = true;
+
+	for (offsetMs = 0u; offsetMs < ISENSE_UPDATE_PERIOD; offsetMs += 5u)
+	{
+		SimReset(&trace, true);
+		SimRunMs(offsetMs);
+
+		HOST_CHECK(true == SimCalibrate(ISENSE_CAL_MODE_LOAD));
+
+		ISENSE_GetCalibrationData(data, &len);
+
+		HOST_CHECK(ISENSE_CAL_STATUS_FAIL == data[0u]);
+		HOST_CHECK(ISENSE_CAL_FAIL_CHECK == data[3u]);
+		HOST_CHECK((int16_t)SimReadU16(&data[12u]) > ISENSE_CAL_CHECK_MAX_MA);
+
+		CheckPowerPutBack(true);
+	}
+
+	// Jig load missing
+	trace = m_quiet;
+	trace.loadMa = 25u;
+
+	SimReset(&trace, true);
+
+	HOST_CHECK(true == SimCalibrate(ISENSE_CAL_MODE_LOAD));
+
+	ISENSE_GetCalibrationData(data, &len);
+
+	// Coefficients are fitted to 52mA whatever the jig draws, the check can't see it
+	HOST_CHECK(ISENSE_CAL_STATUS_PASS == data[0u]);
+	HOST_CHECK((int16_t)SimReadU16(&data[12u]) >= ISENSE_CAL_CHECK_MIN_MA);
+	HOST_CHECK((int16_t)SimReadU16(&data[12u]) <= ISENSE_CAL_CHECK_MAX_MA);
+}
+
+
+static void TestFailFetDrive(void)
+{
+	SIM_Trace_t trace = m_quiet;
+	uint8_t data[ISENSE_CAL_READ_LEN];
+	uint16_t len;
+
+	trace.fetDead = true;
+
+	SimReset(&trace, true);
+
+	m_kta = 0x55u;
+	m_ktb = 0x66u;
+
+	HOST_CHECK(true == SimCalibrate(ISENSE_CAL_MODE_LOAD));
+
+	ISENSE_GetCalibrationData(data, &len);
+
+	HOST_CHECK(ISENSE_CAL_STATUS_FAIL == data[0u]);
+	HOST_CHECK(ISENSE_CAL_FAIL_RANGE == data[3u]);
+
+	// Nothing written
+	HOST_CHECK((0x55u == m_kta) && (0x66u == m_ktb));
+	HOST_CHECK(0u == m_board.nvWrites);
+
+	CheckPowerPutBack(true);
+}
+
+
+static void TestFailPowerChanged(void)
+{
+	uint8_t data[ISENSE_CAL_READ_LEN];
+	uint16_t len;
+	uint8_t phase;
+
+	for (phase = ISENSE_CAL_PHASE_RAIL; phase <= ISENSE_CAL_PHASE_ISENSE; phase++)
+	{
+		SimReset(&m_quiet, true);
+
+		ISENSE_StartCalibration(ISENSE_CAL_MODE_LOAD);
+
+		while (m_calPhase != phase)
+		{
+			SimTick();
+		}
+
+		SimRunMs(100u);
+
+		// Battery low cut takes the boost converter away
+		POWERSOURCE_Set5vBoostEnable(false);
+
+		SimTick();
+
+		ISENSE_GetCalibrationData(data, &len);
+
+		HOST_CHECK(ISENSE_CAL_STATUS_FAIL == data[0u]);
+		HOST_CHECK(ISENSE_CAL_FAIL_POWER_CHANGED == data[3u]);
+		HOST_CHECK(0u == m_board.nvWrites);
+
+		// Put back to what it was at the start
+		CheckPowerPutBack(true);
+	}
+}
+
+
+static void TestAbort(void)
+{
+	uint8_t phase;
+
+	for (phase = ISENSE_CAL_PHASE_FILTER_READY; phase <= ISENSE_CAL_PHASE_CHECK; phase++)
+	{
+		SimReset(&m_quiet, false);
+
+		ISENSE_StartCalibration(ISENSE_CAL_MODE_LOAD);
+
+		while ( (m_calPhase != phase) && (ISENSE_CAL_STATUS_BUSY == m_calStatus) )
+		{
+			SimTick();
+		}
+
+		SimRunMs(50u);
+
+		ISENSE_AbortCalibration();
+
+		HOST_CHECK(ISENSE_CAL_STATUS_IDLE == ISENSE_GetCalibrationStatus());
+
+		// Load point written before the check
+		HOST_CHECK((ISENSE_CAL_PHASE_CHECK == phase) == (0u != m_board.nvWrites));
+
+		// Boost converter forced on by the calibration is switched off again
+		CheckPowerPutBack(false);
+	}
+}
+
+
+// Points taken with the boost converter off, then the span written
+static void TestSpan(void)
+{
+	SIM_Trace_t trace = m_quiet;
+	uint8_t data[ISENSE_CAL_READ_LEN];
+	uint16_t len;
+	int32_t resMa;
+	int32_t spanK;
+
+	trace.offsetMa = 40;
+	trace.gain = 1.08;
+
+	SimReset(&trace, false);
+
+	// Not enough points
+	HOST_CHECK(false == ISENSE_WriteNVCalibration());
+
+	m_trace.loadMa = 51u;
+
+	HOST_CHECK(true == SimCalibrate(ISENSE_CAL_MODE_51MA));
+	HOST_CHECK(ISENSE_CAL_STATUS_PASS == ISENSE_GetCalibrationStatus());
+	CheckPowerPutBack(false);
+
+	ISENSE_GetCalibrationData(data, &len);
+
+	// No check phase when a point is taken
+	HOST_CHECK(SimReadU16(&data[14u]) <= (ADC_GetSettleTimeMs(ANALOG_CHANNEL_CS1)
+			+ (ISENSE_CAL_FILTER_PERIOD_MS * AVE_FILTER_ELEMENT_COUNT) + 3u));
+
+	m_trace.loadMa = 510u;
+
+	HOST_CHECK(true == SimCalibrate(ISENSE_CAL_MODE_510MA));
+	HOST_CHECK(ISENSE_CAL_STATUS_PASS == ISENSE_GetCalibrationStatus());
+	CheckPowerPutBack(false);
+
+	HOST_CHECK(true == ISENSE_WriteNVCalibration());
+	HOST_CHECK((true == m_nvValid[ISENSE_RES_SPAN_L]) && (true == m_nvValid[ISENSE_RES_SPAN_H]));
+
+	// Span from two 16 sample points, each has the resistor noise
+	spanK = (int32_t)m_resLoadCurrCalibScale_K;
+	HOST_CHECK(Within(spanK, (int32_t)(65536.0 / trace.gain), (int32_t)(6553.6 / trace.gain)));
+
+	// Read a load through the resistor with the boost converter back on
+	POWERSOURCE_Set5vBoostEnable(true);
+	m_trace.loadMa = 300u;
+
+	SimRunMs(2000u);
+	resMa = SimAverageMa(ISENSE_GetSenseResistorMa, 20u);
+
+	printf("resistor gain %.2f offset %dmA, span K 0x%05x, 300mA reads %dmA on the resistor\n",
+			trace.gain, trace.offsetMa, (unsigned)spanK, (int)resMa);
+
+	HOST_CHECK(Within(resMa, 300, 30));
+
+	// Points used up
+	HOST_CHECK(false == ISENSE_WriteNVCalibration());
+}
+
+
+// Q16 tables against the fitted values and the float quadratic over every fet
+// drive reading and temperature, the current factor rounding, and the integer
+// calibration coefficients against the float formulas in double precision
+static void TestTables(void)
+{
+	static const uint16_t loadsMa[] = {50u, 51u, 510u};
+	double maxErr = 0.0;
+	double maxErrRange = 0.0;
+	double err;
+	double ref;
+	double k12;
+	double refKta;
+	double refKtb;
+	uint32_t factorPoints = 0u;
+	uint32_t factorDiffs = 0u;
+	uint32_t coeffPoints = 0u;
+	uint32_t coeffExact = 0u;
+	ISENSE_CalPoint_t point;
+	uint32_t fetX;
+	int64_t wide;
+	uint16_t row;
+	uint16_t adc;
+	int32_t t;
+	uint8_t kta;
+	uint8_t ktb;
+	uint8_t i;
+
+	for (row = 0u; row < ID_T_POLY_COEFF_LEN; row++)
+	{
+		HOST_CHECK(a[row] == (int32_t)lround(m_refA[row] * 65536.0));
+		HOST_CHECK(b[row] == (int32_t)lround(m_refB[row] * 65536.0));
+		HOST_CHECK(c[row] == (int32_t)lround(m_refC[row] * 65536.0));
+	}
+
+	for (adc = 0u; adc < 4096u; adc++)
+	{
+		row = RefRow(adc);
+
+		for (t = INT8_MIN; t <= INT8_MAX; t++)
+		{
+			fetX = ISENSE_ConvertFETDrvToX(adc, (int8_t)t);
+			ref = RefFetX(adc, (int8_t)t);
+
+			// Same sum without the int32 limit
+			wide = ((int64_t)a[row] * t * t) + ((int64_t)b[row] * t) + c[row];
+			HOST_CHECK(fetX == ((wide > 0) ? (uint32_t)wide : 0u));
+
+			// No more than the rounding of the three coefficients
+			err = fabs((fetX / 65536.0) - ref);
+			HOST_CHECK(err <= (((t * t) + abs(t) + 1) * 0.5 / 65536.0));
+			maxErr = (err > maxErr) ? err : maxErr;
+
+			if ( (t < -40) || (t > 85) )
+			{
+				continue;
+			}
+
+			maxErrRange = (err > maxErrRange) ? err : maxErrRange;
+
+			// The current factor, only differs where the reference is next to .5
+			factorPoints++;
+
+			if ((int32_t)((fetX + (1ul << (ID_T_POLY_COEFF_Q - 1u))) >> ID_T_POLY_COEFF_Q) != (int32_t)(ref + 0.5))
+			{
+				factorDiffs++;
+				HOST_CHECK(fabs((ref - floor(ref)) - 0.5) <= err);
+			}
+		}
+	}
+
+	for (i = 0u; i < (sizeof(loadsMa) / sizeof(loadsMa[0u])); i++)
+	{
+		for (adc = 0u; adc < 4096u; adc += 4u)
+		{
+			for (t = -20; t <= 85; t++)
+			{
+				point.iFet = adc;
+				point.temperature = (uint8_t)t;
+				ref = RefFetX(adc, (int8_t)t);
+
+				if (ref < 0.5)
+				{
+					continue;
+				}
+
+				k12 = loadsMa[i] / (ref * ((0.0052 * t) + 0.9376));
+				refKta = 0.0052 * k12 * 8192.0;
+				refKtb = 0.9376 * k12 * 32.0;
+
+				if ( (refKta > 254.0) || (refKtb > 254.0) )
+				{
+					HOST_CHECK( (false == ISENSE_CalculateFETDriveCoeffs(&point, loadsMa[i], &kta, &ktb)) ||
+								(refKta > 255.0) || (refKtb > 255.0) || (kta >= 253u) || (ktb >= 253u) );
+					continue;
+				}
+
+				coeffPoints++;
+				HOST_CHECK(true == ISENSE_CalculateFETDriveCoeffs(&point, loadsMa[i], &kta, &ktb));
+				HOST_CHECK(fabs(kta - refKta) < 1.0 + (refKta * 1e-3));
+				HOST_CHECK(fabs(ktb - refKtb) < 1.0 + (refKtb * 1e-3));
+
+				if ( (kta == (uint8_t)refKta) && (ktb == (uint8_t)refKtb) )
+				{
+					coeffExact++;
+				}
+			}
+		}
+	}
+
+	printf("test_isense: Q16 fet drive tables, max error %.4f, %.4f at -40..85C, rounded factor differs at %u of %u points\n",
+			maxErr, maxErrRange, factorDiffs, factorPoints);
+	printf("test_isense: calibration coefficients at %u points, %u same as the float formulas truncated\n",
+			coeffPoints, coeffExact);
+}
+
+
+static void TestStartChecks(void)
+{
+	SimReset(&m_quiet, true);
+
+	HOST_CHECK(false == ISENSE_StartCalibration((ISENSE_CalMode_t)(ISENSE_CAL_MODE_510MA + 1u)));
+	HOST_CHECK(ISENSE_CAL_STATUS_IDLE == ISENSE_GetCalibrationStatus());
+	HOST_CHECK(false == ISENSE_IsCalibrating());
+
+	HOST_CHECK(true == ISENSE_StartCalibration(ISENSE_CAL_MODE_LOAD));
+	HOST_CHECK(true == ISENSE_IsCalibrating());
+
+	SimRunMs(100u);
+
+	// Restarting goes back to the start with the power put back
+	HOST_CHECK(ISENSE_CAL_PHASE_RAIL == m_calPhase);
+	HOST_CHECK(true == ISENSE_StartCalibration(ISENSE_CAL_MODE_LOAD));
+	HOST_CHECK(ISENSE_CAL_PHASE_FILTER_READY == m_calPhase);
+	HOST_CHECK(FILTER_PERIOD_MS_ISENSE == m_currentSenseFilter.filterPeriodMs);
+
+	ISENSE_AbortCalibration();
+}
+
+
+int main(void)
+{
+	TestTables();
+	TestStartChecks();
+	TestLoadPass(&m_quiet);
+	TestLoadPass(&m_noisy);
+	TestOffsetSpread(&m_quiet);
+	TestOffsetSpread(&m_noisy);
+	TestFailCheck();
+	TestFailFetDrive();
+	TestFailPowerChanged();
+	TestAbort();
+	TestSpan();
+
+	return HOST_Report("test_isense");
+}
@@ -0,0 +1,496 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file		test_seqlock.c
+ * @date       	18 October 2026
+ * @brief       Stress test of the seqlock snapshots. A writer interrupt is swept
+ * 				across every instruction of a reader, first on a plain shared
+ * 				block, then on the real adc readers against the dma callback and
+ * 				ADC_Service, and every copy the reader accepts has to be the whole
+ * 				of the state from before or after the write. Also sweeps a higher
+ * 				priority SEQLOCK_TryWriteBegin across a lower priority update.
+ *
+ */
+// ----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+
+#include "system_conf.h"
+
+// The factory calibration lives in system memory on the part
+static const uint16_t m_simVrefIntCal = 1526u;
+#undef VREFINT_CAL_ADDR
+#define VREFINT_CAL_ADDR				(&m_simVrefIntCal)
+
+#include "../Src/util.c"
+#include "../Src/ave_filter.c"
+#include "../Src/adc.c"
+
+#define SIM_WORDS						8u
+#define SIM_MAX_STEPS					20000u
+
+
+// ----------------------------------------------------------------------------
+// Stubs
+
+ADC_HandleTypeDef hadc;
+DMA_HandleTypeDef hdma_adc;
+
+uint32_t HAL_GetTick(void) { return g_hostTick; }
+HAL_StatusTypeDef HAL_ADC_Init(ADC_HandleTypeDef *hadc) { return HAL_OK; }
+HAL_StatusTypeDef HAL_ADCEx_Calibration_Start(ADC_HandleTypeDef *hadc) { return HAL_OK; }
+HAL_StatusTypeDef HAL_ADC_Start_DMA(ADC_HandleTypeDef *hadc, uint32_t *pData, uint32_t Length) { return HAL_OK; }
+HAL_StatusTypeDef HAL_ADC_Stop_DMA(ADC_HandleTypeDef *hadc) { return HAL_OK; }
+void HAL_DMA_IRQHandler(DMA_HandleTypeDef *hdma) { }
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority) { }
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn) { }
+
+
+// ----------------------------------------------------------------------------
+// Plain shared block
+
+typedef struct
+{
+	SEQLOCK_t seq;
+	uint32_t value[SIM_WORDS];
+} SIM_Shared_t;
+
+static SIM_Shared_t m_shared;
+static uint32_t m_writeValue;
+static volatile bool m_fired;
+static volatile bool m_irqWriteDone;
+
+static void SharedWrite(const uint32_t value)
+{
+	uint32_t i;
+
+	SEQLOCK_WriteBegin(&m_shared.seq);
+
+	for (i = 0u; i < SIM_WORDS; i++)
+	{
+		m_shared.value[i] = value;
+	}
+
+	SEQLOCK_WriteEnd(&m_shared.seq);
+}
+
+static bool SharedTryWrite(const uint32_t value)
+{
+	uint32_t i;
+
+	if (false == SEQLOCK_TryWriteBegin(&m_shared.seq))
+	{
+		return false;
+	}
+
+	for (i = 0u; i < SIM_WORDS; i++)
+	{
+		m_shared.value[i] = value;
+	}
+
+	SEQLOCK_WriteEnd(&m_shared.seq);
+
+	return true;
+}
+
+static void SharedCopy(uint32_t * const p_copy)
+{
+	uint32_t i;
+
+	for (i = 0u; i < SIM_WORDS; i++)
+	{
+		p_copy[i] = m_shared.value[i];
+	}
+}
+
+static bool SharedWhole(const uint32_t * const p_copy)
+{
+	uint32_t i;
+
+	for (i = 1u; i < SIM_WORDS; i++)
+	{
+		if (p_copy[i] != p_copy[0u])
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void WriterIrq(void)
+{
+	m_fired = true;
+	SharedWrite(m_writeValue);
+}
+
+static void TryWriterIrq(void)
+{
+	m_fired = true;
+	m_irqWriteDone = SharedTryWrite(m_writeValue);
+}
+
+
+// ----------------------------------------------------------------------------
+// Adc state, saved so each sweep point starts from the same place
+
+typedef struct
+{
+	AVE_FILTER_U16_t aveFilters[MAX_ANALOG_CHANNELS];
+	AVE_FILTER_S32_t currentSenseFilter;
+#if ADC_BOXCAR_FILTERS > 0u
+	uint16_t boxcarElements[ADC_BOXCAR_FILTERS][AVE_FILTER_ELEMENT_COUNT];
+#endif
+#if FILTER_TYPE_ISENSE == AVE_FILTER_TYPE_BOXCAR
+	int32_t currentSenseElements[AVE_FILTER_ELEMENT_COUNT];
+#endif
+	uint16_t adcVals[ADC_DMA_SEQUENCES * MAX_ANALOG_CHANNELS];
+	int32_t csTotalDiff;
+	bool newSequence;
+	uint32_t seq;
+	uint32_t refScale;
+} SIM_AdcState_t;
+
+static SIM_AdcState_t m_adcSaved;
+
+static void AdcSave(void)
+{
+	memcpy(m_adcSaved.aveFilters, m_aveFilters, sizeof(m_aveFilters));
+	memcpy(&m_adcSaved.currentSenseFilter, &m_currentSenseFilter, sizeof(m_currentSenseFilter));
+#if ADC_BOXCAR_FILTERS > 0u
+	memcpy(m_adcSaved.boxcarElements, m_boxcarElements, sizeof(m_boxcarElements));
+#endif
+#if FILTER_TYPE_ISENSE == AVE_FILTER_TYPE_BOXCAR
+	memcpy(m_adcSaved.currentSenseElements, m_currentSenseElements, sizeof(m_currentSenseElements));
+#endif
+	memcpy(m_adcSaved.adcVals, m_adcVals, sizeof(m_adcVals));
+	m_adcSaved.csTotalDiff = m_csTotalDiff;
+	m_adcSaved.newSequence = m_newSequence;
+	m_adcSaved.seq = m_adcSeq;
+	m_adcSaved.refScale = m_adcRefScale;
+}
+
+static void AdcRestore(void)
+{
+	memcpy(m_aveFilters, m_adcSaved.aveFilters, sizeof(m_aveFilters));
+	memcpy(&m_currentSenseFilter, &m_adcSaved.currentSenseFilter, sizeof(m_currentSenseFilter));
+#if ADC_BOXCAR_FILTERS > 0u
+	memcpy(m_boxcarElements, m_adcSaved.boxcarElements, sizeof(m_boxcarElements));
+#endif
+#if FILTER_TYPE_ISENSE == AVE_FILTER_TYPE_BOXCAR
+	memcpy(m_currentSenseElements, m_adcSaved.currentSenseElements, sizeof(m_currentSenseElements));
+#endif
+	memcpy(m_adcVals, m_adcSaved.adcVals, sizeof(m_adcVals));
+	m_csTotalDiff = m_adcSaved.csTotalDiff;
+	m_newSequence = m_adcSaved.newSequence;
+	m_adcSeq = m_adcSaved.seq;
+	m_adcRefScale = m_adcSaved.refScale;
+}
+
+static void AdcFill(const uint16_t base)
+{
+	uint8_t i;
+
+	for (i = 0u; i < MAX_ANALOG_CHANNELS; i++)
+	{
+		m_adcVals[MAX_ANALOG_CHANNELS + i] = base + (i * 97u);
+	}
+
+	// Internal reference near its calibration value, current sense a few counts apart
+	m_adcVals[MAX_ANALOG_CHANNELS + ANALOG_CHANNEL_INTREF] = base / 2u;
+	m_adcVals[MAX_ANALOG_CHANNELS + ANALOG_CHANNEL_CS2] = m_adcVals[MAX_ANALOG_CHANNELS + ANALOG_CHANNEL_CS1] - (base / 64u);
+}
+
+static void AdcSequenceIrq(void)
+{
+	m_fired = true;
+	HAL_ADC_ConvCpltCallback(&hadc);
+}
+
+static void AdcServiceIrq(void)
+{
+	m_fired = true;
+	ADC_Service(g_hostTick);
+}
+
+
+// ----------------------------------------------------------------------------
+// Tests
+
+static void TestSharedRetry(void)
+{
+	uint32_t copy[SIM_WORDS];
+	uint32_t seq;
+	uint32_t n;
+	uint32_t points;
+	uint32_t torn = 0u;
+
+	// No seqlock, the sweep has to find torn copies or it isn't reaching the copy
+	for (n = 0u; n < SIM_MAX_STEPS; n++)
+	{
+		SharedWrite(1u);
+		m_writeValue = 2u;
+		m_fired = false;
+
+		HOST_InterruptAfter(n, WriterIrq);
+		SharedCopy(copy);
+		HOST_InterruptAfter(0u, NULL);
+
+		if (false == SharedWhole(copy))
+		{
+			torn++;
+		}
+
+		if (false == m_fired)
+		{
+			break;
+		}
+	}
+
+	HOST_CHECK(torn > 0u);
+	points = n;
+
+	// Reader retries until whole
+	for (n = 0u; n < SIM_MAX_STEPS; n++)
+	{
+		SharedWrite(1u);
+		m_writeValue = 2u;
+		m_fired = false;
+
+		HOST_InterruptAfter(n, WriterIrq);
+
+		do
+		{
+			seq = SEQLOCK_ReadBegin(&m_shared.seq);
+			SharedCopy(copy);
+		} while (true == SEQLOCK_ReadRetry(&m_shared.seq, seq));
+
+		HOST_InterruptAfter(0u, NULL);
+
+		HOST_CHECK(true == SharedWhole(copy));
+		HOST_CHECK( (1u == copy[0u]) || (2u == copy[0u]) );
+
+		if (false == m_fired)
+		{
+			break;
+		}
+	}
+
+	HOST_CHECK(n < SIM_MAX_STEPS);
+
+	printf("test_seqlock: plain copy torn at %u of %u points, seqlock reader whole at all %u\n", (unsigned)torn,
+			(unsigned)points, (unsigned)n);
+}
+
+
+static void TestSharedOneShot(void)
+{
+	uint32_t copy[SIM_WORDS];
+	uint32_t seq;
+	uint32_t n;
+	uint32_t dropped = 0u;
+
+	// An osloop style reader takes one attempt and keeps its last good copy
+	for (n = 0u; n < SIM_MAX_STEPS; n++)
+	{
+		SharedWrite(1u);
+		m_writeValue = 2u;
+		m_fired = false;
+
+		HOST_InterruptAfter(n, WriterIrq);
+		seq = SEQLOCK_ReadBegin(&m_shared.seq);
+		SharedCopy(copy);
+
+		if (true == SEQLOCK_ReadRetry(&m_shared.seq, seq))
+		{
+			dropped++;
+		}
+		else
+		{
+			HOST_CHECK(true == SharedWhole(copy));
+		}
+
+		HOST_InterruptAfter(0u, NULL);
+
+		if (false == m_fired)
+		{
+			break;
+		}
+	}
+
+	HOST_CHECK(dropped > 0u);
+
+	// A reader that lands on an update in progress always drops it
+	SEQLOCK_WriteBegin(&m_shared.seq);
+	seq = SEQLOCK_ReadBegin(&m_shared.seq);
+	HOST_CHECK(true == SEQLOCK_ReadRetry(&m_shared.seq, seq));
+	SEQLOCK_WriteEnd(&m_shared.seq);
+}
+
+
+static void TestTryWrite(void)
+{
+	uint32_t copy[SIM_WORDS];
+	uint32_t n;
+	uint32_t dropped = 0u;
+	bool done;
+
+	// A higher priority writer interrupting a lower priority update drops its
+	// own update, either way the block ends up whole with the counter even
+	for (n = 0u; n < SIM_MAX_STEPS; n++)
+	{
+		SharedWrite(1u);
+		m_writeValue = 3u;
+		m_fired = false;
+		m_irqWriteDone = false;
+
+		HOST_InterruptAfter(n, TryWriterIrq);
+		done = SharedTryWrite(2u);
+		HOST_InterruptAfter(0u, NULL);
+
+		SharedCopy(copy);
+
+		HOST_CHECK(true == done);
+		HOST_CHECK(true == SharedWhole(copy));
+		HOST_CHECK(0u == (m_shared.seq & 1u));
+
+		if (true == m_fired)
+		{
+			if (false == m_irqWriteDone)
+			{
+				dropped++;
+				HOST_CHECK(2u == copy[0u]);
+			}
+			else
+			{
+				// Got in before the update started or after it finished
+				HOST_CHECK( (2u == copy[0u]) || (3u == copy[0u]) );
+			}
+		}
+		else
+		{
+			HOST_CHECK(2u == copy[0u]);
+			break;
+		}
+	}
+
+	HOST_CHECK(dropped > 0u);
+	HOST_CHECK(n < SIM_MAX_STEPS);
+}
+
+
+static void TestAdcSnapshot(void (*p_writer)(void), const char * const p_name)
+{
+	ADC_Snapshot_t before, after, snapshot;
+	uint16_t calBefore, calAfter, cal;
+	int16_t csBefore, csAfter, cs;
+	uint32_t n;
+	uint32_t changed = 0u;
+
+	AdcSave();
+
+	ADC_GetSnapshot(&before);
+	calBefore = ADC_GetCalibratedAverage(ANALOG_CHANNEL_VBAT);
+	csBefore = ADC_GetCurrentSenseAverage();
+
+	p_writer();
+
+	ADC_GetSnapshot(&after);
+	calAfter = ADC_GetCalibratedAverage(ANALOG_CHANNEL_VBAT);
+	csAfter = ADC_GetCurrentSenseAverage();
+
+	HOST_CHECK( (0 != memcmp(&before, &after, sizeof(before))) || (calBefore != calAfter) );
+
+	for (n = 0u; n < SIM_MAX_STEPS; n++)
+	{
+		AdcRestore();
+		m_fired = false;
+
+		HOST_InterruptAfter(n, p_writer);
+		ADC_GetSnapshot(&snapshot);
+		HOST_InterruptAfter(0u, NULL);
+
+		HOST_CHECK( (0 == memcmp(&snapshot, &before, sizeof(snapshot))) || (0 == memcmp(&snapshot, &after, sizeof(snapshot))) );
+
+		if (0 == memcmp(&snapshot, &after, sizeof(snapshot)))
+		{
+			changed++;
+		}
+
+		if (false == m_fired)
+		{
+			break;
+		}
+	}
+
+	HOST_CHECK(n < SIM_MAX_STEPS);
+	HOST_CHECK(changed > 0u);
+
+	for (n = 0u; n < SIM_MAX_STEPS; n++)
+	{
+		AdcRestore();
+		m_fired = false;
+
+		HOST_InterruptAfter(n, p_writer);
+		cal = ADC_GetCalibratedAverage(ANALOG_CHANNEL_VBAT);
+		cs = ADC_GetCurrentSenseAverage();
+		HOST_InterruptAfter(0u, NULL);
+
+		HOST_CHECK( (cal == calBefore) || (cal == calAfter) );
+		HOST_CHECK( (cs == csBefore) || (cs == csAfter) );
+
+		if (false == m_fired)
+		{
+			break;
+		}
+	}
+
+	HOST_CHECK(n < SIM_MAX_STEPS);
+
+	printf("test_seqlock: %s swept over %u reader instructions\n", p_name, (unsigned)n);
+
+	AdcRestore();
+}
+
+
+int main(void)
+{
+	uint32_t i;
+
+	if (false == HOST_InterruptAfter(0u, WriterIrq))
+	{
+		printf("test_seqlock: SKIP, host can't single step\n");
+		return 0;
+	}
+
+	HOST_InterruptAfter(0u, NULL);
+
+	TestSharedRetry();
+	TestSharedOneShot();
+	TestTryWrite();
+
+	// Fill the filters then give them a different sequence, after long enough
+	// that every periodic filter takes it
+	g_hostTick = 1000u;
+	ADC_Init(g_hostTick);
+	AdcFill(2000u);
+
+	for (i = 0u; i < (4u * AVE_FILTER_ELEMENT_COUNT); i++)
+	{
+		g_hostTick += 10u;
+		HAL_ADC_ConvCpltCallback(&hadc);
+		ADC_Service(g_hostTick);
+	}
+
+	HOST_CHECK(true == ADC_GetFilterReady());
+
+	g_hostTick += 1000u;
+	AdcFill(2600u);
+	TestAdcSnapshot(AdcSequenceIrq, "adc dma callback");
+
+	HAL_ADC_ConvCpltCallback(&hadc);
+	g_hostTick += 1000u;
+	TestAdcSnapshot(AdcServiceIrq, "adc service");
+
+	return HOST_Report("test_seqlock");
+}
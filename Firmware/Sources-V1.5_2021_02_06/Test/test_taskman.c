@@ -0,0 +1,837 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file		test_taskman.c
+ * @date       	18 October 2026
+ * @brief       Host test of the taskman stop sleep accounting. The rtc day count
+ * 				is checked against the C library calendar, sleeps are checked
+ * 				across midnight, month end, leap February and year end in 24 and
+ * 				12 hour mode, and the system tick is run through back to back stop
+ * 				sleeps against a simulated rtc to check it doesn't drift.
+ *
+ * 				The loop periods are checked against the adaptive rules, then the
+ * 				real TASKMAN_Run and osloop timer run for a simulated hour in a few
+ * 				battery scenarios, counting wakes, osloop services, task runs and
+ * 				stops with and without adaptive mode. A rough mcu current model
+ * 				turns the counts into an average current.
+ *
+ * 				The real adc runs under the simulation with one conversion
+ * 				sequence per ms, the time until its averages are ready is checked
+ * 				after power on through ADC_Init and after a stop wake through
+ * 				OSLOOP_Restart.
+ *
+ */
+// ----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <setjmp.h>
+#include <string.h>
+#include <time.h>
+
+#include "../Src/taskman.c"
+
+// The factory calibration lives in system memory on the part
+static const uint16_t m_simVrefIntCal = 1526u;
+#undef VREFINT_CAL_ADDR
+#define VREFINT_CAL_ADDR				(&m_simVrefIntCal)
+
+#include "../Src/util.c"
+#include "../Src/ave_filter.c"
+#include "../Src/adc.c"
+
+// osloop.c is built alongside, see the Makefile
+void OSLOOP_TIMER_IRQHandler(void);
+
+#define SIM_EPOCH_2000					946684800ll		/* 1st January 2000 in unix time */
+#define SIM_SLEEPS						10000u
+
+// Loop simulation, mcu currents at 48MHz are STM32F030 datasheet typicals, the
+// run times are rough figures for this firmware
+#define SIM_RUN_MS						(60u * 60u * 1000u)
+#define SIM_RUN_UA						12000u		/* Run mode */
+#define SIM_SLEEP_UA					3000u		/* Sleep mode, peripherals on */
+#define SIM_STOP_UA						15u			/* Stop mode, main regulator on */
+#define SIM_LOOP_US						10u			/* SysTick interrupt and one pass of the taskman loop */
+#define SIM_OSLOOP_US					60u			/* One osloop service */
+#define SIM_TASK_US						1500u		/* One run of the tasks */
+#define SIM_ADC_VALUE					2000u		/* Every channel of a conversion sequence */
+
+typedef struct
+{
+	uint32_t loops;
+	uint32_t osloops;
+	uint32_t tasks;
+	uint32_t stops;
+	uint64_t runUs;
+	uint64_t awakeUs;
+	uint64_t stopUs;
+} SIM_Counts_t;
+
+
+// ----------------------------------------------------------------------------
+// Simulated rtc, counts sub second ticks since 1st January 2000
+
+RTC_HandleTypeDef hrtc;
+IWDG_HandleTypeDef hiwdg;
+ADC_HandleTypeDef hadc;
+DMA_HandleTypeDef hdma_adc;
+__IO uint32_t uwTick;
+
+static uint64_t m_simRtcTicks;
+static uint32_t m_simRtcFraction;
+static uint32_t m_simWakeCounter;
+static uint32_t m_simStopJitter;
+
+static SIM_Counts_t m_sim;
+static jmp_buf m_simEnd;
+static uint32_t m_simEndMs;
+static uint32_t m_simOsloopPhase;
+static uint32_t m_simTaskUs;
+static uint32_t m_simCommandPeriodMs;
+static uint32_t m_simLastCommandMs;
+static uint32_t m_simHostIdleMs;
+static bool m_simCanShutdown;
+static ChargerStatus_T m_simChargerStatus;
+static uint8_t m_simNv[256u];
+static bool m_simNvValid[256u];
+static bool m_simAdcRunning;
+static uint16_t m_simAdcValue = SIM_ADC_VALUE;
+static uint32_t m_simAdcSequences;
+
+static uint32_t SimTicksPerSecond(void)
+{
+	return hrtc.Init.SynchPrediv + 1u;
+}
+
+static void SimToRtc(const uint64_t ticks, RTC_TimeTypeDef * const p_time, RTC_DateTypeDef * const p_date)
+{
+	const time_t t = (time_t)(SIM_EPOCH_2000 + (int64_t)(ticks / SimTicksPerSecond()));
+	struct tm tm;
+
+	gmtime_r(&t, &tm);
+
+	if (NULL != p_time)
+	{
+		memset(p_time, 0, sizeof(*p_time));
+
+		p_time->Hours = (uint8_t)tm.tm_hour;
+		p_time->Minutes = (uint8_t)tm.tm_min;
+		p_time->Seconds = (uint8_t)tm.tm_sec;
+		p_time->SubSeconds = hrtc.Init.SynchPrediv - (uint32_t)(ticks % SimTicksPerSecond());
+
+		if (RTC_HOURFORMAT_12 == hrtc.Init.HourFormat)
+		{
+			p_time->TimeFormat = (tm.tm_hour >= 12) ? RTC_HOURFORMAT12_PM : RTC_HOURFORMAT12_AM;
+			p_time->Hours = (0 == (tm.tm_hour % 12)) ? 12u : (uint8_t)(tm.tm_hour % 12);
+		}
+	}
+
+	if (NULL != p_date)
+	{
+		memset(p_date, 0, sizeof(*p_date));
+
+		p_date->Year = (uint8_t)(tm.tm_year - 100);
+		p_date->Month = (uint8_t)(tm.tm_mon + 1);
+		p_date->Date = (uint8_t)tm.tm_mday;
+		p_date->WeekDay = (0 == tm.tm_wday) ? 7u : (uint8_t)tm.tm_wday;
+	}
+}
+
+static uint64_t SimTicksAt(const int year, const int month, const int day, const int hour, const int min, const int sec, const uint32_t sub)
+{
+	struct tm tm;
+
+	memset(&tm, 0, sizeof(tm));
+	tm.tm_year = year - 1900;
+	tm.tm_mon = month - 1;
+	tm.tm_mday = day;
+	tm.tm_hour = hour;
+	tm.tm_min = min;
+	tm.tm_sec = sec;
+
+	return ((uint64_t)(timegm(&tm) - SIM_EPOCH_2000) * SimTicksPerSecond()) + sub;
+}
+
+static uint32_t SimSleepMs(const uint64_t sleepTicks, const uint64_t wakeTicks)
+{
+	RTC_TimeTypeDef sleepTime, wakeTime;
+	RTC_DateTypeDef sleepDate, wakeDate;
+
+	SimToRtc(sleepTicks, &sleepTime, &sleepDate);
+	SimToRtc(wakeTicks, &wakeTime, &wakeDate);
+
+	return TASKMAN_GetSleepTimeMs(&sleepTime, &sleepDate, &wakeTime, &wakeDate);
+}
+
+
+// ----------------------------------------------------------------------------
+// Stubs
+
+uint32_t HAL_GetTick(void) { return uwTick; }
+uint32_t HAL_RCC_GetPCLK1Freq(void) { return 48000000u; }
+void HAL_SuspendTick(void) { }
+void HAL_ResumeTick(void) { }
+
+HAL_StatusTypeDef HAL_ADC_Init(ADC_HandleTypeDef *hadc) { return HAL_OK; }
+HAL_StatusTypeDef HAL_ADCEx_Calibration_Start(ADC_HandleTypeDef *hadc) { return HAL_OK; }
+void HAL_DMA_IRQHandler(DMA_HandleTypeDef *hdma) { }
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority) { }
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn) { }
+
+HAL_StatusTypeDef HAL_ADC_Start_DMA(ADC_HandleTypeDef *hadc, uint32_t *pData, uint32_t Length)
+{
+	m_simAdcRunning = true;
+	m_simAdcSequences = 0u;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ADC_Stop_DMA(ADC_HandleTypeDef *hadc)
+{
+	m_simAdcRunning = false;
+	return HAL_OK;
+}
+
+// One conversion sequence into the next half of the dma buffer
+static void SimAdcSequence(void)
+{
+	const uint32_t half = m_simAdcSequences % ADC_DMA_SEQUENCES;
+	uint8_t i;
+
+	for (i = 0u; i < MAX_ANALOG_CHANNELS; i++)
+	{
+		m_adcVals[(half * MAX_ANALOG_CHANNELS) + i] = m_simAdcValue;
+	}
+
+	m_simAdcSequences++;
+
+	if (0u == half)
+	{
+		HAL_ADC_ConvHalfCpltCallback(&hadc);
+	}
+	else
+	{
+		HAL_ADC_ConvCpltCallback(&hadc);
+	}
+}
+
+// One ms of simulated time, the osloop timer fires every period. The auto reload
+// is read at the update so a new period starts after the current one.
+static void SimAdvanceMs(void)
+{
+	uwTick++;
+	m_sim.awakeUs += 1000u;
+
+	m_simRtcFraction += SimTicksPerSecond();
+	m_simRtcTicks += m_simRtcFraction / 1000u;
+	m_simRtcFraction %= 1000u;
+
+	if (true == m_simAdcRunning)
+	{
+		SimAdcSequence();
+	}
+
+	if (0u != (TIMER_OSLOOP->DIER & TIM_IT_UPDATE))
+	{
+		m_simOsloopPhase += 1000u;
+
+		if (m_simOsloopPhase >= (TIMER_OSLOOP->ARR + 1u))
+		{
+			m_simOsloopPhase = 0u;
+			m_sim.osloops++;
+			m_sim.runUs += SIM_OSLOOP_US;
+
+			HOST_RaiseIrq(HOST_IRQ_OSLOOP);
+		}
+	}
+
+	if ( (0u != m_simCommandPeriodMs) && ((uwTick - m_simLastCommandMs) >= m_simCommandPeriodMs) )
+	{
+		m_simLastCommandMs = uwTick;
+	}
+
+	if ((int32_t)(uwTick - m_simEndMs) >= 0)
+	{
+		longjmp(m_simEnd, 1);
+	}
+}
+
+// Once per run of the tasks, which take long enough to move time on
+HAL_StatusTypeDef HAL_IWDG_Refresh(IWDG_HandleTypeDef *hiwdg)
+{
+	m_sim.tasks++;
+	m_sim.runUs += SIM_TASK_US;
+	m_simTaskUs += SIM_TASK_US;
+
+	while (m_simTaskUs >= 1000u)
+	{
+		m_simTaskUs -= 1000u;
+		SimAdvanceMs();
+	}
+
+	return HAL_OK;
+}
+
+// Sleep lasts until the next SysTick
+void HAL_PWR_EnterSLEEPMode(uint32_t Regulator, uint8_t SLEEPEntry)
+{
+	m_sim.loops++;
+	m_sim.runUs += SIM_LOOP_US;
+
+	SimAdvanceMs();
+}
+
+HAL_StatusTypeDef HAL_RTC_GetTime(RTC_HandleTypeDef *hrtc, RTC_TimeTypeDef *sTime, uint32_t Format)
+{
+	SimToRtc(m_simRtcTicks, sTime, NULL);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_RTC_GetDate(RTC_HandleTypeDef *hrtc, RTC_DateTypeDef *sDate, uint32_t Format)
+{
+	SimToRtc(m_simRtcTicks, NULL, sDate);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_RTCEx_SetWakeUpTimer_IT(RTC_HandleTypeDef *hrtc, uint32_t WakeUpCounter, uint32_t WakeUpClock)
+{
+	m_simWakeCounter = WakeUpCounter;
+	return HAL_OK;
+}
+
+uint32_t HAL_RTCEx_DeactivateWakeUpTimer(RTC_HandleTypeDef *hrtc) { return HAL_OK; }
+
+// Stop lasts the wakeup timer period (RTCCLK / 16 counts) plus some jitter for
+// where in the sub second the sleep started
+void HAL_PWR_EnterSTOPMode(uint32_t Regulator, uint8_t STOPEntry)
+{
+	const uint64_t ticks = (((uint64_t)m_simWakeCounter * SimTicksPerSecond()) / TASKMAN_SLEEP_SETTING_K) + m_simStopJitter;
+
+	m_simRtcTicks += ticks;
+
+	m_sim.stops++;
+	m_sim.stopUs += (ticks * 1000000u) / SimTicksPerSecond();
+}
+
+void ANALOG_Init(const uint32_t sysTime) { }
+void ANALOG_Service(const uint32_t sysTime) { }
+void ANALOG_Shutdown(void) { }
+void BATCHAR_Init(void) { }
+bool BATCHAR_IsRunning(void) { return false; }
+void BATCHAR_Service(const uint32_t sysTime) { }
+void BATCHAR_Task(void) { }
+void BATTERY_Init(void) { }
+void BATTERY_Task(void) { }
+void BIST_Init(void) { }
+bool BIST_IsRunning(void) { return false; }
+void BIST_Task(void) { }
+void BUTTON_Init(void) { }
+bool BUTTON_IsButtonActive(void) { return false; }
+void BUTTON_Task(void) { }
+ChargerStatus_T CHARGER_GetStatus(void) { return m_simChargerStatus; }
+void CHARGER_Init(void) { }
+bool CHARGER_RequirePoll(void) { return false; }
+void CHARGER_SetInterrupt(void) { }
+void CHARGER_Task(void) { }
+void E2_Init(void) { }
+void FUELGAUGE_Init(void) { }
+bool FUELGAUGE_IsBusy(void) { return false; }
+void FUELGAUGE_Task(void) { }
+uint32_t HOSTCOMMS_GetHostIdleMs(const uint32_t sysTime) { return m_simHostIdleMs; }
+uint32_t HOSTCOMMS_GetLastCommandAgeMs(const uint32_t sysTime) { return (0u != m_simCommandPeriodMs) ? (sysTime - m_simLastCommandMs) : UINT32_MAX; }
+bool HOSTCOMMS_IsHostQuiesced(void) { return false; }
+void HOSTCOMMS_Init(const uint32_t sysTime) { }
+void HOSTCOMMS_PiJuiceAddressSetEnable(const bool enabled) { }
+void HOSTCOMMS_Service(const uint32_t sysTime) { }
+void HOSTCOMMS_SetInterrupt(void) { }
+void HOSTCOMMS_Task(void) { }
+void I2CDRV_Init(const uint32_t sysTime) { }
+void I2CDRV_Service(const uint32_t sysTime) { }
+void I2CDRV_Shutdown(void) { }
+void IODRV_CaptureEdge(const uint16_t gpioPin_bm) { }
+void IODRV_Init(const uint32_t sysTime) { }
+void IODRV_Service(const uint32_t sysTime) { }
+void IODRV_Shutdown(void) { }
+void ISENSE_Init(void) { }
+bool ISENSE_IsCalibrating(void) { return false; }
+void ISENSE_Task(void) { }
+void IoControlInit() { }
+void LED_Init(const uint32_t sysTime) { }
+void LED_Service(const uint32_t sysTime) { }
+void LED_Shutdown(void) { }
+
+bool NV_ReadVariable_U8(const uint16_t address, uint8_t * const p_var)
+{
+	*p_var = m_simNv[address & 0xFFu];
+	return m_simNvValid[address & 0xFFu];
+}
+
+bool NV_WriteVariable_U8(const uint16_t address, const uint8_t var)
+{
+	m_simNv[address & 0xFFu] = var;
+	m_simNvValid[address & 0xFFu] = true;
+	return true;
+}
+
+void NV_SetDataInitialised(void) { }
+bool POWERMAN_CanShutDown(void) { return m_simCanShutdown; }
+void POWERMAN_Init(void) { }
+void POWERMAN_Task(void) { }
+void POWERSOURCE_Init(void) { }
+bool POWERSOURCE_NeedPoll(void) { return false; }
+void POWERSOURCE_Task(void) { }
+void RTC_EvaluateAlarm(void) { }
+bool RTC_GetAlarmState(void) { return false; }
+bool RTC_GetWakeEvent(void) { return false; }
+void RtcInit(void) { }
+void SwitchResConfigInit(uint32_t resistorConfigAdc) { }
+uint32_t TIMING_STATS_GetTimeUs(void) { return 0u; }
+void TIMING_STATS_Init(void) { }
+uint32_t TIMING_STATS_RecordTask(const TIMING_STATS_Id_t id, const uint32_t startTime, const uint32_t endTime) { return endTime; }
+uint32_t TIMING_STATS_RecordService(const TIMING_STATS_Id_t id, const uint32_t startTime, const uint32_t endTime) { return endTime; }
+
+
+// ----------------------------------------------------------------------------
+// Tests
+
+static void TestRtcDay(void)
+{
+	const uint64_t end = SimTicksAt(2099, 12, 31, 12, 0, 0, 0u);
+	RTC_DateTypeDef date;
+	uint64_t ticks;
+	uint32_t day = 0u;
+
+	// One day on per calendar day from 2000 to 2099, 1st January 2000 is day 1
+	for (ticks = SimTicksAt(2000, 1, 1, 12, 0, 0, 0u); ticks <= end; ticks += 86400ull * SimTicksPerSecond())
+	{
+		SimToRtc(ticks, NULL, &date);
+		day++;
+
+		HOST_CHECK(day == TASKMAN_GetRtcDay(&date));
+	}
+
+	HOST_CHECK(36525u == day);
+}
+
+
+static void TestBoundaries(void)
+{
+	static const int dates[][6u] =
+	{
+		/* Sleep at 23:59:58 and a half on the first date, wake on the second */
+		{ 2023, 1, 15, 2023, 1, 16 },		/* midnight */
+		{ 2024, 1, 31, 2024, 2, 1 },		/* month end */
+		{ 2024, 4, 30, 2024, 5, 1 },		/* 30 day month end */
+		{ 2024, 2, 28, 2024, 2, 29 },		/* leap February */
+		{ 2024, 2, 29, 2024, 3, 1 },
+		{ 2023, 2, 28, 2023, 3, 1 },		/* not a leap year */
+		{ 2000, 2, 28, 2000, 2, 29 },		/* 2000 is a leap year */
+		{ 2023, 12, 31, 2024, 1, 1 },		/* year end */
+	};
+	const uint32_t half = SimTicksPerSecond() / 2u;
+	uint64_t sleepTicks;
+	uint32_t i;
+	uint32_t format;
+
+	for (format = 0u; format < 2u; format++)
+	{
+		hrtc.Init.HourFormat = (0u == format) ? RTC_HOURFORMAT_24 : RTC_HOURFORMAT_12;
+
+		for (i = 0u; i < (sizeof(dates) / sizeof(dates[0u])); i++)
+		{
+			sleepTicks = SimTicksAt(dates[i][0u], dates[i][1u], dates[i][2u], 23, 59, 58, half);
+
+			HOST_CHECK((sleepTicks + (4ull * SimTicksPerSecond())) ==
+					SimTicksAt(dates[i][3u], dates[i][4u], dates[i][5u], 0, 0, 2, half));
+
+			m_sleepRemainder = 0u;
+			HOST_CHECK(4000u == SimSleepMs(sleepTicks, sleepTicks + (4ull * SimTicksPerSecond())));
+
+			m_sleepRemainder = 0u;
+			HOST_CHECK(3500u == SimSleepMs(sleepTicks, sleepTicks + (3ull * SimTicksPerSecond()) + half));
+		}
+
+		// Noon and midnight in 12 hour mode, 11:59:59 to 12:00:03
+		sleepTicks = SimTicksAt(2024, 6, 1, 11, 59, 59, 0u);
+		m_sleepRemainder = 0u;
+		HOST_CHECK(4000u == SimSleepMs(sleepTicks, sleepTicks + (4ull * SimTicksPerSecond())));
+
+		sleepTicks = SimTicksAt(2024, 6, 1, 12, 59, 59, 0u);
+		m_sleepRemainder = 0u;
+		HOST_CHECK(4000u == SimSleepMs(sleepTicks, sleepTicks + (4ull * SimTicksPerSecond())));
+	}
+
+	hrtc.Init.HourFormat = RTC_HOURFORMAT_24;
+}
+
+
+static void TestBadReadings(void)
+{
+	const uint64_t sleepTicks = SimTicksAt(2024, 2, 29, 23, 59, 59, 10u);
+
+	m_sleepRemainder = 0u;
+
+	// Backwards by a second, a day, or a sub second tick within the same second
+	HOST_CHECK(0u == SimSleepMs(sleepTicks, sleepTicks - SimTicksPerSecond()));
+	HOST_CHECK(0u == SimSleepMs(sleepTicks, sleepTicks - (86400ull * SimTicksPerSecond())));
+	HOST_CHECK(0u == SimSleepMs(sleepTicks, sleepTicks - 1u));
+
+	// Up to a day is accounted, more than that is a jump
+	HOST_CHECK(0u == SimSleepMs(sleepTicks, sleepTicks));
+	HOST_CHECK(86400000u == SimSleepMs(sleepTicks, sleepTicks + (86400ull * SimTicksPerSecond())));
+	HOST_CHECK(0u == SimSleepMs(sleepTicks, sleepTicks + (86401ull * SimTicksPerSecond())));
+	HOST_CHECK(0u == SimSleepMs(sleepTicks, sleepTicks + (10ull * 86400ull * SimTicksPerSecond())));
+
+	// A bad reading leaves the carried fraction alone
+	HOST_CHECK(0u == m_sleepRemainder);
+}
+
+
+static void TestStopDrift(const uint32_t synchPrediv, const int year, const int month, const int day)
+{
+	uint64_t sleepStart;
+	uint64_t elapsedTicks = 0u;
+	uint32_t tickStart;
+	uint64_t expectMs;
+	uint32_t maxStepError = 0u;
+	uint32_t i;
+
+	hrtc.Init.SynchPrediv = synchPrediv;
+	m_simRtcTicks = SimTicksAt(year, month, day, 20, 0, 0, 0u);
+	m_sleepRemainder = 0u;
+	m_runState = TASKMAN_RUNSTATE_LOW_POWER;
+	m_stopSleepSetting = (TASKMAN_SLEEP_TIME_MS * TASKMAN_SLEEP_SETTING_K) / 1000u;
+
+	uwTick = 0x10000000u;
+	tickStart = uwTick;
+
+	srand(synchPrediv);
+
+	// Back to back 4S stops, each starting at a random point in the second
+	for (i = 0u; i < SIM_SLEEPS; i++)
+	{
+		m_simStopJitter = (uint32_t)rand() % SimTicksPerSecond();
+		sleepStart = m_simRtcTicks;
+
+		m_runState = TASKMAN_RUNSTATE_LOW_POWER;
+		TASKMAN_WaitInterrupt();
+
+		elapsedTicks += m_simRtcTicks - sleepStart;
+		expectMs = (elapsedTicks * 1000u) / SimTicksPerSecond();
+
+		// Never more than the part of a ms the carry hasn't paid out yet
+		if ((expectMs - (uint32_t)(uwTick - tickStart)) > maxStepError)
+		{
+			maxStepError = (uint32_t)(expectMs - (uint32_t)(uwTick - tickStart));
+		}
+	}
+
+	HOST_CHECK(expectMs == (uint32_t)(uwTick - tickStart));
+	HOST_CHECK(0u == maxStepError);
+
+	printf("test_taskman: prediv %u, %u stops, %llu ms asleep, tick %u ms\n", (unsigned)synchPrediv, (unsigned)SIM_SLEEPS,
+			(unsigned long long)expectMs, (unsigned)(uwTick - tickStart));
+
+	hrtc.Init.SynchPrediv = 255u;
+}
+
+
+static void SimConfig(const uint8_t osloop, const uint8_t task, const uint8_t sleep)
+{
+	const uint8_t config[3u] = { osloop, task, sleep };
+
+	TASKMAN_SetLoopConfigData(config, 3u);
+}
+
+
+static void TestLoopPeriods(void)
+{
+	uint8_t data[4u];
+	uint16_t len;
+	uint32_t t;
+
+	m_simChargerStatus = CHG_NO_VALID_SOURCE;
+	m_extiEvent = EXTI_EVENT_NONE;
+	uwTick = 100000u;
+
+	SimConfig(0x81u, 20u, 40u);
+	HOST_CHECK(999u == TIMER_OSLOOP->ARR);
+	HOST_CHECK(20u == m_activeTaskPeriodMs);
+	HOST_CHECK(8192u == m_activeSleepSetting);
+
+	// Quiet host stretches after 30S, not before
+	TASKMAN_UpdateLoopPeriods(uwTick, TASKMAN_ADAPT_HOST_IDLE_MS);
+	HOST_CHECK(false == m_adaptStretched);
+
+	TASKMAN_UpdateLoopPeriods(uwTick, TASKMAN_ADAPT_HOST_IDLE_MS + 1u);
+	HOST_CHECK(true == m_adaptStretched);
+	HOST_CHECK(3999u == TIMER_OSLOOP->ARR);
+	HOST_CHECK(0u != (TIMER_OSLOOP->CR1 & TIM_CR1_ARPE));
+	HOST_CHECK(4u == OSLOOP_GetPeriod());
+	HOST_CHECK(80u == m_activeTaskPeriodMs);
+	HOST_CHECK(16384u == m_activeSleepSetting);
+
+	TASKMAN_GetLoopConfigData(data, &len);
+	HOST_CHECK(4u == len);
+	HOST_CHECK(0x81u == data[0u]);
+	HOST_CHECK(20u == data[1u]);
+	HOST_CHECK(40u == data[2u]);
+	HOST_CHECK(1u == data[3u]);
+
+	// A host command brings them straight back
+	TASKMAN_UpdateLoopPeriods(uwTick, 0u);
+	HOST_CHECK(false == m_adaptStretched);
+	HOST_CHECK(999u == TIMER_OSLOOP->ARR);
+	HOST_CHECK(20u == m_activeTaskPeriodMs);
+	HOST_CHECK(8192u == m_activeSleepSetting);
+
+	// Charger input keeps them normal
+	m_simChargerStatus = CHG_IN_READY;
+	TASKMAN_UpdateLoopPeriods(uwTick, UINT32_MAX);
+	HOST_CHECK(false == m_adaptStretched);
+	m_simChargerStatus = CHG_NO_VALID_SOURCE;
+
+	// A charger interrupt holds the normal periods for 10S
+	t = uwTick;
+	m_extiEvent = EXTI_EVENT_CHARGER;
+	TASKMAN_UpdateLoopPeriods(t, UINT32_MAX);
+	HOST_CHECK(false == m_adaptStretched);
+	m_extiEvent = EXTI_EVENT_NONE;
+
+	TASKMAN_UpdateLoopPeriods(t + TASKMAN_ADAPT_HOLD_MS - 1u, UINT32_MAX);
+	HOST_CHECK(false == m_adaptStretched);
+
+	TASKMAN_UpdateLoopPeriods(t + TASKMAN_ADAPT_HOLD_MS, UINT32_MAX);
+	HOST_CHECK(true == m_adaptStretched);
+
+	// Stretched osloop period is capped at 8mS, sleep at the 16 bit wakeup counter
+	SimConfig(0x83u, 20u, 255u);
+	HOST_CHECK(2999u == TIMER_OSLOOP->ARR);
+	HOST_CHECK(52224u == m_activeSleepSetting);
+
+	TASKMAN_UpdateLoopPeriods(t + TASKMAN_ADAPT_HOLD_MS, UINT32_MAX);
+	HOST_CHECK(7999u == TIMER_OSLOOP->ARR);
+	HOST_CHECK(0xFFFFu == m_activeSleepSetting);
+
+	// Adaptive mode off never stretches
+	SimConfig(0x02u, 10u, 20u);
+	TASKMAN_UpdateLoopPeriods(t + TASKMAN_ADAPT_HOLD_MS, UINT32_MAX);
+	HOST_CHECK(false == m_adaptStretched);
+	HOST_CHECK(1999u == TIMER_OSLOOP->ARR);
+	HOST_CHECK(10u == m_activeTaskPeriodMs);
+	HOST_CHECK(4096u == m_activeSleepSetting);
+
+	// Out of range osloop period or unknown bits rejected
+	SimConfig(0x09u, 10u, 20u);
+	SimConfig(0x42u, 10u, 20u);
+	TASKMAN_GetLoopConfigData(data, &len);
+	HOST_CHECK(0x02u == data[0u]);
+
+	// Zero gives the default
+	SimConfig(0x00u, 0u, 0u);
+	HOST_CHECK(999u == TIMER_OSLOOP->ARR);
+	HOST_CHECK(TASKMAN_TASK_PERIOD_MS == m_activeTaskPeriodMs);
+	HOST_CHECK(8192u == m_activeSleepSetting);
+}
+
+
+// Runs the real taskman loop and osloop timer for a simulated hour
+static SIM_Counts_t SimLoop(const char * const p_name, const uint8_t osloopConfig)
+{
+	uint32_t averageUa;
+
+	memset(&m_sim, 0, sizeof(m_sim));
+
+	uwTick = 0u;
+	m_simEndMs = SIM_RUN_MS;
+	m_simLastCommandMs = 0u;
+	m_simOsloopPhase = 0u;
+	m_simTaskUs = 0u;
+	m_simStopJitter = 0u;
+	m_simRtcTicks = SimTicksAt(2024, 1, 1, 0, 0, 0, 0u);
+	m_simRtcFraction = 0u;
+	m_extiEvent = EXTI_EVENT_NONE;
+
+	SimConfig(osloopConfig, 0u, 0u);
+
+	TASKMAN_Init();
+	OSLOOP_Init();
+
+	if (0 == setjmp(m_simEnd))
+	{
+		TASKMAN_Run();
+	}
+
+	averageUa = (uint32_t)( ((m_sim.runUs * SIM_RUN_UA) + ((m_sim.awakeUs - m_sim.runUs) * SIM_SLEEP_UA) + (m_sim.stopUs * SIM_STOP_UA))
+				/ (m_sim.awakeUs + m_sim.stopUs) );
+
+	printf("test_taskman: %-31s wakes %7u osloop %7u tasks %6u stops %4u awake %7.1fs avg %5uuA\n", p_name,
+			(unsigned)m_sim.loops, (unsigned)m_sim.osloops, (unsigned)m_sim.tasks, (unsigned)m_sim.stops,
+			(double)m_sim.awakeUs / 1000000.0, (unsigned)averageUa);
+
+	return m_sim;
+}
+
+
+static void TestLoopSim(void)
+{
+	SIM_Counts_t normal;
+	SIM_Counts_t adaptive;
+
+	HOST_SetIrqHandler(HOST_IRQ_OSLOOP, OSLOOP_TIMER_IRQHandler);
+
+	// Pi off on battery, stops between 4S wakes, 8S when stretched
+	m_simHostIdleMs = HOSTCOMMS_IDLE_FOREVER;
+	m_simCanShutdown = true;
+	m_simChargerStatus = CHG_NO_VALID_SOURCE;
+	m_simCommandPeriodMs = 0u;
+
+	normal = SimLoop("pi off, battery", 0x01u);
+	adaptive = SimLoop("pi off, battery, adaptive", 0x81u);
+
+	HOST_CHECK( (normal.stops > 850u) && (normal.stops < 900u) );
+	HOST_CHECK( (adaptive.stops * 100u) > (normal.stops * 48u) );
+	HOST_CHECK( (adaptive.stops * 100u) < (normal.stops * 52u) );
+	HOST_CHECK( (adaptive.osloops * 100u) < (normal.osloops * 30u) );
+	HOST_CHECK(adaptive.awakeUs < normal.awakeUs);
+
+	// Pi running on battery with a command a minute, no stop, stretched for the
+	// quiet half of each minute. SysTick still wakes the sleep every mS.
+	m_simHostIdleMs = 0u;
+	m_simCanShutdown = false;
+	m_simCommandPeriodMs = 60000u;
+
+	normal = SimLoop("pi on, command a minute", 0x01u);
+	adaptive = SimLoop("pi on, command a minute, adapt", 0x81u);
+
+	HOST_CHECK(0u == normal.stops);
+	HOST_CHECK(0u == adaptive.stops);
+	HOST_CHECK( (adaptive.osloops * 100u) < (normal.osloops * 70u) );
+	HOST_CHECK( (adaptive.tasks * 100u) < (normal.tasks * 70u) );
+
+	// Charger connected, adaptive mode changes nothing
+	m_simChargerStatus = CHG_IN_READY;
+
+	normal = SimLoop("pi on, charger", 0x01u);
+	adaptive = SimLoop("pi on, charger, adaptive", 0x81u);
+
+	HOST_CHECK(normal.osloops == adaptive.osloops);
+	HOST_CHECK(normal.tasks == adaptive.tasks);
+
+	m_simChargerStatus = CHG_NO_VALID_SOURCE;
+}
+
+
+// Runs the simulated ms until the adc averages are ready, returns how many it took
+static uint32_t SimAdcReadyMs(void)
+{
+	const uint32_t start = uwTick;
+
+	while ( (false == ADC_GetFilterReady()) && ((uwTick - start) < 1000u) )
+	{
+		SimAdvanceMs();
+	}
+
+	return uwTick - start;
+}
+
+
+// The real adc through a power on and a stop wake. ADC_Init has to refill the
+// filters before the averages are ready, after a wake they're seeded with the
+// averages from before the stop so TASKMAN_WaitInterrupt can carry on straight
+// away and the values it reads are the ones from before the stop.
+static void TestWakeAdc(void)
+{
+	uint16_t before[MAX_ANALOG_CHANNELS];
+	uint32_t initMs;
+	uint32_t wakeMs;
+	uint32_t i;
+
+	uwTick = 0u;
+	m_simEndMs = SIM_RUN_MS;
+	m_simStopJitter = 0u;
+	m_simAdcValue = SIM_ADC_VALUE;
+
+	OSLOOP_Init();
+	initMs = SimAdcReadyMs();
+
+	// Long enough for every periodic filter to take the input
+	for (i = 0u; i < 10000u; i++)
+	{
+		SimAdvanceMs();
+	}
+
+	for (i = 0u; i < MAX_ANALOG_CHANNELS; i++)
+	{
+		before[i] = ADC_GetAverageValue((uint8_t)i);
+		HOST_CHECK(SIM_ADC_VALUE == before[i]);
+	}
+
+	// Input has moved on by the time the stop ends
+	m_simAdcValue = SIM_ADC_VALUE + 100u;
+	m_stopSleepSetting = (TASKMAN_SLEEP_TIME_MS * TASKMAN_SLEEP_SETTING_K) / 1000u;
+	m_runState = TASKMAN_RUNSTATE_LOW_POWER;
+
+	TASKMAN_WaitInterrupt();
+
+	HOST_CHECK(true == m_simAdcRunning);
+	HOST_CHECK(0u == m_simAdcSequences);
+	wakeMs = SimAdcReadyMs();
+
+	for (i = 0u; i < MAX_ANALOG_CHANNELS; i++)
+	{
+		HOST_CHECK(before[i] == ADC_GetAverageValue((uint8_t)i));
+	}
+
+	// Settle sequences are thrown away, the next one is used
+	ADC_StartWindow(ANALOG_CHANNEL_VBAT);
+
+	for (i = 0u; i < ADC_RESTART_SETTLE_SEQUENCES; i++)
+	{
+		SimAdvanceMs();
+		HOST_CHECK(0u == m_windowCount);
+	}
+
+	SimAdvanceMs();
+	HOST_CHECK(1u == m_windowCount);
+	HOST_CHECK((SIM_ADC_VALUE + 100u) == m_windowTotal);
+	ADC_GetWindowAverage();
+
+	HOST_CHECK(initMs >= AVE_FILTER_ELEMENT_COUNT);
+	HOST_CHECK(0u == wakeMs);
+	HOST_CHECK(wakeMs < initMs);
+
+	printf("test_taskman: adc averages ready %u ms after ADC_Init, %u ms after a stop wake\n",
+			(unsigned)initMs, (unsigned)wakeMs);
+}
+
+
+int main(void)
+{
+	hrtc.Init.AsynchPrediv = 127u;
+	hrtc.Init.SynchPrediv = 255u;
+	hrtc.Init.HourFormat = RTC_HOURFORMAT_24;
+
+	TIMER_OSLOOP->PSC = 47u;
+	TIMER_OSLOOP->ARR = 999u;
+
+	TestRtcDay();
+	TestBoundaries();
+	TestBadReadings();
+
+	// Stop wakes restart the adc, which needs its filters set up first
+	ADC_Init(uwTick);
+
+	// 10000 stops is about 12 hours, start at 8pm to cross year end and leap
+	// February
+	TestStopDrift(255u, 2023, 12, 31);
+	TestStopDrift(255u, 2024, 2, 28);
+
+	// A sub second count that doesn't divide into 1000
+	TestStopDrift(399u, 2024, 2, 28);
+
+	TestLoopPeriods();
+	TestLoopSim();
+	TestWakeAdc();
+
+	return HOST_Report("test_taskman");
+}
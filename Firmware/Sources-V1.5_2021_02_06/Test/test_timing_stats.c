@@ -0,0 +1,298 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file		test_timing_stats.c
+ * @date       	18 October 2026
+ * @brief       Host test of the timing_stats aggregation, min, max, decaying
+ * 				mean, histogram buckets and percentile, the readout pages and the
+ * 				systick uS conversion.
+ *
+ */
+// ----------------------------------------------------------------------------
+
+#include <stdio.h>
+
+#include "../Src/util.c"
+#include "../Src/timing_stats.c"
+
+
+// ----------------------------------------------------------------------------
+// Stubs
+
+uint32_t HAL_GetTick(void)
+{
+	return g_hostTick;
+}
+
+uint32_t HAL_RCC_GetPCLK1Freq(void)
+{
+	return 48000000u;
+}
+
+
+// ----------------------------------------------------------------------------
+// Tests
+
+static void TestBuckets(void)
+{
+	uint32_t value;
+	uint8_t bucket;
+	uint8_t last = 0u;
+
+	// Every value lands in a bucket whose upper edge is at or above it, buckets
+	// never go backwards and each bucket upper edge is the last value in it
+	for (value = 0u; value <= UINT16_MAX; value++)
+	{
+		bucket = TIMING_STATS_GetBucket((uint16_t)value);
+
+		HOST_CHECK(bucket < TIMING_STATS_HIST_BUCKETS);
+		HOST_CHECK(bucket >= last);
+		HOST_CHECK(TIMING_STATS_GetBucketUpper(bucket) >= value);
+
+		if (value < UINT16_MAX)
+		{
+			HOST_CHECK( (TIMING_STATS_GetBucketUpper(bucket) == value) ==
+					(TIMING_STATS_GetBucket((uint16_t)(value + 1u)) != bucket) );
+		}
+
+		last = bucket;
+	}
+
+	// 4 buckets per octave, at most 25% wide
+	HOST_CHECK(TIMING_STATS_GetBucket(100u) == TIMING_STATS_GetBucket(111u));
+	HOST_CHECK(TIMING_STATS_GetBucket(111u) != TIMING_STATS_GetBucket(112u));
+	HOST_CHECK(TIMING_STATS_GetBucketUpper(TIMING_STATS_GetBucket(1000u)) == 1023u);
+}
+
+
+static void TestMinMaxMean(void)
+{
+	TIMING_STATS_Summary_t summary;
+	uint32_t i;
+
+	TIMING_STATS_Reset();
+
+	TIMING_STATS_GetSummary(TIMING_STATS_RTC_TASK, &summary);
+	HOST_CHECK(0u == summary.count);
+	HOST_CHECK(0u == summary.max);
+
+	TIMING_STATS_RecordTask(TIMING_STATS_RTC_TASK, 1000u, 1010u);
+	TIMING_STATS_RecordTask(TIMING_STATS_RTC_TASK, 2000u, 2030u);
+	TIMING_STATS_RecordTask(TIMING_STATS_RTC_TASK, 3000u, 3021u);
+
+	TIMING_STATS_GetSummary(TIMING_STATS_RTC_TASK, &summary);
+	HOST_CHECK(3u == summary.count);
+	HOST_CHECK(10u == summary.min);
+	HOST_CHECK(30u == summary.max);
+	HOST_CHECK(20u == summary.mean);
+	HOST_CHECK(30u == summary.p99);
+
+	// Time wraps between start and end
+	TIMING_STATS_RecordTask(TIMING_STATS_RTC_TASK, 0xFFFFFFF0u, 0x00000010u);
+	TIMING_STATS_GetSummary(TIMING_STATS_RTC_TASK, &summary);
+	HOST_CHECK(32u == summary.max);
+
+	// Long durations saturate
+	TIMING_STATS_RecordTask(TIMING_STATS_RTC_TASK, 0u, 100000u);
+	TIMING_STATS_GetSummary(TIMING_STATS_RTC_TASK, &summary);
+	HOST_CHECK(UINT16_MAX == summary.max);
+
+	// Decay halves the count and total so the mean follows the recent samples
+	TIMING_STATS_Reset();
+
+	for (i = 0u; i < TIMING_STATS_DECAY_COUNT; i++)
+	{
+		TIMING_STATS_RecordService(TIMING_STATS_LED_SERVICE, 0u, 100u);
+	}
+
+	TIMING_STATS_GetSummary(TIMING_STATS_LED_SERVICE, &summary);
+	HOST_CHECK(TIMING_STATS_DECAY_COUNT == summary.count);
+	HOST_CHECK(100u == summary.mean);
+
+	for (i = 0u; i < (TIMING_STATS_DECAY_COUNT / 2u); i++)
+	{
+		TIMING_STATS_RecordService(TIMING_STATS_LED_SERVICE, 0u, 300u);
+	}
+
+	TIMING_STATS_GetSummary(TIMING_STATS_LED_SERVICE, &summary);
+	HOST_CHECK(TIMING_STATS_DECAY_COUNT == summary.count);
+	HOST_CHECK(200u == summary.mean);
+	HOST_CHECK(100u == summary.min);
+	HOST_CHECK(300u == summary.max);
+
+	// Other entries untouched
+	TIMING_STATS_GetSummary(TIMING_STATS_ADC_SERVICE, &summary);
+	HOST_CHECK(0u == summary.count);
+
+	// Bad ids ignored, summary left alone
+	summary.count = 1234u;
+	TIMING_STATS_RecordService(TIMING_STATS_MAX_ENTRIES, 0u, 1u);
+	TIMING_STATS_GetSummary(TIMING_STATS_MAX_ENTRIES, &summary);
+	HOST_CHECK(1234u == summary.count);
+}
+
+
+static void TestPercentile(void)
+{
+	TIMING_STATS_Summary_t summary;
+	uint32_t i;
+
+	TIMING_STATS_Reset();
+
+	// 990 short loops and 10 long ones, p99 stays with the short ones
+	for (i = 0u; i < 990u; i++)
+	{
+		TIMING_STATS_RecordService(TIMING_STATS_OSLOOP, 0u, 40u + (i % 8u));
+	}
+
+	for (i = 0u; i < 10u; i++)
+	{
+		TIMING_STATS_RecordService(TIMING_STATS_OSLOOP, 0u, 900u);
+	}
+
+	TIMING_STATS_GetSummary(TIMING_STATS_OSLOOP, &summary);
+	HOST_CHECK(1000u == summary.count);
+	HOST_CHECK(40u == summary.min);
+	HOST_CHECK(900u == summary.max);
+	HOST_CHECK(47u == summary.p99);
+
+	// 20 long ones pushes p99 up to the max
+	for (i = 0u; i < 10u; i++)
+	{
+		TIMING_STATS_RecordService(TIMING_STATS_OSLOOP, 0u, 900u);
+	}
+
+	TIMING_STATS_GetSummary(TIMING_STATS_OSLOOP, &summary);
+	HOST_CHECK(900u == summary.p99);
+
+	// Module entries have no histogram, p99 is the max
+	TIMING_STATS_RecordService(TIMING_STATS_ADC_SERVICE, 0u, 5u);
+	TIMING_STATS_RecordService(TIMING_STATS_ADC_SERVICE, 0u, 50u);
+	TIMING_STATS_GetSummary(TIMING_STATS_ADC_SERVICE, &summary);
+	HOST_CHECK(50u == summary.p99);
+}
+
+
+static void TestBusyEntry(void)
+{
+	TIMING_STATS_Summary_t summary = { 1u, 2u, 3u, 4u, 5u };
+
+	TIMING_STATS_Reset();
+	TIMING_STATS_RecordTask(TIMING_STATS_BUTTON_TASK, 0u, 10u);
+
+	// A sample or a readout landing on an update in progress is dropped and the
+	// summary is left as it was
+	SEQLOCK_WriteBegin(&m_entries[TIMING_STATS_BUTTON_TASK].seq);
+
+	TIMING_STATS_RecordService(TIMING_STATS_BUTTON_TASK, 0u, 99u);
+	TIMING_STATS_GetSummary(TIMING_STATS_BUTTON_TASK, &summary);
+	HOST_CHECK(5u == summary.count);
+	HOST_CHECK(1u == summary.min);
+
+	SEQLOCK_WriteEnd(&m_entries[TIMING_STATS_BUTTON_TASK].seq);
+
+	TIMING_STATS_GetSummary(TIMING_STATS_BUTTON_TASK, &summary);
+	HOST_CHECK(1u == summary.count);
+	HOST_CHECK(10u == summary.max);
+}
+
+
+static void TestReadCmd(void)
+{
+	uint8_t data[32u];
+	uint8_t select[2u] = { TIMING_STATS_CMD_SELECT_PAGE, 1u };
+	uint8_t reset = TIMING_STATS_CMD_RESET;
+	uint16_t len;
+	uint8_t page;
+
+	TIMING_STATS_Reset();
+
+	TIMING_STATS_RecordService(TIMING_STATS_OSLOOP, 0u, 0x1234u);
+	TIMING_STATS_RecordTask(TIMING_STATS_TASKMAN, 0u, 7u);
+	TIMING_STATS_RecordService(TIMING_STATS_ADC_SERVICE, 0u, 0x0102u);
+	TIMING_STATS_RecordTask(TIMING_STATS_I2CDRV_TRANSACT, 0u, 0x0304u);
+
+	TIMING_STATS_ReadCmd(data, &len);
+	HOST_CHECK(TIMING_STATS_READ_LEN == len);
+	HOST_CHECK(0u == data[0u]);
+	HOST_CHECK(TIMING_STATS_PAGES == data[1u]);
+	HOST_CHECK(0x1234u == UTIL_FromBytes_U16(&data[2u]));
+	HOST_CHECK(0x1234u == UTIL_FromBytes_U16(&data[4u]));
+	HOST_CHECK(7u == UTIL_FromBytes_U16(&data[10u]));
+	HOST_CHECK(1000u == UTIL_FromBytes_U16(&data[18u]));
+	HOST_CHECK(1u == UTIL_FromBytes_U16(&data[20u]));
+	HOST_CHECK(1u == UTIL_FromBytes_U16(&data[24u]));
+
+	// Page 1 starts with the first module entry, mean then max
+	TIMING_STATS_ReadCmd(data, &len);
+	HOST_CHECK(1u == data[0u]);
+	HOST_CHECK(0x0102u == UTIL_FromBytes_U16(&data[2u]));
+	HOST_CHECK(0x0102u == UTIL_FromBytes_U16(&data[4u]));
+
+	// Pages come from the page 0 snapshot
+	TIMING_STATS_RecordTask(TIMING_STATS_I2CDRV_TRANSACT, 0u, 0x0500u);
+
+	for (page = 2u; page < TIMING_STATS_PAGES; page++)
+	{
+		TIMING_STATS_ReadCmd(data, &len);
+		HOST_CHECK(page == data[0u]);
+	}
+
+	HOST_CHECK(0x0304u == UTIL_FromBytes_U16(&data[2u + (((TIMING_STATS_I2CDRV_TRANSACT - TIMING_STATS_LOOP_COUNT) % TIMING_STATS_PAGE_ENTRIES) * 4u) + 2u]));
+
+	// Back round to page 0
+	TIMING_STATS_ReadCmd(data, &len);
+	HOST_CHECK(0u == data[0u]);
+
+	TIMING_STATS_WriteCmd(select, 2u);
+	TIMING_STATS_ReadCmd(data, &len);
+	HOST_CHECK(1u == data[0u]);
+
+	select[1u] = TIMING_STATS_PAGES;
+	TIMING_STATS_WriteCmd(select, 2u);
+	TIMING_STATS_ReadCmd(data, &len);
+	HOST_CHECK(0u == data[0u]);
+
+	TIMING_STATS_WriteCmd(&reset, 1u);
+	TIMING_STATS_ReadCmd(data, &len);
+	HOST_CHECK(0u == UTIL_FromBytes_U16(&data[20u]));
+}
+
+
+static void TestGetTimeUs(void)
+{
+	SysTick->LOAD = 47999u;
+	TIMING_STATS_Init();
+
+	g_hostTick = 5u;
+	SysTick->VAL = 47999u;
+	HOST_CHECK(5000u == TIMING_STATS_GetTimeUs());
+
+	// 16/16 scale truncates, reads up to 1uS low
+	SysTick->VAL = 24000u;
+	HOST_CHECK((TIMING_STATS_GetTimeUs() - 5499u) <= 1u);
+
+	SysTick->VAL = 0u;
+	HOST_CHECK((TIMING_STATS_GetTimeUs() - 5998u) <= 1u);
+
+	g_hostTick = 6u;
+	SysTick->VAL = 47999u;
+	HOST_CHECK(6000u == TIMING_STATS_GetTimeUs());
+}
+
+
+int main(void)
+{
+	SysTick->LOAD = 47999u;
+	TIM6->PSC = 47u;
+
+	TIMING_STATS_Init();
+
+	TestBuckets();
+	TestMinMaxMean();
+	TestPercentile();
+	TestBusyEntry();
+	TestReadCmd();
+	TestGetTimeUs();
+
+	return HOST_Report("test_timing_stats");
+}
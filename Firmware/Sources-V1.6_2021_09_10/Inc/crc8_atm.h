@@ -10,6 +10,7 @@
 
 #include "stdint.h"
 
+uint8_t Crc8( uint8_t inCrc, uint8_t inData );
 uint8_t Crc8Block( uint8_t crc, uint8_t *data, uint8_t len );
 
 #endif /* CRC8_ATM_H_ */
@@ -28,7 +28,8 @@ typedef enum {
 	ALARM_EVT,
 	MCU_RESET,
 	LOG_RESERVED2,
-	ALARM_WRITE
+	ALARM_WRITE,
+	POWER_OFF_EVT
 } LogMsgId_T;
 
 typedef struct __attribute__((packed))
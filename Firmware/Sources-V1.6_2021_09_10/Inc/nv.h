@@ -133,7 +133,9 @@
  BAT_R90L_NV_ADDR, \
  BAT_R90H_NV_ADDR, \
  WATCHDOG_CONFIGH_NV_ADDR, \
- LOG_CONFIG_NV_ADDR
+ LOG_CONFIG_NV_ADDR, \
+ IDLE_POWER_OFF_CONFIG_NV_ADDR, \
+ IDLE_POWER_OFF_DWELL_NV_ADDR
 
 typedef enum
 {
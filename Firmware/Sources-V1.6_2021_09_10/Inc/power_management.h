@@ -8,6 +8,11 @@
 #ifndef POWER_MANAGEMENT_H_
 #define POWER_MANAGEMENT_H_
 
+#define IDLE_POWER_OFF_DEFAULT_DWELL	20 // 2 seconds
+
+#define IDLE_POWER_OFF_TRIGGER_IDLE		0 // load current below threshold for dwell time
+#define IDLE_POWER_OFF_TRIGGER_DELAY	1 // scheduled delay expired
+
 typedef enum RunPinInstallationStatus_T {
 	RUN_PIN_NOT_INSTALLED = 0,
 	RUN_PIN_INSTALLED,
@@ -29,6 +34,8 @@ uint8_t PowerMngmtGetPowerOffCounter(void);
 void PowerMngmtConfigureWatchdogCmd(uint8_t data[], uint16_t len);
 void PowerMngmtGetWatchdogConfigurationCmd(uint8_t data[], uint16_t *len);
 void PowerMngmtHostPollEvent(void);
+void PowerMngmtSetIdlePowerOffCmd(uint8_t data[], uint16_t len);
+void PowerMngmtGetIdlePowerOffCmd(uint8_t data[], uint16_t *len);
 //int8_t WakeUpHost(void);
 
 #endif /* POWER_MANAGEMENT_H_ */
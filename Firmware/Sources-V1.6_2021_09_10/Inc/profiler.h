@@ -0,0 +1,33 @@
+/*
+ * profiler.h
+ *
+ *  Created on: 18.10.2026.
+ *      Author: milan
+ */
+
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include "stdint.h"
+#include "stm32f0xx_hal.h"
+
+#define PROF_BUCKETS_NUM		256 // histogram buckets, 16 bit sample counter each
+#define PROF_PAGE_BUCKETS		14 // buckets per host read, fits 31 byte smbus block with fcs
+#define PROF_PAGES_NUM			((PROF_BUCKETS_NUM + PROF_PAGE_BUCKETS - 1) / PROF_PAGE_BUCKETS)
+
+#define PROF_DEFAULT_PERIOD_US	997 // prime, so sampling does not lock to 1ms/20ms periodic tasks
+#define PROF_AUTO_SHIFT			0 // bucket size fitted so code from base to _etext fills the buckets
+#define PROF_DEFAULT_BASE		FLASH_BASE
+
+#define PROF_STATUS_RUNNING		0x01
+#define PROF_STATUS_SATURATED	0x02
+
+void ProfilerInit(void);
+void ProfilerStart(uint16_t periodUs, uint8_t shift, uint32_t base);
+void ProfilerStop(void);
+void ProfilerClear(void);
+
+void ProfilerReadCmd(uint8_t data[], uint16_t *len);
+int8_t ProfilerWriteCmd(uint8_t data[], uint16_t len);
+
+#endif /* PROFILER_H_ */
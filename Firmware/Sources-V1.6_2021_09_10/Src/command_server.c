@@ -22,6 +22,7 @@
 #include "io_control.h"
 #include "execution.h"
 #include "logging.h"
+#include "profiler.h"
 
 #define REGISTERS_NUM	((uint16_t)256)
 
@@ -85,6 +86,7 @@ void CmdServerReadWriteAlarm(uint8_t dir, uint8_t *pData, uint16_t *dataLen);
 void CmdServerReadWriteRtcAlarmCtrlStatus(uint8_t dir, uint8_t *pData, uint16_t *dataLen);
 void CmdServerReadWriteInputsConfig(uint8_t dir, uint8_t *pData, uint16_t *dataLen);
 void CmdServerReadWriteScheduledPowerOff(uint8_t dir, uint8_t *pData, uint16_t *dataLen);
+void CmdServerReadWriteIdlePowerOff(uint8_t dir, uint8_t *pData, uint16_t *dataLen);
 void CmdServerReadWriteVSysSwitchState(uint8_t dir, uint8_t *pData, uint16_t *dataLen);
 void CmdServerReadWriteWakeupOnCharge(uint8_t dir, uint8_t *pData, uint16_t *dataLen);
 void CmdServerReadWriteOwnAddress1(uint8_t dir, uint8_t *pData, uint16_t *dataLen);
@@ -101,6 +103,7 @@ void CmdServerReadWriteIoConfig2(uint8_t dir, uint8_t *pData, uint16_t *dataLen)
 void CmdServerReadWriteIoValue1(uint8_t dir, uint8_t *pData, uint16_t *dataLen);
 void CmdServerReadWriteIoValue2(uint8_t dir, uint8_t *pData, uint16_t *dataLen);
 void CmdServerReadWriteLogging(uint8_t dir, uint8_t *pData, uint16_t *dataLen);
+void CmdServerReadWriteProfiler(uint8_t dir, uint8_t *pData, uint16_t *dataLen);
 
 MasterCommand_T masterCommands[REGISTERS_NUM] =
 {
@@ -210,7 +213,7 @@ MasterCommand_T masterCommands[REGISTERS_NUM] =
 /*98*/	CmdServerReadWriteScheduledPowerOff, // 0 - 250 seconds, 0xFF means no power off, 251 - 254 reserved
 /*99*/  CmdServerReadWriteWakeupOnCharge,
 /*100*/	CmdServerReadWriteVSysSwitchState, // --Vsys output switch control--
-/*101*/	NULL,
+/*101*/	CmdServerReadWriteIdlePowerOff, // bit7 non volatile, bits 0-6 load current threshold 10mA, 0 disabled; dwell 100ms
 
 	// --on board led--
 /*102*/	CmdServerReadWriteLedState1,	//
@@ -386,7 +389,7 @@ MasterCommand_T masterCommands[REGISTERS_NUM] =
 /*244*/	NULL,
 /*245*/	NULL,
 /*246*/	CmdServerReadWriteLogging,
-/*247*/	NULL,
+/*247*/	CmdServerReadWriteProfiler,
 /*248*/	CmdServerReadWriteTestAndCalibration,
 /*249*/	NULL,
 /*250*/	CmdServerReadBoardFaultStatus,
@@ -819,6 +822,14 @@ void CmdServerReadWriteScheduledPowerOff(uint8_t dir, uint8_t *pData, uint16_t *
 	}
 }
 
+void CmdServerReadWriteIdlePowerOff(uint8_t dir, uint8_t *pData, uint16_t *dataLen) {
+	if (dir == MASTER_CMD_DIR_WRITE) {
+		PowerMngmtSetIdlePowerOffCmd(pData+1, *dataLen - 1);
+	} else {
+		PowerMngmtGetIdlePowerOffCmd(pData, dataLen);
+	}
+}
+
 void CmdServerReadWriteVSysSwitchState(uint8_t dir, uint8_t *pData, uint16_t *dataLen) {
 	if (dir == MASTER_CMD_DIR_WRITE) {
 		PowerSourceSetVSysSwitchState(pData[1]);
@@ -1051,6 +1062,7 @@ void CmdServerRunBootloader(uint8_t dir, uint8_t *pData, uint16_t *dataLen) {
   __HAL_RCC_TIM3_CLK_DISABLE();
   __HAL_RCC_TIM14_CLK_DISABLE();
   __HAL_RCC_TIM15_CLK_DISABLE();
+  __HAL_RCC_TIM16_CLK_DISABLE();
   __HAL_RCC_TIM17_CLK_DISABLE();
   __HAL_RCC_PWR_CLK_DISABLE();
   __HAL_RCC_SYSCFG_CLK_DISABLE();
@@ -1148,3 +1160,13 @@ void CmdServerReadWriteLogging(uint8_t dir, uint8_t *pData, uint16_t *dataLen) {
 	}
 #endif
 }
+
+void CmdServerReadWriteProfiler(uint8_t dir, uint8_t *pData, uint16_t *dataLen) {
+#if defined PROFILER
+	if (dir == MASTER_CMD_DIR_WRITE) {
+		ProfilerWriteCmd(pData+1, *dataLen - 1);
+	} else {
+		ProfilerReadCmd(pData, dataLen);
+	}
+#endif
+}
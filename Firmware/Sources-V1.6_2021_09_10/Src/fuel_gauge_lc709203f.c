@@ -100,6 +100,64 @@ int8_t FuelGaugeWriteWord(uint8_t cmd, uint16_t word) {
 	//HAL_Delay(2);
 }
 
+// Reads group of registers one after another, each a blocking read. Bus error aborts
+// rest of the group, as following transfers would only wait for the same timeout, and
+// is reported for all words not read. Crc error invalidates only affected word.
+static int8_t FuelGaugeReadBatch(const uint8_t cmd[], uint16_t *word[], int8_t status[], uint8_t n) {
+	uint8_t i;
+	for (i = 0; i < n; i++) {
+		status[i] = FuelGaugeReadWord(cmd[i], word[i]);
+		if (status[i] > 0) {
+			int8_t err = status[i];
+			while (++i < n) status[i] = err;
+			return err;
+		}
+	}
+	return 0;
+}
+
+static void FuelGaugeCountI2cResult(int8_t succ) {
+	if (succ == 0) {
+		fuelGaugeI2cErrorCounter = 0;
+	} else if (succ > 0) {
+		fuelGaugeI2cErrorCounter = fuelGaugeI2cErrorCounter < 127 ? fuelGaugeI2cErrorCounter + 1 : 127;
+	}
+}
+
+// Periodic fuel gauge poll, voltage, rsoc and thermistor temperature that are due in
+// this task period are read one after another, errors are counted once per poll.
+// Rsoc is due every 4th and temperature every 8th period of cnt, while the ic answers.
+static int8_t fgRsocReadStatus;
+static int8_t fgTempReadStatus;
+
+static void FuelGaugePoll(uint8_t cnt) {
+	uint8_t icOk = fuelGaugeI2cErrorCounter < 5 && fuelGaugeI2cErrorCounter >= 0;
+	uint8_t socDue = icOk && (cnt&0x04) && rsocMeasurementConfig == RSOC_MEASUREMENT_AUTO_DETECT;
+	uint8_t tempDue = icOk && (cnt&0x08) && fuelGaugeTempMode == FUEL_GAUGE_TEMP_MODE_THERMISTOR
+		&& (tempSensorConfig == BAT_TEMP_SENSE_CONFIG_AUTO_DETECT || tempSensorConfig == BAT_TEMP_SENSE_CONFIG_NTC);
+	uint8_t cmd[3];
+	uint16_t *word[3];
+	int8_t status[3];
+	uint8_t n = 0;
+
+	fgRsocReadStatus = 1;
+	fgTempReadStatus = 1;
+
+	if (socDue) {
+		cmd[n] = 0x09; word[n++] = &batteryVoltage;
+		cmd[n] = 0x0F; word[n++] = &batteryRsoc;
+	}
+	if (tempDue) {
+		cmd[n] = 0x08; word[n++] = &fuelGaugeTemp;
+	}
+	if (n == 0) return;
+
+	FuelGaugeCountI2cResult(FuelGaugeReadBatch(cmd, word, status, n));
+
+	if (socDue) fgRsocReadStatus = status[1];
+	if (tempDue) fgTempReadStatus = status[n-1];
+}
+
 inline int32_t GetSocFromOCV(uint16_t ocv){
 	int32_t i;
 	for (i = 0; i < 256; i++) {
@@ -275,24 +333,11 @@ void SocEvaluateDirectDynVoltage(uint16_t batVolt, int32_t dt) {
 }
 
 void SocEvaluateFuelGaugeIc(void) {
-	volatile int8_t succ;
-	// read battery voltage
-	succ = FuelGaugeReadWord(0x09, &batteryVoltage);
-	if (succ == 0) {
-		fuelGaugeI2cErrorCounter = 0;
-	} else if (succ > 0) {
-		fuelGaugeI2cErrorCounter = fuelGaugeI2cErrorCounter < 127 ? fuelGaugeI2cErrorCounter + 1 : 127;
-		return;
-	}
+	// voltage and state of charge are read by FuelGaugePoll
+	if (fgRsocReadStatus > 0) return;
 
-	// read state of charge
-	succ = FuelGaugeReadWord(0x0F, &batteryRsoc);
-	if (succ == 0) {
-		fuelGaugeI2cErrorCounter = 0;
+	if (fgRsocReadStatus == 0) {
 		soc = ((int32_t)batteryRsoc) << 21;
-	} else if (succ > 0) {
-		fuelGaugeI2cErrorCounter = fuelGaugeI2cErrorCounter < 127 ? fuelGaugeI2cErrorCounter + 1 : 127;
-		return;
 	}
 
 	if (batteryRsoc != prevRsoc && (HAL_GetTick() - dischargeCount) > 500) {
@@ -336,6 +381,8 @@ static void FuelGaugeTask(void *argument) {
 			}
 			updateCnt++;
 
+			FuelGaugePoll(updateCnt);
+
 			if (rsocMeasurementConfig == RSOC_MEASUREMENT_AUTO_DETECT && fuelGaugeI2cErrorCounter < 5 && fuelGaugeI2cErrorCounter > -5) {
 				if ( fuelGaugeI2cErrorCounter >= 0 ) {
 					// in case fuel gauge ic is present use it
@@ -366,10 +413,9 @@ static void FuelGaugeTask(void *argument) {
 					if ( fuelGaugeI2cErrorCounter < 5 && fuelGaugeI2cErrorCounter >= 0 ) {
 						// if left tries
 						if (fuelGaugeTempMode == FUEL_GAUGE_TEMP_MODE_THERMISTOR) {
-							// try to read battery temperature from fuel gauge ic
-							succ = FuelGaugeReadWord(0x08, &fuelGaugeTemp);
+							// battery temperature is read from fuel gauge ic in FuelGaugePoll
+							succ = fgTempReadStatus;
 							if (succ == 0) {
-								fuelGaugeI2cErrorCounter = 0;
 								// check if NTC measurement is valid, compatible NTC sensor should give temp reading above -20C
 								if (fuelGaugeTemp <= 0x09E4 || currentBatProfile==NULL || currentBatProfile->ntcB == 0xFFFF || currentBatProfile->ntcResistance != 1000) {
 									// in case of invalid measurement, use on board measurement and update fuel gauge
@@ -388,10 +434,7 @@ static void FuelGaugeTask(void *argument) {
 									}
 									ntcFaultFlag = 0;
 								}
-							} else if (succ > 0) {
-								// failed reading mean no fuel gauge ic on board
-								fuelGaugeI2cErrorCounter = fuelGaugeI2cErrorCounter < 127 ? fuelGaugeI2cErrorCounter + 1 : 127;
-							}
+							} // failed reading, counted by poll, mean no fuel gauge ic on board
 						} else {
 							fuelGaugeTemp = mcuTemperature * 10 + 2732;
 							fuelGaugeTemp = fuelGaugeTemp > 0x0D04 ? 0x0D04 : fuelGaugeTemp;
@@ -499,6 +542,8 @@ void FuelGaugeTask(void) {
 			}
 			updateCnt++;
 
+			FuelGaugePoll(updateCnt);
+
 			if (rsocMeasurementConfig == RSOC_MEASUREMENT_AUTO_DETECT && fuelGaugeI2cErrorCounter < 5 && fuelGaugeI2cErrorCounter > -5) {
 				if ( fuelGaugeI2cErrorCounter >= 0 ) {
 					// in case fuel gauge ic is present use it
@@ -529,10 +574,9 @@ void FuelGaugeTask(void) {
 					if ( fuelGaugeI2cErrorCounter < 5 && fuelGaugeI2cErrorCounter >= 0 ) {
 						// if left tries
 						if (fuelGaugeTempMode == FUEL_GAUGE_TEMP_MODE_THERMISTOR) {
-							// try to read battery temperature from fuel gauge ic
-							succ = FuelGaugeReadWord(0x08, &fuelGaugeTemp);
+							// battery temperature is read from fuel gauge ic in FuelGaugePoll
+							succ = fgTempReadStatus;
 							if (succ == 0) {
-								fuelGaugeI2cErrorCounter = 0;
 								// check if NTC measurement is valid, compatible NTC sensor should give temp reading above -20C
 								if (fuelGaugeTemp <= 0x09E4 || currentBatProfile==NULL || currentBatProfile->ntcB == 0xFFFF ) {
 									// in case of invalid measurement, use on board measurement and update fuel gauge
@@ -561,10 +605,7 @@ void FuelGaugeTask(void) {
 									}
 									ntcFaultFlag = 0;
 								}
-							} else if (succ > 0) {
-								// failed reading mean no fuel gauge ic on board
-								fuelGaugeI2cErrorCounter = fuelGaugeI2cErrorCounter < 127 ? fuelGaugeI2cErrorCounter + 1 : 127;
-							}
+							} // failed reading, counted by poll, mean no fuel gauge ic on board
 						} else {
 							fuelGaugeTemp = mcuTemperature * 10 + 2732;
 							fuelGaugeTemp = fuelGaugeTemp > 0x0D04 ? 0x0D04 : fuelGaugeTemp;
@@ -25,7 +25,8 @@ uint8_t log_read_flag = 0;
 	log_buf[log_last+1] = ++log_last_seq_num; /* second byte in frame is sequence number */ \
 	log_buf[log_last+2] = id;   /* third byte in frame is log message id */ \
 
-#define IS_LOG_ENABLED(id) ((id>3 && id<10) ? log_config&(0x01<<(id-3)) : log_config&0x01)
+// log_config enable bits: bit 0 OTHER, bits 1..6 ids 5VREG_ON..RESERVED2, bit 7 POWER_OFF_EVT
+#define IS_LOG_ENABLED(id) ((id>3 && id<10) ? log_config&(0x01<<(id-3)) : (id==POWER_OFF_EVT) ? log_config&0x80 : log_config&0x01)
 
 uint8_t *LoggingInitMessage(LogMsgId_T id) {
 	if (!IS_LOG_ENABLED(id)) return NULL;
@@ -49,6 +49,7 @@
 #include "io_control.h"
 #include "execution.h"
 #include "logging.h"
+#include "profiler.h"
 
 #define OWN1_I2C_ADDRESS		0x14
 #define OWN2_I2C_ADDRESS		0x68
@@ -703,6 +704,9 @@ int main(void)
 	NvSetDataInitialized();
 #if defined LOGGING
 	LoggingInit();
+#endif
+#if defined PROFILER
+	ProfilerInit();
 #endif
 	/*if ( executionState == EXECUTION_STATE_CONFIG_RESET ) {
 		LedSetRGB(1, 0, 255, 0);
@@ -11,6 +11,7 @@
 #include "fuel_gauge_lc709203f.h"
 #include "time_count.h"
 #include "power_source.h"
+#include "load_current_sense.h"
 #include "button.h"
 //#include "led.h"
 #include "logging.h"
@@ -47,6 +48,14 @@ uint32_t lastWakeupTimer __attribute__((section("no_init")));
 
 uint32_t delayedPowerOffCounter __attribute__((section("no_init")));
 
+// Power off when host idle, after scheduled power off request 5V regulator is turned off as soon as
+// load current stays below threshold for dwell time, scheduled delay is then only upper bound.
+uint8_t idlePowerOffConfig __attribute__((section("no_init"))); // bit7 - non volatile, bits 0-6 threshold in 10mA, 0 - disabled
+uint8_t idlePowerOffDwell __attribute__((section("no_init"))); // dwell time in 100ms
+static uint32_t powerOffScheduleTimer;
+static uint32_t idleCurrentTimer;
+static uint8_t idleCurrentFlag = 0;
+
 uint16_t watchdogConfig __attribute__((section("no_init")));
 uint32_t watchdogExpirePeriod __attribute__((section("no_init"))); // 0 - disabled, 1-255 expiration time minutes
 uint32_t watchdogTimer __attribute__((section("no_init")));
@@ -93,6 +102,15 @@ void PowerManagementInit(void) {
 			watchdogConfig  = 0;
 		}
 
+		idlePowerOffConfig = 0;
+		idlePowerOffDwell = IDLE_POWER_OFF_DEFAULT_DWELL;
+		if (NvReadVariableU8(IDLE_POWER_OFF_CONFIG_NV_ADDR, (uint8_t*)&idlePowerOffConfig) == NV_READ_VARIABLE_SUCCESS) {
+			idlePowerOffConfig |= 0x80;
+			if (NvReadVariableU8(IDLE_POWER_OFF_DWELL_NV_ADDR, (uint8_t*)&idlePowerOffDwell) != NV_READ_VARIABLE_SUCCESS || idlePowerOffDwell == 0) {
+				idlePowerOffDwell = IDLE_POWER_OFF_DEFAULT_DWELL;
+			}
+		}
+
 		delayedPowerOffCounter = 0;
 		watchdogExpirePeriod = 0;
 		watchdogTimer = 0;
@@ -137,8 +155,25 @@ __STATIC_INLINE void LOG_PM_WAKEUP_EVENT(uint8_t triggers) {
 	buf[11] = curr;
 	buf[12] = curr>>8;
 }
+
+__STATIC_INLINE void LOG_PM_POWER_OFF_EVENT(uint8_t trigger, int32_t curr) {
+	uint8_t *buf = LoggingInitMessage(POWER_OFF_EVT);
+	if (buf == NULL) 	return;
+	uint32_t delay = MS_TIME_COUNT(powerOffScheduleTimer);
+	buf[0] = trigger;
+	buf[1] = delay;
+	buf[2] = delay >> 8;
+	buf[3] = delay >> 16;
+	buf[4] = delay >> 24;
+	buf[5] = idlePowerOffConfig;
+	buf[6] = idlePowerOffDwell;
+	buf[7] = curr;
+	buf[8] = curr >> 8;
+	buf[9] = batteryRsoc>>2;
+}
 #else
 #define LOG_PM_WAKEUP_EVENT(triggers)
+#define LOG_PM_POWER_OFF_EVENT(trigger, curr)
 #endif
 
 int8_t ResetHost(void) {
@@ -236,6 +271,37 @@ void ButtonEventFuncPowerResetCb(uint8_t b, ButtonEvent_T event) {
 	ButtonRemoveEvent(b);
 }
 
+static void PowerMngmtIdlePowerOffTask(void) {
+	if ( !delayedPowerOffCounter || !(idlePowerOffConfig&0x7F) ) {
+		idleCurrentFlag = 0;
+		return;
+	}
+
+	// load current can be measured only while powering host from battery
+	if ( !POW_5V_BOOST_EN_STATUS() || pow5vInDetStatus == POW_5V_IN_DETECTION_STATUS_PRESENT ) {
+		idleCurrentFlag = 0;
+		return;
+	}
+
+	int32_t curr = GetLoadCurrent();
+	if ( curr < 0 || curr > (int32_t)(idlePowerOffConfig&0x7F) * 10 ) {
+		// host still running, restart dwell
+		idleCurrentFlag = 0;
+		return;
+	}
+
+	if ( !idleCurrentFlag ) {
+		idleCurrentFlag = 1;
+		MS_TIME_COUNTER_INIT(idleCurrentTimer);
+	} else if ( MS_TIME_COUNT(idleCurrentTimer) >= (uint32_t)idlePowerOffDwell * 100 ) {
+		// halted host current is stable, no need to wait for scheduled delay
+		LOG_PM_POWER_OFF_EVENT(IDLE_POWER_OFF_TRIGGER_IDLE, curr);
+		Turn5vBoost(0);
+		delayedPowerOffCounter = 0;
+		idleCurrentFlag = 0;
+	}
+}
+
 void PowerMngmtHostPollEvent(void) {
 	rtcWakeupEventFlag = 0;
 	ioWakeupEvent = 0;
@@ -278,8 +344,11 @@ static void PowerManagementTask(void *argument) {
 		delayedTurnOnFlag = 0;
 	}
 
+	PowerMngmtIdlePowerOffTask();
+
 	if ( delayedPowerOffCounter && delayedPowerOffCounter <= HAL_GetTick() ) {
 		if (POW_5V_BOOST_EN_STATUS() && (pow5vInDetStatus != POW_5V_IN_DETECTION_STATUS_PRESENT)) {
+			LOG_PM_POWER_OFF_EVENT(IDLE_POWER_OFF_TRIGGER_DELAY, GetLoadCurrent());
 			Turn5vBoost(0);
 		}
 		delayedPowerOffCounter = 0;
@@ -341,8 +410,11 @@ void PowerManagementTask(void) {
 		MS_TIME_COUNTER_INIT(lastWakeupTimer);
 	}
 
+	PowerMngmtIdlePowerOffTask();
+
 	if ( delayedPowerOffCounter && delayedPowerOffCounter <= HAL_GetTick() ) {
 		if (POW_5V_BOOST_EN_STATUS() && (pow5vInDetStatus != POW_5V_IN_DETECTION_STATUS_PRESENT)) {
+			LOG_PM_POWER_OFF_EVENT(IDLE_POWER_OFF_TRIGGER_DELAY, GetLoadCurrent());
 			Turn5vBoost(0);
 		}
 		delayedPowerOffCounter = 0;
@@ -363,6 +435,8 @@ void PowerMngmtSchedulePowerOff(uint8_t dalayCode) {
 	if (dalayCode <= 250) {
 		delayedPowerOffCounter = HAL_GetTick() + dalayCode * 1024;
 		if (delayedPowerOffCounter == 0) delayedPowerOffCounter ++; // 0 is used to indicate non active counter, so avoid that value
+		MS_TIME_COUNTER_INIT(powerOffScheduleTimer);
+		idleCurrentFlag = 0;
 	} else if (dalayCode == 0xFF) {
 		delayedPowerOffCounter = 0; // deactivate scheduled power off
 	}
@@ -466,6 +540,35 @@ void PowerMngmtSetWakeupOnChargeCmd(uint8_t data[], uint16_t len) {
 	}
 }
 
+void PowerMngmtSetIdlePowerOffCmd(uint8_t data[], uint16_t len) {
+	if (len < 2) return;
+
+	uint8_t dwell = data[1] ? data[1] : IDLE_POWER_OFF_DEFAULT_DWELL;
+
+	if (data[0]&0x80) {
+		NvWriteVariableU8(IDLE_POWER_OFF_CONFIG_NV_ADDR, data[0]&0x7F);
+		NvWriteVariableU8(IDLE_POWER_OFF_DWELL_NV_ADDR, dwell);
+		if (NvReadVariableU8(IDLE_POWER_OFF_CONFIG_NV_ADDR, (uint8_t*)&idlePowerOffConfig) != NV_READ_VARIABLE_SUCCESS
+		 || NvReadVariableU8(IDLE_POWER_OFF_DWELL_NV_ADDR, (uint8_t*)&idlePowerOffDwell) != NV_READ_VARIABLE_SUCCESS
+		 ) {
+			idlePowerOffConfig = 0;
+			idlePowerOffDwell = IDLE_POWER_OFF_DEFAULT_DWELL;
+		} else {
+			idlePowerOffConfig |= 0x80;
+		}
+	} else {
+		idlePowerOffConfig = data[0];
+		idlePowerOffDwell = dwell;
+	}
+	idleCurrentFlag = 0;
+}
+
+void PowerMngmtGetIdlePowerOffCmd(uint8_t data[], uint16_t *len) {
+	data[0] = idlePowerOffConfig;
+	data[1] = idlePowerOffDwell;
+	*len = 2;
+}
+
 void PowerMngmtGetWakeupOnChargeCmd(uint8_t data[], uint16_t *len)  {
 	if (wakeupOnChargeConfig&0x80)
 		data[0] = wakeupOnChargeConfig;
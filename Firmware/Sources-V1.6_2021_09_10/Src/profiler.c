@@ -0,0 +1,205 @@
+/*
+ * profiler.c
+ *
+ *  Created on: 18.10.2026.
+ *      Author: milan
+ *
+ *  Statistical PC sampling profiler. TIM16 interrupt at lowest priority takes
+ *  program counter from exception stack frame and counts it into histogram of
+ *  code address buckets. Host reads histogram over i2c and symbolises it against
+ *  firmware elf (Software/Test/pijuice_prof.py).
+ */
+
+#include "profiler.h"
+
+#if defined PROFILER
+
+extern void Error_Handler(void);
+
+static TIM_HandleTypeDef htim16;
+
+static uint16_t profBuckets[PROF_BUCKETS_NUM];
+static volatile uint32_t profTotalSamples;
+static volatile uint32_t profOutOfRange;
+static uint32_t profBase = PROF_DEFAULT_BASE;
+static uint8_t profShift;
+static uint16_t profPeriodUs = PROF_DEFAULT_PERIOD_US;
+static volatile uint8_t profStatus = 0;
+static uint8_t profReadPage = 0;
+
+// Exception entry stacks r0-r3, r12, lr, pc, xpsr. Handler must be naked so stack
+// pointer is captured before compiler generated prologue, EXC_RETURN bit 2
+// selects stack used by interrupted code.
+void TIM16_IRQHandler(void) __attribute__((naked));
+void ProfilerSample(uint32_t *frame) __attribute__((used));
+
+extern uint32_t _etext; // end of code, defined in linker script
+
+void TIM16_IRQHandler(void) {
+	__asm volatile (
+		"movs r0, #4 \n"
+		"mov r1, lr \n"
+		"tst r0, r1 \n"
+		"beq 1f \n"
+		"mrs r0, psp \n"
+		"b 2f \n"
+		"1: \n"
+		"mrs r0, msp \n"
+		"2: \n"
+		"ldr r2, =ProfilerSample \n"
+		"bx r2 \n" // tail call, lr still holds EXC_RETURN
+		".align 2 \n"
+		".ltorg \n"
+	);
+}
+
+void ProfilerSample(uint32_t *frame) {
+	TIM16->SR = ~TIM_SR_UIF;
+
+	uint32_t idx = (frame[6] - profBase) >> profShift;
+
+	profTotalSamples ++;
+	if (idx >= PROF_BUCKETS_NUM) {
+		// outside of profiled range, also catches pc below base
+		profOutOfRange ++;
+		return;
+	}
+
+	if (++profBuckets[idx] == 0xFFFF) {
+		// stop rather than wrap so collected profile stays proportional
+		ProfilerStop();
+		profStatus |= PROF_STATUS_SATURATED;
+	}
+}
+
+// Smallest bucket size that still covers all code from base to end of text
+static uint8_t ProfilerFitShift(uint32_t base) {
+	uint32_t end = (uint32_t)&_etext;
+	uint8_t shift = 1;
+	if (end <= base) return 8;
+	while (shift < 23 && ((end - base) >> shift) >= PROF_BUCKETS_NUM) shift++;
+	return shift;
+}
+
+void ProfilerInit(void) {
+	profStatus = 0;
+	profShift = ProfilerFitShift(profBase);
+	profReadPage = 0;
+	ProfilerClear();
+}
+
+void ProfilerClear(void) {
+	int16_t i = PROF_BUCKETS_NUM;
+	while(i--) profBuckets[i] = 0;
+	profTotalSamples = 0;
+	profOutOfRange = 0;
+	profStatus &= ~PROF_STATUS_SATURATED;
+}
+
+void ProfilerStart(uint16_t periodUs, uint8_t shift, uint32_t base) {
+	ProfilerStop();
+
+	profPeriodUs = periodUs >= 50 ? periodUs : PROF_DEFAULT_PERIOD_US; // keep sampling overhead bounded
+	profBase = base ? base : PROF_DEFAULT_BASE;
+	profShift = (shift > 0 && shift < 24) ? shift : ProfilerFitShift(profBase);
+	ProfilerClear();
+
+	// 1MHz timer clock
+	htim16.Instance = TIM16;
+	htim16.Init.Prescaler = (HAL_RCC_GetPCLK1Freq() / 1000000) - 1;
+	htim16.Init.CounterMode = TIM_COUNTERMODE_UP;
+	htim16.Init.Period = profPeriodUs - 1;
+	htim16.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+	htim16.Init.RepetitionCounter = 0;
+	if (HAL_TIM_Base_Init(&htim16) != HAL_OK)
+	{
+		Error_Handler();
+	}
+
+	// lowest priority, i2c and adc handlers are not delayed by sampling
+	HAL_NVIC_SetPriority(TIM16_IRQn, 3, 0);
+	HAL_NVIC_EnableIRQ(TIM16_IRQn);
+
+	profStatus |= PROF_STATUS_RUNNING;
+	HAL_TIM_Base_Start_IT(&htim16);
+}
+
+void ProfilerStop(void) {
+	if (!(profStatus & PROF_STATUS_RUNNING)) return;
+	HAL_TIM_Base_Stop_IT(&htim16);
+	HAL_NVIC_DisableIRQ(TIM16_IRQn);
+	profStatus &= ~PROF_STATUS_RUNNING;
+}
+
+void ProfilerReadCmd(uint8_t data[], uint16_t *len) {
+	int8_t i = 31;
+	while(i--) data[i] = 0;
+	*len = 31;
+
+	data[0] = profReadPage;
+	data[1] = profStatus;
+
+	if (profReadPage == 0) {
+		// header page
+		uint32_t total = profTotalSamples;
+		uint32_t outOfRange = profOutOfRange;
+		data[2] = profShift;
+		data[3] = PROF_PAGES_NUM;
+		data[4] = PROF_PAGE_BUCKETS;
+		data[5] = profBase;
+		data[6] = profBase >> 8;
+		data[7] = profBase >> 16;
+		data[8] = profBase >> 24;
+		data[9] = total;
+		data[10] = total >> 8;
+		data[11] = total >> 16;
+		data[12] = total >> 24;
+		data[13] = outOfRange;
+		data[14] = outOfRange >> 8;
+		data[15] = outOfRange >> 16;
+		data[16] = outOfRange >> 24;
+		data[17] = profPeriodUs;
+		data[18] = profPeriodUs >> 8;
+	} else {
+		uint16_t b = (uint16_t)(profReadPage - 1) * PROF_PAGE_BUCKETS;
+		for (i = 0; i < PROF_PAGE_BUCKETS && b < PROF_BUCKETS_NUM; i++, b++) {
+			data[2+i*2] = profBuckets[b];
+			data[3+i*2] = profBuckets[b] >> 8;
+		}
+	}
+
+	// host reads pages in sequence, header comes again after last page
+	profReadPage = profReadPage < PROF_PAGES_NUM ? profReadPage + 1 : 0;
+}
+
+int8_t ProfilerWriteCmd(uint8_t data[], uint16_t len) {
+	if (len < 1) return 1;
+
+	switch (data[0]) {
+	case 0x00:
+		ProfilerStop();
+		break;
+	case 0x01:
+		if (len >= 8) {
+			ProfilerStart(data[1] | ((uint16_t)data[2] << 8), data[3],
+					data[4] | ((uint32_t)data[5] << 8) | ((uint32_t)data[6] << 16) | ((uint32_t)data[7] << 24));
+		} else {
+			ProfilerStart(PROF_DEFAULT_PERIOD_US, PROF_AUTO_SHIFT, PROF_DEFAULT_BASE);
+		}
+		break;
+	case 0x02:
+		ProfilerClear();
+		break;
+	case 0x03:
+		if (len < 2) return 1;
+		profReadPage = data[1] <= PROF_PAGES_NUM ? data[1] : 0;
+		return 0;
+	default:
+		return 1;
+	}
+
+	profReadPage = 0;
+	return 0;
+}
+
+#endif // PROFILER
@@ -617,6 +617,10 @@ void HAL_TIM_Base_MspInit(TIM_HandleTypeDef* htim_base)
   {
 	  __HAL_RCC_TIM14_CLK_ENABLE();
   }
+  else if(htim_base->Instance==TIM16)
+  {
+	  __HAL_RCC_TIM16_CLK_ENABLE();
+  }
 
 }
 
@@ -795,6 +799,11 @@ void HAL_TIM_Base_MspDeInit(TIM_HandleTypeDef* htim_base)
 
   /* USER CODE END TIM14_MspDeInit 1 */
   }
+  else if(htim_base->Instance==TIM16)
+  {
+    /* Peripheral clock disable */
+    __HAL_RCC_TIM16_CLK_DISABLE();
+  }
   /* USER CODE BEGIN TIM17_MspDeInit 1 */
 
   /* USER CODE END TIM17_MspDeInit 1 */
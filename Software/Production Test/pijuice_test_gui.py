@@ -18,6 +18,24 @@ except:
 pijuiceConfigData = {}
 PiJuiceConfigDataPath = '/var/lib/pijuice/pijuice_config.JSON' #os.getcwd() + '/pijuice_config.JSON'
 
+# Firmware built in self test, command 249
+BIST_CMD = 249
+BIST_START = 0xB1
+BIST_READ_LEN = 25
+BIST_FAULTS = 0x01
+BIST_BOOST_OFF = 0x02
+BIST_BOOST_ON = 0x04
+BIST_CHARGER = 0x08
+BIST_ISENSE = 0x10
+BIST_STEPS = ['Board faults', 'Boost regulator off', 'Boost regulator on', 'Charger', 'Current sense calibration']
+BIST_FAILS = [
+	{1: 'board fault', 2: 'invalid charge level'},
+	{1: 'cannot turn off'},
+	{1: 'not turned on or bad regulator voltage', 2: 'battery refused to power boost regulator'},
+	{1: 'charger fault', 2: 'charger status fault', 3: 'battery not detected'},
+	{1: 'load current out of range after calibration'}]
+CHARGE_FAULTS = ['NO_FAULT', 'THERMAL_SHUTDOWN', 'BATTERY_TEMPERATURE_FAULT', 'WATCHDOG_TIMER_EXPIRED', 'SAFETY_TIMER_EXPIRED', 'IN_SUPPLY_FAULT', 'USB_SUPPLY_FAULT', 'BATTERY_FAULT', 'UNKNOWN']
+
 def _ValidateIntEntry(var, oldVar, min, max):
 	new_value = var.get()
 	try:
@@ -250,74 +268,100 @@ class PiJuiceHatTab:
 		except:
 			print('error writing to board variant file')
 	
-	def _HatConfigCmd(self):
-		if pijuice != None:
-		
-			#tkMessageBox.showinfo('Set switch', 'Set tet switch in calibration resistor position and press ok', parent=self.frame)
-			time.sleep(1)
-			
-			#check charger i2c and fuel gauge ic fault status
-			faultStatus = pijuice.interface.ReadData(250, 1)
-			if faultStatus['error'] != 'NO_ERROR':
-				tkinter.messagebox.showerror('On-board test', 'Test failed, I2C communication error.', parent=self.frame)
-				return
-			else:
-				f = faultStatus['data'][0]
-				chargeFaults = ['NO_FAULT', 'THERMAL_SHUTDOWN', 'BATTERY_TEMPERATURE_FAULT', 'WATCHDOG_TIMER_EXPIRED', 'SAFETY_TIMER_EXPIRED', 'IN_SUPPLY_FAULT', 'USB_SUPPLY_FAULT', 'BATTERY_FAULT', 'UNKNOWN']
+	def _RunBist(self, steps, timeout):
+		# Start firmware self test and poll until it finishes, returns result data or None on failure
+		ret = pijuice.interface.WriteData(BIST_CMD, [BIST_START, steps])
+		if ret['error'] != 'NO_ERROR':
+			tkinter.messagebox.showerror('On-board test', 'Test failed, I2C communication error.', parent=self.frame)
+			return None
+		start = time.time()
+		while True:
+			time.sleep(0.05)
+			ret = pijuice.interface.ReadData(BIST_CMD, BIST_READ_LEN)
+			if ret['error'] == 'NO_ERROR' and ret['data'][0] != 1:
+				break
+			if time.time() - start > timeout:
+				pijuice.interface.WriteData(BIST_CMD, [0x00])
+				tkinter.messagebox.showerror('On-board test', 'Test failed, self test did not complete.', parent=self.frame)
+				return None
+		d = ret['data']
+		stepTimes = [d[13 + i * 2] | (d[14 + i * 2] << 8) for i in range(0, len(BIST_STEPS))]
+		print('Self test', d[0:3], 'step times ms', stepTimes, 'total ms', d[23] | (d[24] << 8))
+		if d[0] != 2:
+			step = d[1] if d[1] < len(BIST_STEPS) else 0
+			reason = BIST_FAILS[step].get(d[2], 'error ' + str(d[2]))
+			if step == 0 and d[2] == 1:
+				f = d[4]
 				if (f & 0x01) != 0:
-					tkinter.messagebox.showerror('On-board test', 'Test failed, Charger ic I2C communication error.', parent=self.frame)
-					return
+					reason = 'Charger ic I2C communication error'
 				elif (f & 0x0E) != 0:
-					tkinter.messagebox.showerror('On-board test', 'Test failed,' + chargeFaults[(f & 0x0E) >> 1] + '.', parent=self.frame)
-					return
+					reason = CHARGE_FAULTS[(f & 0x0E) >> 1]
 				elif (f & 0x10) != 0:
-					tkinter.messagebox.showerror('On-board test', 'Test failed, Fuel gauge ic I2C communication error.', parent=self.frame)
-					return
-				elif (f & 0x20) != 0:
-					tkinter.messagebox.showerror('On-board test', 'Test failed, Battery temperature sensor fault.', parent=self.frame)
-					return
+					reason = 'Fuel gauge ic I2C communication error'
+			elif step == 0 and d[2] == 2:
+				reason += ' ' + str(d[5])
+			elif step in (1, 2):
+				reason += ' ' + str(d[7 + (step - 1) * 2] | (d[8 + (step - 1) * 2] << 8)) + 'mV'
+			elif step == 4:
+				reason += ' ' + str(d[11] | (d[12] << 8)) + 'mA'
+			tkinter.messagebox.showerror(BIST_STEPS[step] + ' test', 'Test failed, ' + reason + '.', parent=self.frame)
+			return None
+		return d
 
-			# charge level test
-			chg = pijuice.status.GetChargeLevel()
-			if chg['error'] == 'NO_ERROR':
-				chg = chg['data']
-				if chg < 1 or chg > 99:
-					tkinter.messagebox.showerror('On-board test', 'Test failed, invalid charge level.', parent=self.frame)
-					return
-			else:
-				tkinter.messagebox.showerror('On-board test', 'Test failed, I2C communication error.', parent=self.frame)
+	def _WaitIoVoltage(self, low, high, timeout):
+		# Poll GPIO 5V until it is inside the window, returns last reading or None on I2C error
+		start = time.time()
+		while True:
+			v5v = pijuice.status.GetIoVoltage()
+			if v5v['error'] != 'NO_ERROR':
+				return None
+			if (low <= v5v['data'] <= high) or (time.time() - start > timeout):
+				return v5v['data']
+			time.sleep(0.05)
+
+	def _WaitBatteryStatus(self, status, timeout):
+		# Poll battery status until it matches, returns last status or None on I2C error
+		start = time.time()
+		while True:
+			ret = pijuice.status.GetStatus()
+			if ret['error'] != 'NO_ERROR':
+				return None
+			if (ret['data']['battery'] == status) or (time.time() - start > timeout):
+				return ret['data']['battery']
+			time.sleep(0.1)
+
+	def _HatConfigCmd(self):
+		if pijuice != None:
+			testStart = time.time()
+
+			# board faults, charge level, boost regulator off/on and charger run in firmware
+			if self._RunBist(BIST_FAULTS | BIST_BOOST_OFF | BIST_BOOST_ON | BIST_CHARGER, 10) == None:
 				return
-				
+
 			# power button test, turn off boost regulator, and check if it turns on button press
 			ret = pijuice.power.SetPowerOff(0)
 			if ret['error'] != 'NO_ERROR':
 				tkinter.messagebox.showerror('Power button test', 'Test failed, I2C communication error.', parent=self.frame)
 				return
-			time.sleep(0.2)
-			v5v = pijuice.status.GetIoVoltage()
-			if v5v['error'] != 'NO_ERROR':
-				tkinter.messagebox.showerror('Boost regulator test', 'Boost regulator test failed, I2C communication error.', parent=self.frame)
+			v = self._WaitIoVoltage(0, 500, 1.5)
+			if v == None:
+				tkinter.messagebox.showerror('Power button test', 'Test failed, I2C communication error.', parent=self.frame)
+				return
+			elif v > 500:
+				print(v)
+				tkinter.messagebox.showerror('Power button test', 'Test failed, cannot turn off boost regulator', parent=self.frame)
 				return
-			else:
-				v = v5v['data']
-				if v > 500:
-					print(v)
-					tkinter.messagebox.showerror('Boost regulator test', 'Boost regulator test failed, cannot turn off', parent=self.frame)
-					return
 			tkinter.messagebox.showinfo("Power button test", "Short press switch1 and press ok", icon='warning')
-			time.sleep(0.2)
-			
+
 			# test boost regulator is turned on and have good voltage
-			v5v = pijuice.status.GetIoVoltage()
-			if v5v['error'] != 'NO_ERROR':
-				tkinter.messagebox.showerror('Boost regulator test', 'Boost regulator test failed, I2C communication error.', parent=self.frame)
+			v = self._WaitIoVoltage(4900, 5250, 1.5)
+			if v == None:
+				tkinter.messagebox.showerror('Power button test', 'Test failed, I2C communication error.', parent=self.frame)
+				return
+			elif v < 4900 or v > 5250:
+				print(v)
+				tkinter.messagebox.showerror('Power button test', 'Test failed, boost regulator not turned on or bad regulator voltage', parent=self.frame)
 				return
-			else:
-				v = v5v['data']
-				if v < 4900 or v > 5250:
-					print(v)
-					tkinter.messagebox.showerror('Boost regulator test', 'Boost regulator test failed, no turned on or bad regulator voltage', parent=self.frame)
-					return
 					
 			if self.pijuiceBoardType.get() == 0:
 				# sw2 button test
@@ -367,57 +411,29 @@ class PiJuiceHatTab:
 				return
 			ret = pijuice.status.SetLedState('D2', [0,0,0])
 				
-			# calibrate current sense
-			pijuice.interface.WriteData(248, [0x55, 0x26, 0xa0, 0x2b]) # send calibration command
-			# verify 
-			time.sleep(0.4)
-			# test load current after calibration
-			curr = pijuice.status.GetIoCurrent()
-			if curr['error'] == 'NO_ERROR':
-				curr = curr['data']
-				if curr < 42 or curr > 59:
-					# try once more
-					pijuice.interface.WriteData(248, [0x55, 0x26, 0xa0, 0x2b]) # send calibration command
-					# verify 
-					time.sleep(0.4)
-					# test load current after calibration
-					curr = pijuice.status.GetIoCurrent()
-					if curr['error'] == 'NO_ERROR':
-						curr = curr['data']
-						if curr < 42 or curr > 59:
-							print(curr)
-							tkinter.messagebox.showinfo('Current sense calibration', 'Current sense calibration failed.', parent=self.frame)
-							return
-					else:
-						tkinter.messagebox.showinfo('Current sense calibration', 'Current sense calibration failed, I2C communication error.', parent=self.frame)
-						return
-			else:
-				tkinter.messagebox.showinfo('Current sense calibration', 'Current sense calibration failed, I2C communication error.', parent=self.frame)
+			# calibrate current sense with calibration load and check load current, firmware retries once
+			if self._RunBist(BIST_ISENSE, 60) == None:
 				return
 				
 			# USB micro input charging test
 			tkinter.messagebox.showinfo('Plug in USB micro power', 'Plug in power to PiJuce USB micro input and press ok', parent=self.frame)
-			time.sleep(1.5)
-			status = pijuice.status.GetStatus()
-			if status['error'] != 'NO_ERROR':
+			status = self._WaitBatteryStatus('CHARGING_FROM_IN', 3)
+			if status == None:
 				tkinter.messagebox.showerror('USB micro input charging test', 'Test failed, I2C communication error.', parent=self.frame)
 				return
-			else:
-				if status['data']['battery'] != 'CHARGING_FROM_IN':
-					tkinter.messagebox.showerror('USB micro input charging test', 'Test failed, Battery is not charging.', parent=self.frame)
-					return
+			elif status != 'CHARGING_FROM_IN':
+				tkinter.messagebox.showerror('USB micro input charging test', 'Test failed, Battery is not charging.', parent=self.frame)
+				return
 					
 			tkinter.messagebox.showinfo('Set switch', 'Remove USB micro input from PiJuice board, set test switch in RPI 5V position and press ok', parent=self.frame)
-			time.sleep(1.5)
 			# 5V gpio charging test
-			status = pijuice.status.GetStatus()
-			if status['error'] != 'NO_ERROR':
+			status = self._WaitBatteryStatus('CHARGING_FROM_5V_IO', 3)
+			if status == None:
 				tkinter.messagebox.showinfo('5V GPIO charging test', 'Test failed, I2C communication error.', parent=self.frame)
 				return
-			else:
-				if status['data']['battery'] != 'CHARGING_FROM_5V_IO':
-					tkinter.messagebox.showinfo('5V GPIO charging test', 'Test failed, Battery is not charging.', parent=self.frame)
-					return
+			elif status != 'CHARGING_FROM_5V_IO':
+				tkinter.messagebox.showinfo('5V GPIO charging test', 'Test failed, Battery is not charging.', parent=self.frame)
+				return
 					
 			chg = pijuice.status.GetChargeLevel()
 			if chg['error'] == 'NO_ERROR':
@@ -449,6 +465,7 @@ class PiJuiceHatTab:
 				tkinter.messagebox.showerror('System power switch test', 'Test failed.', parent=self.frame)
 				return
 			
+			print('Board test time %.1f s' % (time.time() - testStart))
 			tkinter.messagebox.showinfo('Test complete', 'Unit successfully passed test.', parent=self.frame)
 			
 			#self.advWindow = PiJuiceHATConfigGui()
@@ -0,0 +1,509 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * PiJuice HAT battery power supply and hwmon driver
+ *
+ * Talks to PiJuice mcu command server over i2c (default address 0x14).
+ * Each register read returns data bytes followed by fcs byte, fcs is
+ * 0xFF xor-ed with all data bytes.
+ */
+
+#include <linux/delay.h>
+#include <linux/device.h>
+#include <linux/hwmon.h>
+#include <linux/i2c.h>
+#include <linux/interrupt.h>
+#include <linux/jiffies.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/mod_devicetable.h>
+#include <linux/mutex.h>
+#include <linux/power_supply.h>
+#include <linux/version.h>
+#include <linux/workqueue.h>
+
+#define PIJUICE_STATUS_CMD		0x40
+#define PIJUICE_CHARGE_LEVEL_CMD	0x41
+#define PIJUICE_FAULT_EVENT_CMD		0x44
+#define PIJUICE_BATTERY_TEMP_CMD	0x47
+#define PIJUICE_BATTERY_VOLTAGE_CMD	0x49
+#define PIJUICE_BATTERY_CURRENT_CMD	0x4B
+#define PIJUICE_IO_VOLTAGE_CMD		0x4D
+#define PIJUICE_IO_CURRENT_CMD		0x4F
+
+/* status register, 0x40 */
+#define PIJUICE_STATUS_FAULT		BIT(0)
+#define PIJUICE_STATUS_BAT(s)		(((s) >> 2) & 0x03)
+#define PIJUICE_STATUS_IN(s)		(((s) >> 4) & 0x03)
+#define PIJUICE_STATUS_IO(s)		(((s) >> 6) & 0x03)
+
+#define PIJUICE_BAT_NORMAL		0
+#define PIJUICE_BAT_CHARGING_FROM_IN	1
+#define PIJUICE_BAT_CHARGING_FROM_IO	2
+#define PIJUICE_BAT_NOT_PRESENT		3
+
+#define PIJUICE_POWER_IN_PRESENT	3
+
+/* fault register, 0x44 */
+#define PIJUICE_FAULT_BAT_PROFILE	BIT(5)
+#define PIJUICE_FAULT_CHG_TEMP(f)	(((f) >> 6) & 0x03)
+
+/* charging temperature fault field, same order as batChargingTempEnum in pijuice.py */
+#define PIJUICE_CHG_TEMP_NORMAL		0
+#define PIJUICE_CHG_TEMP_SUSPEND	1
+#define PIJUICE_CHG_TEMP_COOL		2
+#define PIJUICE_CHG_TEMP_WARM		3
+
+/*
+ * charging is suspended both below the cold and above the hot point of the
+ * battery profile, a suspend with battery above this is taken as overheat
+ */
+#define PIJUICE_SUSPEND_HOT_MIN_C	25
+
+#define PIJUICE_RETRIES			3
+
+static unsigned int poll_interval_ms = 2000;
+module_param(poll_interval_ms, uint, 0644);
+MODULE_PARM_DESC(poll_interval_ms,
+	"Polling period when no event interrupt is available, 0 disables (default 2000)");
+
+static unsigned int min_read_interval_ms = 500;
+module_param(min_read_interval_ms, uint, 0644);
+MODULE_PARM_DESC(min_read_interval_ms,
+	"Minimum time between mcu reads, sysfs reads inside it use cached values (default 500)");
+
+struct pijuice_state {
+	u8 status;
+	u8 fault;
+	u8 capacity;
+	s8 temp;
+	u16 voltage;
+	s16 current_ma;
+	u16 io_voltage;
+	s16 io_current_ma;
+};
+
+struct pijuice {
+	struct i2c_client *client;
+	struct power_supply *battery;
+	struct device *hwmon;
+	struct delayed_work work;
+	struct mutex lock; /* protects state and last_update */
+	struct pijuice_state state;
+	unsigned long last_update;
+	bool valid;
+};
+
+static u8 pijuice_fcs(const u8 *data, int len)
+{
+	u8 fcs = 0xFF;
+
+	while (len--)
+		fcs ^= *data++;
+	return fcs;
+}
+
+static int pijuice_read(struct pijuice *pj, u8 cmd, u8 *data, int len)
+{
+	u8 buf[I2C_SMBUS_BLOCK_MAX];
+	int retries = PIJUICE_RETRIES;
+	int ret;
+
+	if (len + 1 > sizeof(buf))
+		return -EINVAL;
+
+	do {
+		ret = i2c_smbus_read_i2c_block_data(pj->client, cmd, len + 1, buf);
+		if (ret == len + 1) {
+			if (pijuice_fcs(buf, len) == buf[len])
+				goto valid;
+			/*
+			 * mcu sometimes clocks out first data byte with msb
+			 * cleared, same workaround as in pijuice.py
+			 */
+			buf[0] |= 0x80;
+			if (pijuice_fcs(buf, len) == buf[len])
+				goto valid;
+			ret = -EBADMSG;
+		} else if (ret >= 0) {
+			ret = -EIO;
+		}
+		usleep_range(1000, 2000);
+	} while (--retries);
+
+	dev_dbg(&pj->client->dev, "read 0x%02x failed: %d\n", cmd, ret);
+	return ret;
+
+valid:
+	memcpy(data, buf, len);
+	return 0;
+}
+
+static int pijuice_update(struct pijuice *pj, bool force)
+{
+	struct pijuice_state st;
+	u8 d[2];
+	int ret;
+
+	lockdep_assert_held(&pj->lock);
+
+	if (!force && pj->valid &&
+	    time_before(jiffies, pj->last_update + msecs_to_jiffies(min_read_interval_ms)))
+		return 0;
+
+	ret = pijuice_read(pj, PIJUICE_STATUS_CMD, &st.status, 1);
+	if (ret)
+		goto err;
+	ret = pijuice_read(pj, PIJUICE_FAULT_EVENT_CMD, &st.fault, 1);
+	if (ret)
+		goto err;
+	ret = pijuice_read(pj, PIJUICE_CHARGE_LEVEL_CMD, &st.capacity, 1);
+	if (ret)
+		goto err;
+	ret = pijuice_read(pj, PIJUICE_BATTERY_TEMP_CMD, d, 2);
+	if (ret)
+		goto err;
+	st.temp = (s8)d[0];
+	ret = pijuice_read(pj, PIJUICE_BATTERY_VOLTAGE_CMD, d, 2);
+	if (ret)
+		goto err;
+	st.voltage = d[0] | (d[1] << 8);
+	ret = pijuice_read(pj, PIJUICE_BATTERY_CURRENT_CMD, d, 2);
+	if (ret)
+		goto err;
+	st.current_ma = (s16)(d[0] | (d[1] << 8));
+	ret = pijuice_read(pj, PIJUICE_IO_VOLTAGE_CMD, d, 2);
+	if (ret)
+		goto err;
+	st.io_voltage = d[0] | (d[1] << 8);
+	ret = pijuice_read(pj, PIJUICE_IO_CURRENT_CMD, d, 2);
+	if (ret)
+		goto err;
+	st.io_current_ma = (s16)(d[0] | (d[1] << 8));
+
+	pj->state = st;
+	pj->last_update = jiffies;
+	pj->valid = true;
+	return 0;
+
+err:
+	pj->valid = false;
+	return ret;
+}
+
+static bool pijuice_changed(const struct pijuice_state *a, const struct pijuice_state *b)
+{
+	return a->status != b->status || a->fault != b->fault ||
+	       a->capacity != b->capacity;
+}
+
+/* re-read mcu state and notify userspace if anything user visible changed */
+static void pijuice_refresh(struct pijuice *pj)
+{
+	struct pijuice_state prev;
+	bool was_valid, changed;
+
+	mutex_lock(&pj->lock);
+	prev = pj->state;
+	was_valid = pj->valid;
+	changed = !pijuice_update(pj, true) &&
+		  (!was_valid || pijuice_changed(&prev, &pj->state));
+	mutex_unlock(&pj->lock);
+
+	if (changed)
+		power_supply_changed(pj->battery);
+}
+
+static void pijuice_work(struct work_struct *work)
+{
+	struct pijuice *pj = container_of(work, struct pijuice, work.work);
+
+	pijuice_refresh(pj);
+
+	if (!pj->client->irq && poll_interval_ms)
+		schedule_delayed_work(&pj->work, msecs_to_jiffies(poll_interval_ms));
+}
+
+static irqreturn_t pijuice_irq(int irq, void *dev_id)
+{
+	struct pijuice *pj = dev_id;
+
+	pijuice_refresh(pj);
+	return IRQ_HANDLED;
+}
+
+static enum power_supply_property pijuice_battery_props[] = {
+	POWER_SUPPLY_PROP_STATUS,
+	POWER_SUPPLY_PROP_CHARGE_TYPE,
+	POWER_SUPPLY_PROP_HEALTH,
+	POWER_SUPPLY_PROP_PRESENT,
+	POWER_SUPPLY_PROP_TECHNOLOGY,
+	POWER_SUPPLY_PROP_CAPACITY,
+	POWER_SUPPLY_PROP_VOLTAGE_NOW,
+	POWER_SUPPLY_PROP_CURRENT_NOW,
+	POWER_SUPPLY_PROP_TEMP,
+	POWER_SUPPLY_PROP_SCOPE,
+};
+
+static int pijuice_health(const struct pijuice_state *st)
+{
+	switch (PIJUICE_FAULT_CHG_TEMP(st->fault)) {
+	case PIJUICE_CHG_TEMP_SUSPEND:
+		return st->temp >= PIJUICE_SUSPEND_HOT_MIN_C ? POWER_SUPPLY_HEALTH_OVERHEAT :
+								POWER_SUPPLY_HEALTH_COLD;
+	case PIJUICE_CHG_TEMP_COOL:
+		return POWER_SUPPLY_HEALTH_COOL;
+	case PIJUICE_CHG_TEMP_WARM:
+		return POWER_SUPPLY_HEALTH_WARM;
+	default:
+		break;
+	}
+
+	if (st->fault & PIJUICE_FAULT_BAT_PROFILE)
+		return POWER_SUPPLY_HEALTH_UNSPEC_FAILURE;
+	return POWER_SUPPLY_HEALTH_GOOD;
+}
+
+static int pijuice_battery_get_property(struct power_supply *psy,
+					enum power_supply_property psp,
+					union power_supply_propval *val)
+{
+	struct pijuice *pj = power_supply_get_drvdata(psy);
+	struct pijuice_state *st = &pj->state;
+	int bat, ret;
+
+	mutex_lock(&pj->lock);
+	ret = pijuice_update(pj, false);
+	if (ret)
+		goto out;
+
+	bat = PIJUICE_STATUS_BAT(st->status);
+
+	switch (psp) {
+	case POWER_SUPPLY_PROP_STATUS:
+		if (bat == PIJUICE_BAT_NOT_PRESENT)
+			val->intval = POWER_SUPPLY_STATUS_UNKNOWN;
+		else if (bat == PIJUICE_BAT_CHARGING_FROM_IN || bat == PIJUICE_BAT_CHARGING_FROM_IO)
+			val->intval = st->capacity >= 100 ? POWER_SUPPLY_STATUS_FULL :
+							    POWER_SUPPLY_STATUS_CHARGING;
+		else if (PIJUICE_STATUS_IN(st->status) == PIJUICE_POWER_IN_PRESENT ||
+			 PIJUICE_STATUS_IO(st->status) == PIJUICE_POWER_IN_PRESENT)
+			val->intval = st->capacity >= 100 ? POWER_SUPPLY_STATUS_FULL :
+							    POWER_SUPPLY_STATUS_NOT_CHARGING;
+		else
+			val->intval = POWER_SUPPLY_STATUS_DISCHARGING;
+		break;
+	case POWER_SUPPLY_PROP_CHARGE_TYPE:
+		if (bat == PIJUICE_BAT_NOT_PRESENT)
+			val->intval = POWER_SUPPLY_CHARGE_TYPE_UNKNOWN;
+		else if (bat == PIJUICE_BAT_CHARGING_FROM_IN || bat == PIJUICE_BAT_CHARGING_FROM_IO)
+			val->intval = POWER_SUPPLY_CHARGE_TYPE_STANDARD;
+		else
+			val->intval = POWER_SUPPLY_CHARGE_TYPE_NONE;
+		break;
+	case POWER_SUPPLY_PROP_HEALTH:
+		val->intval = pijuice_health(st);
+		break;
+	case POWER_SUPPLY_PROP_PRESENT:
+		val->intval = bat != PIJUICE_BAT_NOT_PRESENT;
+		break;
+	case POWER_SUPPLY_PROP_TECHNOLOGY:
+		val->intval = POWER_SUPPLY_TECHNOLOGY_LIPO;
+		break;
+	case POWER_SUPPLY_PROP_CAPACITY:
+		val->intval = min_t(int, st->capacity, 100);
+		break;
+	case POWER_SUPPLY_PROP_VOLTAGE_NOW:
+		val->intval = st->voltage * 1000;
+		break;
+	case POWER_SUPPLY_PROP_CURRENT_NOW:
+		/* mcu reports discharge current as positive */
+		val->intval = -st->current_ma * 1000;
+		break;
+	case POWER_SUPPLY_PROP_TEMP:
+		val->intval = st->temp * 10;
+		break;
+	case POWER_SUPPLY_PROP_SCOPE:
+		val->intval = POWER_SUPPLY_SCOPE_SYSTEM;
+		break;
+	default:
+		ret = -EINVAL;
+	}
+out:
+	mutex_unlock(&pj->lock);
+	return ret;
+}
+
+static const struct power_supply_desc pijuice_battery_desc = {
+	.name		= "pijuice-battery",
+	.type		= POWER_SUPPLY_TYPE_BATTERY,
+	.properties	= pijuice_battery_props,
+	.num_properties	= ARRAY_SIZE(pijuice_battery_props),
+	.get_property	= pijuice_battery_get_property,
+};
+
+/*
+ * hwmon: in0/curr1 battery, in1/curr2 GPIO 5V rail supplied to or drawn
+ * from host, temp1 battery
+ */
+static int pijuice_hwmon_read(struct device *dev, enum hwmon_sensor_types type,
+			      u32 attr, int channel, long *val)
+{
+	struct pijuice *pj = dev_get_drvdata(dev);
+	struct pijuice_state *st = &pj->state;
+	int ret;
+
+	mutex_lock(&pj->lock);
+	ret = pijuice_update(pj, false);
+	if (ret)
+		goto out;
+
+	switch (type) {
+	case hwmon_in:
+		*val = channel ? st->io_voltage : st->voltage;
+		break;
+	case hwmon_curr:
+		*val = channel ? st->io_current_ma : st->current_ma;
+		break;
+	case hwmon_temp:
+		*val = st->temp * 1000;
+		break;
+	default:
+		ret = -EOPNOTSUPP;
+	}
+out:
+	mutex_unlock(&pj->lock);
+	return ret;
+}
+
+static int pijuice_hwmon_read_string(struct device *dev, enum hwmon_sensor_types type,
+				     u32 attr, int channel, const char **str)
+{
+	static const char * const in_labels[] = { "vbat", "v5v_gpio" };
+	static const char * const curr_labels[] = { "ibat", "i5v_gpio" };
+
+	switch (type) {
+	case hwmon_in:
+		*str = in_labels[channel];
+		return 0;
+	case hwmon_curr:
+		*str = curr_labels[channel];
+		return 0;
+	case hwmon_temp:
+		*str = "battery";
+		return 0;
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+static umode_t pijuice_hwmon_is_visible(const void *data, enum hwmon_sensor_types type,
+					u32 attr, int channel)
+{
+	return 0444;
+}
+
+static const struct hwmon_channel_info *pijuice_hwmon_info[] = {
+	HWMON_CHANNEL_INFO(in, HWMON_I_INPUT | HWMON_I_LABEL, HWMON_I_INPUT | HWMON_I_LABEL),
+	HWMON_CHANNEL_INFO(curr, HWMON_C_INPUT | HWMON_C_LABEL, HWMON_C_INPUT | HWMON_C_LABEL),
+	HWMON_CHANNEL_INFO(temp, HWMON_T_INPUT | HWMON_T_LABEL),
+	NULL
+};
+
+static const struct hwmon_ops pijuice_hwmon_ops = {
+	.is_visible	= pijuice_hwmon_is_visible,
+	.read		= pijuice_hwmon_read,
+	.read_string	= pijuice_hwmon_read_string,
+};
+
+static const struct hwmon_chip_info pijuice_hwmon_chip_info = {
+	.ops	= &pijuice_hwmon_ops,
+	.info	= pijuice_hwmon_info,
+};
+
+static void pijuice_cancel_work(void *data)
+{
+	struct pijuice *pj = data;
+
+	cancel_delayed_work_sync(&pj->work);
+}
+
+static int pijuice_probe(struct i2c_client *client)
+{
+	struct device *dev = &client->dev;
+	struct power_supply_config psy_cfg = {};
+	struct pijuice *pj;
+	u8 status;
+	int ret;
+
+	if (!i2c_check_functionality(client->adapter, I2C_FUNC_SMBUS_READ_I2C_BLOCK))
+		return -ENODEV;
+
+	pj = devm_kzalloc(dev, sizeof(*pj), GFP_KERNEL);
+	if (!pj)
+		return -ENOMEM;
+
+	pj->client = client;
+	mutex_init(&pj->lock);
+	INIT_DELAYED_WORK(&pj->work, pijuice_work);
+	i2c_set_clientdata(client, pj);
+
+	/* check there is command server answering with valid fcs */
+	ret = pijuice_read(pj, PIJUICE_STATUS_CMD, &status, 1);
+	if (ret)
+		return dev_err_probe(dev, ret, "no PiJuice at 0x%02x\n", client->addr);
+
+	psy_cfg.drv_data = pj;
+	pj->battery = devm_power_supply_register(dev, &pijuice_battery_desc, &psy_cfg);
+	if (IS_ERR(pj->battery))
+		return dev_err_probe(dev, PTR_ERR(pj->battery), "failed to register battery\n");
+
+	pj->hwmon = devm_hwmon_device_register_with_info(dev, "pijuice", pj,
+							 &pijuice_hwmon_chip_info, NULL);
+	if (IS_ERR(pj->hwmon))
+		return dev_err_probe(dev, PTR_ERR(pj->hwmon), "failed to register hwmon\n");
+
+	ret = devm_add_action_or_reset(dev, pijuice_cancel_work, pj);
+	if (ret)
+		return ret;
+
+	if (client->irq) {
+		ret = devm_request_threaded_irq(dev, client->irq, NULL, pijuice_irq,
+						IRQF_ONESHOT, dev_name(dev), pj);
+		if (ret) {
+			dev_warn(dev, "irq %d unavailable (%d), polling\n", client->irq, ret);
+			client->irq = 0;
+		}
+	}
+
+	schedule_delayed_work(&pj->work, 0);
+	return 0;
+}
+
+static const struct i2c_device_id pijuice_id[] = {
+	{ "pijuice", 0 },
+	{ }
+};
+MODULE_DEVICE_TABLE(i2c, pijuice_id);
+
+static const struct of_device_id pijuice_of_match[] = {
+	{ .compatible = "pisupply,pijuice" },
+	{ }
+};
+MODULE_DEVICE_TABLE(of, pijuice_of_match);
+
+static struct i2c_driver pijuice_driver = {
+	.driver = {
+		.name		= "pijuice",
+		.of_match_table	= pijuice_of_match,
+	},
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+	.probe		= pijuice_probe,
+#else
+	.probe_new	= pijuice_probe,
+#endif
+	.id_table	= pijuice_id,
+};
+module_i2c_driver(pijuice_driver);
+
+MODULE_DESCRIPTION("PiJuice HAT battery power supply driver");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,145 @@
+#!/bin/bash
+# Checks pijuice_power.ko against an emulated PiJuice on i2c-stub, no hardware needed.
+# Needs root, i2c-tools and the module built in this directory (make).
+#	sudo ./test-i2c-stub.sh
+#
+# i2c-stub serves i2c block reads from consecutive byte registers, so the fcs of each
+# PiJuice register is the first byte of the next one. The values are chosen so every
+# read the driver makes has a valid fcs, see README.md.
+
+MODULE=$(dirname "$0")/pijuice_power.ko
+ADDR=0x14
+PSY=/sys/class/power_supply/pijuice-battery
+FAILS=0
+CHECKS=0
+
+if [ "$(id -u)" -ne 0 ]; then
+	echo "Run as root"
+	exit 2
+fi
+
+if ! [ -e "$MODULE" ]; then
+	echo "$MODULE not found, run make first"
+	exit 2
+fi
+
+check() {
+	local name=$1 expected=$2 actual=$3
+	CHECKS=$((CHECKS + 1))
+	if [ "$actual" != "$expected" ]; then
+		echo "FAIL $name: expected '$expected', got '$actual'"
+		FAILS=$((FAILS + 1))
+	fi
+}
+
+set_reg() {
+	i2cset -y "$BUS" $ADDR "$1" "$2"
+}
+
+# fault register 0x44, its fcs is 0x45
+set_fault() {
+	set_reg 0x44 "$1"
+	set_reg 0x45 $((0xFF ^ $1))
+}
+
+# battery temperature 0x47, the driver ignores the second byte 0x48 so it is set to
+# keep the fcs at 0x49, which is also the low byte of the battery voltage
+set_temp() {
+	local t=$(($1 & 0xFF))
+	set_reg 0x47 $t
+	set_reg 0x48 $((0xFF ^ t ^ 0x3C))
+}
+
+psy() {
+	cat "$PSY/$1" 2>/dev/null
+}
+
+hwmon() {
+	cat "$HWMON/$1" 2>/dev/null
+}
+
+cleanup() {
+	[ -n "$BUS" ] && [ -e "/sys/bus/i2c/devices/i2c-$BUS/delete_device" ] && \
+		echo $ADDR > "/sys/bus/i2c/devices/i2c-$BUS/delete_device" 2>/dev/null
+	rmmod pijuice_power 2>/dev/null
+	rmmod i2c-stub 2>/dev/null
+}
+trap cleanup EXIT
+
+modprobe i2c-dev || exit 2
+modprobe i2c-stub chip_addr=$ADDR || exit 2
+BUS=$(i2cdetect -l | grep "SMBus stub" | cut -f1 | cut -d- -f2)
+if [ -z "$BUS" ]; then
+	echo "i2c-stub bus not found"
+	exit 2
+fi
+
+for rv in 40:B0 41:4F 42:B0 44:00 45:FF 47:19 48:DA 49:3C 4A:0F 4B:CC 4C:00 4D:33 4E:14 4F:D8 50:01 51:26; do
+	set_reg 0x${rv%:*} 0x${rv#*:}
+done
+
+# Every sysfs read goes to the bus, so register changes show at once
+insmod "$MODULE" min_read_interval_ms=0 poll_interval_ms=0 || exit 2
+echo pijuice $ADDR > "/sys/bus/i2c/devices/i2c-$BUS/new_device"
+
+for i in 1 2 3 4 5 6 7 8 9 10; do
+	[ -e "$PSY" ] && break
+	sleep 0.2
+done
+HWMON=$(grep -l "^pijuice$" /sys/class/hwmon/hwmon*/name 2>/dev/null | head -1 | xargs -r dirname)
+
+check "power_supply registered" "yes" "$([ -e "$PSY" ] && echo yes)"
+check "hwmon registered" "yes" "$([ -n "$HWMON" ] && echo yes)"
+
+# Values from the table in README.md
+check status "Not charging" "$(psy status)"
+check charge_type "N/A" "$(psy charge_type)"
+check present 1 "$(psy present)"
+check capacity 79 "$(psy capacity)"
+check voltage_now 3900000 "$(psy voltage_now)"
+check current_now -204000 "$(psy current_now)"
+check temp 250 "$(psy temp)"
+check health "Good" "$(psy health)"
+
+check in0_input 3900 "$(hwmon in0_input)"
+check in1_input 5171 "$(hwmon in1_input)"
+check curr1_input 204 "$(hwmon curr1_input)"
+check curr2_input 472 "$(hwmon curr2_input)"
+check temp1_input 25000 "$(hwmon temp1_input)"
+check in0_label vbat "$(hwmon in0_label)"
+check in1_label v5v_gpio "$(hwmon in1_label)"
+check temp1_label battery "$(hwmon temp1_label)"
+
+# Charging temperature field, bits 6 and 7 of the fault register
+set_temp 50
+set_fault 0x40
+check "health suspend at 50C" "Overheat" "$(psy health)"
+check "temp at 50C" 500 "$(psy temp)"
+set_temp -5
+check "health suspend at -5C" "Cold" "$(psy health)"
+check "temp at -5C" -50 "$(psy temp)"
+set_temp 5
+set_fault 0x80
+check "health cool" "Cool" "$(psy health)"
+set_temp 42
+set_fault 0xC0
+check "health warm" "Warm" "$(psy health)"
+set_temp 25
+set_fault 0x20
+check "health profile fault" "Unspecified failure" "$(psy health)"
+set_fault 0x00
+check "health normal" "Good" "$(psy health)"
+
+# Charging, status 0xB4 with charge level 0x4B and its fcs 0xB4
+set_reg 0x40 0xB4
+set_reg 0x41 0x4B
+set_reg 0x42 0xB4
+check "status charging" "Charging" "$(psy status)"
+check "capacity charging" 75 "$(psy capacity)"
+
+# Broken fcs fails the read
+set_reg 0x42 0x00
+check "bad fcs" "" "$(psy capacity)"
+
+echo "test-i2c-stub: $([ $FAILS -eq 0 ] && echo PASS || echo FAIL), $CHECKS checks, $FAILS failed"
+[ $FAILS -eq 0 ]
@@ -14,6 +14,9 @@ pijuice_user_functions = ['USER_EVENT'] + ['USER_FUNC' + str(i+1) for i in range
 
 
 class PiJuiceInterface(object):
+    # Time for the firmware to act on a write before it is read back for verification
+    VERIFY_DELAY = 0.05
+
     def __init__(self, bus=1, address=0x14):
         """Create a new PiJuice instance.  Bus is an optional parameter that
         specifies the I2C bus number to use, for example 1 would use device
@@ -25,6 +28,11 @@ class PiJuiceInterface(object):
         self.t = None
         self.comError = False
         self.errTime = 0
+        self.transactionDepth = 0
+        self.cache = {}
+        self.written = {}
+        self.original = {}
+        self.verifyDelay = 0
 
     def __del__(self):
         """Clean up any resources used by the PiJuice instance."""
@@ -67,32 +75,33 @@ class PiJuiceInterface(object):
             self.comError = True
             self.errTime = time.time()
 
-    def _DoTransfer(self, oper):
+    def _ReadRegisters(self):
+        # Reads the whole register list in one worker thread, stops at the first failure
+        self.block = {}
+        for cmd, length in self.regs:
+            try:
+                self.block[cmd] = self.i2cbus.read_i2c_block_data(self.addr, cmd, length + 1)
+            except:  # IOError:
+                self.comError = True
+                self.errTime = time.time()
+                return
+        self.comError = False
+
+    def _DoTransfer(self, oper, timeout=0.1):
         if (self.t != None and self.t.is_alive()) or (self.comError and (time.time()-self.errTime) < 4):
             return False
 
         self.t = threading.Thread(target=oper, args=())
         self.t.start()
 
-        # wait for transfer to finish or timeout
-        n = 0
-        while self.t.is_alive() and n < 2:
-            time.sleep(0.05)
-            n = n + 1
+        # wait for transfer to finish or timeout, returns as soon as the transfer is done
+        self.t.join(timeout)
         if self.comError or self.t.is_alive():
             return False
 
         return True
 
-    def ReadData(self, cmd, length):
-        d = []
-
-        self.cmd = cmd
-        self.length = length + 1
-        if not self._DoTransfer(self._Read):
-            return {'error': 'COMMUNICATION_ERROR'}
-
-        d = self.d
+    def _CheckData(self, d):
         if self._GetChecksum(d[0:-1]) != d[-1]:
             # With n+1 byte data (n data bytes and 1 checksum byte) sometimes the
             # MSbit of the first received data byte is 0 while it should be 1. So we
@@ -105,11 +114,96 @@ class PiJuiceInterface(object):
         del d[-1]
         return {'data': d, 'error': 'NO_ERROR'}
 
+    def _Prefetch(self, registers):
+        self.regs = [r for r in registers if r[0] not in self.cache]
+        if len(self.regs) == 0:
+            return
+        # Partial results are still cached, missing registers fall back to ReadData
+        self.block = {}
+        self._DoTransfer(self._ReadRegisters, 0.1 + 0.02 * len(self.regs))
+        if self.t != None and self.t.is_alive():
+            return
+        for cmd, length in self.regs:
+            if cmd in self.block:
+                result = self._CheckData(self.block[cmd])
+                if result['error'] == 'NO_ERROR':
+                    self.cache[cmd] = (length, result['data'])
+
+    def BeginTransaction(self, registers=[]):
+        """Start a batched config transaction. registers is a list of (cmd, length)
+        pairs that are read from the device in one pass, later reads of them are
+        served from the cache. Inside a transaction writes of data equal to the
+        cached value are skipped and WriteDataVerify defers its read back to
+        EndTransaction. Transactions nest, only the outermost one verifies.
+        """
+        self.transactionDepth = self.transactionDepth + 1
+        self._Prefetch(registers)
+
+    def EndTransaction(self):
+        """End a batched config transaction. Registers written during the
+        transaction are read back in one pass after the longest requested delay.
+        If any differ the transaction is rolled back, every written register whose
+        value before the transaction is known is written back to it and read back
+        once more. Returns WRITE_FAILED with the failed commands in data and the
+        commands back at their old value in restored.
+        """
+        if self.transactionDepth == 0:
+            return {'error': 'NO_ERROR'}
+        self.transactionDepth = self.transactionDepth - 1
+        if self.transactionDepth > 0:
+            return {'error': 'NO_ERROR'}
+
+        written = self.written
+        original = self.original
+        delay = self.verifyDelay
+        self.written = {}
+        self.original = {}
+        self.verifyDelay = 0
+        self.cache = {}
+        if len(written) == 0:
+            return {'error': 'NO_ERROR'}
+
+        time.sleep(delay)
+        self._Prefetch([(cmd, len(data)) for cmd, data in written.items()])
+        failed = [cmd for cmd, data in written.items() if self.cache.get(cmd, (0, None))[1] != data]
+        if len(failed) == 0:
+            self.cache = {}
+            return {'error': 'NO_ERROR'}
+
+        # Undo in reverse order, registers already at their old value are not rewritten
+        restore = [(cmd, original[cmd]) for cmd in reversed(list(written)) if original.get(cmd) != None]
+        rewritten = [cmd for cmd, data in restore if self.cache.get(cmd, (0, None))[1] != data
+                     and self.WriteData(cmd, data)['error'] == 'NO_ERROR']
+        self.cache = {}
+        if len(rewritten) > 0:
+            time.sleep(delay)
+        self._Prefetch([(cmd, len(data)) for cmd, data in restore])
+        restored = [cmd for cmd, data in restore if self.cache.get(cmd, (0, None))[1] == data]
+        self.cache = {}
+        return {'data': failed, 'restored': restored, 'error': 'WRITE_FAILED'}
+
+    def ReadData(self, cmd, length):
+        if self.transactionDepth > 0 and cmd in self.cache and self.cache[cmd][0] == length:
+            return {'data': self.cache[cmd][1][:], 'error': 'NO_ERROR'}
+
+        self.cmd = cmd
+        self.length = length + 1
+        if not self._DoTransfer(self._Read):
+            return {'error': 'COMMUNICATION_ERROR'}
+
+        result = self._CheckData(self.d)
+        if self.transactionDepth > 0 and result['error'] == 'NO_ERROR':
+            self.cache[cmd] = (length, result['data'][:])
+        return result
+
     def WriteData(self, cmd, data):
         fcs = self._GetChecksum(data)
         d = data[:]
         d.append(fcs)
 
+        # Whatever was cached is stale once written
+        self.cache.pop(cmd, None)
+
         self.cmd = cmd
         self.d = d
         if not self._DoTransfer(self._Write):
@@ -118,15 +212,27 @@ class PiJuiceInterface(object):
         return {'error': 'NO_ERROR'}
 
     def WriteDataVerify(self, cmd, data, delay=None):
+        if self.transactionDepth > 0:
+            cached = self.cache.get(cmd)
+            if cached != None and cached[1] == data and cmd not in self.written:
+                return {'error': 'NO_ERROR'}
+            if cmd not in self.written:
+                # Kept for the rollback, unknown unless prefetched or read in the transaction
+                self.original[cmd] = None if cached == None else cached[1][:]
+            # A failed write may still have landed, it is verified like the others
+            wresult = self.WriteData(cmd, data)
+            self.written[cmd] = data[:]
+            self.verifyDelay = max(self.verifyDelay, self.VERIFY_DELAY if delay == None else delay)
+            return wresult
+
         wresult = self.WriteData(cmd, data)
         if wresult['error'] != 'NO_ERROR':
             return wresult
         else:
-            if delay != None:
-                try:
-                    time.sleep(delay*1)
-                except:
-                    time.sleep(0.1)
+            try:
+                time.sleep(self.VERIFY_DELAY if delay == None else delay*1)
+            except:
+                time.sleep(0.1)
             result = self.ReadData(cmd, len(data))
             if result['error'] != 'NO_ERROR':
                 return result
@@ -914,6 +1020,8 @@ class PiJuicePower(object):
     POWER_OFF_CMD = 0x62
     WAKEUP_ON_CHARGE_CMD = 0x63
     SYSTEM_POWER_SWITCH_CTRL_CMD = 0x64
+    IDLE_POWER_OFF_CMD = 0x65
+    HOST_ACTIVITY_CMD = 0xF4
 
     def __init__(self, interface):
         self.interface = interface
@@ -931,6 +1039,28 @@ class PiJuicePower(object):
     def GetPowerOff(self):
         return self.interface.ReadData(self.POWER_OFF_CMD, 1)
 
+    # threshold 10 - 1270 mA of load current below which host is considered halted, 0 disables,
+    # dwell 0.1 - 25.5 seconds current has to stay below threshold before power is cut
+    def SetIdlePowerOff(self, threshold, dwell = 2, non_volatile = False):
+        try:
+            nv = 0x80 if non_volatile == True else 0x00
+            t = int(threshold) // 10
+            d = int(float(dwell) * 10)
+            if t < 0 or t > 127 or d < 1 or d > 255:
+                return {'error': 'BAD_ARGUMENT'}
+        except:
+            return {'error': 'BAD_ARGUMENT'}
+        return self.interface.WriteData(self.IDLE_POWER_OFF_CMD, [nv | t, d])
+
+    def GetIdlePowerOff(self):
+        ret = self.interface.ReadData(self.IDLE_POWER_OFF_CMD, 2)
+        if ret['error'] != 'NO_ERROR':
+            return ret
+        else:
+            d = ret['data']
+            return {'data': {'threshold': (d[0]&0x7F) * 10, 'dwell': d[1] / 10},
+                    'non_volatile': bool(d[0] & 0x80), 'error': 'NO_ERROR'}
+
     def SetWakeUpOnCharge(self, arg, non_volatile = False):
         try:
             nv = 0x80 if non_volatile == True else 0x00
@@ -975,6 +1105,31 @@ class PiJuicePower(object):
         minutes = minutes << ((cfg&0x4000) >> 13) #correct resolution for range 16384-65536
         return {'data': minutes, 'non_volatile': bool(cfg & 0x8000), 'error': 'NO_ERROR'}
 
+    # Host promises not to poll for seconds (0 until resumed), PiJuice stops in low power mode between
+    # any transfers it still makes rather than waiting 5 seconds after each one. Firmware 1.5 and later.
+    def SetHostQuiesce(self, seconds = 0):
+        try:
+            d = int(seconds)
+            if d < 0 or d > 0xFFFF:
+                return {'error': 'BAD_ARGUMENT'}
+        except:
+            return {'error': 'BAD_ARGUMENT'}
+        return self.interface.WriteData(self.HOST_ACTIVITY_CMD, [0x01, d & 0xFF, (d >> 8) & 0xFF])
+
+    def SetHostResume(self):
+        return self.interface.WriteData(self.HOST_ACTIVITY_CMD, [0x00])
+
+    # Quiesce state, the host poll period PiJuice has learnt to stop between and
+    # whether a write was dropped with its receive ring full since the last call
+    def GetHostActivity(self):
+        ret = self.interface.ReadData(self.HOST_ACTIVITY_CMD, 6)
+        if ret['error'] != 'NO_ERROR':
+            return ret
+        else:
+            d = ret['data']
+            return {'data': {'quiesced': bool(d[0] & 0x01), 'predicting': bool(d[0] & 0x02), 'write_overflow': bool(d[0] & 0x04),
+                    'confidence': d[1], 'poll_period': d[2] | (d[3] << 8), 'poll_jitter': d[4] | (d[5] << 8)}, 'error': 'NO_ERROR'}
+
     def SetSystemPowerSwitch(self, state):
         try:
             d = int(state) // 100
@@ -1009,6 +1164,14 @@ class PiJuiceConfig(object):
     RESET_TO_DEFAULT_CMD = 0xF0
     FIRMWARE_VERSION_CMD = 0xFD
 
+    # (cmd, length) register groups read by the settings screens, for BeginTransaction
+    GENERAL_CONFIG_REGS = [(RUN_PIN_CONFIG_CMD, 1), (I2C_ADDRESS_CMD, 1), (I2C_ADDRESS_CMD + 1, 1),
+        (ID_EEPROM_ADDRESS_CMD, 1), (ID_EEPROM_WRITE_PROTECT_CTRL_CMD, 1), (POWER_INPUTS_CONFIG_CMD, 1),
+        (POWER_REGULATOR_CONFIG_CMD, 1), (CHARGING_CONFIG_CMD, 1)]
+    BUTTON_CONFIG_REGS = [(BUTTON_CONFIGURATION_CMD, 12), (BUTTON_CONFIGURATION_CMD + 1, 12), (BUTTON_CONFIGURATION_CMD + 2, 12)]
+    LED_CONFIG_REGS = [(LED_CONFIGURATION_CMD, 4), (LED_CONFIGURATION_CMD + 1, 4)]
+    IO_CONFIG_REGS = [(IO_CONFIGURATION_CMD, 5), (IO_CONFIGURATION_CMD + 5, 5)]
+
     def __init__(self, interface):
         self.interface = interface
 
@@ -1562,6 +1725,27 @@ class PiJuiceConfig(object):
     def RunTestCalibration(self):
         self.interface.WriteData(248, [0x55, 0x26, 0xa0, 0x2b])
 
+    calibrationStatus = ['IDLE', 'BUSY', 'PASS', 'FAIL']
+
+    def GetTestCalibrationStatus(self):
+        # Firmware 1.5 and later, calibration runs in the background, poll until status is not BUSY
+        ret = self.interface.ReadData(248, 18)
+        if ret['error'] != 'NO_ERROR':
+            return ret
+        d = ret['data']
+        return {'data': {
+            'status': self.calibrationStatus[d[0]] if d[0] < len(self.calibrationStatus) else 'UNKNOWN',
+            'phase': d[2],
+            'fault': d[3],
+            'kta': d[4],
+            'ktb': d[5],
+            'offset': ctypes.c_int16(d[6] | (d[7] << 8)).value,
+            'scale': d[8] | (d[9] << 8) | (d[10] << 16) | (d[11] << 24),
+            'current': ctypes.c_int16(d[12] | (d[13] << 8)).value,
+            'elapsed': d[14] | (d[15] << 8),
+            'remaining': d[16] | (d[17] << 8)},
+            'error': 'NO_ERROR'}
+
 
 # Create an interface object for accessing PiJuice features via I2C bus.
 class PiJuice(object):
@@ -3,6 +3,7 @@
 #
 # -*- coding: utf-8 -*-
 # pylint: disable=import-error
+import copy
 import datetime
 import os
 import re
@@ -460,6 +461,7 @@ class GeneralTab(object):
 
     def _get_device_config(self):
         config = {}
+        pijuice.interface.BeginTransaction(pijuice.config.GENERAL_CONFIG_REGS)
         config['run_pin'] = self.RUN_PIN_VALUES.index(pijuice.config.GetRunPinConfig().get('data'))
         config['i2c_addr'] = pijuice.config.GetAddress(1).get('data')
         config['i2c_addr_rtc'] = pijuice.config.GetAddress(2).get('data')
@@ -476,6 +478,7 @@ class GeneralTab(object):
 
         config['power_reg_mode'] = self.POWER_REGULATOR_MODES.index(pijuice.config.GetPowerRegulatorMode().get('data'))
         config['charging_enabled'] = pijuice.config.GetChargingConfig().get('data', {}).get('charging_enabled')
+        pijuice.interface.EndTransaction()
         return config
 
     def main(self, *args):
@@ -545,27 +548,11 @@ class GeneralTab(object):
         self.main()
 
     def _apply_settings(self, *args):
+        # Device config is read in one pass and the writes are verified together at the end
+        pijuice.interface.BeginTransaction(pijuice.config.GENERAL_CONFIG_REGS)
         device_config = self._get_device_config()
         changed = [key for key in self.current_config.keys() if self.current_config[key] != device_config[key]]
 
-        for i, addr in enumerate(['i2c_addr', 'i2c_addr_rtc']):
-            if addr in changed:
-                value = device_config[addr]
-                try:
-                    new_value = int(str(self.current_config[addr]), 16)
-                    if new_value >= 8 and new_value <= 0x77:
-                        value = self.current_config[addr]
-                    else:
-                        self.current_config[addr] = value
-                        return confirmation_dialog("I2C address has to be between 0x08 and 0x77", next=self.main)
-                except:
-                    pass
-                pijuice.config.SetAddress(i + 1, value)
-                global pijuiceConfigData
-                pijuiceConfigData.setdefault('board', {}).setdefault('general', {})['i2c_addr'+['','_rtc'][i]] = value
-                savePiJuiceConfig()
-                _InitPiJuiceInterface()
-
         if 'run_pin' in changed:
             pijuice.config.SetRunPinConfig(self.RUN_PIN_VALUES[self.current_config['run_pin']])
 
@@ -588,11 +575,33 @@ class GeneralTab(object):
             pijuice.config.SetPowerRegulatorMode(self.POWER_REGULATOR_MODES[self.current_config['power_reg_mode']])
         if 'charging_enabled' in changed:
             pijuice.config.SetChargingConfig({'charging_enabled': self.current_config['charging_enabled']}, True)
-        
-        # Give PiJuice MCU sufficient time to change the settings before reading them back
-        time.sleep(0.2)
+
+        result = pijuice.interface.EndTransaction()
+
+        # Address changes go last, the interface is reopened at the new address
+        for i, addr in enumerate(['i2c_addr', 'i2c_addr_rtc']):
+            if addr in changed:
+                value = device_config[addr]
+                try:
+                    new_value = int(str(self.current_config[addr]), 16)
+                    if new_value >= 8 and new_value <= 0x77:
+                        value = self.current_config[addr]
+                    else:
+                        self.current_config[addr] = value
+                        return confirmation_dialog("I2C address has to be between 0x08 and 0x77", next=self.main)
+                except:
+                    pass
+                pijuice.config.SetAddress(i + 1, value)
+                global pijuiceConfigData
+                pijuiceConfigData.setdefault('board', {}).setdefault('general', {})['i2c_addr'+['','_rtc'][i]] = value
+                savePiJuiceConfig()
+                _InitPiJuiceInterface()
+
         self.current_config = self._get_device_config()
-        confirmation_dialog("Settings successfully updated", single_option=True, next=self.main)
+        if result['error'] != 'NO_ERROR':
+            confirmation_dialog("Failed to apply some settings: " + result['error'], single_option=True, next=self.main)
+        else:
+            confirmation_dialog("Settings successfully updated", single_option=True, next=self.main)
 
     def _reset_settings(self, button, is_confirmed):
         if is_confirmed:
@@ -643,6 +652,7 @@ class LEDTab(object):
     
     def _get_led_config(self):
         config = []
+        pijuice.interface.BeginTransaction(pijuice.config.LED_CONFIG_REGS)
         for i in range(len(self.LED_NAMES)):
             result = pijuice.config.GetLedConfiguration(self.LED_NAMES[i])
             led_config = {}
@@ -652,13 +662,15 @@ class LEDTab(object):
                 led_config['function'] = self.LED_FUNCTIONS_OPTIONS[0]
             led_config['color'] = [result['data']['parameter']['r'], result['data']['parameter']['g'], result['data']['parameter']['b']]
             config.append(led_config)
+        pijuice.interface.EndTransaction()
         return config
     
     def _refresh_settings(self, *args):
         self.current_config = self._get_led_config()
     
     def _apply_settings(self, *args):
-        device_config = self._get_led_config()
+        # Unchanged LEDs are not rewritten, both are verified after one delay
+        pijuice.interface.BeginTransaction(pijuice.config.LED_CONFIG_REGS)
         for i in range(len(self.LED_NAMES)):
             config = {
                 "function": self.current_config[i]['function'],
@@ -669,9 +681,13 @@ class LEDTab(object):
                 }
             }
             pijuice.config.SetLedConfiguration(self.LED_NAMES[i], config)
-        
+        result = pijuice.interface.EndTransaction()
+
         self.current_config = self._get_led_config()
-        confirmation_dialog("Settings successfully updated", single_option=True, next=self.main)
+        if result['error'] != 'NO_ERROR':
+            confirmation_dialog("Failed to apply settings: " + result['error'], single_option=True, next=self.main)
+        else:
+            confirmation_dialog("Settings successfully updated", single_option=True, next=self.main)
     
     def _list_functions(self, button, led_index):
         body = [urwid.Text("Choose function for " + self.LED_NAMES[led_index]), urwid.Divider()]
@@ -711,7 +727,7 @@ class ButtonsTab(object):
 
     def __init__(self):
         self.device_config = self._get_device_config()
-        self.current_config = self._get_device_config()
+        self.current_config = copy.deepcopy(self.device_config)
         self.main()
 
     def main(self, *args):
@@ -794,6 +810,7 @@ class ButtonsTab(object):
     def _get_device_config(self):
         config = {}
         got_error = False
+        pijuice.interface.BeginTransaction(pijuice.config.BUTTON_CONFIG_REGS)
         for button in self.BUTTONS:
             button_config = pijuice.config.GetButtonConfiguration(button)
             if button_config.get('error', 'NO_ERROR'):
@@ -801,6 +818,7 @@ class ButtonsTab(object):
             else:
                 config[button] = {}
                 got_error = True
+        pijuice.interface.EndTransaction()
 
         if got_error:
             confirmation_dialog("Failed to connect to PiJuice", next=main_menu, single_option=True)
@@ -810,13 +828,19 @@ class ButtonsTab(object):
     def _apply_settings(self, *args):
         got_error = False
         errors = []
+        # Unchanged buttons are not rewritten, the rest are verified after one delay
+        pijuice.interface.BeginTransaction(pijuice.config.BUTTON_CONFIG_REGS)
         for button in self.BUTTONS:
             error_msg = pijuice.config.SetButtonConfiguration(button, self.current_config[button]).get('error', 'NO_ERROR')
             errors.append(error_msg)
             got_error |= error_msg != "NO_ERROR"
+        error_msg = pijuice.interface.EndTransaction().get('error', 'NO_ERROR')
+        if error_msg != "NO_ERROR":
+            errors.append(error_msg)
+            got_error = True
 
         self.device_config = self._get_device_config()
-        self.current_config = self._get_device_config()
+        self.current_config = copy.deepcopy(self.device_config)
         if got_error:
             confirmation_dialog("Failed to apply settings: " + str(errors), next=self.main, single_option=True)
         else:
@@ -985,22 +1009,28 @@ class IOTab(object):
 
     def _get_device_config(self, *args):
         config = []
+        pijuice.interface.BeginTransaction(pijuice.config.IO_CONFIG_REGS)
         for i in range(self.IO_PINS_COUNT):
             result = pijuice.config.GetIoConfiguration(i + 1)
             if result['error'] != 'NO_ERROR':
                 confirmation_dialog("Unable to connect to device: {}".format(result['error']), next=main_menu, single_option=True)
             else:
                 config.append(result['data'])
+        pijuice.interface.EndTransaction()
         return config
     
     def _apply_settings(self, button, pin_id):
         if pin_id >= self.IO_PINS_COUNT:
-            # Apply for all pins
+            # Apply for all pins, verified together after one delay
             errors = []
+            pijuice.interface.BeginTransaction(pijuice.config.IO_CONFIG_REGS)
             for i in range(self.IO_PINS_COUNT):
                 error_msg = self._apply_for_pin(i)
                 if error_msg != 'NO_ERROR':
                     errors.append(error_msg)
+            error_msg = pijuice.interface.EndTransaction().get('error', 'NO_ERROR')
+            if error_msg != 'NO_ERROR':
+                errors.append(error_msg)
             if errors:
                 confirmation_dialog("Failed to apply some settings. Error: {}".format(errors), next=self.main, single_option=True)
             else:
@@ -328,6 +328,8 @@ class PiJuiceHATConfig(object):
         self.frame.columnconfigure(3, weight=5, uniform=1)
         self.frame.rowconfigure(14, weight=1)
 
+        pijuice.interface.BeginTransaction(pijuice.config.GENERAL_CONFIG_REGS)
+
         Label(self.frame, text="Run pin:").grid(row=0, column=0, padx=(2, 2), pady=(10, 0), sticky = W)
         self.runPinConfig = StringVar()
         self.runPinConfigSel = Combobox(self.frame, textvariable=self.runPinConfig, state='readonly')
@@ -442,6 +444,8 @@ class PiJuiceHATConfig(object):
             self.chargingEnabled.set(config['data']['charging_enabled'])
         self.chargingEnabled.trace("w", self._UpdateChargingConfig)
 
+        pijuice.interface.EndTransaction()
+
         self.defaultConfigBtn = Button(self.frame, text='Reset to default configuration', state="normal", underline=0, command= self._ResetToDefaultConfigCmd)
         self.defaultConfigBtn.grid(row=14, column=0, padx=(2, 2), pady=(20, 0), sticky = S+W)
 
@@ -596,11 +600,16 @@ class PiJuiceButtonsConfig(object):
                 self.evParamList[ind].trace("w", self._ConfigEdited)
 
             self.configs.append({})
-            self.ReadConfig(i)
+
+        self.Refresh()
 
         self.applyBtn.configure(state="disabled")
 
     def _ApplyNewConfig(self):
+        # Changed buttons are written back to back and verified together after one delay
+        written = []
+        reread = []
+        pijuice.interface.BeginTransaction()
         for bind in range(0, len(pijuice.config.buttons)):
             config = {}
             for j in range(0, len(pijuice.config.buttonEvents)):
@@ -610,20 +619,33 @@ class PiJuiceButtonsConfig(object):
                 if self.configs[bind]['data'] != config:
                     status = pijuice.config.SetButtonConfiguration(pijuice.config.buttons[bind], config)
                     if status['error'] != 'NO_ERROR':
-                        time.sleep(0.4)
-                        self.ReadConfig(bind)
+                        reread.append(bind)
                     else:
-                        self.configs[bind]['data'] = config
-                        self.errorStatus.set('')
-                        notify_service()
+                        written.append((bind, config))
+        # Buttons put back by a rollback are read again along with the failed ones
+        result = pijuice.interface.EndTransaction()
+        failed = result.get('data', []) + result.get('restored', [])
+
+        for bind, config in written:
+            if pijuice.config.BUTTON_CONFIGURATION_CMD + bind in failed:
+                reread.append(bind)
+            else:
+                self.configs[bind]['data'] = config
+                self.errorStatus.set('')
+        if len(written) > len(reread):
+            notify_service()
+        for bind in reread:
+            self.ReadConfig(bind)
 
         self.applyBtn.configure(state="disabled")
 
     def Refresh(self):
         isError = False
+        pijuice.interface.BeginTransaction(pijuice.config.BUTTON_CONFIG_REGS)
         for i in range(0, len(pijuice.config.buttons)):
             if self.ReadConfig(i)['error'] != 'NO_ERROR':
                 isError = True
+        pijuice.interface.EndTransaction()
         if not isError:
             self.errorStatus.set('')
         self.applyBtn.configure(state="disabled")
@@ -671,6 +693,7 @@ class PiJuiceLedConfig(object):
         self.paramEntryList = []
         self.configs = []
 
+        pijuice.interface.BeginTransaction(pijuice.config.LED_CONFIG_REGS)
         for i in range(0, len(pijuice.config.leds)):
             Label(self.frame, text=pijuice.config.leds[i]+" function:").grid(row=i*5, column=0, padx=(5, 5), pady=(20, 0), sticky = W)
             ledConfig = StringVar()
@@ -733,6 +756,7 @@ class PiJuiceLedConfig(object):
             paramR.trace("w", self._ConfigEdited)
             paramG.trace("w", self._ConfigEdited)
             paramB.trace("w", self._ConfigEdited)
+        pijuice.interface.EndTransaction()
 
         self.applyBtn = Button(self.frame, text='Apply', state="disabled", underline=0, command=self._ApplyNewConfig)
         self.applyBtn.grid(row=10, column=2, padx=5, sticky=E)
@@ -758,6 +782,8 @@ class PiJuiceLedConfig(object):
         self.applyBtn.configure(state="normal")
 
     def _ApplyNewConfig(self):
+        # Both LEDs are verified together after one delay
+        pijuice.interface.BeginTransaction()
         for i in range(0, len(pijuice.config.leds)):
             ledConfig = {'function':self.ledConfigsSel[i].get(), 'parameter':{'r':self.paramList[i*3].get(), 'g':self.paramList[i*3+1].get(), 'b':self.paramList[i*3+2].get()}}
             # Validate values
@@ -786,6 +812,10 @@ class PiJuiceLedConfig(object):
                     self.applyBtn.configure(state="disabled")
                 else:
                     MessageBox.showerror('Apply LED Configuration', status['error'], parent=self.frame)
+        status = pijuice.interface.EndTransaction()
+        if status['error'] != 'NO_ERROR':
+            self.applyBtn.configure(state="normal")
+            MessageBox.showerror('Apply LED Configuration', status['error'], parent=self.frame)
 
 class PiJuiceBatteryConfig(object):
     def __init__(self, master):
@@ -1214,6 +1244,7 @@ class PiJuiceIoConfig(object):
         self.paramConfig1 =[None, None]
         self.paramConfig2 =[None, None]
 
+        pijuice.interface.BeginTransaction(pijuice.config.IO_CONFIG_REGS)
         for i in range(0, 2):
             Label(self.frame, text="IO"+str(i+1)+":").grid(row=1+i*4, column=0, padx=(2, 2), pady=(2, 0), sticky = W)
             Label(self.frame, text="mode:").grid(row=0+i*4, column=1, padx=5, pady=(10, 0), sticky = W)
@@ -1259,6 +1290,7 @@ class PiJuiceIoConfig(object):
             self.modeSel[i].bind("<<ComboboxSelected>>", lambda event, idx=i: self._ModeSelected(event, idx))
             self.param1[i].trace("w", lambda name, index, mode, idx=i: self._ParamEdited1(idx))
             self.param2[i].trace("w", lambda name, index, mode, idx=i: self._ParamEdited2(idx))
+        pijuice.interface.EndTransaction()
 
         self.applyBtn = Button(self.frame, text='Apply', state="normal", underline=0, command=self._ApplyNewConfig)
         self.applyBtn.grid(row=8, column=2, padx=(2, 2), pady=(20, 0), sticky=E)
@@ -1338,6 +1370,8 @@ class PiJuiceIoConfig(object):
                 _ValidateFloatEntry(self.param2[i], min, self.paramConfig2[i]['max'])
 
     def _ApplyNewConfig(self):
+        # Unchanged pins are not rewritten, both are verified together after one delay
+        pijuice.interface.BeginTransaction(pijuice.config.IO_CONFIG_REGS)
         for i in range(0, 2):
             newCfg = {
                 'mode':self.mode[i].get(),
@@ -1353,6 +1387,11 @@ class PiJuiceIoConfig(object):
                 MessageBox.showerror('IO' + str(i+1) + ' Configuration', 'Reason: ' + ret['error'], parent=self.frame)
             else:
                 self.config[i] = newCfg
+        ret = pijuice.interface.EndTransaction()
+        if ret['error'] != 'NO_ERROR':
+            for cmd in ret['data']:
+                i = (cmd - pijuice.config.IO_CONFIGURATION_CMD) // 5
+                MessageBox.showerror('IO' + str(i+1) + ' Configuration', 'Reason: ' + ret['error'], parent=self.frame)
 
 
 class PiJuiceHATConfigGui(object):
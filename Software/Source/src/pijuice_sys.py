@@ -16,6 +16,7 @@ import subprocess
 import sys
 import time
 import re
+import select
 
 from pijuice import PiJuice
 
@@ -43,6 +44,14 @@ PID_FILE = '/run/pijuice/pijuice_sys.pid'
 HALT_FILE = '/run/pijuice/pijuice_halt.flag'
 I2C_ADDRESS_DEFAULT = 0x14
 I2C_BUS_DEFAULT = 1
+# User functions listed in configData['user_functions_persistent'] are started once with
+# single argument 'worker' and receive events on stdin, one JSON object per line:
+# {"event": <event>, "param": <param>}. Worker is restarted if it exits.
+# Each line is sent with one write, a line that doesn't fit in the pipe is dropped whole.
+userWorkers = {}  # func -> {'cmd', 'owner', 'proc', 'restarts', 'next_start'}
+WORKER_RESTART_DELAY_MIN = 1
+WORKER_RESTART_DELAY_MAX = 60
+WORKER_STOP_TIMEOUT = 2
 
 def _SystemHalt(event):
     if (event in ('low_charge', 'low_battery_voltage', 'no_power')
@@ -80,41 +89,13 @@ def ExecuteFunc(func, event, param):
         # Remove possible argumemts
         cmd = function.split()[0]
 
-        # Check cmd is an executable file and the file owner belongs
-        # to the pijuice group.
-        # If so, execute the command as the file owner
-
-        try:
-            statinfo = os.stat(cmd)
-        except:
-            # File not found
+        if func in configData.get('user_functions_persistent', []):
+            _SendWorkerEvent(func, cmd, event, param)
             return
-        # Get owner and ownergroup names
-        owner = pwd.getpwuid(statinfo.st_uid).pw_name
-        ownergroup = grp.getgrgid(statinfo.st_gid).gr_name
-        # Do not allow programs owned by root
-        if owner == 'root':
-            print("root owned " + cmd + " not allowed")
-            return
-        # Check cmd has executable permission
-        if statinfo.st_mode & stat.S_IXUSR == 0:
-            print(cmd + " is not executable")
-            return
-        # Owner of cmd must belong to mygroup ('pijuice')
-        mygroup = grp.getgrgid(os.getegid()).gr_name
-        # Find all groups owner belongs too
-        groups = [g.gr_name for g in grp.getgrall() if owner in g.gr_mem]
-        groups.append(ownergroup) # append primary group
-        # Does owner belong to mygroup?
-        found = 0
-        for g in groups:
-            if g == mygroup:
-                found = 1
-                break
-        if found == 0:
-            print(cmd + " owner ('" + owner + "') does not belong to '" + mygroup + "'")
+
+        owner = _GetUserFuncOwner(cmd)
+        if owner is None:
             return
-        # All checks passed
         cmd = "sudo -u " + owner + " " + cmd + " {event} {param}".format(
                                                       event=str(event),
                                                       param=str(param))
@@ -124,6 +105,148 @@ def ExecuteFunc(func, event, param):
             print('Failed to execute user func')
 
 
+def _GetUserFuncOwner(cmd):
+    # Check cmd is an executable file and the file owner belongs
+    # to the pijuice group.
+    # If so, return owner, command is executed as the file owner
+    try:
+        statinfo = os.stat(cmd)
+    except:
+        # File not found
+        return None
+    # Get owner and ownergroup names
+    owner = pwd.getpwuid(statinfo.st_uid).pw_name
+    ownergroup = grp.getgrgid(statinfo.st_gid).gr_name
+    # Do not allow programs owned by root
+    if owner == 'root':
+        print("root owned " + cmd + " not allowed")
+        return None
+    # Check cmd has executable permission
+    if statinfo.st_mode & stat.S_IXUSR == 0:
+        print(cmd + " is not executable")
+        return None
+    # Owner of cmd must belong to mygroup ('pijuice')
+    mygroup = grp.getgrgid(os.getegid()).gr_name
+    # Find all groups owner belongs too
+    groups = [g.gr_name for g in grp.getgrall() if owner in g.gr_mem]
+    groups.append(ownergroup) # append primary group
+    # Does owner belong to mygroup?
+    if mygroup not in groups:
+        print(cmd + " owner ('" + owner + "') does not belong to '" + mygroup + "'")
+        return None
+    # All checks passed
+    return owner
+
+
+def _AsUser(owner, args):
+    return ["sudo", "-u", owner] + args
+
+
+def _StartWorker(func, cmd):
+    w = userWorkers.setdefault(func, {'cmd': cmd, 'proc': None, 'restarts': 0, 'next_start': 0})
+    w['cmd'] = cmd
+    if w['proc'] is not None:
+        w['proc'].stdin.close() # of the worker that exited
+    w['proc'] = None
+    if time.time() < w['next_start']:
+        return None
+    # back off restarts of worker that keeps exiting
+    delay = min(WORKER_RESTART_DELAY_MIN << min(w['restarts'], 6), WORKER_RESTART_DELAY_MAX)
+    w['next_start'] = time.time() + delay
+    w['restarts'] += 1
+    owner = _GetUserFuncOwner(cmd)
+    if owner is None:
+        return None
+    w['owner'] = owner
+    try:
+        # own process group, so the worker and anything it starts can be stopped together
+        proc = subprocess.Popen(_AsUser(owner, [cmd, "worker"]),
+                                stdin=subprocess.PIPE, close_fds=True, start_new_session=True)
+        # never block system task on worker that does not read its events
+        os.set_blocking(proc.stdin.fileno(), False)
+    except Exception as e:
+        print('Failed to start user func worker ' + cmd + ': ' + str(e), flush=True)
+        return None
+    w['proc'] = proc
+    w['started'] = time.time()
+    return proc
+
+
+def _SignalWorker(w, sig):
+    # Worker runs as its owner and only the owner can signal it, the whole group started
+    # for sudo is signalled. If sudo runs the command on a pty it is in a group of its own,
+    # sudo relays the signals it gets to it, all but SIGKILL.
+    subprocess.call(_AsUser(w['owner'], ['kill', '-' + str(int(sig)), '--', '-' + str(w['proc'].pid)]),
+                    stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    if sig != signal.SIGKILL:
+        try:
+            w['proc'].send_signal(sig)
+        except OSError:
+            pass
+
+
+def _StopWorker(func):
+    w = userWorkers.pop(func, None)
+    if w is None or w['proc'] is None:
+        return
+    try:
+        w['proc'].stdin.close() # EOF tells worker to exit
+    except OSError:
+        pass
+    for sig in (None, signal.SIGTERM, signal.SIGKILL):
+        if sig is not None:
+            _SignalWorker(w, sig)
+        try:
+            w['proc'].wait(timeout=WORKER_STOP_TIMEOUT)
+            break
+        except subprocess.TimeoutExpired:
+            pass
+    else:
+        print('User func worker ' + w['cmd'] + ' did not stop', flush=True)
+
+
+def _SendWorkerEvent(func, cmd, event, param):
+    w = userWorkers.get(func)
+    proc = w['proc'] if (w is not None and w['cmd'] == cmd) else None
+    if proc is None or proc.poll() is not None:
+        if w is not None and w['cmd'] != cmd:
+            _StopWorker(func)
+        proc = _StartWorker(func, cmd)
+        if proc is None:
+            return
+    msg = (json.dumps({'event': str(event), 'param': str(param)}) + '\n').encode('utf-8')
+    if len(msg) > select.PIPE_BUF:
+        # only a write up to PIPE_BUF is all or nothing
+        print('User func worker ' + cmd + ' event ' + str(event) + ' too long, dropped', flush=True)
+        return
+    try:
+        os.write(proc.stdin.fileno(), msg)
+    except BlockingIOError:
+        print('User func worker ' + cmd + ' busy, event ' + str(event) + ' dropped', flush=True)
+    except (BrokenPipeError, OSError):
+        print('User func worker ' + cmd + ' not running, event ' + str(event) + ' dropped', flush=True)
+
+
+def _SuperviseWorkers():
+    persistent = configData.get('user_functions_persistent', [])
+    for func in list(userWorkers.keys()):
+        if func not in persistent or configData.get('user_functions', {}).get(func, '').split()[:1] != [userWorkers[func]['cmd']]:
+            # removed from configuration
+            _StopWorker(func)
+    for func in persistent:
+        function = configData.get('user_functions', {}).get(func, '')
+        if function == '':
+            continue
+        w = userWorkers.get(func)
+        if w is not None and w['proc'] is not None:
+            if w['proc'].poll() is None:
+                if w['restarts'] and time.time() - w['started'] > WORKER_RESTART_DELAY_MAX:
+                    w['restarts'] = 0 # worker is stable again
+                continue
+            print('User func worker ' + w['cmd'] + ' exited with ' + str(w['proc'].returncode), flush=True)
+        _StartWorker(func, function.split()[0])
+
+
 def _EvalButtonEvents():
     btEvents = pijuice.status.GetButtonEvents()
     if btEvents['error'] == 'NO_ERROR':
@@ -296,6 +419,7 @@ def _LoadConfiguration():
 
 def reload_settings(signum=None, frame=None):
     _LoadConfiguration() # Update configuration
+    _SuperviseWorkers() # Start/stop workers of changed user functions
     global watchdogEn
     if watchdogEn: _ConfigureWatchdog('ACTIVATE') # Update watchdog setting
 
@@ -392,6 +516,8 @@ def main():
 
     if watchdogEn: _ConfigureWatchdog('ACTIVATE')
 
+    _SuperviseWorkers()
+
     if sysStartEvEn:
         ExecuteFunc(configData['system_events']['sys_start']['function'], 'sys_start', configData)
 
@@ -418,6 +544,8 @@ def main():
                         _EvalPowerInputs(status)
             else:
                 print(ret)
+        if userWorkers or configData.get('user_functions_persistent'):
+            _SuperviseWorkers()
         time.sleep(1)
 
 
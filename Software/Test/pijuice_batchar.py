@@ -0,0 +1,160 @@
+#!/usr/bin/env python3
+#
+# Author: Milan Neskovic, Pi Supply, 2021, https://github.com/mmilann
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# Usage:
+# Battery characterisation with firmware 1.5 pulsed load mode, replaces pijuice-soc-test.py.
+# Firmware switches resistor load attached at PiJuice Vsys on and off and measures battery voltage
+# right before and after each edge, this script only collects the records and fits the profile.
+# Power supply should be connected to Raspberry Pi only, start with battery full, test ends when battery
+# open circuit voltage drops below end voltage. Records are logged to battery_char.csv.
+# Prints ocv10, ocv50, ocv90, r10, r50, r90 battery extended profile parameters at the end.
+# Usage:
+#	Run test: python3 pijuice_batchar.py
+#	Fit saved log again: python3 pijuice_batchar.py --fit battery_char.csv
+
+import sys
+import time
+
+# Parameters:
+Rload = 4.41 #[Ohm] Resistance of test load resistor connected to Vsys. 10Ohm/2W resistor is good example.
+onTime = 1000 #[ms] Length of time interval resistor load is on
+offTime = 500 #[ms] Length of time interval resistor load is off
+edgeDelay = 100 #[ms] Delay after edge before battery voltage is measured
+endVolt = 3250 #[mV] End test when battery open circuit voltage drops below this level
+logFile = 'battery_char.csv'
+
+BATCHAR_CMD = 0xF5 #245
+BATCHAR_READ_SIZE = 52
+BATCHAR_RECORDS_PER_READ = 3
+POWER_INPUTS_CONFIG_CMD = 0x5E
+STATUS = ['IDLE', 'RUNNING', 'DONE', 'STOPPED', 'VSYS_FAULT', 'BAD_CONFIG']
+FIELDS = ['seq', 'time', 'ocv', 'vload', 'iload', 'r', 'discharged', 'pjsoc']
+
+def U16(d):
+	return d[0] | (d[1] << 8)
+
+def Bytes16(v):
+	return [v & 0xFF, (v >> 8) & 0xFF]
+
+def Median(v):
+	v = sorted(v)
+	n = len(v)
+	return v[n // 2] if n % 2 else (v[n // 2 - 1] + v[n // 2]) / 2.0
+
+def Fit(records):
+	# Capacity is what came out by the end voltage, charge level is taken from discharged charge.
+	# Returns the profile with capacity and charge level error added, None if it can't be fitted
+	if len(records) < 10:
+		print('Not enough records to fit', len(records))
+		return None
+	capacity = records[-1]['discharged']
+	print('\nMeasured capacity %.1f mAh, %d records' % (capacity, len(records)))
+	profile = {}
+	for soc in (10, 50, 90):
+		target = (100 - soc) * capacity / 100.0
+		# Records within 2.5% charge of the point, median rejects the odd bad cycle
+		near = [r for r in records if abs(r['discharged'] - target) <= capacity * 0.025]
+		if len(near) == 0:
+			print('No records near %d%%' % soc)
+			return None
+		profile['ocv%d' % soc] = int(round(Median([r['ocv'] for r in near])))
+		profile['r%d' % soc] = round(Median([r['r'] for r in near]), 1)
+	err = [abs(r['pjsoc'] - (100.0 - r['discharged'] * 100.0 / capacity)) for r in records]
+	print('PiJuice charge level error, mean %.2f%%, max %.2f%%' % (sum(err) / len(err), max(err)))
+	print('ocv10: %d mV, ocv50: %d mV, ocv90: %d mV' % (profile['ocv10'], profile['ocv50'], profile['ocv90']))
+	print('r10: %.1f mOhm, r50: %.1f mOhm, r90: %.1f mOhm' % (profile['r10'], profile['r50'], profile['r90']))
+	print(profile)
+	profile['capacity'] = capacity
+	profile['socErrMean'] = sum(err) / len(err)
+	profile['socErrMax'] = max(err)
+	return profile
+
+def DecodeRead(d):
+	# 52 byte read: status, waiting count, dropped count, then up to three 16 byte records
+	status = STATUS[d[0]] if d[0] < len(STATUS) else 'UNKNOWN'
+	records = []
+	for i in range(0, min(d[1], BATCHAR_RECORDS_PER_READ)):
+		v = [U16(d[4 + i * 16 + j * 2:6 + i * 16 + j * 2]) for j in range(0, 8)]
+		r = dict(zip(FIELDS, v))
+		r['discharged'] = r['discharged'] / 10.0
+		r['pjsoc'] = r['pjsoc'] / 10.0
+		records.append(r)
+	return status, d[1], U16(d[2:4]), records
+
+def LoadLog(fileName):
+	records = []
+	with open(fileName) as f:
+		for line in f:
+			v = line.strip().split(',')
+			if len(v) == len(FIELDS) and v[0] != FIELDS[0]:
+				records.append(dict(zip(FIELDS, [float(x) for x in v])))
+	return records
+
+def Run():
+	from pijuice import PiJuiceInterface
+
+	ifs = PiJuiceInterface(1, 0x14)
+
+	# Turn off GPIO input to prevent charging, restored at the end
+	ret = ifs.ReadData(POWER_INPUTS_CONFIG_CMD, 1)
+	inputsConfig = ret['data'][0] if ret['error'] == 'NO_ERROR' else None
+	ifs.WriteData(POWER_INPUTS_CONFIG_CMD, [0x09])
+	time.sleep(0.2)
+
+	ret = ifs.WriteData(BATCHAR_CMD, [0xC5] + Bytes16(onTime) + Bytes16(offTime) + Bytes16(edgeDelay)
+		+ Bytes16(endVolt) + Bytes16(int(Rload * 1000)))
+	if ret['error'] != 'NO_ERROR':
+		print('Start failed', ret)
+		exit(-1)
+
+	records = []
+	lastSeq = 0
+	dropped = 0
+	status = 'RUNNING'
+	with open(logFile, 'a') as f:
+		f.write(','.join(FIELDS) + '\n')
+		try:
+			while True:
+				ret = ifs.ReadData(BATCHAR_CMD, BATCHAR_READ_SIZE)
+				if ret['error'] != 'NO_ERROR':
+					# Records stay in firmware until released, just read again
+					time.sleep(0.1)
+					continue
+				d = ret['data']
+				status, waiting, dropped, read = DecodeRead(d)
+				count = len(read)
+				for r in read:
+					if r['seq'] != lastSeq + 1:
+						print('Missed records', lastSeq + 1, r['seq'] - 1)
+					lastSeq = r['seq']
+					records.append(r)
+					f.write(','.join(str(r[k]) for k in FIELDS) + '\n')
+					print('%6ds, OCV:%04dmV, Vload:%04dmV, Iload:%04dmA, Rbat:%6.1fmOhm, discharged:%7.1fmAh, pj charge:%05.1f%%'
+						% (r['time'], r['ocv'], r['vload'], r['iload'], r['r'], r['discharged'], r['pjsoc']))
+				if count > 0:
+					ifs.WriteData(BATCHAR_CMD, [0x0A, count])
+					f.flush()
+				if status != 'RUNNING' and waiting <= count:
+					break
+				if waiting <= count:
+					time.sleep(1.0)
+		except KeyboardInterrupt:
+			ifs.WriteData(BATCHAR_CMD, [0x00])
+			print(' stopped')
+
+	print('Test ended', status, 'dropped records', dropped)
+	if inputsConfig != None:
+		ifs.WriteData(POWER_INPUTS_CONFIG_CMD, [inputsConfig])
+	Fit(records)
+
+if __name__ == '__main__':
+	if '--fit' in sys.argv:
+		Fit(LoadLog(sys.argv[sys.argv.index('--fit') + 1]))
+	else:
+		Run()
@@ -12,7 +12,7 @@
 # if there is file path as input argument it will append messages 
 # to file, otherwise will only print to screen
 # Usage: 
-# 	Enable: python3 pijuice_log.py --enable "OTHER|5VREG_ON|5VREG_OFF|WAKEUP_EVT|ALARM_EVT|MCU_RESET"
+# 	Enable: python3 pijuice_log.py --enable "OTHER|5VREG_ON|5VREG_OFF|WAKEUP_EVT|ALARM_EVT|MCU_RESET|POWER_OFF_EVT"
 #	Read: python3 pijuice_log.py
 #	Read to file: python3 pijuice_log.py ./pijuice_log.txt
 #	Disable logging: python3 pijuice_log.py --disable
@@ -107,6 +107,22 @@ def Parse_MCU_RESET(data):
 	
 	return logStr
 	
+def Parse_POWER_OFF_EVT(data):
+	t = GetDateTime(data[2:])
+
+	delay = data[11] | (data[12] << 8) | (data[13] << 16) | (data[14] << 24)
+	i = (data[18] << 8) | data[17]
+	if (i & (1 << 15)):
+		i = i - (1 << 16)
+	curr5Vgpio = "{0:.3f}".format(i/1000)
+	threshold = (data[15]&0x7F)*10
+
+	logStr = str(data[0]) + ' ' + LOG_MSG_DEFS[data[1]]['name'] +' '+str(t) + ', ' + ['HOST IDLE', 'DELAY EXPIRED'][data[10]&0x01] + ', after ' + "{0:.2f}".format(delay/1000) + 's, Battery: '+str((data[19]<<2)/10)+'%\n' \
+	+ '	GPIO_5V: ' +str(curr5Vgpio)+'A' + '\n' \
+	+ '	IDLE_POWER_OFF: ' + (('threshold ' + str(threshold) + 'mA, dwell ' + str(data[16]/10) + 's') if threshold else 'DISABLED') + '\n'
+
+	return logStr
+
 LOG_MSG_DEFS = [{'name':'NO_LOG   ', 'parser':{}}, 
 				{'name':'MESSAGE  ', 'parser':{}},
 				{'name':'VALUE	  ', 'parser':{}},
@@ -117,9 +133,10 @@ LOG_MSG_DEFS = [{'name':'NO_LOG   ', 'parser':{}},
 				{'name':'ALARM_EVT  ', 'parser':Parse_ALARM_EVT},
 				{'name':'MCU_RESET  ', 'parser':Parse_MCU_RESET},
 				{'name':'RESERVED1', 'parser':{}},
-				{'name':'ALARM_WRITE  ', 'parser':Parse_ALARM_EVT}]
+				{'name':'ALARM_WRITE  ', 'parser':Parse_ALARM_EVT},
+				{'name':'POWER_OFF_EVT  ', 'parser':Parse_POWER_OFF_EVT}]
 
-LOG_ENABLE_LIST = ['OTHER', '5VREG_ON', '5VREG_OFF', 'WAKEUP_EVT', 'ALARM_EVT', 'MCU_RESET', 'RESERVED2']
+LOG_ENABLE_LIST = ['OTHER', '5VREG_ON', '5VREG_OFF', 'WAKEUP_EVT', 'ALARM_EVT', 'MCU_RESET', 'RESERVED2', 'POWER_OFF_EVT']
 
 def GetStatus(d):
 	status = {}
@@ -300,7 +317,7 @@ if '--get_config' in sys.argv:
 		msk = 0x01
 		strOut = ''
 		#print(ret['data'][3])
-		for i in range(0, 7):
+		for i in range(0, len(LOG_ENABLE_LIST)):
 			if msk&ret['data'][3]: strOut += ('|'if strOut else '') + LOG_ENABLE_LIST[i]
 			msk <<= 1
 		print(strOut)
@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+#
+# Author: Milan Neskovic, Pi Supply, 2021, https://github.com/mmilann
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# Usage:
+# Controls PiJuice statistical PC sampling profiler, firmware version >= 1.6
+# built with PROFILER defined, and prints flat profile of firmware functions.
+# Each histogram bucket covers 2^shift bytes of code starting from base address,
+# shift 0 lets firmware pick the smallest bucket size that covers all of its code,
+# buckets that span several functions are split between them by overlap.
+# Usage:
+#	Start: python3 pijuice_prof.py --start [--period us] [--shift n] [--base 0x08000000]
+#	Stop: python3 pijuice_prof.py --stop
+#	Clear: python3 pijuice_prof.py --clear
+#	Read: python3 pijuice_prof.py --read ./PiJuice.elf [--nm arm-none-eabi-nm]
+
+from pijuice import PiJuice, PiJuiceInterface
+import time, sys, subprocess
+
+PROFILER_CMD = 0xF7 #247
+PROF_READ_SIZE = 31
+
+def GetArg(name, default):
+	if name in sys.argv:
+		i = sys.argv.index(name) + 1
+		if len(sys.argv) > i:
+			return sys.argv[i]
+	return default
+
+def U32(d):
+	return d[0] | (d[1] << 8) | (d[2] << 16) | (d[3] << 24)
+
+def ReadPage(ifs):
+	ret = ifs.ReadData(PROFILER_CMD, PROF_READ_SIZE)
+	if ret['error'] != 'NO_ERROR':
+		print(ret)
+		exit(-1)
+	return ret['data']
+
+def ReadProfile(ifs):
+	ifs.WriteData(PROFILER_CMD, [0x03, 0])
+	time.sleep(0.01)
+	d = ReadPage(ifs)
+	if d[0] != 0:
+		print('Unexpected profiler header', d)
+		exit(-1)
+	prof = {'status':d[1], 'shift':d[2], 'pages':d[3], 'perPage':d[4], 'base':U32(d[5:9]),
+		'total':U32(d[9:13]), 'outOfRange':U32(d[13:17]), 'periodUs':d[17] | (d[18] << 8), 'buckets':[]}
+	for p in range(1, prof['pages'] + 1):
+		d = ReadPage(ifs)
+		if d[0] != p:
+			print('Profiler page out of sequence', p, d[0])
+			exit(-1)
+		prof['buckets'] += [d[2+i*2] | (d[3+i*2] << 8) for i in range(0, prof['perPage'])]
+	return prof
+
+def LoadSymbols(elf, nm):
+	out = subprocess.check_output([nm, '-n', '-S', '--defined-only', elf]).decode()
+	syms = []
+	for line in out.splitlines():
+		f = line.split()
+		if len(f) == 4 and f[2] in 'tTwW':
+			addr = int(f[0], 16) & ~0x01 # thumb bit
+			size = int(f[1], 16)
+			if size > 0:
+				syms.append((addr, addr + size, f[3]))
+	return syms
+
+def FlatProfile(prof, syms):
+	flat = {}
+	width = 1 << prof['shift']
+	for i, cnt in enumerate(prof['buckets']):
+		if cnt == 0:
+			continue
+		lo = prof['base'] + i * width
+		hi = lo + width
+		overlaps = [(min(e, hi) - max(s, lo), n) for s, e, n in syms if s < hi and e > lo]
+		covered = sum(o for o, n in overlaps)
+		if covered == 0:
+			flat['<unknown>'] = flat.get('<unknown>', 0) + cnt
+			continue
+		for o, n in overlaps:
+			flat[n] = flat.get(n, 0) + cnt * o / covered
+	return flat
+
+ifs = PiJuiceInterface(1,0x14)
+
+if '--start' in sys.argv:
+	period = int(GetArg('--period', '997'), 0)
+	shift = int(GetArg('--shift', '0'), 0)
+	base = int(GetArg('--base', '0x08000000'), 0)
+	ret = ifs.WriteData(PROFILER_CMD, [0x01, period & 0xFF, (period >> 8) & 0xFF, shift,
+		base & 0xFF, (base >> 8) & 0xFF, (base >> 16) & 0xFF, (base >> 24) & 0xFF])
+	print('Profiler start', ret['error'])
+	exit(0)
+
+if '--stop' in sys.argv:
+	ret = ifs.WriteData(PROFILER_CMD, [0x00])
+	print('Profiler stop', ret['error'])
+	exit(0)
+
+if '--clear' in sys.argv:
+	ret = ifs.WriteData(PROFILER_CMD, [0x02])
+	print('Profiler clear', ret['error'])
+	exit(0)
+
+if '--read' in sys.argv:
+	elf = GetArg('--read', None)
+	prof = ReadProfile(ifs)
+	inRange = prof['total'] - prof['outOfRange']
+	print('samples:', prof['total'], 'out of range:', prof['outOfRange'], 'period:', prof['periodUs'], 'us',
+		'base:', hex(prof['base']), 'bucket:', 1 << prof['shift'], 'bytes',
+		'RUNNING' if (prof['status'] & 0x01) else 'STOPPED', 'SATURATED' if (prof['status'] & 0x02) else '')
+	if elf == None or elf.startswith('--'):
+		for i, cnt in enumerate(prof['buckets']):
+			if cnt:
+				print(hex(prof['base'] + (i << prof['shift'])), cnt)
+		exit(0)
+	flat = FlatProfile(prof, LoadSymbols(elf, GetArg('--nm', 'arm-none-eabi-nm')))
+	cum = 0
+	print('  %     cum %   samples  function')
+	for n, cnt in sorted(flat.items(), key=lambda x: -x[1]):
+		pct = 100 * cnt / inRange if inRange else 0
+		cum += pct
+		print('%6.2f %7.2f %9.1f  %s' % (pct, cum, cnt, n))
+	exit(0)
+
+print('Usage: pijuice_prof.py --start [--period us] [--shift n] [--base addr] | --stop | --clear | --read [firmware.elf] [--nm path]')
@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+#
+# Author: Milan Neskovic, Pi Supply, 2021, https://github.com/mmilann
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# Usage:
+# Reads PiJuice osloop/taskman timing statistics, firmware version 1.5.
+# Osloop service routines are in osloop timer ticks, taskman tasks and i2c transactions in microseconds.
+# Usage:
+#	Read: python3 pijuice_timing.py
+#	Clear: python3 pijuice_timing.py --clear
+
+from pijuice import PiJuiceInterface
+import sys
+
+TIMING_STATS_CMD = 0xF6 #246
+TIMING_READ_SIZE = 31
+
+MODULES = ['ADC_Service', 'IODRV_Service', 'ANALOG_Service', 'I2CDRV_Service', 'HOSTCOMMS_Service', 'LED_Service',
+	'CHARGER_Task', 'FUELGAUGE_Task', 'BATTERY_Task', 'POWERSOURCE_Task', 'ISENSE_Task', 'RTC_EvaluateAlarm',
+	'BUTTON_Task', 'POWERMAN_Task', 'HOSTCOMMS_Task', 'RTC_Mirror',
+	'I2CDRV_Transaction']
+OSLOOP_MODULES = 6
+
+def U16(d):
+	return d[0] | (d[1] << 8)
+
+def U32(d):
+	return U16(d[0:2]) | (U16(d[2:4]) << 16)
+
+def ReadPage(ifs):
+	ret = ifs.ReadData(TIMING_STATS_CMD, TIMING_READ_SIZE)
+	if ret['error'] != 'NO_ERROR':
+		print(ret)
+		exit(-1)
+	return ret['data']
+
+ifs = PiJuiceInterface(1,0x14)
+
+if '--clear' in sys.argv:
+	ret = ifs.WriteData(TIMING_STATS_CMD, [0x00])
+	print('Timing stats clear', ret['error'])
+	exit(0)
+
+ifs.WriteData(TIMING_STATS_CMD, [0x01, 0])
+d = ReadPage(ifs)
+if d[0] != 0:
+	print('Unexpected timing stats header', d)
+	exit(-1)
+pages = d[1]
+tickUs = 1000.0 / U16(d[18:20]) if U16(d[18:20]) else 0
+
+print('%-18s %8s %8s %8s %8s %10s' % ('loop', 'min', 'max', 'mean', 'p99', 'count'))
+for i, (name, scale, unit) in enumerate([('osloop', tickUs, 'us'), ('taskman', 1, 'us')]):
+	v = [U16(d[2+i*8+j*2:4+i*8+j*2]) * scale for j in range(0, 4)]
+	print('%-18s %8.1f %8.1f %8.1f %8.1f %10d %s' % (name, v[0], v[1], v[2], v[3], U32(d[20+i*4:24+i*4]), unit))
+
+entries = []
+for p in range(1, pages):
+	d = ReadPage(ifs)
+	if d[0] != p:
+		print('Timing stats page out of sequence', p, d[0])
+		exit(-1)
+	entries += [(U16(d[2+i*4:4+i*4]), U16(d[4+i*4:6+i*4])) for i in range(0, 7)]
+
+print('\n%-18s %8s %8s' % ('module', 'mean', 'max'))
+for i, name in enumerate(MODULES):
+	if i < len(entries):
+		scale = tickUs if i < OSLOOP_MODULES else 1
+		print('%-18s %8.1f %8.1f us' % (name, entries[i][0] * scale, entries[i][1] * scale))
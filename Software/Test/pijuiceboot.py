@@ -7,19 +7,22 @@
 # MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
 # GNU General Public License for more details.
 
-# Description: Python tcript loads firmware to PiJuice boards
+# Description: Python script loads firmware to PiJuice boards through the STM32 embedded bootloader.
+# Every step waits on the bootloader ACK rather than a fixed delay, pages left erased (all 0xFF) are
+# not written. Several boards can be programmed at once, one per i2c bus or UART port.
 # Write firmware: python3 pijuiceboot.py 14 ./PiJuice-V1.5_2021_02_06.elf.binary
 # No start option: python3 pijuiceboot.py 14 ./PiJuice-V1.5_2021_02_06.elf.binary --no_start
 # Bulk erase option: python3 pijuiceboot.py 14 ./PiJuice-V1.5_2021_02_06.elf.binary --bulk_erase
 # Dump config to file: python3 pijuiceboot.py 14  --dump_config ./pjConfig.bin
 # Write config file: python3 pijuiceboot.py 14 --load_config ./pjConfig.bin
+# Boards on i2c buses 1, 3 and 4 at once: python3 pijuiceboot.py 14 ./PiJuice-V1.5_2021_02_06.elf.binary --bus 1,3,4
+# Boards on UART, BOOT0 held high: python3 pijuiceboot.py 14 ./PiJuice-V1.5_2021_02_06.elf.binary --uart /dev/ttyUSB0,/dev/ttyUSB1
+# Board on Raspberry Pi UART started with BOOT/RESET gpios: python3 pijuiceboot.py 14 ./fw.binary --uart /dev/serial0 --gpio_reset
+# Boards on two UARTs, BOOT:RESET gpios for each: python3 pijuiceboot.py 14 ./fw.binary --uart /dev/ttyAMA1,/dev/ttyAMA2 --gpio_reset 10:6,20:21
 
 import time
-#import serial
-import os, sys, getopt
-from smbus import SMBus
+import os, sys, threading
 from fcntl import ioctl
-#import wiringpi
 
 WRITE_PAGE_SIZE = 256
 ERASE_PAGE_SIZE = 2048
@@ -30,71 +33,31 @@ CONFIG_START_ADDRESS  = 0x0803BC00
 
 ACK = 0x79
 NACK = 0x1F
+BUSY = 0x76
 NO_RESP	= 0x00
 
-adr=0x41
-ser = open('/dev/i2c-{0}'.format(1),'r+b',buffering=0)
-ioctl(ser.fileno(), 0x0706, adr&0x7F)
+BOOTLOADER_I2C_ADDRESS = 0x41
+I2C_SLAVE = 0x0706
+
+DEFAULT_GPIO_PAIR = (10, 6) # BOOT0, RESET
+
+# Upper limits only, every wait ends as soon as the bootloader answers
+CMD_TIMEOUT = 0.2
+WRITE_TIMEOUT = 0.5
+PAGE_ERASE_TIMEOUT = 0.05 # per page
+MASS_ERASE_TIMEOUT = 2
+START_TIMEOUT = 1
+POLL_INTERVAL = 0.0002
 
 if not 'pytest' in sys.modules:  # workaround for https://github.com/pytest-dev/pytest/issues/4843
     sys.stdout.reconfigure(encoding='utf-8', errors='namereplace')
     sys.stderr.reconfigure(encoding='utf-8', errors='namereplace')
-    
-#ser = serial.Serial(
-#	port='/dev/serial0',
-#	baudrate = 115200,
-#	parity=serial.PARITY_EVEN,
-#	stopbits=serial.STOPBITS_ONE,
-#	bytesize=serial.EIGHTBITS, 
-#	timeout=0.1
-#)
-counter=0
-def StartUart():
-    ser.reset_input_buffer()
-    cmd = [0x7F]
-    ser.write(cmd) 
-    time.sleep(0.1) 
-    rsp=ser.read(1)
-    if rsp:
-        print(hex(ord(rsp)))
-    else:
-        print ("failed to start uart, no ack") 
-
-def Receive():
-    #uint8_t ack, dataLen;
-    #int bytesRead;
-    retryAttempts = 0
-
-    #bytesRead=read(sysBootloaderFd, &ack, 1);
-    #if (bytesRead < 1) return -1;
-    # get ACK
-    i = 0;
-    #while ser.in_waiting == 0 and i < 200: #while (ser.read(sysBootloaderFd, &ack, 1) < 1 && i < 200) {
-    #    i+=1
-    time.sleep(0.01);
-
-    #if (i >= 200): return -1
-    ack = ser.read(1)[0]
-    #print('ACK:',ack)
-    if (ack != ACK):
-        print("No ack", ack)
-        return -2
-
-    bytesRead = 13#ser.in_waiting
-    data = ser.read(13)
-    dataLen = data[0];
-    #print("bytesRead %d  dataLen", bytesRead, dataLen);
-    if (bytesRead < dataLen): return -4
-
-    bytesRead = 1#ser.in_waiting
-    ack = ser.read(1)[0]
-    #print("Ack:", ack);
-    #print("data: %x, %x, %x\n", data[0], data[1], data[12]);
-    if (bytesRead < 1): return -5
-
-    if (ack != ACK): return -6
-
-    return data
+
+printLock = threading.Lock()
+
+def Log(name, *args):
+    with printLock:
+        print(name + ':', *args)
 
 def GetCheckSum(msg, size):
     result = (0x00)
@@ -102,491 +65,464 @@ def GetCheckSum(msg, size):
         result = result ^ msg[i];
     return result
 
-def WaitAck(tout):
-    try:
-        start_time=time.time()
-        ack = None
-        while (ack==None) and ((time.time()-start_time) < tout):
-            ack=ser.read(1)
-            #print "wait ack", (time.time()-start_time)
-        if ack:
-            return ord(ack)
-        else:
+class I2cLink():
+    # Bootloader on /dev/i2c-N, erase takes the page count and the page list as two frames
+    splitErase = True
+
+    def __init__(self, bus):
+        self.name = 'i2c-' + str(bus)
+        self.bus = bus
+        self.fd = os.open('/dev/i2c-{0}'.format(bus), os.O_RDWR)
+        ioctl(self.fd, I2C_SLAVE, BOOTLOADER_I2C_ADDRESS & 0x7F)
+
+    def Write(self, data):
+        os.write(self.fd, bytes(data))
+
+    def Read(self, size, timeout = CMD_TIMEOUT):
+        return os.read(self.fd, size)
+
+    def ReadByte(self):
+        # Bootloader does not answer the address while it is busy
+        try:
+            return os.read(self.fd, 1)[0]
+        except OSError:
+            return None
+
+    def Close(self):
+        os.close(self.fd)
+
+class UartLink():
+    splitErase = False
+
+    def __init__(self, port):
+        import serial
+        self.name = port
+        self.ser = serial.Serial(port=port, baudrate=115200, parity=serial.PARITY_EVEN,
+            stopbits=serial.STOPBITS_ONE, bytesize=serial.EIGHTBITS, timeout=0.01)
+
+    def Write(self, data):
+        self.ser.write(bytes(data))
+
+    def Read(self, size, timeout = CMD_TIMEOUT):
+        self.ser.timeout = timeout
+        rsp = self.ser.read(size)
+        self.ser.timeout = 0.01
+        return rsp
+
+    def ReadByte(self):
+        rsp = self.ser.read(1)
+        return rsp[0] if rsp else None
+
+    def Close(self):
+        self.ser.close()
+
+class Bootloader():
+    def __init__(self, link):
+        self.link = link
+        self.name = link.name
+
+    def WaitAck(self, tout):
+        # Poll until ACK or NACK, BUSY and no answer mean try again
+        endTime = time.monotonic() + tout
+        while True:
+            rsp = self.link.ReadByte()
+            if rsp == ACK or rsp == NACK:
+                return rsp
+            if time.monotonic() > endTime:
+                return NO_RESP if rsp == None else rsp
+            time.sleep(POLL_INTERVAL)
+
+    def Send(self, data, tout = CMD_TIMEOUT):
+        # Write is refused while the bootloader is still busy with the last command
+        endTime = time.monotonic() + tout
+        while True:
+            try:
+                self.link.Write(data)
+                return True
+            except OSError:
+                if time.monotonic() > endTime:
+                    return False
+                time.sleep(POLL_INTERVAL)
+
+    def Command(self, cmd, tout = CMD_TIMEOUT):
+        if not self.Send([cmd, cmd ^ 0xFF], tout):
             return NO_RESP
-    except:
-        return NO_RESP
-        
-def SendAddress(addr):
-    sendData = [0x00]*5
-    sendData[3] = addr & 0x000000FF;
-    addr >>= 8;
-    sendData[2] = addr & 0x000000FF;
-    addr >>= 8;
-    sendData[1] = addr & 0x000000FF;
-    addr >>= 8;
-    sendData[0] = addr & 0x000000FF;
-    sendData[4] = GetCheckSum(sendData, 4);
-    ser.write(bytearray(sendData[0:5]));
-    time.sleep(0.01)
-    
-def GoCommand(addr):
-    #ser.reset_input_buffer()
-    ser.write(bytearray([0x21, 0xDE]))
-    time.sleep(0.01)
-    # get ACK
-    ackRsp = WaitAck(0.2)
-    if ackRsp != ACK:
-        print("go cmd start failed, no ack", hex(ackRsp))
-        return "ERROR ACK=" + hex(ackRsp)
-
-    # send address
-    SendAddress(addr)
-
-    # get ACK
-    ackRsp = WaitAck(2)
-    if ackRsp != ACK:
-        print("go cmd address failed, no ack", hex(ackRsp))
-        return "ERROR ACK=" + hex(ackRsp)
-    else:
+        return self.WaitAck(tout)
+
+    def SendAddress(self, addr):
+        sendData = [(addr >> 24) & 0xFF, (addr >> 16) & 0xFF, (addr >> 8) & 0xFF, addr & 0xFF]
+        sendData.append(GetCheckSum(sendData, 4))
+        self.Send(sendData)
+        return self.WaitAck(CMD_TIMEOUT)
+
+    def Sync(self, tout):
+        # UART needs 0x7F for baud rate detection, NACK means it was already done
+        endTime = time.monotonic() + tout
+        while time.monotonic() < endTime:
+            if isinstance(self.link, UartLink):
+                self.link.Write([0x7F])
+                if self.WaitAck(0.05) in (ACK, NACK):
+                    return True
+            elif self.GetCommands(False) == 'OK':
+                return True
+            else:
+                time.sleep(0.005)
+        return False
+
+    def GetCommands(self, show = True):
+        ackRsp = self.Command(0x00)
+        if ackRsp != ACK:
+            return "ERROR ACK=" + hex(ackRsp)
+        try:
+            data = self.link.Read(13)
+        except OSError:
+            return "ERROR READ"
+        if self.WaitAck(CMD_TIMEOUT) != ACK:
+            return "ERROR ACK"
+        if show:
+            Log(self.name, 'Commands:', list(data))
+        return 'OK'
+
+    def GoCommand(self, addr):
+        ackRsp = self.Command(0x21)
+        if ackRsp != ACK:
+            Log(self.name, "go cmd start failed, no ack", hex(ackRsp))
+            return "ERROR ACK=" + hex(ackRsp)
+
+        ackRsp = self.SendAddress(addr)
+        if ackRsp != ACK:
+            Log(self.name, "go cmd address failed, no ack", hex(ackRsp))
+            return "ERROR ACK=" + hex(ackRsp)
         return "OK"
 
-def ExtendedEraseMemory(pages, count):
-    sendData = [0x00]*256
-
-    # send read command
-    #ser.reset_input_buffer()
-    ser.write(bytearray([0x44, 0xBB]))
-    # get ACK
-    ackRsp = WaitAck(0.2)
-    if ackRsp != ACK:
-        print("Erase start no ack", hex(ackRsp))
-        return -2
-
-    if (count > 0):
-        #print("Erase of pages started")
-        # send number of pages
-        N = count - 1;
-        sendData[1] = N & 0x00FF;
-        N >>= 8;
-        sendData[0] = N & 0x00FF;
-
-        csum = 0x00
-        csum = csum ^ sendData[0]
-        csum = csum ^ sendData[1]
-        sendData[2] = csum;
-        time.sleep(0.1)
-        ser.write(bytearray(sendData[0:3]))
-        #print(sendData[1:3])
-        #bus.write_block_data(adr, sendData[0], sendData[1:3])
-        time.sleep(0.1)
-        # get ACK
-        ackRsp = WaitAck(0.2)
+    def ExtendedEraseMemory(self, pages):
+        # pages = None for mass erase
+        ackRsp = self.Command(0x44)
         if ackRsp != ACK:
-            #if (bytesRead < 1) return -3;
-            #if (ack != ACK) return -4;
-            print("Erase start no ack", hex(ackRsp))
-            return -4#"ERROR ACK=" + hex(ackRsp)
-
-        csum = 0x00
-        for i in range(0, count):#(i = 0; i < count; i++) {
-            page = pages[i];
-            sendData[1 + 2*i] = page & 0x00FF
-            page = page >> 8
-            sendData[0 + 2*i] = page & 0x00FF
-            csum = csum ^ sendData[0 + 2*i]
-            csum = csum ^ sendData[1 + 2*i]
-
-        sendData[2*count] = csum
-        time.sleep(0.1)
-        ser.write(bytearray(sendData[0:2 * count + 1]))
-        time.sleep(count * 0.05)
-    else:
-        #Send special erase command
-        #print("Special erase started")
-        code = pages[0];
-        sendData[1] = code & 0x00FF;
-        code >>= 8;
-        sendData[0] = code & 0x00FF;
-        csum = 0x00;
-        csum = csum ^ sendData[0];
-        csum = csum ^ sendData[1];
-        sendData[2] = csum;
-        ser.write(bytearray(sendData[0:3]))
-        time.sleep(0.5)
-
-    ackRsp = WaitAck(2)
-    if ackRsp == ACK:
-        return "OK";
-    else:
+            Log(self.name, "Erase start no ack", hex(ackRsp))
+            return -2
+
+        if pages == None:
+            sendData = [0xFF, 0xFF, 0x00]
+            tout = MASS_ERASE_TIMEOUT
+        else:
+            count = len(pages)
+            sendData = [((count - 1) >> 8) & 0xFF, (count - 1) & 0xFF]
+            for page in pages:
+                sendData += [(page >> 8) & 0xFF, page & 0xFF]
+            tout = count * PAGE_ERASE_TIMEOUT + CMD_TIMEOUT
+            if self.link.splitErase:
+                header = sendData[0:2] + [GetCheckSum(sendData, 2)]
+                sendData = sendData[2:]
+                self.Send(header)
+                ackRsp = self.WaitAck(CMD_TIMEOUT)
+                if ackRsp != ACK:
+                    Log(self.name, "Erase count no ack", hex(ackRsp))
+                    return -4
+            sendData.append(GetCheckSum(sendData, len(sendData)))
+
+        self.Send(sendData)
+        ackRsp = self.WaitAck(tout)
+        if ackRsp == ACK:
+            return "OK"
+        Log(self.name, "Erase no ack", hex(ackRsp))
         return -6
 
-def GetCommandsI2C():
-    #ser.reset_input_buffer()
-    cmd = 0xFF
-    try:
-        ser.write(bytearray([0x00, 0xFF]))#bus.write_byte_data(adr, 0x00, cmd)
-    except:
-        print("Error, cannot communicate, embedded bootloader may not be started properly!")
-        return -1
-    #rsp=ser.read(1) #ser.read(1)
-    time.sleep(0.01)
-    data = Receive()
-    if len(data):
-        print('Commands:',[((data[i])) for i in range(0,len(data))])
-    return 'OK'
-
-def GetCommands():
-    ser.reset_input_buffer()
-    cmd = [0x00, 0xFF]
-    ser.write(bytearray(cmd)) 
-    rsp=ser.read(1)
-    time.sleep(0.01)
-    print(hex(ord(rsp)))
-    rsp=ser.read(20)
-    time.sleep(0.01)
-    if len(rsp):
-        print([hex(ord(rsp[i])) for i in range(0,len(rsp))]) #print hex(ord(rsp))
-
-def WriteUnprotect():
-    # send readout unprotect  command
-    #ser.reset_input_buffer()
-    ser.write(bytearray([chr(0x73), chr(0x8C)]))
-    time.sleep(0.02)#usleep(10000);
-
-    # get ACK
-    ack=ser.read(1)
-    if (not ack or ord(ack) != ACK):
-        print("0x73 WriteUnprotect failed, no ack", hex(ord(ack)) if ack else 0)
-        return "ERROR"
-
-    return 0
-
-def WritePage(addr, data, size):
-    # send read command
-    #ser.reset_input_buffer()
-    ser.write(bytearray([0x31, 0xCE]))
-    time.sleep(0.0005)
-    ackRsp = WaitAck(0.5)
-    if ackRsp != ACK:
-        print("0x31 write cmd failed", hex(ackRsp))
-        return -2
-        
-    # send address
-    SendAddress(addr)
-
-    ackRsp = WaitAck(0.2)
-    if ackRsp != ACK:
-        print("Send address cmd failed", hex(ackRsp))
-        return -4
+    def WritePage(self, addr, data):
+        size = len(data)
+        ackRsp = self.Command(0x31)
+        if ackRsp != ACK:
+            Log(self.name, "0x31 write cmd failed", hex(ackRsp))
+            return -2
 
-    sendData = [0x00]*(size+2)
-    sendData[0] = size-1;
-    csum = (0x00)
-    csum = csum ^ (size-1)
-    for i in range(0,size): #(i = 0; i < size; i++):
-        sendData[i+1] = data[i];
-        csum = csum ^ data[i];
-        #print i, len(data), sendData[i+1], csum
-    sendData[size+1] = csum&0xFF;
-    #print('Write',sendData[size+1],size+2)
-    ser.write(bytearray(sendData[0:int(size+2)]));
-    #time.sleep(0.001)
-
-    ackRsp = WaitAck(0.5)
-    if ackRsp != ACK:
-        print("Write failed", hex(ackRsp))
-        return -6
-        # get address ACK
-    #else:
-    #	print "page", j, "succ"
+        ackRsp = self.SendAddress(addr)
+        if ackRsp != ACK:
+            Log(self.name, "Send address cmd failed", hex(ackRsp))
+            return -4
 
-    return "OK"
+        sendData = [size - 1] + list(data)
+        sendData.append(GetCheckSum(sendData, size + 1))
+        self.Send(sendData)
+
+        ackRsp = self.WaitAck(WRITE_TIMEOUT)
+        if ackRsp != ACK:
+            Log(self.name, "Write failed", hex(ackRsp))
+            return -6
+        return "OK"
+
+    def ReadPage(self, addr, size):
+        ackRsp = self.Command(0x11)
+        if ackRsp != ACK:
+            Log(self.name, "0x11 read cmd failed", hex(ackRsp))
+            return {'error':-5}
+
+        ackRsp = self.SendAddress(addr)
+        if ackRsp != ACK:
+            Log(self.name, "Send address cmd failed", hex(ackRsp))
+            return {'error':-4}
+
+        self.Send([size - 1, (~(size - 1)) & 0xFF])
+        ackRsp = self.WaitAck(CMD_TIMEOUT)
+        if ackRsp != ACK:
+            Log(self.name, "Send number of bytes to read ACK failed", hex(ackRsp))
+            return {'error':-6}
+        try:
+            rsp = self.link.Read(size)
+        except OSError:
+            return {'error':-7}
+        if len(rsp) < size:
+            return {'error':-7}
+        return {'data':rsp, 'error':'OK'}
+
+    def ReadBinary(self, address, dumpFile = None):
+        adr = address if address >= EEPROM_START_ADDRESS else EEPROM_START_ADDRESS
+        startAdr = adr
+        d = bytearray()
+        while adr < (EEPROM_START_ADDRESS+EEPROM_SIZE):
+            status = self.ReadPage(adr, WRITE_PAGE_SIZE)
+            if (status['error'] != 'OK'):
+                Log(self.name, "Error reading binary:", hex(adr), status['error'])
+                return {'error':'READ_BINARY,' + str(status['error'])}
+            d += status['data']
+            adr += WRITE_PAGE_SIZE
+
+        d = d.rstrip(b'\xff')
+
+        if dumpFile != None:
+            try:
+                with open(dumpFile, "wb") as cfgFile:
+                    cfgFile.write(d)
+            except:
+                Log(self.name, 'Configuration file dump error, check if path is valid', dumpFile)
+                return {'error':'DUMP_FILE_WRITE'}
+
+        return {'data':d, 'error':'OK'}
+
+    def WriteBinary(self, data, address):
+        # Last page first so the vector table only goes in once the rest is good,
+        # each page is read back as soon as its write is acknowledged
+        pageCount = (len(data) + WRITE_PAGE_SIZE - 1) // WRITE_PAGE_SIZE
+        adr = address if address >= EEPROM_START_ADDRESS else EEPROM_START_ADDRESS
+        skipped = 0
+        for i in range(pageCount-1, -1, -1):
+            d = data[i * WRITE_PAGE_SIZE:(i+1) * WRITE_PAGE_SIZE]
+            if d.count(0xFF) == len(d):
+                # Already erased
+                skipped += 1
+                continue
+            err = self.WritePage(adr + i * WRITE_PAGE_SIZE, d)
+            if err != "OK":
+                Log(self.name, "Page:", i, "write failed")
+                return -7
+            status = self.ReadPage(adr + i * WRITE_PAGE_SIZE, len(d))
+            if (status['error'] != 'OK'):
+                Log(self.name, "Error reading page:", i, status['error'])
+                return -8
+            if bytes(d) != status['data']:
+                Log(self.name, "Page:", i, "read verify failed")
+                return -9
+            Log(self.name, "Page:", i, "write success")
+        Log(self.name, 'pageCount', pageCount, 'erased pages skipped', skipped)
+        return "OK"
+
+    def ErasePages(self, firstPage, count):
+        pages = list(range(firstPage, firstPage + count))
+        for i in range(0, len(pages), MAX_ERASE_SECTORS):
+            err = self.ExtendedEraseMemory(pages[i:i+MAX_ERASE_SECTORS])
+            if err != "OK":
+                return err
+        return "OK"
 
-def ReadPage(addr, size):
-    #send read command
-    ser.write(bytearray([0x11, 0xEE]))
+def GpioPairs(value, portCount):
+    # BOOT0 and RESET gpio of the board on each UART port, given as boot:reset in port order.
+    # On its own the option is the one board on gpio 10 and 6, more boards need a pair each.
+    if value == None or value.startswith('--'):
+        return [DEFAULT_GPIO_PAIR] if portCount == 1 else None
+    try:
+        pairs = [tuple(int(pin) for pin in pair.split(':')) for pair in value.split(',')]
+    except ValueError:
+        return None
+    pins = [pin for pair in pairs for pin in pair]
+    if len(pairs) != portCount or any(len(pair) != 2 for pair in pairs) or len(set(pins)) != len(pins):
+        return None
+    return pairs
+
+def StartBootloaderGPIO(pairs):
+    # All boards reset together with BOOT0 held, Sync then waits for each bootloader to answer
+    for boot, reset in pairs:
+        os.system("gpio -g mode {0} out".format(boot))
+        os.system("gpio -g write {0} 1".format(boot)) # activate BOOT pin
+        os.system("gpio -g mode {0} out".format(reset))
+        os.system("gpio -g write {0} 0".format(reset)) # activate reset
+    time.sleep(0.01)
+    for boot, reset in pairs:
+        os.system("gpio -g write {0} 1".format(reset)) # return from reset
     time.sleep(0.01)
-    ackRsp = WaitAck(0.2)
-    if ackRsp != ACK:
-        print("0x11 write cmd failed", hex(ackRsp))
-        return {'error':-5}
-
-    #send address
-    SendAddress(addr)
-
-    # get address ACK
-    ackRsp = WaitAck(0.2)
-    if ackRsp != ACK:
-        print("Send address cmd failed", hex(ackRsp))
-        return {'error':-4}
-    #time.sleep(0.001)
-
-    # send number of bytes to read
-    sendData = [0x00]*(size+2)
-    sendData[0] = size-1
-    csum = 0x00
-    csum = ~ sendData[0]
-    sendData[1] = csum&0xFF;
-    #get ACK
-    ser.write(bytearray(sendData[0:2]))
-    time.sleep(0.0005)
-
-    ackRsp = WaitAck(0.5)
-    if ackRsp != ACK:
-        print("Send number of bytes to read ACK failed", hex(ackRsp))
-        return {'error':-6}
+    for boot, reset in pairs:
+        os.system("gpio -g write {0} 0".format(boot)) # deactivate BOOT pin
+
+def StartBootloaderI2C(boot, addr):
+    Log(boot.name, "Starting bootloader")
+    from smbus import SMBus
+    bus = SMBus(boot.link.bus)
     try:
-        rsp=ser.read(size) #bytesRead = read(sysBootloaderFd, data, size);
-        #print("mem data read", len(rsp))
+        bus.write_i2c_block_data(addr, 0xFE, [0x01, 0xFE])
     except:
-        return {'error':-7}
-        #if (bytesRead < size): return {'error':-7}
-
-    return {'data':rsp, 'error':'OK'}
-
-def ReadBinary(address, dumpFile = None):
-    adr = address if address >= EEPROM_START_ADDRESS else EEPROM_START_ADDRESS
-    startAdr = adr
-    d = [0xff]*((EEPROM_START_ADDRESS+EEPROM_SIZE) - adr)
-    while adr < (EEPROM_START_ADDRESS+EEPROM_SIZE):#for i in range(pageCount-1, -1, -1):#range(0, pageCount): #
-        time.sleep(0.001)
-
-        status = ReadPage(adr, WRITE_PAGE_SIZE);
-        if (status['error'] != 'OK'):
-            print("Error reading binary:", adr, status['error'])
-            return {'error':'READ_BINARY,'+status['error']}
-        else:
-            #print('Page read:',len(status['data']), status['data'])
-            d[adr-startAdr:adr-startAdr+WRITE_PAGE_SIZE] = status['data']
-        adr += WRITE_PAGE_SIZE
-            
-    end = 0
-    for i in range(len(d)-1, -1, -1):
-        if d[i] != 0xff:
-            end = i+1
-            break
-    d= d[0:end]
-    
-    if dumpFile != None:
+        pass
+    if not boot.Sync(0.05):
+        Log(boot.name, "Starting bootloader old firmware")
         try:
-            with open(dumpFile, "wb") as cfgFile:
-                cfgFile.write(bytearray(d))
+            bus.write_i2c_block_data(addr, 0xFE, [0x01])
         except:
-            print('Configuration file dump error, check if path is valid', sys.argv[fi])
-            return {'error':'DUMP_FILE_WRITE'}
-    
-    return {'data':d, 'error':'OK'}
-
-def WriteBinary(data, address):
-    pageCount = len(data) // WRITE_PAGE_SIZE
-    if (len(data) % WRITE_PAGE_SIZE):
-        pageCount = pageCount + 1
-    print('pageCount',pageCount)
-    adr = address if address >= EEPROM_START_ADDRESS else EEPROM_START_ADDRESS
-    for i in range(pageCount-1, -1, -1):#range(0, pageCount): #
-        #WriteUnprotect()
-        time.sleep(0.001)
-        d = data[i * WRITE_PAGE_SIZE:(i+1) * WRITE_PAGE_SIZE]
-        #print('writing page: ',i, len(d))
-        err = WritePage(adr + i * WRITE_PAGE_SIZE, d, len(d))
+            pass
+    bus.close()
+
+def LoadConfig(boot, loadConfig):
+    erasePageCount = (len(loadConfig) + ERASE_PAGE_SIZE - 1) // ERASE_PAGE_SIZE
+    sectorOffset = (CONFIG_START_ADDRESS-EEPROM_START_ADDRESS) // ERASE_PAGE_SIZE
+    Log(boot.name, "Erase page count", erasePageCount, sectorOffset)
+    err = boot.ErasePages(sectorOffset, erasePageCount)
+    if err != "OK":
+        Log(boot.name, "Erase error", err)
+        return err
+    err = boot.WriteBinary(loadConfig, CONFIG_START_ADDRESS)
+    if err != "OK":
+        Log(boot.name, "Write failed exiting..", err)
+        return err
+    Log(boot.name, "Configuration load success")
+    return "OK"
+
+def WriteFirmware(boot, data, bulkErase):
+    # erase first sector, board will not run a half written image
+    err = boot.ExtendedEraseMemory([0])
+    if err != "OK":
+        Log(boot.name, "Erase failed", err)
+        return -4
+    Log(boot.name, "First page erase succcess")
+
+    if bulkErase:
+        # Mass erase fast path, configuration is saved and put back
+        status = boot.ReadBinary(CONFIG_START_ADDRESS)
+        if status['error'] != "OK":
+            Log(boot.name, "Configuration read error", status['error'])
+            return status['error']
+        Log(boot.name, "Configuration read success")
+
+        err = boot.ExtendedEraseMemory(None)
         if err != "OK":
-            print("Page:", i, "write failed")
-            return -7
-        #time.sleep(0.01)
-        # read verify
-        status = ReadPage(adr + i * WRITE_PAGE_SIZE, len(d));
-        if (status['error'] != 'OK'):
-            print("Error reading page:", i, status['error'])
-            return -8
-        else:
-            #print('Page read:',len(status['data']), status['data'])
-            if bytearray(d) != status['data']:
-                print("Page:", i, "read verify failed");
-                return -9
-            else:
-                #print('mem data read success')
-                print("Page:", i, "write success")
+            Log(boot.name, "Bulk erase error", err)
+            return err
+        Log(boot.name, "Bulk erase success")
+
+        err = boot.WriteBinary(status['data'], CONFIG_START_ADDRESS)
+        if err != "OK":
+            Log(boot.name, "Configuration write failed exiting..", err)
+            return err
+        Log(boot.name, "Configuration load success", len(status['data']))
+    else:
+        erasePageCount = (len(data) + ERASE_PAGE_SIZE - 1) // ERASE_PAGE_SIZE
+        Log(boot.name, "Erase page count", erasePageCount)
+        err = boot.ErasePages(1, erasePageCount - 1)
+        if err != "OK":
+            Log(boot.name, "Erase error", err)
+            return err
+        Log(boot.name, "Erase success")
+
+    err = boot.WriteBinary(data, EEPROM_START_ADDRESS)
+    if err != "OK":
+        Log(boot.name, "Write failed exiting..", err)
+        return err
+    Log(boot.name, "Firmware load success")
     return "OK"
 
-def StartBootloaderGPIO():
-    os.system("gpio -g mode 10 out") #wiringpi.pinMode(10, 1)# gpio -g mode 10 out
-    os.system("gpio -g write 10 1") #wiringpi.digitalWrite(10, 1) # activate BOOT pin
-    time.sleep(0.01)
-    os.system("gpio -g mode 6 out") #wiringpi.pinMode(6, 1) # gpio -g mode 6 out
-    os.system("gpio -g write 6 0") #wiringpi.digitalWrite(6, 0) # activate reset
-    time.sleep(0.2)
-    os.system("gpio -g write 6 1") #wiringpi.digitalWrite(6, 1) # return from reset
-    time.sleep(0.1)
-    os.system("gpio -g write 10 0") #wiringpi.digitalWrite(10, 0) # deactivate BOOT pin
-
-def StartBootloaderI2C(addr):
-    print("Starting bootloader \n");
+def Program(link, opts, results):
+    startTime = time.monotonic()
+    boot = Bootloader(link)
+    err = "OK"
     try:
-        bus=SMBus(1)
-        #startCmd = [0xFE, 0x01, 0xFE] 
-        bus.write_i2c_block_data(addr, 0xFE, [0x01, 0xFE])
-        time.sleep(0.01)  #usleep(10000)
-        print("Starting bootloader old firmware\n");
-        bus.write_i2c_block_data(addr, 0xFE, [0x01])
-        time.sleep(0.01)
-    except:
-        return
-
-#print ((sys.argv))
-#data = open(sys.argv[2]).read() #map(lambda c: ord(c), open("PiJuice-V1.5_2021_02_06.elf.binary").read()) # TO-DO recognise file path by pijuice firmware name format
-cfgFp = None
-loadConfig = None
-if '--dump_config' in sys.argv:
-    fi = sys.argv.index('--dump_config')+1
-    if len(sys.argv) > fi:
-        cfgFp = sys.argv[fi]
-        if fi < 4:
-            # Start embedded bootloader
-            if not ('--no_start' in sys.argv):
-                StartBootloaderI2C(int(sys.argv[1], 16))
-
-            status = ReadBinary(CONFIG_START_ADDRESS, cfgFp)
-            if status['error'] == "OK":
-                print("Configuration read success");
+        if opts['start'] and isinstance(link, I2cLink):
+            StartBootloaderI2C(boot, opts['addr'])
+        if not boot.Sync(START_TIMEOUT):
+            Log(boot.name, "Error, cannot communicate, embedded bootloader may not be started properly!")
+            err = -1
+        else:
+            boot.GetCommands()
+            if opts['dumpConfig'] != None:
+                status = boot.ReadBinary(CONFIG_START_ADDRESS, opts['dumpConfig'])
+                err = status['error']
+            elif opts['loadConfig'] != None:
+                err = LoadConfig(boot, opts['loadConfig'])
             else:
-                print("Configuration read error", status['error']);
-                exit(status['error'])
+                err = WriteFirmware(boot, opts['data'], opts['bulkErase'])
 
-            err = GoCommand(EEPROM_START_ADDRESS)
-            if err != "OK":
-                print("Cannot execute code")
-            else:
-                print("Code executed successfully")
-            exit(err)
-        
-elif '--load_config' in sys.argv:
-    fi = sys.argv.index('--load_config')+1
-    if len(sys.argv) > fi:
-        loadCfgFile = sys.argv[fi]
-        cfgFile = open(sys.argv[fi], "rb")
-        loadConfig = cfgFile.read()
-        cfgFile.close()
-        if fi < 4:
-            # Start embedded bootloader
-            if not ('--no_start' in sys.argv):
-                StartBootloaderI2C(int(sys.argv[1], 16))
-
-            erasePageCount = len(loadConfig) // ERASE_PAGE_SIZE;
-            if (len(loadConfig) % ERASE_PAGE_SIZE):
-                erasePageCount = erasePageCount + 1
-            sectorOffset = (CONFIG_START_ADDRESS-EEPROM_START_ADDRESS) // ERASE_PAGE_SIZE
-            print("Erase page count", erasePageCount, sectorOffset)
-            pages = [0x0000]*256
-            for i in range(0, erasePageCount):
-                pages[i] = sectorOffset + i
-            err = ExtendedEraseMemory(pages, erasePageCount);
             if err == "OK":
-                print("Erase success");
-            else:
-                print("Erase error", err);
-                exit(err) #ret = -5;
-            time.sleep(0.2)
-            err = WriteBinary(loadConfig, CONFIG_START_ADDRESS)
-            if err != "OK":
-                print("Write failed exiting..", err)
-                exit(err)
-            else:
-                print("Firmware load success")
-                
-            err = GoCommand(EEPROM_START_ADDRESS)
-            if err != "OK":
-                print("Cannot execute code")
-            else:
-                print("Code executed successfully")
-            exit(err)
-            
-file = open(sys.argv[2], "rb")
-data = file.read()
-file.close()
-print("File size:", len(data))
-
-# Start embedded bootloader
-if not ('--no_start' in sys.argv):
-    StartBootloaderI2C(int(sys.argv[1], 16))
-
-if GetCommandsI2C() != 'OK':
-    exit(-1)
-#WriteUnprotect()
-
-# erase first sector
-pages = [0x0000]
-err = ExtendedEraseMemory(pages, len(pages))
-if err != "OK":
-    print("Erase failed", err)
-    exit(-4) #ret = -4;
-else:
-    print("First page erase succcess")
-
-# erase all other pages
-if '--bulk_erase' in sys.argv:     
-    status = ReadBinary(CONFIG_START_ADDRESS, cfgFp)
-    if status['error'] == "OK":
-        print("Configuration read success");
-    else:
-        print("Configuration read error", status['error'] );
-        exit(status['error'])
-
-    # mass erase command
-    pages = [0xFFFF]
-    err = ExtendedEraseMemory(pages, 0)
-    if err == "OK":
-        print("Bulk erase success");
-    else:
-        print("Bulk erase error", err);
-        exit(err) #ret = -5;
-        
-    #print('config', status['data'])
-    err = WriteBinary(status['data'], CONFIG_START_ADDRESS)
-    if err != "OK":
-        print("Configuration write failed exiting..", err)
-        exit(err)
-    else:
-        print("Configuration load success", len(status['data']))
-        
-    err = WriteBinary(data, EEPROM_START_ADDRESS)
-    if err != "OK":
-        print("Write failed exiting..", err)
-        exit(err)
-    else:
-        print("Firmware load success")
-        
-else:
-    # get page count
-    erasePageCount = len(data) // ERASE_PAGE_SIZE;
-    if (len(data) % ERASE_PAGE_SIZE):
-        erasePageCount = erasePageCount + 1
-    print("Erase page count", erasePageCount)
-    pages = [0x0000]*erasePageCount
-    for i in range(1, erasePageCount):
-        pages[i-1] = i
-
-    erasePageCount -= 1 # first sector alredy erased
-    erased = 0
-    while erased<erasePageCount:
-        p = pages[erased:erased+MAX_ERASE_SECTORS]
-        print('erasing',erased,len(p))
-        err = ExtendedEraseMemory(p, len(p));
+                err = boot.GoCommand(EEPROM_START_ADDRESS)
+                Log(boot.name, "Code executed successfully" if err == "OK" else "Cannot execute code")
+    except Exception as e:
+        Log(link.name, "Error", e)
+        err = str(e)
+    link.Close()
+    results[link.name] = (err, time.monotonic() - startTime)
+
+def OptionValue(name):
+    if name in sys.argv:
+        fi = sys.argv.index(name) + 1
+        if len(sys.argv) > fi:
+            return sys.argv[fi]
+    return None
+
+def main():
+    opts = {
+        'addr': int(sys.argv[1], 16),
+        'start': not ('--no_start' in sys.argv),
+        'bulkErase': '--bulk_erase' in sys.argv,
+        'dumpConfig': OptionValue('--dump_config'),
+        'loadConfig': None,
+        'data': None
+    }
+
+    if OptionValue('--load_config') != None:
+        with open(OptionValue('--load_config'), "rb") as cfgFile:
+            opts['loadConfig'] = cfgFile.read()
+    elif opts['dumpConfig'] == None:
+        with open(sys.argv[2], "rb") as binFile:
+            opts['data'] = binFile.read()
+        print("File size:", len(opts['data']))
+
+    links = []
+    if OptionValue('--uart') != None:
+        ports = OptionValue('--uart').split(',')
+        if '--gpio_reset' in sys.argv:
+            pairs = GpioPairs(OptionValue('--gpio_reset'), len(ports))
+            if pairs == None:
+                print("--gpio_reset needs a boot:reset gpio pair for each UART port, e.g. --gpio_reset 10:6,20:21")
+                sys.exit(-1)
+            StartBootloaderGPIO(pairs)
+        links += [UartLink(port) for port in ports]
+    if OptionValue('--bus') != None or len(links) == 0:
+        buses = OptionValue('--bus') or '1'
+        links += [I2cLink(int(bus)) for bus in buses.split(',')]
+
+    if opts['dumpConfig'] != None and len(links) > 1:
+        print("Configuration dump is for one board only")
+        sys.exit(-1)
+
+    startTime = time.monotonic()
+    results = {}
+    threads = [threading.Thread(target=Program, args=(link, opts, results)) for link in links]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+
+    failed = 0
+    for name in results:
+        err, duration = results[name]
+        print(name, 'OK' if err == "OK" else 'FAILED ' + str(err), '%.1fs' % duration)
         if err != "OK":
-            print("Erase error", err);
-            exit(err) #ret = -5;
-        erased += MAX_ERASE_SECTORS
-    print("Erase success")
+            failed += 1
+    print('Boards:', len(results), 'failed:', failed, 'total time %.1fs' % (time.monotonic() - startTime))
+    sys.exit(0 if failed == 0 else -1)
 
-    err = WriteBinary(data, EEPROM_START_ADDRESS)
-    if err != "OK":
-        print("Write failed exiting..", err)
-        exit(err)
-    else:
-        print("Firmware load success", err)
-
-err = GoCommand(EEPROM_START_ADDRESS)
-if err != "OK":
-    print("Cannot execute code")
-else:
-    print("Code executed successfully")
-#print("EEPROM programming finished successfully");
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# Usage:
+# Host check of the pijuice_batchar.py profile fit. A synthetic cell with known capacity,
+# open circuit voltage curve and internal resistance is discharged with the pulsed load the
+# way firmware 1.5 records it, at the firmware record resolution, with noise and bad cycles.
+# The fit has to give back the capacity, ocv and r at 10, 50 and 90% within tolerance, from
+# the records directly, from a saved log and from the 52 byte reads.
+#	python3 test_batchar.py
+
+import contextlib
+import io
+import math
+import os
+import random
+import sys
+import tempfile
+import unittest
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+
+import pijuice_batchar as batchar
+
+CAPACITY = 2000.0 # [mAh] to the end voltage
+END_MV = 3250
+
+# Tolerances
+CAPACITY_TOL = 0.005 # fraction
+OCV_TOL = 3 # [mV]
+R_TOL = 0.02 # fraction
+
+class Cell:
+	# OCV rises steeply out of empty, flat middle, steeper again near full. R is highest
+	# when empty and drops off to a floor above about 30%.
+	def __init__(self, capacity=CAPACITY, rFull=110.0, rEmpty=260.0):
+		self.capacity = capacity
+		self.rFull = rFull
+		self.rEmpty = rEmpty
+
+	def Ocv(self, soc):
+		s = soc / 100.0
+		return END_MV + 470.0 * (1.0 - math.exp(-s / 0.06)) + 300.0 * s + 150.0 * s ** 4
+
+	def R(self, soc):
+		s = soc / 100.0
+		return self.rFull + (self.rEmpty - self.rFull) * (1.0 - s) ** 6
+
+# Records as the firmware makes them, one per on/off cycle until ocv drops below the end voltage
+def Discharge(cell, seed=1, rLoad=4.41, onMs=1000, offMs=500, noiseMv=2.0, badEvery=0, socOffset=0.0):
+	rnd = random.Random(seed)
+	records = []
+	discharged = 0.0
+	seq = 0
+	t = 0.0
+	while True:
+		soc = 100.0 * (1.0 - discharged / cell.capacity)
+		ocv = cell.Ocv(soc)
+		if ocv < END_MV:
+			break
+		r = cell.R(soc)
+		iLoad = ocv / (rLoad * 1000.0 + r) * 1000.0
+		vLoad = ocv - iLoad * r / 1000.0
+		ocvMeas = ocv + rnd.gauss(0.0, noiseMv)
+		vLoadMeas = vLoad + rnd.gauss(0.0, noiseMv)
+		# Mean of the rising and falling edges, each edge has its own noise
+		rMeas = (ocvMeas - vLoadMeas) * 1000.0 / iLoad
+		seq += 1
+		if badEvery and seq % badEvery == 0:
+			# A cycle where the load did not switch or the window caught a transient
+			rMeas = rnd.choice([0.0, 3.0 * rMeas])
+			ocvMeas -= rnd.uniform(20.0, 80.0)
+		discharged += iLoad * onMs / 3600000.0
+		t += (onMs + offMs) / 1000.0
+		records.append({'seq': seq, 'time': int(t), 'ocv': int(round(ocvMeas)), 'vload': int(round(vLoadMeas)),
+			'iload': int(round(iLoad)), 'r': int(round(rMeas)), 'discharged': int(discharged * 10.0) / 10.0,
+			'pjsoc': int(max(0.0, min(100.0, soc + socOffset)) * 10.0) / 10.0})
+	return records
+
+def QuietFit(records):
+	with contextlib.redirect_stdout(io.StringIO()):
+		return batchar.Fit(records)
+
+class TestBatcharFit(unittest.TestCase):
+
+	def CheckProfile(self, cell, profile):
+		self.assertIsNotNone(profile)
+		self.assertAlmostEqual(profile['capacity'], cell.capacity, delta=cell.capacity * CAPACITY_TOL)
+		for soc in (10, 50, 90):
+			self.assertAlmostEqual(profile['ocv%d' % soc], cell.Ocv(soc), delta=OCV_TOL, msg='ocv%d' % soc)
+			self.assertAlmostEqual(profile['r%d' % soc], cell.R(soc), delta=cell.R(soc) * R_TOL, msg='r%d' % soc)
+
+	def test_recovers_profile(self):
+		cell = Cell()
+		self.CheckProfile(cell, QuietFit(Discharge(cell)))
+
+	def test_other_cells(self):
+		for capacity, rFull, rEmpty, seed in ((1000.0, 180.0, 400.0, 2), (5000.0, 60.0, 140.0, 3), (12000.0, 40.0, 90.0, 4)):
+			cell = Cell(capacity, rFull, rEmpty)
+			self.CheckProfile(cell, QuietFit(Discharge(cell, seed=seed)))
+
+	def test_noise_and_bad_cycles(self):
+		# One bad cycle in 50, and noisier windows
+		cell = Cell()
+		self.CheckProfile(cell, QuietFit(Discharge(cell, seed=5, noiseMv=4.0, badEvery=50)))
+
+	def test_charge_level_error(self):
+		cell = Cell()
+		profile = QuietFit(Discharge(cell, socOffset=1.5))
+		self.assertAlmostEqual(profile['socErrMean'], 1.5, delta=0.15)
+		self.assertLessEqual(profile['socErrMax'], 1.5 + 0.3)
+
+	def test_not_enough_records(self):
+		cell = Cell()
+		self.assertIsNone(QuietFit(Discharge(cell)[:9]))
+		self.assertIsNone(QuietFit([]))
+
+	def test_gap_at_a_point(self):
+		# Records lost around 50% can't be fitted
+		cell = Cell()
+		records = [r for r in Discharge(cell) if abs(r['discharged'] - cell.capacity / 2.0) > cell.capacity * 0.03]
+		self.assertIsNone(QuietFit(records))
+
+	def test_saved_log(self):
+		cell = Cell()
+		records = Discharge(cell, seed=6)
+		fd, path = tempfile.mkstemp(suffix='.csv')
+		try:
+			with os.fdopen(fd, 'w') as f:
+				# As the run writes it, a header at the start of each run
+				f.write(','.join(batchar.FIELDS) + '\n')
+				for r in records:
+					f.write(','.join(str(r[k]) for k in batchar.FIELDS) + '\n')
+			loaded = batchar.LoadLog(path)
+		finally:
+			os.remove(path)
+		self.assertEqual(len(loaded), len(records))
+		self.assertEqual(QuietFit(loaded), QuietFit(records))
+		self.CheckProfile(cell, QuietFit(loaded))
+
+	def test_decode_read(self):
+		cell = Cell()
+		records = Discharge(cell, seed=7)
+		decoded = []
+		for i in range(0, len(records), batchar.BATCHAR_RECORDS_PER_READ):
+			chunk = records[i:i + batchar.BATCHAR_RECORDS_PER_READ]
+			d = [batchar.STATUS.index('RUNNING'), len(records) - i, 3, 0]
+			for r in chunk:
+				for k in batchar.FIELDS:
+					v = r[k] * 10.0 if k in ('discharged', 'pjsoc') else r[k]
+					d += batchar.Bytes16(int(round(v)))
+			d += [0] * (batchar.BATCHAR_READ_SIZE - len(d))
+			status, waiting, dropped, read = batchar.DecodeRead(d)
+			self.assertEqual(status, 'RUNNING')
+			self.assertEqual(waiting, len(records) - i)
+			self.assertEqual(dropped, 3)
+			self.assertEqual(len(read), len(chunk))
+			decoded += read
+		self.assertEqual([r['seq'] for r in decoded], list(range(1, len(records) + 1)))
+		self.CheckProfile(cell, QuietFit(decoded))
+		# Waiting count larger than a read only gives the records in the read
+		status, waiting, dropped, read = batchar.DecodeRead([2, 5, 0, 0] + [0] * 48)
+		self.assertEqual((status, waiting, len(read)), ('DONE', 5, 3))
+		self.assertEqual(batchar.DecodeRead([9, 0, 0, 0] + [0] * 48)[0], 'UNKNOWN')
+
+if __name__ == '__main__':
+	unittest.main()
@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# Usage:
+# Host check of the table driven CRC-8-ATM (SMBus PEC) used for fuel gauge transfers.
+# Firmware crc8_atm.c (V1.6) and crc.c (V1.5) are built for the host with gcc and
+# compared with the bitwise polynomial 0x07 CRC, and with the shift loop the V1.6
+# firmware used before the table, over random buffers and known PEC vectors.
+#	python3 test_crc8.py
+
+import ctypes
+import os
+import random
+import shutil
+import subprocess
+import tempfile
+import unittest
+
+FIRMWARE = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', '..', 'Firmware')
+V16 = os.path.join(FIRMWARE, 'Sources-V1.6_2021_09_10')
+V15 = os.path.join(FIRMWARE, 'Sources-V1.5_2021_02_06')
+
+# (data, crc) pairs, CRC-8/SMBUS: poly 0x07, init 0, no reflection, no xorout
+PEC_VECTORS = [
+	(b'', 0x00),
+	(b'\x00', 0x00),
+	(b'\x01', 0x07),
+	(b'\x80', 0x89),
+	(b'\xFF', 0xF3),
+	(b'123456789', 0xF4), # standard check value
+]
+
+def Crc8Bitwise(crc, data):
+	for b in data:
+		crc ^= b
+		for i in range(0, 8):
+			crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+	return crc
+
+def Crc8ShiftLoop(crc, data):
+	# Previous firmware Crc8, POLYNOMIAL (0x1070U << 3) on a 16 bit word
+	for b in data:
+		d = ((crc ^ b) << 8) & 0xFFFF
+		for i in range(0, 8):
+			if d & 0x8000:
+				d ^= 0x1070 << 3
+			d = (d << 1) & 0xFFFF
+		crc = d >> 8
+	return crc
+
+def BuildLib(tmp, name, src, inc):
+	lib = os.path.join(tmp, name + '.so')
+	subprocess.check_call(['gcc', '-shared', '-fPIC', '-O2', '-I' + inc, '-o', lib, src])
+	return ctypes.CDLL(lib)
+
+@unittest.skipIf(shutil.which('gcc') is None, 'gcc not found')
+class Crc8TableTest(unittest.TestCase):
+
+	@classmethod
+	def setUpClass(cls):
+		cls.tmp = tempfile.mkdtemp()
+		cls.v16 = BuildLib(cls.tmp, 'crc8_atm', os.path.join(V16, 'Src', 'crc8_atm.c'), os.path.join(V16, 'Inc'))
+		cls.v16.Crc8.restype = ctypes.c_uint8
+		cls.v16.Crc8.argtypes = [ctypes.c_uint8, ctypes.c_uint8]
+		cls.v16.Crc8Block.restype = ctypes.c_uint8
+		cls.v16.Crc8Block.argtypes = [ctypes.c_uint8, ctypes.c_char_p, ctypes.c_uint8]
+		cls.v15 = BuildLib(cls.tmp, 'crc', os.path.join(V15, 'Src', 'crc.c'), os.path.join(V15, 'Inc'))
+		cls.v15.crc_8_update.restype = ctypes.c_uint8
+		cls.v15.crc_8_update.argtypes = [ctypes.c_uint, ctypes.c_char_p, ctypes.c_size_t]
+
+	@classmethod
+	def tearDownClass(cls):
+		shutil.rmtree(cls.tmp)
+
+	def test_every_crc_and_byte(self):
+		for crc in range(0, 256):
+			for b in range(0, 256):
+				expected = Crc8Bitwise(crc, [b])
+				self.assertEqual(self.v16.Crc8(crc, b), expected)
+				self.assertEqual(Crc8ShiftLoop(crc, [b]), expected)
+				self.assertEqual(self.v15.crc_8_update(crc, bytes([b]), 1), expected)
+
+	def test_random_buffers(self):
+		rnd = random.Random(0x07)
+		for n in range(0, 2000):
+			data = bytes(rnd.getrandbits(8) for i in range(0, rnd.randint(1, 255)))
+			crc = rnd.getrandbits(8)
+			expected = Crc8Bitwise(crc, data)
+			self.assertEqual(self.v16.Crc8Block(crc, data, len(data)), expected)
+			self.assertEqual(self.v15.crc_8_update(crc, data, len(data)), expected)
+
+	def test_pec_vectors(self):
+		for data, pec in PEC_VECTORS:
+			self.assertEqual(Crc8Bitwise(0, data), pec)
+			self.assertEqual(self.v16.Crc8Block(0, data, len(data)), pec)
+			self.assertEqual(self.v15.crc_8_update(0, data, len(data)), pec)
+
+	def test_fuel_gauge_word_read(self):
+		# LC709203F read frame: address w, register, address r, lsb, msb, pec
+		frame = bytes([0x16, 0x09, 0x17, 0x6A, 0x0E])
+		pec = Crc8Bitwise(0, frame)
+		self.assertEqual(self.v16.Crc8Block(0, frame, len(frame)), pec)
+		# a frame with its pec appended checks to 0
+		self.assertEqual(self.v16.Crc8Block(0, frame + bytes([pec]), len(frame) + 1), 0)
+
+if __name__ == '__main__':
+	unittest.main()
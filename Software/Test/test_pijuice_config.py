@@ -0,0 +1,242 @@
+#!/usr/bin/env python3
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# Usage:
+# Host check of the pijuice.py batched config transactions against a mock SMBus that logs
+# every transfer and every delay. It pins down the order: one read pass at the start, reads
+# served from the cache, unchanged writes skipped, changed writes back to back, one delay of
+# the longest requested length and one read back pass. On a partial failure, a rejected or
+# NACKed write, the registers written are put back to their values before the transaction.
+#	python3 test_pijuice_config.py
+
+import os
+import sys
+import types
+import unittest
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'Source'))
+
+# pijuice.py opens the bus through smbus, which is only on the Pi
+if 'smbus' not in sys.modules:
+	sys.modules['smbus'] = types.SimpleNamespace(SMBus=lambda bus: None)
+
+import pijuice
+
+def Checksum(data):
+	fcs = 0xFF
+	for x in data:
+		fcs ^= x
+	return fcs
+
+class Clock:
+	# Stands in for the time module in pijuice.py, the delays are logged instead of slept
+	def __init__(self, log):
+		self.now = 1000.0
+		self.log = log
+
+	def time(self):
+		return self.now
+
+	def sleep(self, s):
+		self.log.append(('sleep', s))
+		self.now += s
+
+	def Advance(self, s):
+		self.now += s
+
+class Bus:
+	# Register file of the PiJuice, transfers are logged in order. A command in nack raises
+	# like a NACKed transfer, a command in reject takes the write but keeps its old value the
+	# way the firmware does with an out of range setting.
+	def __init__(self, log, registers):
+		self.log = log
+		self.registers = {cmd: data[:] for cmd, data in registers.items()}
+		self.nack = set()
+		self.reject = set()
+
+	def read_i2c_block_data(self, addr, cmd, length):
+		self.log.append(('read', cmd))
+		if cmd in self.nack:
+			raise IOError('NACK')
+		d = self.registers.get(cmd, [0] * (length - 1))[:length - 1]
+		return d + [Checksum(d)]
+
+	def write_i2c_block_data(self, addr, cmd, d):
+		self.log.append(('write', cmd, d[:-1]))
+		if cmd in self.nack:
+			raise IOError('NACK')
+		if Checksum(d[:-1]) != d[-1]:
+			return
+		if cmd not in self.reject:
+			self.registers[cmd] = d[:-1]
+
+LED = pijuice.PiJuiceConfig.LED_CONFIGURATION_CMD
+IO = pijuice.PiJuiceConfig.IO_CONFIGURATION_CMD
+RUN_PIN = pijuice.PiJuiceConfig.RUN_PIN_CONFIG_CMD
+
+REGISTERS = {
+	LED: [1, 0, 60, 0],     # CHARGE_STATUS
+	LED + 1: [3, 0, 0, 60], # USER_LED
+	IO: [0, 0, 0, 0, 0],
+	IO + 5: [0, 0, 0, 0, 0],
+	RUN_PIN: [0],
+}
+
+def LedConfig(function, r, g, b):
+	return {'function': function, 'parameter': {'r': r, 'g': g, 'b': b}}
+
+class TestConfigTransaction(unittest.TestCase):
+
+	def setUp(self):
+		self.log = []
+		self.clock = Clock(self.log)
+		self.time = pijuice.time
+		pijuice.time = self.clock
+		self.pj = pijuice.PiJuice(1, 0x14)
+		self.bus = Bus(self.log, REGISTERS)
+		self.pj.interface.i2cbus = self.bus
+
+	def tearDown(self):
+		pijuice.time = self.time
+
+	def Reads(self, cmds):
+		return [('read', cmd) for cmd in cmds]
+
+	def test_batching_order(self):
+		interface = self.pj.interface
+		config = self.pj.config
+		interface.BeginTransaction(config.LED_CONFIG_REGS)
+		self.assertEqual(self.log, self.Reads([LED, LED + 1]))
+		del self.log[:]
+
+		# Both reads come from the cache
+		d1 = config.GetLedConfiguration('D1')
+		d2 = config.GetLedConfiguration('D2')
+		self.assertEqual(d1['data'], LedConfig('CHARGE_STATUS', 0, 60, 0))
+		self.assertEqual(d2['data'], LedConfig('USER_LED', 0, 0, 60))
+		self.assertEqual(self.log, [])
+
+		# D1 is unchanged and not written, D2 is written without a delay or read back
+		self.assertEqual(config.SetLedConfiguration('D1', d1['data']), {'error': 'NO_ERROR'})
+		self.assertEqual(config.SetLedConfiguration('D2', LedConfig('USER_LED', 10, 20, 30)), {'error': 'NO_ERROR'})
+		self.assertEqual(self.log, [('write', LED + 1, [3, 10, 20, 30])])
+		del self.log[:]
+
+		self.assertEqual(interface.EndTransaction(), {'error': 'NO_ERROR'})
+		self.assertEqual(self.log, [('sleep', 0.2)] + self.Reads([LED + 1]))
+		self.assertEqual(self.bus.registers[LED + 1], [3, 10, 20, 30])
+
+		# Outside a transaction every call goes to the bus again
+		del self.log[:]
+		config.GetLedConfiguration('D1')
+		self.assertEqual(self.log, self.Reads([LED]))
+
+	def test_longest_delay(self):
+		interface = self.pj.interface
+		config = self.pj.config
+		interface.BeginTransaction(config.LED_CONFIG_REGS + config.IO_CONFIG_REGS)
+		del self.log[:]
+		interface.WriteDataVerify(LED, [2, 1, 1, 1], 0.2)
+		interface.WriteDataVerify(IO, [1, 0, 0, 0, 0], 0.5)
+		interface.WriteDataVerify(IO + 5, [1, 1, 0, 0, 0], 0.1)
+		interface.WriteDataVerify(RUN_PIN, [1])
+		self.assertEqual(interface.EndTransaction(), {'error': 'NO_ERROR'})
+		self.assertEqual([e[:2] for e in self.log],
+			[('write', LED), ('write', IO), ('write', IO + 5), ('write', RUN_PIN), ('sleep', 0.5)]
+			+ self.Reads([LED, IO, IO + 5, RUN_PIN]))
+
+	def test_nested(self):
+		interface = self.pj.interface
+		config = self.pj.config
+		interface.BeginTransaction(config.LED_CONFIG_REGS)
+		interface.BeginTransaction(config.LED_CONFIG_REGS)
+		self.assertEqual(self.log, self.Reads([LED, LED + 1]))
+		config.SetLedConfiguration('D1', LedConfig('USER_LED', 1, 2, 3))
+		del self.log[:]
+		self.assertEqual(interface.EndTransaction(), {'error': 'NO_ERROR'})
+		self.assertEqual(self.log, [])
+		self.assertEqual(interface.EndTransaction(), {'error': 'NO_ERROR'})
+		self.assertEqual(self.log, [('sleep', 0.2)] + self.Reads([LED]))
+		# Unbalanced end is harmless
+		self.assertEqual(interface.EndTransaction(), {'error': 'NO_ERROR'})
+
+	def test_rollback_rejected_write(self):
+		interface = self.pj.interface
+		config = self.pj.config
+		self.bus.reject.add(IO + 5)
+		interface.BeginTransaction(config.LED_CONFIG_REGS + config.IO_CONFIG_REGS)
+		del self.log[:]
+		interface.WriteDataVerify(LED, [2, 1, 1, 1], 0.2)
+		interface.WriteDataVerify(IO, [1, 0, 0, 0, 0], 0.2)
+		interface.WriteDataVerify(IO + 5, [1, 1, 0, 0, 0], 0.2)
+		del self.log[:]
+		result = interface.EndTransaction()
+		self.assertEqual(result['error'], 'WRITE_FAILED')
+		self.assertEqual(result['data'], [IO + 5])
+		self.assertEqual(sorted(result['restored']), [LED, IO, IO + 5])
+
+		# One read back, undo in reverse skipping the register that never changed, one more read back
+		self.assertEqual(self.log, [('sleep', 0.2)] + self.Reads([LED, IO, IO + 5])
+			+ [('write', IO, REGISTERS[IO]), ('write', LED, REGISTERS[LED]), ('sleep', 0.2)]
+			+ self.Reads([IO + 5, IO, LED]))
+		self.assertEqual(self.bus.registers, REGISTERS)
+
+	def test_rollback_unknown_original(self):
+		# A register that was neither prefetched nor read can't be put back
+		interface = self.pj.interface
+		config = self.pj.config
+		self.bus.reject.add(LED)
+		interface.BeginTransaction(config.LED_CONFIG_REGS)
+		interface.WriteDataVerify(LED, [2, 1, 1, 1], 0.2)
+		interface.WriteDataVerify(RUN_PIN, [1])
+		result = interface.EndTransaction()
+		self.assertEqual(result['data'], [LED])
+		self.assertEqual(result['restored'], [LED])
+		self.assertEqual(self.bus.registers[RUN_PIN], [1])
+
+		# Read in the transaction is as good as prefetched
+		self.bus.registers[RUN_PIN] = [0]
+		interface.BeginTransaction(config.LED_CONFIG_REGS)
+		config.GetRunPinConfig()
+		interface.WriteDataVerify(LED, [2, 1, 1, 1], 0.2)
+		interface.WriteDataVerify(RUN_PIN, [1])
+		result = interface.EndTransaction()
+		self.assertEqual(sorted(result['restored']), [RUN_PIN, LED])
+		self.assertEqual(self.bus.registers, REGISTERS)
+
+	def test_rollback_nack(self):
+		# The NACK holds off the bus for 4s, a rollback within that can't reach the device
+		interface = self.pj.interface
+		config = self.pj.config
+		interface.BeginTransaction(config.IO_CONFIG_REGS)
+		self.assertEqual(interface.WriteDataVerify(IO, [1, 0, 0, 0, 0], 0.2), {'error': 'NO_ERROR'})
+		self.bus.nack.add(IO + 5)
+		self.assertEqual(interface.WriteDataVerify(IO + 5, [1, 1, 0, 0, 0], 0.2), {'error': 'COMMUNICATION_ERROR'})
+		del self.log[:]
+		result = interface.EndTransaction()
+		self.assertEqual(result, {'data': [IO, IO + 5], 'restored': [], 'error': 'WRITE_FAILED'})
+		self.assertEqual(self.log, [('sleep', 0.2)])
+		self.assertEqual(self.bus.registers[IO], [1, 0, 0, 0, 0])
+
+		# Once the hold off has passed the written register goes back, the NACKed one is reported
+		self.bus.registers[IO] = REGISTERS[IO][:]
+		self.bus.nack.discard(IO + 5)
+		self.clock.Advance(4)
+		interface.BeginTransaction(config.IO_CONFIG_REGS)
+		interface.WriteDataVerify(IO, [1, 0, 0, 0, 0], 0.2)
+		self.bus.nack.add(IO + 5)
+		interface.WriteDataVerify(IO + 5, [1, 1, 0, 0, 0], 0.2)
+		self.bus.nack.discard(IO + 5)
+		self.clock.Advance(4)
+		result = interface.EndTransaction()
+		self.assertEqual(result['error'], 'WRITE_FAILED')
+		self.assertEqual(result['data'], [IO + 5])
+		self.assertEqual(sorted(result['restored']), [IO, IO + 5])
+		self.assertEqual(self.bus.registers, REGISTERS)
+
+if __name__ == '__main__':
+	unittest.main()
@@ -0,0 +1,231 @@
+#!/usr/bin/env python3
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# Usage:
+# Host check of the persistent user function workers of pijuice_sys.py, run as the current
+# user instead of through sudo. It times the event latency of a worker against a process per
+# event, checks a worker that stops reading gets whole lines only, with the lines that did
+# not fit dropped, checks the restart backoff on a clock of its own and that stopping a
+# worker that ignores EOF and SIGTERM takes down its whole process group.
+#	python3 test_pijuice_sys_workers.py
+
+import contextlib
+import io
+import json
+import os
+import pwd
+import shutil
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+import types
+import unittest
+from unittest import mock
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'Source'))
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'Source', 'src'))
+
+# pijuice.py opens the bus through smbus, which is only on the Pi
+if 'smbus' not in sys.modules:
+	sys.modules['smbus'] = types.SimpleNamespace(SMBus=lambda bus: None)
+
+import pijuice_sys
+
+FUNC = 'USER_FUNC1'
+
+class Clock:
+	# Stands in for the time module in pijuice_sys.py
+	def __init__(self):
+		self.now = 1000.0
+
+	def time(self):
+		return self.now
+
+	def Advance(self, s):
+		self.now += s
+
+class WorkerTest(unittest.TestCase):
+	def setUp(self):
+		self.dir = tempfile.mkdtemp()
+		user = pwd.getpwuid(os.getuid()).pw_name
+		self.patches = [
+			mock.patch.object(pijuice_sys, '_AsUser', lambda owner, args: args),
+			mock.patch.object(pijuice_sys, '_GetUserFuncOwner', lambda cmd: user),
+			mock.patch.object(pijuice_sys, 'configData', {}),
+			mock.patch.object(pijuice_sys, 'userWorkers', {}),
+		]
+		for p in self.patches:
+			p.start()
+
+	def tearDown(self):
+		with contextlib.redirect_stdout(io.StringIO()):
+			for func in list(pijuice_sys.userWorkers.keys()):
+				pijuice_sys._StopWorker(func)
+		for p in reversed(self.patches):
+			p.stop()
+		shutil.rmtree(self.dir)
+
+	def Script(self, name, text):
+		path = os.path.join(self.dir, name)
+		with open(path, 'w') as f:
+			f.write(text)
+		os.chmod(path, 0o755)
+		return path
+
+	def Configure(self, cmd):
+		pijuice_sys.configData['user_functions'] = {FUNC: cmd}
+		pijuice_sys.configData['user_functions_persistent'] = [FUNC]
+
+	def WaitLines(self, path, n, timeout=10):
+		end = time.time() + timeout
+		while time.time() < end:
+			if os.path.exists(path):
+				with open(path) as f:
+					lines = f.read().splitlines()
+				if len(lines) >= n:
+					return lines
+			time.sleep(0.01)
+		self.fail('worker wrote fewer than ' + str(n) + ' lines')
+
+	def testEventLatency(self):
+		log = os.path.join(self.dir, 'recv.log')
+		cmd = self.Script('worker.py', '#!' + sys.executable + '\n'
+			'import sys, time\n'
+			'if sys.argv[1] == "worker":\n'
+			'\twith open("' + log + '", "a") as f:\n'
+			'\t\tfor line in sys.stdin:\n'
+			'\t\t\tf.write(repr(time.time()) + "\\n")\n'
+			'\t\t\tf.flush()\n'
+			'else:\n'
+			'\twith open("' + log + '", "a") as f:\n'
+			'\t\tf.write(repr(time.time()) + "\\n")\n')
+		self.Configure(cmd)
+		n = 20
+		sent = []
+		for i in range(n):
+			sent.append(time.time())
+			pijuice_sys.ExecuteFunc(FUNC, 'SINGLE_PRESS', 'SW' + str(i))
+			time.sleep(0.02)
+		worker = [float(t) - s for t, s in zip(self.WaitLines(log, n), sent)]
+		pijuice_sys._StopWorker(FUNC)
+		os.remove(log)
+
+		# the way a non persistent user function runs, one process per event, without sudo
+		spawned = []
+		for i in range(n):
+			s = time.time()
+			subprocess.call([cmd, 'SINGLE_PRESS', 'SW' + str(i)])
+			spawned.append(float(self.WaitLines(log, i + 1)[i]) - s)
+
+		print('\nevent latency median: worker %.2f ms, process per event %.2f ms' %
+			(statistics.median(worker) * 1000, statistics.median(spawned) * 1000))
+		self.assertLess(statistics.median(worker), statistics.median(spawned))
+		self.assertLess(statistics.median(worker), 0.05)
+
+	def testWholeLinesOnly(self):
+		out = os.path.join(self.dir, 'recv.log')
+		go = os.path.join(self.dir, 'go')
+		cmd = self.Script('worker.py', '#!' + sys.executable + '\n'
+			'import os, sys, time\n'
+			'while not os.path.exists("' + go + '"):\n'
+			'\ttime.sleep(0.01)\n'
+			'with open("' + out + '", "w") as f:\n'
+			'\tf.write(sys.stdin.read())\n')
+		self.Configure(cmd)
+		n = 200
+		param = 'x' * 1000
+		stdout = io.StringIO()
+		with contextlib.redirect_stdout(stdout):
+			for i in range(n):
+				pijuice_sys.ExecuteFunc(FUNC, str(i), param)
+			# over PIPE_BUF a write may be split, so it is not sent at all
+			pijuice_sys.ExecuteFunc(FUNC, 'long', 'x' * pijuice_sys.select.PIPE_BUF)
+		dropped = stdout.getvalue().count('busy, event')
+		self.assertGreater(dropped, 0)
+		self.assertEqual(stdout.getvalue().count('event long too long, dropped'), 1)
+
+		open(go, 'w').close()
+		pijuice_sys._StopWorker(FUNC)
+		with open(out) as f:
+			received = [json.loads(line) for line in f.read().splitlines()]
+		self.assertEqual(len(received) + dropped, n)
+		# the worker did not read, so the lines that fit are the first ones
+		self.assertEqual([ev['event'] for ev in received], [str(i) for i in range(len(received))])
+		self.assertTrue(all(ev['param'] == param for ev in received))
+
+	def testRestartBackoff(self):
+		cmd = self.Script('worker.sh', '#!/bin/sh\nexit 1\n')
+		self.Configure(cmd)
+		clock = Clock()
+		starts = []
+
+		def Supervise():
+			with contextlib.redirect_stdout(io.StringIO()):
+				pijuice_sys._SuperviseWorkers()
+			w = pijuice_sys.userWorkers[FUNC]
+			if w['proc'] is not None and (not starts or starts[-1] != w['started']):
+				starts.append(w['started'])
+				return w['proc']
+			return None
+
+		with mock.patch.object(pijuice_sys, 'time', clock):
+			for i in range(400):
+				proc = Supervise()
+				if proc is not None:
+					proc.wait()
+				clock.Advance(0.5)
+			gaps = [b - a for a, b in zip(starts, starts[1:])]
+			self.assertEqual(gaps, [1, 2, 4, 8, 16, 32, 60, 60])
+
+			# worker that keeps running for longer than the longest delay is stable again
+			self.Script('worker.sh', '#!/bin/sh\nexec cat > /dev/null\n')
+			clock.Advance(60)
+			proc = Supervise()
+			self.assertIsNotNone(proc)
+			clock.Advance(61)
+			Supervise()
+			self.assertEqual(pijuice_sys.userWorkers[FUNC]['restarts'], 0)
+
+			self.Script('worker.sh', '#!/bin/sh\nexit 1\n')
+			proc.kill()
+			proc.wait()
+			del starts[:]
+			for i in range(8):
+				p = Supervise()
+				if p is not None:
+					p.wait()
+				clock.Advance(0.5)
+			self.assertEqual([b - a for a, b in zip(starts, starts[1:])], [1, 2])
+
+	def testStopProcessGroup(self):
+		# ignored signals stay ignored in the children, only SIGKILL stops them
+		cmd = self.Script('worker.sh', '#!/bin/sh\ntrap "" TERM\nsleep 1000 &\n'
+			'while :; do sleep 1; done\n')
+		self.Configure(cmd)
+		stdout = io.StringIO()
+		with mock.patch.object(pijuice_sys, 'WORKER_STOP_TIMEOUT', 0.5), contextlib.redirect_stdout(stdout):
+			pijuice_sys._SuperviseWorkers()
+			pgid = pijuice_sys.userWorkers[FUNC]['proc'].pid
+			time.sleep(0.2)
+			self.assertEqual(os.getpgid(pgid), pgid)
+			pijuice_sys._StopWorker(FUNC)
+		self.assertNotIn('did not stop', stdout.getvalue())
+		self.assertNotIn(FUNC, pijuice_sys.userWorkers)
+		# orphaned children are reaped by init, give it a moment
+		end = time.time() + 5
+		while time.time() < end:
+			try:
+				os.killpg(pgid, 0)
+			except ProcessLookupError:
+				break
+			time.sleep(0.05)
+		self.assertRaises(ProcessLookupError, os.killpg, pgid, 0)
+
+if __name__ == '__main__':
+	unittest.main()
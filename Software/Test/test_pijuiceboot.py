@@ -0,0 +1,544 @@
+#!/usr/bin/env python3
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# Usage:
+# Host check of pijuiceboot.py against an emulated STM32 system memory bootloader. UART boards
+# sit on the far end of a pseudo terminal and are opened by the script through pyserial, I2C
+# boards stand in for the /dev/i2c-N calls. The emulated flash only clears bits on a write, so
+# a page that wasn't erased fails the read back. Busy times for programming and erase, and the
+# bus byte times, are taken from the STM32F030 datasheet, 100kHz I2C and 115200 baud.
+#	python3 test_pijuiceboot.py
+# Flashing time of an older pijuiceboot.py (i2c only) against this one, on the same I2C board:
+#	PIJUICEBOOT_OLD=./pijuiceboot_old.py python3 test_pijuiceboot.py TestFlashTime
+
+import contextlib
+import errno
+import io
+import os
+import random
+import select
+import sys
+import tempfile
+import threading
+import time
+import tty
+import types
+import unittest
+from unittest import mock
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+
+import pijuiceboot as boot
+
+try:
+	import serial
+except ImportError:
+	serial = None
+
+CONFIG_OFFSET = boot.CONFIG_START_ADDRESS - boot.EEPROM_START_ADDRESS
+
+ACK = boot.ACK
+NACK = boot.NACK
+
+# Bus and flash timing [s]
+I2C_BYTE_TIME = 9 / 100000.0
+UART_BYTE_TIME = 11 / 115200.0
+PAGE_WRITE_TIME = 128 * 53.5e-6 # 256 bytes, half word programming
+PAGE_ERASE_TIME = 0.03
+MASS_ERASE_TIME = 0.03
+
+def Image(size, gap, seed=1):
+	# Firmware with an erased run in the middle, as the linker leaves between sections
+	rnd = random.Random(seed)
+	body = bytes(rnd.getrandbits(8) for _ in range(size))
+	at = size // 2
+	return body[:at] + b'\xff' * gap + body[at + gap:]
+
+class Stm32Bootloader:
+	# Command handling of the system memory bootloader (AN3155 UART, AN4221 I2C) on a 256KB
+	# flash. Bytes go in with Feed as they arrive, answers come out of Take once any busy time
+	# is over.
+	def __init__(self, splitErase, config=b'', timed=False):
+		self.splitErase = splitErase
+		self.flash = bytearray(b'\xff' * boot.EEPROM_SIZE)
+		self.flash[CONFIG_OFFSET:CONFIG_OFFSET + len(config)] = config
+		self.pageWriteTime = PAGE_WRITE_TIME if timed else 0.0005
+		self.pageEraseTime = PAGE_ERASE_TIME if timed else 0.001
+		self.massEraseTime = MASS_ERASE_TIME if timed else 0.001
+		self.stuckPages = set() # write pages where a bit doesn't take
+		self.lock = threading.Lock()
+		self.Reset(True)
+
+	def Reset(self, inBootloader):
+		with self.lock:
+			self.running = not inBootloader
+			self.synced = False
+			self.state = 'cmd'
+			self.frame = bytearray()
+			self.out = bytearray()
+			self.busyUntil = 0.0
+			self.goAddress = None
+			self.counts = {'write': 0, 'read': 0, 'erase': 0, 'mass': 0, 'nack': 0}
+
+	def Busy(self):
+		return time.monotonic() < self.busyUntil
+
+	def Feed(self, data):
+		with self.lock:
+			if self.running:
+				return
+			for b in data:
+				self.frame.append(b)
+				need = self.FrameSize()
+				if need != None and len(self.frame) >= need:
+					frame = bytes(self.frame)
+					self.frame.clear()
+					self.Handle(frame)
+
+	def Take(self, size=None):
+		with self.lock:
+			if self.Busy():
+				return b''
+			size = len(self.out) if size == None else size
+			data = bytes(self.out[:size])
+			del self.out[:size]
+			return data
+
+	def FrameSize(self):
+		f = self.frame
+		if self.state == 'cmd':
+			return 1 if (f[0] == 0x7F and not self.splitErase and not self.synced) else 2
+		if self.state == 'addr':
+			return 5
+		if self.state == 'count':
+			return 2
+		if self.state == 'data':
+			return f[0] + 3
+		if self.state == 'erase':
+			if self.splitErase or f[0] == 0xFF:
+				return 3
+			if len(f) < 2:
+				return None
+			return 2 + 2 * (((f[0] << 8) | f[1]) + 1) + 1
+		if self.state == 'pages':
+			return 2 * self.eraseCount + 1
+		return None
+
+	def Answer(self, ok):
+		self.out.append(ACK if ok else NACK)
+		if not ok:
+			self.counts['nack'] += 1
+			self.state = 'cmd'
+		return ok
+
+	def Handle(self, f):
+		if self.state == 'cmd':
+			if len(f) == 1:
+				# Baud rate sync
+				self.synced = True
+				self.out.append(ACK)
+			elif self.Answer(f[1] == f[0] ^ 0xFF and f[0] in (0x00, 0x11, 0x21, 0x31, 0x44)):
+				self.cmd = f[0]
+				if f[0] == 0x00:
+					self.out += bytes([11, 0x31, 0x00, 0x01, 0x02, 0x11, 0x21, 0x31, 0x44, 0x63, 0x73, 0x82, 0x92, ACK])
+				else:
+					self.state = 'erase' if f[0] == 0x44 else 'addr'
+		elif self.state == 'addr':
+			addr = int.from_bytes(f[0:4], 'big')
+			self.offset = addr - boot.EEPROM_START_ADDRESS
+			if self.Answer(f[4] == f[0] ^ f[1] ^ f[2] ^ f[3] and 0 <= self.offset < boot.EEPROM_SIZE):
+				if self.cmd == 0x21:
+					self.goAddress = addr
+					self.running = True
+					self.state = 'cmd'
+				else:
+					self.state = 'count' if self.cmd == 0x11 else 'data'
+		elif self.state == 'count':
+			if self.Answer(f[1] == f[0] ^ 0xFF):
+				self.out += self.flash[self.offset:self.offset + f[0] + 1]
+				self.counts['read'] += 1
+				self.state = 'cmd'
+		elif self.state == 'data':
+			n = f[0] + 1
+			cs = 0
+			for b in f[:n + 1]:
+				cs ^= b
+			if self.Answer(cs == f[n + 1] and self.offset + n <= boot.EEPROM_SIZE):
+				for i in range(n):
+					self.flash[self.offset + i] &= f[1 + i]
+				if (self.offset // boot.WRITE_PAGE_SIZE) in self.stuckPages:
+					self.flash[self.offset] = f[1] ^ 0x01
+				self.counts['write'] += 1
+				self.busyUntil = time.monotonic() + self.pageWriteTime * n / boot.WRITE_PAGE_SIZE
+				self.state = 'cmd'
+		elif self.state == 'erase':
+			if f[0] == 0xFF and f[1] == 0xFF:
+				if self.Answer(f[2] == 0x00):
+					self.flash[:] = b'\xff' * len(self.flash)
+					self.counts['mass'] += 1
+					self.busyUntil = time.monotonic() + self.massEraseTime
+					self.state = 'cmd'
+			elif self.splitErase:
+				if self.Answer(f[2] == f[0] ^ f[1]):
+					self.eraseCount = ((f[0] << 8) | f[1]) + 1
+					self.state = 'pages'
+			else:
+				self.Erase(f[2:-1], f[:-1], f[-1])
+		elif self.state == 'pages':
+			self.Erase(f[:-1], f[:-1], f[-1])
+
+	def Erase(self, pages, covered, checksum):
+		cs = 0
+		for b in covered:
+			cs ^= b
+		if self.Answer(cs == checksum):
+			for i in range(0, len(pages), 2):
+				p = (pages[i] << 8) | pages[i + 1]
+				self.flash[p * boot.ERASE_PAGE_SIZE:(p + 1) * boot.ERASE_PAGE_SIZE] = b'\xff' * boot.ERASE_PAGE_SIZE
+			self.counts['erase'] += len(pages) // 2
+			self.busyUntil = time.monotonic() + self.pageEraseTime * (len(pages) // 2)
+			self.state = 'cmd'
+
+class PtyBoard(threading.Thread):
+	# UART board, the bootloader answers on the master side of a pseudo terminal and the script
+	# opens the slave side by name. Bytes are paced at the baud rate.
+	def __init__(self, model, byteTime=0.0):
+		threading.Thread.__init__(self, daemon=True)
+		self.model = model
+		self.byteTime = byteTime
+		self.master, self.slave = os.openpty()
+		tty.setraw(self.slave)
+		self.port = os.ttyname(self.slave)
+		self.stop = False
+		self.start()
+
+	def run(self):
+		while not self.stop:
+			ready = select.select([self.master], [], [], 0.0005)[0]
+			if ready:
+				try:
+					data = os.read(self.master, 4096)
+				except OSError:
+					data = b''
+				time.sleep(len(data) * self.byteTime)
+				self.model.Feed(data)
+			out = self.model.Take()
+			if out:
+				time.sleep(len(out) * self.byteTime)
+				os.write(self.master, out)
+
+	def Close(self):
+		self.stop = True
+		self.join()
+		os.close(self.master)
+		os.close(self.slave)
+
+class I2cBus:
+	# Stands in for the os calls pijuiceboot makes on /dev/i2c-N, each read and write is one
+	# transfer to the bootloader address. While the bootloader is busy it either stretches the
+	# clock or doesn't answer its address.
+	def __init__(self, models, byteTime=0.0, stretch=True):
+		self.models = models
+		self.byteTime = byteTime
+		self.stretch = stretch
+
+	def __getattr__(self, name):
+		return getattr(os, name)
+
+	def open(self, path, flags=0):
+		return 1000 + int(path.split('-')[-1])
+
+	def close(self, fd):
+		pass
+
+	def Model(self, fd):
+		return self.models[fd - 1000]
+
+	def Transfer(self, model, size):
+		time.sleep((size + 1) * self.byteTime)
+		if model.running and not model.out:
+			raise OSError(errno.ENXIO, 'no answer')
+		while model.Busy():
+			if not self.stretch:
+				raise OSError(errno.EREMOTEIO, 'busy')
+			time.sleep(0.0002)
+
+	def write(self, fd, data):
+		model = self.Model(fd)
+		self.Transfer(model, len(data))
+		model.Feed(bytes(data))
+		return len(data)
+
+	def read(self, fd, size):
+		model = self.Model(fd)
+		self.Transfer(model, size)
+		data = model.Take(size)
+		if not data:
+			raise OSError(errno.ENXIO, 'no answer')
+		return data
+
+class I2cFile:
+	# The file the older script opens on /dev/i2c-1
+	def __init__(self, bus):
+		self.bus = bus
+
+	def fileno(self):
+		return 1001
+
+	def write(self, data):
+		return self.bus.write(1001, data)
+
+	def read(self, size):
+		return self.bus.read(1001, size)
+
+@contextlib.contextmanager
+def Quiet():
+	# The scripts reconfigure stdout, so not a StringIO
+	with contextlib.redirect_stdout(io.TextIOWrapper(io.BytesIO())):
+		yield
+
+def Opts(data=None, bulkErase=False, dumpConfig=None, loadConfig=None):
+	return {'addr': 0x14, 'start': False, 'bulkErase': bulkErase, 'dumpConfig': dumpConfig,
+		'loadConfig': loadConfig, 'data': data}
+
+def ProgramI2c(models, opts, byteTime=0.0, stretch=True):
+	bus = I2cBus(models, byteTime, stretch)
+	results = {}
+	with mock.patch.object(boot, 'os', bus), mock.patch.object(boot, 'ioctl', lambda *a: None), Quiet():
+		links = [boot.I2cLink(n) for n in models]
+		threads = [threading.Thread(target=boot.Program, args=(link, opts, results)) for link in links]
+		for t in threads:
+			t.start()
+		for t in threads:
+			t.join()
+	return results
+
+def PtyParity():
+	# Linux ptys refuse a tcsetattr with even parity once open, the bytes carry no parity anyway
+	return mock.patch.object(serial, 'PARITY_EVEN', serial.PARITY_NONE)
+
+def ProgramUart(boards, opts):
+	results = {}
+	with PtyParity(), Quiet():
+		links = [boot.UartLink(b.port) for b in boards]
+		threads = [threading.Thread(target=boot.Program, args=(link, opts, results)) for link in links]
+		for t in threads:
+			t.start()
+		for t in threads:
+			t.join()
+	return results
+
+CONFIG = bytes(random.Random(9).getrandbits(8) for _ in range(300))
+
+class TestBootloaderI2c(unittest.TestCase):
+
+	def CheckFlashed(self, model, fw, config=CONFIG):
+		self.assertEqual(bytes(model.flash[:len(fw)]), fw)
+		self.assertEqual(bytes(model.flash[CONFIG_OFFSET:CONFIG_OFFSET + len(config)]), config)
+		self.assertEqual(model.goAddress, boot.EEPROM_START_ADDRESS)
+
+	def test_flash(self):
+		fw = Image(20000, 3000)
+		for stretch in (True, False):
+			model = Stm32Bootloader(True, CONFIG)
+			model.flash[:30000] = bytes(random.Random(2).getrandbits(8) for _ in range(30000)) # old firmware
+			results = ProgramI2c({1: model}, Opts(fw), stretch=stretch)
+			self.assertEqual(results['i2c-1'][0], 'OK')
+			self.CheckFlashed(model, fw)
+			pages = [fw[i:i + boot.WRITE_PAGE_SIZE] for i in range(0, len(fw), boot.WRITE_PAGE_SIZE)]
+			self.assertEqual(model.counts['write'], sum(1 for p in pages if p.count(0xFF) != len(p)))
+			self.assertEqual(model.counts['erase'], (len(fw) + boot.ERASE_PAGE_SIZE - 1) // boot.ERASE_PAGE_SIZE)
+			self.assertEqual(model.counts['nack'], 0)
+
+	def test_bulk_erase(self):
+		fw = Image(20000, 3000)
+		model = Stm32Bootloader(True, CONFIG)
+		model.flash[0x20000:0x21000] = b'\x00' * 0x1000 # left over past the image
+		results = ProgramI2c({1: model}, Opts(fw, bulkErase=True))
+		self.assertEqual(results['i2c-1'][0], 'OK')
+		self.CheckFlashed(model, fw)
+		self.assertEqual(model.counts['mass'], 1)
+		self.assertEqual(bytes(model.flash[0x20000:0x21000]), b'\xff' * 0x1000)
+
+	def test_parallel_buses(self):
+		fw = Image(12000, 2500)
+		models = {n: Stm32Bootloader(True, CONFIG) for n in (1, 3, 4)}
+		results = ProgramI2c(models, Opts(fw))
+		self.assertEqual(sorted(results), ['i2c-1', 'i2c-3', 'i2c-4'])
+		for n in models:
+			self.assertEqual(results['i2c-%d' % n][0], 'OK')
+			self.CheckFlashed(models[n], fw)
+
+	def test_verify_fails(self):
+		fw = Image(12000, 0)
+		model = Stm32Bootloader(True, CONFIG)
+		model.stuckPages.add(20)
+		results = ProgramI2c({1: model}, Opts(fw))
+		self.assertEqual(results['i2c-1'][0], -9)
+		self.assertEqual(model.goAddress, None)
+
+	def test_config(self):
+		model = Stm32Bootloader(True, CONFIG)
+		fw = Image(12000, 0)
+		model.flash[:len(fw)] = fw
+		fd, path = tempfile.mkstemp(suffix='.bin')
+		os.close(fd)
+		try:
+			results = ProgramI2c({1: model}, Opts(dumpConfig=path))
+			self.assertEqual(results['i2c-1'][0], 'OK')
+			with open(path, 'rb') as f:
+				self.assertEqual(f.read(), CONFIG)
+		finally:
+			os.remove(path)
+		newConfig = bytes(random.Random(10).getrandbits(8) for _ in range(2100))
+		model.Reset(True)
+		results = ProgramI2c({1: model}, Opts(loadConfig=newConfig))
+		self.assertEqual(results['i2c-1'][0], 'OK')
+		self.CheckFlashed(model, fw, newConfig)
+
+	def test_no_bootloader(self):
+		model = Stm32Bootloader(True, CONFIG)
+		model.Reset(False)
+		with mock.patch.object(boot, 'START_TIMEOUT', 0.1):
+			results = ProgramI2c({1: model}, Opts(Image(4000, 0)))
+		self.assertEqual(results['i2c-1'][0], -1)
+
+@unittest.skipUnless(serial, 'needs pyserial')
+class TestBootloaderUart(unittest.TestCase):
+
+	def setUp(self):
+		self.boards = []
+
+	def tearDown(self):
+		for b in self.boards:
+			b.Close()
+
+	def Board(self, inBootloader=True):
+		model = Stm32Bootloader(False, CONFIG)
+		model.Reset(inBootloader)
+		self.boards.append(PtyBoard(model))
+		return self.boards[-1]
+
+	def test_flash(self):
+		fw = Image(16000, 3000)
+		for bulkErase in (False, True):
+			b = self.Board()
+			results = ProgramUart([b], Opts(fw, bulkErase))
+			self.assertEqual(results[b.port][0], 'OK')
+			self.assertEqual(bytes(b.model.flash[:len(fw)]), fw)
+			self.assertEqual(bytes(b.model.flash[CONFIG_OFFSET:CONFIG_OFFSET + len(CONFIG)]), CONFIG)
+			self.assertEqual(b.model.goAddress, boot.EEPROM_START_ADDRESS)
+			self.assertEqual(b.model.counts['nack'], 0)
+
+	def test_parallel_ports(self):
+		fw = Image(10000, 2000)
+		boards = [self.Board() for _ in range(3)]
+		results = ProgramUart(boards, Opts(fw))
+		for b in boards:
+			self.assertEqual(results[b.port][0], 'OK')
+			self.assertEqual(bytes(b.model.flash[:len(fw)]), fw)
+
+	def test_gpio_pairs(self):
+		self.assertEqual(boot.GpioPairs(None, 1), [boot.DEFAULT_GPIO_PAIR])
+		self.assertEqual(boot.GpioPairs('--bulk_erase', 1), [boot.DEFAULT_GPIO_PAIR])
+		self.assertEqual(boot.GpioPairs(None, 2), None)
+		self.assertEqual(boot.GpioPairs('10:6,20:21', 2), [(10, 6), (20, 21)])
+		self.assertEqual(boot.GpioPairs('10:6', 2), None)
+		self.assertEqual(boot.GpioPairs('10:6,10:21', 2), None)
+		self.assertEqual(boot.GpioPairs('10:6,20', 2), None)
+		self.assertEqual(boot.GpioPairs('10:6,x:21', 2), None)
+
+	def RunMain(self, boards, gpio, fw):
+		# Boards start in the application and only enter the bootloader when their own reset
+		# gpio rises with their BOOT0 gpio high
+		levels = {}
+		def System(cmd):
+			w = cmd.split()
+			if w[:3] == ['gpio', '-g', 'write']:
+				pin, level = int(w[3]), int(w[4])
+				rising = level == 1 and levels.get(pin, 1) == 0
+				levels[pin] = level
+				for (bootPin, resetPin), b in zip(pairs, boards):
+					if pin == resetPin and rising and levels.get(bootPin) == 1:
+						b.model.Reset(True)
+			return 0
+		pairs = boot.GpioPairs(gpio, len(boards)) or [boot.DEFAULT_GPIO_PAIR]
+		fd, path = tempfile.mkstemp(suffix='.binary')
+		with os.fdopen(fd, 'wb') as f:
+			f.write(fw)
+		argv = ['pijuiceboot.py', '14', path, '--uart', ','.join(b.port for b in boards), '--gpio_reset']
+		if gpio != None:
+			argv.append(gpio)
+		try:
+			with mock.patch.object(sys, 'argv', argv), mock.patch.object(boot.os, 'system', System), PtyParity(), Quiet():
+				with self.assertRaises(SystemExit) as e:
+					boot.main()
+		finally:
+			os.remove(path)
+		return e.exception.code
+
+	def test_gpio_reset_each_board(self):
+		fw = Image(6000, 0)
+		boards = [self.Board(False) for _ in range(2)]
+		self.assertEqual(self.RunMain(boards, '10:6,20:21', fw), 0)
+		for b in boards:
+			self.assertEqual(bytes(b.model.flash[:len(fw)]), fw)
+			self.assertEqual(b.model.goAddress, boot.EEPROM_START_ADDRESS)
+
+	def test_gpio_reset_refused(self):
+		boards = [self.Board(False) for _ in range(2)]
+		self.assertEqual(self.RunMain(boards, None, Image(6000, 0)), -1)
+		for b in boards:
+			self.assertTrue(b.model.running)
+
+def RunOldScript(path, model, argv):
+	# The older script is i2c only and runs at module level, its /dev/i2c-1 file, the ioctl and
+	# smbus are replaced
+	bus = I2cBus({1: model}, I2C_BYTE_TIME)
+	with open(path) as f:
+		src = f.read()
+	def Open(name, *args, **kwargs):
+		return I2cFile(bus) if name.startswith('/dev/i2c') else open(name, *args, **kwargs)
+	fakeModules = {'smbus': types.SimpleNamespace(SMBus=None), 'fcntl': types.SimpleNamespace(ioctl=lambda *a: None)}
+	ns = {'__name__': '__main__', 'open': Open}
+	with mock.patch.dict(sys.modules, fakeModules), mock.patch.object(sys, 'argv', argv), Quiet():
+		try:
+			exec(compile(src, path, 'exec'), ns)
+		except SystemExit:
+			pass
+
+@unittest.skipUnless(os.environ.get('PIJUICEBOOT_OLD'), 'set PIJUICEBOOT_OLD to an older pijuiceboot.py')
+class TestFlashTime(unittest.TestCase):
+
+	def test_time(self):
+		fw = Image(56000, 4000)
+		fd, path = tempfile.mkstemp(suffix='.binary')
+		with os.fdopen(fd, 'wb') as f:
+			f.write(fw)
+		try:
+			for bulkErase in (False, True):
+				model = Stm32Bootloader(True, CONFIG, timed=True)
+				argv = ['pijuiceboot.py', '14', path, '--no_start'] + (['--bulk_erase'] if bulkErase else [])
+				t = time.monotonic()
+				RunOldScript(os.environ['PIJUICEBOOT_OLD'], model, argv)
+				old = time.monotonic() - t
+				self.assertEqual(bytes(model.flash[:len(fw)]), fw)
+
+				model = Stm32Bootloader(True, CONFIG, timed=True)
+				t = time.monotonic()
+				results = ProgramI2c({1: model}, Opts(fw, bulkErase), byteTime=I2C_BYTE_TIME)
+				new = time.monotonic() - t
+				self.assertEqual(results['i2c-1'][0], 'OK')
+				self.assertEqual(bytes(model.flash[:len(fw)]), fw)
+				print('\n%d byte image, %s erase: old %.1fs, new %.1fs' %
+					(len(fw), 'bulk' if bulkErase else 'page', old, new))
+				self.assertLess(new, old)
+		finally:
+			os.remove(path)
+
+if __name__ == '__main__':
+	unittest.main()
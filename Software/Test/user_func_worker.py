@@ -0,0 +1,25 @@
+#!/usr/bin/python3
+
+# Persistent user function, started once by pijuice_sys.py with argument 'worker'
+# when its USER_FUNC is listed in "user_functions_persistent" of pijuice_config.JSON.
+# Events arrive on stdin one JSON object per line, EOF means service stopped.
+
+import sys
+import json
+import logging
+
+logger = logging.getLogger('user_func_worker')
+hdlr = logging.FileHandler('/home/pi/user_func_worker.log')
+formatter = logging.Formatter('%(asctime)s %(levelname)s %(message)s')
+hdlr.setFormatter(formatter)
+logger.addHandler(hdlr) 
+logger.setLevel(logging.INFO)
+
+logger.info('started ' + str(sys.argv))
+
+for line in sys.stdin:
+	try:
+		ev = json.loads(line)
+	except ValueError:
+		continue
+	logger.info(ev['event'] + ' ' + ev['param'])